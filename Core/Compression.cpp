@@ -0,0 +1,311 @@
+#include "pch.h"
+#include "Compression.h"
+#include <cstring>
+
+namespace Compression
+{
+    // LZ4 block format: a sequence is a token (literal length << 4 | match length - kMinMatch), the literal length's
+    // extra bytes, the literals, a 16-bit little-endian match offset and the match length's extra bytes. The last
+    // sequence has literals only. The last match must start kLastMatchStart bytes before the end and stop
+    // kLastLiterals bytes before it.
+    const uint32_t kMinMatch = 4;
+    const uint32_t kMaxOffset = 65535;
+    const uint32_t kLastLiterals = 5;
+    const uint32_t kLastMatchStart = 12;
+    const uint32_t kHashBits = 14;
+
+    static inline uint32_t Read32(const uint8_t* p)
+    {
+        uint32_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    static inline uint32_t HashSequence(uint32_t sequence)
+    {
+        return (sequence * 2654435761u) >> (32 - kHashBits);
+    }
+
+    static inline uint8_t* WriteLength(uint8_t* op, size_t length)
+    {
+        for (; length >= 255; length -= 255)
+            *op++ = 255;
+        *op++ = (uint8_t)length;
+        return op;
+    }
+
+    static uint8_t* WriteSequence(uint8_t* op, const uint8_t* literals, size_t literalLength, uint32_t offset, size_t matchLength)
+    {
+        uint8_t* token = op++;
+        *token = (uint8_t)(std::min<size_t>(literalLength, 15) << 4);
+        if (literalLength >= 15)
+            op = WriteLength(op, literalLength - 15);
+        if (literalLength > 0)
+            std::memcpy(op, literals, literalLength);
+        op += literalLength;
+
+        if (matchLength > 0)
+        {
+            *op++ = (uint8_t)offset;
+            *op++ = (uint8_t)(offset >> 8);
+            *token |= (uint8_t)std::min<size_t>(matchLength - kMinMatch, 15);
+            if (matchLength - kMinMatch >= 15)
+                op = WriteLength(op, matchLength - kMinMatch - 15);
+        }
+        return op;
+    }
+
+    size_t LZCompressBound(size_t srcSize)
+    {
+        return srcSize + srcSize / 255 + 16;
+    }
+
+    size_t LZCompress(const uint8_t* src, size_t srcSize, uint8_t* dst)
+    {
+        uint8_t* op = dst;
+        size_t anchor = 0;
+
+        if (srcSize > kLastMatchStart)
+        {
+            std::vector<uint32_t> table(1 << kHashBits, 0);
+            const size_t matchStartLimit = srcSize - kLastMatchStart;
+            const size_t matchEndLimit = srcSize - kLastLiterals;
+
+            size_t ip = 1;
+            uint32_t misses = 0;
+            while (ip < matchStartLimit)
+            {
+                const uint32_t sequence = Read32(src + ip);
+                const uint32_t hash = HashSequence(sequence);
+                size_t ref = table[hash];
+                table[hash] = (uint32_t)ip;
+
+                if (ip - ref > kMaxOffset || Read32(src + ref) != sequence)
+                {
+                    // Skip faster through data that doesn't compress.
+                    ip += 1 + (misses++ >> 6);
+                    continue;
+                }
+                misses = 0;
+
+                while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1])
+                {
+                    --ip;
+                    --ref;
+                }
+
+                size_t matchLength = kMinMatch;
+                while (ip + matchLength < matchEndLimit && src[ref + matchLength] == src[ip + matchLength])
+                    ++matchLength;
+
+                op = WriteSequence(op, src + anchor, ip - anchor, (uint32_t)(ip - ref), matchLength);
+                ip += matchLength;
+                anchor = ip;
+
+                // Seed the table inside the match so that the next search can find its tail.
+                if (ip - 2 < matchStartLimit)
+                    table[HashSequence(Read32(src + ip - 2))] = (uint32_t)(ip - 2);
+            }
+        }
+
+        op = WriteSequence(op, src + anchor, srcSize - anchor, 0, 0);
+        return op - dst;
+    }
+
+    static inline bool ReadLength(const uint8_t*& ip, const uint8_t* srcEnd, size_t& length)
+    {
+        uint8_t byte;
+        do
+        {
+            if (ip == srcEnd)
+                return false;
+            byte = *ip++;
+            length += byte;
+        } while (byte == 255);
+        return true;
+    }
+
+    bool LZDecompress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize)
+    {
+        const uint8_t* ip = src;
+        const uint8_t* const srcEnd = src + srcSize;
+        uint8_t* op = dst;
+        uint8_t* const dstEnd = dst + dstSize;
+
+        while (ip < srcEnd)
+        {
+            const uint8_t token = *ip++;
+
+            size_t literalLength = token >> 4;
+            if (literalLength == 15 && !ReadLength(ip, srcEnd, literalLength))
+                return false;
+            if (literalLength > (size_t)(srcEnd - ip) || literalLength > (size_t)(dstEnd - op))
+                return false;
+            std::memcpy(op, ip, literalLength);
+            ip += literalLength;
+            op += literalLength;
+
+            // The last sequence ends after its literals.
+            if (ip == srcEnd)
+                break;
+
+            if (srcEnd - ip < 2)
+                return false;
+            const size_t offset = ip[0] | (size_t)ip[1] << 8;
+            ip += 2;
+            if (offset == 0 || offset > (size_t)(op - dst))
+                return false;
+
+            size_t matchLength = token & 15;
+            if (matchLength == 15 && !ReadLength(ip, srcEnd, matchLength))
+                return false;
+            matchLength += kMinMatch;
+            if (matchLength > (size_t)(dstEnd - op))
+                return false;
+
+            const uint8_t* match = op - offset;
+            if (offset >= matchLength)
+            {
+                std::memcpy(op, match, matchLength);
+                op += matchLength;
+            }
+            else if (offset == 1)
+            {
+                std::memset(op, *match, matchLength);
+                op += matchLength;
+            }
+            else
+            {
+                // Overlapping matches repeat the last offset bytes. Eight bytes at a time are safe when the source
+                // stays at least eight bytes behind.
+                size_t i = 0;
+                if (offset >= 8)
+                {
+                    for (; i + 8 <= matchLength; i += 8)
+                        std::memcpy(op + i, match + i, 8);
+                }
+                for (; i < matchLength; ++i)
+                    op[i] = match[i];
+                op += matchLength;
+            }
+        }
+
+        return op == dstEnd;
+    }
+
+    void Shuffle(const uint8_t* src, size_t size, uint32_t stride, uint8_t* dst)
+    {
+        const size_t count = stride > 0 ? size / stride : 0;
+        for (uint32_t b = 0; b < stride; ++b)
+        {
+            uint8_t* plane = dst + b * count;
+            for (size_t e = 0; e < count; ++e)
+                plane[e] = src[e * stride + b];
+        }
+        std::memcpy(dst + count * stride, src + count * stride, size - count * stride);
+    }
+
+    void Unshuffle(const uint8_t* src, size_t size, uint32_t stride, uint8_t* dst)
+    {
+        const size_t count = stride > 0 ? size / stride : 0;
+        for (uint32_t b = 0; b < stride; ++b)
+        {
+            const uint8_t* plane = src + b * count;
+            for (size_t e = 0; e < count; ++e)
+                dst[e * stride + b] = plane[e];
+        }
+        std::memcpy(dst + count * stride, src + count * stride, size - count * stride);
+    }
+
+    std::vector<uint8_t> CompressChunked(const uint8_t* src, size_t rawSize, const std::vector<uint32_t>& shuffleStrides)
+    {
+        const uint32_t numChunks = GetChunkCount(rawSize);
+        std::vector<uint8_t> stream(numChunks * sizeof(ChunkDesc));
+        std::vector<uint8_t> shuffled(kChunkSize);
+        std::vector<uint8_t> candidate(LZCompressBound(kChunkSize));
+        std::vector<uint8_t> best(LZCompressBound(kChunkSize));
+
+        for (uint32_t chunkIdx = 0; chunkIdx < numChunks; ++chunkIdx)
+        {
+            const uint8_t* chunk = src + (size_t)chunkIdx * kChunkSize;
+            const size_t chunkSize = std::min<size_t>(kChunkSize, rawSize - (size_t)chunkIdx * kChunkSize);
+
+            ChunkDesc desc = {};
+            desc.offset = (uint32_t)stream.size();
+            desc.size = (uint32_t)chunkSize;
+            desc.method = kStoredChunk;
+
+            for (uint32_t stride : shuffleStrides)
+            {
+                if (stride > 255 || stride >= chunkSize)
+                    continue;
+
+                const uint8_t* input = chunk;
+                if (stride > 1)
+                {
+                    Shuffle(chunk, chunkSize, stride, shuffled.data());
+                    input = shuffled.data();
+                }
+
+                const size_t size = LZCompress(input, chunkSize, candidate.data());
+                if (size < desc.size)
+                {
+                    desc.size = (uint32_t)size;
+                    desc.method = kLZChunk;
+                    desc.shuffleStride = (uint8_t)(stride > 1 ? stride : 0);
+                    best.swap(candidate);
+                }
+            }
+
+            const uint8_t* payload = desc.method == kLZChunk ? best.data() : chunk;
+            stream.insert(stream.end(), payload, payload + desc.size);
+            std::memcpy(stream.data() + chunkIdx * sizeof(ChunkDesc), &desc, sizeof(ChunkDesc));
+        }
+
+        return stream;
+    }
+
+    bool DecompressChunk(const uint8_t* stream, size_t streamSize, size_t rawSize, uint32_t chunkIdx, uint8_t* dst)
+    {
+        const uint32_t numChunks = GetChunkCount(rawSize);
+        if (chunkIdx >= numChunks || streamSize < numChunks * sizeof(ChunkDesc))
+            return false;
+
+        ChunkDesc desc;
+        std::memcpy(&desc, stream + chunkIdx * sizeof(ChunkDesc), sizeof(ChunkDesc));
+        if ((uint64_t)desc.offset + desc.size > streamSize)
+            return false;
+
+        const uint8_t* payload = stream + desc.offset;
+        const size_t chunkSize = std::min<size_t>(kChunkSize, rawSize - (size_t)chunkIdx * kChunkSize);
+        uint8_t* out = dst + (size_t)chunkIdx * kChunkSize;
+
+        if (desc.method == kStoredChunk)
+        {
+            if (desc.size != chunkSize)
+                return false;
+            std::memcpy(out, payload, chunkSize);
+            return true;
+        }
+
+        if (desc.method != kLZChunk)
+            return false;
+
+        // Matches read back what was just decoded, which would be slow from write-combined memory. Decode into
+        // cached scratch memory instead and copy the result out once.
+        thread_local std::vector<uint8_t> decoded, unshuffled;
+        decoded.resize(kChunkSize);
+        if (!LZDecompress(payload, desc.size, decoded.data(), chunkSize))
+            return false;
+
+        const uint8_t* result = decoded.data();
+        if (desc.shuffleStride > 1)
+        {
+            unshuffled.resize(kChunkSize);
+            Unshuffle(decoded.data(), chunkSize, desc.shuffleStride, unshuffled.data());
+            result = unshuffled.data();
+        }
+        std::memcpy(out, result, chunkSize);
+        return true;
+    }
+}
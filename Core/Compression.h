@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Fast lossless compression for asset sections. The codec is a greedy LZ77 that writes the LZ4 block format, so it
+// decodes at memory speed. Before compression, a chunk may be byte-shuffled: for an array of fixed-size elements,
+// byte k of every element is gathered together, which lines up the slowly varying exponent and high mantissa bytes
+// of vertex attributes into long runs the LZ stage can match.
+namespace Compression
+{
+    // Worst-case output size of LZCompress for srcSize bytes.
+    size_t LZCompressBound(size_t srcSize);
+
+    // Compresses srcSize bytes into dst, which must hold LZCompressBound(srcSize) bytes. Returns the compressed size.
+    size_t LZCompress(const uint8_t* src, size_t srcSize, uint8_t* dst);
+
+    // Returns false unless src is well formed and decodes to exactly dstSize bytes. Never reads or writes out of
+    // bounds, whatever the input.
+    bool LZDecompress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize);
+
+    // Treats src as size / stride elements of stride bytes and writes byte k of every element contiguously. Trailing
+    // bytes that don't fill an element are copied unchanged.
+    void Shuffle(const uint8_t* src, size_t size, uint32_t stride, uint8_t* dst);
+    void Unshuffle(const uint8_t* src, size_t size, uint32_t stride, uint8_t* dst);
+
+    // Chunked streams let a section be decoded in parallel, one chunk per task. A stream starts with a table of
+    // GetChunkCount(rawSize) ChunkDesc entries, followed by the chunk payloads. Every chunk but the last decodes to
+    // kChunkSize bytes.
+    const uint32_t kChunkSize = 256 * 1024;
+
+    enum ChunkMethod : uint8_t
+    {
+        kStoredChunk,
+        kLZChunk,
+    };
+
+    struct ChunkDesc
+    {
+        uint32_t offset;        // From the start of the stream
+        uint32_t size;
+        uint8_t  method;        // ChunkMethod
+        uint8_t  shuffleStride; // 0 when not shuffled
+        uint16_t reserved;
+    };
+
+    inline uint32_t GetChunkCount(size_t rawSize) { return (uint32_t)((rawSize + kChunkSize - 1) / kChunkSize); }
+
+    // Compresses src as a chunked stream. Each chunk tries every stride in shuffleStrides (0 for no shuffle) and
+    // keeps whichever compresses smallest, falling back to storing the chunk when compression doesn't pay.
+    std::vector<uint8_t> CompressChunked(const uint8_t* src, size_t rawSize,
+        const std::vector<uint32_t>& shuffleStrides = std::vector<uint32_t>(1, 0));
+
+    // Decodes chunk chunkIdx of a stream into its place in dst, the start of the whole rawSize-byte output. dst may
+    // be write-combined memory: every byte is written exactly once, in order. Chunks can be decoded concurrently.
+    bool DecompressChunk(const uint8_t* stream, size_t streamSize, size_t rawSize, uint32_t chunkIdx, uint8_t* dst);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <dxgiformat.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Parses DDS headers and finds where each subresource lies in the file. Nothing here touches the file system or
+// Direct3D, so it builds and can be checked on any platform; DDSTextureLoader creates textures from what it returns,
+// reading the subresources straight out of a file mapping.
+namespace DDSLayout
+{
+    enum Result
+    {
+        kOk,
+        kNotDDS,        // No DDS magic number, or headers of the wrong size
+        kInvalidData,   // Headers that contradict themselves
+        kNotSupported,  // A valid file that Direct3D 12 can't create a texture from
+        kTruncated,     // Headers or subresources run past the end of the data
+    };
+
+    // Values of DDS_RESOURCE_DIMENSION and D3D12_RESOURCE_DIMENSION
+    enum Dimension
+    {
+        kTexture1D = 2,
+        kTexture2D = 3,
+        kTexture3D = 4,
+    };
+
+    struct TextureDesc
+    {
+        size_t headerSize;      // Magic number and headers; the first subresource follows
+        Dimension dimension;
+        uint32_t width;
+        uint32_t height;
+        uint32_t depth;         // 1 unless 3D
+        uint32_t arraySize;     // Six per cube for cube maps
+        uint32_t mipCount;
+        DXGI_FORMAT format;
+        bool isCubeMap;
+        uint32_t alphaMode;     // A DDS_ALPHA_MODE
+    };
+
+    // Reads the headers at the start of a DDS file. Only the first headerSize bytes are needed, at most
+    // 4 + 124 + 20.
+    Result ParseHeader(const uint8_t* data, size_t size, TextureDesc& desc);
+
+    struct Subresource
+    {
+        uint64_t offset;        // From the end of the headers
+        uint32_t rowPitch;
+        uint32_t slicePitch;
+    };
+
+    struct Layout
+    {
+        uint32_t width;         // Of the finest mip kept
+        uint32_t height;
+        uint32_t depth;
+        uint32_t mipCount;      // Kept in each array slice
+        uint32_t skipMip;       // Finer mips left out for exceeding the size limit
+        std::vector<Subresource> subresources;  // mipCount of them per array slice, in Direct3D order
+        uint64_t dataSize;      // What must follow the headers for every subresource, kept or not, to be there
+    };
+
+    // Lays out the subresources that follow the headers, leaving out mips with a side larger than maxSize unless
+    // maxSize is 0 or the texture has a single mip.
+    Result GetLayout(const TextureDesc& desc, size_t maxSize, Layout& layout);
+
+    size_t BitsPerPixel(DXGI_FORMAT fmt);
+    bool IsBlockCompressed(DXGI_FORMAT fmt);
+    DXGI_FORMAT MakeSRGB(DXGI_FORMAT format);
+
+    // Bytes in a surface of the given size, in one of its rows and the number of rows (of blocks, for compressed
+    // formats).
+    void GetSurfaceInfo(size_t width, size_t height, DXGI_FORMAT fmt, size_t* outNumBytes, size_t* outRowBytes,
+        size_t* outNumRows);
+}
@@ -56,3 +56,48 @@ HRESULT __cdecl CreateDDSTextureFromFile( _In_ ID3D12Device* d3dDevice,
                                             );
 
 size_t BitsPerPixel(_In_ DXGI_FORMAT fmt);
+
+// Enough of the start of a DDS file for any of its headers.
+const size_t kMaxDDSHeaderSize = 4 + 124 + 20;
+
+// Where the mips of a 2D texture lie in its DDS file, finest first, for loading only some of them.
+struct DDSMipLayout
+{
+    size_t headerSize;      // Magic number and headers; the first mip follows
+    uint32_t width;
+    uint32_t height;
+    uint32_t mipCount;
+    DXGI_FORMAT format;
+    bool blockCompressed;
+    uint64_t mipOffset[D3D12_REQ_MIP_LEVELS];   // From the start of the file
+    uint64_t mipSize[D3D12_REQ_MIP_LEVELS];
+    uint64_t fileSize;      // Where the last mip ends
+
+    // Whether a texture can be created with this mip as its finest. Block compressed textures need their top level
+    // to be whole blocks.
+    bool CanStartAt(uint32_t mip) const
+    {
+        uint32_t w = width >> mip, h = height >> mip;
+        return mip < mipCount && (!blockCompressed || (w > 0 && h > 0 && w % 4 == 0 && h % 4 == 0));
+    }
+};
+
+// Reads the layout from the start of a DDS file, at least kMaxDDSHeaderSize bytes of it unless the file is shorter.
+// Fails unless the file holds a single 2D texture, the only kind whose mips can be loaded separately.
+HRESULT __cdecl GetDDSMipLayout( _In_reads_bytes_(ddsDataSize) const uint8_t* ddsData,
+                                 _In_ size_t ddsDataSize,
+                                 _Out_ DDSMipLayout& layout
+                               );
+
+// Creates a texture from mip firstMip of a DDS file and the coarser ones after it. ddsHeader is the start of the
+// file, as given to GetDDSMipLayout, and mipData the file's contents from the offset of firstMip to its end.
+HRESULT __cdecl CreateDDSTextureFromMips( _In_ ID3D12Device* d3dDevice,
+                                          _In_reads_bytes_(ddsHeaderSize) const uint8_t* ddsHeader,
+                                          _In_ size_t ddsHeaderSize,
+                                          _In_reads_bytes_(mipDataSize) const uint8_t* mipData,
+                                          _In_ size_t mipDataSize,
+                                          _In_ uint32_t firstMip,
+                                          _In_ bool forceSRGB,
+                                          _Outptr_opt_ ID3D12Resource** texture,
+                                          _In_ D3D12_CPU_DESCRIPTOR_HANDLE textureView
+                                        );
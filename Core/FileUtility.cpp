@@ -13,7 +13,14 @@
 
 #include "pch.h"
 #include "FileUtility.h"
+#include <algorithm>
 #include <fstream>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 //#include <zlib.h> // From NuGet package 
 
 using namespace std;
@@ -130,8 +137,104 @@ ByteArray Utility::ReadFileSync( const wstring& fileName)
     return ReadFileHelperEx(make_shared<wstring>(fileName));
 }
 
+#ifdef _WIN32
 task<ByteArray> Utility::ReadFileAsync(const wstring& fileName)
 {
     shared_ptr<wstring> SharedPtr = make_shared<wstring>(fileName);
     return create_task( [=] { return ReadFileHelperEx(SharedPtr); } );
 }
+#endif
+
+bool FileMapping::Open(const wstring& fileName, bool copyOnWrite)
+{
+    Close();
+
+#ifdef _WIN32
+    // Sharing delete access lets a rebuild rename a new file over this one while it is still mapped.
+    m_File = CreateFileW(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (m_File == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(m_File, &fileSize) || fileSize.QuadPart == 0)
+    {
+        Close();
+        return false;
+    }
+
+    // A read-only mapping handle still allows copy-on-write views.
+    m_Mapping = CreateFileMappingW(m_File, nullptr, copyOnWrite ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, nullptr);
+    if (m_Mapping == nullptr)
+    {
+        Close();
+        return false;
+    }
+
+    m_Data = (uint8_t*)MapViewOfFile(m_Mapping, copyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+    m_Size = (size_t)fileSize.QuadPart;
+#else
+    m_File = open(WideStringToUTF8(fileName).c_str(), O_RDONLY);
+    if (m_File == -1)
+        return false;
+
+    struct stat fileStat;
+    if (fstat(m_File, &fileStat) != 0 || fileStat.st_size == 0)
+    {
+        Close();
+        return false;
+    }
+
+    void* data = mmap(nullptr, (size_t)fileStat.st_size, copyOnWrite ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, m_File, 0);
+    m_Data = data == MAP_FAILED ? nullptr : (uint8_t*)data;
+    m_Size = (size_t)fileStat.st_size;
+#endif
+
+    if (m_Data == nullptr)
+    {
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+void FileMapping::Close()
+{
+#ifdef _WIN32
+    if (m_Data != nullptr)
+        UnmapViewOfFile(m_Data);
+    if (m_Mapping != nullptr)
+        CloseHandle(m_Mapping);
+    if (m_File != INVALID_HANDLE_VALUE)
+        CloseHandle(m_File);
+    m_Mapping = nullptr;
+    m_File = INVALID_HANDLE_VALUE;
+#else
+    if (m_Data != nullptr)
+        munmap(m_Data, m_Size);
+    if (m_File != -1)
+        close(m_File);
+    m_File = -1;
+#endif
+    m_Data = nullptr;
+    m_Size = 0;
+}
+
+void FileMapping::Prefetch(size_t offset, size_t size) const
+{
+    if (m_Data == nullptr || offset >= m_Size)
+        return;
+
+    size = std::min(size, m_Size - offset);
+
+#ifdef _WIN32
+    WIN32_MEMORY_RANGE_ENTRY range = { m_Data + offset, size };
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+    // madvise wants a page-aligned start.
+    const size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    const size_t alignedOffset = offset & ~(pageSize - 1);
+    madvise(m_Data + alignedOffset, size + offset - alignedOffset, MADV_WILLNEED);
+#endif
+}
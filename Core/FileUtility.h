@@ -16,12 +16,16 @@
 #include "pch.h"
 #include <vector>
 #include <string>
+#ifdef _WIN32
 #include <ppl.h>
+#endif
 
 namespace Utility
 {
     using namespace std;
+#ifdef _WIN32
     using namespace concurrency;
+#endif
 
     typedef shared_ptr<vector<byte> > ByteArray;
     extern ByteArray NullFile;
@@ -31,7 +35,42 @@ namespace Utility
     // This operation blocks until the entire file is read.
     ByteArray ReadFileSync(const wstring& fileName);
 
+#ifdef _WIN32
     // Same as previous except that it does not block but instead returns a task.
     task<ByteArray> ReadFileAsync(const wstring& fileName);
+#endif
+
+    // Maps an entire file into the address space. Pages are read in on first touch and, being backed by the file
+    // rather than the page file, can be dropped again under memory pressure. A copy-on-write mapping may be written
+    // to; modified pages become private and are never written back to the file.
+    class FileMapping
+    {
+    public:
+        FileMapping() {}
+        ~FileMapping() { Close(); }
+
+        FileMapping(const FileMapping&) = delete;
+        FileMapping& operator=(const FileMapping&) = delete;
+
+        bool Open(const wstring& fileName, bool copyOnWrite = false);
+        void Close();
+
+        bool IsOpen() const { return m_Data != nullptr; }
+        uint8_t* GetData() const { return m_Data; }
+        size_t GetSize() const { return m_Size; }
+
+        // Hints that [offset, offset + size) will soon be read front to back.
+        void Prefetch(size_t offset, size_t size) const;
+
+    private:
+#ifdef _WIN32
+        HANDLE m_File = INVALID_HANDLE_VALUE;
+        HANDLE m_Mapping = nullptr;
+#else
+        int m_File = -1;
+#endif
+        uint8_t* m_Data = nullptr;
+        size_t m_Size = 0;
+    };
 
 } // namespace Utility
@@ -12,7 +12,7 @@
 
 #pragma once
 
-#include "Math/Common.h"
+#include <cstring>
 
 // This requires SSE4.2 which is present on Intel Nehalem (Nov. 2008)
 // and AMD Bulldozer (Oct. 2011) processors.  I could put a runtime
@@ -25,6 +25,7 @@
 #endif
 
 #if ENABLE_SSE_CRC32
+#include "Math/Common.h"
 #pragma intrinsic(_mm_crc32_u32)
 #pragma intrinsic(_mm_crc32_u64)
 #endif
@@ -63,4 +64,28 @@ namespace Utility
         return HashRange((uint32_t*)StateDesc, (uint32_t*)(StateDesc + Count), Hash);
     }
 
+    // A 64-bit hash of arbitrary bytes, for naming files by their contents, where the 32-bit CRC above would collide
+    // too often.  Not cryptographic.
+    inline uint64_t HashBytes64( const void* Data, size_t Size, uint64_t Hash = 0 )
+    {
+        const uint64_t kMul = 0x9E3779B97F4A7C15ull;
+        const uint8_t* Bytes = (const uint8_t*)Data;
+
+        Hash ^= Size * kMul;
+        for (size_t i = 0; i < Size; i += 8)
+        {
+            uint64_t Word = 0;
+            memcpy(&Word, Bytes + i, Size - i < 8 ? Size - i : 8);
+            Word *= 0xBF58476D1CE4E5B9ull;
+            Word ^= Word >> 31;
+            Hash = (Hash ^ Word) * kMul;
+            Hash ^= Hash >> 29;
+        }
+
+        Hash ^= Hash >> 32;
+        Hash *= 0x94D049BB133111EBull;
+        Hash ^= Hash >> 29;
+        return Hash;
+    }
+
 } // namespace Utility
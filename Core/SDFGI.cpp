@@ -17,6 +17,7 @@
 #include "CompiledShaders/SDFGIProbeVizPS.h"
 #include "CompiledShaders/SDFGIProbeVizGS.h"
 #include "CompiledShaders/SDFGIProbeUpdateCS.h"
+#include "CompiledShaders/SDFGIProbeReprojectCS.h"
 #include "CompiledShaders/SDFGIProbeIrradianceDepthVizPS.h"
 #include "CompiledShaders/SDFGIProbeIrradianceDepthVizVS.h"
 #include "CompiledShaders/SDFGIProbeCubemapVizVS.h"
@@ -47,15 +48,15 @@ namespace SDFGI {
     }
 
     // TODO: grid has to be a perfect square.
-    SDFGIProbeGrid::SDFGIProbeGrid(Math::AxisAlignedBox bbox) : sceneBounds(bbox) {
+    SDFGIProbeGrid::SDFGIProbeGrid(Math::AxisAlignedBox bbox, float spacing) : sceneBounds(bbox) {
 #if SCENE_IS_CORNELL_BOX
         sceneBounds.SetMin(Vector3(-400, 80, -400));
         //sceneBounds.SetMin(Vector3(-160, 350, -350));
         //sceneBounds.SetMin(Vector3(-160, 355, -300));
 
-        float spacing = 800.0f;
+        if (spacing <= 0.0f) spacing = 800.0f;
 #else
-        float spacing = 100.0f;
+        if (spacing <= 0.0f) spacing = 100.0f;
 #endif
         probeSpacing[0] = spacing;
         probeSpacing[1] = spacing;
@@ -125,8 +126,10 @@ namespace SDFGI {
         InitializeTextures();
         InitializeViews();
         InitializeProbeBuffer();
+        InitializeProbeTiles();
         InitializeProbeVizShader();
         InitializeProbeUpdateShader();
+        InitializeProbeReprojectShader();
         InitializeProbeAtlasVizShader();
         InitializeCubemapVizShader();
         InitializeDownsampleShader();
@@ -144,14 +147,43 @@ namespace SDFGI {
     }
 
     void SDFGIManager::InitializeTextures() {
+        InitializeAtlases();
+
+        if (probeCount > 330) useCubemaps = false;
+
+        if (useCubemaps) {
+            // Individual cubemap faces for all probes.
+            probeCubemapFaceTextures = new Texture*[probeCount];
+            for (uint32_t probe  = 0; probe < probeCount; ++probe) {
+                probeCubemapFaceTextures[probe] = new Texture[6];
+
+                for (int face = 0; face < 6; ++face)
+                {
+                    probeCubemapFaceTextures[probe][face].Create2D(
+                        cubemapFaceResolution * sizeof(float) * 4,
+                        cubemapFaceResolution, cubemapFaceResolution,
+                        DXGI_FORMAT_R11G11B10_FLOAT,
+                        nullptr,
+                        // TODO: doesn't need render target flag.
+                        D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS | D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET
+                    );
+                }
+            }
+
+            // A single texture array containing all cubemap faces.
+            probeCubemapArray.CreateArray(L"ProbeCubemapArray", cubemapFaceResolution, cubemapFaceResolution, 6*probeCount, DXGI_FORMAT_R11G11B10_FLOAT);
+        }
+    };
+
+    void SDFGIManager::InitializeAtlases() {
         uint32_t width = probeGrid.probeCount[0];
         uint32_t height = probeGrid.probeCount[1];
         uint32_t depth = probeGrid.probeCount[2];
         probeCount = width * height * depth;
         maxZIndex = depth;
 
-        uint32_t atlasWidth = (width * probeAtlasBlockResolution) + (width + 1) * gutterSize;
-        uint32_t atlasHeight = (height * probeAtlasBlockResolution) + (height + 1) * gutterSize;
+        uint32_t atlasWidth = SDFGIAtlas::SDFGIAtlasExtent(width, probeAtlasBlockResolution, gutterSize);
+        uint32_t atlasHeight = SDFGIAtlas::SDFGIAtlasExtent(height, probeAtlasBlockResolution, gutterSize);
         uint32_t atlasDepth = depth; 
 
         irradianceAtlas.CreateArray(
@@ -173,32 +205,7 @@ namespace SDFGI {
             D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN,
             externalHeap
         );
-
-        if (probeCount > 330) useCubemaps = false;
-
-        if (useCubemaps) {
-            // Individual cubemap faces for all probes.
-            probeCubemapFaceTextures = new Texture*[probeCount];
-            for (uint32_t probe  = 0; probe < probeCount; ++probe) {
-                probeCubemapFaceTextures[probe] = new Texture[6];
-
-                for (int face = 0; face < 6; ++face)
-                {
-                    probeCubemapFaceTextures[probe][face].Create2D(
-                        cubemapFaceResolution * sizeof(float) * 4,
-                        cubemapFaceResolution, cubemapFaceResolution,
-                        DXGI_FORMAT_R11G11B10_FLOAT,
-                        nullptr,
-                        // TODO: doesn't need render target flag.
-                        D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS | D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET
-                    );
-                }
-            }
-
-            // A single texture array containing all cubemap faces.
-            probeCubemapArray.CreateArray(L"ProbeCubemapArray", cubemapFaceResolution, cubemapFaceResolution, 6*probeCount, DXGI_FORMAT_R11G11B10_FLOAT);
-        }
-    };
+    }
 
     void SDFGIManager::InitializeViews() {
         if (useCubemaps) {
@@ -240,6 +247,29 @@ namespace SDFGI {
         probeBuffer.Create(L"Probe Data Buffer", probeData.size(), sizeof(float), probeData.data());
     }
 
+    void SDFGIManager::InitializeProbeTiles() {
+        probeTileScheduler.Reset(probeGrid.probeCount.data());
+        probeTileArgs.Create(L"Probe Tile Dispatch Args", probeTileScheduler.GetTileCount(), sizeof(SDFGIProbeScheduler::TileCommand));
+    }
+
+    void SDFGIManager::InvalidateAllProbes() {
+        probeTileScheduler.InvalidateAll();
+    }
+
+    void SDFGIManager::InvalidateProbes(const Math::AxisAlignedBox& worldBounds) {
+        Vector3 gridMin = probeGrid.sceneBounds.GetMin();
+        Vector3 boundsMin = worldBounds.GetMin();
+        Vector3 boundsMax = worldBounds.GetMax();
+        const float gridMins[3] = { gridMin.GetX(), gridMin.GetY(), gridMin.GetZ() };
+        const float boundsMins[3] = { boundsMin.GetX(), boundsMin.GetY(), boundsMin.GetZ() };
+        const float boundsMaxs[3] = { boundsMax.GetX(), boundsMax.GetY(), boundsMax.GetZ() };
+
+        uint32_t probeMin[3], probeMax[3];
+        if (SDFGIProbeScheduler::GetProbeRange(boundsMins, boundsMaxs, gridMins, probeGrid.probeSpacing.data(),
+                probeGrid.probeCount.data(), probeMin, probeMax))
+            probeTileScheduler.Invalidate(probeMin, probeMax);
+    }
+
     void SDFGIManager::InitializeProbeVizShader()  {
         probeVizRS.Reset(2, 1);
 
@@ -284,7 +314,7 @@ namespace SDFGI {
     }
 
     void SDFGIManager::InitializeProbeUpdateShader() {
-        probeUpdateRS.Reset(8, 1);
+        probeUpdateRS.Reset(10, 1);
 
         // probeBuffer.
         probeUpdateRS[0].InitAsBufferSRV(/*register=t*/0, D3D12_SHADER_VISIBILITY_ALL);
@@ -310,6 +340,12 @@ namespace SDFGI {
         // SDF texture info
         probeUpdateRS[7].InitAsConstantBuffer(1, D3D12_SHADER_VISIBILITY_ALL);
 
+        // Coarse levels of the SDF min-distance pyramid.
+        probeUpdateRS[8].InitAsDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, /*register=u*/4, SDF_HIERARCHY_COARSE_LEVELS);
+
+        // First probe of the tile, written by each indirect command.
+        probeUpdateRS[9].InitAsConstants(/*register=b*/2, 3);
+
         probeUpdateRS.InitStaticSampler(0, SamplerLinearClampDesc, D3D12_SHADER_VISIBILITY_ALL);
 
         probeUpdateRS.Finalize(L"DDGI Compute Root Signature");
@@ -318,6 +354,11 @@ namespace SDFGI {
         probeUpdatePSO.SetComputeShader(g_pSDFGIProbeUpdateCS, sizeof(g_pSDFGIProbeUpdateCS));
         probeUpdatePSO.Finalize();
 
+        probeUpdateCommandSignature.Reset(2);
+        probeUpdateCommandSignature[0].Constant(9, 0, 3);
+        probeUpdateCommandSignature[1].Dispatch();
+        probeUpdateCommandSignature.Finalize(&probeUpdateRS);
+
 
 
         atlasBorderRS.Reset(3, 1);
@@ -341,6 +382,56 @@ namespace SDFGI {
     }
 
 
+    // Layout of the ProbeData cbuffer of the probe update and atlas border shaders.
+    __declspec(align(16)) struct ProbeData {
+        XMFLOAT4X4 RandomRotation;                  // 64
+
+        Vector3 GridSize;                           // 16
+
+        Vector3 ProbeSpacing;                       // 16
+
+        Vector3 SceneMinBounds;                     // 16
+
+        unsigned int ProbeCount;                    // 4
+        unsigned int ProbeAtlasBlockResolution;     // 4
+        unsigned int GutterSize;                    // 4 
+        float MaxWorldDepth;                        // 4
+
+        BOOL SampleSDF;                             // 4
+        float Hysteresis;                           // 4
+    };
+
+    static ProbeData MakeProbeData(const SDFGIManager& manager) {
+        const SDFGIProbeGrid& probeGrid = manager.probeGrid;
+        ProbeData probeData = {};
+        probeData.ProbeCount = probeGrid.probes.size();
+        probeData.GridSize = Vector3(probeGrid.probeCount[0], probeGrid.probeCount[1], probeGrid.probeCount[2]);
+        probeData.ProbeSpacing = Vector3(probeGrid.probeSpacing[0], probeGrid.probeSpacing[1], probeGrid.probeSpacing[2]);
+        probeData.SceneMinBounds = probeGrid.sceneBounds.GetMin();
+        probeData.ProbeAtlasBlockResolution = manager.probeAtlasBlockResolution;
+        probeData.GutterSize = manager.gutterSize;
+        probeData.MaxWorldDepth = probeGrid.sceneBounds.GetMaxDistance();
+        probeData.SampleSDF = !manager.useCubemaps;
+        probeData.Hysteresis = manager.hysteresis;
+        return probeData;
+    }
+
+    void SDFGIManager::UpdateAtlasBorders(ComputeContext& context) {
+        ScopedTimer _prof(L"Fill in atlas borders", context);
+
+        ProbeData probeData = MakeProbeData(*this);
+
+        context.SetPipelineState(atlasBorderPSO);
+        context.SetRootSignature(atlasBorderRS);
+
+        context.SetDynamicDescriptor(0, 0, irradianceAtlas.GetUAV());
+        context.SetDynamicDescriptor(1, 0, depthAtlas.GetUAV());
+
+        context.SetDynamicConstantBufferView(2, sizeof(ProbeData), &probeData);
+
+        context.Dispatch(probeGrid.probeCount[0], probeGrid.probeCount[1], probeGrid.probeCount[2]);
+    }
+
     void SDFGIManager::UpdateProbes(GraphicsContext& context) {
 
         if (!externalDescAllocated) {
@@ -351,11 +442,7 @@ namespace SDFGI {
             depthAtlasSRVHandle = externalHeap->Alloc(1);
         }
 
-        if (updateTimer > 3) {
-            updateTimer = 0;
-        }
-        else {
-            updateTimer++;
+        if (probeTileScheduler.BuildFrame(probeUpdatePeriod, probeTileCommands) == 0) {
             return;
         }
 
@@ -363,32 +450,7 @@ namespace SDFGI {
         computeContext.TransitionResource(irradianceAtlas, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
         computeContext.TransitionResource(depthAtlas, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
 
-        __declspec(align(16)) struct ProbeData {
-            XMFLOAT4X4 RandomRotation;                  // 64
-
-            Vector3 GridSize;                           // 16
-
-            Vector3 ProbeSpacing;                       // 16
-
-            Vector3 SceneMinBounds;                     // 16
-
-            unsigned int ProbeCount;                    // 4
-            unsigned int ProbeAtlasBlockResolution;     // 4
-            unsigned int GutterSize;                    // 4 
-            float MaxWorldDepth;                        // 4
-
-            BOOL SampleSDF;
-        } probeData;
-        {
-            probeData.ProbeCount = probeGrid.probes.size();
-            probeData.GridSize = Vector3(probeGrid.probeCount[0], probeGrid.probeCount[1], probeGrid.probeCount[2]);
-            probeData.ProbeSpacing = Vector3(probeGrid.probeSpacing[0], probeGrid.probeSpacing[1], probeGrid.probeSpacing[2]);
-            probeData.SceneMinBounds = probeGrid.sceneBounds.GetMin();
-            probeData.ProbeAtlasBlockResolution = probeAtlasBlockResolution;
-            probeData.GutterSize = gutterSize;
-            probeData.MaxWorldDepth = probeGrid.sceneBounds.GetMaxDistance();
-            probeData.SampleSDF = !useCubemaps;
-        }
+        ProbeData probeData = MakeProbeData(*this);
 
         // Main Pass
         {
@@ -403,6 +465,8 @@ namespace SDFGI {
             if (useCubemaps) computeContext.SetDynamicDescriptor(3, 0, probeCubemapArray.GetSRV());
             computeContext.SetDynamicDescriptor(5, 0, Renderer::m_VoxelAlbedo.GetUAV());
             computeContext.SetDynamicDescriptor(6, 0, Renderer::m_FinalSDFOutput.GetUAV());
+            for (uint32_t level = 0; level < SDF_HIERARCHY_COARSE_LEVELS; ++level)
+                computeContext.SetDynamicDescriptor(8, level, Renderer::m_SDFMips[level].GetUAV());
 
 
             __declspec(align(16)) struct SDFData {
@@ -415,6 +479,7 @@ namespace SDFGI {
                 float zmax;
                 // texture resolution
                 float sdfResolution;
+                uint32_t sdfHierarchical;
             } sdfData;
 
             //float rotation_scaler = 0.001f;
@@ -429,37 +494,24 @@ namespace SDFGI {
             sdfData.zmin = -2000;
             sdfData.zmax = 2000;
             sdfData.sdfResolution = SDF_TEXTURE_RESOLUTION;
+            sdfData.sdfHierarchical = Renderer::HierarchicalSDFTrace;
 
             computeContext.SetDynamicConstantBufferView(4, sizeof(ProbeData), &probeData);
             computeContext.SetDynamicConstantBufferView(7, sizeof(SDFData), &sdfData);
 
-            // New: One thread per probe atlas contribution texel
-            // CTA size = 8 x 8
-            // Group Count = probeCount.x, ..., probeCount.z
-            // Thus, this line stays the same!
-
-            // Old: One thread per probe.
-            computeContext.Dispatch(probeGrid.probeCount[0], probeGrid.probeCount[1], probeGrid.probeCount[2]);
+            // One indirect command per active tile: its first probe goes to root parameter 9, then one group per probe
+            // of the tile, one thread per probe atlas texel. The border ring is filled by the same groups.
+            // WriteBuffer reads whole 16-byte chunks, and an odd number of 24-byte commands ends halfway into one, so
+            // pad with an unused command.
+            const uint32_t commandCount = (uint32_t)probeTileCommands.size();
+            probeTileCommands.resize((commandCount + 1) & ~1u);
+            computeContext.WriteBuffer(probeTileArgs, 0, probeTileCommands.data(), commandCount * sizeof(SDFGIProbeScheduler::TileCommand));
+            computeContext.TransitionResource(probeTileArgs, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT);
+            computeContext.ExecuteIndirect(probeUpdateCommandSignature, probeTileArgs, 0, commandCount);
             computeContext.Flush();
 
         }
 
-        {
-            ScopedTimer _prof(L"Fill in atlas borders", context);
-            //ComputePSO atlasBorderPSO;
-            //RootSignature atlasBorderRS;
-
-            computeContext.SetPipelineState(atlasBorderPSO);
-            computeContext.SetRootSignature(atlasBorderRS);
-
-            computeContext.SetDynamicDescriptor(0, 0, irradianceAtlas.GetUAV());
-            computeContext.SetDynamicDescriptor(1, 0, depthAtlas.GetUAV());
-
-            computeContext.SetDynamicConstantBufferView(2, sizeof(ProbeData), &probeData);
-
-            computeContext.Dispatch(probeGrid.probeCount[0], probeGrid.probeCount[1], probeGrid.probeCount[2]);
-        }
-
         computeContext.TransitionResource(irradianceAtlas, D3D12_RESOURCE_STATE_GENERIC_READ);
         computeContext.TransitionResource(depthAtlas, D3D12_RESOURCE_STATE_GENERIC_READ);
         uint32_t DestCount = 1;
@@ -479,6 +531,110 @@ namespace SDFGI {
         externalDescAllocated = true;
     }
     
+    void SDFGIManager::InitializeProbeReprojectShader() {
+        probeReprojectRS.Reset(4, 0);
+
+        // Old irradiance and depth atlases.
+        probeReprojectRS[0].InitAsDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, /*register=t*/0, 2);
+
+        // New irradiance atlas.
+        probeReprojectRS[1].InitAsDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, /*register=u*/0, 1);
+
+        // New depth atlas.
+        probeReprojectRS[2].InitAsDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, /*register=u*/1, 1);
+
+        // Old and new grid info.
+        probeReprojectRS[3].InitAsConstantBuffer(/*register=b*/0, D3D12_SHADER_VISIBILITY_ALL);
+
+        probeReprojectRS.Finalize(L"SDFGI Probe Reprojection Root Signature");
+
+        probeReprojectPSO.SetRootSignature(probeReprojectRS);
+        probeReprojectPSO.SetComputeShader(g_pSDFGIProbeReprojectCS, sizeof(g_pSDFGIProbeReprojectCS));
+        probeReprojectPSO.Finalize();
+    }
+
+    void SDFGIManager::RequestRelocation(const Math::AxisAlignedBox& sceneBounds, float spacing) {
+        relocationPending = true;
+        relocationBounds = sceneBounds;
+        relocationSpacing = spacing;
+    }
+
+    void SDFGIManager::RelocateGrid(GraphicsContext& context, const Math::AxisAlignedBox& sceneBounds, float spacing) {
+        if (useCubemaps) {
+            Utility::Printf("SDFGI: grid relocation is not supported with cubemap probes\n");
+            return;
+        }
+
+        ScopedTimer _prof(L"Relocate Probe Grid", context);
+
+        // Commands recorded so far this frame may still reference the probe buffer that is about to be replaced.
+        context.Flush(true);
+
+        // The current atlases become the reprojection source; the new grid's atlases are created in place of the
+        // ones kept from the previous relocation.
+        SDFGIProbeGrid oldGrid = probeGrid;
+        std::swap(irradianceAtlas, previousIrradianceAtlas);
+        std::swap(depthAtlas, previousDepthAtlas);
+
+        probeGrid = SDFGIProbeGrid(sceneBounds, spacing);
+        InitializeAtlases();
+        InitializeProbeBuffer();
+
+        __declspec(align(16)) struct ReprojectData {
+            Vector3 GridSize;                           // 16
+            Vector3 ProbeSpacing;                       // 16
+            Vector3 SceneMinBounds;                     // 16
+
+            Vector3 OldGridSize;                        // 16
+            Vector3 OldProbeSpacing;                    // 16
+            Vector3 OldSceneMinBounds;                  // 16
+
+            unsigned int ProbeAtlasBlockResolution;     // 4
+            unsigned int GutterSize;                    // 4
+        } reprojectData;
+        {
+            reprojectData.GridSize = Vector3(probeGrid.probeCount[0], probeGrid.probeCount[1], probeGrid.probeCount[2]);
+            reprojectData.ProbeSpacing = Vector3(probeGrid.probeSpacing[0], probeGrid.probeSpacing[1], probeGrid.probeSpacing[2]);
+            reprojectData.SceneMinBounds = probeGrid.sceneBounds.GetMin();
+            reprojectData.OldGridSize = Vector3(oldGrid.probeCount[0], oldGrid.probeCount[1], oldGrid.probeCount[2]);
+            reprojectData.OldProbeSpacing = Vector3(oldGrid.probeSpacing[0], oldGrid.probeSpacing[1], oldGrid.probeSpacing[2]);
+            reprojectData.OldSceneMinBounds = oldGrid.sceneBounds.GetMin();
+            reprojectData.ProbeAtlasBlockResolution = probeAtlasBlockResolution;
+            reprojectData.GutterSize = gutterSize;
+        }
+
+        ComputeContext& computeContext = context.GetComputeContext();
+        computeContext.TransitionResource(previousIrradianceAtlas, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+        computeContext.TransitionResource(previousDepthAtlas, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+        computeContext.TransitionResource(irradianceAtlas, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+        computeContext.TransitionResource(depthAtlas, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+
+        {
+            ScopedTimer _prof(L"Reproject Irradiance and Depth", context);
+
+            computeContext.SetPipelineState(probeReprojectPSO);
+            computeContext.SetRootSignature(probeReprojectRS);
+
+            computeContext.SetDynamicDescriptor(0, 0, previousIrradianceAtlas.GetSRV());
+            computeContext.SetDynamicDescriptor(0, 1, previousDepthAtlas.GetSRV());
+            computeContext.SetDynamicDescriptor(1, 0, irradianceAtlas.GetUAV());
+            computeContext.SetDynamicDescriptor(2, 0, depthAtlas.GetUAV());
+
+            computeContext.SetDynamicConstantBufferView(3, sizeof(ReprojectData), &reprojectData);
+
+            // One thread per texel of every new probe's block, as in the probe update pass.
+            computeContext.Dispatch(probeGrid.probeCount[0], probeGrid.probeCount[1], probeGrid.probeCount[2]);
+        }
+
+        computeContext.InsertUAVBarrier(irradianceAtlas);
+        computeContext.InsertUAVBarrier(depthAtlas);
+        UpdateAtlasBorders(computeContext);
+
+        // Every tile starts out invalidated, so the probe update refreshes the whole grid this frame and publishes the
+        // new atlases to the external heap right away.
+        InitializeProbeTiles();
+    }
+
     void SDFGIManager::InitializeProbeAtlasVizShader() {
         atlasVizRS.Reset(3, 1);
         // Irradiance atlas.
@@ -702,6 +858,11 @@ namespace SDFGI {
     void SDFGIManager::Update(GraphicsContext& context, const Math::Camera& camera, const D3D12_VIEWPORT& viewport, const D3D12_RECT& scissor) {
         ScopedTimer _prof(L"SDFGI Update", context);
 
+        if (relocationPending) {
+            relocationPending = false;
+            RelocateGrid(context, relocationBounds, relocationSpacing);
+        }
+
         if (useCubemaps) {
             RenderCubemapsForProbes(context, camera, viewport, scissor);
         }
@@ -5,6 +5,9 @@
 #include "CommandContext.h"
 #include "GpuBuffer.h"
 #include "ColorBuffer.h"
+#include "SDFGIAtlasCommon.h"
+#include "SDFGIProbeScheduler.h"
+#include "CommandSignature.h"
 #include <array>
 
 using namespace Math;
@@ -45,7 +48,8 @@ namespace SDFGI
     Vector3f probeSpacing;
     Math::AxisAlignedBox sceneBounds;
     std::vector<SDFGIProbe> probes;
-    SDFGIProbeGrid(Math::AxisAlignedBox sceneBounds);
+    // A spacing of 0 picks the scene's default.
+    SDFGIProbeGrid(Math::AxisAlignedBox sceneBounds, float spacing = 0.0f);
 
     void GenerateProbes();
   };
@@ -97,8 +101,9 @@ namespace SDFGI
 
     DescriptorHeap *externalHeap;
 
-    uint32_t probeAtlasBlockResolution = 8;
-    uint32_t gutterSize = 2;
+    // The probe update shader's group size is SDFGI_ATLAS_BLOCK_RESOLUTION, so these can't change at runtime.
+    const uint32_t probeAtlasBlockResolution = SDFGI_ATLAS_BLOCK_RESOLUTION;
+    const uint32_t gutterSize = SDFGI_ATLAS_GUTTER_SIZE;
     ColorBuffer irradianceAtlas;
     ColorBuffer &getIrradianceAtlas() { return irradianceAtlas; }
     D3D12_GPU_DESCRIPTOR_HANDLE GetIrradianceAtlasGpuSRV() const;
@@ -110,14 +115,23 @@ namespace SDFGI
     DescriptorHandle depthAtlasSRVHandle;
     DescriptorHandle &GetDepthAtlasDescriptorHandle() { return depthAtlasSRVHandle; }
 
+    // Atlases of the grid before the last relocation, read by the reprojection pass. Kept around so the next
+    // relocation doesn't have to allocate them again.
+    ColorBuffer previousIrradianceAtlas;
+    ColorBuffer previousDepthAtlas;
+
     // Individual cubemap faces for all probes.
     Texture **probeCubemapFaceTextures;
     D3D12_CPU_DESCRIPTOR_HANDLE **probeCubemapFaceUAVs;
     // A single texture array containing all cubemap faces.
     ColorBuffer probeCubemapArray;
 
-    //FrameCount for probeUpdates
-    uint32_t updateTimer = 0;
+    // Every probe is updated once every probeUpdatePeriod frames; each frame updates an equal share of the probe tiles
+    // plus any that were invalidated.
+    int probeUpdatePeriod = 4;
+    SDFGIProbeScheduler::TileScheduler probeTileScheduler;
+    std::vector<SDFGIProbeScheduler::TileCommand> probeTileCommands;
+    IndirectArgsBuffer probeTileArgs;
 
 
 
@@ -136,6 +150,8 @@ namespace SDFGI
 
     // Initialize all textures needed.
     void InitializeTextures();
+    // (Re)create the irradiance and depth atlases for the current probe grid.
+    void InitializeAtlases();
     // Initialize all views needed.
     void InitializeViews();
 
@@ -150,10 +166,30 @@ namespace SDFGI
     ComputePSO probeUpdatePSO;
     RootSignature probeUpdateRS;
 
+    CommandSignature probeUpdateCommandSignature;
+
     ComputePSO atlasBorderPSO;
     RootSignature atlasBorderRS;
     void InitializeProbeUpdateShader();
+    void InitializeProbeTiles();
+    // Forces the probes inside worldBounds into the next update, e.g. when the scene around them changed.
+    void InvalidateProbes(const Math::AxisAlignedBox& worldBounds);
+    // Forces every probe into the next update, e.g. when the lighting changed.
+    void InvalidateAllProbes();
     void UpdateProbes(GraphicsContext& context);
+    void UpdateAtlasBorders(ComputeContext& context);
+
+    // Grid relocation: moves and/or respaces the probe grid, seeding the new atlases by trilinearly resampling the old
+    // ones so converged lighting survives. Requests are applied at the start of the next Update. Not supported with
+    // cubemap probes, whose per-probe textures would have to be rebuilt.
+    ComputePSO probeReprojectPSO;
+    RootSignature probeReprojectRS;
+    bool relocationPending = false;
+    Math::AxisAlignedBox relocationBounds;
+    float relocationSpacing = 0.0f;
+    void InitializeProbeReprojectShader();
+    void RequestRelocation(const Math::AxisAlignedBox& sceneBounds, float spacing = 0.0f);
+    void RelocateGrid(GraphicsContext& context, const Math::AxisAlignedBox& sceneBounds, float spacing);
 
     // Visualization: irradiance atlas (WIP: depth atlas).
     GraphicsPSO atlasVizPSO;    
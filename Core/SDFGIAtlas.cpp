@@ -0,0 +1,94 @@
+#include "pch.h"
+#include "SDFGIAtlas.h"
+#include <xmmintrin.h>
+
+namespace SDFGIAtlas
+{
+    // The layout math is constexpr so mistakes in it show up at compile time.
+    static_assert(AtlasExtent(1) == SDFGI_ATLAS_BLOCK_RESOLUTION + 2 * SDFGI_ATLAS_GUTTER_SIZE, "One block plus two gutters");
+    static_assert(SDFGIAtlasExtent(4, 8, 2) == 42, "4 blocks of 8 and 5 gutters of 2");
+    static_assert(SDFGIAtlasBlockOrigin(uint2(3, 1), 8, 2).x == 32 && SDFGIAtlasBlockOrigin(uint2(3, 1), 8, 2).y == 12, "");
+    static_assert(SDFGIAtlasBlockOrigin(uint2(3, 0), 8, 2).x + 8 + 2 == SDFGIAtlasBlockOrigin(uint2(4, 0), 8, 2).x, "");
+    static_assert(SDFGIAtlasBlockOrigin(uint2(7, 7), 8, 2).x + 8 + 2 == SDFGIAtlasExtent(8, 8, 2), "Last block ends one gutter before the edge");
+    static_assert(SDFGIOctEncode(float3(0.0f, 0.0f, 1.0f)).x == 0.0f && SDFGIOctEncode(float3(0.0f, 0.0f, 1.0f)).y == 0.0f, "+Z maps to the center");
+    static_assert(SDFGIOctEncode(float3(0.0f, 0.0f, -1.0f)).x == 1.0f && SDFGIOctEncode(float3(0.0f, 0.0f, -1.0f)).y == 1.0f, "-Z maps to a corner");
+    static_assert(SDFGIOctEncode(float3(1.0f, 0.0f, 0.0f)).x == 1.0f, "+X maps to the right edge midpoint");
+    static_assert(SDFGIBorderSource(SDFGIBorderTexel(0, 8), 8).x == 7 && SDFGIBorderSource(SDFGIBorderTexel(0, 8), 8).y == 0, "Top edge mirrors");
+    static_assert(SDFGIBorderSource(int2(-1, -1), 8).x == 7 && SDFGIBorderSource(int2(-1, -1), 8).y == 7, "Corners swap diagonally");
+
+    namespace
+    {
+        const __m128 kSignMask = _mm_set1_ps(-0.0f);
+        const __m128 kOne = _mm_set1_ps(1.0f);
+
+        __m128 Abs(__m128 a) { return _mm_andnot_ps(kSignMask, a); }
+
+        // Lanes of b where mask is set, of a elsewhere. Plain SSE, so this doesn't need _mm_blendv_ps.
+        __m128 Select(__m128 a, __m128 b, __m128 mask) { return _mm_or_ps(_mm_and_ps(mask, b), _mm_andnot_ps(mask, a)); }
+
+        __m128 SignNotZero(__m128 a)
+        {
+            return _mm_or_ps(kOne, _mm_and_ps(kSignMask, _mm_cmpnge_ps(a, _mm_setzero_ps())));
+        }
+    }
+
+    void OctEncodeBatch(const float* x, const float* y, const float* z, float* u, float* v, size_t count)
+    {
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            const __m128 vx = _mm_loadu_ps(x + i);
+            const __m128 vy = _mm_loadu_ps(y + i);
+            const __m128 vz = _mm_loadu_ps(z + i);
+
+            const __m128 invL1Norm = _mm_div_ps(kOne, _mm_add_ps(_mm_add_ps(Abs(vx), Abs(vy)), Abs(vz)));
+            const __m128 ru = _mm_mul_ps(vx, invL1Norm);
+            const __m128 rv = _mm_mul_ps(vy, invL1Norm);
+            const __m128 fu = _mm_mul_ps(_mm_sub_ps(kOne, Abs(rv)), SignNotZero(ru));
+            const __m128 fv = _mm_mul_ps(_mm_sub_ps(kOne, Abs(ru)), SignNotZero(rv));
+
+            const __m128 lowerHemisphere = _mm_cmplt_ps(vz, _mm_setzero_ps());
+            _mm_storeu_ps(u + i, Select(ru, fu, lowerHemisphere));
+            _mm_storeu_ps(v + i, Select(rv, fv, lowerHemisphere));
+        }
+
+        for (; i < count; ++i)
+        {
+            const float2 o = SDFGIOctEncode(float3(x[i], y[i], z[i]));
+            u[i] = o.x;
+            v[i] = o.y;
+        }
+    }
+
+    void OctDecodeBatch(const float* u, const float* v, float* x, float* y, float* z, size_t count)
+    {
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            const __m128 ou = _mm_loadu_ps(u + i);
+            const __m128 ov = _mm_loadu_ps(v + i);
+
+            const __m128 dz = _mm_sub_ps(_mm_sub_ps(kOne, Abs(ou)), Abs(ov));
+            const __m128 fx = _mm_mul_ps(_mm_sub_ps(kOne, Abs(ov)), SignNotZero(ou));
+            const __m128 fy = _mm_mul_ps(_mm_sub_ps(kOne, Abs(ou)), SignNotZero(ov));
+
+            const __m128 lowerHemisphere = _mm_cmplt_ps(dz, _mm_setzero_ps());
+            const __m128 dx = Select(ou, fx, lowerHemisphere);
+            const __m128 dy = Select(ov, fy, lowerHemisphere);
+
+            const __m128 lengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+            const __m128 invLength = _mm_div_ps(kOne, _mm_sqrt_ps(lengthSq));
+            _mm_storeu_ps(x + i, _mm_mul_ps(dx, invLength));
+            _mm_storeu_ps(y + i, _mm_mul_ps(dy, invLength));
+            _mm_storeu_ps(z + i, _mm_mul_ps(dz, invLength));
+        }
+
+        for (; i < count; ++i)
+        {
+            const float3 d = SDFGIOctDecode(float2(u[i], v[i]));
+            x[i] = d.x;
+            y[i] = d.y;
+            z[i] = d.z;
+        }
+    }
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "SDFGIAtlasCommon.h"
+#include <cstddef>
+
+// CPU side of the probe atlas math in SDFGIAtlasCommon.h: batched octahedral encode/decode for tools that convert
+// large numbers of directions. Tests/SDFGIAtlasTest.cpp checks the layout and mapping.
+namespace SDFGIAtlas
+{
+    // Atlas extent for the default block and gutter sizes.
+    constexpr uint AtlasExtent(uint probeCount)
+    {
+        return SDFGIAtlasExtent(probeCount, SDFGI_ATLAS_BLOCK_RESOLUTION, SDFGI_ATLAS_GUTTER_SIZE);
+    }
+
+    // Structure-of-arrays batches. Results are bit-identical to SDFGIOctEncode/SDFGIOctDecode on every element; the
+    // input and output arrays may not overlap.
+    void OctEncodeBatch(const float* x, const float* y, const float* z, float* u, float* v, size_t count);
+    void OctDecodeBatch(const float* u, const float* v, float* x, float* y, float* z, size_t count);
+}
@@ -0,0 +1,204 @@
+// Octahedral probe mapping and irradiance/depth atlas layout, shared between C++ and HLSL.
+//
+// The atlas is a Texture2DArray with one slice per probe grid z. Within a slice, probe (x, y) owns a square block of
+// SDFGI_ATLAS_BLOCK_RESOLUTION texels, and every block is surrounded by SDFGI_ATLAS_GUTTER_SIZE texels of gutter (the
+// border pass fills the gutter ring so bilinear taps near a block edge wrap around the octahedron correctly):
+//
+//     | gutter | block 0 | gutter | block 1 | gutter | ... | block n-1 | gutter |
+//
+// Everything in here must stay valid HLSL and valid C++: only constructors and .x/.y/.z member access on vectors,
+// no swizzles, no operators on vector types.
+
+#ifndef SDFGI_ATLAS_COMMON_H
+#define SDFGI_ATLAS_COMMON_H
+
+#ifdef __cplusplus
+#include <cstdint>
+#include <cmath>
+#define SDFGI_SHARED inline
+#define SDFGI_CONSTEXPR constexpr
+namespace SDFGIAtlas
+{
+    typedef uint32_t uint;
+    using std::sqrt;
+
+    struct float2
+    {
+        float x, y;
+        constexpr float2() : x(0.0f), y(0.0f) {}
+        constexpr float2(float x, float y) : x(x), y(y) {}
+    };
+
+    struct float3
+    {
+        float x, y, z;
+        constexpr float3() : x(0.0f), y(0.0f), z(0.0f) {}
+        constexpr float3(float x, float y, float z) : x(x), y(y), z(z) {}
+    };
+
+    struct uint2
+    {
+        uint x, y;
+        constexpr uint2() : x(0), y(0) {}
+        constexpr uint2(uint x, uint y) : x(x), y(y) {}
+    };
+
+    struct int2
+    {
+        int x, y;
+        constexpr int2() : x(0), y(0) {}
+        constexpr int2(int x, int y) : x(x), y(y) {}
+    };
+#else
+#define SDFGI_SHARED
+#define SDFGI_CONSTEXPR
+#endif
+
+// Texels per side of one probe's octahedral block, and of the gutter between blocks. The probe update shader runs one
+// thread group per probe with one thread per block texel, so this is also its group size.
+#define SDFGI_ATLAS_BLOCK_RESOLUTION 8
+#define SDFGI_ATLAS_GUTTER_SIZE 2
+
+// --- Octahedral mapping ---
+
+SDFGI_CONSTEXPR float SDFGIAbs(float k)
+{
+    return k < 0.0f ? -k : k;
+}
+
+SDFGI_CONSTEXPR float SDFGISignNotZero(float k)
+{
+    return k >= 0.0f ? 1.0f : -1.0f;
+}
+
+// Unit direction -> [-1, 1]^2. Directions with z < 0 fold over the diagonals into the outer triangles.
+SDFGI_CONSTEXPR float2 SDFGIOctEncode(float3 v)
+{
+    float invL1Norm = 1.0f / (SDFGIAbs(v.x) + SDFGIAbs(v.y) + SDFGIAbs(v.z));
+    float2 result = float2(v.x * invL1Norm, v.y * invL1Norm);
+    if (v.z < 0.0f)
+    {
+        result = float2((1.0f - SDFGIAbs(result.y)) * SDFGISignNotZero(result.x),
+                        (1.0f - SDFGIAbs(result.x)) * SDFGISignNotZero(result.y));
+    }
+    return result;
+}
+
+// [-1, 1]^2 -> unit direction.
+SDFGI_SHARED float3 SDFGIOctDecode(float2 o)
+{
+    float3 v = float3(o.x, o.y, 1.0f - SDFGIAbs(o.x) - SDFGIAbs(o.y));
+    if (v.z < 0.0f)
+    {
+        v = float3((1.0f - SDFGIAbs(o.y)) * SDFGISignNotZero(o.x),
+                   (1.0f - SDFGIAbs(o.x)) * SDFGISignNotZero(o.y),
+                   v.z);
+    }
+    float invLength = 1.0f / sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
+    return float3(v.x * invLength, v.y * invLength, v.z * invLength);
+}
+
+// --- Atlas layout ---
+
+// Width (or height) of an atlas slice holding probeCount blocks along that axis.
+SDFGI_CONSTEXPR uint SDFGIAtlasExtent(uint probeCount, uint blockResolution, uint gutterSize)
+{
+    return probeCount * blockResolution + (probeCount + 1) * gutterSize;
+}
+
+// Texel coordinate of the first (top-left) texel of a probe's block within its slice.
+SDFGI_CONSTEXPR uint2 SDFGIAtlasBlockOrigin(uint2 probeXY, uint blockResolution, uint gutterSize)
+{
+    return uint2(gutterSize + probeXY.x * (blockResolution + gutterSize),
+                 gutterSize + probeXY.y * (blockResolution + gutterSize));
+}
+
+// Position within a block (texel + sub-texel offset, in texels) -> octahedral coordinate in [-1, 1]^2.
+SDFGI_CONSTEXPR float2 SDFGIBlockToOct(float2 blockPosition, uint blockResolution)
+{
+    return float2(blockPosition.x / blockResolution * 2.0f - 1.0f,
+                  blockPosition.y / blockResolution * 2.0f - 1.0f);
+}
+
+// Octahedral coordinate -> position within a block, in texels. Inverse of SDFGIBlockToOct.
+SDFGI_CONSTEXPR float2 SDFGIOctToBlock(float2 o, uint blockResolution)
+{
+    return float2((o.x * 0.5f + 0.5f) * blockResolution, (o.y * 0.5f + 0.5f) * blockResolution);
+}
+
+// Normalized UV into an atlas slice for sampling direction-encoded o of probe probeXY.
+SDFGI_CONSTEXPR float2 SDFGIAtlasUV(float2 o, uint2 probeXY, uint blockResolution, uint gutterSize, float2 atlasSize)
+{
+    uint2 origin = SDFGIAtlasBlockOrigin(probeXY, blockResolution, gutterSize);
+    float2 blockPosition = SDFGIOctToBlock(o, blockResolution);
+    return float2((origin.x + blockPosition.x) / atlasSize.x, (origin.y + blockPosition.y) / atlasSize.y);
+}
+
+// Number of texels in the one-texel ring around a block.
+#define SDFGI_ATLAS_BORDER_TEXELS(blockResolution) (4 * (blockResolution) + 4)
+
+// Block-local coordinate of the i-th texel of the border ring, i in [0, SDFGI_ATLAS_BORDER_TEXELS): top, bottom, left
+// and right edges first, then the four corners. Coordinates are in [-1, blockResolution].
+SDFGI_CONSTEXPR int2 SDFGIBorderTexel(uint i, uint blockResolution)
+{
+    int side = (int)(i / blockResolution);
+    int d = (int)(i % blockResolution);
+    int b = (int)blockResolution;
+    if (side == 0)
+        return int2(d, -1);
+    if (side == 1)
+        return int2(d, b);
+    if (side == 2)
+        return int2(-1, d);
+    if (side == 3)
+        return int2(b, d);
+    return int2((d & 1) != 0 ? b : -1, (d & 2) != 0 ? b : -1);
+}
+
+// For a texel of the border ring (block-local), the texel inside the block it must copy so the octahedral map wraps:
+// edges mirror onto the same edge, corners take the opposite corner. Interior texels map to themselves.
+SDFGI_CONSTEXPR int2 SDFGIBorderSource(int2 border, uint blockResolution)
+{
+    int last = (int)blockResolution - 1;
+    bool outsideX = border.x < 0 || border.x > last;
+    bool outsideY = border.y < 0 || border.y > last;
+    if (outsideX && outsideY)
+        return int2(border.x < 0 ? last : 0, border.y < 0 ? last : 0);
+    if (outsideY)
+        return int2(last - border.x, border.y < 0 ? 0 : last);
+    if (outsideX)
+        return int2(border.x < 0 ? 0 : last, last - border.y);
+    return border;
+}
+
+// --- Grid reprojection ---
+
+SDFGI_CONSTEXPR float SDFGIClamp(float x, float lo, float hi)
+{
+    return x < lo ? lo : (x > hi ? hi : x);
+}
+
+// Where probe newProbe (integer grid coordinate) of a new grid sits in an old grid, in old-grid probe units, clamped to
+// the old grid. Probes of the new grid outside the old one take the nearest old probes' data.
+SDFGI_CONSTEXPR float3 SDFGIOldGridCoord(float3 newProbe, float3 newMin, float3 newSpacing,
+                                         float3 oldMin, float3 oldSpacing, float3 oldCount)
+{
+    return float3(SDFGIClamp((newMin.x + newProbe.x * newSpacing.x - oldMin.x) / oldSpacing.x, 0.0f, oldCount.x - 1.0f),
+                  SDFGIClamp((newMin.y + newProbe.y * newSpacing.y - oldMin.y) / oldSpacing.y, 0.0f, oldCount.y - 1.0f),
+                  SDFGIClamp((newMin.z + newProbe.z * newSpacing.z - oldMin.z) / oldSpacing.z, 0.0f, oldCount.z - 1.0f));
+}
+
+// First probe of the 2-probe trilinear footprint along one axis for a clamped old-grid coordinate. The footprint never
+// leaves the grid; with a single probe along the axis the second probe gets zero weight.
+SDFGI_CONSTEXPR uint SDFGITrilinearBase(float coord, float count)
+{
+    uint base = (uint)coord;
+    uint last = count > 1.0f ? (uint)count - 2 : 0;
+    return base < last ? base : last;
+}
+
+#ifdef __cplusplus
+} // namespace SDFGIAtlas
+#endif
+
+#endif // SDFGI_ATLAS_COMMON_H
@@ -0,0 +1,106 @@
+#include "pch.h"
+#include "SDFGIProbeScheduler.h"
+#include <algorithm>
+#include <cmath>
+
+namespace SDFGIProbeScheduler
+{
+    bool GetProbeRange(const float boundsMin[3], const float boundsMax[3], const float gridMin[3],
+        const float probeSpacing[3], const uint32_t probeCount[3], uint32_t probeMin[3], uint32_t probeMax[3])
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            const float lo = (boundsMin[axis] - gridMin[axis]) / probeSpacing[axis];
+            const float hi = (boundsMax[axis] - gridMin[axis]) / probeSpacing[axis];
+            // Probes on either side of the box see it, so round outwards.
+            if (probeCount[axis] == 0 || !(hi >= 0.0f) || !(lo <= probeCount[axis] - 1.0f))
+                return false;
+            probeMin[axis] = (uint32_t)std::max(std::floor(lo), 0.0f);
+            probeMax[axis] = (uint32_t)std::min(std::ceil(hi), probeCount[axis] - 1.0f);
+        }
+        return true;
+    }
+
+    void TileScheduler::Reset(const uint32_t probeCount[3], uint32_t tileSize)
+    {
+        ASSERT(tileSize > 0);
+        m_TileSize = tileSize;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            m_ProbeCount[axis] = probeCount[axis];
+            m_TileCount[axis] = (probeCount[axis] + tileSize - 1) / tileSize;
+        }
+        m_SweepCursor = 0;
+        m_Invalidated.assign(GetTileCount(), 1);
+    }
+
+    void TileScheduler::Invalidate(const uint32_t probeMin[3], const uint32_t probeMax[3])
+    {
+        uint32_t tileMin[3], tileMax[3];
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            if (m_ProbeCount[axis] == 0 || probeMin[axis] > probeMax[axis])
+                return;
+            tileMin[axis] = std::min(probeMin[axis], m_ProbeCount[axis] - 1) / m_TileSize;
+            tileMax[axis] = std::min(probeMax[axis], m_ProbeCount[axis] - 1) / m_TileSize;
+        }
+
+        for (uint32_t z = tileMin[2]; z <= tileMax[2]; ++z)
+            for (uint32_t y = tileMin[1]; y <= tileMax[1]; ++y)
+                for (uint32_t x = tileMin[0]; x <= tileMax[0]; ++x)
+                    m_Invalidated[(z * m_TileCount[1] + y) * m_TileCount[0] + x] = 1;
+    }
+
+    void TileScheduler::InvalidateAll()
+    {
+        std::fill(m_Invalidated.begin(), m_Invalidated.end(), (uint8_t)1);
+    }
+
+    void TileScheduler::AppendTile(uint32_t tile, std::vector<TileCommand>& commands, uint32_t& groups) const
+    {
+        const uint32_t tileXYZ[3] =
+        {
+            tile % m_TileCount[0],
+            tile / m_TileCount[0] % m_TileCount[1],
+            tile / (m_TileCount[0] * m_TileCount[1])
+        };
+
+        TileCommand command;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            // Tiles on the far edges of the grid are clipped to it.
+            command.tileOrigin[axis] = tileXYZ[axis] * m_TileSize;
+            command.groupCount[axis] = std::min(m_TileSize, m_ProbeCount[axis] - command.tileOrigin[axis]);
+        }
+        commands.push_back(command);
+        groups += command.groupCount[0] * command.groupCount[1] * command.groupCount[2];
+    }
+
+    uint32_t TileScheduler::BuildFrame(uint32_t updatePeriod, std::vector<TileCommand>& commands)
+    {
+        commands.clear();
+        const uint32_t tileCount = GetTileCount();
+        if (tileCount == 0)
+            return 0;
+
+        uint32_t groups = 0;
+        for (uint32_t tile = 0; tile < tileCount; ++tile)
+        {
+            if (m_Invalidated[tile])
+                AppendTile(tile, commands, groups);
+        }
+
+        // Tiles of the sweep that were just updated for being invalidated still count as swept.
+        const uint32_t sweepShare = (tileCount + std::max(updatePeriod, 1u) - 1) / std::max(updatePeriod, 1u);
+        for (uint32_t i = 0; i < sweepShare; ++i)
+        {
+            const uint32_t tile = m_SweepCursor;
+            m_SweepCursor = (m_SweepCursor + 1) % tileCount;
+            if (!m_Invalidated[tile])
+                AppendTile(tile, commands, groups);
+        }
+
+        std::fill(m_Invalidated.begin(), m_Invalidated.end(), (uint8_t)0);
+        return groups;
+    }
+}
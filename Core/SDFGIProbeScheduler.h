@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Decides which probes the SDFGI probe update touches each frame. The grid is split into tiles of probes; every frame
+// updates the tiles that were invalidated plus the next share of a round-robin sweep, so the whole grid is refreshed
+// once every updatePeriod frames at a steady per-frame cost. Each active tile becomes one indirect command: root
+// constants with the tile's first probe, then a dispatch of one group per probe in the tile.
+namespace SDFGIProbeScheduler
+{
+    // Probes per tile side.
+    const uint32_t kDefaultTileSize = 4;
+
+    // Layout of one command for a command signature of { Constant(3 dwords), Dispatch }.
+    struct TileCommand
+    {
+        uint32_t tileOrigin[3];
+        uint32_t groupCount[3];
+    };
+    static_assert(sizeof(TileCommand) == 24, "Must match the probe update command signature's stride");
+
+    // Finds the probes [probeMin, probeMax] (inclusive) on either side of a world-space box, in a grid whose first
+    // probe sits at gridMin. Returns false if the box misses the grid.
+    bool GetProbeRange(const float boundsMin[3], const float boundsMax[3], const float gridMin[3],
+        const float probeSpacing[3], const uint32_t probeCount[3], uint32_t probeMin[3], uint32_t probeMax[3]);
+
+    class TileScheduler
+    {
+    public:
+        // Starts over for a grid of probeCount probes. Every tile starts out invalidated.
+        void Reset(const uint32_t probeCount[3], uint32_t tileSize = kDefaultTileSize);
+
+        uint32_t GetTileCount() const { return m_TileCount[0] * m_TileCount[1] * m_TileCount[2]; }
+
+        // Forces the tiles overlapping probes [probeMin, probeMax] (inclusive) into the next frame.
+        void Invalidate(const uint32_t probeMin[3], const uint32_t probeMax[3]);
+        void InvalidateAll();
+
+        // Replaces commands with this frame's: the invalidated tiles, then enough tiles of the sweep to finish it
+        // within updatePeriod frames. Returns the number of thread groups the commands dispatch.
+        uint32_t BuildFrame(uint32_t updatePeriod, std::vector<TileCommand>& commands);
+
+    private:
+        void AppendTile(uint32_t tile, std::vector<TileCommand>& commands, uint32_t& groups) const;
+
+        uint32_t m_ProbeCount[3] = {};
+        uint32_t m_TileCount[3] = {};
+        uint32_t m_TileSize = kDefaultTileSize;
+        uint32_t m_SweepCursor = 0;
+        std::vector<uint8_t> m_Invalidated;
+    };
+}
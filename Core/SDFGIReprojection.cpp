@@ -0,0 +1,105 @@
+#include "pch.h"
+#include "SDFGIReprojection.h"
+#include <algorithm>
+
+using namespace SDFGIAtlas;
+
+namespace SDFGIReprojection
+{
+    static_assert(SDFGITrilinearBase(0.0f, 1.0f) == 0, "A single probe is its own footprint");
+    static_assert(SDFGITrilinearBase(3.0f, 4.0f) == 2, "The last probe is the far end of the last footprint");
+    static_assert(SDFGITrilinearBase(1.5f, 4.0f) == 1, "");
+    static_assert(SDFGIOldGridCoord(float3(0.0f, 0.0f, 0.0f), float3(-50.0f, 0.0f, 250.0f), float3(100.0f, 100.0f, 100.0f),
+        float3(0.0f, 0.0f, 0.0f), float3(100.0f, 100.0f, 100.0f), float3(4.0f, 4.0f, 4.0f)).x == 0.0f, "Clamps below the old grid");
+    static_assert(SDFGIOldGridCoord(float3(0.0f, 0.0f, 0.0f), float3(-50.0f, 0.0f, 250.0f), float3(100.0f, 100.0f, 100.0f),
+        float3(0.0f, 0.0f, 0.0f), float3(100.0f, 100.0f, 100.0f), float3(4.0f, 4.0f, 4.0f)).z == 2.5f, "");
+
+    Atlas CreateAtlas(const GridDesc& grid, uint channels, uint blockResolution, uint gutterSize)
+    {
+        Atlas atlas;
+        atlas.width = SDFGIAtlasExtent(grid.count[0], blockResolution, gutterSize);
+        atlas.height = SDFGIAtlasExtent(grid.count[1], blockResolution, gutterSize);
+        atlas.slices = grid.count[2];
+        atlas.channels = channels;
+        atlas.texels.assign((size_t)atlas.width * atlas.height * atlas.slices * channels, 0.0f);
+        return atlas;
+    }
+
+    void Reproject(const GridDesc& oldGrid, const Atlas& oldAtlas, const GridDesc& newGrid, Atlas& newAtlas,
+        uint blockResolution, uint gutterSize)
+    {
+        ASSERT(oldAtlas.channels == newAtlas.channels);
+        const float3 oldCount((float)oldGrid.count[0], (float)oldGrid.count[1], (float)oldGrid.count[2]);
+        const uint channels = newAtlas.channels;
+        std::vector<float> sum(channels);
+
+        for (uint pz = 0; pz < newGrid.count[2]; ++pz)
+        {
+            for (uint py = 0; py < newGrid.count[1]; ++py)
+            {
+                for (uint px = 0; px < newGrid.count[0]; ++px)
+                {
+                    const float3 oldCoord = SDFGIOldGridCoord(float3((float)px, (float)py, (float)pz),
+                        newGrid.minBounds, newGrid.spacing, oldGrid.minBounds, oldGrid.spacing, oldCount);
+                    const uint base[3] =
+                    {
+                        SDFGITrilinearBase(oldCoord.x, oldCount.x),
+                        SDFGITrilinearBase(oldCoord.y, oldCount.y),
+                        SDFGITrilinearBase(oldCoord.z, oldCount.z)
+                    };
+                    const float t[3] = { oldCoord.x - base[0], oldCoord.y - base[1], oldCoord.z - base[2] };
+                    const uint2 origin = SDFGIAtlasBlockOrigin(uint2(px, py), blockResolution, gutterSize);
+
+                    for (uint ty = 0; ty < blockResolution; ++ty)
+                    {
+                        for (uint tx = 0; tx < blockResolution; ++tx)
+                        {
+                            std::fill(sum.begin(), sum.end(), 0.0f);
+                            for (uint corner = 0; corner < 8; ++corner)
+                            {
+                                const uint offset[3] = { corner & 1, (corner >> 1) & 1, (corner >> 2) & 1 };
+                                const float weight =
+                                    (offset[0] ? t[0] : 1.0f - t[0]) *
+                                    (offset[1] ? t[1] : 1.0f - t[1]) *
+                                    (offset[2] ? t[2] : 1.0f - t[2]);
+                                if (weight == 0.0f)
+                                    continue;
+
+                                const uint2 oldOrigin = SDFGIAtlasBlockOrigin(uint2(base[0] + offset[0], base[1] + offset[1]), blockResolution, gutterSize);
+                                const float* oldTexel = oldAtlas.At(oldOrigin.x + tx, oldOrigin.y + ty, base[2] + offset[2]);
+                                for (uint c = 0; c < channels; ++c)
+                                    sum[c] += weight * oldTexel[c];
+                            }
+
+                            float* newTexel = newAtlas.At(origin.x + tx, origin.y + ty, pz);
+                            for (uint c = 0; c < channels; ++c)
+                                newTexel[c] = sum[c];
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    void FillBorders(const GridDesc& grid, Atlas& atlas, uint blockResolution, uint gutterSize)
+    {
+        for (uint pz = 0; pz < grid.count[2]; ++pz)
+        {
+            for (uint py = 0; py < grid.count[1]; ++py)
+            {
+                for (uint px = 0; px < grid.count[0]; ++px)
+                {
+                    const uint2 origin = SDFGIAtlasBlockOrigin(uint2(px, py), blockResolution, gutterSize);
+                    for (uint i = 0; i < SDFGI_ATLAS_BORDER_TEXELS(blockResolution); ++i)
+                    {
+                        const int2 border = SDFGIBorderTexel(i, blockResolution);
+                        const int2 source = SDFGIBorderSource(border, blockResolution);
+                        const float* from = atlas.At(origin.x + source.x, origin.y + source.y, pz);
+                        float* to = atlas.At(origin.x + border.x, origin.y + border.y, pz);
+                        std::copy(from, from + atlas.channels, to);
+                    }
+                }
+            }
+        }
+    }
+}
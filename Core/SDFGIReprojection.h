@@ -0,0 +1,44 @@
+#pragma once
+
+#include "SDFGIAtlasCommon.h"
+#include <vector>
+
+// CPU reference for SDFGIProbeReprojectCS, which carries converged probe irradiance and depth over to a new probe grid
+// when the grid scrolls, is resized or changes spacing, instead of restarting from black.
+namespace SDFGIReprojection
+{
+    using SDFGIAtlas::uint;
+    using SDFGIAtlas::float3;
+
+    struct GridDesc
+    {
+        float3 minBounds;
+        float3 spacing;
+        uint count[3];
+    };
+
+    // One atlas as the GPU lays it out: count[2] slices of SDFGIAtlasExtent texels squared, channels floats per texel.
+    struct Atlas
+    {
+        uint width = 0;
+        uint height = 0;
+        uint slices = 0;
+        uint channels = 0;
+        std::vector<float> texels;
+
+        float* At(uint x, uint y, uint slice) { return &texels[((size_t)slice * height + y) * width * channels + x * channels]; }
+        const float* At(uint x, uint y, uint slice) const { return &texels[((size_t)slice * height + y) * width * channels + x * channels]; }
+    };
+
+    // Zero-filled atlas for grid with the given block and gutter sizes.
+    Atlas CreateAtlas(const GridDesc& grid, uint channels,
+        uint blockResolution = SDFGI_ATLAS_BLOCK_RESOLUTION, uint gutterSize = SDFGI_ATLAS_GUTTER_SIZE);
+
+    // Writes every block texel of newAtlas from oldAtlas, exactly as the shader does. Gutters are left untouched.
+    void Reproject(const GridDesc& oldGrid, const Atlas& oldAtlas, const GridDesc& newGrid, Atlas& newAtlas,
+        uint blockResolution = SDFGI_ATLAS_BLOCK_RESOLUTION, uint gutterSize = SDFGI_ATLAS_GUTTER_SIZE);
+
+    // Fills the one-texel ring around every block, as SDFGIAtlasBorderUpdateCS does.
+    void FillBorders(const GridDesc& grid, Atlas& atlas,
+        uint blockResolution = SDFGI_ATLAS_BLOCK_RESOLUTION, uint gutterSize = SDFGI_ATLAS_GUTTER_SIZE);
+}
@@ -0,0 +1,440 @@
+#include "pch.h"
+#include "SDFHierarchy.h"
+#include <cfloat>
+#include <chrono>
+#include <random>
+
+namespace SDFHierarchy
+{
+    namespace
+    {
+        size_t LevelIndex(uint32_t levelResolution, uint32_t x, uint32_t y, uint32_t z)
+        {
+            return x + (size_t)levelResolution * (y + (size_t)levelResolution * z);
+        }
+
+        bool OutOfBounds(const Volume& volume, const int v[3])
+        {
+            const int last = (int)volume.resolution - 1;
+            return v[0] < 0 || v[1] < 0 || v[2] < 0 || v[0] > last || v[1] > last || v[2] > last;
+        }
+
+        struct Box
+        {
+            int lo[3];
+            int hi[3];
+        };
+
+        // Distance from an integer voxel to the nearest voxel of an (inclusive) integer box, as the jump flood would
+        // compute it.
+        float BoxDistance(const Box& box, int x, int y, int z)
+        {
+            const int v[3] = { x, y, z };
+            float sq = 0.0f;
+            for (int i = 0; i < 3; ++i)
+            {
+                int d = std::max(std::max(box.lo[i] - v[i], v[i] - box.hi[i]), 0);
+                sq += (float)(d * d);
+            }
+            return std::sqrt(sq);
+        }
+
+        // Walks the ray in eighths of a voxel, so that it can't pass through a surface voxel without landing in it.
+        // Slow, but what both traversals are measured against.
+        TraceResult TraceReference(const Volume& volume, const float eye[3], const float dir[3])
+        {
+            TraceResult result = {};
+            const int start[3] = { (int)eye[0], (int)eye[1], (int)eye[2] };
+            if (!OutOfBounds(volume, start) && volume.Fetch(0, start[0], start[1], start[2]) == 0.0f)
+                result.depth = SDF_START_ESCAPE_DISTANCE;
+
+            for (;; result.depth += 0.125f)
+            {
+                const int v[3] = {
+                    (int)(eye[0] + result.depth * dir[0]),
+                    (int)(eye[1] + result.depth * dir[1]),
+                    (int)(eye[2] + result.depth * dir[2])
+                };
+                if (OutOfBounds(volume, v))
+                    return result;
+
+                result.steps++;
+                if (volume.Fetch(0, v[0], v[1], v[2]) == 0.0f)
+                {
+                    result.hit = true;
+                    std::copy(v, v + 3, result.voxel);
+                    return result;
+                }
+            }
+        }
+
+        bool SameResult(const TraceResult& a, const TraceResult& b)
+        {
+            return a.hit == b.hit && (!a.hit || std::equal(a.voxel, a.voxel + 3, b.voxel));
+        }
+
+        // Squared distance transform of n values stride apart, in place: each becomes the least f[j] + (i - j)^2 over
+        // the finite f[j], the lower envelope of the parabolas rooted at them (Felzenszwalb and Huttenlocher). Values
+        // with no finite one in reach stay FLT_MAX. Every value is an integer well within float precision.
+        void DistanceTransform(float* values, size_t stride, uint32_t n, std::vector<float>& f, std::vector<int>& roots,
+            std::vector<float>& bounds)
+        {
+            f.resize(n);
+            roots.resize(n);
+            bounds.resize(n + 1);
+            for (uint32_t i = 0; i < n; ++i)
+                f[i] = values[i * stride];
+
+            int k = -1;
+            for (int q = 0; q < (int)n; ++q)
+            {
+                if (f[q] == FLT_MAX)
+                    continue;
+
+                float s = -FLT_MAX;
+                while (k >= 0)
+                {
+                    const int r = roots[k];
+                    s = ((f[q] + (float)(q * q)) - (f[r] + (float)(r * r))) / (float)(2 * (q - r));
+                    if (s > bounds[k])
+                        break;
+                    --k;
+                }
+                ++k;
+                roots[k] = q;
+                bounds[k] = k == 0 ? -FLT_MAX : s;
+            }
+            if (k < 0)
+                return;
+            bounds[k + 1] = FLT_MAX;
+
+            for (int q = 0, j = 0; q < (int)n; ++q)
+            {
+                while (bounds[j + 1] < (float)q)
+                    ++j;
+                const int d = q - roots[j];
+                values[q * stride] = (float)(d * d) + f[roots[j]];
+            }
+        }
+    }
+
+    float Volume::Fetch(uint32_t level, int x, int y, int z) const
+    {
+        const uint32_t levelResolution = SDFLevelResolution(resolution, level);
+        const uint32_t lx = (uint32_t)x >> level;
+        const uint32_t ly = SDFStorageCoord((uint32_t)y >> level, levelResolution);
+        const uint32_t lz = SDFStorageCoord((uint32_t)z >> level, levelResolution);
+        return levels[level][LevelIndex(levelResolution, lx, ly, lz)];
+    }
+
+    void BuildPyramid(Volume& volume)
+    {
+        ASSERT(volume.levels[0].size() == (size_t)volume.resolution * volume.resolution * volume.resolution);
+
+        for (uint32_t level = 1; level < SDF_HIERARCHY_LEVELS; ++level)
+        {
+            const std::vector<float>& src = volume.levels[level - 1];
+            const uint32_t srcResolution = SDFLevelResolution(volume.resolution, level - 1);
+            const uint32_t dstResolution = SDFLevelResolution(volume.resolution, level);
+            std::vector<float>& dst = volume.levels[level];
+            dst.resize((size_t)dstResolution * dstResolution * dstResolution);
+
+            for (uint32_t z = 0; z < dstResolution; ++z)
+            {
+                for (uint32_t y = 0; y < dstResolution; ++y)
+                {
+                    for (uint32_t x = 0; x < dstResolution; ++x)
+                    {
+                        const uint32_t sx = 2 * x, sy = 2 * y, sz = 2 * z;
+                        dst[LevelIndex(dstResolution, x, y, z)] = SDFMinReduce(
+                            src[LevelIndex(srcResolution, sx, sy, sz)], src[LevelIndex(srcResolution, sx + 1, sy, sz)],
+                            src[LevelIndex(srcResolution, sx, sy + 1, sz)], src[LevelIndex(srcResolution, sx + 1, sy + 1, sz)],
+                            src[LevelIndex(srcResolution, sx, sy, sz + 1)], src[LevelIndex(srcResolution, sx + 1, sy, sz + 1)],
+                            src[LevelIndex(srcResolution, sx, sy + 1, sz + 1)], src[LevelIndex(srcResolution, sx + 1, sy + 1, sz + 1)]);
+                    }
+                }
+            }
+        }
+    }
+
+    Volume BakeVolume(const std::vector<float>& triangles, uint32_t resolution)
+    {
+        const size_t voxelCount = (size_t)resolution * resolution * resolution;
+        std::vector<float> distances(voxelCount, FLT_MAX);
+
+        // Points no more than half a voxel apart leave no voxel a triangle crosses without one.
+        for (size_t t = 0; t + 9 <= triangles.size(); t += 9)
+        {
+            const float* a = &triangles[t];
+            const float* b = &triangles[t + 3];
+            const float* c = &triangles[t + 6];
+            const float* corners[3] = { a, b, c };
+            float longestEdge = 0.0f;
+            for (int e = 0; e < 3; ++e)
+            {
+                const float* p = corners[e];
+                const float* q = corners[(e + 1) % 3];
+                const float dx = q[0] - p[0], dy = q[1] - p[1], dz = q[2] - p[2];
+                longestEdge = std::max(longestEdge, std::sqrt(dx * dx + dy * dy + dz * dz));
+            }
+            const uint32_t steps = (uint32_t)std::ceil(longestEdge * 2.0f) + 1;
+
+            for (uint32_t i = 0; i <= steps; ++i)
+            {
+                for (uint32_t j = 0; i + j <= steps; ++j)
+                {
+                    const float u = (float)i / steps, v = (float)j / steps;
+                    int voxel[3];
+                    for (int axis = 0; axis < 3; ++axis)
+                        voxel[axis] = (int)std::floor(a[axis] + (b[axis] - a[axis]) * u + (c[axis] - a[axis]) * v);
+                    if (voxel[0] >= 0 && voxel[1] >= 0 && voxel[2] >= 0 &&
+                        voxel[0] < (int)resolution && voxel[1] < (int)resolution && voxel[2] < (int)resolution)
+                        distances[LevelIndex(resolution, voxel[0], voxel[1], voxel[2])] = 0.0f;
+                }
+            }
+        }
+
+        // The squared distance transform separates into one pass along each axis.
+        std::vector<float> f, bounds;
+        std::vector<int> roots;
+        const size_t row = resolution, slice = (size_t)resolution * resolution;
+        for (uint32_t z = 0; z < resolution; ++z)
+        {
+            for (uint32_t y = 0; y < resolution; ++y)
+                DistanceTransform(&distances[LevelIndex(resolution, 0, y, z)], 1, resolution, f, roots, bounds);
+        }
+        for (uint32_t z = 0; z < resolution; ++z)
+        {
+            for (uint32_t x = 0; x < resolution; ++x)
+                DistanceTransform(&distances[LevelIndex(resolution, x, 0, z)], row, resolution, f, roots, bounds);
+        }
+        for (uint32_t y = 0; y < resolution; ++y)
+        {
+            for (uint32_t x = 0; x < resolution; ++x)
+                DistanceTransform(&distances[LevelIndex(resolution, x, y, 0)], slice, resolution, f, roots, bounds);
+        }
+
+        Volume volume;
+        volume.resolution = resolution;
+        volume.levels[0].resize(voxelCount);
+        for (uint32_t z = 0; z < resolution; ++z)
+        {
+            for (uint32_t y = 0; y < resolution; ++y)
+            {
+                const size_t src = LevelIndex(resolution, 0, y, z);
+                const size_t dst = LevelIndex(resolution, 0, SDFStorageCoord(y, resolution), SDFStorageCoord(z, resolution));
+                for (uint32_t x = 0; x < resolution; ++x)
+                    volume.levels[0][dst + x] = std::sqrt(distances[src + x]);
+            }
+        }
+
+        BuildPyramid(volume);
+        return volume;
+    }
+
+    TraceResult TraceLinear(const Volume& volume, const float eye[3], const float dir[3], uint32_t maxSteps)
+    {
+        TraceResult result = {};
+        for (uint32_t i = 0; i < maxSteps; ++i)
+        {
+            result.steps = i + 1;
+            const int v[3] = {
+                (int)(eye[0] + result.depth * dir[0]),
+                (int)(eye[1] + result.depth * dir[1]),
+                (int)(eye[2] + result.depth * dir[2])
+            };
+            if (OutOfBounds(volume, v))
+                return result;
+
+            float dist = volume.Fetch(0, v[0], v[1], v[2]);
+            if (dist == 0.0f)
+            {
+                if (i != 0)
+                {
+                    result.hit = true;
+                    std::copy(v, v + 3, result.voxel);
+                    return result;
+                }
+                dist = SDF_START_ESCAPE_DISTANCE;
+            }
+            result.depth += dist;
+        }
+        return result;
+    }
+
+    TraceResult TraceHierarchical(const Volume& volume, const float eye[3], const float dir[3], uint32_t maxSteps)
+    {
+        TraceResult result = {};
+        // The exact distance at the origin picks the first coarse level.
+        uint32_t level = 0;
+
+        for (uint32_t i = 0; i < maxSteps; ++i)
+        {
+            result.steps = i + 1;
+            const float p[3] = {
+                eye[0] + result.depth * dir[0],
+                eye[1] + result.depth * dir[1],
+                eye[2] + result.depth * dir[2]
+            };
+            const int v[3] = { (int)p[0], (int)p[1], (int)p[2] };
+            if (OutOfBounds(volume, v))
+                return result;
+
+            float dist = volume.Fetch(level, v[0], v[1], v[2]);
+
+            if (level > 0)
+            {
+                if (SDFCellIsEmpty(dist))
+                {
+                    const float cellSize = (float)(1u << level);
+                    const float exitDistance = SDFCellExitDistance(p[0], p[1], p[2], dir[0], dir[1], dir[2], cellSize);
+                    result.depth += SDFCoarseAdvance(dist, exitDistance);
+                    level = std::max(level, SDFLevelForDistance(dist));
+                }
+                else
+                {
+                    level--;
+                }
+                continue;
+            }
+
+            if (dist == 0.0f)
+            {
+                if (result.depth > 0.0f)
+                {
+                    result.hit = true;
+                    std::copy(v, v + 3, result.voxel);
+                    return result;
+                }
+                dist = SDF_START_ESCAPE_DISTANCE;
+            }
+            result.depth += dist;
+            level = SDFLevelForDistance(dist);
+        }
+        return result;
+    }
+
+    Volume CreateTestVolume(uint32_t resolution)
+    {
+        const int r = (int)resolution;
+        const Box boxes[] = {
+            { { 0, 0, 0 }, { r - 1, 1, r - 1 } },               // floor
+            { { 0, 0, 0 }, { 1, r / 2, r - 1 } },               // wall
+            { { 0, 0, 0 }, { r - 1, r / 2, 1 } },               // wall
+            { { r / 4, 0, r / 4 }, { r / 4 + 3, r / 3, r / 4 + 3 } },
+            { { r / 2, 0, r / 4 }, { r / 2 + 3, r / 3, r / 4 + 3 } },
+            { { r / 4, 0, r / 2 }, { r / 4 + 3, r / 3, r / 2 + 3 } },
+            { { r / 2, 0, r / 2 }, { r / 2 + 3, r / 3, r / 2 + 3 } },
+        };
+
+        Volume volume;
+        volume.resolution = resolution;
+        volume.levels[0].resize((size_t)resolution * resolution * resolution);
+
+        for (int z = 0; z < r; ++z)
+        {
+            for (int y = 0; y < r; ++y)
+            {
+                for (int x = 0; x < r; ++x)
+                {
+                    float dist = FLT_MAX;
+                    for (const Box& box : boxes)
+                        dist = std::min(dist, BoxDistance(box, x, y, z));
+
+                    const uint32_t sy = SDFStorageCoord((uint32_t)y, resolution);
+                    const uint32_t sz = SDFStorageCoord((uint32_t)z, resolution);
+                    volume.levels[0][LevelIndex(resolution, x, sy, sz)] = dist;
+                }
+            }
+        }
+
+        BuildPyramid(volume);
+        return volume;
+    }
+
+    std::vector<float> CreateRandomRays(const Volume& volume, uint32_t rayCount, uint32_t seed)
+    {
+        std::mt19937 gen(seed);
+        std::uniform_real_distribution<float> position(0.1f * volume.resolution, 0.9f * volume.resolution);
+        std::normal_distribution<float> direction(0.0f, 1.0f);
+
+        std::vector<float> rays(rayCount * 6);
+        for (uint32_t i = 0; i < rayCount; ++i)
+        {
+            float* ray = &rays[i * 6];
+            ray[0] = position(gen);
+            ray[1] = position(gen);
+            ray[2] = position(gen);
+
+            float len = 0.0f;
+            do {
+                ray[3] = direction(gen);
+                ray[4] = direction(gen);
+                ray[5] = direction(gen);
+                len = std::sqrt(ray[3] * ray[3] + ray[4] * ray[4] + ray[5] * ray[5]);
+            } while (len < 1e-4f);
+            ray[3] /= len;
+            ray[4] /= len;
+            ray[5] /= len;
+        }
+        return rays;
+    }
+
+    void Benchmark(const Volume& volume, uint32_t rayCount, uint32_t seed)
+    {
+        const std::vector<float> rays = CreateRandomRays(volume, rayCount, seed);
+
+        std::vector<TraceResult> linear(rayCount), hierarchical(rayCount);
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for (uint32_t i = 0; i < rayCount; ++i)
+            linear[i] = TraceLinear(volume, &rays[i * 6], &rays[i * 6 + 3]);
+        auto mid = std::chrono::high_resolution_clock::now();
+        for (uint32_t i = 0; i < rayCount; ++i)
+            hierarchical[i] = TraceHierarchical(volume, &rays[i * 6], &rays[i * 6 + 3]);
+        auto end = std::chrono::high_resolution_clock::now();
+
+        uint64_t linearSteps = 0, hierarchicalSteps = 0;
+        uint64_t linearEscapeSteps = 0, hierarchicalEscapeSteps = 0;
+        uint32_t escapes = 0, agree = 0, linearCorrect = 0, hierarchicalCorrect = 0;
+        for (uint32_t i = 0; i < rayCount; ++i)
+        {
+            linearSteps += linear[i].steps;
+            hierarchicalSteps += hierarchical[i].steps;
+            if (!linear[i].hit)
+            {
+                ++escapes;
+                linearEscapeSteps += linear[i].steps;
+                hierarchicalEscapeSteps += hierarchical[i].steps;
+            }
+            if (SameResult(linear[i], hierarchical[i]))
+                ++agree;
+        }
+
+        // The reference march is slow enough that a sample of the rays tells as much.
+        const uint32_t referenceCount = std::min(rayCount, 10000u);
+        for (uint32_t i = 0; i < referenceCount; ++i)
+        {
+            const TraceResult reference = TraceReference(volume, &rays[i * 6], &rays[i * 6 + 3]);
+            if (SameResult(linear[i], reference))
+                ++linearCorrect;
+            if (SameResult(hierarchical[i], reference))
+                ++hierarchicalCorrect;
+        }
+
+        const double linearMs = std::chrono::duration<double, std::milli>(mid - start).count();
+        const double hierarchicalMs = std::chrono::duration<double, std::milli>(end - mid).count();
+
+        Utility::Printf("SDF traversal benchmark: %u rays, %u^3 volume\n", rayCount, volume.resolution);
+        Utility::Printf("  linear:       %6.1f steps/ray, %8.2f ms, %6.2f%% as the reference march\n",
+            (double)linearSteps / rayCount, linearMs, 100.0 * linearCorrect / referenceCount);
+        Utility::Printf("  hierarchical: %6.1f steps/ray, %8.2f ms, %6.2f%% as the reference march\n",
+            (double)hierarchicalSteps / rayCount, hierarchicalMs, 100.0 * hierarchicalCorrect / referenceCount);
+        if (escapes > 0)
+        {
+            Utility::Printf("  escaping rays (%u): %.1f -> %.1f steps/ray\n", escapes,
+                (double)linearEscapeSteps / escapes, (double)hierarchicalEscapeSteps / escapes);
+        }
+        Utility::Printf("  same result: %.2f%%\n", 100.0 * agree / rayCount);
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "SDFHierarchyCommon.h"
+#include <cstdint>
+#include <vector>
+
+// CPU reference for the SDF min-distance pyramid and its hierarchical traversal. The GPU path (SDFMinMipCS.hlsl and
+// SDFHierarchy.hlsli) is built from the same SDFHierarchyCommon.h, so this is what the shaders are checked against.
+namespace SDFHierarchy
+{
+    // An SDF and its pyramid, laid out exactly like the GPU textures: x fastest, y and z flipped.
+    struct Volume
+    {
+        uint32_t resolution = 0;
+        std::vector<float> levels[SDF_HIERARCHY_LEVELS];
+
+        // Fetch by texture-space voxel coordinate (level 0 units), applying the storage flip.
+        float Fetch(uint32_t level, int x, int y, int z) const;
+    };
+
+    struct TraceResult
+    {
+        bool hit;
+        // Texel-space distance travelled.
+        float depth;
+        // Number of SDF fetches, at any level.
+        uint32_t steps;
+        // Texture-space voxel that was hit.
+        int voxel[3];
+    };
+
+    // Fills levels[1..] from levels[0].
+    void BuildPyramid(Volume& volume);
+
+    // The SDF of triangles, 9 floats apiece in texture-space voxel units (voxel v spans [v, v + 1)), as the jump flood
+    // would compute it from their voxelization: the distance from every voxel to the nearest one a triangle passes
+    // through. Builds the pyramid too. Parts of triangles outside the volume are left out.
+    Volume BakeVolume(const std::vector<float>& triangles, uint32_t resolution);
+
+    // The single-resolution march SampleSDFAlbedo and SDFDebugRayMarchPS ran before the pyramid: a full step of the
+    // distance at every voxel, which is few fetches but can step over thin surfaces. Kept as the baseline.
+    TraceResult TraceLinear(const Volume& volume, const float eye[3], const float dir[3], uint32_t maxSteps = 512);
+
+    // Same traversal as SDFHierarchyTrace in SDFHierarchy.hlsli.
+    TraceResult TraceHierarchical(const Volume& volume, const float eye[3], const float dir[3], uint32_t maxSteps = 512);
+
+    // A floor, two walls and a few pillars; leaves plenty of open sky for escaping rays.
+    Volume CreateTestVolume(uint32_t resolution);
+
+    // rayCount random rays inside the middle 80% of the volume, 6 floats each: texture-space origin, then unit direction.
+    std::vector<float> CreateRandomRays(const Volume& volume, uint32_t rayCount, uint32_t seed);
+
+    // Traces rayCount random rays with both methods and prints average steps, timings, how often each agrees with a
+    // march too fine to miss a surface, and how often they agree with each other.
+    void Benchmark(const Volume& volume, uint32_t rayCount, uint32_t seed = 1);
+}
@@ -0,0 +1,102 @@
+// Min-distance mip pyramid of the SDF volume, shared between C++ and HLSL.
+//
+// Level 0 is the full resolution SDF written by the jump flood (distance, in voxels, from each voxel to the nearest
+// surface voxel; 0 at the surface). Level L stores, for each cell of 2^L x 2^L x 2^L voxels, the minimum level 0
+// distance found inside the cell. A cell whose minimum is non-zero contains no surface voxel, so a ray can skip it
+// entirely instead of crawling through it one sphere step at a time.
+//
+// Everything in here must stay valid HLSL and valid C++: scalar math only, no references, no overloads.
+
+#ifndef SDF_HIERARCHY_COMMON_H
+#define SDF_HIERARCHY_COMMON_H
+
+#ifdef __cplusplus
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#define SDF_SHARED inline
+namespace SDFHierarchy
+{
+    typedef uint32_t uint;
+    using std::min;
+    using std::max;
+    using std::floor;
+#else
+#define SDF_SHARED
+#endif
+
+// Levels in the pyramid, including level 0. 512^3 -> 32^3 at the top.
+#define SDF_HIERARCHY_LEVELS 5
+#define SDF_HIERARCHY_COARSE_LEVELS (SDF_HIERARCHY_LEVELS - 1)
+
+// The SDF is sampled at integer voxel coordinates but rays are truncated to voxels, so a point inside a voxel can be
+// up to one voxel diagonal closer to the surface than the stored value says. Skipping ahead loses a second diagonal
+// because the voxel the ray lands in is truncated as well.
+#define SDF_VOXEL_DIAGONAL 1.7320508f
+
+// Nudges a ray past the face of the cell it is leaving so the next lookup lands in the neighbouring cell.
+#define SDF_CELL_EXIT_BIAS 0.01f
+
+// Step taken when a ray starts inside a surface voxel (e.g. a probe sitting in a wall).
+#define SDF_START_ESCAPE_DISTANCE 4.0f
+
+SDF_SHARED uint SDFLevelResolution(uint baseResolution, uint level)
+{
+    return max(baseResolution >> level, 1u);
+}
+
+// The SDF texture is stored with y and z flipped relative to texture space. Flipping commutes with the 2x reduction
+// because resolutions are powers of two, so coarse levels use the same convention.
+SDF_SHARED uint SDFStorageCoord(uint texCoord, uint levelResolution)
+{
+    return levelResolution - 1 - texCoord;
+}
+
+SDF_SHARED float SDFMinReduce(float a, float b, float c, float d, float e, float f, float g, float h)
+{
+    return min(min(min(a, b), min(c, d)), min(min(e, f), min(g, h)));
+}
+
+SDF_SHARED bool SDFCellIsEmpty(float cellMinDistance)
+{
+    return cellMinDistance > 0.0f;
+}
+
+// Ray parameter at which a ray at texel-space coordinate p (one axis) leaves its cell of the given size.
+SDF_SHARED float SDFAxisExitDistance(float p, float dir, float cellSize)
+{
+    float cellMin = floor(p / cellSize) * cellSize;
+    if (dir > 0.0f)
+        return (cellMin + cellSize - p) / dir;
+    if (dir < 0.0f)
+        return (cellMin - p) / dir;
+    return 3.402823466e+38f;
+}
+
+SDF_SHARED float SDFCellExitDistance(float px, float py, float pz, float dx, float dy, float dz, float cellSize)
+{
+    return min(SDFAxisExitDistance(px, dx, cellSize), min(SDFAxisExitDistance(py, dy, cellSize), SDFAxisExitDistance(pz, dz, cellSize)));
+}
+
+// How far a ray may advance through an empty coarse cell: to the far side of the cell, and from there on by the cell's
+// minimum distance, which holds at the exit point as much as anywhere else in the cell.
+SDF_SHARED float SDFCoarseAdvance(float cellMinDistance, float exitDistance)
+{
+    return exitDistance + SDF_CELL_EXIT_BIAS + max(cellMinDistance - 2.0f * SDF_VOXEL_DIAGONAL, 0.0f);
+}
+
+// The coarsest level whose cells are at most a quarter of a distance the ray is known to be clear by, so that the
+// next lookup is likely to land in an empty cell without skipping less than a finer one would.
+SDF_SHARED uint SDFLevelForDistance(float distance)
+{
+    uint level = 0;
+    while (level < SDF_HIERARCHY_COARSE_LEVELS && (float)(4u << level) <= distance)
+        level++;
+    return level;
+}
+
+#ifdef __cplusplus
+} // namespace SDFHierarchy
+#endif
+
+#endif // SDF_HIERARCHY_COMMON_H
@@ -0,0 +1,569 @@
+#include "pch.h"
+#include "SDFPacketTracer.h"
+#include <chrono>
+#include <immintrin.h>
+
+// MSVC compiles any intrinsic anywhere; GCC and Clang only inside functions marked with its instruction set, so the ops
+// of each ISA are marked, and the traversal is forced inline into a marked entry point per ISA.
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SIMD_FUNCTION(isa)
+#define SIMD_INLINE __forceinline
+#else
+#include <cpuid.h>
+#define SIMD_FUNCTION(isa) __attribute__((target(isa)))
+#define SIMD_INLINE inline __attribute__((always_inline))
+#endif
+#define SSE4_FUNCTION SIMD_FUNCTION("sse4.1")
+#define AVX2_FUNCTION SIMD_FUNCTION("avx2")
+#define AVX512_FUNCTION SIMD_FUNCTION("avx512f")
+
+using namespace SDFHierarchy;
+
+namespace SDFPacketTracer
+{
+    namespace
+    {
+        // Each ISA wraps its float vector (F), int vector (I) and lane mask (M) behind the same handful of operations so
+        // that TracePacketT below is written once. SSE and AVX2 masks are all-ones lanes; AVX-512 masks are k-registers.
+        // MinF and MaxF pick their operands like std::min and std::max do, so that ties between -0 and +0 match too.
+
+        struct SSE4
+        {
+            static const uint32_t Width = 4;
+            typedef __m128 F;
+            typedef __m128i I;
+            typedef __m128i M;
+
+            // No masked load before AVX; a partial packet is loaded lane by lane so nothing past the batch is read.
+            SSE4_FUNCTION static F LoadF(const float* p, M m)
+            {
+                const uint32_t bits = ToBits(m);
+                if (bits == 0xF)
+                    return _mm_loadu_ps(p);
+
+                alignas(16) float lanes[4] = {};
+                for (uint32_t lane = 0; lane < 4; ++lane)
+                {
+                    if (bits & (1u << lane))
+                        lanes[lane] = p[lane];
+                }
+                return _mm_load_ps(lanes);
+            }
+            SSE4_FUNCTION static F SetF(float f) { return _mm_set1_ps(f); }
+            SSE4_FUNCTION static I SetI(int i) { return _mm_set1_epi32(i); }
+            SSE4_FUNCTION static F Add(F a, F b) { return _mm_add_ps(a, b); }
+            SSE4_FUNCTION static F Sub(F a, F b) { return _mm_sub_ps(a, b); }
+            SSE4_FUNCTION static F Mul(F a, F b) { return _mm_mul_ps(a, b); }
+            SSE4_FUNCTION static F Div(F a, F b) { return _mm_div_ps(a, b); }
+            SSE4_FUNCTION static F MinF(F a, F b) { return _mm_min_ps(b, a); }
+            SSE4_FUNCTION static F MaxF(F a, F b) { return _mm_max_ps(b, a); }
+            SSE4_FUNCTION static F Floor(F a) { return _mm_floor_ps(a); }
+            SSE4_FUNCTION static I AddI(I a, I b) { return _mm_add_epi32(a, b); }
+            SSE4_FUNCTION static I SubI(I a, I b) { return _mm_sub_epi32(a, b); }
+            SSE4_FUNCTION static I MulI(I a, I b) { return _mm_mullo_epi32(a, b); }
+            SSE4_FUNCTION static I MaxI(I a, I b) { return _mm_max_epi32(a, b); }
+            SSE4_FUNCTION static I ShiftRightI(I a, uint32_t n) { return _mm_srl_epi32(a, _mm_cvtsi32_si128((int)n)); }
+            SSE4_FUNCTION static I Truncate(F a) { return _mm_cvttps_epi32(a); }
+
+            SSE4_FUNCTION static M FromBits(uint32_t bits)
+            {
+                const __m128i laneBits = _mm_setr_epi32(1, 2, 4, 8);
+                return _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32((int)bits), laneBits), laneBits);
+            }
+            SSE4_FUNCTION static uint32_t ToBits(M m) { return (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(m)); }
+            SSE4_FUNCTION static M And(M a, M b) { return _mm_and_si128(a, b); }
+            SSE4_FUNCTION static M Or(M a, M b) { return _mm_or_si128(a, b); }
+            SSE4_FUNCTION static M AndNot(M a, M b) { return _mm_andnot_si128(b, a); }
+            SSE4_FUNCTION static M LessI(I a, I b) { return _mm_cmplt_epi32(a, b); }
+            SSE4_FUNCTION static M GreaterI(I a, I b) { return _mm_cmpgt_epi32(a, b); }
+            SSE4_FUNCTION static M EqualI(I a, I b) { return _mm_cmpeq_epi32(a, b); }
+            SSE4_FUNCTION static M EqualF(F a, F b) { return _mm_castps_si128(_mm_cmpeq_ps(a, b)); }
+            SSE4_FUNCTION static M GreaterF(F a, F b) { return _mm_castps_si128(_mm_cmpgt_ps(a, b)); }
+            SSE4_FUNCTION static M LessEqualF(F a, F b) { return _mm_castps_si128(_mm_cmple_ps(a, b)); }
+
+            SSE4_FUNCTION static F SelectF(M m, F a, F b) { return _mm_blendv_ps(b, a, _mm_castsi128_ps(m)); }
+            SSE4_FUNCTION static I SelectI(M m, I a, I b) { return _mm_blendv_epi8(b, a, m); }
+            SSE4_FUNCTION static F MaskAdd(M m, F a, F b) { return _mm_add_ps(a, _mm_and_ps(b, _mm_castsi128_ps(m))); }
+            SSE4_FUNCTION static I MaskIncrement(M m, I a) { return _mm_sub_epi32(a, m); }
+
+            // No gather instruction; fetch only the active lanes, the others keep their value from inactive.
+            SSE4_FUNCTION static F Gather(const float* base, I index, M m, F inactive)
+            {
+                alignas(16) int idx[4];
+                alignas(16) float out[4];
+                _mm_store_si128((__m128i*)idx, index);
+                _mm_store_ps(out, inactive);
+                uint32_t bits = ToBits(m);
+                for (uint32_t lane = 0; lane < 4; ++lane)
+                {
+                    if (bits & (1u << lane))
+                        out[lane] = base[idx[lane]];
+                }
+                return _mm_load_ps(out);
+            }
+
+            SSE4_FUNCTION static void StoreF(float* p, F a) { _mm_storeu_ps(p, a); }
+            SSE4_FUNCTION static void StoreI(int* p, I a) { _mm_storeu_si128((__m128i*)p, a); }
+        };
+
+        struct AVX2
+        {
+            static const uint32_t Width = 8;
+            typedef __m256 F;
+            typedef __m256i I;
+            typedef __m256i M;
+
+            AVX2_FUNCTION static F LoadF(const float* p, M m) { return _mm256_maskload_ps(p, m); }
+            AVX2_FUNCTION static F SetF(float f) { return _mm256_set1_ps(f); }
+            AVX2_FUNCTION static I SetI(int i) { return _mm256_set1_epi32(i); }
+            AVX2_FUNCTION static F Add(F a, F b) { return _mm256_add_ps(a, b); }
+            AVX2_FUNCTION static F Sub(F a, F b) { return _mm256_sub_ps(a, b); }
+            AVX2_FUNCTION static F Mul(F a, F b) { return _mm256_mul_ps(a, b); }
+            AVX2_FUNCTION static F Div(F a, F b) { return _mm256_div_ps(a, b); }
+            AVX2_FUNCTION static F MinF(F a, F b) { return _mm256_min_ps(b, a); }
+            AVX2_FUNCTION static F MaxF(F a, F b) { return _mm256_max_ps(b, a); }
+            AVX2_FUNCTION static F Floor(F a) { return _mm256_floor_ps(a); }
+            AVX2_FUNCTION static I AddI(I a, I b) { return _mm256_add_epi32(a, b); }
+            AVX2_FUNCTION static I SubI(I a, I b) { return _mm256_sub_epi32(a, b); }
+            AVX2_FUNCTION static I MulI(I a, I b) { return _mm256_mullo_epi32(a, b); }
+            AVX2_FUNCTION static I MaxI(I a, I b) { return _mm256_max_epi32(a, b); }
+            AVX2_FUNCTION static I ShiftRightI(I a, uint32_t n) { return _mm256_srl_epi32(a, _mm_cvtsi32_si128((int)n)); }
+            AVX2_FUNCTION static I Truncate(F a) { return _mm256_cvttps_epi32(a); }
+
+            AVX2_FUNCTION static M FromBits(uint32_t bits)
+            {
+                const __m256i laneBits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+                return _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32((int)bits), laneBits), laneBits);
+            }
+            AVX2_FUNCTION static uint32_t ToBits(M m) { return (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(m)); }
+            AVX2_FUNCTION static M And(M a, M b) { return _mm256_and_si256(a, b); }
+            AVX2_FUNCTION static M Or(M a, M b) { return _mm256_or_si256(a, b); }
+            AVX2_FUNCTION static M AndNot(M a, M b) { return _mm256_andnot_si256(b, a); }
+            AVX2_FUNCTION static M LessI(I a, I b) { return _mm256_cmpgt_epi32(b, a); }
+            AVX2_FUNCTION static M GreaterI(I a, I b) { return _mm256_cmpgt_epi32(a, b); }
+            AVX2_FUNCTION static M EqualI(I a, I b) { return _mm256_cmpeq_epi32(a, b); }
+            AVX2_FUNCTION static M EqualF(F a, F b) { return _mm256_castps_si256(_mm256_cmp_ps(a, b, _CMP_EQ_OQ)); }
+            AVX2_FUNCTION static M GreaterF(F a, F b) { return _mm256_castps_si256(_mm256_cmp_ps(a, b, _CMP_GT_OQ)); }
+            AVX2_FUNCTION static M LessEqualF(F a, F b) { return _mm256_castps_si256(_mm256_cmp_ps(a, b, _CMP_LE_OQ)); }
+
+            AVX2_FUNCTION static F SelectF(M m, F a, F b) { return _mm256_blendv_ps(b, a, _mm256_castsi256_ps(m)); }
+            AVX2_FUNCTION static I SelectI(M m, I a, I b) { return _mm256_blendv_epi8(b, a, m); }
+            AVX2_FUNCTION static F MaskAdd(M m, F a, F b) { return _mm256_add_ps(a, _mm256_and_ps(b, _mm256_castsi256_ps(m))); }
+            AVX2_FUNCTION static I MaskIncrement(M m, I a) { return _mm256_sub_epi32(a, m); }
+
+            AVX2_FUNCTION static F Gather(const float* base, I index, M m, F inactive)
+            {
+                return _mm256_mask_i32gather_ps(inactive, base, index, _mm256_castsi256_ps(m), 4);
+            }
+
+            AVX2_FUNCTION static void StoreF(float* p, F a) { _mm256_storeu_ps(p, a); }
+            AVX2_FUNCTION static void StoreI(int* p, I a) { _mm256_storeu_si256((__m256i*)p, a); }
+        };
+
+        struct AVX512
+        {
+            static const uint32_t Width = 16;
+            typedef __m512 F;
+            typedef __m512i I;
+            typedef __mmask16 M;
+
+            AVX512_FUNCTION static F LoadF(const float* p, M m) { return _mm512_maskz_loadu_ps(m, p); }
+            AVX512_FUNCTION static F SetF(float f) { return _mm512_set1_ps(f); }
+            AVX512_FUNCTION static I SetI(int i) { return _mm512_set1_epi32(i); }
+            AVX512_FUNCTION static F Add(F a, F b) { return _mm512_add_ps(a, b); }
+            AVX512_FUNCTION static F Sub(F a, F b) { return _mm512_sub_ps(a, b); }
+            AVX512_FUNCTION static F Mul(F a, F b) { return _mm512_mul_ps(a, b); }
+            AVX512_FUNCTION static F Div(F a, F b) { return _mm512_div_ps(a, b); }
+            AVX512_FUNCTION static F MinF(F a, F b) { return _mm512_min_ps(b, a); }
+            AVX512_FUNCTION static F MaxF(F a, F b) { return _mm512_max_ps(b, a); }
+            AVX512_FUNCTION static F Floor(F a) { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEG_INF); }
+            AVX512_FUNCTION static I AddI(I a, I b) { return _mm512_add_epi32(a, b); }
+            AVX512_FUNCTION static I SubI(I a, I b) { return _mm512_sub_epi32(a, b); }
+            AVX512_FUNCTION static I MulI(I a, I b) { return _mm512_mullo_epi32(a, b); }
+            AVX512_FUNCTION static I MaxI(I a, I b) { return _mm512_max_epi32(a, b); }
+            AVX512_FUNCTION static I ShiftRightI(I a, uint32_t n) { return _mm512_srl_epi32(a, _mm_cvtsi32_si128((int)n)); }
+            AVX512_FUNCTION static I Truncate(F a) { return _mm512_cvttps_epi32(a); }
+
+            AVX512_FUNCTION static M FromBits(uint32_t bits) { return (M)bits; }
+            AVX512_FUNCTION static uint32_t ToBits(M m) { return (uint32_t)m; }
+            AVX512_FUNCTION static M And(M a, M b) { return (M)(a & b); }
+            AVX512_FUNCTION static M Or(M a, M b) { return (M)(a | b); }
+            AVX512_FUNCTION static M AndNot(M a, M b) { return (M)(a & ~b); }
+            AVX512_FUNCTION static M LessI(I a, I b) { return _mm512_cmplt_epi32_mask(a, b); }
+            AVX512_FUNCTION static M GreaterI(I a, I b) { return _mm512_cmpgt_epi32_mask(a, b); }
+            AVX512_FUNCTION static M EqualI(I a, I b) { return _mm512_cmpeq_epi32_mask(a, b); }
+            AVX512_FUNCTION static M EqualF(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_EQ_OQ); }
+            AVX512_FUNCTION static M GreaterF(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+            AVX512_FUNCTION static M LessEqualF(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ); }
+
+            AVX512_FUNCTION static F SelectF(M m, F a, F b) { return _mm512_mask_blend_ps(m, b, a); }
+            AVX512_FUNCTION static I SelectI(M m, I a, I b) { return _mm512_mask_blend_epi32(m, b, a); }
+            AVX512_FUNCTION static F MaskAdd(M m, F a, F b) { return _mm512_mask_add_ps(a, m, a, b); }
+            AVX512_FUNCTION static I MaskIncrement(M m, I a) { return _mm512_mask_add_epi32(a, m, a, _mm512_set1_epi32(1)); }
+
+            AVX512_FUNCTION static F Gather(const float* base, I index, M m, F inactive)
+            {
+                return _mm512_mask_i32gather_ps(inactive, m, index, base, 4);
+            }
+
+            AVX512_FUNCTION static void StoreF(float* p, F a) { _mm512_storeu_ps(p, a); }
+            AVX512_FUNCTION static void StoreI(int* p, I a) { _mm512_storeu_si512(p, a); }
+        };
+
+        // SDFAxisExitDistance for every lane.
+        template <typename S>
+        SIMD_INLINE typename S::F AxisExitDistance(typename S::F p, typename S::F dir, typename S::F cellSize)
+        {
+            typedef typename S::F F;
+            const F zero = S::SetF(0.0f);
+            const F cellMin = S::Mul(S::Floor(S::Div(p, cellSize)), cellSize);
+            const F forward = S::Div(S::Sub(S::Add(cellMin, cellSize), p), dir);
+            const F backward = S::Div(S::Sub(cellMin, p), dir);
+            return S::SelectF(S::GreaterF(dir, zero), forward,
+                S::SelectF(S::GreaterF(zero, dir), backward, S::SetF(3.402823466e+38f)));
+        }
+
+        // SDFLevelForDistance for every lane: the number of coarse levels whose threshold the distance reaches.
+        template <typename S>
+        SIMD_INLINE typename S::I LevelForDistance(typename S::F distance)
+        {
+            typename S::I level = S::SetI(0);
+            for (uint32_t l = 0; l < SDF_HIERARCHY_COARSE_LEVELS; ++l)
+                level = S::MaskIncrement(S::LessEqualF(S::SetF((float)(4u << l)), distance), level);
+            return level;
+        }
+
+        // Packet version of TraceHierarchical. Every lane keeps its own level, and the float math is done in the same
+        // order as the scalar code with separate multiplies and adds, so every lane takes the same steps and lands on
+        // the same voxel.
+        template <typename S>
+        SIMD_INLINE void TracePacketT(const Volume& volume, const RayBatch& rays, uint32_t first, uint32_t laneMask,
+            TraceResult* results, uint32_t maxSteps)
+        {
+            typedef typename S::F F;
+            typedef typename S::I I;
+            typedef typename S::M M;
+
+            const M inputMask = S::FromBits(laneMask);
+            const F ox = S::LoadF(&rays.origin[0][first], inputMask);
+            const F oy = S::LoadF(&rays.origin[1][first], inputMask);
+            const F oz = S::LoadF(&rays.origin[2][first], inputMask);
+            const F dx = S::LoadF(&rays.direction[0][first], inputMask);
+            const F dy = S::LoadF(&rays.direction[1][first], inputMask);
+            const F dz = S::LoadF(&rays.direction[2][first], inputMask);
+
+            const I zero = S::SetI(0);
+            const I one = S::SetI(1);
+            const I last = S::SetI((int)volume.resolution - 1);
+            const F zeroF = S::SetF(0.0f);
+            const F escape = S::SetF(SDF_START_ESCAPE_DISTANCE);
+            const F notSurface = S::SetF(1.0f);
+            const F exitBias = S::SetF(SDF_CELL_EXIT_BIAS);
+            const F diagonals = S::SetF(2.0f * SDF_VOXEL_DIAGONAL);
+
+            M active = inputMask;
+            M hit = S::FromBits(0);
+            F depth = zeroF;
+            I steps = zero;
+            I level = zero;
+            I hitX = S::SetI(-1), hitY = S::SetI(-1), hitZ = S::SetI(-1);
+
+            for (uint32_t i = 0; i < maxSteps && S::ToBits(active) != 0; ++i)
+            {
+                steps = S::MaskIncrement(active, steps);
+
+                const F px = S::Add(ox, S::Mul(depth, dx));
+                const F py = S::Add(oy, S::Mul(depth, dy));
+                const F pz = S::Add(oz, S::Mul(depth, dz));
+                const I vx = S::Truncate(px);
+                const I vy = S::Truncate(py);
+                const I vz = S::Truncate(pz);
+
+                M outside = S::Or(S::Or(S::LessI(vx, zero), S::LessI(vy, zero)), S::LessI(vz, zero));
+                outside = S::Or(outside, S::Or(S::Or(S::GreaterI(vx, last), S::GreaterI(vy, last)), S::GreaterI(vz, last)));
+                active = S::AndNot(active, outside);
+                if (S::ToBits(active) == 0)
+                    break;
+
+                // One gather per level that some lane is at, with the same storage flip as Volume::Fetch.
+                F dist = notSurface;
+                F cellSize = S::SetF(1.0f);
+                for (uint32_t l = 0; l < SDF_HIERARCHY_LEVELS; ++l)
+                {
+                    const M atLevel = S::And(active, S::EqualI(level, S::SetI((int)l)));
+                    if (S::ToBits(atLevel) == 0)
+                        continue;
+
+                    const uint32_t levelResolution = SDFLevelResolution(volume.resolution, l);
+                    const I levelSize = S::SetI((int)levelResolution);
+                    const I levelLast = S::SetI((int)levelResolution - 1);
+                    const I lx = S::ShiftRightI(vx, l);
+                    const I ly = S::SubI(levelLast, S::ShiftRightI(vy, l));
+                    const I lz = S::SubI(levelLast, S::ShiftRightI(vz, l));
+                    const I index = S::AddI(lx, S::MulI(levelSize, S::AddI(ly, S::MulI(levelSize, lz))));
+                    dist = S::Gather(volume.levels[l].data(), index, atLevel, dist);
+                    cellSize = S::SelectF(atLevel, S::SetF((float)(1u << l)), cellSize);
+                }
+
+                // Coarse lanes skip past an empty cell or drop a level.
+                const M coarse = S::And(active, S::GreaterI(level, zero));
+                const M empty = S::And(coarse, S::GreaterF(dist, zeroF));
+                if (S::ToBits(empty) != 0)
+                {
+                    const F exitDistance = S::MinF(AxisExitDistance<S>(px, dx, cellSize),
+                        S::MinF(AxisExitDistance<S>(py, dy, cellSize), AxisExitDistance<S>(pz, dz, cellSize)));
+                    const F advance = S::Add(S::Add(exitDistance, exitBias), S::MaxF(S::Sub(dist, diagonals), zeroF));
+                    depth = S::MaskAdd(empty, depth, advance);
+                    level = S::SelectI(empty, S::MaxI(level, LevelForDistance<S>(dist)), level);
+                }
+                level = S::SelectI(S::AndNot(coarse, empty), S::SubI(level, one), level);
+
+                // Level 0 lanes stop at a surface, unless they started in it, and otherwise step by the distance.
+                const M fine = S::AndNot(active, coarse);
+                const M surface = S::And(fine, S::EqualF(dist, zeroF));
+                const M hitNow = S::And(surface, S::GreaterF(depth, zeroF));
+                hit = S::Or(hit, hitNow);
+                hitX = S::SelectI(hitNow, vx, hitX);
+                hitY = S::SelectI(hitNow, vy, hitY);
+                hitZ = S::SelectI(hitNow, vz, hitZ);
+                active = S::AndNot(active, hitNow);
+
+                const M stepping = S::AndNot(fine, hitNow);
+                dist = S::SelectF(surface, escape, dist);
+                depth = S::MaskAdd(stepping, depth, dist);
+                level = S::SelectI(stepping, LevelForDistance<S>(dist), level);
+            }
+
+            alignas(64) float depthOut[S::Width];
+            alignas(64) int stepsOut[S::Width];
+            alignas(64) int voxelOut[3][S::Width];
+            S::StoreF(depthOut, depth);
+            S::StoreI(stepsOut, steps);
+            S::StoreI(voxelOut[0], hitX);
+            S::StoreI(voxelOut[1], hitY);
+            S::StoreI(voxelOut[2], hitZ);
+            const uint32_t hitBits = S::ToBits(hit);
+
+            for (uint32_t lane = 0; lane < S::Width; ++lane)
+            {
+                if ((laneMask & (1u << lane)) == 0)
+                    continue;
+
+                TraceResult& result = results[lane];
+                result.hit = (hitBits & (1u << lane)) != 0;
+                result.depth = depthOut[lane];
+                result.steps = (uint32_t)stepsOut[lane];
+                result.voxel[0] = result.hit ? voxelOut[0][lane] : 0;
+                result.voxel[1] = result.hit ? voxelOut[1][lane] : 0;
+                result.voxel[2] = result.hit ? voxelOut[2][lane] : 0;
+            }
+        }
+
+        SSE4_FUNCTION void TracePacketSSE4(const Volume& volume, const RayBatch& rays, uint32_t first, uint32_t laneMask,
+            TraceResult* results, uint32_t maxSteps)
+        {
+            TracePacketT<SSE4>(volume, rays, first, laneMask, results, maxSteps);
+        }
+
+        AVX2_FUNCTION void TracePacketAVX2(const Volume& volume, const RayBatch& rays, uint32_t first, uint32_t laneMask,
+            TraceResult* results, uint32_t maxSteps)
+        {
+            TracePacketT<AVX2>(volume, rays, first, laneMask, results, maxSteps);
+        }
+
+        AVX512_FUNCTION void TracePacketAVX512(const Volume& volume, const RayBatch& rays, uint32_t first,
+            uint32_t laneMask, TraceResult* results, uint32_t maxSteps)
+        {
+            TracePacketT<AVX512>(volume, rays, first, laneMask, results, maxSteps);
+        }
+
+        void CpuId(int info[4], int leaf)
+        {
+#ifdef _MSC_VER
+            __cpuidex(info, leaf, 0);
+#else
+            unsigned int regs[4];
+            __cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+            std::copy(regs, regs + 4, info);
+#endif
+        }
+
+        // XCR0, the state components the OS saves on a context switch.
+        uint64_t GetEnabledXState()
+        {
+#ifdef _MSC_VER
+            return _xgetbv(0);
+#else
+            uint32_t low, high;
+            __asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+            return (uint64_t)high << 32 | low;
+#endif
+        }
+
+        uint32_t HighestSetBit(uint32_t bits)
+        {
+#ifdef _MSC_VER
+            unsigned long index;
+            _BitScanReverse(&index, bits);
+            return (uint32_t)index;
+#else
+            return 31 - (uint32_t)__builtin_clz(bits);
+#endif
+        }
+
+        bool SameResult(const TraceResult& a, const TraceResult& b)
+        {
+            return a.hit == b.hit && a.steps == b.steps && a.depth == b.depth &&
+                (!a.hit || std::equal(a.voxel, a.voxel + 3, b.voxel));
+        }
+    }
+
+    SimdLevel DetectSimdLevel()
+    {
+        static SimdLevel s_Level = []()
+        {
+            int info[4];
+            CpuId(info, 0);
+            const int maxLeaf = info[0];
+
+            CpuId(info, 1);
+            const bool sse41 = (info[2] & (1 << 19)) != 0;
+            if (!sse41)
+                return SimdLevel::Scalar;
+
+            const bool osxsave = (info[2] & (1 << 27)) != 0;
+            const bool avx = (info[2] & (1 << 28)) != 0;
+            if (!osxsave || !avx || maxLeaf < 7)
+                return SimdLevel::SSE4;
+
+            // The OS has to save the YMM (and for AVX-512, opmask and ZMM) state across context switches.
+            const uint64_t xcr0 = GetEnabledXState();
+            CpuId(info, 7);
+            const bool avx2 = (info[1] & (1 << 5)) != 0 && (xcr0 & 0x6) == 0x6;
+            const bool avx512 = (info[1] & (1 << 16)) != 0 && (xcr0 & 0xE6) == 0xE6;
+
+            if (avx512)
+                return SimdLevel::AVX512;
+            if (avx2)
+                return SimdLevel::AVX2;
+            return SimdLevel::SSE4;
+        }();
+        return s_Level;
+    }
+
+    const char* GetSimdLevelName(SimdLevel level)
+    {
+        switch (level)
+        {
+        case SimdLevel::AVX512: return "AVX-512";
+        case SimdLevel::AVX2: return "AVX2";
+        case SimdLevel::SSE4: return "SSE4.1";
+        default: return "scalar";
+        }
+    }
+
+    uint32_t GetPacketWidth(SimdLevel level)
+    {
+        switch (level)
+        {
+        case SimdLevel::AVX512: return AVX512::Width;
+        case SimdLevel::AVX2: return AVX2::Width;
+        case SimdLevel::SSE4: return SSE4::Width;
+        default: return 1;
+        }
+    }
+
+    void RayBatch::Resize(uint32_t count)
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            origin[axis].resize(count);
+            direction[axis].resize(count);
+        }
+    }
+
+    void RayBatch::Set(uint32_t i, const float o[3], const float d[3])
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            origin[axis][i] = o[axis];
+            direction[axis][i] = d[axis];
+        }
+    }
+
+    void TracePacket(const Volume& volume, const RayBatch& rays, uint32_t first, uint32_t laneMask,
+        TraceResult* results, uint32_t maxSteps, SimdLevel level)
+    {
+        ASSERT(volume.levels[0].size() == (size_t)volume.resolution * volume.resolution * volume.resolution);
+        ASSERT((uint64_t)volume.resolution * volume.resolution * volume.resolution <= 0x7FFFFFFF, "Gather indices are 32-bit");
+
+        ASSERT((laneMask >> GetPacketWidth(level)) == 0);
+        if (laneMask == 0)
+            return;
+
+        // Masked loads never touch inactive lanes, so only the rays up to the highest active lane need to exist.
+        ASSERT(first + HighestSetBit(laneMask) < rays.Count());
+
+        switch (level)
+        {
+        case SimdLevel::AVX512: TracePacketAVX512(volume, rays, first, laneMask, results, maxSteps); break;
+        case SimdLevel::AVX2: TracePacketAVX2(volume, rays, first, laneMask, results, maxSteps); break;
+        case SimdLevel::SSE4: TracePacketSSE4(volume, rays, first, laneMask, results, maxSteps); break;
+        default:
+        {
+            const float origin[3] = { rays.origin[0][first], rays.origin[1][first], rays.origin[2][first] };
+            const float direction[3] = { rays.direction[0][first], rays.direction[1][first], rays.direction[2][first] };
+            results[0] = TraceHierarchical(volume, origin, direction, maxSteps);
+            break;
+        }
+        }
+    }
+
+    void TraceRays(const Volume& volume, const RayBatch& rays, TraceResult* results, uint32_t maxSteps, SimdLevel level)
+    {
+        const uint32_t width = GetPacketWidth(level);
+        const uint32_t count = rays.Count();
+        for (uint32_t first = 0; first < count; first += width)
+        {
+            const uint32_t lanes = std::min(width, count - first);
+            TracePacket(volume, rays, first, (1u << lanes) - 1, results + first, maxSteps, level);
+        }
+    }
+
+    void Benchmark(const Volume& volume, uint32_t rayCount, uint32_t seed)
+    {
+        const std::vector<float> aos = CreateRandomRays(volume, rayCount, seed);
+        RayBatch rays;
+        rays.Resize(rayCount);
+        for (uint32_t i = 0; i < rayCount; ++i)
+            rays.Set(i, &aos[i * 6], &aos[i * 6 + 3]);
+
+        std::vector<TraceResult> reference(rayCount), packet(rayCount);
+
+        Utility::Printf("SDF packet tracer benchmark: %u rays, %u^3 volume, single thread\n", rayCount, volume.resolution);
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for (uint32_t i = 0; i < rayCount; ++i)
+            reference[i] = TraceHierarchical(volume, &aos[i * 6], &aos[i * 6 + 3]);
+        double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+        Utility::Printf("  scalar:  %8.2f Mrays/s\n", rayCount / seconds * 1e-6);
+
+        const SimdLevel best = DetectSimdLevel();
+        for (int l = (int)SimdLevel::SSE4; l <= (int)best; ++l)
+        {
+            const SimdLevel level = (SimdLevel)l;
+
+            start = std::chrono::high_resolution_clock::now();
+            TraceRays(volume, rays, packet.data(), 512, level);
+            seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+            uint32_t mismatches = 0;
+            for (uint32_t i = 0; i < rayCount; ++i)
+                mismatches += SameResult(reference[i], packet[i]) ? 0 : 1;
+
+            Utility::Printf("  %-7s  %8.2f Mrays/s (x%u), %u mismatches\n", GetSimdLevelName(level),
+                rayCount / seconds * 1e-6, GetPacketWidth(level), mismatches);
+        }
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "SDFHierarchy.h"
+
+// SoA ray-packet sphere tracer over the dense SDF volume, for CPU bakes and for validating GPU traces in bulk. Traces
+// 4, 8 or 16 rays at once with SSE4.1, AVX2 or AVX-512, picked at runtime, or one at a time on CPUs with none of them.
+// Results are bit-identical to SDFHierarchy::TraceHierarchical: every lane walks the min-distance pyramid on its own.
+namespace SDFPacketTracer
+{
+    enum class SimdLevel
+    {
+        Scalar,     // TraceHierarchical, one ray per packet
+        SSE4,
+        AVX2,
+        AVX512
+    };
+
+    // Widest instruction set supported by both the CPU and the OS.
+    SimdLevel DetectSimdLevel();
+    const char* GetSimdLevelName(SimdLevel level);
+    uint32_t GetPacketWidth(SimdLevel level);
+
+    // Rays in structure-of-arrays layout, texture-space origins and unit directions.
+    struct RayBatch
+    {
+        std::vector<float> origin[3];
+        std::vector<float> direction[3];
+
+        void Resize(uint32_t count);
+        uint32_t Count() const { return (uint32_t)origin[0].size(); }
+        void Set(uint32_t i, const float o[3], const float d[3]);
+    };
+
+    // Traces one packet of GetPacketWidth(level) rays starting at rays[first]. Lanes whose bit is clear in laneMask are
+    // neither read nor written, so a partial packet at the end of a batch is just a packet with its high bits clear.
+    void TracePacket(const SDFHierarchy::Volume& volume, const RayBatch& rays, uint32_t first, uint32_t laneMask,
+        SDFHierarchy::TraceResult* results, uint32_t maxSteps = 512, SimdLevel level = DetectSimdLevel());
+
+    // Traces the whole batch, results[i] for rays[i].
+    void TraceRays(const SDFHierarchy::Volume& volume, const RayBatch& rays, SDFHierarchy::TraceResult* results,
+        uint32_t maxSteps = 512, SimdLevel level = DetectSimdLevel());
+
+    // Single-threaded rays per second for the scalar traversal and every packet width this CPU supports.
+    void Benchmark(const SDFHierarchy::Volume& volume, uint32_t rayCount, uint32_t seed = 1);
+}
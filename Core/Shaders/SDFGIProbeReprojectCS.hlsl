@@ -0,0 +1,67 @@
+cbuffer ReprojectData : register(b0) {
+    float3 GridSize;
+    float pad0;
+
+    float3 ProbeSpacing;
+    float pad1;
+
+    float3 SceneMinBounds;
+    float pad2;
+
+    float3 OldGridSize;
+    float pad3;
+
+    float3 OldProbeSpacing;
+    float pad4;
+
+    float3 OldSceneMinBounds;
+    float pad5;
+
+    uint ProbeAtlasBlockResolution;
+    uint GutterSize;
+};
+
+Texture2DArray<float4> OldIrradianceAtlas : register(t0);
+Texture2DArray<float2> OldDepthAtlas : register(t1);
+
+RWTexture2DArray<float4> IrradianceAtlas : register(u0);
+RWTexture2DArray<float2> DepthAtlas : register(u1);
+
+#include "../SDFGIAtlasCommon.h"
+
+// Seeds the atlases of a new probe grid from the atlases of the grid it replaces. Every texel of a new probe's block is
+// the trilinear blend, over the 8 old probes around the new probe's position, of the same octahedral texel, so it keeps
+// pointing in the same direction. Must stay in sync with SDFGIReprojection::Reproject.
+//
+// One group per new probe, one thread per block texel.
+[numthreads(SDFGI_ATLAS_BLOCK_RESOLUTION, SDFGI_ATLAS_BLOCK_RESOLUTION, 1)]
+void main(uint3 groupID : SV_GroupID, uint3 groupThreadID : SV_GroupThreadID)
+{
+    float3 oldCoord = SDFGIOldGridCoord(float3(groupID), SceneMinBounds, ProbeSpacing, OldSceneMinBounds, OldProbeSpacing, OldGridSize);
+    uint3 base = uint3(SDFGITrilinearBase(oldCoord.x, OldGridSize.x),
+                       SDFGITrilinearBase(oldCoord.y, OldGridSize.y),
+                       SDFGITrilinearBase(oldCoord.z, OldGridSize.z));
+    float3 t = oldCoord - float3(base);
+
+    float4 irradiance = 0;
+    float2 depth = 0;
+    for (uint corner = 0; corner < 8; corner++)
+    {
+        uint3 offset = uint3(corner & 1, (corner >> 1) & 1, (corner >> 2) & 1);
+        float3 axisWeights = lerp(1.0 - t, t, float3(offset));
+        float weight = axisWeights.x * axisWeights.y * axisWeights.z;
+        // Also keeps the loads inside the old grid along axes with a single probe.
+        if (weight == 0.0)
+            continue;
+
+        uint3 oldProbe = base + offset;
+        uint2 oldOrigin = SDFGIAtlasBlockOrigin(oldProbe.xy, ProbeAtlasBlockResolution, GutterSize);
+        uint3 oldTexCoord = uint3(oldOrigin + groupThreadID.xy, oldProbe.z);
+        irradiance += weight * OldIrradianceAtlas[oldTexCoord];
+        depth += weight * OldDepthAtlas[oldTexCoord];
+    }
+
+    uint3 texCoord = uint3(SDFGIAtlasBlockOrigin(groupID.xy, ProbeAtlasBlockResolution, GutterSize) + groupThreadID.xy, groupID.z);
+    IrradianceAtlas[texCoord] = irradiance;
+    DepthAtlas[texCoord] = depth;
+}
@@ -32,6 +32,13 @@ cbuffer SDFData : register(b1) {
     float zmax;
     // texture resolution
     float sdfResolution;
+    // Nonzero to trace through the min-distance pyramid instead of sphere tracing the full resolution SDF
+    uint sdfHierarchical;
+};
+
+// First probe of the tile this dispatch updates, set per indirect command.
+cbuffer ProbeTile : register(b2) {
+    uint3 TileOrigin;
 };
 
 StructuredBuffer<float3> ProbePositions : register(t0);
@@ -42,6 +49,9 @@ RWTexture2DArray<float2> DepthAtlas : register(u1);
 
 RWTexture3D<uint4> AlbedoTex : register(u2);
 RWTexture3D<float> SDFTex : register(u3);
+// Coarse SDF levels in u4 and up.
+#include "SDFHierarchy.hlsli"
+#include "../SDFGIAtlasCommon.h"
 
 SamplerState LinearSampler : register(s0);
 
@@ -98,6 +108,20 @@ float4 UnpackRGBA8(uint packedColor) {
 
 float4 SampleSDFAlbedo(float3 worldPos, float3 marchingDirection, out float3 worldHitPos) {
     float3 eye = WorldSpaceToTextureSpace(worldPos); 
+    worldHitPos = worldPos;
+
+    if (sdfHierarchical) {
+        int3 hit;
+        float depth;
+        uint steps;
+        if (!SDFHierarchyTrace(eye, marchingDirection, hit, depth, steps)) {
+            return float4(0., 0., 0., 1.);
+        }
+
+        worldHitPos = TextureSpaceToWorldSpace(eye + depth * marchingDirection);
+        return UnpackRGBA8(AlbedoTex[hit]) * computeFalloff(depth, 0.15f);
+    }
+
     float test = 4.0f;
     // Ray March Code
     float start = 0;
@@ -126,21 +150,6 @@ float4 SampleSDFAlbedo(float3 worldPos, float3 marchingDirection, out float3 wor
 
 // --- Atlas Helper Functions ---
 
-float2 signNotZero(float2 v) {
-    return float2((v.x >= 0.0 ? 1.0 : -1.0), (v.y >= 0.0 ? 1.0 : -1.0));
-}
-
-float2 octEncode(float3 v) {
-    float l1norm = abs(v.x) + abs(v.y) + abs(v.z);
-    float2 result = v.xy * (1.0 / l1norm);
-    
-    if (v.z < 0.0) {
-        result = (1.0 - abs(result.yx)) * signNotZero(result.xy);
-    }
-    
-    return result;
-}
-
 int GetFaceIndex(float3 dir)
 {
     float3 absDir = abs(dir);
@@ -170,35 +179,6 @@ float3 spherical_fibonacci(uint index, uint sample_count) {
     return float3(cos(phi) * sin_theta, sin(phi) * sin_theta, cos_theta);
 }
 
-float2 normalized_oct_coord(int2 fragCoord, int probe_side_length) {
-
-    int probe_with_border_side = probe_side_length + 2;
-    float2 octahedral_texel_coordinates = int2((fragCoord.x - 1) % probe_with_border_side, (fragCoord.y - 1) % probe_with_border_side);
-
-    octahedral_texel_coordinates += float2(0.5f, 0.5f);
-    octahedral_texel_coordinates *= (2.0f / float(probe_side_length));
-    octahedral_texel_coordinates -= float2(1.0f, 1.0f);
-
-    return octahedral_texel_coordinates;
-}
-
-float sign_not_zero(in float k) {
-    return (k >= 0.0) ? 1.0 : -1.0;
-}
-
-float2 sign_not_zero2(in float2 v) {
-    return float2(sign_not_zero(v.x), sign_not_zero(v.y));
-}
-
-
-float3 oct_decode(float2 o) {
-    float3 v = float3(o.x, o.y, 1.0 - abs(o.x) - abs(o.y));
-    if (v.z < 0.0) {
-        v.xy = (1.0 - abs(v.yx)) * sign_not_zero2(v.xy);
-    }
-    return normalize(v);
-}
-
 //static const float2 offsets[5] = {
 //    float2(0.15, 0.15),
 //    float2(0.15, 0.85),
@@ -270,21 +250,23 @@ static const float2 offsets[36] = {
 
 // --- Shader Start ---
 
-[numthreads(8, 8, 1)]
-void main(uint3 dispatchThreadID : SV_DispatchThreadID, uint3 groupThreadID : SV_GroupThreadID) {
-    uint probeIndex = (dispatchThreadID.x / 8)
-                + (dispatchThreadID.y / 8) * GridSize.x
-                + dispatchThreadID.z * GridSize.x * GridSize.y;
-    if (probeIndex >= ProbeCount) return;
+// Final block texels, for filling the border ring without another pass.
+groupshared float4 BlockIrradiance[SDFGI_ATLAS_BLOCK_RESOLUTION * SDFGI_ATLAS_BLOCK_RESOLUTION];
+groupshared float2 BlockDepth[SDFGI_ATLAS_BLOCK_RESOLUTION * SDFGI_ATLAS_BLOCK_RESOLUTION];
+
+// One group per probe of the tile, one thread per texel of its block. Tiles are clipped to the grid on the CPU, so every
+// group has a probe.
+[numthreads(SDFGI_ATLAS_BLOCK_RESOLUTION, SDFGI_ATLAS_BLOCK_RESOLUTION, 1)]
+void main(uint3 groupID : SV_GroupID, uint3 groupThreadID : SV_GroupThreadID, uint groupIndex : SV_GroupIndex) {
+    uint3 probe = TileOrigin + groupID;
+    uint probeIndex = probe.x
+                + probe.y * GridSize.x
+                + probe.z * GridSize.x * GridSize.y;
 
     float3 probePosition = ProbePositions[probeIndex].xyz;
 
-    uint3 probeTexCoord = uint3(GutterSize, GutterSize, 0) + uint3(
-        (dispatchThreadID.x / 8) * (GutterSize),
-        (dispatchThreadID.y / 8) * (GutterSize),
-        dispatchThreadID.z
-    );
-    probeTexCoord += uint3(dispatchThreadID.xy, 0);
+    uint2 blockOrigin = SDFGIAtlasBlockOrigin(probe.xy, ProbeAtlasBlockResolution, GutterSize);
+    uint3 probeTexCoord = uint3(blockOrigin + groupThreadID.xy, probe.z);
 
     const uint sample_count = 36;
 
@@ -292,14 +274,14 @@ void main(uint3 dispatchThreadID : SV_DispatchThreadID, uint3 groupThreadID : SV
     float y = groupThreadID.y;
 
     float4 pastFrameIrradiance = IrradianceAtlas[probeTexCoord];
-    //IrradianceAtlas[probeTexCoord] = float4(0, 0, 0, 0);
+    float4 irradiance = pastFrameIrradiance;
+    float2 depth = DepthAtlas[probeTexCoord];
+    //irradiance = float4(0, 0, 0, 0);
     for (int s = 0; s < sample_count; s++) {
-        float2 inputToDecode = float2(((float)x + offsets[s].x) / ProbeAtlasBlockResolution, ((float)y + offsets[s].y) / ProbeAtlasBlockResolution);
-        //float2 inputToDecode = float2(((float)x + 0.5) / ProbeAtlasBlockResolution, ((float)y + 0.5) / ProbeAtlasBlockResolution);
-        inputToDecode *= 2;
-        inputToDecode -= float2(1.0, 1.0);
+        float2 inputToDecode = SDFGIBlockToOct(float2(x + offsets[s].x, y + offsets[s].y), ProbeAtlasBlockResolution);
+        //float2 inputToDecode = SDFGIBlockToOct(float2(x + 0.5, y + 0.5), ProbeAtlasBlockResolution);
 
-        float3 texelDirection = oct_decode(inputToDecode);
+        float3 texelDirection = SDFGIOctDecode(inputToDecode);
 
         float3 worldHitPos;
         float4 irradianceSample = SampleSDFAlbedo(probePosition, normalize(texelDirection), worldHitPos);
@@ -309,18 +291,35 @@ void main(uint3 dispatchThreadID : SV_DispatchThreadID, uint3 groupThreadID : SV
         // if (distance > MaxWorldDepth) {
         //     // We can limit the reach of SDF albedo query here.
         // } else {
-            IrradianceAtlas[probeTexCoord] += irradianceSample;
+            irradiance += irradianceSample;
         // }
 
         float worldDepth = min(length(worldHitPos - probePosition), MaxWorldDepth);
-        DepthAtlas[probeTexCoord] = lerp(float2(worldDepth, worldDepth * worldDepth), DepthAtlas[probeTexCoord], Hysteresis);
+        depth = lerp(float2(worldDepth, worldDepth * worldDepth), depth, Hysteresis);
     }
     
-    IrradianceAtlas[probeTexCoord] /= sample_count;
+    irradiance /= sample_count;
 
-    IrradianceAtlas[probeTexCoord] = lerp(IrradianceAtlas[probeTexCoord], pastFrameIrradiance, Hysteresis);
+    irradiance = lerp(irradiance, pastFrameIrradiance, Hysteresis);
 
-    //IrradianceAtlas[probeTexCoord] = float4(x / 8.0, y / 8.0, 0, 1);
+    //irradiance = float4(x / 8.0, y / 8.0, 0, 1);
+
+    IrradianceAtlas[probeTexCoord] = irradiance;
+    DepthAtlas[probeTexCoord] = depth;
+
+    // Border ring: each texel copies the block texel the octahedral wrap maps it to.
+    BlockIrradiance[groupIndex] = irradiance;
+    BlockDepth[groupIndex] = depth;
+    GroupMemoryBarrierWithGroupSync();
+
+    for (uint i = groupIndex; i < SDFGI_ATLAS_BORDER_TEXELS(SDFGI_ATLAS_BLOCK_RESOLUTION); i += SDFGI_ATLAS_BLOCK_RESOLUTION * SDFGI_ATLAS_BLOCK_RESOLUTION) {
+        int2 border = SDFGIBorderTexel(i, SDFGI_ATLAS_BLOCK_RESOLUTION);
+        int2 source = SDFGIBorderSource(border, SDFGI_ATLAS_BLOCK_RESOLUTION);
+        uint sourceIndex = source.y * SDFGI_ATLAS_BLOCK_RESOLUTION + source.x;
+        uint3 borderTexCoord = uint3(int2(blockOrigin) + border, probe.z);
+        IrradianceAtlas[borderTexCoord] = BlockIrradiance[sourceIndex];
+        DepthAtlas[borderTexCoord] = BlockDepth[sourceIndex];
+    }
 }
 
 //
@@ -0,0 +1,78 @@
+// Hierarchical SDF traversal over the min-distance pyramid (see SDFHierarchyCommon.h). Shaders only take it when
+// Renderer::HierarchicalSDFTrace is set, and sphere trace the full resolution SDF otherwise.
+//
+// The including shader must declare the full resolution SDF as `RWTexture3D<float> SDFTex` and provide
+// `sdfResolution`. The coarse levels are bound as an array starting at SDF_MIP_REGISTER.
+
+#include "../SDFHierarchyCommon.h"
+
+#ifndef SDF_MIP_REGISTER
+#define SDF_MIP_REGISTER u4
+#endif
+
+#ifndef SDF_HIERARCHY_MAX_STEPS
+#define SDF_HIERARCHY_MAX_STEPS 512
+#endif
+
+RWTexture3D<float> SDFMipTex[SDF_HIERARCHY_COARSE_LEVELS] : register(SDF_MIP_REGISTER);
+
+float SDFHierarchyFetch(uint level, int3 texCoord)
+{
+    uint levelResolution = SDFLevelResolution((uint)sdfResolution, level);
+    uint3 coord = uint3(texCoord) >> level;
+    coord.y = SDFStorageCoord(coord.y, levelResolution);
+    coord.z = SDFStorageCoord(coord.z, levelResolution);
+    if (level == 0)
+        return SDFTex[coord];
+    return SDFMipTex[NonUniformResourceIndex(level - 1)][coord];
+}
+
+// Marches from eye (texture space) along dir. Returns true on a hit, with hitVoxel in storage coordinates (ready to
+// index the albedo volume) and depth the texel-space distance travelled. steps counts fetches at any level.
+bool SDFHierarchyTrace(float3 eye, float3 dir, out int3 hitVoxel, out float depth, out uint steps)
+{
+    // The exact distance at the origin picks the first coarse level.
+    uint level = 0;
+    depth = 0;
+    hitVoxel = int3(-1, -1, -1);
+
+    for (steps = 0; steps < SDF_HIERARCHY_MAX_STEPS; steps++)
+    {
+        float3 p = eye + depth * dir;
+        int3 voxel = p;
+        if (any(voxel > int3(sdfResolution - 1, sdfResolution - 1, sdfResolution - 1)) || any(voxel < int3(0, 0, 0)))
+            return false;
+
+        float dist = SDFHierarchyFetch(level, voxel);
+
+        if (level > 0)
+        {
+            if (SDFCellIsEmpty(dist))
+            {
+                float cellSize = (float)(1u << level);
+                float exitDistance = SDFCellExitDistance(p.x, p.y, p.z, dir.x, dir.y, dir.z, cellSize);
+                depth += SDFCoarseAdvance(dist, exitDistance);
+                level = max(level, SDFLevelForDistance(dist));
+            }
+            else
+            {
+                level--;
+            }
+            continue;
+        }
+
+        if (dist == 0.f)
+        {
+            if (depth > 0.f)
+            {
+                hitVoxel = int3(voxel.x, SDFStorageCoord(voxel.y, (uint)sdfResolution), SDFStorageCoord(voxel.z, (uint)sdfResolution));
+                return true;
+            }
+            dist = SDF_START_ESCAPE_DISTANCE;
+        }
+        depth += dist;
+        // Near a surface the coarse cells are never empty; only climb back up as far as the distance says is clear.
+        level = SDFLevelForDistance(dist);
+    }
+    return false;
+}
@@ -19,114 +19,579 @@
 #include "FileUtility.h"
 #include "GraphicsCommon.h"
 #include "CommandContext.h"
-#include <map>
+#include "CommandListManager.h"
+#include "TextureStreaming.h"
+#include "Hash.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
 #include <thread>
+#include <unordered_map>
 
 using namespace std;
 using namespace Graphics;
-using Utility::ByteArray;
 
 //
 // A ManagedTexture allows for multiple threads to request a Texture load of the same
 // file.  It also contains a reference count of the Texture so that it can be freed
 // when it is no longer referenced.
 //
-// Raw ManagedTexture pointers are not exposed to clients.  
+// Raw ManagedTexture pointers are not exposed to clients, nor returned by the cache:
+// a lookup takes its reference before the cache lock is released.
 //
 class ManagedTexture : public Texture
 {
     friend class TextureRef;
+    friend void TextureManager::UpdateStreaming( void );
+    friend void TextureManager::ReportScreenSizes( const TextureRef* textures, const float* pixels, uint32_t count );
 
 public:
-    ManagedTexture( const wstring& FileName );
+    ManagedTexture( const wstring& FileName, uint64_t KeyHash );
+    ~ManagedTexture();
+
+    uint64_t GetKeyHash(void) const { return m_KeyHash; }
+    const wstring& GetKey(void) const { return m_MapKey; }
+    size_t GetReferenceCount(void) const { return m_ReferenceCount; }
 
     void WaitForLoad(void) const;
-    void CreateFromMemory(ByteArray memory, eDefaultTexture fallback, bool sRGB);
+    void CreateFromFile(const wstring& filePath, eDefaultTexture fallback, bool sRGB);
+
+    // Loads only the mip tail and registers the texture with the streamer. Returns false, having done nothing, when
+    // the file isn't a 2D texture with mips beyond its tail.
+    bool CreateStreamedFromFile(const wstring& filePath, bool sRGB);
+
+    // Starts using a texture that a streaming load created in m_StagingSRV, as of streaming generation generation.
+    // Returns the resource it replaces.
+    Microsoft::WRL::ComPtr<ID3D12Resource> SwapStreamedResource(Microsoft::WRL::ComPtr<ID3D12Resource> resource,
+        uint32_t generation);
+    uint32_t GetSRVGeneration(void) const { return m_SRVGeneration; }
 
 private:
 
     bool IsValid(void) const { return m_IsValid; }
-    void Unload();
+    void AddRef(void) { ++m_ReferenceCount; }
+    void Release(void);
+    void FinishLoading(void) { m_LoadPromise.set_value(); }
 
-    std::wstring m_MapKey;		// For deleting from the map later
+    std::wstring m_MapKey;		// For finding in the cache; m_KeyHash is its hash
+    uint64_t m_KeyHash;
     bool m_IsValid;
-    bool m_IsLoading;
-    size_t m_ReferenceCount;
+    std::promise<void> m_LoadPromise;
+    std::shared_future<void> m_Loaded;
+    std::atomic<size_t> m_ReferenceCount;
+
+    // Streamed textures only
+    uint32_t m_StreamingId;     // In the scheduler, or ~0u
+    uint32_t m_SRVGeneration;   // The streaming generation that last gave it a new SRV
+    D3D12_CPU_DESCRIPTOR_HANDLE m_StagingSRV;
+    std::wstring m_FilePath;
+    std::vector<uint8_t> m_DDSHeader;
+    DDSMipLayout m_MipLayout;
+    bool m_sRGB;
 };
 
 namespace TextureManager
 {
     wstring s_RootPath = L"";
-    map<wstring, std::unique_ptr<ManagedTexture>> s_TextureCache;
+
+    // The cache is split into shards by key hash, so requests for different textures rarely share a lock. A lock is
+    // only held to find or insert an entry, never while a texture loads or while a second requester waits for it.
+    struct alignas(64) CacheShard
+    {
+        mutex Mutex;
+        unordered_multimap<uint64_t, std::unique_ptr<ManagedTexture>> Textures;
+    };
+    const uint32_t kNumCacheShards = 64;
+    CacheShard s_TextureCache[kNumCacheShards];
+    std::atomic<uint32_t> s_NumLoadsStarted(0);
+
+    static CacheShard& GetShard( uint64_t keyHash )
+    {
+        return s_TextureCache[(keyHash >> 32) % kNumCacheShards];
+    }
 
     void Initialize( const wstring& TextureLibRoot )
     {
         s_RootPath = TextureLibRoot;
     }
 
-    void Shutdown( void )
+    // Streaming. A load reads mips firstMip and coarser and creates a new texture from them on an I/O thread; the
+    // frame thread then swaps it in and retires the resource it replaces, which is released once the GPU is done
+    // with it. Everything below is guarded by s_StreamingMutex.
+    struct StreamingJob
     {
-        s_TextureCache.clear();
+        uint32_t id;
+        uint32_t firstMip;
+        wstring filePath;
+        vector<uint8_t> header;
+        DDSMipLayout layout;
+        bool sRGB;
+        D3D12_CPU_DESCRIPTOR_HANDLE srv;
+        Microsoft::WRL::ComPtr<ID3D12Resource> resource;
+        bool succeeded;
+    };
+
+    struct RetiredResource
+    {
+        Microsoft::WRL::ComPtr<ID3D12Resource> resource;
+        uint64_t frame;     // When it was retired
+        uint64_t fence;     // 0 until kRetireFrames have passed
+    };
+
+    // Models pick up new SRVs in the frame after the swap at the latest, and may draw with the old ones until then.
+    // Resources are held for that long before waiting on the GPU fence.
+    const uint64_t kRetireFrames = 2;
+
+    // Finished loads are swapped in together, at most once every kSwapFrames frames, so that models rewrite their
+    // descriptor tables once for a batch of textures rather than once for every mip that arrives.
+    const uint64_t kSwapFrames = 4;
+
+    mutex s_StreamingMutex;
+    condition_variable s_StreamingJobReady;
+    TextureStreaming::Scheduler s_Scheduler;
+    vector<ManagedTexture*> s_StreamedTextures;     // By scheduler id; null once destroyed
+    deque<StreamingJob> s_PendingJobs;
+    vector<StreamingJob> s_FinishedJobs;
+    vector<RetiredResource> s_RetiredResources;
+    vector<thread> s_StreamingThreads;
+    // Screen size reports wait here for UpdateStreaming, so that drawing never contends with the I/O threads for
+    // s_StreamingMutex. UpdateStreaming swaps the two lists and passes on what the previous frame reported.
+    struct UsageReport
+    {
+        uint32_t id;
+        float pixels;
+    };
+
+    mutex s_UsageMutex;
+    vector<UsageReport> s_UsageReports;
+    vector<UsageReport> s_FrameUsageReports;
+    bool s_StreamingEnabled = false;
+    bool s_StopStreaming = false;
+    uint64_t s_StreamingFrame = 0;
+    uint64_t s_LastSwapFrame = 0;
+    uint64_t s_LastSwapFence = 0;       // The last fence of the frames before the last swap
+    std::atomic<uint32_t> s_StreamingGeneration(0);
+
+    static void StreamingThread( void )
+    {
+        for (;;)
+        {
+            StreamingJob job;
+            {
+                unique_lock<mutex> Lock(s_StreamingMutex);
+                s_StreamingJobReady.wait(Lock, []{ return s_StopStreaming || !s_PendingJobs.empty(); });
+                if (s_StopStreaming)
+                    return;
+                job = std::move(s_PendingJobs.front());
+                s_PendingJobs.pop_front();
+            }
+
+            const uint64_t offset = job.layout.mipOffset[job.firstMip];
+            Utility::FileMapping file;
+            job.succeeded = file.Open(job.filePath) && file.GetSize() >= job.layout.fileSize &&
+                SUCCEEDED(CreateDDSTextureFromMips(g_Device, job.header.data(), job.header.size(), file.GetData() + offset,
+                    (size_t)(job.layout.fileSize - offset), job.firstMip, job.sRGB, job.resource.GetAddressOf(), job.srv));
+
+            lock_guard<mutex> Guard(s_StreamingMutex);
+            s_FinishedJobs.push_back(std::move(job));
+        }
     }
 
-    mutex s_Mutex;
+    void EnableStreaming( uint64_t budgetBytes, uint32_t ioThreads )
+    {
+        lock_guard<mutex> Guard(s_StreamingMutex);
+        s_Scheduler.SetBudget(budgetBytes);
+        s_Scheduler.SetMaxPendingRequests(2 * std::max(ioThreads, 1u));
+        s_StreamingEnabled = true;
+        s_StopStreaming = false;
+        while (s_StreamingThreads.size() < std::max(ioThreads, 1u))
+            s_StreamingThreads.emplace_back(StreamingThread);
+    }
 
-    ManagedTexture* FindOrLoadTexture( const wstring& fileName, eDefaultTexture fallback, bool forceSRGB )
+    bool IsStreamingEnabled( void )
     {
-        ManagedTexture* tex = nullptr;
+        return s_StreamingEnabled;
+    }
+
+    uint32_t GetStreamingGeneration( void )
+    {
+        return s_StreamingGeneration;
+    }
+
+    void ReportScreenSizes( const TextureRef* textures, const float* pixels, uint32_t count )
+    {
+        lock_guard<mutex> Guard(s_UsageMutex);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const ManagedTexture* tex = textures[i].m_ref;
+            if (pixels[i] > 0.0f && tex != nullptr && tex->m_StreamingId != ~0u)
+                s_UsageReports.push_back({ tex->m_StreamingId, pixels[i] });
+        }
+    }
+
+    void UpdateStreaming( void )
+    {
+        if (!s_StreamingEnabled)
+            return;
 
         {
-            lock_guard<mutex> Guard(s_Mutex);
+            lock_guard<mutex> Guard(s_UsageMutex);
+            s_UsageReports.swap(s_FrameUsageReports);
+        }
+
+        lock_guard<mutex> Guard(s_StreamingMutex);
+        ++s_StreamingFrame;
+
+        for (size_t i = 0; i < s_RetiredResources.size(); )
+        {
+            RetiredResource& retired = s_RetiredResources[i];
+            if (retired.fence == 0 && s_StreamingFrame - retired.frame >= kRetireFrames)
+                retired.fence = g_CommandManager.GetGraphicsQueue().GetNextFenceValue();
+
+            if (retired.fence != 0 && g_CommandManager.IsFenceComplete(retired.fence))
+            {
+                s_RetiredResources[i] = std::move(s_RetiredResources.back());
+                s_RetiredResources.pop_back();
+            }
+            else
+                ++i;
+        }
+
+        // A batch is only swapped in once the GPU is done with the frames before the last one, so that models, which
+        // switched to their other descriptor tables then, can rewrite the ones they switched away from.
+        if (!s_FinishedJobs.empty() && s_StreamingFrame - s_LastSwapFrame >= kSwapFrames &&
+            g_CommandManager.IsFenceComplete(s_LastSwapFence))
+        {
+            const uint32_t generation = s_StreamingGeneration + 1;
+            bool anySwapped = false;
+            for (StreamingJob& job : s_FinishedJobs)
+            {
+                ManagedTexture* tex = s_StreamedTextures[job.id];
+                const bool swapped = tex != nullptr && job.succeeded;
+                if (swapped)
+                    job.resource = tex->SwapStreamedResource(job.resource, generation);
+                if (job.resource != nullptr)
+                    s_RetiredResources.push_back({ job.resource, s_StreamingFrame, 0 });
+                s_Scheduler.CompleteRequest(job.id, swapped);
+                anySwapped |= swapped;
+            }
+            s_FinishedJobs.clear();
 
-            wstring key = fileName;
-            if (forceSRGB)
-                key += L"_sRGB";
+            if (anySwapped)
+            {
+                s_StreamingGeneration = generation;
+                s_LastSwapFrame = s_StreamingFrame;
+                s_LastSwapFence = g_CommandManager.GetGraphicsQueue().GetNextFenceValue() - 1;
+            }
+        }
+
+        // A texture destroyed since it was reported may have left its id to a new one, which then gets a report
+        // too many for a frame; that only loads its mips a frame early.
+        for (const UsageReport& report : s_FrameUsageReports)
+        {
+            if (s_StreamedTextures[report.id] != nullptr)
+                s_Scheduler.ReportUsage(report.id, report.pixels);
+        }
+        s_FrameUsageReports.clear();
+
+        vector<TextureStreaming::Request> requests;
+        s_Scheduler.Update(requests);
+        for (const TextureStreaming::Request& request : requests)
+        {
+            const ManagedTexture* tex = s_StreamedTextures[request.texture];
+            StreamingJob job;
+            job.id = request.texture;
+            job.firstMip = request.firstMip;
+            job.filePath = tex->m_FilePath;
+            job.header = tex->m_DDSHeader;
+            job.layout = tex->m_MipLayout;
+            job.sRGB = tex->m_sRGB;
+            job.srv = tex->m_StagingSRV;
+            job.succeeded = false;
+            s_PendingJobs.push_back(std::move(job));
+        }
+        if (!requests.empty())
+            s_StreamingJobReady.notify_all();
+    }
+
+    void PrintStreamingStats( void )
+    {
+        lock_guard<mutex> Guard(s_StreamingMutex);
+        Utility::Printf("Texture streaming: %llu MB of %llu MB budget resident, %llu MB planned, %u loads pending\n",
+            s_Scheduler.GetResidentBytes() >> 20, s_Scheduler.GetBudget() >> 20, s_Scheduler.GetPlannedBytes() >> 20,
+            s_Scheduler.GetPendingRequestCount());
+    }
+
+    void Shutdown( void )
+    {
+        {
+            lock_guard<mutex> Guard(s_StreamingMutex);
+            s_StopStreaming = true;
+        }
+        s_StreamingJobReady.notify_all();
+        for (thread& t : s_StreamingThreads)
+            t.join();
+        s_StreamingThreads.clear();
+        s_PendingJobs.clear();
+        s_FinishedJobs.clear();
+        s_RetiredResources.clear();
+        s_UsageReports.clear();
+        s_FrameUsageReports.clear();
+        s_StreamingEnabled = false;
+
+        for (CacheShard& shard : s_TextureCache)
+            shard.Textures.clear();
+    }
+
+    TextureRef FindOrLoadTexture( const wstring& fileName, eDefaultTexture fallback, bool forceSRGB, bool allowStreaming )
+    {
+        const bool streamed = allowStreaming && s_StreamingEnabled;
+
+        wstring key = fileName;
+        if (forceSRGB)
+            key += L"_sRGB";
+        if (streamed)
+            key += L"_streamed";
+
+        const uint64_t keyHash = Utility::HashBytes64(key.data(), key.size() * sizeof(wchar_t));
+        CacheShard& shard = GetShard(keyHash);
+
+        ManagedTexture* tex = nullptr;
+        ManagedTexture* newTex = nullptr;
+        TextureRef ref;
+        {
+            lock_guard<mutex> Guard(shard.Mutex);
 
             // Search for an existing managed texture
-            auto iter = s_TextureCache.find(key);
-            if (iter != s_TextureCache.end())
+            auto range = shard.Textures.equal_range(keyHash);
+            for (auto iter = range.first; iter != range.second && tex == nullptr; ++iter)
             {
-                // If a texture was already created make sure it has finished loading before
-                // returning a point to it.
-                tex = iter->second.get();
-                tex->WaitForLoad();
-                return tex;
+                if (iter->second->GetKey() == key)
+                    tex = iter->second.get();
+            }
+
+            if (tex != nullptr)
+            {
+                ref = TextureRef(tex);
             }
             else
             {
                 // If it's not found, create a new managed texture and start loading it
-                tex = new ManagedTexture(key);
-                s_TextureCache[key].reset(tex);
+                newTex = new ManagedTexture(key, keyHash);
+                shard.Textures.emplace(keyHash, std::unique_ptr<ManagedTexture>(newTex));
+                ref = TextureRef(newTex);
             }
         }
 
-        Utility::ByteArray ba = Utility::ReadFileSync( s_RootPath + fileName );
-        tex->CreateFromMemory(ba, fallback, forceSRGB);
+        if (tex != nullptr)
+        {
+            // If a texture was already created make sure it has finished loading before
+            // returning a reference to it.
+            tex->WaitForLoad();
+            return ref;
+        }
+
+        // This was the first time it was requested, so the caller must read the file
+        ++s_NumLoadsStarted;
+        if (!streamed || !newTex->CreateStreamedFromFile(s_RootPath + fileName, forceSRGB))
+        {
+            newTex->CreateFromFile(s_RootPath + fileName, fallback, forceSRGB);
+        }
 
-        // This was the first time it was requested, so indicate that the caller must read the file
-        return tex;
+        return ref;
     }
 
-    void DestroyTexture(const wstring& key)
+    // Called when a texture's reference count dropped to zero. By then the texture may have been found again, and
+    // even released and destroyed again, so it is only destroyed if it is still cached and still unreferenced.
+    void DestroyTexture( uint64_t keyHash, const ManagedTexture* tex )
     {
-        lock_guard<mutex> Guard(s_Mutex);
+        std::unique_ptr<ManagedTexture> destroyed;
+        {
+            CacheShard& shard = GetShard(keyHash);
+            lock_guard<mutex> Guard(shard.Mutex);
 
-        auto iter = s_TextureCache.find(key);
-        if (iter != s_TextureCache.end())
-            s_TextureCache.erase(iter);
+            auto range = shard.Textures.equal_range(keyHash);
+            for (auto iter = range.first; iter != range.second; ++iter)
+            {
+                if (iter->second.get() == tex)
+                {
+                    if (tex->GetReferenceCount() == 0)
+                    {
+                        destroyed = std::move(iter->second);
+                        shard.Textures.erase(iter);
+                    }
+                    break;
+                }
+            }
+        }
+        // The texture is freed here, outside the lock.
+    }
+
+    void BenchmarkCache( uint32_t maxThreads )
+    {
+        // The files don't exist, so every load is cheap and resolves to the fallback; what is measured is the cache.
+        const uint32_t kNumBenchmarkTextures = 1024;
+        const uint32_t kLookupsPerThread = 200000;
+        maxThreads = std::max(maxThreads, 1u);
+
+        vector<wstring> names(kNumBenchmarkTextures);
+        for (uint32_t i = 0; i < kNumBenchmarkTextures; ++i)
+            names[i] = L"__TextureCacheBenchmark/" + to_wstring(i) + L".dds";
+
+        // Every thread requests every texture at the same time. Each must be loaded exactly once.
+        const uint32_t loadsBefore = s_NumLoadsStarted;
+        vector<vector<TextureRef>> held(maxThreads);
+        {
+            vector<thread> threads;
+            for (uint32_t t = 0; t < maxThreads; ++t)
+            {
+                threads.emplace_back([&, t]
+                {
+                    held[t].reserve(kNumBenchmarkTextures);
+                    for (uint32_t i = 0; i < kNumBenchmarkTextures; ++i)
+                        held[t].push_back(LoadDDSFromFile(names[(i + t * 7919) % kNumBenchmarkTextures], kBlackTransparent2D));
+                });
+            }
+            for (thread& t : threads)
+                t.join();
+        }
+        const uint32_t loads = s_NumLoadsStarted - loadsBefore;
+        Utility::Printf("Texture cache: %u threads requested %u textures, %u loads (%s)\n", maxThreads,
+            kNumBenchmarkTextures, loads, loads == kNumBenchmarkTextures ? "deduplicated" : "DUPLICATED");
+
+        // Lookups of resident textures, each taking and dropping a reference
+        double singleThreadRate = 0.0;
+        for (uint32_t threadCount = 1; ; threadCount = std::min(threadCount * 2, maxThreads))
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            vector<thread> threads;
+            for (uint32_t t = 0; t < threadCount; ++t)
+            {
+                threads.emplace_back([&, t]
+                {
+                    uint32_t rng = 0x9E3779B9u * (t + 1);
+                    for (uint32_t i = 0; i < kLookupsPerThread; ++i)
+                    {
+                        rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+                        TextureRef ref = LoadDDSFromFile(names[rng % kNumBenchmarkTextures], kBlackTransparent2D);
+                    }
+                });
+            }
+            for (thread& t : threads)
+                t.join();
+            const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+            const double rate = threadCount * (double)kLookupsPerThread / seconds;
+            if (threadCount == 1)
+                singleThreadRate = rate;
+            Utility::Printf("Texture cache: %2u threads, %7.2f M lookups/s, %5.2fx one thread\n", threadCount,
+                rate * 1e-6, rate / singleThreadRate);
+
+            if (threadCount == maxThreads)
+                break;
+        }
     }
 
 } // namespace TextureManager
 
-ManagedTexture::ManagedTexture( const wstring& FileName )
-    : m_MapKey(FileName), m_IsValid(false), m_IsLoading(true), m_ReferenceCount(0)
+ManagedTexture::ManagedTexture( const wstring& FileName, uint64_t KeyHash )
+    : m_MapKey(FileName), m_KeyHash(KeyHash), m_IsValid(false), m_Loaded(m_LoadPromise.get_future().share()),
+    m_ReferenceCount(0), m_StreamingId(~0u), m_SRVGeneration(0), m_sRGB(false)
 {
     m_hCpuDescriptorHandle.ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
+    m_StagingSRV.ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
+}
+
+ManagedTexture::~ManagedTexture()
+{
+    if (m_StreamingId != ~0u)
+    {
+        lock_guard<mutex> Guard(TextureManager::s_StreamingMutex);
+        TextureManager::s_Scheduler.RemoveTexture(m_StreamingId);
+        TextureManager::s_StreamedTextures[m_StreamingId] = nullptr;
+    }
+}
+
+bool ManagedTexture::CreateStreamedFromFile(const wstring& filePath, bool sRGB)
+{
+    Utility::FileMapping file;
+    if (!file.Open(filePath))
+        return false;
+
+    DDSMipLayout layout;
+    if (FAILED(GetDDSMipLayout(file.GetData(), file.GetSize(), layout)) || layout.fileSize > file.GetSize())
+        return false;
+
+    // The tail is the mips no larger than kMipTailSize. There must be finer mips to stream, and each of them must be
+    // able to start a texture.
+    uint32_t tailMip = 0;
+    while (tailMip + 1 < layout.mipCount && std::max(layout.width, layout.height) >> tailMip > TextureStreaming::kMipTailSize)
+        ++tailMip;
+    if (tailMip == 0)
+        return false;
+    for (uint32_t mip = 0; mip <= tailMip; ++mip)
+    {
+        if (!layout.CanStartAt(mip))
+            return false;
+    }
+
+    const uint64_t tailOffset = layout.mipOffset[tailMip];
+    m_hCpuDescriptorHandle = AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+    if (FAILED(CreateDDSTextureFromMips(g_Device, file.GetData(), layout.headerSize, file.GetData() + tailOffset,
+        (size_t)(layout.fileSize - tailOffset), tailMip, sRGB, m_pResource.GetAddressOf(), m_hCpuDescriptorHandle)))
+    {
+        // Descriptors are never freed, so this one is simply abandoned to the full load.
+        m_pResource = nullptr;
+        return false;
+    }
+
+    m_StagingSRV = AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+    m_UsageState = D3D12_RESOURCE_STATE_GENERIC_READ;
+    m_IsValid = true;
+    D3D12_RESOURCE_DESC desc = GetResource()->GetDesc();
+    m_Width = (uint32_t)desc.Width;
+    m_Height = desc.Height;
+    m_Depth = desc.DepthOrArraySize;
+
+    m_FilePath = filePath;
+    m_DDSHeader.assign(file.GetData(), file.GetData() + layout.headerSize);
+    m_MipLayout = layout;
+    m_sRGB = sRGB;
+
+    vector<uint64_t> mipBytes(layout.mipSize, layout.mipSize + layout.mipCount);
+    {
+        lock_guard<mutex> Guard(TextureManager::s_StreamingMutex);
+        m_StreamingId = TextureManager::s_Scheduler.AddTexture(layout.width, layout.height, mipBytes, tailMip);
+        if (m_StreamingId >= TextureManager::s_StreamedTextures.size())
+            TextureManager::s_StreamedTextures.resize(m_StreamingId + 1, nullptr);
+        TextureManager::s_StreamedTextures[m_StreamingId] = this;
+    }
+
+    FinishLoading();
+    return true;
+}
+
+Microsoft::WRL::ComPtr<ID3D12Resource> ManagedTexture::SwapStreamedResource(Microsoft::WRL::ComPtr<ID3D12Resource> resource,
+    uint32_t generation)
+{
+    g_Device->CopyDescriptorsSimple(1, m_hCpuDescriptorHandle, m_StagingSRV, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+    m_pResource.Swap(resource);
+
+    D3D12_RESOURCE_DESC desc = GetResource()->GetDesc();
+    m_Width = (uint32_t)desc.Width;
+    m_Height = desc.Height;
+    m_SRVGeneration = generation;
+    return resource;
 }
 
-void ManagedTexture::CreateFromMemory(ByteArray ba, eDefaultTexture fallback, bool forceSRGB)
+void ManagedTexture::CreateFromFile(const wstring& filePath, eDefaultTexture fallback, bool forceSRGB)
 {
-    if (ba->size() == 0)
+    // The texture's subresources are copied from the mapping straight into upload memory, so the file is never
+    // read into a buffer of its own.
+    Utility::FileMapping file;
+    if (!file.Open(filePath))
     {
         m_hCpuDescriptorHandle = GetDefaultTexture(fallback);
     }
@@ -135,7 +600,8 @@ void ManagedTexture::CreateFromMemory(ByteArray ba, eDefaultTexture fallback, bo
         // We probably have a texture to load, so let's allocate a new descriptor
         m_hCpuDescriptorHandle = AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
 
-        if ( SUCCEEDED( CreateDDSTextureFromMemory( g_Device, (const uint8_t*)ba->data(), ba->size(),
+        file.Prefetch(0, file.GetSize());
+        if ( SUCCEEDED( CreateDDSTextureFromMemory( g_Device, file.GetData(), file.GetSize(),
             0, forceSRGB, m_pResource.GetAddressOf(), m_hCpuDescriptorHandle) ) )
         {
             m_UsageState = D3D12_RESOURCE_STATE_GENERIC_READ;
@@ -152,55 +618,57 @@ void ManagedTexture::CreateFromMemory(ByteArray ba, eDefaultTexture fallback, bo
         }
     }
 
-    m_IsLoading = false;
+    FinishLoading();
 }
 
 void ManagedTexture::WaitForLoad( void ) const
 {
-    while ((volatile bool&)m_IsLoading)
-        this_thread::yield();
+    m_Loaded.wait();
 }
 
-void ManagedTexture::Unload()
+void ManagedTexture::Release()
 {
-    TextureManager::DestroyTexture(m_MapKey);
+    // Once the count reaches zero another thread may destroy this texture, so nothing of it is read after that.
+    const uint64_t keyHash = m_KeyHash;
+    if (--m_ReferenceCount == 0)
+        TextureManager::DestroyTexture(keyHash, this);
 }
 
 TextureRef::TextureRef( const TextureRef& ref ) : m_ref(ref.m_ref)
 {
     if (m_ref != nullptr)
-        ++m_ref->m_ReferenceCount;
+        m_ref->AddRef();
 }
 
 TextureRef::TextureRef( ManagedTexture* tex ) : m_ref(tex)
 {
     if (m_ref != nullptr)
-        ++m_ref->m_ReferenceCount;
+        m_ref->AddRef();
 }
 
 TextureRef::~TextureRef()
 {
-    if (m_ref != nullptr && --m_ref->m_ReferenceCount == 0)
-        m_ref->Unload();
+    if (m_ref != nullptr)
+        m_ref->Release();
 }
 
 void TextureRef::operator= (std::nullptr_t)
 {
     if (m_ref != nullptr)
-        --m_ref->m_ReferenceCount;
+        m_ref->Release();
 
     m_ref = nullptr;
 }
 
-void TextureRef::operator= (TextureRef& rhs)
+void TextureRef::operator= (const TextureRef& rhs)
 {
+    if (rhs.m_ref != nullptr)
+        rhs.m_ref->AddRef();
+
     if (m_ref != nullptr)
-        --m_ref->m_ReferenceCount;
+        m_ref->Release();
 
     m_ref = rhs.m_ref;
-
-    if (m_ref != nullptr)
-        ++m_ref->m_ReferenceCount;
 }
 
 bool TextureRef::IsValid() const
@@ -219,6 +687,11 @@ const Texture* TextureRef::operator->( void ) const
     return m_ref;
 }
 
+uint32_t TextureRef::GetSRVGeneration() const
+{
+    return m_ref != nullptr ? m_ref->GetSRVGeneration() : 0;
+}
+
 D3D12_CPU_DESCRIPTOR_HANDLE TextureRef::GetSRV() const
 {
     if (m_ref != nullptr)
@@ -228,12 +701,12 @@ D3D12_CPU_DESCRIPTOR_HANDLE TextureRef::GetSRV() const
 }
 
 
-TextureRef TextureManager::LoadDDSFromFile( const wstring& filePath, eDefaultTexture fallback, bool forceSRGB )
+TextureRef TextureManager::LoadDDSFromFile( const wstring& filePath, eDefaultTexture fallback, bool forceSRGB, bool allowStreaming )
 {
-    return FindOrLoadTexture(filePath, fallback, forceSRGB);
+    return FindOrLoadTexture(filePath, fallback, forceSRGB, allowStreaming);
 }
 
-TextureRef TextureManager::LoadDDSFromFile( const string& filePath, eDefaultTexture fallback, bool forceSRGB )
+TextureRef TextureManager::LoadDDSFromFile( const string& filePath, eDefaultTexture fallback, bool forceSRGB, bool allowStreaming )
 {
-    return LoadDDSFromFile(Utility::UTF8ToWideString(filePath), fallback, forceSRGB);
+    return LoadDDSFromFile(Utility::UTF8ToWideString(filePath), fallback, forceSRGB, allowStreaming);
 }
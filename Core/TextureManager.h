@@ -37,9 +37,37 @@ namespace TextureManager
     void Shutdown(void);
 
     // Load a texture from a DDS file.  Never returns null references, but if a 
-    // texture cannot be found, ref->IsValid() will return false.
-    TextureRef LoadDDSFromFile( const std::wstring& filePath, eDefaultTexture fallback = kMagenta2D, bool sRGB = false );
-    TextureRef LoadDDSFromFile( const std::string& filePath, eDefaultTexture fallback = kMagenta2D, bool sRGB = false );
+    // texture cannot be found, ref->IsValid() will return false.  With allowStreaming,
+    // and streaming enabled, a 2D texture with mips starts out with only its mip tail
+    // and its SRV changes whenever UpdateStreaming gives it more or fewer mips, so the
+    // caller must copy GetSRV() again when GetStreamingGeneration() changes.
+    TextureRef LoadDDSFromFile( const std::wstring& filePath, eDefaultTexture fallback = kMagenta2D, bool sRGB = false, bool allowStreaming = false );
+    TextureRef LoadDDSFromFile( const std::string& filePath, eDefaultTexture fallback = kMagenta2D, bool sRGB = false, bool allowStreaming = false );
+
+    // Streams the mips of textures loaded with allowStreaming on ioThreads background threads, keeping
+    // them within budgetBytes (see TextureStreaming.h).  Call before loading them.
+    void EnableStreaming( uint64_t budgetBytes, uint32_t ioThreads = 2 );
+    bool IsStreamingEnabled( void );
+
+    // Once per frame, before anything draws with streamed textures: swaps in the textures whose loads
+    // finished, frees the ones the GPU is done with and starts the next loads.
+    void UpdateStreaming( void );
+
+    // Tells the streamer that each of count textures spans about pixels[i] pixels on screen this
+    // frame.  Textures that don't stream are skipped.  The reports are only queued, under a lock the
+    // I/O threads never take, and the next UpdateStreaming hands them to the scheduler all at once.
+    void ReportScreenSizes( const TextureRef* textures, const float* pixels, uint32_t count );
+
+    // Increases every time UpdateStreaming gives streamed textures new SRVs, which it does for a batch of them at a
+    // time, at most once every few frames.
+    uint32_t GetStreamingGeneration( void );
+
+    // Prints the streaming budget, what is resident and what is pending.
+    void PrintStreamingStats( void );
+
+    // Loads the same missing textures from maxThreads threads at once, checking that each is loaded
+    // once, then times cached lookups from 1, 2, 4... maxThreads threads and prints how they scale.
+    void BenchmarkCache( uint32_t maxThreads );
 }
 
 // Forward declaration; private implementation
@@ -59,7 +87,7 @@ public:
     ~TextureRef();
 
     void operator= (std::nullptr_t);
-    void operator= (TextureRef& rhs);
+    void operator= (const TextureRef& rhs);
 
     // Check that this points to a valid texture (which loaded successfully)
     bool IsValid() const;
@@ -68,6 +96,9 @@ public:
     // returns a valid descriptor handle (specified by the fallback)
     D3D12_CPU_DESCRIPTOR_HANDLE GetSRV() const;
 
+    // The streaming generation at which the texture last got a new SRV, or 0 if it never did.
+    uint32_t GetSRVGeneration() const;
+
     // Get the texture pointer.  Client is responsible to not dereference
     // null pointers.
     const Texture* Get( void ) const;
@@ -75,5 +106,7 @@ public:
     const Texture* operator->( void ) const;
 
 private:
+    friend void TextureManager::ReportScreenSizes( const TextureRef* textures, const float* pixels, uint32_t count );
+
     ManagedTexture* m_ref;
 };
@@ -0,0 +1,213 @@
+#include "pch.h"
+#include "TextureStreaming.h"
+#include <algorithm>
+
+namespace TextureStreaming
+{
+    // The GPU samples mip log2(texels per pixel) and blends it with the next coarser one, so the finest mip needed is
+    // the last one that still has at least as many texels across as the texture spans pixels.
+    static uint32_t GetMipForPixels(uint32_t maxDimension, float pixels, uint32_t tailMip)
+    {
+        uint32_t mip = 0;
+        while (mip < tailMip && (float)(maxDimension >> (mip + 1)) >= pixels)
+            ++mip;
+        return mip;
+    }
+
+    uint32_t Scheduler::AddTexture(uint32_t width, uint32_t height, const std::vector<uint64_t>& mipBytes, uint32_t tailMip)
+    {
+        ASSERT(!mipBytes.empty() && tailMip < mipBytes.size());
+
+        uint32_t id;
+        if (!m_FreeIds.empty())
+        {
+            id = m_FreeIds.back();
+            m_FreeIds.pop_back();
+        }
+        else
+        {
+            id = (uint32_t)m_Textures.size();
+            m_Textures.emplace_back();
+        }
+
+        Texture& tex = m_Textures[id];
+        tex.chainBytes.assign(mipBytes.size() + 1, 0);
+        for (size_t mip = mipBytes.size(); mip-- > 0; )
+            tex.chainBytes[mip] = tex.chainBytes[mip + 1] + mipBytes[mip];
+        tex.maxDimension = std::max(width, height);
+        tex.tailMip = tailMip;
+        tex.residentMip = tailMip;
+        tex.targetMip = tailMip;
+        tex.wantedMip = tailMip;
+        tex.reportedPixels = 0.0f;
+        tex.wantedPixels = 0.0f;
+        tex.lastSeenFrame = 0;
+        tex.alive = true;
+        tex.pending = false;
+        return id;
+    }
+
+    void Scheduler::RemoveTexture(uint32_t texture)
+    {
+        Texture& tex = m_Textures[texture];
+        ASSERT(tex.alive);
+        tex.alive = false;
+
+        // A pending request still refers to the id, so it is only reused once that request completes.
+        if (!tex.pending)
+            m_FreeIds.push_back(texture);
+    }
+
+    void Scheduler::ReportUsage(uint32_t texture, float pixels)
+    {
+        Texture& tex = m_Textures[texture];
+        tex.reportedPixels = std::max(tex.reportedPixels, pixels);
+    }
+
+    void Scheduler::CompleteRequest(uint32_t texture, bool succeeded)
+    {
+        Texture& tex = m_Textures[texture];
+        ASSERT(tex.pending && m_PendingCount > 0);
+        tex.pending = false;
+        --m_PendingCount;
+
+        if (!tex.alive)
+        {
+            m_FreeIds.push_back(texture);
+            return;
+        }
+
+        if (succeeded)
+            tex.residentMip = tex.targetMip;
+        else
+            tex.targetMip = tex.residentMip;
+    }
+
+    uint64_t Scheduler::GetResidentBytes() const
+    {
+        uint64_t bytes = 0;
+        for (const Texture& tex : m_Textures)
+        {
+            if (tex.alive)
+                bytes += tex.chainBytes[tex.residentMip];
+        }
+        return bytes;
+    }
+
+    uint64_t Scheduler::GetPlannedBytes() const
+    {
+        uint64_t bytes = 0;
+        for (const Texture& tex : m_Textures)
+        {
+            if (tex.alive)
+                bytes += tex.chainBytes[tex.targetMip];
+        }
+        return bytes;
+    }
+
+    void Scheduler::Issue(uint32_t texture, uint32_t firstMip, uint64_t& plannedBytes, std::vector<Request>& requests)
+    {
+        Texture& tex = m_Textures[texture];
+        ASSERT(!tex.pending && firstMip != tex.residentMip && firstMip <= tex.tailMip);
+        plannedBytes += tex.chainBytes[firstMip];
+        plannedBytes -= tex.chainBytes[tex.residentMip];
+        tex.targetMip = firstMip;
+        tex.pending = true;
+        ++m_PendingCount;
+
+        Request request;
+        request.texture = texture;
+        request.firstMip = firstMip;
+        requests.push_back(request);
+    }
+
+    void Scheduler::Update(std::vector<Request>& requests)
+    {
+        ++m_Frame;
+
+        std::vector<uint32_t> loads;
+        std::vector<uint32_t> evictions;
+        for (uint32_t id = 0; id < (uint32_t)m_Textures.size(); ++id)
+        {
+            Texture& tex = m_Textures[id];
+            if (!tex.alive)
+                continue;
+
+            // A texture keeps what it needed when it was last seen for a while, so that looking away and back
+            // doesn't throw mips out and read them again.
+            if (tex.reportedPixels > 0.0f)
+            {
+                tex.wantedPixels = tex.reportedPixels;
+                tex.lastSeenFrame = m_Frame;
+            }
+            else if (m_Frame - tex.lastSeenFrame > m_RetentionFrames)
+            {
+                tex.wantedPixels = 0.0f;
+            }
+            tex.reportedPixels = 0.0f;
+            tex.wantedMip = GetMipForPixels(tex.maxDimension, tex.wantedPixels, tex.tailMip);
+
+            if (tex.pending)
+                continue;
+            if (tex.wantedMip < tex.residentMip)
+                loads.push_back(id);
+            else if (tex.wantedMip > tex.residentMip)
+                evictions.push_back(id);
+        }
+
+        // Loads go by how many pixels are short of texels: the texture's size on screen times the mips it lacks.
+        auto Shortfall = [&](uint32_t id)
+        {
+            const Texture& tex = m_Textures[id];
+            return tex.wantedPixels * (float)(tex.residentMip - tex.wantedMip);
+        };
+        std::stable_sort(loads.begin(), loads.end(),
+            [&](uint32_t a, uint32_t b) { return Shortfall(a) > Shortfall(b); });
+
+        // Evictions go from the textures seen longest ago, then the smallest on screen.
+        std::stable_sort(evictions.begin(), evictions.end(), [&](uint32_t a, uint32_t b)
+        {
+            const Texture& ta = m_Textures[a];
+            const Texture& tb = m_Textures[b];
+            return ta.lastSeenFrame != tb.lastSeenFrame ? ta.lastSeenFrame < tb.lastSeenFrame : ta.wantedPixels < tb.wantedPixels;
+        });
+
+        uint64_t plannedBytes = GetPlannedBytes();
+        size_t nextEviction = 0;
+
+        // Planning counts an eviction as done when it is issued. The texture is briefly held twice while it is
+        // recreated, which the pending limit keeps bounded.
+        auto Evict = [&]()
+        {
+            uint32_t id = evictions[nextEviction++];
+            Issue(id, m_Textures[id].wantedMip, plannedBytes, requests);
+        };
+
+        // A budget that shrank below what is resident is met first.
+        while (plannedBytes > m_Budget && nextEviction < evictions.size() && m_PendingCount < m_MaxPending)
+            Evict();
+
+        for (uint32_t id : loads)
+        {
+            if (m_PendingCount >= m_MaxPending)
+                break;
+
+            const Texture& tex = m_Textures[id];
+            auto ExtraBytes = [&](uint32_t mip) { return tex.chainBytes[mip] - tex.chainBytes[tex.residentMip]; };
+
+            uint32_t firstMip = tex.wantedMip;
+            while (plannedBytes + ExtraBytes(firstMip) > m_Budget && nextEviction < evictions.size() &&
+                m_PendingCount + 1 < m_MaxPending)
+            {
+                Evict();
+            }
+
+            // Without enough room, part of the shortfall is still better than none.
+            while (firstMip < tex.residentMip && plannedBytes + ExtraBytes(firstMip) > m_Budget)
+                ++firstMip;
+
+            if (firstMip < tex.residentMip)
+                Issue(id, firstMip, plannedBytes, requests);
+        }
+    }
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Decides which mips of streamed textures are resident. Every texture keeps its mip tail, the mips no larger than
+// kMipTailSize, resident from the moment it loads. Finer mips are requested from how large the texture appears on
+// screen, biggest shortfall first, and textures that are no longer seen give their fine mips back when the memory
+// budget needs the room. The scheduler only plans: the texture manager reads the files, recreates the textures and
+// reports back when a request is done. Nothing here touches the GPU.
+namespace TextureStreaming
+{
+    // Mips whose larger side is at most this many texels make up the tail that is loaded up front.
+    const uint32_t kMipTailSize = 128;
+
+    struct Request
+    {
+        uint32_t texture;
+        uint32_t firstMip;  // The finest mip the texture is to have; coarser than its current one for evictions
+    };
+
+    class Scheduler
+    {
+    public:
+        void SetBudget(uint64_t bytes) { m_Budget = bytes; }
+        uint64_t GetBudget() const { return m_Budget; }
+
+        // Requests that may be outstanding at once; each one holds two copies of a texture while it runs.
+        void SetMaxPendingRequests(uint32_t count) { m_MaxPending = count; }
+
+        // Frames a texture keeps wanting its mips after it was last seen.
+        void SetRetentionFrames(uint32_t frames) { m_RetentionFrames = frames; }
+
+        // mipBytes[i] is the size of mip i, finest first, and the texture starts out with mips tailMip and coarser.
+        // Returns the id that the calls below take.
+        uint32_t AddTexture(uint32_t width, uint32_t height, const std::vector<uint64_t>& mipBytes, uint32_t tailMip);
+        void RemoveTexture(uint32_t texture);
+
+        // Records that the texture spans about this many pixels on screen. The largest report of a frame counts.
+        void ReportUsage(uint32_t texture, float pixels);
+
+        // Ends the frame and appends the requests to start now, loads and evictions, most urgent first.
+        void Update(std::vector<Request>& requests);
+
+        // Called when a request from Update finished, whether or not it succeeded.
+        void CompleteRequest(uint32_t texture, bool succeeded);
+
+        uint32_t GetResidentMip(uint32_t texture) const { return m_Textures[texture].residentMip; }
+        uint32_t GetWantedMip(uint32_t texture) const { return m_Textures[texture].wantedMip; }
+        uint32_t GetPendingRequestCount() const { return m_PendingCount; }
+        uint64_t GetResidentBytes() const;  // Of the mips in place now
+        uint64_t GetPlannedBytes() const;   // Once the pending requests are done
+
+    private:
+        struct Texture
+        {
+            std::vector<uint64_t> chainBytes;   // chainBytes[i]: mips i and coarser; one extra 0 at the end
+            uint32_t maxDimension;
+            uint32_t tailMip;
+            uint32_t residentMip;
+            uint32_t targetMip;         // residentMip unless a request is pending
+            uint32_t wantedMip;
+            float reportedPixels;       // This frame's largest report
+            float wantedPixels;         // What wantedMip was computed from
+            uint64_t lastSeenFrame;
+            bool alive;
+            bool pending;
+        };
+
+        void Issue(uint32_t texture, uint32_t firstMip, uint64_t& plannedBytes, std::vector<Request>& requests);
+
+        std::vector<Texture> m_Textures;
+        std::vector<uint32_t> m_FreeIds;
+        uint64_t m_Budget = ~0ull;
+        uint64_t m_Frame = 0;
+        uint32_t m_MaxPending = 4;
+        uint32_t m_RetentionFrames = 120;
+        uint32_t m_PendingCount = 0;
+    };
+}
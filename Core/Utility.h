@@ -17,9 +17,9 @@
 
 namespace Utility
 {
-#ifdef _CONSOLE
+#if defined(_CONSOLE) || !defined(_WIN32)
     inline void Print( const char* msg ) { printf("%s", msg); }
-    inline void Print( const wchar_t* msg ) { wprintf(L"%ws", msg); }
+    inline void Print( const wchar_t* msg ) { wprintf(L"%ls", msg); }
 #else
     inline void Print( const char* msg ) { OutputDebugStringA(msg); }
     inline void Print( const wchar_t* msg ) { OutputDebugString(msg); }
@@ -159,5 +159,7 @@ namespace Utility
 
 #define BreakIfFailed( hr ) if (FAILED(hr)) __debugbreak()
 
+#ifdef _WIN32
 void SIMDMemCopy( void* __restrict Dest, const void* __restrict Source, size_t NumQuadwords );
 void SIMDMemFill( void* __restrict Dest, __m128 FillVector, size_t NumQuadwords );
+#endif
@@ -13,6 +13,9 @@
 
 #pragma once
 
+// Off Windows only the platform-neutral units build, for the tests in Tests/: no Direct3D, no DirectXMath.
+#ifdef _WIN32
+
 #pragma warning(disable:4201) // nonstandard extension used : nameless struct/union
 #pragma warning(disable:4238) // nonstandard extension used : class rvalue used as lvalue
 #pragma warning(disable:4239) // A non-const reference may only be bound to an lvalue; assignment operator takes a reference to non-const
@@ -41,6 +44,8 @@
 
 #define WIN32_LEAN_AND_MEAN
 
+#endif // _WIN32
+
 // Enable imgui window
 #define UI_ENABLE 1
 #define DISABLE_FRUSTUM_CULL 1
@@ -58,6 +63,7 @@
 // WARNING: Have only tested 128 and 512
 #define SDF_TEXTURE_RESOLUTION 512
 
+#ifdef _WIN32
 #include <Windows.h>
 #include <wrl/client.h>
 #include <wrl/event.h>
@@ -72,6 +78,16 @@
 #define D3D12_GPU_VIRTUAL_ADDRESS_NULL      ((D3D12_GPU_VIRTUAL_ADDRESS)0)
 #define D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN   ((D3D12_GPU_VIRTUAL_ADDRESS)-1)
 #define MY_IID_PPV_ARGS                     IID_PPV_ARGS
+#else
+// The little of the Windows headers and the MSVC runtime the portable units use.
+#include <csignal>
+#include <cstddef>
+#include <cstdio>
+typedef unsigned char byte;
+#define vsprintf_s vsnprintf
+#define __debugbreak() raise(SIGTRAP)
+template <size_t size> inline int strcpy_s(char (&dest)[size], const char* source) { snprintf(dest, size, "%s", source); return 0; }
+#endif // _WIN32
 
 
 #include <cstdint>
@@ -83,11 +99,15 @@
 #include <cwctype>
 #include <exception>
 
+#ifdef _WIN32
 #include <ppltasks.h>
+#endif
 #include <functional>
 
 #include "Utility.h"
+#ifdef _WIN32
 #include "VectorMath.h"
 #include "EngineTuning.h"
 #include "EngineProfiling.h"
 #include "Util/CommandLineArg.h"
+#endif
@@ -12,81 +12,122 @@
 //
 
 #include "Animation.h"
+#include "AnimationCompress.h"
+#ifdef _WIN32
 #include "Model.h"
+#endif
 #include "../Core/Utility.h"
-#include "../Core/Math/Common.h"
-#include "../Core/Math/Quaternion.h"
-
-using Math::Quaternion;
-using Math::Vector4;
 
-static inline float ToFloat(const int8_t x) { return Math::Max(x / 127.0f, -1.0f); }
-static inline float ToFloat(const uint8_t x) { return x / 255.0f; }
-static inline float ToFloat(const int16_t x) { return Math::Max(x / 32767.0f, -1.0f); }
-static inline float ToFloat(const uint16_t x) { return x / 65535.0f; }
-
-static inline void Lerp3(float* Dest, const float* Key1, const float* Key2, float T)
-{
-    Dest[0] = Math::Lerp(Key1[0], Key2[0], T);
-    Dest[1] = Math::Lerp(Key1[1], Key2[1], T);
-    Dest[2] = Math::Lerp(Key1[2], Key2[2], T);
-}
-
-template <typename T>
-static inline Quaternion ToQuat(const T* rot)
-{
-    return (Quaternion)Vector4(ToFloat(rot[0]), ToFloat(rot[1]), ToFloat(rot[2]), ToFloat(rot[3]));
-}
+#include <cstring>
+#include <emmintrin.h>
 
-static inline Quaternion ToQuat(const float* rot)
-{
-    return Quaternion(XMLoadFloat4((const XMFLOAT4*)rot));
-}
+using namespace AnimationCompress;
 
-static inline void Slerp(float* Dest, const void* Key1, const void* Key2, float T, uint32_t Format)
+namespace
 {
-    switch (Format)
-    {
-    case AnimationCurve::kSNorm8:
+    __m128i LoadKey48(const uint8_t* key)
     {
-        const int8_t* key1 = (const int8_t*)Key1;
-        const int8_t* key2 = (const int8_t*)Key2;
-        XMStoreFloat4((XMFLOAT4*)Dest, (FXMVECTOR)Math::Slerp(ToQuat(key1), ToQuat(key2), T));
-        break;
+        uint64_t bits = 0;
+        std::memcpy(&bits, key, 6);
+        return _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)&bits), _mm_setzero_si128());
     }
-    case AnimationCurve::kUNorm8:
+
+    // The three stored components are in [-1/sqrt(2), 1/sqrt(2)] and the dropped, largest one is positive. The low
+    // bits of the first two words are its index, which selects where each lane comes from without branching: lanes
+    // before it keep their stored component, it gets the reconstructed one and lanes after it take their left
+    // neighbor's.
+    __m128 DecodeSmallestThree48(const uint8_t* key)
     {
-        const uint8_t* key1 = (const uint8_t*)Key1;
-        const uint8_t* key2 = (const uint8_t*)Key2;
-        XMStoreFloat4((XMFLOAT4*)Dest, (FXMVECTOR)Math::Slerp(ToQuat(key1), ToQuat(key2), T));
-        break;
+        const __m128i words = LoadKey48(key);
+        const __m128i ones = _mm_set1_epi32(1);
+        const __m128i largest = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(_mm_shuffle_epi32(words, _MM_SHUFFLE(0, 0, 0, 0)), ones), 1),
+            _mm_and_si128(_mm_shuffle_epi32(words, _MM_SHUFFLE(1, 1, 1, 1)), ones));
+
+        __m128 q = _mm_cvtepi32_ps(_mm_srli_epi32(words, 1));
+        q = _mm_sub_ps(_mm_mul_ps(q, _mm_set1_ps(1.41421356f / 32767.0f)), _mm_set1_ps(0.70710678f));
+        q = _mm_and_ps(q, _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1)));
+
+        __m128 sum = _mm_mul_ps(q, q);
+        sum = _mm_add_ps(sum, _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(2, 3, 0, 1)));
+        sum = _mm_add_ps(sum, _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 0, 3, 2)));
+        const __m128 w = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(1.0f), sum), _mm_setzero_ps()));
+
+        const __m128i lane = _mm_set_epi32(3, 2, 1, 0);
+        const __m128 before = _mm_castsi128_ps(_mm_cmplt_epi32(lane, largest));
+        const __m128 at = _mm_castsi128_ps(_mm_cmpeq_epi32(lane, largest));
+        const __m128 shifted = _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(q), 4));
+        const __m128 after = _mm_andnot_ps(_mm_or_ps(before, at), shifted);
+        return _mm_or_ps(_mm_or_ps(_mm_and_ps(before, q), _mm_and_ps(at, w)), after);
     }
-    case AnimationCurve::kSNorm16:
+
+    __m128 DecodeRangeUNorm16(const uint8_t* key, __m128 scale, __m128 bias)
     {
-        const int16_t* key1 = (const int16_t*)Key1;
-        const int16_t* key2 = (const int16_t*)Key2;
-        XMStoreFloat4((XMFLOAT4*)Dest, (FXMVECTOR)Math::Slerp(ToQuat(key1), ToQuat(key2), T));
-        break;
+        return _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(LoadKey48(key)), scale), bias);
     }
-    case AnimationCurve::kUNorm16:
+
+    __m128 DecodeKeyFrame(const AnimationCurve& curve, const uint8_t* key, __m128 scale, __m128 bias)
     {
-        const uint16_t* key1 = (const uint16_t*)Key1;
-        const uint16_t* key2 = (const uint16_t*)Key2;
-        XMStoreFloat4((XMFLOAT4*)Dest, (FXMVECTOR)Math::Slerp(ToQuat(key1), ToQuat(key2), T));
-        break;
+        switch (curve.keyFrameFormat)
+        {
+        case AnimationCurve::kSmallestThree48:
+            return DecodeSmallestThree48(key);
+        case AnimationCurve::kRangeUNorm16:
+            return DecodeRangeUNorm16(key, scale, bias);
+        default:
+            // kFloat, the builder writes no other format, as a float4 rotation or a float3 that mustn't be read past
+            if (curve.keyFrameStride == 4)
+                return _mm_loadu_ps((const float*)key);
+            return _mm_movelh_ps(_mm_castsi128_ps(_mm_loadl_epi64((const __m128i*)key)), _mm_load_ss((const float*)key + 2));
+        }
     }
-    case AnimationCurve::kFloat:
+
+    __m128 Sample(const AnimationCurve& curve, const uint8_t* keyFrameData, float time)
     {
-        const float* key1 = (const float*)Key1;
-        const float* key2 = (const float*)Key2;
-        XMStoreFloat4((XMFLOAT4*)Dest, (FXMVECTOR)Math::Slerp(ToQuat(key1), ToQuat(key2), T));
-        break;
-    }
-    default:
-        ASSERT(0, "Unexpected animation key frame data format");
-        break;
+        const uint32_t lastKey = (uint32_t)curve.numSegments;
+        float progress = (time - curve.startTime) * curve.rangeScale;
+        progress = progress > 0.0f ? (progress < curve.numSegments ? progress : curve.numSegments) : 0.0f;
+        const uint32_t segment = (uint32_t)progress < lastKey ? (uint32_t)progress : lastKey;
+        const float t = curve.interpolation == AnimationCurve::kStep ? 0.0f : progress - (float)segment;
+
+        const uint8_t* keys = keyFrameData + curve.keyFrameOffset;
+        __m128 scale = _mm_setzero_ps(), bias = _mm_setzero_ps();
+        if (curve.keyFrameFormat == AnimationCurve::kRangeUNorm16)
+        {
+            scale = _mm_loadu_ps((const float*)keys);
+            bias = _mm_loadu_ps((const float*)keys + 4);
+            keys += kRangeHeaderSize;
+        }
+
+        const uint32_t keySize = GetKeyFrameSize(curve);
+        const __m128 a = DecodeKeyFrame(curve, keys + keySize * segment, scale, bias);
+        if (segment == lastKey || t == 0.0f)
+            return a;
+        __m128 b = DecodeKeyFrame(curve, keys + keySize * (segment + 1), scale, bias);
+
+        if (curve.targetPath != AnimationCurve::kRotation)
+            return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), _mm_set1_ps(t)));
+
+        // Nlerp along the shorter arc
+        __m128 dot = _mm_mul_ps(a, b);
+        dot = _mm_add_ps(dot, _mm_shuffle_ps(dot, dot, _MM_SHUFFLE(2, 3, 0, 1)));
+        dot = _mm_add_ps(dot, _mm_shuffle_ps(dot, dot, _MM_SHUFFLE(1, 0, 3, 2)));
+        b = _mm_xor_ps(b, _mm_and_ps(_mm_cmplt_ps(dot, _mm_setzero_ps()), _mm_set1_ps(-0.0f)));
+
+        __m128 q = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), _mm_set1_ps(t)));
+        __m128 length = _mm_mul_ps(q, q);
+        length = _mm_add_ps(length, _mm_shuffle_ps(length, length, _MM_SHUFFLE(2, 3, 0, 1)));
+        length = _mm_add_ps(length, _mm_shuffle_ps(length, length, _MM_SHUFFLE(1, 0, 3, 2)));
+        return _mm_div_ps(q, _mm_sqrt_ps(length));
     }
 }
+
+void SampleCurve(const AnimationCurve& curve, const uint8_t* keyFrameData, float time, float* value)
+{
+    _mm_storeu_ps(value, Sample(curve, keyFrameData, time));
+}
+
+#ifdef _WIN32
+// Playback needs the model and DirectXMath, so off Windows only SampleCurve builds, for the tests.
 void ModelInstance::UpdateAnimations(float deltaTime)
 {
     uint32_t NumAnimations = m_Model->m_NumAnimations;
@@ -117,37 +158,27 @@ void ModelInstance::UpdateAnimations(float deltaTime)
             anim.state = AnimationState::kStopped;
         }
 
-        const AnimationCurve* firstCurve = m_Model->m_CurveData.get() + animation.firstCurve;
+        const AnimationCurve* firstCurve = m_Model->m_CurveData + animation.firstCurve;
 
         // Update animation nodes
         for (uint32_t j = 0; j < animation.numCurves; ++j)
         {
             const AnimationCurve& curve = firstCurve[j];
-            ASSERT(curve.numSegments > 0);
-
-            const float progress = Math::Clamp((anim.time - curve.startTime) * curve.rangeScale, 0.0f, curve.numSegments);
-            const uint32_t segment = (uint32_t)progress;
-            const float lerpT = progress - (float)segment;
-
-            const size_t stride = curve.keyFrameStride * 4;
-            const byte* key1 = m_Model->m_KeyFrameData.get() + curve.keyFrameOffset + stride * segment;
-            const byte* key2 = key1 + stride;
+            const __m128 value = Sample(curve, m_Model->m_KeyFrameData, anim.time);
             GraphNode& node = animGraph[curve.targetNode];
 
             switch (curve.targetPath)
             {
             case AnimationCurve::kTranslation:
-                ASSERT(curve.keyFrameFormat == AnimationCurve::kFloat);
-                Lerp3((float*)&node.xform + 12, (const float*)key1, (const float*)key2, lerpT);
+                XMStoreFloat3((XMFLOAT3*)((float*)&node.xform + 12), value);
                 break;
             case AnimationCurve::kRotation:
                 node.staleMatrix = true;
-                Slerp((float*)&node.rotation, key1, key2, lerpT, curve.keyFrameFormat);
+                node.rotation = Math::Quaternion(value);
                 break;
             case AnimationCurve::kScale:
-                ASSERT(curve.keyFrameFormat == AnimationCurve::kFloat);
                 node.staleMatrix = true;
-                Lerp3((float*)&node.scale, (const float*)key1, (const float*)key2, lerpT);
+                XMStoreFloat3(&node.scale, value);
                 break;
             default:
             case AnimationCurve::kWeights:
@@ -192,4 +223,5 @@ void ModelInstance::LoopAllAnimations(void)
         anim.state = AnimationState::kLooping;
         anim.time = 0.0f;
     }
-}
\ No newline at end of file
+}
+#endif
\ No newline at end of file
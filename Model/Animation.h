@@ -26,7 +26,11 @@ struct AnimationCurve
 {
     enum { kTranslation, kRotation, kScale, kWeights }; // targetPath
     enum { kLinear, kStep, kCatmullRomSpline, kCubicSpline }; // interpolation
-    enum { kSNorm8, kUNorm8, kSNorm16, kUNorm16, kFloat }; // format
+    enum { kSNorm8, kUNorm8, kSNorm16, kUNorm16, kFloat, kSmallestThree48, kRangeUNorm16 }; // format
+
+    // kSmallestThree48 rotations are 6 bytes each: the three smallest components in 15 bits apiece and which one was
+    // dropped. kRangeUNorm16 translations and scales are three UNORM16s, 6 bytes, after a float4 scale and a float4
+    // bias that map them back. Keys of either are 6 bytes whatever keyFrameStride says; see AnimationCompress.h.
 
     uint32_t targetNode : 28;           // Which node is being animated
     uint32_t targetPath : 2;            // What aspect of the transform is animated
@@ -34,11 +38,20 @@ struct AnimationCurve
     uint32_t keyFrameOffset : 26;       // Byte offset to first key frame
     uint32_t keyFrameFormat : 3;        // Data format for the key frames
     uint32_t keyFrameStride : 3;        // Number of 4-byte words for one key frame
-    float numSegments;                  // Number of evenly-spaced gaps between keyframes
+    float numSegments;                  // Number of evenly-spaced gaps between keyframes (0 for a constant)
     float startTime;                    // Time stamp of the first key frame
     float rangeScale;                   // numSegments / (endTime - startTime)
 };
 
+//
+// Evaluates a curve at a time, clamping to its ends, into the four floats of value: a float3 (and a fourth that
+// should be ignored) or a quaternion. keyFrameData is what the curve's keyFrameOffset is relative to. Rotations are
+// nlerped along the shorter arc, which strays from the slerp between keys alpha radians apart by at most
+// alpha^3 / 240 radians for alpha up to 1.5. AnimationCompress keeps keys within kMaxKeyAngle of their neighbors,
+// which holds that to kNlerpTolerance.
+//
+void SampleCurve(const AnimationCurve& curve, const uint8_t* keyFrameData, float time, float* value);
+
 //
 // An animation is composed of multiple animation curves.
 //
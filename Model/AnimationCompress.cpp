@@ -0,0 +1,352 @@
+#include "AnimationCompress.h"
+#include "../Core/Utility.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+namespace AnimationCompress
+{
+    uint32_t GetComponentCount(uint32_t targetPath)
+    {
+        return targetPath == AnimationCurve::kRotation ? 4 : 3;
+    }
+
+    void Normalize(float* q)
+    {
+        const double length = std::sqrt((double)q[0] * q[0] + (double)q[1] * q[1] + (double)q[2] * q[2] + (double)q[3] * q[3]);
+        for (int c = 0; c < 4; ++c)
+            q[c] = length > 0.0 ? (float)(q[c] / length) : (c == 3 ? 1.0f : 0.0f);
+    }
+
+    // The value of a key, skipping the tangents of cubic splines.
+    static const float* GetKeyValue(const SourceCurve& source, uint32_t key)
+    {
+        const uint32_t n = GetComponentCount(source.targetPath);
+        return source.values + (source.interpolation == AnimationCurve::kCubicSpline ? 3 * key + 1 : key) * n;
+    }
+
+    // Evaluates the source the way glTF defines its interpolation, clamping to its ends.
+    void EvaluateSource(const SourceCurve& source, float time, float* value)
+    {
+        const uint32_t n = GetComponentCount(source.targetPath);
+        const bool rotation = source.targetPath == AnimationCurve::kRotation;
+        const uint32_t lastKey = source.keyCount - 1;
+
+        // The last key at or before the time
+        const uint32_t key = (uint32_t)(std::upper_bound(source.times, source.times + source.keyCount, time) - source.times);
+        if (key == 0 || key > lastKey)
+        {
+            std::copy_n(GetKeyValue(source, key == 0 ? 0 : lastKey), n, value);
+            return;
+        }
+
+        const uint32_t k0 = key - 1, k1 = key;
+        const float* v0 = GetKeyValue(source, k0);
+        const float* v1 = GetKeyValue(source, k1);
+        const float dt = source.times[k1] - source.times[k0];
+        const float t = dt > 0.0f ? (time - source.times[k0]) / dt : 0.0f;
+
+        switch (source.interpolation)
+        {
+        case AnimationCurve::kStep:
+            std::copy_n(v0, n, value);
+            return;
+
+        case AnimationCurve::kCubicSpline:
+        {
+            // Hermite between each value and its out-tangent and the next value and its in-tangent
+            const float* outTangent = v0 + n;
+            const float* inTangent = v1 - n;
+            const float t2 = t * t, t3 = t2 * t;
+            for (uint32_t c = 0; c < n; ++c)
+            {
+                value[c] = (2.0f * t3 - 3.0f * t2 + 1.0f) * v0[c] + (t3 - 2.0f * t2 + t) * dt * outTangent[c] +
+                    (-2.0f * t3 + 3.0f * t2) * v1[c] + (t3 - t2) * dt * inTangent[c];
+            }
+            break;
+        }
+
+        case AnimationCurve::kCatmullRomSpline:
+        {
+            // Through the neighboring keys, which past the ends are the end keys reflected, so that the curve
+            // leaves its ends at the slope of its end segments
+            const float* before = GetKeyValue(source, k0 == 0 ? 0 : k0 - 1);
+            const float* after = GetKeyValue(source, k1 == lastKey ? lastKey : k1 + 1);
+            const float t2 = t * t, t3 = t2 * t;
+            for (uint32_t c = 0; c < n; ++c)
+            {
+                const float p0 = k0 == 0 ? 2.0f * v0[c] - v1[c] : before[c];
+                const float p3 = k1 == lastKey ? 2.0f * v1[c] - v0[c] : after[c];
+                value[c] = 0.5f * (2.0f * v0[c] + (v1[c] - p0) * t + (2.0f * p0 - 5.0f * v0[c] + 4.0f * v1[c] - p3) * t2 +
+                    (3.0f * v0[c] - p0 - 3.0f * v1[c] + p3) * t3);
+            }
+            break;
+        }
+
+        default:
+            if (!rotation)
+            {
+                for (uint32_t c = 0; c < n; ++c)
+                    value[c] = v0[c] + (v1[c] - v0[c]) * t;
+                return;
+            }
+            else
+            {
+                // Spherical, along the shorter arc
+                double dot = 0.0;
+                for (uint32_t c = 0; c < 4; ++c)
+                    dot += (double)v0[c] * v1[c];
+                const double sign = dot < 0.0 ? -1.0 : 1.0;
+                dot = std::min(std::abs(dot), 1.0);
+                const double angle = std::acos(dot);
+                double w0 = 1.0 - t, w1 = t;
+                if (angle > 1e-6)
+                {
+                    w0 = std::sin((1.0 - t) * angle) / std::sin(angle);
+                    w1 = std::sin(t * angle) / std::sin(angle);
+                }
+                for (uint32_t c = 0; c < 4; ++c)
+                    value[c] = (float)(w0 * v0[c] + w1 * sign * v1[c]);
+            }
+            break;
+        }
+
+        if (rotation)
+            Normalize(value);
+    }
+
+    // The rotation angle between two unit quaternions, or the distance between two vectors. The angle comes from
+    // the chord rather than from the dot product, which has no precision left for angles this small.
+    float GetError(uint32_t targetPath, const float* a, const float* b)
+    {
+        if (targetPath != AnimationCurve::kRotation)
+        {
+            double sum = 0.0;
+            for (int c = 0; c < 3; ++c)
+                sum += ((double)a[c] - b[c]) * ((double)a[c] - b[c]);
+            return (float)std::sqrt(sum);
+        }
+
+        double dot = 0.0;
+        for (int c = 0; c < 4; ++c)
+            dot += (double)a[c] * b[c];
+        const double sign = dot < 0.0 ? -1.0 : 1.0;
+        double chord = 0.0;
+        for (int c = 0; c < 4; ++c)
+            chord += ((double)a[c] - sign * b[c]) * ((double)a[c] - sign * b[c]);
+        return (float)(4.0 * std::asin(std::min(std::sqrt(chord) * 0.5, 1.0)));
+    }
+
+    void EncodeSmallestThree48(const float* rotation, uint8_t* key)
+    {
+        float q[4] = { rotation[0], rotation[1], rotation[2], rotation[3] };
+        Normalize(q);
+
+        uint32_t largest = 0;
+        for (uint32_t c = 1; c < 4; ++c)
+        {
+            if (std::abs(q[c]) > std::abs(q[largest]))
+                largest = c;
+        }
+        const float sign = q[largest] < 0.0f ? -1.0f : 1.0f;
+
+        uint16_t words[3];
+        for (uint32_t c = 0, i = 0; c < 4; ++c)
+        {
+            if (c == largest)
+                continue;
+            const float x = std::min(std::max((sign * q[c] * 1.41421356f + 1.0f) * 0.5f, 0.0f), 1.0f);
+            words[i++] = (uint16_t)((uint32_t)std::lround(x * 32767.0f) << 1);
+        }
+        words[0] |= largest >> 1;
+        words[1] |= largest & 1;
+        std::memcpy(key, words, 6);
+    }
+
+    // Rotations quantize to smallest three, vectors to the range of the keys. Either way the keys are the float
+    // values the source was resampled to, n components apiece.
+    void Encode(uint32_t targetPath, uint32_t format, const std::vector<float>& keys, std::vector<uint8_t>& encoded)
+    {
+        const uint32_t n = GetComponentCount(targetPath);
+        const size_t keyCount = keys.size() / n;
+        encoded.clear();
+
+        if (format == AnimationCurve::kFloat)
+        {
+            encoded.resize(keys.size() * 4);
+            std::memcpy(encoded.data(), keys.data(), encoded.size());
+        }
+        else if (format == AnimationCurve::kSmallestThree48)
+        {
+            encoded.resize(keyCount * 6);
+            for (size_t k = 0; k < keyCount; ++k)
+                EncodeSmallestThree48(&keys[k * 4], &encoded[k * 6]);
+        }
+        else
+        {
+            float scale[4] = {}, bias[4] = {}, extent[3] = {};
+            for (uint32_t c = 0; c < 3; ++c)
+            {
+                float lo = keys[c], hi = keys[c];
+                for (size_t k = 1; k < keyCount; ++k)
+                {
+                    lo = std::min(lo, keys[k * 3 + c]);
+                    hi = std::max(hi, keys[k * 3 + c]);
+                }
+                extent[c] = hi - lo;
+                scale[c] = extent[c] / 65535.0f;
+                bias[c] = lo;
+            }
+
+            encoded.resize(kRangeHeaderSize + keyCount * 6);
+            std::memcpy(encoded.data(), scale, 16);
+            std::memcpy(encoded.data() + 16, bias, 16);
+            for (size_t k = 0; k < keyCount; ++k)
+            {
+                uint16_t words[3];
+                for (uint32_t c = 0; c < 3; ++c)
+                {
+                    const float x = extent[c] > 0.0f ? (keys[k * 3 + c] - bias[c]) / extent[c] : 0.0f;
+                    words[c] = (uint16_t)std::lround(std::min(std::max(x, 0.0f), 1.0f) * 65535.0f);
+                }
+                std::memcpy(&encoded[kRangeHeaderSize + k * 6], words, 6);
+            }
+        }
+    }
+
+    // The times the error is measured at: every source key and three times between each pair of them. Stepped
+    // sources jump at their keys, where either value is as right as the other, so only the last of their keys is
+    // checked.
+    static void GetTestTimes(const SourceCurve& source, std::vector<float>& times)
+    {
+        times.clear();
+        const bool step = source.interpolation == AnimationCurve::kStep;
+        for (uint32_t k = 0; k < source.keyCount; ++k)
+        {
+            if (!step || k + 1 == source.keyCount)
+                times.push_back(source.times[k]);
+            if (k + 1 == source.keyCount)
+                break;
+            for (int quarter = 1; quarter < 4; ++quarter)
+                times.push_back(source.times[k] + (source.times[k + 1] - source.times[k]) * quarter * 0.25f);
+        }
+    }
+
+    // The largest angle between adjacent rotation keys.
+    static float GetMaxKeyAngle(const std::vector<float>& keys)
+    {
+        float maxAngle = 0.0f;
+        for (size_t k = 4; k < keys.size(); k += 4)
+            maxAngle = std::max(maxAngle, GetError(AnimationCurve::kRotation, &keys[k - 4], &keys[k]));
+        return maxAngle;
+    }
+
+    // The largest error of a curve at the given times, stopping early once it passes the limit.
+    static float MeasureError(const AnimationCurve& curve, const uint8_t* keyFrames, const std::vector<float>& times,
+        const std::vector<float>& reference, float limit)
+    {
+        const uint32_t n = GetComponentCount(curve.targetPath);
+        float maxError = 0.0f;
+        for (size_t i = 0; i < times.size(); ++i)
+        {
+            float value[4];
+            SampleCurve(curve, keyFrames, times[i], value);
+            maxError = std::max(maxError, GetError(curve.targetPath, value, &reference[i * n]));
+            if (maxError > limit)
+                break;
+        }
+        return maxError;
+    }
+
+    bool Compress(const SourceCurve& source, CompressedCurve& result)
+    {
+        if (source.keyCount == 0 || source.targetPath > AnimationCurve::kScale)
+            return false;
+
+        const uint32_t n = GetComponentCount(source.targetPath);
+        const bool rotation = source.targetPath == AnimationCurve::kRotation;
+        const float startTime = source.times[0];
+        const float endTime = source.times[source.keyCount - 1];
+        const float duration = endTime - startTime;
+
+        result.endTime = endTime;
+        result.tolerance = kRotationTolerance - kNlerpTolerance;
+        if (!rotation)
+        {
+            float largest = 1.0f;
+            for (uint32_t k = 0; k < source.keyCount; ++k)
+            {
+                for (uint32_t c = 0; c < 3; ++c)
+                    largest = std::max(largest, std::abs(GetKeyValue(source, k)[c]));
+            }
+            result.tolerance = kVectorTolerance * largest;
+        }
+
+        std::vector<float> testTimes, reference;
+        GetTestTimes(source, testTimes);
+        reference.resize(testTimes.size() * n);
+        for (size_t i = 0; i < testTimes.size(); ++i)
+            EvaluateSource(source, testTimes[i], &reference[i * n]);
+
+        // Segment counts grow by a quarter at a time, and the source's own count is tried as it is, since evenly
+        // spaced sources usually need about that many
+        std::vector<uint32_t> segmentCounts;
+        const uint32_t sourceSegments = source.keyCount - 1;
+        const uint32_t maxSegments = duration > 0.0f ?
+            std::max(sourceSegments, (uint32_t)std::ceil(duration * kMaxSampleRate)) : 0;
+        for (uint32_t s = 0; s < maxSegments; s = std::max(s + 1, (uint32_t)std::ceil(s * 1.25f)))
+            segmentCounts.push_back(s);
+        segmentCounts.push_back(maxSegments);
+        segmentCounts.push_back(sourceSegments);
+        std::sort(segmentCounts.begin(), segmentCounts.end());
+        segmentCounts.erase(std::unique(segmentCounts.begin(), segmentCounts.end()), segmentCounts.end());
+        while (segmentCounts.back() > maxSegments)
+            segmentCounts.pop_back();
+
+        const uint32_t formats[2] = { rotation ? (uint32_t)AnimationCurve::kSmallestThree48 : (uint32_t)AnimationCurve::kRangeUNorm16, AnimationCurve::kFloat };
+
+        AnimationCurve& curve = result.curve;
+        curve.targetNode = 0;
+        curve.targetPath = source.targetPath;
+        curve.interpolation = source.interpolation == AnimationCurve::kStep ? AnimationCurve::kStep : AnimationCurve::kLinear;
+        curve.keyFrameOffset = 0;
+        curve.keyFrameStride = n;
+        curve.startTime = startTime;
+
+        std::vector<float> keys;
+        for (uint32_t segments : segmentCounts)
+        {
+            keys.resize((segments + 1) * n);
+            for (uint32_t k = 0; k <= segments; ++k)
+            {
+                const float time = segments == 0 ? startTime : startTime + duration * k / segments;
+                EvaluateSource(source, time, &keys[k * n]);
+            }
+
+            // Keys further apart would let the nlerp between them stray past kNlerpTolerance, unless there can be
+            // no more of them.
+            if (rotation && curve.interpolation == AnimationCurve::kLinear && segments < maxSegments &&
+                GetMaxKeyAngle(keys) > kMaxKeyAngle)
+                continue;
+
+            curve.numSegments = (float)segments;
+            curve.rangeScale = segments == 0 ? 0.0f : segments / duration;
+
+            for (uint32_t format : formats)
+            {
+                curve.keyFrameFormat = format;
+                Encode(source.targetPath, format, keys, result.keyFrames);
+                result.maxError = MeasureError(curve, result.keyFrames.data(), testTimes, reference, result.tolerance);
+                if (result.maxError <= result.tolerance)
+                    return true;
+            }
+        }
+
+        // Nothing met the tolerance, which only happens when the source changes faster than kMaxSampleRate can follow,
+        // so the most keys tried are kept as floats, which is what result.keyFrames has now.
+        result.maxError = MeasureError(curve, result.keyFrames.data(), testTimes, reference, FLT_MAX);
+        return true;
+    }
+}
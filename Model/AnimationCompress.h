@@ -0,0 +1,83 @@
+#pragma once
+
+#include "Animation.h"
+
+#include <cstdint>
+#include <vector>
+
+// Turns glTF animation samplers into the curves playback reads: resampled to evenly spaced keys, which is all
+// UpdateAnimations can step through, as few as keep the curve within a tolerance of the source, and quantized when
+// that stays within it too. Rotations become kSmallestThree48 and translations and scales kRangeUNorm16 relative to
+// the range the curve covers, falling back to floats only for curves the quantization would take out of tolerance.
+// Whatever the source interpolation, the result plays back linearly (or stepped for stepped sources), and the error
+// is measured through SampleCurve, the same code playback runs.
+namespace AnimationCompress
+{
+    // Largest angle a rotation may end up from the source, in radians. kNlerpTolerance of it is left for how far
+    // SampleCurve's nlerp strays from the slerp between keys, and the keys are held to the rest.
+    const float kRotationTolerance = 0.001f;
+    const float kNlerpTolerance = 0.00025f;
+
+    // Largest angle between adjacent rotation keys, in radians. The nlerp error is at most kMaxKeyAngle^3 / 240, just
+    // under kNlerpTolerance.
+    const float kMaxKeyAngle = 0.39f;
+
+    // Largest distance a translation or scale may end up from the source, relative to the largest magnitude any of
+    // its components reaches but at least this much absolutely.
+    const float kVectorTolerance = 0.0001f;
+
+    // Sources whose keys aren't evenly spaced are resampled at up to this many keys per second.
+    const float kMaxSampleRate = 60.0f;
+
+    // Bytes before the first key of a kRangeUNorm16 curve: the float4 scale and the float4 bias.
+    const uint32_t kRangeHeaderSize = 32;
+
+    struct SourceCurve
+    {
+        uint32_t targetPath;        // AnimationCurve::kTranslation, kRotation or kScale
+        uint32_t interpolation;     // AnimationCurve::kLinear, kStep, kCatmullRomSpline or kCubicSpline
+        const float* times;         // keyCount increasing time stamps
+        const float* values;        // keyCount float3s (float4 quaternions for rotations), each an in-tangent, value,
+                                    // out-tangent triple for cubic splines
+        uint32_t keyCount;
+    };
+
+    struct CompressedCurve
+    {
+        AnimationCurve curve;           // Everything but targetNode, and keyFrameOffset is 0
+        std::vector<uint8_t> keyFrames; // What the curve's keyFrameOffset points at
+        float endTime;
+        float tolerance;                // What maxError is held to, in radians for rotations
+        float maxError;                 // Largest difference from the source at the times checked
+    };
+
+    // Returns false if the source has no keys or isn't a translation, rotation or scale.
+    bool Compress(const SourceCurve& source, CompressedCurve& result);
+
+    // The steps Compress is made of.
+
+    // 4 for rotations, 3 for translations and scales.
+    uint32_t GetComponentCount(uint32_t targetPath);
+
+    // Scales a quaternion to unit length; a zero one becomes the identity.
+    void Normalize(float* q);
+
+    // Evaluates the source the way glTF defines its interpolation, clamping to its ends.
+    void EvaluateSource(const SourceCurve& source, float time, float* value);
+
+    // The rotation angle between two unit quaternions, or the distance between two vectors.
+    float GetError(uint32_t targetPath, const float* a, const float* b);
+
+    void EncodeSmallestThree48(const float* rotation, uint8_t* key);
+
+    // Writes keys, GetComponentCount floats apiece, in one of the key frame formats. kRangeUNorm16 curves start with
+    // the kRangeHeaderSize bytes of their range.
+    void Encode(uint32_t targetPath, uint32_t format, const std::vector<float>& keys, std::vector<uint8_t>& encoded);
+
+    // Bytes of one key frame of a curve.
+    inline uint32_t GetKeyFrameSize(const AnimationCurve& curve)
+    {
+        return curve.keyFrameFormat == AnimationCurve::kSmallestThree48 ||
+            curve.keyFrameFormat == AnimationCurve::kRangeUNorm16 ? 6 : curve.keyFrameStride * 4;
+    }
+}
@@ -0,0 +1,633 @@
+#include "BlockCompress.h"
+#include "../Core/Utility.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace BlockCompress
+{
+    // Average and principal axis of the first dims channels of 16 pixels. The axis comes from a few rounds of power
+    // iteration on the covariance matrix and is zero for flat blocks.
+    static void FitAxis(const float pixels[16][4], int dims, float mean[4], float axis[4])
+    {
+        for (int c = 0; c < 4; ++c)
+        {
+            mean[c] = 0.0f;
+            axis[c] = 0.0f;
+        }
+        for (int i = 0; i < 16; ++i)
+        {
+            for (int c = 0; c < dims; ++c)
+                mean[c] += pixels[i][c] / 16.0f;
+        }
+
+        float covariance[4][4] = {};
+        for (int i = 0; i < 16; ++i)
+        {
+            float d[4];
+            for (int c = 0; c < dims; ++c)
+                d[c] = pixels[i][c] - mean[c];
+            for (int r = 0; r < dims; ++r)
+            {
+                for (int c = 0; c < dims; ++c)
+                    covariance[r][c] += d[r] * d[c];
+            }
+        }
+
+        // Start from the channel with the most variance, which can't be orthogonal to the principal axis
+        int start = 0;
+        for (int c = 1; c < dims; ++c)
+            start = covariance[c][c] > covariance[start][start] ? c : start;
+        if (covariance[start][start] <= 0.0f)
+            return;
+
+        float v[4] = {};
+        for (int c = 0; c < dims; ++c)
+            v[c] = covariance[start][c];
+
+        for (int iteration = 0; iteration < 8; ++iteration)
+        {
+            float w[4] = {};
+            for (int r = 0; r < dims; ++r)
+            {
+                for (int c = 0; c < dims; ++c)
+                    w[r] += covariance[r][c] * v[c];
+            }
+
+            float length = 0.0f;
+            for (int c = 0; c < dims; ++c)
+                length = std::max(length, std::fabs(w[c]));
+            if (length == 0.0f)
+                return;
+            for (int c = 0; c < dims; ++c)
+                v[c] = w[c] / length;
+        }
+
+        float length = 0.0f;
+        for (int c = 0; c < dims; ++c)
+            length += v[c] * v[c];
+        length = std::sqrt(length);
+        for (int c = 0; c < dims; ++c)
+            axis[c] = v[c] / length;
+    }
+
+    // Endpoints at the extremes of the pixels' projections on the axis.
+    static void AxisExtents(const float pixels[16][4], int dims, const float mean[4], const float axis[4],
+        float low[4], float high[4])
+    {
+        float minT = 0.0f;
+        float maxT = 0.0f;
+        for (int i = 0; i < 16; ++i)
+        {
+            float t = 0.0f;
+            for (int c = 0; c < dims; ++c)
+                t += (pixels[i][c] - mean[c]) * axis[c];
+            minT = std::min(minT, t);
+            maxT = std::max(maxT, t);
+        }
+        for (int c = 0; c < dims; ++c)
+        {
+            low[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * minT));
+            high[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * maxT));
+        }
+    }
+
+    // Least squares endpoints for fixed interpolation weights: weights[i] is how much of high pixel i takes. Returns
+    // false when the weights don't determine both endpoints (all pixels on one of them).
+    static bool SolveEndpoints(const float pixels[16][4], int dims, const float weights[16], float low[4], float high[4])
+    {
+        float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+        float ax[4] = {}, bx[4] = {};
+        for (int i = 0; i < 16; ++i)
+        {
+            const float b = weights[i];
+            const float a = 1.0f - b;
+            aa += a * a;
+            ab += a * b;
+            bb += b * b;
+            for (int c = 0; c < dims; ++c)
+            {
+                ax[c] += a * pixels[i][c];
+                bx[c] += b * pixels[i][c];
+            }
+        }
+
+        const float determinant = aa * bb - ab * ab;
+        if (std::fabs(determinant) < 1e-6f)
+            return false;
+
+        for (int c = 0; c < dims; ++c)
+        {
+            low[c] = std::min(255.0f, std::max(0.0f, (ax[c] * bb - bx[c] * ab) / determinant));
+            high[c] = std::min(255.0f, std::max(0.0f, (bx[c] * aa - ax[c] * ab) / determinant));
+        }
+        return true;
+    }
+
+    static void LoadPixels(const uint8_t rgba[64], float pixels[16][4])
+    {
+        for (int i = 0; i < 16; ++i)
+        {
+            for (int c = 0; c < 4; ++c)
+                pixels[i][c] = rgba[i * 4 + c];
+        }
+    }
+
+    // ---- BC1 color ----
+
+    static uint16_t Pack565(const float color[3])
+    {
+        const int r = (int)std::lround(color[0] * 31.0f / 255.0f);
+        const int g = (int)std::lround(color[1] * 63.0f / 255.0f);
+        const int b = (int)std::lround(color[2] * 31.0f / 255.0f);
+        return (uint16_t)((r << 11) | (g << 5) | b);
+    }
+
+    static void Unpack565(uint16_t packed, int color[3])
+    {
+        const int r = (packed >> 11) & 31;
+        const int g = (packed >> 5) & 63;
+        const int b = packed & 31;
+        color[0] = (r << 3) | (r >> 2);
+        color[1] = (g << 2) | (g >> 4);
+        color[2] = (b << 3) | (b >> 2);
+    }
+
+    // The four colors of a block whose endpoints are c0 and c1, in index order.
+    static void ColorPalette(uint16_t c0, uint16_t c1, bool fourColors, int palette[4][4])
+    {
+        Unpack565(c0, palette[0]);
+        Unpack565(c1, palette[1]);
+        for (int c = 0; c < 3; ++c)
+        {
+            if (fourColors)
+            {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+            else
+            {
+                palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+                palette[3][c] = 0;
+            }
+        }
+        for (int i = 0; i < 4; ++i)
+            palette[i][3] = fourColors || i != 3 ? 255 : 0;
+    }
+
+    // Picks the nearest of the four colors for every pixel and returns the squared error.
+    static float AssignColorIndices(const float pixels[16][4], uint16_t c0, uint16_t c1, uint32_t& indices)
+    {
+        int palette[4][4];
+        ColorPalette(c0, c1, true, palette);
+
+        float total = 0.0f;
+        indices = 0;
+        for (int i = 0; i < 16; ++i)
+        {
+            float best = FLT_MAX;
+            uint32_t bestIndex = 0;
+            for (uint32_t p = 0; p < 4; ++p)
+            {
+                float error = 0.0f;
+                for (int c = 0; c < 3; ++c)
+                {
+                    const float d = pixels[i][c] - palette[p][c];
+                    error += d * d;
+                }
+                if (error < best)
+                {
+                    best = error;
+                    bestIndex = p;
+                }
+            }
+            indices |= bestIndex << (2 * i);
+            total += best;
+        }
+        return total;
+    }
+
+    // Always in four color mode (c0 > c1), which BC3 assumes anyway.
+    static void CompressColorBlock(const float pixels[16][4], uint8_t* block)
+    {
+        static const float kWeights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+
+        float mean[4], axis[4], low[4], high[4];
+        FitAxis(pixels, 3, mean, axis);
+        AxisExtents(pixels, 3, mean, axis, low, high);
+
+        uint16_t bestC0 = 0, bestC1 = 0;
+        uint32_t bestIndices = 0;
+        float bestError = FLT_MAX;
+
+        for (int iteration = 0; iteration < 3; ++iteration)
+        {
+            uint16_t c0 = Pack565(high);
+            uint16_t c1 = Pack565(low);
+            if (c0 < c1)
+                std::swap(c0, c1);
+
+            uint32_t indices = 0;
+            const float error = c0 == c1 ? AssignColorIndices(pixels, c0, c0, indices) : AssignColorIndices(pixels, c0, c1, indices);
+            if (c0 == c1)
+                indices = 0;
+
+            if (error < bestError)
+            {
+                bestError = error;
+                bestC0 = c0;
+                bestC1 = c1;
+                bestIndices = indices;
+            }
+
+            if (error == 0.0f || c0 == c1)
+                break;
+
+            // Refit both endpoints to the chosen indices. Index 0 is c0, the high end.
+            float weights[16];
+            for (int i = 0; i < 16; ++i)
+                weights[i] = 1.0f - kWeights[(indices >> (2 * i)) & 3];
+            if (!SolveEndpoints(pixels, 3, weights, low, high))
+                break;
+        }
+
+        block[0] = (uint8_t)bestC0;
+        block[1] = (uint8_t)(bestC0 >> 8);
+        block[2] = (uint8_t)bestC1;
+        block[3] = (uint8_t)(bestC1 >> 8);
+        std::memcpy(block + 4, &bestIndices, 4);
+    }
+
+    static void DecompressColorBlock(const uint8_t* block, bool forceFourColors, uint8_t rgba[64])
+    {
+        const uint16_t c0 = (uint16_t)(block[0] | (block[1] << 8));
+        const uint16_t c1 = (uint16_t)(block[2] | (block[3] << 8));
+        uint32_t indices;
+        std::memcpy(&indices, block + 4, 4);
+
+        int palette[4][4];
+        ColorPalette(c0, c1, forceFourColors || c0 > c1, palette);
+
+        for (int i = 0; i < 16; ++i)
+        {
+            const int* color = palette[(indices >> (2 * i)) & 3];
+            for (int c = 0; c < 4; ++c)
+                rgba[i * 4 + c] = (uint8_t)color[c];
+        }
+    }
+
+    // ---- BC4 single channel, used for BC3 alpha and both BC5 channels ----
+
+    static void ChannelPalette(int a0, int a1, int palette[8])
+    {
+        palette[0] = a0;
+        palette[1] = a1;
+        if (a0 > a1)
+        {
+            for (int i = 2; i < 8; ++i)
+                palette[i] = ((8 - i) * a0 + (i - 1) * a1 + 3) / 7;
+        }
+        else
+        {
+            for (int i = 2; i < 6; ++i)
+                palette[i] = ((6 - i) * a0 + (i - 1) * a1 + 2) / 5;
+            palette[6] = 0;
+            palette[7] = 255;
+        }
+    }
+
+    static void CompressChannelBlock(const float pixels[16][4], int channel, uint8_t* block)
+    {
+        int low = 255;
+        int high = 0;
+        for (int i = 0; i < 16; ++i)
+        {
+            low = std::min(low, (int)pixels[i][channel]);
+            high = std::max(high, (int)pixels[i][channel]);
+        }
+
+        // Equal endpoints select the six value mode, where index 0 reproduces them exactly
+        int palette[8];
+        ChannelPalette(high, low, palette);
+
+        uint64_t bits = (uint64_t)high | ((uint64_t)low << 8);
+        for (int i = 0; i < 16 && high != low; ++i)
+        {
+            int best = INT_MAX;
+            uint64_t bestIndex = 0;
+            for (int p = 0; p < 8; ++p)
+            {
+                const int error = std::abs((int)pixels[i][channel] - palette[p]);
+                if (error < best)
+                {
+                    best = error;
+                    bestIndex = (uint64_t)p;
+                }
+            }
+            bits |= bestIndex << (16 + 3 * i);
+        }
+
+        for (int b = 0; b < 8; ++b)
+            block[b] = (uint8_t)(bits >> (8 * b));
+    }
+
+    static void DecompressChannelBlock(const uint8_t* block, int channel, uint8_t rgba[64])
+    {
+        uint64_t bits = 0;
+        for (int b = 0; b < 8; ++b)
+            bits |= (uint64_t)block[b] << (8 * b);
+
+        int palette[8];
+        ChannelPalette(block[0], block[1], palette);
+        for (int i = 0; i < 16; ++i)
+            rgba[i * 4 + channel] = (uint8_t)palette[(bits >> (16 + 3 * i)) & 7];
+    }
+
+    // ---- BC7 mode 6: one subset, RGBA endpoints of 7 bits plus a shared low bit each, 4-bit indices ----
+
+    static const int kBC7Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    static inline int InterpolateBC7(int e0, int e1, int weight)
+    {
+        return ((64 - weight) * e0 + weight * e1 + 32) >> 6;
+    }
+
+    // Quantizes float endpoints to the mode 6 grid, trying all four p-bit pairs, and picks indices for the best.
+    static float FitMode6(const float pixels[16][4], const float low[4], const float high[4], int endpoints[2][4],
+        int indices[16])
+    {
+        float bestError = FLT_MAX;
+
+        for (int pbits = 0; pbits < 4; ++pbits)
+        {
+            int e[2][4];
+            const float* source[2] = { low, high };
+            for (int j = 0; j < 2; ++j)
+            {
+                const int p = (pbits >> j) & 1;
+                for (int c = 0; c < 4; ++c)
+                {
+                    const int q = std::min(127, std::max(0, (int)std::lround((source[j][c] - p) / 2.0f)));
+                    e[j][c] = (q << 1) | p;
+                }
+            }
+
+            int palette[16][4];
+            for (int w = 0; w < 16; ++w)
+            {
+                for (int c = 0; c < 4; ++c)
+                    palette[w][c] = InterpolateBC7(e[0][c], e[1][c], kBC7Weights4[w]);
+            }
+
+            // Projecting on the endpoint line narrows each pixel down to the two weights around it
+            float direction[4];
+            float lengthSquared = 0.0f;
+            for (int c = 0; c < 4; ++c)
+            {
+                direction[c] = float(e[1][c] - e[0][c]);
+                lengthSquared += direction[c] * direction[c];
+            }
+            const float scale = lengthSquared > 0.0f ? 64.0f / lengthSquared : 0.0f;
+
+            float error = 0.0f;
+            int chosen[16];
+            for (int i = 0; i < 16 && error < bestError; ++i)
+            {
+                float t = 0.0f;
+                for (int c = 0; c < 4; ++c)
+                    t += (pixels[i][c] - e[0][c]) * direction[c];
+                t *= scale;
+
+                int upper = 0;
+                while (upper < 15 && kBC7Weights4[upper] < t)
+                    ++upper;
+
+                float best = FLT_MAX;
+                for (int w = std::max(upper - 1, 0); w <= upper; ++w)
+                {
+                    float d = 0.0f;
+                    for (int c = 0; c < 4; ++c)
+                    {
+                        const float delta = pixels[i][c] - palette[w][c];
+                        d += delta * delta;
+                    }
+                    if (d < best)
+                    {
+                        best = d;
+                        chosen[i] = w;
+                    }
+                }
+                error += best;
+            }
+
+            if (error < bestError)
+            {
+                bestError = error;
+                std::memcpy(endpoints, e, sizeof(e));
+                std::memcpy(indices, chosen, sizeof(chosen));
+            }
+        }
+
+        return bestError;
+    }
+
+    class BitWriter
+    {
+    public:
+        explicit BitWriter(uint8_t* block) : m_Block(block), m_Position(0) { std::memset(block, 0, 16); }
+
+        void Write(uint32_t value, int bits)
+        {
+            for (int b = 0; b < bits; ++b, ++m_Position)
+                m_Block[m_Position >> 3] |= (uint8_t)(((value >> b) & 1) << (m_Position & 7));
+        }
+
+    private:
+        uint8_t* m_Block;
+        int m_Position;
+    };
+
+    class BitReader
+    {
+    public:
+        explicit BitReader(const uint8_t* block) : m_Block(block), m_Position(0) {}
+
+        uint32_t Read(int bits)
+        {
+            uint32_t value = 0;
+            for (int b = 0; b < bits; ++b, ++m_Position)
+                value |= (uint32_t)((m_Block[m_Position >> 3] >> (m_Position & 7)) & 1) << b;
+            return value;
+        }
+
+    private:
+        const uint8_t* m_Block;
+        int m_Position;
+    };
+
+    static void CompressBC7Block(const float pixels[16][4], uint8_t* block)
+    {
+        float mean[4], axis[4], low[4], high[4];
+        FitAxis(pixels, 4, mean, axis);
+        AxisExtents(pixels, 4, mean, axis, low, high);
+
+        int endpoints[2][4];
+        int indices[16];
+        float bestError = FitMode6(pixels, low, high, endpoints, indices);
+
+        for (int iteration = 0; iteration < 2 && bestError > 0.0f; ++iteration)
+        {
+            float weights[16];
+            for (int i = 0; i < 16; ++i)
+                weights[i] = kBC7Weights4[indices[i]] / 64.0f;
+            if (!SolveEndpoints(pixels, 4, weights, low, high))
+                break;
+
+            int refinedEndpoints[2][4];
+            int refinedIndices[16];
+            const float error = FitMode6(pixels, low, high, refinedEndpoints, refinedIndices);
+            if (error >= bestError)
+                break;
+
+            bestError = error;
+            std::memcpy(endpoints, refinedEndpoints, sizeof(endpoints));
+            std::memcpy(indices, refinedIndices, sizeof(indices));
+        }
+
+        // The first index is stored with its high bit implied to be zero
+        if (indices[0] >= 8)
+        {
+            for (int c = 0; c < 4; ++c)
+                std::swap(endpoints[0][c], endpoints[1][c]);
+            for (int i = 0; i < 16; ++i)
+                indices[i] = 15 - indices[i];
+        }
+
+        BitWriter writer(block);
+        writer.Write(1 << 6, 7);
+        for (int c = 0; c < 4; ++c)
+        {
+            writer.Write(endpoints[0][c] >> 1, 7);
+            writer.Write(endpoints[1][c] >> 1, 7);
+        }
+        writer.Write(endpoints[0][0] & 1, 1);
+        writer.Write(endpoints[1][0] & 1, 1);
+        for (int i = 0; i < 16; ++i)
+            writer.Write(indices[i], i == 0 ? 3 : 4);
+    }
+
+    // Only mode 6 is decoded; blocks in other modes come back transparent black.
+    static void DecompressBC7Block(const uint8_t* block, uint8_t rgba[64])
+    {
+        if ((block[0] & 0x7f) != 0x40)
+        {
+            std::memset(rgba, 0, 64);
+            return;
+        }
+
+        BitReader reader(block);
+        reader.Read(7);
+
+        int endpoints[2][4];
+        for (int c = 0; c < 4; ++c)
+        {
+            endpoints[0][c] = reader.Read(7) << 1;
+            endpoints[1][c] = reader.Read(7) << 1;
+        }
+        const int p0 = reader.Read(1);
+        const int p1 = reader.Read(1);
+        for (int c = 0; c < 4; ++c)
+        {
+            endpoints[0][c] |= p0;
+            endpoints[1][c] |= p1;
+        }
+
+        for (int i = 0; i < 16; ++i)
+        {
+            const int index = reader.Read(i == 0 ? 3 : 4);
+            for (int c = 0; c < 4; ++c)
+                rgba[i * 4 + c] = (uint8_t)InterpolateBC7(endpoints[0][c], endpoints[1][c], kBC7Weights4[index]);
+        }
+    }
+
+    uint32_t GetBlockSize(Format format)
+    {
+        return format == kBC1 ? 8 : 16;
+    }
+
+    void CompressBlock(const uint8_t rgba[64], Format format, uint8_t* block)
+    {
+        float pixels[16][4];
+        LoadPixels(rgba, pixels);
+
+        switch (format)
+        {
+        case kBC1:
+            CompressColorBlock(pixels, block);
+            break;
+        case kBC3:
+            CompressChannelBlock(pixels, 3, block);
+            CompressColorBlock(pixels, block + 8);
+            break;
+        case kBC5:
+            CompressChannelBlock(pixels, 0, block);
+            CompressChannelBlock(pixels, 1, block + 8);
+            break;
+        case kBC7:
+            CompressBC7Block(pixels, block);
+            break;
+        }
+    }
+
+    void DecompressBlock(const uint8_t* block, Format format, uint8_t rgba[64])
+    {
+        switch (format)
+        {
+        case kBC1:
+            DecompressColorBlock(block, false, rgba);
+            break;
+        case kBC3:
+            DecompressColorBlock(block + 8, true, rgba);
+            DecompressChannelBlock(block, 3, rgba);
+            break;
+        case kBC5:
+            for (int i = 0; i < 16; ++i)
+            {
+                rgba[i * 4 + 2] = 0;
+                rgba[i * 4 + 3] = 255;
+            }
+            DecompressChannelBlock(block, 0, rgba);
+            DecompressChannelBlock(block + 8, 1, rgba);
+            break;
+        case kBC7:
+            DecompressBC7Block(block, rgba);
+            break;
+        }
+    }
+
+    void CompressImage(const uint8_t* rgba, size_t rowPitch, uint32_t width, uint32_t height, Format format,
+        uint8_t* blocks, size_t blockRowPitch)
+    {
+        const uint32_t blockSize = GetBlockSize(format);
+        uint8_t pixels[64];
+
+        for (uint32_t by = 0; by < height; by += 4)
+        {
+            uint8_t* blockRow = blocks + (by / 4) * blockRowPitch;
+            for (uint32_t bx = 0; bx < width; bx += 4)
+            {
+                for (uint32_t y = 0; y < 4; ++y)
+                {
+                    const uint8_t* row = rgba + std::min(by + y, height - 1) * rowPitch;
+                    for (uint32_t x = 0; x < 4; ++x)
+                        std::memcpy(pixels + (y * 4 + x) * 4, row + std::min(bx + x, width - 1) * 4, 4);
+                }
+                CompressBlock(pixels, format, blockRow + (bx / 4) * blockSize);
+            }
+        }
+    }
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Block compression of 8-bit RGBA images on the CPU, with no dependency on DirectXTex or Windows, so textures encode
+// the same on every platform the content builds on. The encoders aim for DirectXTex's default quality at a fraction
+// of its time: colors are fit along their principal axis and refined by least squares, and BC7 uses mode 6 only.
+namespace BlockCompress
+{
+    enum Format
+    {
+        kBC1,   // RGB, 4 bits per pixel
+        kBC3,   // RGBA with interpolated alpha, 8 bits per pixel
+        kBC5,   // Two channels (red and green), 8 bits per pixel
+        kBC7,   // RGBA, 8 bits per pixel
+    };
+
+    // 8 bytes for BC1, 16 for the others.
+    uint32_t GetBlockSize(Format format);
+
+    // Encodes one 4x4 block of RGBA pixels, row by row.
+    void CompressBlock(const uint8_t rgba[64], Format format, uint8_t* block);
+    void DecompressBlock(const uint8_t* block, Format format, uint8_t rgba[64]);
+
+    // Encodes an image of any size; pixels past the right and bottom edges repeat the last column and row.
+    void CompressImage(const uint8_t* rgba, size_t rowPitch, uint32_t width, uint32_t height, Format format,
+        uint8_t* blocks, size_t blockRowPitch);
+}
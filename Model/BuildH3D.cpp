@@ -140,11 +140,6 @@ bool ModelH3D::BuildModel(ModelData& model, const std::wstring& basePath) const
     }
 
     ASSERT(model.m_TextureOptions.size() == model.m_TextureNames.size());
-    for (size_t ti = 0; ti < model.m_TextureNames.size(); ++ti)
-    {
-        std::wstring fullPath = basePath + Utility::UTF8ToWideString(model.m_TextureNames[ti]);
-        CompileTextureOnDemand(fullPath, model.m_TextureOptions[ti]);
-    }
 
     model.m_BoundingSphere = BoundingSphere(kZero);
     model.m_BoundingBox = AxisAlignedBox(kZero);
@@ -205,7 +200,7 @@ bool ModelH3D::BuildModel(ModelData& model, const std::wstring& basePath) const
 
         BoundingSphere sphereOS;
         AxisAlignedBox boxOS;
-        Renderer::CompileMesh(model.m_Meshes, model.m_GeometryData, gltfMesh, 0, Matrix4(kIdentity), sphereOS, boxOS); 
+        Renderer::CompileMesh(model.m_Meshes, model.m_GeometryData, model.m_Meshlets, model.m_MeshletRanges, model.m_Lods, model.m_LodRanges, gltfMesh, 0, Matrix4(kIdentity), sphereOS, boxOS); 
         model.m_BoundingSphere = model.m_BoundingSphere.Union(sphereOS);
         model.m_BoundingBox.AddBoundingBox(boxOS);
     }
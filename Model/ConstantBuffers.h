@@ -79,6 +79,7 @@ __declspec(align(256)) struct RayMarchGlobalConstants
     float zmin;
     float zmax;
     float sdfResolution;
+    uint32_t sdfHierarchical;
 };
 
 __declspec(align(256)) struct SDFGIGlobalConstants
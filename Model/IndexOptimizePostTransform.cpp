@@ -19,9 +19,11 @@
 #include "../Core/Utility.h"
 
 #include <stdint.h>
-#include <ASSERT.h>
 #include <math.h>
 #include <algorithm>
+#include <cstring>
+#include <limits>
+#include <memory>
 
 #include "IndexOptimizePostTransform.h"
 
@@ -448,3 +450,7 @@ void OptimizeFaces(const SrcIndexType* indexList, size_t indexCount, DstIndexTyp
         entriesInCache0 = std::min(entriesInCache1, lruCacheSize);
     }
 }
+
+template void OptimizeFaces<uint16_t, uint16_t>(const uint16_t* indexList, size_t indexCount, uint16_t* newIndexList, size_t lruCacheSize);
+template void OptimizeFaces<uint32_t, uint16_t>(const uint32_t* indexList, size_t indexCount, uint16_t* newIndexList, size_t lruCacheSize);
+template void OptimizeFaces<uint32_t, uint32_t>(const uint32_t* indexList, size_t indexCount, uint32_t* newIndexList, size_t lruCacheSize);
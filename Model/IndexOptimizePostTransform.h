@@ -14,6 +14,9 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+
 //-----------------------------------------------------------------------------
 //  OptimizeFaces
 //-----------------------------------------------------------------------------
@@ -26,11 +29,11 @@
 //          a pointer to a preallocated buffer the same size as indexList to
 //          hold the optimized index list
 //      lruCacheSize
-//          the size of the simulated post-transform cache (max:64)
+//          the size of the simulated post-transform cache (max:64); see
+//          MeshOptimize::kVertexCacheSize
+//
+//  Instantiated for uint16_t to uint16_t, uint32_t to uint16_t and uint32_t
+//  to uint32_t indices.
 //-----------------------------------------------------------------------------
 template <typename SrcIndexType, typename DstIndexType>
 void OptimizeFaces(const SrcIndexType* indexList, size_t indexCount, DstIndexType* newIndexList, size_t lruCacheSize);
-
-template void OptimizeFaces<uint16_t, uint16_t>(const uint16_t* indexList, size_t indexCount, uint16_t* newIndexList, size_t lruCacheSize);
-template void OptimizeFaces<uint32_t, uint16_t>(const uint32_t* indexList, size_t indexCount, uint16_t* newIndexList, size_t lruCacheSize);
-template void OptimizeFaces<uint32_t, uint32_t>(const uint32_t* indexList, size_t indexCount, uint32_t* newIndexList, size_t lruCacheSize);
@@ -0,0 +1,603 @@
+#include "JsonDocument.h"
+#include "../Core/Utility.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+namespace glTF
+{
+    static const JsonValue s_NullValue;
+
+    // Values are carved out of blocks of up to this many, except for containers too large for one. Small documents
+    // get smaller blocks, at roughly one value per 16 characters.
+    static const uint32_t kValuesPerBlock = 16384;
+    static const uint32_t kMinValuesPerBlock = 256;
+    static const size_t kCharsPerBlock = 4096;
+
+    // Powers of ten that doubles hold exactly, for converting short decimals without strtod.
+    static const double kExactPowersOf10[] =
+    {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    static inline bool IsDigit(char c)
+    {
+        return c >= '0' && c <= '9';
+    }
+
+    static inline const char* SkipWhitespace(const char* p, const char* end)
+    {
+        while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t'))
+            ++p;
+        return p;
+    }
+
+    static bool ReadHex4(const char* p, const char* end, uint32_t& value)
+    {
+        if (end - p < 4)
+            return false;
+
+        value = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            const char c = p[i];
+            uint32_t digit;
+            if (c >= '0' && c <= '9')
+                digit = c - '0';
+            else if (c >= 'a' && c <= 'f')
+                digit = c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F')
+                digit = c - 'A' + 10;
+            else
+                return false;
+            value = value << 4 | digit;
+        }
+        return true;
+    }
+
+    static char* EncodeUTF8(uint32_t codePoint, char* out)
+    {
+        if (codePoint < 0x80)
+        {
+            *out++ = (char)codePoint;
+        }
+        else if (codePoint < 0x800)
+        {
+            *out++ = (char)(0xC0 | codePoint >> 6);
+            *out++ = (char)(0x80 | (codePoint & 0x3F));
+        }
+        else if (codePoint < 0x10000)
+        {
+            *out++ = (char)(0xE0 | codePoint >> 12);
+            *out++ = (char)(0x80 | (codePoint >> 6 & 0x3F));
+            *out++ = (char)(0x80 | (codePoint & 0x3F));
+        }
+        else
+        {
+            *out++ = (char)(0xF0 | codePoint >> 18);
+            *out++ = (char)(0x80 | (codePoint >> 12 & 0x3F));
+            *out++ = (char)(0x80 | (codePoint >> 6 & 0x3F));
+            *out++ = (char)(0x80 | (codePoint & 0x3F));
+        }
+        return out;
+    }
+
+    JsonValue::const_iterator JsonValue::find(const char* key, size_t length) const
+    {
+        if (m_Type != kObject)
+            return end();
+
+        // Backwards, so that the last of duplicate keys wins as it does with nlohmann.
+        for (const JsonValue* member = m_Children + m_Size; member != m_Children; )
+        {
+            --member;
+            if (member->m_KeyLength == length && std::memcmp(member->m_Key, key, length) == 0)
+                return const_iterator(member);
+        }
+        return end();
+    }
+
+    const JsonValue& JsonValue::at(const char* key) const
+    {
+        const_iterator member = find(key);
+        if (member == end())
+        {
+            ASSERT(false, "Missing JSON member \"%s\"", key);
+            return s_NullValue;
+        }
+        return member.value();
+    }
+
+    const JsonValue& JsonValue::at(size_t index) const
+    {
+        if (m_Type != kArray || index >= m_Size)
+        {
+            ASSERT(false, "JSON array index %zu out of range", index);
+            return s_NullValue;
+        }
+        return m_Children[index];
+    }
+
+    void JsonValue::Read(std::string& value) const
+    {
+        if (m_Type == kString)
+            value.assign(m_String, m_Size);
+        else
+        {
+            value.clear();
+            ReportTypeMismatch();
+        }
+    }
+
+    void JsonValue::ReportTypeMismatch() const
+    {
+        ASSERT(false, "JSON value of type %u read as another type", (uint32_t)m_Type);
+    }
+
+    JsonDocument::JsonDocument() :
+        m_Begin(nullptr), m_End(nullptr),
+        m_ValueBlockUsed(0), m_ValueBlockSize(0), m_ValuesPerBlock(kValuesPerBlock),
+        m_CharBlockUsed(0), m_CharBlockSize(0),
+        m_MemoryUsage(0)
+    {
+    }
+
+    bool JsonDocument::Fail(const char* at, const char* message)
+    {
+        uint32_t line = 1;
+        const char* lineStart = m_Begin;
+        for (const char* c = m_Begin; c < at; ++c)
+        {
+            if (*c == '\n')
+            {
+                ++line;
+                lineStart = c + 1;
+            }
+        }
+
+        char location[64];
+        std::snprintf(location, sizeof(location), " at line %u, column %u", line, (uint32_t)(at - lineStart) + 1);
+        m_Error = message;
+        m_Error += location;
+        m_Root = JsonValue();
+        return false;
+    }
+
+    JsonValue* JsonDocument::AllocateValues(uint32_t count)
+    {
+        if (count == 0)
+            return nullptr;
+
+        if (count > m_ValueBlockSize - m_ValueBlockUsed)
+        {
+            m_ValueBlockSize = std::max(count, m_ValuesPerBlock);
+            m_ValueBlockUsed = 0;
+            m_ValueBlocks.emplace_back(new JsonValue[m_ValueBlockSize]);
+            m_MemoryUsage += m_ValueBlockSize * sizeof(JsonValue);
+        }
+
+        JsonValue* values = m_ValueBlocks.back().get() + m_ValueBlockUsed;
+        m_ValueBlockUsed += count;
+        return values;
+    }
+
+    char* JsonDocument::AllocateChars(size_t count)
+    {
+        if (count > m_CharBlockSize - m_CharBlockUsed)
+        {
+            m_CharBlockSize = std::max(count, kCharsPerBlock);
+            m_CharBlockUsed = 0;
+            m_CharBlocks.emplace_back(new char[m_CharBlockSize]);
+            m_MemoryUsage += m_CharBlockSize;
+        }
+
+        char* chars = m_CharBlocks.back().get() + m_CharBlockUsed;
+        m_CharBlockUsed += count;
+        return chars;
+    }
+
+    bool JsonDocument::ParseString(const char*& p, const char*& string, uint32_t& length)
+    {
+        const char* quote = p;
+        const char* start = ++p;
+        while (p < m_End && *p != '"' && *p != '\\' && (unsigned char)*p >= 0x20)
+            ++p;
+
+        if (p == m_End)
+            return Fail(quote, "Unterminated string");
+
+        if (*p == '"')
+        {
+            string = start;
+            length = (uint32_t)(p - start);
+            ++p;
+            return true;
+        }
+
+        // Decoded strings are never longer than their escaped form, so the closing quote bounds the copy.
+        const char* close = p;
+        while (close < m_End && *close != '"')
+            close += *close == '\\' ? 2 : 1;
+        if (close >= m_End)
+            return Fail(quote, "Unterminated string");
+
+        char* decoded = AllocateChars(close - start);
+        std::memcpy(decoded, start, p - start);
+        char* out = decoded + (p - start);
+
+        while (p < close)
+        {
+            const char c = *p;
+            if ((unsigned char)c < 0x20)
+                return Fail(p, "Control character in a string");
+
+            if (c != '\\')
+            {
+                *out++ = c;
+                ++p;
+                continue;
+            }
+
+            const char* escape = p;
+            p += 2;
+            switch (escape[1])
+            {
+            case '"': *out++ = '"'; break;
+            case '\\': *out++ = '\\'; break;
+            case '/': *out++ = '/'; break;
+            case 'b': *out++ = '\b'; break;
+            case 'f': *out++ = '\f'; break;
+            case 'n': *out++ = '\n'; break;
+            case 'r': *out++ = '\r'; break;
+            case 't': *out++ = '\t'; break;
+            case 'u':
+            {
+                uint32_t codePoint;
+                if (!ReadHex4(p, close, codePoint))
+                    return Fail(escape, "Invalid \\u escape");
+                p += 4;
+
+                if (codePoint >= 0xD800 && codePoint <= 0xDBFF)
+                {
+                    uint32_t low;
+                    if (close - p < 6 || p[0] != '\\' || p[1] != 'u' || !ReadHex4(p + 2, close, low) ||
+                        low < 0xDC00 || low > 0xDFFF)
+                        return Fail(escape, "Unpaired UTF-16 surrogate");
+                    p += 6;
+                    codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+                }
+                else if (codePoint >= 0xDC00 && codePoint <= 0xDFFF)
+                {
+                    return Fail(escape, "Unpaired UTF-16 surrogate");
+                }
+
+                out = EncodeUTF8(codePoint, out);
+                break;
+            }
+            default:
+                return Fail(escape, "Invalid escape sequence");
+            }
+        }
+
+        string = decoded;
+        length = (uint32_t)(out - decoded);
+        p = close + 1;
+        return true;
+    }
+
+    bool JsonDocument::ParseKey(const char*& p, const char*& key, uint32_t& keyLength)
+    {
+        p = SkipWhitespace(p, m_End);
+        if (p == m_End || *p != '"')
+            return Fail(p, "Expected a member name");
+        if (!ParseString(p, key, keyLength))
+            return false;
+
+        p = SkipWhitespace(p, m_End);
+        if (p == m_End || *p != ':')
+            return Fail(p, "Expected ':'");
+        ++p;
+        return true;
+    }
+
+    bool JsonDocument::ParseNumber(const char*& p, JsonValue& value)
+    {
+        const char* start = p;
+        const bool negative = *p == '-';
+        if (negative)
+            ++p;
+
+        if (p == m_End || !IsDigit(*p))
+            return Fail(start, "Invalid number");
+
+        // Up to 19 significant digits are gathered into the mantissa; digits beyond make it inexact.
+        uint64_t mantissa = 0;
+        int32_t significantDigits = 0;
+        int32_t exponent = 0;
+        bool truncated = false;
+        bool isInteger = true;
+
+        if (*p == '0')
+        {
+            ++p;
+        }
+        else
+        {
+            for (; p < m_End && IsDigit(*p); ++p)
+            {
+                if (significantDigits < 19)
+                    mantissa = mantissa * 10 + (*p - '0');
+                else
+                {
+                    ++exponent;
+                    truncated = true;
+                }
+                ++significantDigits;
+            }
+        }
+
+        if (p < m_End && *p == '.')
+        {
+            isInteger = false;
+            ++p;
+            if (p == m_End || !IsDigit(*p))
+                return Fail(start, "Invalid number");
+
+            for (; p < m_End && IsDigit(*p); ++p)
+            {
+                if (mantissa == 0 && *p == '0')
+                {
+                    --exponent;
+                }
+                else if (significantDigits < 19)
+                {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    ++significantDigits;
+                    --exponent;
+                }
+                else
+                {
+                    truncated = true;
+                }
+            }
+        }
+
+        if (p < m_End && (*p == 'e' || *p == 'E'))
+        {
+            isInteger = false;
+            ++p;
+            bool negativeExponent = false;
+            if (p < m_End && (*p == '+' || *p == '-'))
+                negativeExponent = *p++ == '-';
+            if (p == m_End || !IsDigit(*p))
+                return Fail(start, "Invalid number");
+
+            int32_t explicitExponent = 0;
+            for (; p < m_End && IsDigit(*p); ++p)
+            {
+                if (explicitExponent < 100000)
+                    explicitExponent = explicitExponent * 10 + (*p - '0');
+            }
+            exponent += negativeExponent ? -explicitExponent : explicitExponent;
+        }
+
+        if (isInteger && significantDigits <= 18)
+        {
+            value.m_Type = JsonValue::kInteger;
+            value.m_Integer = negative ? -(int64_t)mantissa : (int64_t)mantissa;
+            return true;
+        }
+
+        char buffer[64];
+        const size_t length = p - start;
+
+        // Longer integers stay exact as long as they fit in 64 bits, as with nlohmann, and become doubles otherwise.
+        if (isInteger && length < sizeof(buffer))
+        {
+            std::memcpy(buffer, start, length);
+            buffer[length] = '\0';
+            errno = 0;
+            if (negative)
+            {
+                const long long integer = std::strtoll(buffer, nullptr, 10);
+                if (errno == 0)
+                {
+                    value.m_Type = JsonValue::kInteger;
+                    value.m_Integer = integer;
+                    return true;
+                }
+            }
+            else
+            {
+                const unsigned long long integer = std::strtoull(buffer, nullptr, 10);
+                if (errno == 0)
+                {
+                    value.m_Type = JsonValue::kUnsigned;
+                    value.m_Unsigned = integer;
+                    return true;
+                }
+            }
+        }
+
+        value.m_Type = JsonValue::kFloat;
+
+        // Both operands are exact, so one multiply or divide rounds the same way strtod does.
+        if (!truncated && mantissa <= (1ull << 53) && exponent >= -22 && exponent <= 22)
+        {
+            double d = (double)mantissa;
+            if (exponent < 0)
+                d /= kExactPowersOf10[-exponent];
+            else
+                d *= kExactPowersOf10[exponent];
+            value.m_Float = negative ? -d : d;
+            return true;
+        }
+
+        if (length < sizeof(buffer))
+        {
+            std::memcpy(buffer, start, length);
+            buffer[length] = '\0';
+            value.m_Float = std::strtod(buffer, nullptr);
+        }
+        else
+        {
+            value.m_Float = std::strtod(std::string(start, length).c_str(), nullptr);
+        }
+
+        // nlohmann rejects numbers that overflow to infinity, so this does too.
+        if (value.m_Float == HUGE_VAL || value.m_Float == -HUGE_VAL)
+            return Fail(start, "Number out of range");
+        return true;
+    }
+
+    bool JsonDocument::Parse(const char* text, size_t length)
+    {
+        m_Root = JsonValue();
+        m_Error.clear();
+        m_Scratch.clear();
+        m_Stack.clear();
+        m_ValueBlocks.clear();
+        m_CharBlocks.clear();
+        m_ValueBlockUsed = m_ValueBlockSize = 0;
+        m_CharBlockUsed = m_CharBlockSize = 0;
+        m_MemoryUsage = 0;
+
+        m_Begin = text;
+        m_End = text + length;
+        m_ValuesPerBlock = (uint32_t)std::min<size_t>(std::max<size_t>(length / 16, kMinValuesPerBlock), kValuesPerBlock);
+
+        const char* p = text;
+        if (length >= 3 && std::memcmp(p, "\xEF\xBB\xBF", 3) == 0)
+            p += 3;
+
+        const char* key = nullptr;
+        uint32_t keyLength = 0;
+
+        for (;;)
+        {
+            p = SkipWhitespace(p, m_End);
+            if (p == m_End)
+                return Fail(p, "Unexpected end of the document");
+
+            JsonValue value;
+            bool closing = false;
+
+            switch (*p)
+            {
+            case '{':
+            case '[':
+            {
+                const bool isObject = *p == '{';
+                Frame frame = { (uint32_t)m_Scratch.size(), key, keyLength, isObject };
+                m_Stack.push_back(frame);
+
+                p = SkipWhitespace(p + 1, m_End);
+                if (p < m_End && *p == (isObject ? '}' : ']'))
+                {
+                    ++p;
+                    closing = true;
+                    break;
+                }
+
+                key = nullptr;
+                keyLength = 0;
+                if (isObject && !ParseKey(p, key, keyLength))
+                    return false;
+                continue;
+            }
+
+            case '"':
+                value.m_Type = JsonValue::kString;
+                if (!ParseString(p, value.m_String, value.m_Size))
+                    return false;
+                break;
+
+            case 't':
+            case 'f':
+            case 'n':
+            {
+                static const char* kLiterals[] = { "true", "false", "null" };
+                const int literal = *p == 't' ? 0 : *p == 'f' ? 1 : 2;
+                const size_t literalLength = std::strlen(kLiterals[literal]);
+                if ((size_t)(m_End - p) < literalLength || std::memcmp(p, kLiterals[literal], literalLength) != 0)
+                    return Fail(p, "Invalid literal");
+                p += literalLength;
+                if (literal < 2)
+                {
+                    value.m_Type = JsonValue::kBoolean;
+                    value.m_Boolean = literal == 0;
+                }
+                break;
+            }
+
+            default:
+                if (*p != '-' && !IsDigit(*p))
+                    return Fail(p, "Unexpected character");
+                if (!ParseNumber(p, value))
+                    return false;
+                break;
+            }
+
+            // Attach the finished value to its container, closing as many containers as end here.
+            for (;;)
+            {
+                if (closing)
+                {
+                    const Frame frame = m_Stack.back();
+                    m_Stack.pop_back();
+
+                    const uint32_t count = (uint32_t)m_Scratch.size() - frame.firstChild;
+                    value = JsonValue();
+                    value.m_Type = frame.isObject ? JsonValue::kObject : JsonValue::kArray;
+                    value.m_Size = count;
+                    value.m_Children = AllocateValues(count);
+                    std::copy(m_Scratch.begin() + frame.firstChild, m_Scratch.end(), value.m_Children);
+                    m_Scratch.resize(frame.firstChild);
+
+                    key = frame.key;
+                    keyLength = frame.keyLength;
+                    closing = false;
+                }
+
+                if (m_Stack.empty())
+                {
+                    p = SkipWhitespace(p, m_End);
+                    if (p != m_End)
+                        return Fail(p, "Unexpected characters after the document");
+                    m_Root = value;
+                    return true;
+                }
+
+                value.m_Key = key;
+                value.m_KeyLength = keyLength;
+                m_Scratch.push_back(value);
+
+                const bool isObject = m_Stack.back().isObject;
+                p = SkipWhitespace(p, m_End);
+                if (p == m_End)
+                    return Fail(p, "Unexpected end of the document");
+
+                if (*p == ',')
+                {
+                    ++p;
+                    key = nullptr;
+                    keyLength = 0;
+                    if (isObject && !ParseKey(p, key, keyLength))
+                        return false;
+                    break;
+                }
+
+                if (*p != (isObject ? '}' : ']'))
+                    return Fail(p, isObject ? "Expected ',' or '}'" : "Expected ',' or ']'");
+
+                ++p;
+                closing = true;
+            }
+        }
+    }
+
+} // namespace glTF
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace glTF
+{
+    // A read-only JSON value that lives in a JsonDocument's arena. It answers the subset of the nlohmann::json
+    // interface that the glTF parser uses (find, at, [], iteration, size and conversion to numbers and strings), so
+    // the same Process* code runs on either. The children of an array or object are contiguous and objects keep
+    // their members in document order; lookups scan the members, which beats hashing for the handful of keys glTF
+    // objects have.
+    class JsonValue
+    {
+    public:
+        enum Type : uint8_t { kNull, kBoolean, kInteger, kUnsigned, kFloat, kString, kArray, kObject };
+
+        class const_iterator
+        {
+        public:
+            const_iterator() : m_Value(nullptr) {}
+            explicit const_iterator(const JsonValue* value) : m_Value(value) {}
+
+            const JsonValue& value() const { return *m_Value; }
+            std::string key() const { return std::string(m_Value->m_Key, m_Value->m_KeyLength); }
+            const JsonValue& operator*() const { return *m_Value; }
+            const JsonValue* operator->() const { return m_Value; }
+            const_iterator& operator++() { ++m_Value; return *this; }
+            bool operator==(const const_iterator& rhs) const { return m_Value == rhs.m_Value; }
+            bool operator!=(const const_iterator& rhs) const { return m_Value != rhs.m_Value; }
+
+        private:
+            const JsonValue* m_Value;
+        };
+        typedef const_iterator iterator;
+
+        JsonValue() : m_Integer(0), m_Key(nullptr), m_Size(0), m_KeyLength(0), m_Type(kNull) {}
+
+        Type type() const { return m_Type; }
+        bool is_null() const { return m_Type == kNull; }
+        bool is_object() const { return m_Type == kObject; }
+        bool is_array() const { return m_Type == kArray; }
+        bool is_string() const { return m_Type == kString; }
+        bool is_number() const { return m_Type == kInteger || m_Type == kUnsigned || m_Type == kFloat; }
+
+        // Number of children of an array or object, 1 for other values and 0 for null, as nlohmann counts them.
+        size_t size() const { return IsContainer() ? m_Size : (m_Type == kNull ? 0 : 1); }
+
+        const_iterator begin() const { return const_iterator(IsContainer() ? m_Children : nullptr); }
+        const_iterator end() const { return const_iterator(IsContainer() ? m_Children + m_Size : nullptr); }
+
+        // Returns end() when this isn't an object or has no such member.
+        const_iterator find(const char* key) const { return find(key, std::strlen(key)); }
+        const_iterator find(const std::string& key) const { return find(key.data(), key.size()); }
+        const_iterator find(const char* key, size_t length) const;
+
+        // Missing members and elements assert and read as null.
+        const JsonValue& at(const char* key) const;
+        const JsonValue& at(const std::string& key) const { return at(key.c_str()); }
+        const JsonValue& at(size_t index) const;
+        const JsonValue& operator[](const std::string& key) const { return at(key.c_str()); }
+        const JsonValue& operator[](size_t index) const { return at(index); }
+        template <typename T>
+        const JsonValue& operator[](T* key) const { return at((const char*)key); }
+
+        template <typename T>
+        T get() const { T value; Read(value); return value; }
+
+        template <typename T, typename = typename std::enable_if<
+            std::is_arithmetic<T>::value || std::is_same<T, std::string>::value>::type>
+        operator T() const { return get<T>(); }
+
+        friend bool operator==(const JsonValue& lhs, const char* rhs)
+        {
+            return lhs.m_Type == kString && lhs.m_Size == std::strlen(rhs) && std::memcmp(lhs.m_String, rhs, lhs.m_Size) == 0;
+        }
+        template <typename T, typename = typename std::enable_if<std::is_arithmetic<T>::value>::type>
+        friend bool operator==(const JsonValue& lhs, T rhs) { return lhs.is_number() && lhs.get<double>() == (double)rhs; }
+        friend bool operator!=(const JsonValue& lhs, const char* rhs) { return !(lhs == rhs); }
+        template <typename T, typename = typename std::enable_if<std::is_arithmetic<T>::value>::type>
+        friend bool operator!=(const JsonValue& lhs, T rhs) { return !(lhs == rhs); }
+
+    private:
+        friend class JsonDocument;
+
+        bool IsContainer() const { return m_Type == kArray || m_Type == kObject; }
+
+        void Read(std::string& value) const;
+        template <typename T>
+        void Read(T& value) const
+        {
+            static_assert(std::is_arithmetic<T>::value, "JSON values only convert to numbers and strings");
+            switch (m_Type)
+            {
+            case kBoolean: value = (T)m_Boolean; break;
+            case kInteger: value = (T)m_Integer; break;
+            case kUnsigned: value = (T)m_Unsigned; break;
+            case kFloat: value = (T)m_Float; break;
+            default: value = (T)0; ReportTypeMismatch(); break;
+            }
+        }
+        void ReportTypeMismatch() const;
+
+        union
+        {
+            bool m_Boolean;
+            int64_t m_Integer;
+            uint64_t m_Unsigned;        // Only for integers too large for m_Integer
+            double m_Float;
+            const char* m_String;       // Not null terminated
+            JsonValue* m_Children;
+        };
+        const char* m_Key;              // Member name when the parent is an object, not null terminated
+        uint32_t m_Size;                // String length or number of children
+        uint32_t m_KeyLength;
+        Type m_Type;
+    };
+
+    // Parses a JSON text into JsonValues allocated from large blocks, with one pass over the text and no allocation
+    // per value. Strings without escapes point into the text, which must outlive the document; strings with escapes
+    // are decoded into the document. Numbers follow the JSON grammar exactly: integers that fit in 64 bits are stored
+    // as integers and everything else is converted to a double with the same rounding as strtod.
+    class JsonDocument
+    {
+    public:
+        JsonDocument();
+
+        // Returns false and keeps a message for GetError on malformed text. A leading UTF-8 byte order mark is skipped.
+        bool Parse(const char* text, size_t length);
+
+        const JsonValue& GetRoot() const { return m_Root; }
+        const std::string& GetError() const { return m_Error; }
+
+        // Bytes held by the arena, for reports.
+        size_t GetMemoryUsage() const { return m_MemoryUsage; }
+
+    private:
+        struct Frame
+        {
+            uint32_t firstChild;    // In m_Scratch
+            const char* key;        // The container's own member name
+            uint32_t keyLength;
+            bool isObject;
+        };
+
+        bool Fail(const char* at, const char* message);
+        bool ParseString(const char*& p, const char*& string, uint32_t& length);
+        bool ParseKey(const char*& p, const char*& key, uint32_t& keyLength);
+        bool ParseNumber(const char*& p, JsonValue& value);
+        JsonValue* AllocateValues(uint32_t count);
+        char* AllocateChars(size_t count);
+
+        JsonValue m_Root;
+        const char* m_Begin;
+        const char* m_End;
+        std::string m_Error;
+
+        // Siblings are gathered here until their container closes and then copied to the arena in one piece.
+        std::vector<JsonValue> m_Scratch;
+        std::vector<Frame> m_Stack;
+
+        std::vector<std::unique_ptr<JsonValue[]>> m_ValueBlocks;
+        uint32_t m_ValueBlockUsed;
+        uint32_t m_ValueBlockSize;
+        uint32_t m_ValuesPerBlock;
+        std::vector<std::unique_ptr<char[]>> m_CharBlocks;
+        size_t m_CharBlockUsed;
+        size_t m_CharBlockSize;
+        size_t m_MemoryUsage;
+    };
+
+} // namespace glTF
@@ -19,9 +19,15 @@
 #include "glTF.h"
 #include "Model.h"
 #include "IndexOptimizePostTransform.h"
+#include "MeshOptimize.h"
 #include "../Core/VectorMath.h"
+#include "../Core/Hash.h"
 #include "DirectXMesh.h"
 
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
 using namespace DirectX;
 using namespace glTF;
 using namespace Math;
@@ -32,6 +38,7 @@ static DXGI_FORMAT JointIndexFormat(const Accessor& accessor)
     {
     case Accessor::kUnsignedByte:  return DXGI_FORMAT_R8G8B8A8_UINT;
     case Accessor::kUnsignedShort: return DXGI_FORMAT_R16G16B16A16_UINT;
+    case Accessor::kFloat:         return DXGI_FORMAT_R32G32B32A32_FLOAT; // Expanded from a sparse accessor
     default:
         ASSERT("Invalid joint index format");
         return DXGI_FORMAT_UNKNOWN;
@@ -70,6 +77,130 @@ static DXGI_FORMAT AccessorFormat(const Accessor& accessor)
     }
 }
 
+// Appends one run of a triangle list, strip or fan (glTF modes 4, 5 and 6) as list triangles with the winding of the
+// source, leaving out degenerate ones. Strips use them to stitch runs together, and they'd only cost vertex work.
+template <typename IndexType>
+static void AppendTriangles(const IndexType* indices, uint32_t count, uint32_t mode, std::vector<uint32_t>& list)
+{
+    if (count < 3)
+        return;
+
+    const uint32_t triangleCount = mode == 4 ? count / 3 : count - 2;
+    const size_t start = list.size();
+    list.resize(start + triangleCount * 3);
+    uint32_t* out = list.data() + start;
+
+    // Every triangle is written and the output only advances past the ones that aren't degenerate, so the loops
+    // don't branch per triangle.
+    size_t written = 0;
+    auto Emit = [&](uint32_t a, uint32_t b, uint32_t c)
+    {
+        out[written + 0] = a;
+        out[written + 1] = b;
+        out[written + 2] = c;
+        written += (a != b && b != c && a != c) ? 3 : 0;
+    };
+
+    if (mode == 4)
+    {
+        for (uint32_t t = 0; t < triangleCount; ++t)
+            Emit(indices[3 * t], indices[3 * t + 1], indices[3 * t + 2]);
+    }
+    else if (mode == 5)
+    {
+        // Odd triangles of a strip are wound the other way around, so two of their corners swap.
+        uint32_t t = 0;
+        for (; t + 1 < triangleCount; t += 2)
+        {
+            Emit(indices[t], indices[t + 1], indices[t + 2]);
+            Emit(indices[t + 1], indices[t + 3], indices[t + 2]);
+        }
+        if (t < triangleCount)
+            Emit(indices[t], indices[t + 1], indices[t + 2]);
+    }
+    else
+    {
+        const uint32_t hub = indices[0];
+        for (uint32_t t = 0; t < triangleCount; ++t)
+            Emit(indices[t + 1], indices[t + 2], hub);
+    }
+
+    list.resize(start + written);
+}
+
+// Appends the triangles of a whole index buffer. Strips and fans may be split into runs by restart indices (the
+// largest value of the index type), which D3D exports use even though glTF doesn't allow them.
+template <typename IndexType>
+static void AppendTriangleRuns(const IndexType* indices, uint32_t count, uint32_t mode, std::vector<uint32_t>& list)
+{
+    const IndexType kRestart = (IndexType)~0u;
+    const IndexType* end = indices + count;
+    const IndexType* run = indices;
+    while (true)
+    {
+        const IndexType* runEnd = mode == 4 ? end : std::find(run, end, kRestart);
+        AppendTriangles(run, (uint32_t)(runEnd - run), mode, list);
+        if (runEnd == end)
+            break;
+        run = runEnd + 1;
+    }
+}
+
+// Converts the indices of a triangle primitive (or the implied ones when it has none) to a plain triangle list.
+static void BuildTriangleList(const glTF::Primitive& prim, uint32_t vertexCount, std::vector<uint32_t>& list)
+{
+    list.clear();
+    if (prim.indices == nullptr)
+    {
+        std::vector<uint32_t> sequence(vertexCount);
+        for (uint32_t i = 0; i < vertexCount; ++i)
+            sequence[i] = i;
+        AppendTriangles(sequence.data(), vertexCount, prim.mode, list);
+        return;
+    }
+
+    const uint32_t count = prim.indices->count;
+    list.reserve(prim.mode == 4 ? count : 3 * (size_t)count);
+    switch (prim.indices->componentType)
+    {
+    case Accessor::kUnsignedByte:
+        AppendTriangleRuns((const uint8_t*)prim.indices->dataPtr, count, prim.mode, list);
+        break;
+    case Accessor::kUnsignedShort:
+        AppendTriangleRuns((const uint16_t*)prim.indices->dataPtr, count, prim.mode, list);
+        break;
+    case Accessor::kUnsignedInt:
+        AppendTriangleRuns((const uint32_t*)prim.indices->dataPtr, count, prim.mode, list);
+        break;
+    default:
+        Utility::Printf("Found an index buffer with an unsupported component type\n");
+        break;
+    }
+}
+// Whether the vertex reader can take an attribute as it is stored. Sparse attributes, attributes without a buffer view
+// and the integer encodings KHR_mesh_quantization allows are expanded to floats first.
+static bool IsReadableInPlace(const Accessor& accessor, uint32_t attribute)
+{
+    if (!accessor.HasInPlaceData())
+        return false;
+
+    switch (attribute)
+    {
+    case Primitive::kTexcoord0:
+    case Primitive::kTexcoord1:
+    case Primitive::kWeights0:
+        // Unsigned bytes and shorts are always normalized here, which AccessorFormat reads as UNORM
+        return accessor.componentType == Accessor::kFloat || accessor.componentType == Accessor::kUnsignedByte ||
+            accessor.componentType == Accessor::kUnsignedShort;
+    case Primitive::kJoints0:
+        return accessor.componentType == Accessor::kUnsignedByte || accessor.componentType == Accessor::kUnsignedShort;
+    case Primitive::kColor0:
+        return true; // Not converted
+    default:
+        return accessor.componentType == Accessor::kFloat;
+    }
+}
+
 void OptimizeMesh( Renderer::Primitive& outPrim, const glTF::Primitive& inPrim, const Math::Matrix4& localToObject )
 {
     ASSERT(inPrim.attributes[0] != nullptr, "Must have POSITION");
@@ -80,50 +211,88 @@ void OptimizeMesh( Renderer::Primitive& outPrim, const glTF::Primitive& inPrim,
     bool b32BitIndices;
     uint32_t maxIndex = inPrim.maxIndex;
 
-    if (inPrim.indices == nullptr)
+    switch (inPrim.mode)
     {
-        ASSERT(inPrim.mode == 4, "Impossible primitive topology when lacking indices");
+    default:
+    case 0: // POINT LIST
+    case 1: // LINE LIST
+    case 2: // LINE LOOP
+    case 3: // LINE STRIP
+        Utility::Printf("Skipping a primitive with a point or line topology\n");
+        return;
+    case 4: // TRIANGLE LIST
+    case 5: // TRIANGLE STRIP
+    case 6: // TRIANGLE FAN
+        break;
+    }
+
+    // Accessors that can't be read in place are expanded into dense copies, and a copy of the primitive that points
+    // at them is converted instead. Only this conversion ever materializes a sparse accessor.
+    bool needsExpansion = inPrim.indices != nullptr && !inPrim.indices->HasInPlaceData();
+    for (uint32_t i = 0; i < Primitive::kNumAttribs; ++i)
+        needsExpansion |= inPrim.attributes[i] != nullptr && !IsReadableInPlace(*inPrim.attributes[i], i);
 
-        indexCount = vertexCount * 3;
-        maxIndex = indexCount - 1;
-        if (indexCount > 0xFFFF)
+    if (needsExpansion)
+    {
+        if (vertexCount == 0)
         {
-            b32BitIndices = true;
-            outPrim.IB = std::make_shared<std::vector<byte>>(4 * indexCount);
-            indices = outPrim.IB->data();
-            uint32_t* tmp = (uint32_t*)indices;
-            for (uint32_t i = 0; i < indexCount; ++i)
-                tmp[i] = i;
+            Utility::Printf("Found a primitive without any vertices\n");
+            return;
         }
-        else
+
+        glTF::Primitive densePrim = inPrim;
+        Accessor denseAccessors[Primitive::kNumAttribs];
+        std::vector<float> denseAttributes[Primitive::kNumAttribs];
+
+        for (uint32_t i = 0; i < Primitive::kNumAttribs; ++i)
         {
-            b32BitIndices = false;
-            outPrim.IB = std::make_shared<std::vector<byte>>(2 * indexCount);
-            indices = outPrim.IB->data();
-            uint16_t* tmp = (uint16_t*)indices;
-            for (uint16_t i = 0; i < indexCount; ++i)
-                tmp[i] = i;
+            const Accessor* attrib = inPrim.attributes[i];
+            if (attrib == nullptr || IsReadableInPlace(*attrib, i))
+                continue;
+
+            if (attrib->count < vertexCount)
+            {
+                Utility::Printf("Found an attribute with fewer elements than positions\n");
+                return;
+            }
+
+            ReadFloatElements(*attrib, denseAttributes[i]);
+
+            Accessor& dense = denseAccessors[i];
+            dense = *attrib;
+            dense.dataPtr = (byte*)denseAttributes[i].data();
+            dense.componentType = Accessor::kFloat;
+            dense.normalized = false;
+            dense.stride = dense.GetElementSize();
+            dense.sparseCount = 0;
+            densePrim.attributes[i] = &dense;
         }
-    }
-    else
-    {
-        switch (inPrim.mode)
+
+        Accessor denseIndexAccessor;
+        std::vector<byte> denseIndices;
+        if (inPrim.indices != nullptr && !inPrim.indices->HasInPlaceData())
         {
-        default:
-        case 0: // POINT LIST
-        case 1: // LINE LIST
-        case 2: // LINE LOOP
-        case 3: // LINE STRIP
-            Utility::Printf("Found unsupported primitive topology\n");
-            return;
-        case 4: // TRIANGLE LIST
-            break;
-        case 5: // TODO: Convert TRIANGLE STRIP
-        case 6: // TODO: Convert TRIANGLE FAN
-            Utility::Printf("Found an index buffer that needs to be converted to a triangle list\n");
-            return;
+            if (inPrim.indices->count == 0)
+            {
+                Utility::Printf("Found a primitive without any triangles\n");
+                return;
+            }
+
+            ReadDenseElements(*inPrim.indices, denseIndices);
+
+            denseIndexAccessor = *inPrim.indices;
+            denseIndexAccessor.dataPtr = denseIndices.data();
+            denseIndexAccessor.stride = 0;
+            denseIndexAccessor.sparseCount = 0;
+            densePrim.indices = &denseIndexAccessor;
         }
 
+        OptimizeMesh(outPrim, densePrim, localToObject);
+        return;
+    }
+
+    if (inPrim.indices != nullptr && inPrim.mode == 4 && inPrim.indices->componentType != Accessor::kUnsignedByte)
+    {
         indices = inPrim.indices->dataPtr;
         indexCount = inPrim.indices->count;
         if (maxIndex == 0)
@@ -147,16 +316,43 @@ void OptimizeMesh( Renderer::Primitive& outPrim, const glTF::Primitive& inPrim,
         if (b32BitIndices)
         {
             ASSERT(inPrim.indices->componentType == Accessor::kUnsignedInt);
-            OptimizeFaces((uint32_t*)inPrim.indices->dataPtr, inPrim.indices->count, (uint32_t*)outPrim.IB->data(), 64);
+            OptimizeFaces((uint32_t*)inPrim.indices->dataPtr, inPrim.indices->count, (uint32_t*)outPrim.IB->data(), MeshOptimize::kVertexCacheSize);
         }
         else if (inPrim.indices->componentType == Accessor::kUnsignedShort)
         {
-            OptimizeFaces((uint16_t*)inPrim.indices->dataPtr, inPrim.indices->count, (uint16_t*)outPrim.IB->data(), 64);
+            OptimizeFaces((uint16_t*)inPrim.indices->dataPtr, inPrim.indices->count, (uint16_t*)outPrim.IB->data(), MeshOptimize::kVertexCacheSize);
         }
         else
         {
-            OptimizeFaces((uint32_t*)inPrim.indices->dataPtr, inPrim.indices->count, (uint16_t*)outPrim.IB->data(), 64);
+            OptimizeFaces((uint32_t*)inPrim.indices->dataPtr, inPrim.indices->count, (uint16_t*)outPrim.IB->data(), MeshOptimize::kVertexCacheSize);
+        }
+        indices = outPrim.IB->data();
+    }
+    else
+    {
+        // Strips, fans, byte indices and unindexed triangles become a 32-bit list first.
+        std::vector<uint32_t> triangleList;
+        BuildTriangleList(inPrim, vertexCount, triangleList);
+        if (triangleList.empty())
+        {
+            Utility::Printf("Found a primitive without any triangles\n");
+            return;
+        }
+
+        indexCount = (uint32_t)triangleList.size();
+        maxIndex = *std::max_element(triangleList.begin(), triangleList.end());
+        if (maxIndex >= vertexCount)
+        {
+            Utility::Printf("Found an index buffer that references missing vertices\n");
+            return;
         }
+
+        b32BitIndices = maxIndex > 0xFFFF;
+        outPrim.IB = std::make_shared<std::vector<byte>>((b32BitIndices ? 4 : 2) * indexCount);
+        if (b32BitIndices)
+            OptimizeFaces(triangleList.data(), indexCount, (uint32_t*)outPrim.IB->data(), MeshOptimize::kVertexCacheSize);
+        else
+            OptimizeFaces(triangleList.data(), indexCount, (uint16_t*)outPrim.IB->data(), MeshOptimize::kVertexCacheSize);
         indices = outPrim.IB->data();
     }
 
@@ -256,6 +452,15 @@ void OptimizeMesh( Renderer::Primitive& outPrim, const glTF::Primitive& inPrim,
         ASSERT(outPrim.m_BoundsOS.GetRadius() > 0.0f);
     }
 
+    // Runs of triangles that face out from the mesh go first, where they hide the rest from most views. This serves
+    // the voxelization passes as much as the main pass, since they draw the same index buffer.
+    const bool indicesInRange = maxIndex < vertexCount;
+    if (indicesInRange)
+    {
+        MeshOptimize::OptimizeOverdraw(indices, b32BitIndices, indexCount, (const uint8_t*)position.get(),
+            sizeof(XMFLOAT3), vertexCount);
+    }
+
     if (HasNormals)
     {
         ASSERT_SUCCEEDED(vbr.Read(normal.get(), "NORMAL", 0, vertexCount));
@@ -335,32 +540,15 @@ void OptimizeMesh( Renderer::Primitive& outPrim, const glTF::Primitive& inPrim,
     }
 
     // Use VBWriter to generate a new, interleaved and compressed vertex buffer
-    std::vector<D3D12_INPUT_ELEMENT_DESC> OutputElements;
-
     outPrim.psoFlags = PSOFlags::kHasPosition | PSOFlags::kHasNormal;
-    OutputElements.push_back({"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT});
-    OutputElements.push_back({"NORMAL", 0, DXGI_FORMAT_R10G10B10A2_UNORM, 0, D3D12_APPEND_ALIGNED_ELEMENT});
     if (tangent.get())
-    {
-        OutputElements.push_back({"TANGENT", 0, DXGI_FORMAT_R10G10B10A2_UNORM, 0, D3D12_APPEND_ALIGNED_ELEMENT});
         outPrim.psoFlags |= PSOFlags::kHasTangent;
-    }
     if (texcoord0.get())
-    {
-        OutputElements.push_back({"TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT});
         outPrim.psoFlags |= PSOFlags::kHasUV0;
-    }
     if (texcoord1.get())
-    {
-        OutputElements.push_back({"TEXCOORD", 1, DXGI_FORMAT_R16G16_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT});
         outPrim.psoFlags |= PSOFlags::kHasUV1;
-    }
     if (HasSkin)
-    {
-        OutputElements.push_back({ "BLENDINDICES", 0, DXGI_FORMAT_R16G16B16A16_UINT, 0, D3D12_APPEND_ALIGNED_ELEMENT });
-        OutputElements.push_back({ "BLENDWEIGHT", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, D3D12_APPEND_ALIGNED_ELEMENT });
         outPrim.psoFlags |= PSOFlags::kHasSkin;
-    }
     if (material.alphaBlend)
         outPrim.psoFlags |= PSOFlags::kAlphaBlend;
     if (material.alphaTest)
@@ -368,6 +556,12 @@ void OptimizeMesh( Renderer::Primitive& outPrim, const glTF::Primitive& inPrim,
     if (material.twoSided)
         outPrim.psoFlags |= PSOFlags::kTwoSided;
 
+    // Defaults for missing attributes come from another slot and aren't written.
+    std::vector<D3D12_INPUT_ELEMENT_DESC> OutputElements;
+    Renderer::GetVertexLayout(outPrim.psoFlags, OutputElements);
+    OutputElements.erase(std::remove_if(OutputElements.begin(), OutputElements.end(),
+        [](const D3D12_INPUT_ELEMENT_DESC& element) { return element.InputSlot != 0; }), OutputElements.end());
+
     D3D12_INPUT_LAYOUT_DESC layout = {OutputElements.data(), (uint32_t)OutputElements.size()};
 
     VBWriter vbw;
@@ -396,20 +590,9 @@ void OptimizeMesh( Renderer::Primitive& outPrim, const glTF::Primitive& inPrim,
     }
 
     // Now write a VB for positions only (or positions and UV when alpha testing)
-    uint32_t depthStride = 12;
+    uint32_t depthStride = Renderer::GetDepthVertexStride(outPrim.psoFlags);
     std::vector<D3D12_INPUT_ELEMENT_DESC> DepthElements;
-    DepthElements.push_back({"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT});
-    if (material.alphaTest)
-    {
-        depthStride += 4;
-        DepthElements.push_back({"TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT});
-    }
-    if (HasSkin)
-    {
-        depthStride += 16;
-        DepthElements.push_back({ "BLENDINDICES", 0, DXGI_FORMAT_R16G16B16A16_UINT, 0, D3D12_APPEND_ALIGNED_ELEMENT });
-        DepthElements.push_back({ "BLENDWEIGHT", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, D3D12_APPEND_ALIGNED_ELEMENT });
-    }
+    Renderer::GetDepthVertexLayout(outPrim.psoFlags, DepthElements);
 
     VBWriter dvbw;
     dvbw.Initialize({DepthElements.data(), (uint32_t)DepthElements.size()});
@@ -428,6 +611,16 @@ void OptimizeMesh( Renderer::Primitive& outPrim, const glTF::Primitive& inPrim,
         dvbw.Write(weights.get(), "BLENDWEIGHT", 0, vertexCount);
     }
 
+    // Both streams are renumbered in the order the triangles first use their vertices, and vertices no triangle uses
+    // are dropped.
+    if (indicesInRange)
+    {
+        std::vector<uint32_t> remap;
+        const uint32_t usedVertexCount = MeshOptimize::OptimizeVertexFetch(indices, b32BitIndices, indexCount, vertexCount, stride, remap);
+        MeshOptimize::RemapVertexBuffer(*outPrim.VB, stride, remap, usedVertexCount);
+        MeshOptimize::RemapVertexBuffer(*outPrim.DepthVB, depthStride, remap, usedVertexCount);
+    }
+
     ASSERT(material.index < 0x8000, "Only 15-bit material indices allowed");
 
     outPrim.vertexStride = (uint16_t)stride;
@@ -435,7 +628,167 @@ void OptimizeMesh( Renderer::Primitive& outPrim, const glTF::Primitive& inPrim,
     outPrim.materialIdx = material.index;
 
     outPrim.primCount = indexCount;
+}
+
+void Renderer::GetVertexLayout(uint16_t psoFlags, std::vector<D3D12_INPUT_ELEMENT_DESC>& layout)
+{
+    using namespace PSOFlags;
+
+    layout.clear();
+    if (psoFlags & kHasPosition)
+    {
+        const DXGI_FORMAT format = (psoFlags & kQuantizedPosition) ? DXGI_FORMAT_R16G16B16A16_UNORM : DXGI_FORMAT_R32G32B32_FLOAT;
+        layout.push_back({"POSITION", 0, format,                            0, D3D12_APPEND_ALIGNED_ELEMENT});
+    }
+    if (psoFlags & kHasNormal)
+        layout.push_back({"NORMAL",   0, DXGI_FORMAT_R10G10B10A2_UNORM,  0, D3D12_APPEND_ALIGNED_ELEMENT});
+    if (psoFlags & kHasTangent)
+        layout.push_back({"TANGENT",  0, DXGI_FORMAT_R10G10B10A2_UNORM,  0, D3D12_APPEND_ALIGNED_ELEMENT});
+    if (psoFlags & kHasUV0)
+        layout.push_back({"TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT,       0, D3D12_APPEND_ALIGNED_ELEMENT});
+    else
+        layout.push_back({"TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT,       1, D3D12_APPEND_ALIGNED_ELEMENT});
+    if (psoFlags & kHasUV1)
+        layout.push_back({"TEXCOORD", 1, DXGI_FORMAT_R16G16_FLOAT,       0, D3D12_APPEND_ALIGNED_ELEMENT});
+    if (psoFlags & kHasSkin)
+    {
+        layout.push_back({ "BLENDINDICES", 0, DXGI_FORMAT_R16G16B16A16_UINT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 });
+        layout.push_back({ "BLENDWEIGHT", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 });
+    }
+}
+
+void Renderer::GetDepthVertexLayout(uint16_t psoFlags, std::vector<D3D12_INPUT_ELEMENT_DESC>& layout)
+{
+    using namespace PSOFlags;
+
+    const DXGI_FORMAT positionFormat = (psoFlags & kQuantizedPosition) ? DXGI_FORMAT_R16G16B16A16_UNORM : DXGI_FORMAT_R32G32B32_FLOAT;
+
+    layout.clear();
+    layout.push_back({"POSITION", 0, positionFormat, 0, D3D12_APPEND_ALIGNED_ELEMENT});
+    if (psoFlags & kAlphaTest)
+        layout.push_back({"TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT});
+    if (psoFlags & kHasSkin)
+    {
+        layout.push_back({ "BLENDINDICES", 0, DXGI_FORMAT_R16G16B16A16_UINT, 0, D3D12_APPEND_ALIGNED_ELEMENT });
+        layout.push_back({ "BLENDWEIGHT", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, D3D12_APPEND_ALIGNED_ELEMENT });
+    }
+}
+
+uint32_t Renderer::GetDepthVertexStride(uint16_t psoFlags)
+{
+    using namespace PSOFlags;
+
+    uint32_t stride = (psoFlags & kQuantizedPosition) ? 8 : 12;
+    if (psoFlags & kAlphaTest)
+        stride += 4;
+    if (psoFlags & kHasSkin)
+        stride += 16;
+    return stride;
+}
+
+void Renderer::QuantizePositions(Primitive& prim, const AxisAlignedBox& bounds, float scale[3], float bias[3])
+{
+    ASSERT((prim.psoFlags & PSOFlags::kQuantizedPosition) == 0);
+
+    const uint32_t vertexCount = (uint32_t)(prim.VB->size() / prim.vertexStride);
+    const uint32_t depthStride = GetDepthVertexStride((uint16_t)prim.psoFlags);
+    ASSERT(prim.DepthVB->size() == (size_t)depthStride * vertexCount);
+
+    const Vector3 minPos = bounds.GetMin();
+    const Vector3 maxPos = bounds.GetMax();
+    const float minValues[3] = { minPos.GetX(), minPos.GetY(), minPos.GetZ() };
+    const float maxValues[3] = { maxPos.GetX(), maxPos.GetY(), maxPos.GetZ() };
+    float toUnorm[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        const float extent = maxValues[i] - minValues[i];
+        bias[i] = minValues[i];
+        scale[i] = extent / 65535.0f;
+        toUnorm[i] = extent > 0.0f ? 65535.0f / extent : 0.0f;
+    }
+
+    // Positions lead both streams, so each vertex is the quantized position followed by the rest as it was.
+    auto Quantize = [&](const Utility::ByteArray& src, uint32_t srcStride)
+    {
+        const uint32_t dstStride = srcStride - 4;
+        Utility::ByteArray dst = std::make_shared<std::vector<byte>>((size_t)dstStride * vertexCount);
+        for (uint32_t v = 0; v < vertexCount; ++v)
+        {
+            const byte* srcVertex = src->data() + (size_t)v * srcStride;
+            byte* dstVertex = dst->data() + (size_t)v * dstStride;
 
-    // TODO:  Generate optimized depth-only streams
+            float position[3];
+            std::memcpy(position, srcVertex, sizeof(position));
+
+            uint16_t unorm[4] = {};
+            for (int i = 0; i < 3; ++i)
+                unorm[i] = (uint16_t)std::min(std::max((position[i] - bias[i]) * toUnorm[i] + 0.5f, 0.0f), 65535.0f);
+
+            std::memcpy(dstVertex, unorm, sizeof(unorm));
+            std::memcpy(dstVertex + sizeof(unorm), srcVertex + sizeof(position), srcStride - sizeof(position));
+        }
+        return dst;
+    };
+
+    prim.VB = Quantize(prim.VB, prim.vertexStride);
+    prim.DepthVB = Quantize(prim.DepthVB, depthStride);
+    prim.vertexStride -= 4;
+    prim.psoFlags |= PSOFlags::kQuantizedPosition;
 }
 
+void Renderer::WeldDepthStream(Primitive& prim)
+{
+    ASSERT(prim.DepthIB == nullptr);
+
+    const uint32_t vertexCount = (uint32_t)(prim.VB->size() / prim.vertexStride);
+    const uint32_t depthStride = GetDepthVertexStride((uint16_t)prim.psoFlags);
+    ASSERT(prim.DepthVB->size() == (size_t)depthStride * vertexCount);
+    ASSERT(depthStride % 4 == 0);
+
+    const byte* depthVertices = prim.DepthVB->data();
+    auto HashVertex = [&](uint32_t v)
+    {
+        const uint32_t* words = (const uint32_t*)(depthVertices + (size_t)v * depthStride);
+        return Utility::HashRange(words, words + depthStride / 4, 2166136261U);
+    };
+    auto SameVertex = [&](uint32_t a, uint32_t b)
+    {
+        return std::memcmp(depthVertices + (size_t)a * depthStride, depthVertices + (size_t)b * depthStride, depthStride) == 0;
+    };
+
+    // Keyed by the first vertex seen with each depth vertex's bytes.
+    std::unordered_map<uint32_t, uint32_t, decltype(HashVertex), decltype(SameVertex)> welded(vertexCount, HashVertex, SameVertex);
+
+    // Welded vertices are numbered in the order the indices first use them, reduced levels included, so that the
+    // depth stream is fetched front to back like the main one.
+    const uint32_t kUnassigned = 0xFFFFFFFF;
+    std::vector<uint32_t> remap(vertexCount, kUnassigned);
+    Utility::ByteArray depthVB = std::make_shared<std::vector<byte>>();
+    depthVB->reserve(prim.DepthVB->size());
+    uint32_t depthVertexCount = 0;
+
+    const size_t indexCount = prim.IB->size() >> (prim.index32 + 1);
+    prim.DepthIB = std::make_shared<std::vector<byte>>(prim.IB->size());
+    for (size_t i = 0; i < indexCount; ++i)
+    {
+        const uint32_t v = prim.index32 ? ((const uint32_t*)prim.IB->data())[i] : ((const uint16_t*)prim.IB->data())[i];
+        ASSERT(v < vertexCount);
+        if (remap[v] == kUnassigned)
+        {
+            auto result = welded.insert(std::make_pair(v, depthVertexCount));
+            if (result.second)
+            {
+                depthVB->insert(depthVB->end(), depthVertices + (size_t)v * depthStride, depthVertices + (size_t)(v + 1) * depthStride);
+                ++depthVertexCount;
+            }
+            remap[v] = result.first->second;
+        }
+
+        if (prim.index32)
+            ((uint32_t*)prim.DepthIB->data())[i] = remap[v];
+        else
+            ((uint16_t*)prim.DepthIB->data())[i] = (uint16_t)remap[v];
+    }
+
+    prim.DepthVB = depthVB;
+}
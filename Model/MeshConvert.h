@@ -14,11 +14,15 @@
 #pragma once
 
 #include "glTF.h"
+#include "Meshlet.h"
+#include "MeshSimplify.h"
 #include "../Core/Math/BoundingSphere.h"
 #include "../Core/Math/BoundingBox.h"
 
+#include <d3d12.h>
 #include <cstdint>
 #include <string>
+#include <vector>
 
 namespace Renderer
 {
@@ -32,7 +36,10 @@ namespace Renderer
         AxisAlignedBox m_BBoxOS;       // object space AABB
         Utility::ByteArray VB;
         Utility::ByteArray IB;
-        Utility::ByteArray DepthVB;
+        Utility::ByteArray DepthVB;     // One vertex per VB vertex until WeldDepthStream
+        Utility::ByteArray DepthIB;     // Indexes the welded DepthVB, with IB's layout and format
+        std::vector<Meshlet> meshlets;
+        std::vector<MeshLod> lods;      // Their indices follow the primCount full detail indices in IB
         uint32_t primCount;
         union
         {
@@ -45,6 +52,24 @@ namespace Renderer
         };
         uint16_t vertexStride;
     };
+
+    // The input layout of the vertex stream OptimizeMesh writes for a primitive with these PSOFlags. Elements in
+    // slot 1 are defaults for attributes the stream doesn't have; the PSOs are created from the same layouts.
+    void GetVertexLayout(uint16_t psoFlags, std::vector<D3D12_INPUT_ELEMENT_DESC>& layout);
+
+    // Same for the depth-only stream: positions, plus UVs when alpha tested and joints when skinned.
+    void GetDepthVertexLayout(uint16_t psoFlags, std::vector<D3D12_INPUT_ELEMENT_DESC>& layout);
+    uint32_t GetDepthVertexStride(uint16_t psoFlags);
+
+    // Rewrites the float positions of an optimized primitive as UNORM16 relative to bounds (which must contain them),
+    // shrinking both of its vertex streams by 4 bytes per vertex. The stored values dequantize with scale and bias.
+    void QuantizePositions(Primitive& prim, const AxisAlignedBox& bounds, float scale[3], float bias[3]);
+
+    // Merges the vertices of the depth-only stream that are the same bytes, which is most vertices split for their
+    // normals or UVs unless the depth stream also carries UVs (alpha testing), and indexes the result with DepthIB.
+    // DepthIB holds IB's triangles in IB's order, so every index range of IB, LODs and meshlets included, draws the
+    // same triangles from either. The last step before merging; DepthVB no longer matches VB vertex for vertex.
+    void WeldDepthStream(Primitive& prim);
 }
 
 void OptimizeMesh( Renderer::Primitive& outPrim, const glTF::Primitive& inPrim, const Math::Matrix4& localToObject );
\ No newline at end of file
@@ -0,0 +1,433 @@
+#include "MeshOptimize.h"
+#include "IndexOptimizePostTransform.h"
+#include "../Core/Utility.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+namespace MeshOptimize
+{
+    static inline uint32_t GetIndex(const void* indices, bool index32, uint32_t i)
+    {
+        return index32 ? ((const uint32_t*)indices)[i] : ((const uint16_t*)indices)[i];
+    }
+
+    static inline void SetIndex(void* indices, bool index32, uint32_t i, uint32_t value)
+    {
+        if (index32)
+            ((uint32_t*)indices)[i] = value;
+        else
+            ((uint16_t*)indices)[i] = (uint16_t)value;
+    }
+
+    static inline const float* GetPosition(const uint8_t* positions, uint32_t positionStride, uint32_t vertex)
+    {
+        return (const float*)(positions + (size_t)vertex * positionStride);
+    }
+
+    // A FIFO post-transform cache, as OptimizeFaces simulates it. Entries are timestamps, so starting over is O(1).
+    class FifoCache
+    {
+    public:
+        FifoCache(uint32_t vertexCount, uint32_t size) : m_Stamps(vertexCount, 0), m_Time(size + 1), m_Size(size) {}
+
+        // Returns whether the vertex had to be shaded.
+        bool Touch(uint32_t vertex)
+        {
+            if (m_Time - m_Stamps[vertex] <= m_Size)
+                return false;
+            m_Stamps[vertex] = m_Time++;
+            return true;
+        }
+
+        uint32_t TouchTriangle(uint32_t a, uint32_t b, uint32_t c)
+        {
+            return (uint32_t)Touch(a) + (uint32_t)Touch(b) + (uint32_t)Touch(c);
+        }
+
+        void Flush() { m_Time += m_Size + 1; }
+
+    private:
+        std::vector<uint64_t> m_Stamps;
+        uint64_t m_Time;
+        uint32_t m_Size;
+    };
+
+    void OptimizeOverdraw(void* indices, bool index32, uint32_t indexCount,
+        const uint8_t* positions, uint32_t positionStride, uint32_t vertexCount, float threshold)
+    {
+        const uint32_t triangleCount = indexCount / 3;
+        if (triangleCount < 2)
+            return;
+
+        auto Triangle = [&](uint32_t t, uint32_t& a, uint32_t& b, uint32_t& c)
+        {
+            a = GetIndex(indices, index32, t * 3 + 0);
+            b = GetIndex(indices, index32, t * 3 + 1);
+            c = GetIndex(indices, index32, t * 3 + 2);
+        };
+
+        // A triangle that shades all three of its vertices starts a new patch of the mesh; the order of patches
+        // doesn't matter to the cache.
+        FifoCache cache(vertexCount, kVertexCacheSize);
+        std::vector<uint32_t> hardStarts;
+        for (uint32_t t = 0; t < triangleCount; ++t)
+        {
+            uint32_t a, b, c;
+            Triangle(t, a, b, c);
+            if (cache.TouchTriangle(a, b, c) == 3 || t == 0)
+                hardStarts.push_back(t);
+        }
+        hardStarts.push_back(triangleCount);
+
+        // Within a patch, a run that has shaded no more vertices per triangle than threshold times the patch does
+        // may also end there: starting the next run with a cold cache costs no more than the threshold allows.
+        std::vector<uint32_t> clusterStarts;
+        for (size_t h = 0; h + 1 < hardStarts.size(); ++h)
+        {
+            const uint32_t start = hardStarts[h], end = hardStarts[h + 1];
+
+            cache.Flush();
+            uint32_t patchMisses = 0;
+            for (uint32_t t = start; t < end; ++t)
+            {
+                uint32_t a, b, c;
+                Triangle(t, a, b, c);
+                patchMisses += cache.TouchTriangle(a, b, c);
+            }
+            const float patchThreshold = threshold * patchMisses / (end - start);
+
+            clusterStarts.push_back(start);
+            cache.Flush();
+            uint32_t runMisses = 0, runTriangles = 0;
+            for (uint32_t t = start; t < end; ++t)
+            {
+                uint32_t a, b, c;
+                Triangle(t, a, b, c);
+                runMisses += cache.TouchTriangle(a, b, c);
+                ++runTriangles;
+                if (t + 1 < end && (float)runMisses <= patchThreshold * runTriangles)
+                {
+                    clusterStarts.push_back(t + 1);
+                    cache.Flush();
+                    runMisses = runTriangles = 0;
+                }
+            }
+        }
+        clusterStarts.push_back(triangleCount);
+
+        // Clusters whose triangles are far out from the center of the mesh and face away from it are likely to hide
+        // the others from wherever the mesh is seen, so they go first. Each triangle is weighed on its own, by area, so
+        // that a long cluster curving around the mesh counts as far out as its triangles are rather than as close as its
+        // centroid is.
+        const uint32_t clusterCount = (uint32_t)clusterStarts.size() - 1;
+        std::vector<double> clusterNormals(clusterCount * 3, 0.0);     // Summed, twice the area long
+        std::vector<double> clusterOutward(clusterCount, 0.0);         // Summed dot(centroid, normal)
+        std::vector<double> clusterAreas(clusterCount, 0.0);           // Twice the area
+        double meshCentroid[3] = {}, meshArea = 0.0;
+
+        for (uint32_t cluster = 0; cluster < clusterCount; ++cluster)
+        {
+            for (uint32_t t = clusterStarts[cluster]; t < clusterStarts[cluster + 1]; ++t)
+            {
+                uint32_t a, b, c;
+                Triangle(t, a, b, c);
+                const float* p0 = GetPosition(positions, positionStride, a);
+                const float* p1 = GetPosition(positions, positionStride, b);
+                const float* p2 = GetPosition(positions, positionStride, c);
+
+                const double e1[3] = { (double)p1[0] - p0[0], (double)p1[1] - p0[1], (double)p1[2] - p0[2] };
+                const double e2[3] = { (double)p2[0] - p0[0], (double)p2[1] - p0[1], (double)p2[2] - p0[2] };
+                const double n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+                const double area = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+                for (int k = 0; k < 3; ++k)
+                {
+                    const double centroid = ((double)p0[k] + p1[k] + p2[k]) / 3.0;
+                    clusterNormals[cluster * 3 + k] += n[k];
+                    clusterOutward[cluster] += centroid * n[k];
+                    meshCentroid[k] += centroid * area;
+                }
+                clusterAreas[cluster] += area;
+                meshArea += area;
+            }
+        }
+
+        if (meshArea > 0.0)
+        {
+            for (int k = 0; k < 3; ++k)
+                meshCentroid[k] /= meshArea;
+        }
+
+        // The area weighted mean of dot(triangle centroid - mesh centroid, triangle normal).
+        std::vector<float> sortKeys(clusterCount);
+        for (uint32_t cluster = 0; cluster < clusterCount; ++cluster)
+        {
+            const double* n = &clusterNormals[cluster * 3];
+            double key = 0.0;
+            if (clusterAreas[cluster] > 0.0)
+                key = (clusterOutward[cluster] - (meshCentroid[0] * n[0] + meshCentroid[1] * n[1] + meshCentroid[2] * n[2])) / clusterAreas[cluster];
+            sortKeys[cluster] = (float)key;
+        }
+
+        std::vector<uint32_t> order(clusterCount);
+        for (uint32_t cluster = 0; cluster < clusterCount; ++cluster)
+            order[cluster] = cluster;
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return sortKeys[a] > sortKeys[b]; });
+
+        const size_t indexSize = index32 ? 4 : 2;
+        std::vector<uint8_t> sorted((size_t)triangleCount * 3 * indexSize);
+        size_t offset = 0;
+        for (uint32_t cluster : order)
+        {
+            const size_t size = (size_t)(clusterStarts[cluster + 1] - clusterStarts[cluster]) * 3 * indexSize;
+            std::memcpy(sorted.data() + offset, (const uint8_t*)indices + (size_t)clusterStarts[cluster] * 3 * indexSize, size);
+            offset += size;
+        }
+        std::memcpy(indices, sorted.data(), sorted.size());
+    }
+
+    uint32_t OptimizeVertexFetch(void* indices, bool index32, uint32_t indexCount, uint32_t vertexCount,
+        uint32_t vertexStride, std::vector<uint32_t>& remap)
+    {
+        // Both orders drop the unused vertices: one numbers the rest as they are first used, the other keeps theirs.
+        std::vector<uint32_t> firstUse(vertexCount, kUnusedVertex);
+        std::vector<uint32_t> firstUseIndices(indexCount);
+        uint32_t usedVertexCount = 0;
+        for (uint32_t i = 0; i < indexCount; ++i)
+        {
+            const uint32_t vertex = GetIndex(indices, index32, i);
+            if (firstUse[vertex] == kUnusedVertex)
+                firstUse[vertex] = usedVertexCount++;
+            firstUseIndices[i] = firstUse[vertex];
+        }
+
+        remap.assign(vertexCount, kUnusedVertex);
+        uint32_t keptCount = 0;
+        for (uint32_t v = 0; v < vertexCount; ++v)
+        {
+            if (firstUse[v] != kUnusedVertex)
+                remap[v] = keptCount++;
+        }
+        std::vector<uint32_t> keptIndices(indexCount);
+        for (uint32_t i = 0; i < indexCount; ++i)
+            keptIndices[i] = remap[GetIndex(indices, index32, i)];
+
+        // Vertices that are already laid out the way the triangles walk them can fetch better than first use does.
+        const VertexFetchStats kept = AnalyzeVertexFetch(keptIndices.data(), true, indexCount, usedVertexCount, vertexStride);
+        const VertexFetchStats reordered = AnalyzeVertexFetch(firstUseIndices.data(), true, indexCount, usedVertexCount, vertexStride);
+        if (reordered.bytesFetched < kept.bytesFetched)
+        {
+            remap.swap(firstUse);
+            keptIndices.swap(firstUseIndices);
+        }
+
+        for (uint32_t i = 0; i < indexCount; ++i)
+            SetIndex(indices, index32, i, keptIndices[i]);
+        return usedVertexCount;
+    }
+
+    void RemapVertexBuffer(std::vector<uint8_t>& vertices, uint32_t vertexStride, const std::vector<uint32_t>& remap,
+        uint32_t usedVertexCount)
+    {
+        std::vector<uint8_t> remapped((size_t)usedVertexCount * vertexStride);
+        for (size_t v = 0; v < remap.size(); ++v)
+        {
+            if (remap[v] != kUnusedVertex)
+                std::memcpy(remapped.data() + (size_t)remap[v] * vertexStride, vertices.data() + v * vertexStride, vertexStride);
+        }
+        vertices.swap(remapped);
+    }
+
+    // Walks the triangles in batches as AnalyzeVertexCache describes and calls shade(vertex) for every vertex shaded,
+    // in the order they are. Returns the number of vertices used.
+    template <typename Function>
+    static uint32_t ShadeBatches(const void* indices, bool index32, uint32_t indexCount, uint32_t vertexCount,
+        uint32_t batchVertices, uint32_t batchTriangles, const Function& shade)
+    {
+        // Stamped with the batch that shaded them.
+        std::vector<uint32_t> shadedIn(vertexCount, 0);
+        uint32_t batch = 1, batchShaded = 0, batchTriangleCount = 0, usedCount = 0;
+
+        for (uint32_t t = 0; t < indexCount / 3; ++t)
+        {
+            uint32_t v[3];
+            for (uint32_t k = 0; k < 3; ++k)
+                v[k] = GetIndex(indices, index32, t * 3 + k);
+
+            uint32_t misses = 0;
+            for (uint32_t k = 0; k < 3; ++k)
+                misses += shadedIn[v[k]] != batch && (k == 0 || v[k] != v[0]) && (k < 2 || v[k] != v[1]);
+
+            if (batchShaded + misses > batchVertices || batchTriangleCount == batchTriangles)
+            {
+                ++batch;
+                batchShaded = batchTriangleCount = 0;
+            }
+
+            for (uint32_t k = 0; k < 3; ++k)
+            {
+                if (shadedIn[v[k]] != batch)
+                {
+                    usedCount += shadedIn[v[k]] == 0;
+                    shadedIn[v[k]] = batch;
+                    ++batchShaded;
+                    shade(v[k]);
+                }
+            }
+            ++batchTriangleCount;
+        }
+        return usedCount;
+    }
+
+    VertexCacheStats AnalyzeVertexCache(const void* indices, bool index32, uint32_t indexCount, uint32_t vertexCount,
+        uint32_t batchVertices, uint32_t batchTriangles)
+    {
+        VertexCacheStats stats = {};
+        if (indexCount < 3)
+            return stats;
+
+        const uint32_t usedCount = ShadeBatches(indices, index32, indexCount, vertexCount, batchVertices, batchTriangles,
+            [&](uint32_t) { ++stats.verticesShaded; });
+
+        stats.acmr = (float)stats.verticesShaded / (indexCount / 3);
+        stats.atvr = (float)stats.verticesShaded / usedCount;
+        return stats;
+    }
+
+    OverdrawStats AnalyzeOverdraw(const void* indices, bool index32, uint32_t indexCount,
+        const uint8_t* positions, uint32_t positionStride, uint32_t vertexCount)
+    {
+        OverdrawStats stats = {};
+        const uint32_t triangleCount = indexCount / 3;
+        if (triangleCount == 0 || vertexCount == 0)
+            return stats;
+
+        float minPos[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, maxPos[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+        for (uint32_t v = 0; v < vertexCount; ++v)
+        {
+            const float* p = GetPosition(positions, positionStride, v);
+            for (int k = 0; k < 3; ++k)
+            {
+                minPos[k] = std::min(minPos[k], p[k]);
+                maxPos[k] = std::max(maxPos[k], p[k]);
+            }
+        }
+
+        const uint32_t kGrid = kOverdrawGridSize;
+        const int64_t kSubpixels = 256;
+        std::vector<float> depth((size_t)kGrid * kGrid);
+
+        for (int view = 0; view < 6; ++view)
+        {
+            // Looking down axis, toward +axis for even views and -axis for odd ones.
+            const int axis = view / 2, u = (axis + 1) % 3, w = (axis + 2) % 3;
+            const float sign = view % 2 == 0 ? 1.0f : -1.0f;
+            const float extent = std::max(maxPos[u] - minPos[u], maxPos[w] - minPos[w]);
+            const float scale = extent > 0.0f ? kGrid / extent : 0.0f;
+
+            std::fill(depth.begin(), depth.end(), FLT_MAX);
+
+            for (uint32_t t = 0; t < triangleCount; ++t)
+            {
+                // Snapped to 1/256 of a pixel, so that neighbors agree exactly on their shared edges.
+                int64_t x[3], y[3];
+                float z[3];
+                for (uint32_t k = 0; k < 3; ++k)
+                {
+                    const float* p = GetPosition(positions, positionStride, GetIndex(indices, index32, t * 3 + k));
+                    x[k] = (int64_t)std::floor((p[u] - minPos[u]) * scale * kSubpixels + 0.5f);
+                    y[k] = (int64_t)std::floor((p[w] - minPos[w]) * scale * kSubpixels + 0.5f);
+                    z[k] = p[axis] * sign;
+                }
+
+                // (u, w, axis) is right handed, so a counterclockwise triangle on the grid faces +axis, toward an eye
+                // looking down -axis, and a clockwise one faces an eye looking down +axis.
+                int64_t area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+                if (area == 0 || (area > 0) == (sign > 0.0f))
+                    continue;
+
+                // Make the triangle counterclockwise either way, so the inside is left of every edge.
+                if (area < 0)
+                {
+                    std::swap(x[1], x[2]);
+                    std::swap(y[1], y[2]);
+                    std::swap(z[1], z[2]);
+                    area = -area;
+                }
+
+                const int gridMax = (int)kGrid - 1;
+                const int x0 = std::max((int)(std::min({ x[0], x[1], x[2] }) / kSubpixels) - 1, 0);
+                const int x1 = std::min((int)(std::max({ x[0], x[1], x[2] }) / kSubpixels) + 1, gridMax);
+                const int y0 = std::max((int)(std::min({ y[0], y[1], y[2] }) / kSubpixels) - 1, 0);
+                const int y1 = std::min((int)(std::max({ y[0], y[1], y[2] }) / kSubpixels) + 1, gridMax);
+
+                // Pixels on a shared edge belong to one triangle only: the one it is a top or left edge of.
+                bool inclusive[3];
+                for (int e = 0; e < 3; ++e)
+                {
+                    const int a = (e + 1) % 3, b = (e + 2) % 3;
+                    inclusive[e] = y[b] < y[a] || (y[b] == y[a] && x[b] < x[a]);
+                }
+
+                for (int py = y0; py <= y1; ++py)
+                {
+                    for (int px = x0; px <= x1; ++px)
+                    {
+                        const int64_t cx = (int64_t)px * kSubpixels + kSubpixels / 2, cy = (int64_t)py * kSubpixels + kSubpixels / 2;
+                        int64_t weights[3];
+                        bool inside = true;
+                        for (int e = 0; e < 3 && inside; ++e)
+                        {
+                            // The edge opposite vertex e.
+                            const int a = (e + 1) % 3, b = (e + 2) % 3;
+                            weights[e] = (x[b] - x[a]) * (cy - y[a]) - (y[b] - y[a]) * (cx - x[a]);
+                            inside = weights[e] > 0 || (weights[e] == 0 && inclusive[e]);
+                        }
+                        if (!inside)
+                            continue;
+
+                        const float fragmentDepth = ((float)weights[0] * z[0] + (float)weights[1] * z[1] + (float)weights[2] * z[2]) / (float)area;
+                        float& pixel = depth[(size_t)py * kGrid + px];
+                        if (fragmentDepth < pixel)
+                        {
+                            stats.pixelsCovered += pixel == FLT_MAX;
+                            stats.pixelsShaded++;
+                            pixel = fragmentDepth;
+                        }
+                    }
+                }
+            }
+        }
+
+        stats.overdraw = stats.pixelsCovered > 0 ? (float)stats.pixelsShaded / stats.pixelsCovered : 0.0f;
+        return stats;
+    }
+
+    VertexFetchStats AnalyzeVertexFetch(const void* indices, bool index32, uint32_t indexCount, uint32_t vertexCount,
+        uint32_t vertexStride)
+    {
+        VertexFetchStats stats = {};
+        if (indexCount < 3 || vertexStride == 0)
+            return stats;
+
+        const uint32_t lineCount = (uint32_t)(((uint64_t)vertexCount * vertexStride + kFetchLineSize - 1) / kFetchLineSize);
+        FifoCache cache(lineCount, kFetchCacheLines);
+
+        const uint32_t usedCount = ShadeBatches(indices, index32, indexCount, vertexCount, kBatchVertices, kBatchTriangles,
+            [&](uint32_t vertex)
+        {
+            const uint64_t start = (uint64_t)vertex * vertexStride;
+            for (uint64_t line = start / kFetchLineSize; line <= (start + vertexStride - 1) / kFetchLineSize; ++line)
+            {
+                if (cache.Touch((uint32_t)line))
+                    stats.bytesFetched += kFetchLineSize;
+            }
+        });
+
+        stats.overfetch = (float)stats.bytesFetched / ((uint64_t)usedCount * vertexStride);
+        return stats;
+    }
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Orders an indexed triangle list for the three costs of drawing it, in the order they have to be applied:
+// OptimizeFaces (IndexOptimizePostTransform.h) orders triangles so that vertices are shaded as few times as possible,
+// OptimizeOverdraw then moves whole runs of them so that outward facing parts of the mesh tend to be drawn before what
+// they hide, from any direction, and OptimizeVertexFetch last renumbers the vertices in the order they are first used
+// so that fetching them walks the vertex buffer forward, where that beats the order they came in. Indices are 16 or
+// 32 bits, as index32 says, and positions point at the first float3 position with positionStride bytes between
+// positions. Nothing here depends on Direct3D, and the analyzers measure the result the way the hardware spends it.
+namespace MeshOptimize
+{
+    // The cache size OptimizeFaces is run with. GPUs no longer keep an LRU of shaded vertices: they shade them in
+    // batches about the size of a wave and only reuse vertices within a batch, which is what AnalyzeVertexCache
+    // measures. Benchmark shows the simulated LRU still does best at the largest size OptimizeFaces allows against
+    // that model, every halving costing a few percent more vertices shaded.
+    const uint32_t kVertexCacheSize = 64;
+
+    // Runs whose vertex reuse is within this factor of their neighborhood's may be drawn in any order, so
+    // OptimizeOverdraw gives up at most this much of OptimizeFaces' vertex reuse.
+    const float kOverdrawThreshold = 1.05f;
+
+    // Reorders the triangles of a list already ordered by OptimizeFaces. The list is cut into clusters where the
+    // vertex cache would start over anyway and where a run has reached its neighborhood's reuse, and the clusters are
+    // sorted by how far out they face from the center of the mesh. Triangles within a cluster keep their order.
+    void OptimizeOverdraw(void* indices, bool index32, uint32_t indexCount,
+        const uint8_t* positions, uint32_t positionStride, uint32_t vertexCount, float threshold = kOverdrawThreshold);
+
+    // Renumbers vertices in the order the indices first use them, rewriting the indices, if AnalyzeVertexFetch says
+    // that fetches fewer bytes of vertexStride byte vertices than the order they are in; otherwise they keep it. Either
+    // way remap gets the new index of every old vertex, or kUnusedVertex for vertices no triangle uses. Returns the
+    // number of vertices used.
+    const uint32_t kUnusedVertex = 0xFFFFFFFF;
+    uint32_t OptimizeVertexFetch(void* indices, bool index32, uint32_t indexCount, uint32_t vertexCount,
+        uint32_t vertexStride, std::vector<uint32_t>& remap);
+
+    // Moves the vertices of a buffer to where remap says and drops the unused ones.
+    void RemapVertexBuffer(std::vector<uint8_t>& vertices, uint32_t vertexStride, const std::vector<uint32_t>& remap,
+        uint32_t usedVertexCount);
+
+    // Vertex reuse as a GPU that shades vertices in batches sees it. A batch takes triangles until one of them would
+    // need more than batchVertices vertices shaded or the batch has batchTriangles triangles; vertices are only reused
+    // within a batch.
+    struct VertexCacheStats
+    {
+        uint32_t verticesShaded;
+        float acmr;     // Vertices shaded per triangle; 0.5 is ideal for large regular meshes, 3 the worst
+        float atvr;     // Vertices shaded per vertex used; 1 is ideal
+    };
+
+    const uint32_t kBatchVertices = 32;
+    const uint32_t kBatchTriangles = 64;
+
+    VertexCacheStats AnalyzeVertexCache(const void* indices, bool index32, uint32_t indexCount, uint32_t vertexCount,
+        uint32_t batchVertices = kBatchVertices, uint32_t batchTriangles = kBatchTriangles);
+
+    // Pixels shaded over pixels covered, from each of the six axis directions, on a kOverdrawGridSize square grid
+    // fitted to the mesh. Back faces are culled and fragments are depth tested as drawn.
+    struct OverdrawStats
+    {
+        uint64_t pixelsCovered;
+        uint64_t pixelsShaded;
+        float overdraw;     // 1 is ideal
+    };
+
+    const uint32_t kOverdrawGridSize = 256;
+
+    OverdrawStats AnalyzeOverdraw(const void* indices, bool index32, uint32_t indexCount,
+        const uint8_t* positions, uint32_t positionStride, uint32_t vertexCount);
+
+    // Bytes read from a vertex buffer with vertexStride bytes per vertex, when every vertex the batches of
+    // AnalyzeVertexCache shade is fetched through a FIFO cache of kFetchCacheLines lines of kFetchLineSize bytes.
+    struct VertexFetchStats
+    {
+        uint64_t bytesFetched;
+        float overfetch;    // Bytes fetched over the size of the vertices used; 1 is ideal
+    };
+
+    const uint32_t kFetchLineSize = 64;
+    const uint32_t kFetchCacheLines = 256;
+
+    VertexFetchStats AnalyzeVertexFetch(const void* indices, bool index32, uint32_t indexCount, uint32_t vertexCount,
+        uint32_t vertexStride);
+}
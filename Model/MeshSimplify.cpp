@@ -0,0 +1,342 @@
+#include "MeshSimplify.h"
+#include "../Core/Utility.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <tuple>
+#include <unordered_map>
+
+namespace MeshSimplify
+{
+    struct PositionKey
+    {
+        uint32_t bits[3];
+        bool operator==(const PositionKey& rhs) const { return std::memcmp(bits, rhs.bits, sizeof(bits)) == 0; }
+    };
+
+    struct PositionKeyHash
+    {
+        size_t operator()(const PositionKey& key) const
+        {
+            return (size_t)(key.bits[0] * 73856093u ^ key.bits[1] * 19349663u ^ key.bits[2] * 83492791u);
+        }
+    };
+
+    static inline void Cross(const float a[3], const float b[3], const float c[3], double n[3])
+    {
+        const double e1[3] = { (double)b[0] - a[0], (double)b[1] - a[1], (double)b[2] - a[2] };
+        const double e2[3] = { (double)c[0] - a[0], (double)c[1] - a[1], (double)c[2] - a[2] };
+        n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+        n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+        n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+    }
+
+    Simplifier::Simplifier(const uint32_t* indices, uint32_t indexCount,
+        const uint8_t* positions, uint32_t positionStride, uint32_t vertexCount)
+        : m_Error(0.0f)
+    {
+        m_Positions.resize(vertexCount * 3);
+        for (uint32_t v = 0; v < vertexCount; ++v)
+            std::memcpy(&m_Positions[v * 3], positions + (size_t)v * positionStride, 12);
+
+        // Vertices split for their attributes still share a position, and the surface is only connected through
+        // those positions.
+        std::unordered_map<PositionKey, uint32_t, PositionKeyHash> firstVertex;
+        m_Canonical.resize(vertexCount);
+        for (uint32_t v = 0; v < vertexCount; ++v)
+        {
+            PositionKey key;
+            for (int k = 0; k < 3; ++k)
+            {
+                // Fold -0 into +0.
+                const float f = m_Positions[v * 3 + k] == 0.0f ? 0.0f : m_Positions[v * 3 + k];
+                std::memcpy(&key.bits[k], &f, 4);
+            }
+            m_Canonical[v] = firstVertex.insert(std::make_pair(key, v)).first->second;
+        }
+
+        m_Indices.reserve(indexCount);
+        for (uint32_t i = 0; i + 2 < indexCount; i += 3)
+        {
+            const uint32_t a = m_Canonical[indices[i]], b = m_Canonical[indices[i + 1]], c = m_Canonical[indices[i + 2]];
+            if (a != b && b != c && c != a)
+                m_Indices.insert(m_Indices.end(), indices + i, indices + i + 3);
+        }
+
+        // Every triangle adds its plane to its corners, weighted by area so that slivers don't dominate.
+        m_Quadrics.assign(vertexCount, Quadric());
+
+        for (size_t i = 0; i < m_Indices.size(); i += 3)
+        {
+            const float* p0 = &m_Positions[m_Canonical[m_Indices[i]] * 3];
+            const float* p1 = &m_Positions[m_Canonical[m_Indices[i + 1]] * 3];
+            const float* p2 = &m_Positions[m_Canonical[m_Indices[i + 2]] * 3];
+            double n[3];
+            Cross(p0, p1, p2, n);
+            const double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            if (length == 0.0)
+                continue;
+
+            const double a = n[0] / length, b = n[1] / length, c = n[2] / length;
+            const double d = -(a * p0[0] + b * p0[1] + c * p0[2]);
+            const double area = length * 0.5;
+            const double plane[10] = { a * a, a * b, a * c, a * d, b * b, b * c, b * d, c * c, c * d, d * d };
+            for (int corner = 0; corner < 3; ++corner)
+            {
+                Quadric& q = m_Quadrics[m_Canonical[m_Indices[i + corner]]];
+                for (int k = 0; k < 10; ++k)
+                    q.a[k] += plane[k] * area;
+                q.weight += area;
+            }
+        }
+
+        // Lock seams (positions with more than one vertex in use) and the ends of edges that aren't shared by exactly
+        // two triangles.
+        m_Locked.assign(vertexCount, 0);
+        std::vector<uint32_t> usedVertex(vertexCount, ~0u);
+        for (uint32_t index : m_Indices)
+        {
+            uint32_t& used = usedVertex[m_Canonical[index]];
+            if (used != ~0u && used != index)
+                m_Locked[m_Canonical[index]] = 1;
+            used = index;
+        }
+
+        std::unordered_map<uint64_t, uint32_t> edgeUses;
+        edgeUses.reserve(m_Indices.size());
+        for (size_t i = 0; i < m_Indices.size(); i += 3)
+        {
+            for (int e = 0; e < 3; ++e)
+            {
+                const uint32_t a = m_Canonical[m_Indices[i + e]], b = m_Canonical[m_Indices[i + (e + 1) % 3]];
+                ++edgeUses[(uint64_t)std::min(a, b) << 32 | std::max(a, b)];
+            }
+        }
+        for (const auto& edge : edgeUses)
+        {
+            if (edge.second != 2)
+            {
+                m_Locked[edge.first >> 32] = 1;
+                m_Locked[edge.first & 0xFFFFFFFF] = 1;
+            }
+        }
+    }
+
+    double Simplifier::Evaluate(const Quadric& q, const float p[3]) const
+    {
+        const double x = p[0], y = p[1], z = p[2];
+        const double* a = q.a;
+        return a[0] * x * x + 2.0 * a[1] * x * y + 2.0 * a[2] * x * z + 2.0 * a[3] * x
+            + a[4] * y * y + 2.0 * a[5] * y * z + 2.0 * a[6] * y
+            + a[7] * z * z + 2.0 * a[8] * z
+            + a[9];
+    }
+
+    // Whether moving vertex onto target turns any of its triangles that survive the collapse around or folds the
+    // surface onto itself.
+    bool Simplifier::Flips(uint32_t vertex, uint32_t target, const std::vector<uint32_t>& triangleOffsets,
+        const std::vector<uint32_t>& triangles) const
+    {
+        for (uint32_t t = triangleOffsets[vertex]; t < triangleOffsets[vertex + 1]; ++t)
+        {
+            const uint32_t* tri = &m_Indices[triangles[t] * 3];
+            uint32_t corners[3];
+            bool collapses = false;
+            for (int k = 0; k < 3; ++k)
+            {
+                corners[k] = m_Canonical[tri[k]];
+                collapses |= corners[k] == target;
+            }
+            if (collapses)
+                continue;
+
+            const float* p[3];
+            const float* q[3];
+            for (int k = 0; k < 3; ++k)
+            {
+                p[k] = &m_Positions[corners[k] * 3];
+                q[k] = corners[k] == vertex ? &m_Positions[target * 3] : p[k];
+            }
+
+            double before[3], after[3];
+            Cross(p[0], p[1], p[2], before);
+            Cross(q[0], q[1], q[2], after);
+            const double dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+            const double beforeSq = before[0] * before[0] + before[1] * before[1] + before[2] * before[2];
+            const double afterSq = after[0] * after[0] + after[1] * after[1] + after[2] * after[2];
+
+            // Turning by more than 60 degrees counts too. Such triangles are usually slivers standing on edge,
+            // which flip for good as soon as anything else moves.
+            if (dot <= 0.5 * std::sqrt(beforeSq * afterSq))
+                return true;
+        }
+
+        // The link condition: vertex and target may only have the neighbors in common that lie across their shared
+        // triangles. Any other common neighbor would end up with two edges to the merged vertex, folding the surface.
+        uint32_t sharedTriangles = 0;
+        std::vector<uint32_t> vertexNeighbors, targetNeighbors;
+        for (uint32_t t = triangleOffsets[vertex]; t < triangleOffsets[vertex + 1]; ++t)
+        {
+            const uint32_t* tri = &m_Indices[triangles[t] * 3];
+            bool shared = false;
+            for (int k = 0; k < 3; ++k)
+            {
+                const uint32_t corner = m_Canonical[tri[k]];
+                shared |= corner == target;
+                if (corner != vertex && corner != target)
+                    vertexNeighbors.push_back(corner);
+            }
+            sharedTriangles += shared ? 1 : 0;
+        }
+        for (uint32_t t = triangleOffsets[target]; t < triangleOffsets[target + 1]; ++t)
+        {
+            const uint32_t* tri = &m_Indices[triangles[t] * 3];
+            for (int k = 0; k < 3; ++k)
+            {
+                const uint32_t corner = m_Canonical[tri[k]];
+                if (corner != vertex && corner != target)
+                    targetNeighbors.push_back(corner);
+            }
+        }
+        std::sort(vertexNeighbors.begin(), vertexNeighbors.end());
+        vertexNeighbors.erase(std::unique(vertexNeighbors.begin(), vertexNeighbors.end()), vertexNeighbors.end());
+        std::sort(targetNeighbors.begin(), targetNeighbors.end());
+        targetNeighbors.erase(std::unique(targetNeighbors.begin(), targetNeighbors.end()), targetNeighbors.end());
+
+        uint32_t commonNeighbors = 0;
+        for (size_t i = 0, j = 0; i < vertexNeighbors.size() && j < targetNeighbors.size(); )
+        {
+            if (vertexNeighbors[i] < targetNeighbors[j])
+                ++i;
+            else if (targetNeighbors[j] < vertexNeighbors[i])
+                ++j;
+            else
+                ++commonNeighbors, ++i, ++j;
+        }
+        return commonNeighbors != sharedTriangles;
+    }
+
+    bool Simplifier::RunPass(uint32_t targetTriangles, float maxError)
+    {
+        const uint32_t vertexCount = (uint32_t)m_Canonical.size();
+        const uint32_t triangleCount = GetTriangleCount();
+
+        // The triangles around every position.
+        std::vector<uint32_t> triangleOffsets(vertexCount + 1, 0);
+        for (uint32_t index : m_Indices)
+            ++triangleOffsets[m_Canonical[index] + 1];
+        for (uint32_t v = 0; v < vertexCount; ++v)
+            triangleOffsets[v + 1] += triangleOffsets[v];
+        std::vector<uint32_t> triangles(m_Indices.size());
+        {
+            std::vector<uint32_t> cursor(triangleOffsets.begin(), triangleOffsets.end() - 1);
+            for (uint32_t i = 0; i < (uint32_t)m_Indices.size(); ++i)
+                triangles[cursor[m_Canonical[m_Indices[i]]]++] = i / 3;
+        }
+
+        struct Collapse
+        {
+            double cost;
+            uint32_t vertex;        // Canonical vertex that goes away
+            uint32_t target;        // Canonical vertex it merges into
+            uint32_t fromIndex;     // The vertex buffer index being replaced...
+            uint32_t toIndex;       // ...and its replacement, on the same side of any seam at target
+        };
+
+        std::vector<Collapse> collapses;
+        collapses.reserve(m_Indices.size() * 2);
+        for (size_t i = 0; i < m_Indices.size(); i += 3)
+        {
+            for (int e = 0; e < 3; ++e)
+            {
+                const uint32_t ia = m_Indices[i + e], ib = m_Indices[i + (e + 1) % 3];
+                const uint32_t a = m_Canonical[ia], b = m_Canonical[ib];
+                const uint32_t ends[2][4] = { { a, b, ia, ib }, { b, a, ib, ia } };
+                for (const auto& end : ends)
+                {
+                    if (m_Locked[end[0]])
+                        continue;
+                    Quadric q = m_Quadrics[end[0]];
+                    const Quadric& qt = m_Quadrics[end[1]];
+                    for (int k = 0; k < 10; ++k)
+                        q.a[k] += qt.a[k];
+                    q.weight += qt.weight;
+                    const double cost = q.weight > 0.0 ? std::max(Evaluate(q, &m_Positions[end[1] * 3]), 0.0) / q.weight : 0.0;
+                    collapses.push_back({ cost, end[0], end[1], end[2], end[3] });
+                }
+            }
+        }
+
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y)
+        {
+            return std::tie(x.cost, x.vertex, x.target) < std::tie(y.cost, y.vertex, y.target);
+        });
+
+        // Each collapse only looks at the triangles around its vertex, so none of their corners may change in the
+        // same pass.
+        std::vector<uint8_t> touched(vertexCount, 0);
+        std::vector<uint32_t> redirect(m_Canonical.size());
+        for (uint32_t v = 0; v < (uint32_t)redirect.size(); ++v)
+            redirect[v] = v;
+
+        const double maxCost = (double)maxError * maxError;
+        uint32_t remaining = triangleCount;
+        bool collapsed = false;
+        for (const Collapse& collapse : collapses)
+        {
+            if (remaining <= targetTriangles || collapse.cost > maxCost)
+                break;
+            if (touched[collapse.vertex] || touched[collapse.target])
+                continue;
+            if (Flips(collapse.vertex, collapse.target, triangleOffsets, triangles))
+                continue;
+
+            uint32_t removed = 0;
+            for (uint32_t t = triangleOffsets[collapse.vertex]; t < triangleOffsets[collapse.vertex + 1]; ++t)
+            {
+                const uint32_t* tri = &m_Indices[triangles[t] * 3];
+                bool shared = false;
+                for (int k = 0; k < 3; ++k)
+                {
+                    touched[m_Canonical[tri[k]]] = 1;
+                    shared |= m_Canonical[tri[k]] == collapse.target;
+                }
+                removed += shared ? 1 : 0;
+            }
+
+            redirect[collapse.fromIndex] = collapse.toIndex;
+            Quadric& q = m_Quadrics[collapse.target];
+            for (int k = 0; k < 10; ++k)
+                q.a[k] += m_Quadrics[collapse.vertex].a[k];
+            q.weight += m_Quadrics[collapse.vertex].weight;
+
+            remaining -= removed;
+            m_Error = std::max(m_Error, (float)std::sqrt(collapse.cost));
+            collapsed = true;
+        }
+
+        if (!collapsed)
+            return false;
+
+        size_t write = 0;
+        for (size_t i = 0; i < m_Indices.size(); i += 3)
+        {
+            const uint32_t tri[3] = { redirect[m_Indices[i]], redirect[m_Indices[i + 1]], redirect[m_Indices[i + 2]] };
+            const uint32_t a = m_Canonical[tri[0]], b = m_Canonical[tri[1]], c = m_Canonical[tri[2]];
+            if (a == b || b == c || c == a)
+                continue;
+            m_Indices[write++] = tri[0];
+            m_Indices[write++] = tri[1];
+            m_Indices[write++] = tri[2];
+        }
+        m_Indices.resize(write);
+        return true;
+    }
+
+    void Simplifier::Simplify(uint32_t targetTriangles, float maxError)
+    {
+        while (GetTriangleCount() > targetTriangles && RunPass(targetTriangles, maxError))
+            ;
+    }
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// A reduced version of a Mesh::Draw. Its indices follow the draw's own in the index buffer and reference the same
+// vertices, so switching levels only changes the index range that is drawn.
+struct MeshLod
+{
+    uint32_t primCount;     // Number of indices
+    uint32_t startIndex;    // Relative to the draw's startIndex
+    float error;            // How far the reduced surface may stray from the full one, in the units of the vertices
+};
+
+// The levels of one Mesh::Draw, coarsest last. Models keep one range per draw, in mesh and draw order.
+struct MeshLodRange
+{
+    uint32_t first;
+    uint32_t count;
+};
+
+namespace MeshSimplify
+{
+    // Levels generated for every draw besides the full one, each aiming for half the triangles of the previous.
+    const uint32_t kMaxMeshLods = 3;
+
+    // Draws with fewer triangles than this aren't worth reducing.
+    const uint32_t kMinLodTriangles = 64;
+
+    // Reduces a triangle list by collapsing edges in order of quadric error. Vertices are never moved or created: an
+    // edge collapses into one of its endpoints, so reduced index lists can share the original vertex buffer. Vertices
+    // on open borders and on attribute seams (split vertices that share a position) are kept, which keeps textures and
+    // silhouettes from tearing. Simplify can be called repeatedly with decreasing targets to build a chain of levels.
+    class Simplifier
+    {
+    public:
+        Simplifier(const uint32_t* indices, uint32_t indexCount,
+            const uint8_t* positions, uint32_t positionStride, uint32_t vertexCount);
+
+        // Collapses edges until at most targetTriangles remain or no edge can collapse without flipping a triangle or
+        // erring by more than maxError.
+        void Simplify(uint32_t targetTriangles, float maxError);
+
+        const std::vector<uint32_t>& GetIndices() const { return m_Indices; }
+        uint32_t GetTriangleCount() const { return (uint32_t)m_Indices.size() / 3; }
+
+        // The largest error of any collapse so far, as a distance.
+        float GetError() const { return m_Error; }
+
+    private:
+        struct Quadric
+        {
+            double a[10];   // Upper triangle of the symmetric 4x4 matrix
+            double weight;
+        };
+
+        bool RunPass(uint32_t targetTriangles, float maxError);
+        double Evaluate(const Quadric& q, const float p[3]) const;
+        bool Flips(uint32_t vertex, uint32_t target, const std::vector<uint32_t>& triangleOffsets,
+            const std::vector<uint32_t>& triangles) const;
+
+        std::vector<uint32_t> m_Indices;        // Original vertex indices of the remaining triangles
+        std::vector<uint32_t> m_Canonical;      // Original vertex to the first vertex with the same position
+        std::vector<float> m_Positions;         // Per original vertex
+        std::vector<Quadric> m_Quadrics;        // Per canonical vertex
+        std::vector<uint8_t> m_Locked;          // Per canonical vertex
+        float m_Error;
+    };
+}
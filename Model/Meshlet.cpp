@@ -0,0 +1,209 @@
+#include "Meshlet.h"
+#include "../Core/Utility.h"
+#ifdef _WIN32
+#include "../Core/VectorMath.h"
+#include "../Core/Math/Frustum.h"
+#endif
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+namespace Meshlets
+{
+    static inline uint32_t GetIndex(const void* indices, bool index32, uint32_t i)
+    {
+        return index32 ? ((const uint32_t*)indices)[i] : ((const uint16_t*)indices)[i];
+    }
+
+    static inline const float* GetPosition(const uint8_t* positions, uint32_t positionStride, uint32_t vertex)
+    {
+        return (const float*)(positions + (size_t)vertex * positionStride);
+    }
+
+    // Fills in the bounds of a meshlet from its triangles and unique vertices.
+    static void ComputeBounds(Meshlet& meshlet, const void* indices, bool index32,
+        const uint8_t* positions, uint32_t positionStride, const std::vector<uint32_t>& vertices)
+    {
+        float minP[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+        float maxP[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+        for (uint32_t vertex : vertices)
+        {
+            const float* p = GetPosition(positions, positionStride, vertex);
+            for (int k = 0; k < 3; ++k)
+            {
+                minP[k] = std::min(minP[k], p[k]);
+                maxP[k] = std::max(maxP[k], p[k]);
+            }
+        }
+
+        // The box center is within a few percent of the optimal sphere for the compact clusters the builder makes.
+        float radiusSq = 0.0f;
+        for (int k = 0; k < 3; ++k)
+            meshlet.center[k] = (minP[k] + maxP[k]) * 0.5f;
+        for (uint32_t vertex : vertices)
+        {
+            const float* p = GetPosition(positions, positionStride, vertex);
+            const float d[3] = { p[0] - meshlet.center[0], p[1] - meshlet.center[1], p[2] - meshlet.center[2] };
+            radiusSq = std::max(radiusSq, d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+        }
+        // Pad for rounding so that no vertex ends up just outside.
+        meshlet.radius = std::sqrt(radiusSq) * 1.0001f;
+
+        // The normal cone. Counterclockwise triangles are front facing.
+        std::vector<float> normals;
+        normals.reserve(meshlet.triangleCount * 3);
+        float axis[3] = {};
+        for (uint32_t t = 0; t < meshlet.triangleCount; ++t)
+        {
+            const uint32_t i = meshlet.startIndex + t * 3;
+            const float* a = GetPosition(positions, positionStride, GetIndex(indices, index32, i + 0));
+            const float* b = GetPosition(positions, positionStride, GetIndex(indices, index32, i + 1));
+            const float* c = GetPosition(positions, positionStride, GetIndex(indices, index32, i + 2));
+            const float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+            const float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+            float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+            const float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+            // Degenerate triangles are never rasterized, so they don't constrain the cone.
+            if (length == 0.0f)
+                continue;
+
+            for (int k = 0; k < 3; ++k)
+            {
+                normals.push_back(n[k] / length);
+                axis[k] += n[k] / length;
+            }
+        }
+
+        meshlet.coneAxis[0] = meshlet.coneAxis[1] = meshlet.coneAxis[2] = 0.0f;
+        meshlet.coneCutoff = 1.0f;
+
+        const float axisLength = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+        if (normals.empty() || axisLength == 0.0f)
+            return;
+
+        float minDot = 1.0f;
+        for (size_t n = 0; n < normals.size(); n += 3)
+            minDot = std::min(minDot, (normals[n] * axis[0] + normals[n + 1] * axis[1] + normals[n + 2] * axis[2]) / axisLength);
+
+        // Past about 84 degrees from the axis the cone covers so little that it rarely culls anything.
+        if (minDot <= 0.1f)
+            return;
+
+        for (int k = 0; k < 3; ++k)
+            meshlet.coneAxis[k] = axis[k] / axisLength;
+        meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+    }
+
+    void Build(const void* indices, bool index32, uint32_t indexCount,
+        const uint8_t* positions, uint32_t positionStride, uint32_t vertexCount,
+        std::vector<Meshlet>& meshlets)
+    {
+        meshlets.clear();
+        if (indices == nullptr || positions == nullptr || indexCount < 3)
+            return;
+
+        // Marks which vertices the current meshlet already references.
+        std::vector<uint32_t> owner(vertexCount, ~0u);
+        std::vector<uint32_t> vertices;
+        vertices.reserve(kMaxMeshletVertices);
+
+        Meshlet meshlet = {};
+
+        auto Flush = [&]()
+        {
+            if (meshlet.triangleCount == 0)
+                return;
+            meshlet.vertexCount = (uint16_t)vertices.size();
+            ComputeBounds(meshlet, indices, index32, positions, positionStride, vertices);
+            meshlets.push_back(meshlet);
+
+            meshlet = Meshlet();
+            meshlet.startIndex = meshlets.back().startIndex + meshlets.back().triangleCount * 3;
+            vertices.clear();
+        };
+
+        const uint32_t triangleCount = indexCount / 3;
+        for (uint32_t t = 0; t < triangleCount; ++t)
+        {
+            uint32_t tri[3];
+            uint32_t newVertices = 0;
+            for (int k = 0; k < 3; ++k)
+            {
+                tri[k] = GetIndex(indices, index32, t * 3 + k);
+                ASSERT(tri[k] < vertexCount, "Index out of range");
+                if (owner[tri[k]] != (uint32_t)meshlets.size() && (k == 0 || tri[k] != tri[0]) && (k < 2 || tri[k] != tri[1]))
+                    ++newVertices;
+            }
+
+            if (vertices.size() + newVertices > kMaxMeshletVertices || meshlet.triangleCount + 1u > kMaxMeshletTriangles)
+                Flush();
+
+            for (int k = 0; k < 3; ++k)
+            {
+                if (owner[tri[k]] != (uint32_t)meshlets.size())
+                {
+                    owner[tri[k]] = (uint32_t)meshlets.size();
+                    vertices.push_back(tri[k]);
+                }
+            }
+            ++meshlet.triangleCount;
+        }
+        Flush();
+    }
+
+    bool ConeCulls(const Meshlet& meshlet, const float eye[3])
+    {
+        if (meshlet.coneCutoff >= 1.0f)
+            return false;
+
+        const float d[3] = { meshlet.center[0] - eye[0], meshlet.center[1] - eye[1], meshlet.center[2] - eye[2] };
+        const float distance = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+        const float dp = d[0] * meshlet.coneAxis[0] + d[1] * meshlet.coneAxis[1] + d[2] * meshlet.coneAxis[2];
+        return dp >= meshlet.coneCutoff * distance + meshlet.radius;
+    }
+
+#ifdef _WIN32
+    // Culling needs DirectXMath, so off Windows only Build is available, for the tests.
+    void Cull(const Meshlet* meshlets, uint32_t count, const Math::Matrix4& localToView, float scale,
+        const Math::Frustum& viewFrustum, const Math::Vector3* eyeLS, std::vector<MeshletSpan>& visible)
+    {
+        float eye[3];
+        if (eyeLS != nullptr)
+        {
+            eye[0] = eyeLS->GetX();
+            eye[1] = eyeLS->GetY();
+            eye[2] = eyeLS->GetZ();
+        }
+
+        bool extending = false;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const Meshlet& meshlet = meshlets[i];
+
+            bool culled = eyeLS != nullptr && ConeCulls(meshlet, eye);
+            if (!culled)
+            {
+                const Math::Vector3 centerVS = Math::Vector3(localToView * Math::Vector3(meshlet.center[0], meshlet.center[1], meshlet.center[2]));
+                culled = !viewFrustum.IntersectSphere(Math::BoundingSphere(centerVS, Math::Scalar(meshlet.radius * scale)));
+            }
+
+            if (culled)
+            {
+                extending = false;
+            }
+            else if (extending)
+            {
+                visible.back().primCount += meshlet.triangleCount * 3;
+            }
+            else
+            {
+                visible.push_back({ meshlet.triangleCount * 3u, meshlet.startIndex });
+                extending = true;
+            }
+        }
+    }
+#endif
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace Math
+{
+    class Matrix4;
+    class Frustum;
+    class Vector3;
+}
+
+// A cluster of up to kMaxMeshletVertices vertices and kMaxMeshletTriangles triangles that occupies a contiguous range
+// of its draw's indices. Meshlets are stored in .mini files next to the meshes so that clusters can be culled one by
+// one instead of drawing or skipping a whole mesh.
+struct Meshlet // 40 bytes
+{
+    float center[3];        // Bounding sphere, in the same space as the vertices
+    float radius;
+    float coneAxis[3];      // Average facing of the triangles
+    float coneCutoff;       // 1 when the triangles face too many ways to be culled as a group
+    uint32_t startIndex;    // Relative to the draw's startIndex
+    uint16_t triangleCount;
+    uint16_t vertexCount;
+};
+
+// The meshlets of one Mesh::Draw. Models keep one range per draw, in mesh and draw order.
+struct MeshletRange
+{
+    uint32_t first;
+    uint32_t count;
+};
+
+// A run of consecutive meshlets that survived culling, as a range of its draw's indices.
+struct MeshletSpan
+{
+    uint32_t primCount;     // Number of indices
+    uint32_t startIndex;    // Relative to the draw's startIndex
+};
+
+namespace Meshlets
+{
+    const uint32_t kMaxMeshletVertices = 64;
+    const uint32_t kMaxMeshletTriangles = 124;
+
+    // Splits an indexed triangle list into meshlets, walking the triangles in index buffer order so that the index
+    // buffer (already ordered for the post-transform cache) doesn't change and every meshlet is one index range.
+    // positions points at the first float3 position and positionStride is the distance between positions in bytes.
+    void Build(const void* indices, bool index32, uint32_t indexCount,
+        const uint8_t* positions, uint32_t positionStride, uint32_t vertexCount,
+        std::vector<Meshlet>& meshlets);
+
+    // Appends the index ranges of the meshlets that intersect viewFrustum, merging neighbors. localToView maps
+    // meshlet bounds to view space and scale is the largest scale it applies. When eyeLS (the eye in the space of the
+    // vertices) is given, meshlets whose triangles all face away from it are culled too.
+    void Cull(const Meshlet* meshlets, uint32_t count, const Math::Matrix4& localToView, float scale,
+        const Math::Frustum& viewFrustum, const Math::Vector3* eyeLS, std::vector<MeshletSpan>& visible);
+
+    // Whether every triangle of a meshlet faces away from eye, which is in the space of the vertices.
+    bool ConeCulls(const Meshlet& meshlet, const float eye[3]);
+}
@@ -0,0 +1,472 @@
+#include "MeshoptDecoder.h"
+#include "../Core/Utility.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace MeshoptDecoder
+{
+    // Vertex data is split into blocks of at most 8KB, each stored byte lane by byte lane as deltas from the previous
+    // vertex. Lanes are cut into groups of 16 deltas that are stored with 0, 2, 4 or 8 bits per delta, the narrow
+    // widths escaping larger values to extra bytes.
+    const uint8_t kVertexHeader = 0xa0;
+    const size_t kVertexBlockSizeBytes = 8192;
+    const size_t kVertexBlockMaxSize = 256;
+    const size_t kByteGroupSize = 16;
+    const size_t kByteGroupDecodeLimit = 24;    // Largest encoded group: 8 bytes of 4-bit codes and 16 escapes
+    const size_t kTailMinSize = 32;
+
+    // Triangles are coded against a FIFO of recent edges and one of recent vertices. Each triangle takes a code byte
+    // and, for vertices that are neither recent nor the next unused index, a delta from the last such index.
+    const uint8_t kIndexHeader = 0xe0;
+    const uint8_t kSequenceHeader = 0xd0;
+    const size_t kCodeAuxTableSize = 16;
+
+    typedef uint32_t VertexFifo[16];
+    typedef uint32_t EdgeFifo[16][2];
+
+    static size_t GetVertexBlockSize(size_t stride)
+    {
+        size_t result = (kVertexBlockSizeBytes / stride) & ~(kByteGroupSize - 1);
+        return std::min(result, kVertexBlockMaxSize);
+    }
+
+    static inline uint8_t Unzigzag8(uint8_t v)
+    {
+        return (uint8_t)(-(v & 1) ^ (v >> 1));
+    }
+
+    static const uint8_t* DecodeBytesGroup(const uint8_t* data, uint8_t* buffer, int bitsLog2)
+    {
+        switch (bitsLog2)
+        {
+        case 0:
+            std::memset(buffer, 0, kByteGroupSize);
+            return data;
+        case 1:
+        case 2:
+        {
+            // Codes are packed from the most significant bits down; the widest code escapes to the next extra byte.
+            const int bits = 1 << bitsLog2;
+            const uint8_t escape = (uint8_t)((1 << bits) - 1);
+            const uint8_t* extra = data + kByteGroupSize * bits / 8;
+            for (size_t i = 0; i < kByteGroupSize; ++i)
+            {
+                uint8_t code = (uint8_t)((data[i * bits / 8] >> (8 - bits - (i * bits) % 8)) & escape);
+                buffer[i] = code == escape ? *extra++ : code;
+            }
+            return extra;
+        }
+        default:
+            std::memcpy(buffer, data, kByteGroupSize);
+            return data + kByteGroupSize;
+        }
+    }
+
+    static const uint8_t* DecodeBytes(const uint8_t* data, const uint8_t* dataEnd, uint8_t* buffer, size_t size)
+    {
+        // Two header bits per group pick its width
+        const size_t headerSize = (size / kByteGroupSize + 3) / 4;
+        if ((size_t)(dataEnd - data) < headerSize)
+            return nullptr;
+
+        const uint8_t* header = data;
+        data += headerSize;
+
+        for (size_t i = 0; i < size; i += kByteGroupSize)
+        {
+            // The tail after the last block guarantees this much slack for every valid stream
+            if ((size_t)(dataEnd - data) < kByteGroupDecodeLimit)
+                return nullptr;
+
+            const size_t group = i / kByteGroupSize;
+            const int bitsLog2 = (header[group / 4] >> ((group % 4) * 2)) & 3;
+            data = DecodeBytesGroup(data, buffer + i, bitsLog2);
+        }
+
+        return data;
+    }
+
+    static const uint8_t* DecodeVertexBlock(const uint8_t* data, const uint8_t* dataEnd, uint8_t* destination,
+        size_t count, size_t stride, uint8_t lastVertex[256])
+    {
+        const size_t alignedCount = (count + kByteGroupSize - 1) & ~(kByteGroupSize - 1);
+
+        uint8_t deltas[kVertexBlockMaxSize];
+        uint8_t transposed[kVertexBlockSizeBytes];
+
+        for (size_t k = 0; k < stride; ++k)
+        {
+            data = DecodeBytes(data, dataEnd, deltas, alignedCount);
+            if (data == nullptr)
+                return nullptr;
+
+            uint8_t previous = lastVertex[k];
+            for (size_t i = 0; i < count; ++i)
+            {
+                previous = (uint8_t)(previous + Unzigzag8(deltas[i]));
+                transposed[i * stride + k] = previous;
+            }
+        }
+
+        std::memcpy(destination, transposed, count * stride);
+        std::memcpy(lastVertex, transposed + (count - 1) * stride, stride);
+        return data;
+    }
+
+    bool DecodeVertexBuffer(void* destination, size_t count, size_t stride, const uint8_t* buffer, size_t size)
+    {
+        if (stride == 0 || stride > 256 || stride % 4 != 0)
+            return false;
+
+        const size_t tailSize = std::max(stride, kTailMinSize);
+        if (size < 1 + tailSize)
+            return false;
+
+        // Only version 0 of the codec exists in files written for the extension
+        if (buffer[0] != kVertexHeader)
+            return false;
+
+        const uint8_t* data = buffer + 1;
+        const uint8_t* dataEnd = buffer + size;
+
+        // The stream ends with the first vertex, which is the baseline for the first deltas
+        uint8_t lastVertex[256];
+        std::memcpy(lastVertex, dataEnd - stride, stride);
+
+        const size_t blockSize = GetVertexBlockSize(stride);
+        uint8_t* output = (uint8_t*)destination;
+
+        for (size_t offset = 0; offset < count; offset += blockSize)
+        {
+            const size_t blockCount = std::min(blockSize, count - offset);
+            data = DecodeVertexBlock(data, dataEnd, output + offset * stride, blockCount, stride, lastVertex);
+            if (data == nullptr)
+                return false;
+        }
+
+        return (size_t)(dataEnd - data) == tailSize;
+    }
+
+    static inline uint32_t DecodeVByte(const uint8_t*& data)
+    {
+        uint8_t lead = *data++;
+        if (lead < 128)
+            return lead;
+
+        uint32_t result = lead & 127;
+        uint32_t shift = 7;
+        for (int i = 0; i < 4; ++i)
+        {
+            uint8_t group = *data++;
+            result |= (uint32_t)(group & 127) << shift;
+            shift += 7;
+            if (group < 128)
+                break;
+        }
+        return result;
+    }
+
+    static inline uint32_t DecodeIndex(const uint8_t*& data, uint32_t last)
+    {
+        uint32_t v = DecodeVByte(data);
+        uint32_t delta = (v >> 1) ^ (uint32_t)-(int32_t)(v & 1);
+        return last + delta;
+    }
+
+    static inline void PushVertexFifo(VertexFifo fifo, uint32_t v, size_t& offset, bool push = true)
+    {
+        fifo[offset] = v;
+        offset = (offset + (push ? 1 : 0)) & 15;
+    }
+
+    static inline void PushEdgeFifo(EdgeFifo fifo, uint32_t a, uint32_t b, size_t& offset)
+    {
+        fifo[offset][0] = a;
+        fifo[offset][1] = b;
+        offset = (offset + 1) & 15;
+    }
+
+    static inline void WriteIndex(void* destination, size_t i, size_t indexSize, uint32_t index)
+    {
+        if (indexSize == 2)
+            ((uint16_t*)destination)[i] = (uint16_t)index;
+        else
+            ((uint32_t*)destination)[i] = index;
+    }
+
+    static inline void WriteTriangle(void* destination, size_t i, size_t indexSize, uint32_t a, uint32_t b, uint32_t c)
+    {
+        WriteIndex(destination, i + 0, indexSize, a);
+        WriteIndex(destination, i + 1, indexSize, b);
+        WriteIndex(destination, i + 2, indexSize, c);
+    }
+
+    bool DecodeIndexBuffer(void* destination, size_t count, size_t indexSize, const uint8_t* buffer, size_t size)
+    {
+        if (count % 3 != 0 || (indexSize != 2 && indexSize != 4))
+            return false;
+
+        // The smallest valid stream has the header, a code per triangle and the code table
+        if (size < 1 + count / 3 + kCodeAuxTableSize)
+            return false;
+
+        if ((buffer[0] & 0xf0) != kIndexHeader)
+            return false;
+
+        const int version = buffer[0] & 0x0f;
+        if (version > 1)
+            return false;
+
+        EdgeFifo edgeFifo;
+        std::memset(edgeFifo, -1, sizeof(edgeFifo));
+        VertexFifo vertexFifo;
+        std::memset(vertexFifo, -1, sizeof(vertexFifo));
+        size_t edgeFifoOffset = 0;
+        size_t vertexFifoOffset = 0;
+
+        uint32_t next = 0;
+        uint32_t last = 0;
+
+        // Version 1 spends codes 13 and 14 on free vertices one below or above the last one
+        const int fecMax = version >= 1 ? 13 : 15;
+
+        const uint8_t* code = buffer + 1;
+        const uint8_t* data = code + count / 3;
+        const uint8_t* dataSafeEnd = buffer + size - kCodeAuxTableSize;
+        const uint8_t* codeAuxTable = dataSafeEnd;
+
+        for (size_t i = 0; i < count; i += 3)
+        {
+            // A triangle reads at most 16 bytes of data (an aux code and three 5-byte indices), and the code table
+            // after the data leaves room for that, so a single check per triangle keeps every read in bounds.
+            if (data > dataSafeEnd)
+                return false;
+
+            const uint8_t codeTri = *code++;
+
+            if (codeTri < 0xf0)
+            {
+                // Edge from the FIFO plus a third vertex that is recent, next, or free
+                const int fe = codeTri >> 4;
+                const uint32_t a = edgeFifo[(edgeFifoOffset - 1 - fe) & 15][0];
+                const uint32_t b = edgeFifo[(edgeFifoOffset - 1 - fe) & 15][1];
+                const int fec = codeTri & 15;
+
+                if (fec < fecMax)
+                {
+                    const uint32_t c = fec == 0 ? next : vertexFifo[(vertexFifoOffset - 1 - fec) & 15];
+                    next += fec == 0 ? 1 : 0;
+
+                    WriteTriangle(destination, i, indexSize, a, b, c);
+
+                    PushVertexFifo(vertexFifo, c, vertexFifoOffset, fec == 0);
+                    PushEdgeFifo(edgeFifo, c, b, edgeFifoOffset);
+                    PushEdgeFifo(edgeFifo, a, c, edgeFifoOffset);
+                }
+                else
+                {
+                    // 13 and 14 step the last free index by -1 and +1, 15 reads a delta
+                    const uint32_t c = fec != 15 ? last + (fec == 13 ? -1 : 1) : DecodeIndex(data, last);
+                    last = c;
+
+                    WriteTriangle(destination, i, indexSize, a, b, c);
+
+                    PushVertexFifo(vertexFifo, c, vertexFifoOffset);
+                    PushEdgeFifo(edgeFifo, c, b, edgeFifoOffset);
+                    PushEdgeFifo(edgeFifo, a, c, edgeFifoOffset);
+                }
+            }
+            else if (codeTri < 0xfe)
+            {
+                // New triangle starting at next, the other two vertices described by an entry of the code table
+                const uint8_t codeAux = codeAuxTable[codeTri & 15];
+                const int feb = codeAux >> 4;
+                const int fec = codeAux & 15;
+
+                const uint32_t a = next++;
+                const uint32_t b = feb == 0 ? next : vertexFifo[(vertexFifoOffset - feb) & 15];
+                next += feb == 0 ? 1 : 0;
+                const uint32_t c = fec == 0 ? next : vertexFifo[(vertexFifoOffset - fec) & 15];
+                next += fec == 0 ? 1 : 0;
+
+                WriteTriangle(destination, i, indexSize, a, b, c);
+
+                PushVertexFifo(vertexFifo, a, vertexFifoOffset);
+                PushVertexFifo(vertexFifo, b, vertexFifoOffset, feb == 0);
+                PushVertexFifo(vertexFifo, c, vertexFifoOffset, fec == 0);
+                PushEdgeFifo(edgeFifo, b, a, edgeFifoOffset);
+                PushEdgeFifo(edgeFifo, c, b, edgeFifoOffset);
+                PushEdgeFifo(edgeFifo, a, c, edgeFifoOffset);
+            }
+            else
+            {
+                // New triangle with its aux code in the data; 0xff makes the first vertex free as well
+                const uint8_t codeAux = *data++;
+                const int fea = codeTri == 0xfe ? 0 : 15;
+                const int feb = codeAux >> 4;
+                const int fec = codeAux & 15;
+
+                // An aux code of 0 outside the table restarts the next index
+                if (codeAux == 0)
+                    next = 0;
+
+                uint32_t a = fea == 0 ? next++ : 0;
+                uint32_t b = feb == 0 ? next++ : vertexFifo[(vertexFifoOffset - feb) & 15];
+                uint32_t c = fec == 0 ? next++ : vertexFifo[(vertexFifoOffset - fec) & 15];
+
+                if (fea == 15)
+                    last = a = DecodeIndex(data, last);
+                if (feb == 15)
+                    last = b = DecodeIndex(data, last);
+                if (fec == 15)
+                    last = c = DecodeIndex(data, last);
+
+                WriteTriangle(destination, i, indexSize, a, b, c);
+
+                PushVertexFifo(vertexFifo, a, vertexFifoOffset);
+                PushVertexFifo(vertexFifo, b, vertexFifoOffset, feb == 0 || feb == 15);
+                PushVertexFifo(vertexFifo, c, vertexFifoOffset, fec == 0 || fec == 15);
+                PushEdgeFifo(edgeFifo, b, a, edgeFifoOffset);
+                PushEdgeFifo(edgeFifo, c, b, edgeFifoOffset);
+                PushEdgeFifo(edgeFifo, a, c, edgeFifoOffset);
+            }
+        }
+
+        // Every data byte must have been consumed, up to the code table
+        return data == dataSafeEnd;
+    }
+
+    bool DecodeIndexSequence(void* destination, size_t count, size_t indexSize, const uint8_t* buffer, size_t size)
+    {
+        if (indexSize != 2 && indexSize != 4)
+            return false;
+
+        // Header, at least a byte per index and a 4-byte tail
+        if (size < 1 + count + 4)
+            return false;
+
+        if ((buffer[0] & 0xf0) != kSequenceHeader)
+            return false;
+
+        const int version = buffer[0] & 0x0f;
+        if (version > 1)
+            return false;
+
+        const uint8_t* data = buffer + 1;
+        const uint8_t* dataSafeEnd = buffer + size - 4;
+
+        // Indices are deltas from one of two baselines, picked by the low bit, so that interleaved runs of two
+        // sequences (as in lines or strips of a grid) both stay small.
+        uint32_t last[2] = {};
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            // An index reads at most 5 bytes, which the tail leaves room for
+            if (data >= dataSafeEnd)
+                return false;
+
+            uint32_t v = DecodeVByte(data);
+            const uint32_t current = v & 1;
+            v >>= 1;
+
+            const uint32_t delta = (v >> 1) ^ (uint32_t)-(int32_t)(v & 1);
+            const uint32_t index = last[current] + delta;
+            last[current] = index;
+
+            WriteIndex(destination, i, indexSize, index);
+        }
+
+        return data == dataSafeEnd;
+    }
+
+    template <typename T>
+    static void DecodeOctahedral(T* data, size_t count)
+    {
+        const float maxValue = float((1 << (sizeof(T) * 8 - 1)) - 1);
+
+        for (size_t i = 0; i < count * 4; i += 4)
+        {
+            // The third component holds 1.0 at the precision of the encoding, which recovers z
+            float x = float(data[i + 0]);
+            float y = float(data[i + 1]);
+            float z = float(data[i + 2]) - std::fabs(x) - std::fabs(y);
+
+            // Unfold the lower hemisphere
+            const float t = std::min(z, 0.0f);
+            x += x >= 0.0f ? t : -t;
+            y += y >= 0.0f ? t : -t;
+
+            const float length = std::sqrt(x * x + y * y + z * z);
+            const float s = length > 0.0f ? maxValue / length : 0.0f;
+
+            data[i + 0] = T(int(x * s + (x >= 0.0f ? 0.5f : -0.5f)));
+            data[i + 1] = T(int(y * s + (y >= 0.0f ? 0.5f : -0.5f)));
+            data[i + 2] = T(int(z * s + (z >= 0.0f ? 0.5f : -0.5f)));
+        }
+    }
+
+    bool DecodeFilterOctahedral(void* data, size_t count, size_t stride)
+    {
+        if (stride == 4)
+            DecodeOctahedral((int8_t*)data, count);
+        else if (stride == 8)
+            DecodeOctahedral((int16_t*)data, count);
+        else
+            return false;
+        return true;
+    }
+
+    bool DecodeFilterQuaternion(void* data, size_t count, size_t stride)
+    {
+        if (stride != 8)
+            return false;
+
+        int16_t* q = (int16_t*)data;
+        const float scale = 1.0f / std::sqrt(2.0f);
+
+        for (size_t i = 0; i < count * 4; i += 4)
+        {
+            // The fourth component holds the quantization scale with the index of the dropped (largest) component in
+            // its two low bits. The other three are stored in rotated order, scaled by sqrt(2) to use the full range.
+            const int sf = q[i + 3] | 3;
+            const float ss = scale / float(sf);
+
+            const float x = float(q[i + 0]) * ss;
+            const float y = float(q[i + 1]) * ss;
+            const float z = float(q[i + 2]) * ss;
+            const float ww = 1.0f - x * x - y * y - z * z;
+            const float w = std::sqrt(std::max(ww, 0.0f));
+
+            const int qc = q[i + 3] & 3;
+            q[i + ((qc + 1) & 3)] = int16_t(int(x * 32767.0f + (x >= 0.0f ? 0.5f : -0.5f)));
+            q[i + ((qc + 2) & 3)] = int16_t(int(y * 32767.0f + (y >= 0.0f ? 0.5f : -0.5f)));
+            q[i + ((qc + 3) & 3)] = int16_t(int(z * 32767.0f + (z >= 0.0f ? 0.5f : -0.5f)));
+            q[i + ((qc + 0) & 3)] = int16_t(int(w * 32767.0f + 0.5f));
+        }
+
+        return true;
+    }
+
+    bool DecodeFilterExponential(void* data, size_t count, size_t stride)
+    {
+        if (stride == 0 || stride % 4 != 0)
+            return false;
+
+        // Each word is a 24-bit signed mantissa under an 8-bit signed exponent
+        uint32_t* words = (uint32_t*)data;
+        for (size_t i = 0; i < count * stride / 4; ++i)
+        {
+            const uint32_t v = words[i];
+            const int32_t mantissa = (int32_t)(v << 8) >> 8;
+            const int32_t exponent = (int32_t)v >> 24;
+
+            const float f = std::ldexp((float)mantissa, exponent);
+            std::memcpy(&words[i], &f, sizeof(f));
+        }
+
+        return true;
+    }
+}
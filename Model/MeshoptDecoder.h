@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Decoders for the bitstreams of the EXT_meshopt_compression glTF extension: vertex attributes, triangle lists and
+// index sequences, plus the filters that undo octahedral, quaternion and exponential encodings. Each decoder checks
+// the stream against its bounds and returns false on malformed or truncated data, leaving the output undefined.
+namespace MeshoptDecoder
+{
+    // Mode ATTRIBUTES: count elements of stride bytes, which must be a multiple of 4 up to 256.
+    bool DecodeVertexBuffer(void* destination, size_t count, size_t stride, const uint8_t* buffer, size_t size);
+
+    // Mode TRIANGLES: count must be a multiple of 3 and indexSize 2 or 4.
+    bool DecodeIndexBuffer(void* destination, size_t count, size_t indexSize, const uint8_t* buffer, size_t size);
+
+    // Mode INDICES: any list of indices, indexSize 2 or 4.
+    bool DecodeIndexSequence(void* destination, size_t count, size_t indexSize, const uint8_t* buffer, size_t size);
+
+    // Filters run in place after decoding. OCTAHEDRAL takes 4 signed bytes or shorts per element (stride 4 or 8) and
+    // turns them into a unit vector and the untouched fourth component. QUATERNION takes 4 shorts (stride 8) and
+    // turns them into a unit quaternion. EXPONENTIAL turns every 32-bit word into a float.
+    bool DecodeFilterOctahedral(void* data, size_t count, size_t stride);
+    bool DecodeFilterQuaternion(void* data, size_t count, size_t stride);
+    bool DecodeFilterExponential(void* data, size_t count, size_t stride);
+}
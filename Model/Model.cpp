@@ -14,9 +14,16 @@
 #include "Model.h"
 #include "Renderer.h"
 #include "ConstantBuffers.h"
+#include "../Core/GraphicsCore.h"
+#include "../Core/GraphicsCommon.h"
+#include "../Core/CommandListManager.h"
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
 
 using namespace Math;
 using namespace Renderer;
+using namespace Graphics;
 
 void Model::Destroy()
 {
@@ -27,23 +34,130 @@ void Model::Destroy()
     m_NumMeshes = 0;
     m_MeshData = nullptr;
     m_SceneGraph = nullptr;
+    m_Meshlets = nullptr;
+    m_MeshletRanges = nullptr;
+    m_Lods = nullptr;
+    m_LodRanges = nullptr;
+    m_FileMapping = nullptr;
+    m_MaterialTextures.clear();
+    m_MaterialTables.clear();
+}
+
+void Model::CopyTextureDescriptors(uint32_t materialIdx, uint32_t table) const
+{
+    const MaterialTextures& material = m_MaterialTextures[materialIdx];
+
+    static const eDefaultTexture kDefaultTextures[kNumTextures] =
+    {
+        kWhiteOpaque2D, kWhiteOpaque2D, kWhiteOpaque2D, kBlackTransparent2D, kDefaultNormalMap
+    };
+
+    D3D12_CPU_DESCRIPTOR_HANDLE SourceTextures[kNumTextures];
+    for (uint32_t j = 0; j < kNumTextures; ++j)
+    {
+        if (material.textureIdx[j] == 0xffff)
+            SourceTextures[j] = GetDefaultTexture(kDefaultTextures[j]);
+        else
+            SourceTextures[j] = textures[material.textureIdx[j]].GetSRV();
+    }
+
+    uint32_t DestCount = kNumTextures;
+    uint32_t SourceCounts[kNumTextures] = { 1, 1, 1, 1, 1 };
+    D3D12_CPU_DESCRIPTOR_HANDLE TableHandle = s_TextureHeap[material.srvTables[table]];
+    g_Device->CopyDescriptors(1, &TableHandle, &DestCount,
+        DestCount, SourceTextures, SourceCounts, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+}
+
+void Model::UpdateTextureDescriptors() const
+{
+    const uint32_t generation = TextureManager::GetStreamingGeneration();
+    if (generation == m_TextureGeneration || m_MaterialTextures.empty())
+        return;
+
+    // The spare tables were current until the last switch, and frames recorded before then may still be drawing
+    // with them. The streamer waits for those frames before it swaps in more textures, so this is rarely put off.
+    if (!g_CommandManager.IsFenceComplete(m_TextureTableFence))
+        return;
+
+    // Only the materials with a texture that got a new SRV since the tables were written switch tables.
+    const uint32_t numMaterials = (uint32_t)m_MaterialTextures.size();
+    m_MaterialTables.resize(numMaterials, 0);
+    std::vector<uint8_t> switched(numMaterials, 0);
+    bool anySwitched = false;
+    for (uint32_t i = 0; i < numMaterials; ++i)
+    {
+        const MaterialTextures& material = m_MaterialTextures[i];
+        for (uint32_t j = 0; j < kNumTextures && !switched[i]; ++j)
+        {
+            const uint16_t textureIdx = material.textureIdx[j];
+            if (textureIdx != 0xffff && textures[textureIdx].GetSRVGeneration() > m_TextureGeneration)
+                switched[i] = 1;
+        }
+        if (!switched[i])
+            continue;
+
+        m_MaterialTables[i] ^= 1;
+        CopyTextureDescriptors(i, m_MaterialTables[i]);
+        anySwitched = true;
+    }
+
+    m_TextureGeneration = generation;
+    if (!anySwitched)
+        return;
+
+    uint8_t* pMesh = m_MeshData;
+    for (uint32_t i = 0; i < m_NumMeshes; ++i)
+    {
+        Mesh& mesh = *(Mesh*)pMesh;
+        if (switched[mesh.materialCBV])
+            mesh.srvTable = m_MaterialTextures[mesh.materialCBV].srvTables[m_MaterialTables[mesh.materialCBV]];
+        pMesh += sizeof(Mesh) + (mesh.numDraws - 1) * sizeof(Mesh::Draw);
+    }
+
+    m_TextureTableFence = g_CommandManager.GetGraphicsQueue().GetNextFenceValue() - 1;
 }
 
 void Model::Render(
     MeshSorter& sorter,
     const GpuBuffer& meshConstants,
     const ScaleAndTranslation sphereTransforms[],
+    const Matrix4 nodeTransforms[],
     const Joint* skeleton ) const
 {
     // Pointer to current mesh
-    const uint8_t* pMesh = m_MeshData.get();
+    const uint8_t* pMesh = m_MeshData;
 
     const Frustum& frustum = sorter.GetViewFrustum();
     const AffineTransform& viewMat = (const AffineTransform&)sorter.GetViewMatrix();
 
+#if DISABLE_FRUSTUM_CULL
+    const bool cullClusters = false;
+#else
+    const bool cullClusters = ClusterCulling && m_MeshletRanges != nullptr && nodeTransforms != nullptr &&
+        sorter.GetClusterCulling() != MeshSorter::kCullMeshes;
+#endif
+    // Pixels covered by one unit of length at clip space w = 1, scaled so that errors below 1 are acceptable.
+    const Matrix4& proj = sorter.GetProjMatrix();
+    const float lodPixelsPerUnit = MeshLODs && m_LodRanges != nullptr ?
+        proj.GetY().GetY() * sorter.GetTargetHeight() * 0.5f / (float)LODPixelError : 0.0f;
+
+    // Streamed textures are sized by how many pixels tall their meshes' bounds appear in the main view, as if the
+    // UVs spanned each texture once.
+    const float texturePixelsPerUnit = sorter.GetBatchType() == MeshSorter::kDefault && TextureManager::IsStreamingEnabled() ?
+        proj.GetY().GetY() * sorter.GetTargetHeight() : 0.0f;
+
+    // The largest size each texture is seen at, handed to the streamer in one go once every mesh is done.
+    std::vector<float> texturePixels(texturePixelsPerUnit > 0.0f ? textures.size() : 0, 0.0f);
+
+    std::vector<MeshletSpan> spans;
+    std::vector<MeshSorter::DrawRange> clusterDraws;
+    uint32_t firstDraw = 0;
+
     for (uint32_t i = 0; i < m_NumMeshes; ++i)
     {
         const Mesh& mesh = *(const Mesh*)pMesh;
+        const uint32_t meshFirstDraw = firstDraw;
+        firstDraw += mesh.numDraws;
 
         const ScaleAndTranslation& sphereXform = sphereTransforms[mesh.meshCBV];
         BoundingSphere sphereLS((const XMFLOAT4*)mesh.bounds);
@@ -56,14 +170,110 @@ void Model::Render(
 #endif
         {
             float distance = -sphereVS.GetCenter().GetZ() - sphereVS.GetRadius();
-            sorter.AddMesh(mesh, distance,
-                meshConstants.GetGpuVirtualAddress() + sizeof(MeshConstants) * mesh.meshCBV,
-                m_MaterialConstants.GetGpuVirtualAddress() + sizeof(MaterialConstants) * mesh.materialCBV,
-                m_DataBuffer.GetGpuVirtualAddress(), skeleton);
+            const Scalar scale = sphereXform.GetScale();
+
+            // The coarsest LOD whose error projects to no more than LODPixelError pixels is drawn. Clip space w is
+            // linear in view space depth for both kinds of projection, so measuring at the nearest point of the
+            // bounds works for shadow and voxel cameras too.
+            float maxLodError = 0.0f;
+            if (lodPixelsPerUnit > 0.0f)
+            {
+                const float nearestW = proj.GetZ().GetW() * (sphereVS.GetCenter().GetZ() + sphereVS.GetRadius()) + proj.GetW().GetW();
+                if (nearestW > 0.0f)
+                    maxLodError = nearestW / (scale * lodPixelsPerUnit);
+            }
+
+            if (texturePixelsPerUnit > 0.0f)
+            {
+                const float nearestW = proj.GetZ().GetW() * (sphereVS.GetCenter().GetZ() + sphereVS.GetRadius()) + proj.GetW().GetW();
+                const float pixels = nearestW > 0.0f ? sphereVS.GetRadius() * texturePixelsPerUnit / nearestW : FLT_MAX;
+                const MaterialTextures& material = m_MaterialTextures[mesh.materialCBV];
+                for (uint32_t j = 0; j < kNumTextures; ++j)
+                {
+                    if (material.textureIdx[j] != 0xffff)
+                        texturePixels[material.textureIdx[j]] = std::max(texturePixels[material.textureIdx[j]], pixels);
+                }
+            }
+
+            // Skinned vertices move away from the bounds they were built with, so those meshes are culled whole.
+            const bool cullMeshClusters = cullClusters && mesh.numJoints == 0;
+
+            if (!cullMeshClusters && maxLodError == 0.0f)
+            {
+                sorter.AddMesh(mesh, distance,
+                    meshConstants.GetGpuVirtualAddress() + sizeof(MeshConstants) * mesh.meshCBV,
+                    m_MaterialConstants.GetGpuVirtualAddress() + sizeof(MaterialConstants) * mesh.materialCBV,
+                    m_DataBuffer.GetGpuVirtualAddress(), skeleton);
+            }
+            else
+            {
+                Matrix4 localToView;
+                Vector3 eyeLS;
+                bool cullBackfaces = false;
+                if (cullMeshClusters)
+                {
+                    const Matrix4& localToWorld = nodeTransforms[mesh.meshCBV];
+                    localToView = sorter.GetViewMatrix() * localToWorld;
+
+                    // Both faces of two-sided and alpha-tested materials are drawn, so only the frustum applies to them.
+                    cullBackfaces = sorter.GetClusterCulling() == MeshSorter::kCullClustersAndBackfaces &&
+                        (mesh.psoFlags & (PSOFlags::kTwoSided | PSOFlags::kAlphaTest)) == 0;
+                    if (cullBackfaces)
+                        eyeLS = Vector3(Invert(localToWorld) * sorter.GetCameraPosition());
+                }
+
+                clusterDraws.clear();
+                for (uint32_t d = 0; d < mesh.numDraws; ++d)
+                {
+                    const Mesh::Draw& draw = mesh.draw[d];
+
+                    const MeshLod* lod = nullptr;
+                    if (maxLodError > 0.0f)
+                    {
+                        const MeshLodRange& lodRange = m_LodRanges[meshFirstDraw + d];
+                        for (uint32_t k = lodRange.count; lod == nullptr && k-- > 0; )
+                        {
+                            if (m_Lods[lodRange.first + k].error <= maxLodError)
+                                lod = &m_Lods[lodRange.first + k];
+                        }
+                    }
+
+                    // Reduced levels are drawn whole; their triangles don't match the meshlets.
+                    if (lod != nullptr)
+                    {
+                        clusterDraws.push_back({ lod->primCount, draw.startIndex + lod->startIndex, draw.baseVertex, draw.depthBaseVertex });
+                        continue;
+                    }
+
+                    const MeshletRange* meshlets = cullMeshClusters ? &m_MeshletRanges[meshFirstDraw + d] : nullptr;
+                    if (meshlets == nullptr || meshlets->count == 0)
+                    {
+                        clusterDraws.push_back({ draw.primCount, draw.startIndex, draw.baseVertex, draw.depthBaseVertex });
+                        continue;
+                    }
+
+                    spans.clear();
+                    Meshlets::Cull(m_Meshlets + meshlets->first, meshlets->count, localToView, scale, frustum,
+                        cullBackfaces ? &eyeLS : nullptr, spans);
+                    for (const MeshletSpan& span : spans)
+                        clusterDraws.push_back({ span.primCount, draw.startIndex + span.startIndex, draw.baseVertex, draw.depthBaseVertex });
+                }
+
+                if (!clusterDraws.empty())
+                {
+                    sorter.AddMesh(mesh, distance,
+                        meshConstants.GetGpuVirtualAddress() + sizeof(MeshConstants) * mesh.meshCBV,
+                        m_MaterialConstants.GetGpuVirtualAddress() + sizeof(MaterialConstants) * mesh.materialCBV,
+                        m_DataBuffer.GetGpuVirtualAddress(), skeleton, clusterDraws.data(), (uint32_t)clusterDraws.size());
+                }
+            }
         }
 
         pMesh += sizeof(Mesh) + (mesh.numDraws - 1) * sizeof(Mesh::Draw);
     }
+
+    if (!texturePixels.empty())
+        TextureManager::ReportScreenSizes(textures.data(), texturePixels.data(), (uint32_t)texturePixels.size());
 }
 
 void ModelInstance::Render(MeshSorter& sorter) const
@@ -72,7 +282,7 @@ void ModelInstance::Render(MeshSorter& sorter) const
     {
         //const Frustum& frustum = sorter.GetWorldFrustum();
         m_Model->Render(sorter, m_MeshConstantsGPU, (const ScaleAndTranslation*)m_BoundingSphereTransforms.get(),
-            m_Skeleton.get());
+            m_NodeTransforms.get(), m_Skeleton.get());
     }
 }
 
@@ -85,6 +295,7 @@ ModelInstance::ModelInstance( std::shared_ptr<const Model> sourceModel )
         m_MeshConstantsCPU.Destroy();
         m_MeshConstantsGPU.Destroy();
         m_BoundingSphereTransforms = nullptr;
+        m_NodeTransforms = nullptr;
         m_AnimGraph = nullptr;
         m_AnimState.clear();
         m_Skeleton = nullptr;
@@ -94,12 +305,14 @@ ModelInstance::ModelInstance( std::shared_ptr<const Model> sourceModel )
         m_MeshConstantsCPU.Create(L"Mesh Constant Upload Buffer", sourceModel->m_NumNodes * sizeof(MeshConstants));
         m_MeshConstantsGPU.Create(L"Mesh Constant GPU Buffer", sourceModel->m_NumNodes, sizeof(MeshConstants));
         m_BoundingSphereTransforms.reset(new __m128[sourceModel->m_NumNodes]);
+        m_NodeTransforms.reset(new Matrix4[sourceModel->m_NumNodes]);
+        std::fill(m_NodeTransforms.get(), m_NodeTransforms.get() + sourceModel->m_NumNodes, Matrix4(kIdentity));
         m_Skeleton.reset(new Joint[sourceModel->m_NumJoints]);
 
         if (sourceModel->m_NumAnimations > 0)
         {
             m_AnimGraph.reset(new GraphNode[sourceModel->m_NumNodes]);
-            std::memcpy(m_AnimGraph.get(), sourceModel->m_SceneGraph.get(), sourceModel->m_NumNodes * sizeof(GraphNode));
+            std::memcpy(m_AnimGraph.get(), sourceModel->m_SceneGraph, sourceModel->m_NumNodes * sizeof(GraphNode));
             m_AnimState.resize(sourceModel->m_NumAnimations);
         }
         else
@@ -124,6 +337,7 @@ ModelInstance& ModelInstance::operator=( std::shared_ptr<const Model> sourceMode
         m_MeshConstantsCPU.Destroy();
         m_MeshConstantsGPU.Destroy();
         m_BoundingSphereTransforms = nullptr;
+        m_NodeTransforms = nullptr;
         m_AnimGraph = nullptr;
         m_AnimState.clear();
         m_Skeleton = nullptr;
@@ -133,12 +347,14 @@ ModelInstance& ModelInstance::operator=( std::shared_ptr<const Model> sourceMode
         m_MeshConstantsCPU.Create(L"Mesh Constant Upload Buffer", sourceModel->m_NumNodes * sizeof(MeshConstants));
         m_MeshConstantsGPU.Create(L"Mesh Constant GPU Buffer", sourceModel->m_NumNodes, sizeof(MeshConstants));
         m_BoundingSphereTransforms.reset(new __m128[sourceModel->m_NumNodes]);
+        m_NodeTransforms.reset(new Matrix4[sourceModel->m_NumNodes]);
+        std::fill(m_NodeTransforms.get(), m_NodeTransforms.get() + sourceModel->m_NumNodes, Matrix4(kIdentity));
         m_Skeleton.reset(new Joint[sourceModel->m_NumJoints]);
 
         if (sourceModel->m_NumAnimations > 0)
         {
             m_AnimGraph.reset(new GraphNode[sourceModel->m_NumNodes]);
-            std::memcpy(m_AnimGraph.get(), sourceModel->m_SceneGraph.get(), sourceModel->m_NumNodes * sizeof(GraphNode));
+            std::memcpy(m_AnimGraph.get(), sourceModel->m_SceneGraph, sourceModel->m_NumNodes * sizeof(GraphNode));
             m_AnimState.resize(sourceModel->m_NumAnimations);
         }
         else
@@ -155,6 +371,8 @@ void ModelInstance::Update(GraphicsContext& gfxContext, float deltaTime)
     if (m_Model == nullptr)
         return;
 
+    m_Model->UpdateTextureDescriptors();
+
     static const size_t kMaxStackDepth = 32;
 
     size_t stackIdx = 0;
@@ -164,8 +382,13 @@ void ModelInstance::Update(GraphicsContext& gfxContext, float deltaTime)
     ScaleAndTranslation* boundingSphereTransforms = (ScaleAndTranslation*)m_BoundingSphereTransforms.get();
     MeshConstants* cb = (MeshConstants*)m_MeshConstantsCPU.Map();
 
+    // Last frame's world transforms, to tell which nodes the animations moved.
+    std::vector<Matrix4> previousTransforms;
+    m_AnimatedBounds.clear();
+
     if (m_AnimGraph)
     {
+        previousTransforms.assign(m_NodeTransforms.get(), m_NodeTransforms.get() + m_Model->m_NumNodes);
         UpdateAnimations(deltaTime);
 
         for (uint32_t i = 0; i < m_Model->m_NumNodes; ++i)
@@ -181,7 +404,7 @@ void ModelInstance::Update(GraphicsContext& gfxContext, float deltaTime)
         }
     }
 
-    const GraphNode* sceneGraph = m_AnimGraph ? m_AnimGraph.get() : m_Model->m_SceneGraph.get();
+    const GraphNode* sceneGraph = m_AnimGraph ? m_AnimGraph.get() : m_Model->m_SceneGraph;
 
     // Traverse the scene graph in depth first order.  This is the same as linear order
     // for how the nodes are stored in memory.  Uses a matrix stack instead of recursion.
@@ -204,6 +427,7 @@ void ModelInstance::Update(GraphicsContext& gfxContext, float deltaTime)
             Scalar scaleZSqr = LengthSquare((Vector3)xform.GetZ());
             Scalar sphereScale = Sqrt(Max(Max(scaleXSqr, scaleYSqr), scaleZSqr));
             boundingSphereTransforms[Node->matrixIdx] = ScaleAndTranslation((Vector3)xform.GetW(), sphereScale);
+            m_NodeTransforms[Node->matrixIdx] = xform;
         }
 
         // If the next node will be a descendent, replace the parent matrix with our new matrix
@@ -236,6 +460,9 @@ void ModelInstance::Update(GraphicsContext& gfxContext, float deltaTime)
         joint.nrmXform = InverseTranspose(joint.posXform.Get3x3());
     }
 
+    if (!previousTransforms.empty())
+        GatherAnimatedBounds(previousTransforms.data());
+
     m_MeshConstantsCPU.Unmap();
 
     gfxContext.TransitionResource(m_MeshConstantsGPU, D3D12_RESOURCE_STATE_COPY_DEST, true);
@@ -243,6 +470,57 @@ void ModelInstance::Update(GraphicsContext& gfxContext, float deltaTime)
     gfxContext.TransitionResource(m_MeshConstantsGPU, D3D12_RESOURCE_STATE_GENERIC_READ);
 }
 
+// Grows box by a bounding sphere, given as center and radius, under xform.
+static void AddSphereBounds(AxisAlignedBox& box, const float sphere[4], const Matrix4& xform)
+{
+    const Vector3 center = Vector3(xform * Vector3(sphere[0], sphere[1], sphere[2]));
+    const Scalar scaleSqr = Max(Max(LengthSquare((Vector3)xform.GetX()), LengthSquare((Vector3)xform.GetY())),
+        LengthSquare((Vector3)xform.GetZ()));
+    const Vector3 extent = Vector3(Sqrt(scaleSqr) * sphere[3]);
+    box.AddPoint(center - extent);
+    box.AddPoint(center + extent);
+}
+
+void ModelInstance::GatherAnimatedBounds(const Matrix4 previousTransforms[])
+{
+    auto Moved = [&](uint32_t matrixIdx)
+    {
+        return std::memcmp(&previousTransforms[matrixIdx], &m_NodeTransforms[matrixIdx], sizeof(Matrix4)) != 0;
+    };
+
+    const uint8_t* pMesh = m_Model->m_MeshData;
+    for (uint32_t i = 0; i < m_Model->m_NumMeshes; ++i)
+    {
+        const Mesh& mesh = *(const Mesh*)pMesh;
+        pMesh += sizeof(Mesh) + (mesh.numDraws - 1) * sizeof(Mesh::Draw);
+
+        bool moved = Moved(mesh.meshCBV);
+        for (uint32_t j = 0; j < mesh.numJoints && !moved; ++j)
+            moved = Moved(m_Model->m_JointIndices[mesh.startJoint + j]);
+        if (!moved)
+            continue;
+
+        // A skinned vertex is a blend of its joints' transforms of it, so it stays within the union of the bounds
+        // as each of the mesh's joints places them.
+        AxisAlignedBox bounds;
+        const Matrix4& previousWorld = previousTransforms[mesh.meshCBV];
+        const Matrix4& world = m_NodeTransforms[mesh.meshCBV];
+        if (mesh.numJoints == 0)
+        {
+            AddSphereBounds(bounds, mesh.bounds, previousWorld);
+            AddSphereBounds(bounds, mesh.bounds, world);
+        }
+        for (uint32_t j = 0; j < mesh.numJoints; ++j)
+        {
+            const uint32_t joint = mesh.startJoint + j;
+            const Matrix4 previousJoint = previousTransforms[m_Model->m_JointIndices[joint]] * m_Model->m_JointIBMs[joint];
+            AddSphereBounds(bounds, mesh.bounds, previousWorld * previousJoint);
+            AddSphereBounds(bounds, mesh.bounds, world * m_Skeleton[joint].posXform);
+        }
+        m_AnimatedBounds.push_back(bounds);
+    }
+}
+
 void ModelInstance::Resize( float newRadius )
 {
     if (m_Model == nullptr)
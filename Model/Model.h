@@ -14,6 +14,9 @@
 #pragma once
 
 #include "Animation.h"
+#include "ConstantBuffers.h"
+#include "Meshlet.h"
+#include "MeshSimplify.h"
 #include "../Core/GpuBuffer.h"
 #include "../Core/VectorMath.h"
 #include "../Core/Camera.h"
@@ -29,6 +32,11 @@ namespace Renderer
     class MeshSorter;
 }
 
+namespace Utility
+{
+    class FileMapping;
+}
+
 //
 // To request a PSO index, provide flags that describe the kind of PSO
 // you need.  If one has not yet been created, it will be created.
@@ -46,18 +54,22 @@ namespace PSOFlags
         kAlphaTest      = 0x040,
         kTwoSided       = 0x080,
         kHasSkin        = 0x100,  // Implies having indices and weights
+        kQuantizedPosition = 0x200,  // UNORM16 positions, see Mesh::positionScale
     };
 }
 
 struct Mesh
 {
     float    bounds[4];     // A bounding sphere
+    float    positionScale[3]; // Stored position * scale + bias is the position the bounds are in
+    float    positionBias[3];  // (1 and 0 unless the positions are quantized)
     uint32_t vbOffset;      // BufferLocation - Buffer.GpuVirtualAddress
     uint32_t vbSize;        // SizeInBytes
     uint32_t vbDepthOffset; // BufferLocation - Buffer.GpuVirtualAddress
     uint32_t vbDepthSize;   // SizeInBytes
     uint32_t ibOffset;      // BufferLocation - Buffer.GpuVirtualAddress
     uint32_t ibSize;        // SizeInBytes
+    uint32_t ibDepthOffset; // Of the depth-only index buffer, which shares ibSize and ibFormat
     uint8_t  vbStride;      // StrideInBytes
     uint8_t  ibFormat;      // DXGI_FORMAT
     uint16_t meshCBV;       // Index of mesh constant buffer
@@ -75,6 +87,7 @@ struct Mesh
         uint32_t primCount;   // Number of indices = 3 * number of triangles
         uint32_t startIndex;  // Offset to first index in index buffer 
         uint32_t baseVertex;  // Offset to first vertex in vertex buffer
+        uint32_t depthBaseVertex; // Offset to first vertex in depth vertex buffer
     };
     Draw draw[1];           // Actually 1 or more draws
 };
@@ -107,6 +120,7 @@ public:
     void Render(Renderer::MeshSorter& sorter,
         const GpuBuffer& meshConstants,
         const Math::ScaleAndTranslation sphereTransforms[],
+        const Math::Matrix4 nodeTransforms[],
         const Joint* skeleton) const;
 
     Math::BoundingSphere m_BoundingSphere; // Object-space bounding sphere
@@ -117,17 +131,46 @@ public:
     uint32_t m_NumMeshes;
     uint32_t m_NumAnimations;
     uint32_t m_NumJoints;
-    std::unique_ptr<uint8_t[]> m_MeshData;
-    std::unique_ptr<GraphNode[]> m_SceneGraph;
+    // These point into m_FileMapping, a copy-on-write view of the .mini file, except for m_KeyFrameData when the
+    // keyframes were stored compressed and had to be decoded into m_DecodedKeyFrames.
+    uint8_t* m_MeshData;
+    const GraphNode* m_SceneGraph;
     std::vector<TextureRef> textures;
-    std::unique_ptr<uint8_t[]> m_KeyFrameData;
-    std::unique_ptr<AnimationCurve[]> m_CurveData;
-    std::unique_ptr<AnimationSet[]> m_Animations;
-    std::unique_ptr<uint16_t[]> m_JointIndices;
-    std::unique_ptr<Math::Matrix4[]> m_JointIBMs;
+    const uint8_t* m_KeyFrameData;
+    const AnimationCurve* m_CurveData;
+    const AnimationSet* m_Animations;
+    const uint16_t* m_JointIndices;
+    const Math::Matrix4* m_JointIBMs;
+    const Meshlet* m_Meshlets;
+    const MeshletRange* m_MeshletRanges;    // One per Mesh::Draw, or null when the file has no meshlets
+    const MeshLod* m_Lods;
+    const MeshLodRange* m_LodRanges;        // One per Mesh::Draw, or null when the file has no LODs
+    std::shared_ptr<Utility::FileMapping> m_FileMapping;
+    std::unique_ptr<uint8_t[]> m_DecodedKeyFrames;
+
+    // Streamed textures get new SRVs as their mips come and go, so with texture streaming each material has two SRV
+    // tables: the one its meshes use, which the GPU may still be reading, and a spare that UpdateTextureDescriptors
+    // rewrites and switches to when one of the material's textures changed.
+    struct MaterialTextures
+    {
+        uint16_t textureIdx[kNumTextures];  // Into textures, or 0xffff for the default
+        uint16_t srvTables[2];              // Offsets into the SRV heap; the same twice without streaming
+    };
+    std::vector<MaterialTextures> m_MaterialTextures;
+
+    // Copies the SRVs of a material's textures into its table.
+    void CopyTextureDescriptors(uint32_t materialIdx, uint32_t table) const;
+
+    // Call once per frame before rendering. Does nothing unless streaming gave a texture a new SRV, and never waits
+    // for the GPU: while it may still be reading the spare tables, the switch is put off to a later frame.
+    void UpdateTextureDescriptors() const;
 
 protected:
     void Destroy();
+
+    mutable uint32_t m_TextureGeneration = 0;   // Of the texture streamer when the tables were last written
+    mutable std::vector<uint8_t> m_MaterialTables;  // Which of srvTables each material's meshes use
+    mutable uint64_t m_TextureTableFence = 0;   // Until which the spare tables may still be in use
 };
 
 class ModelInstance
@@ -154,6 +197,9 @@ public:
     Math::BoundingSphere GetBoundingSphere() const;
     Math::OrientedBox GetBoundingBox() const;
     Math::AxisAlignedBox ModelInstance::GetAxisAlignedBox() const;
+    // World-space bounds of each mesh the animations moved in the last Update, covering where it was and where it
+    // is now. Empty when nothing moved.
+    const std::vector<Math::AxisAlignedBox>& GetAnimatedBounds() const { return m_AnimatedBounds; }
 
     size_t GetNumAnimations(void) const { return m_AnimState.size(); }
     void PlayAnimation(uint32_t animIdx, bool loop);
@@ -164,13 +210,18 @@ public:
     void LoopAllAnimations(void);
 
 private:
+    // Fills m_AnimatedBounds with the meshes whose node or joints moved from previousTransforms.
+    void GatherAnimatedBounds(const Math::Matrix4 previousTransforms[]);
+
     std::shared_ptr<const Model> m_Model;
     UploadBuffer m_MeshConstantsCPU;
     ByteAddressBuffer m_MeshConstantsGPU;
     std::unique_ptr<__m128[]> m_BoundingSphereTransforms;
+    std::unique_ptr<Math::Matrix4[]> m_NodeTransforms;    // World matrices, for culling meshlets
     Math::UniformTransform m_Locator;
 
     std::unique_ptr<GraphNode[]> m_AnimGraph;   // A copy of the scene graph when instancing animation
     std::vector<AnimationState> m_AnimState;    // Per-animation (not per-curve)
     std::unique_ptr<Joint[]> m_Skeleton;
+    std::vector<Math::AxisAlignedBox> m_AnimatedBounds;
 };
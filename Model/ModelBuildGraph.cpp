@@ -0,0 +1,514 @@
+#include "ModelBuildGraph.h"
+#include "glTF.h"
+#include "ParallelFor.h"
+#include "../Core/Utility.h"
+#include "../Core/FileUtility.h"
+#include "../Core/Hash.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sys/stat.h>
+#include <thread>
+#include <type_traits>
+
+using namespace ModelBuildGraph;
+
+namespace
+{
+    const uint32_t kManifestVersion = 1;
+
+    struct ManifestHeader
+    {
+        char id[4];             // "MDEP"
+        uint32_t version;       // kManifestVersion
+        uint32_t miniVersion;
+        uint32_t numSources;
+        uint64_t miniSize;
+        int64_t miniModifiedTime;
+        int32_t sceneIdx;
+        uint32_t optionFlags;
+        uint64_t stageKeys[kNumStages];
+    };
+
+    // Followed by pathLength UTF-16 code units
+    struct SourceRecord
+    {
+        uint64_t size;
+        int64_t modifiedTime;
+        uint64_t hash;
+        uint32_t pathLength;
+        uint32_t padding;
+    };
+
+    enum OptionFlags
+    {
+        kQuantizePositions = 1,
+        kCompressTextures = 2,
+        kCompressFile = 4,
+    };
+
+    // Feeds values into a running hash in order.
+    class KeyBuilder
+    {
+    public:
+        explicit KeyBuilder(uint64_t seed = 0) : m_Hash(seed) {}
+
+        void Add(const void* data, size_t size) { m_Hash = Utility::HashBytes64(data, size, m_Hash); }
+
+        template <typename T>
+        void Add(const T& value)
+        {
+            static_assert(std::is_arithmetic<T>::value, "Only numbers are hashed by value");
+            Add(&value, sizeof(T));
+        }
+
+        void Add(const std::string& str)
+        {
+            Add((uint64_t)str.size());
+            Add(str.data(), str.size());
+        }
+
+        uint64_t Get() const { return m_Hash; }
+
+    private:
+        uint64_t m_Hash;
+    };
+
+    template <typename T>
+    int32_t IndexOf(const std::vector<T>& list, const T* element)
+    {
+        return element == nullptr ? -1 : (int32_t)(element - list.data());
+    }
+
+    // Keys are taken over the values an accessor reads as, so that moving data around a buffer, or storing it
+    // strided, sparse or packed, leaves them alone.
+    uint64_t HashAccessor(const glTF::Accessor& accessor)
+    {
+        KeyBuilder key;
+        key.Add(accessor.componentType);
+        key.Add(accessor.type);
+        key.Add(accessor.normalized);
+        key.Add(accessor.count);
+
+        const uint32_t elementSize = accessor.GetElementSize();
+        if (accessor.HasInPlaceData() && (accessor.stride == 0 || accessor.stride == elementSize))
+        {
+            key.Add(accessor.dataPtr, (size_t)accessor.count * elementSize);
+        }
+        else
+        {
+            std::vector<byte> elements;
+            glTF::ReadDenseElements(accessor, elements);
+            key.Add(elements.data(), elements.size());
+        }
+        return key.Get();
+    }
+
+    void AddNodeList(KeyBuilder& key, const glTF::Asset& asset, const std::vector<glTF::Node*>& nodes)
+    {
+        key.Add((uint32_t)nodes.size());
+        for (const glTF::Node* node : nodes)
+            key.Add(IndexOf(asset.m_nodes, node));
+    }
+
+    // The scene graph numbers nodes in the order the walk from the scene's roots visits them, and joints and
+    // animation targets are stored by those numbers.
+    uint64_t HashHierarchy(const glTF::Asset& asset, const glTF::Scene* scene)
+    {
+        KeyBuilder key;
+        key.Add(IndexOf(asset.m_scenes, scene));
+        AddNodeList(key, asset, scene->nodes);
+        key.Add((uint32_t)asset.m_nodes.size());
+        for (const glTF::Node& node : asset.m_nodes)
+            AddNodeList(key, asset, node.children);
+        return key.Get();
+    }
+
+    bool HashFile(const std::wstring& path, uint64_t size, uint64_t& hash)
+    {
+        if (size == 0)
+        {
+            hash = Utility::HashBytes64(nullptr, 0);
+            return true;
+        }
+
+        Utility::FileMapping file;
+        if (!file.Open(path))
+            return false;
+        file.Prefetch(0, file.GetSize());
+        hash = Utility::HashBytes64(file.GetData(), file.GetSize());
+        return true;
+    }
+}
+
+const char* ModelBuildGraph::GetStageName(uint32_t stage)
+{
+    static const char* kStageNames[kNumStages] = { "geometry", "materials", "animations" };
+    return stage < kNumStages ? kStageNames[stage] : "unknown";
+}
+
+std::wstring ModelBuildGraph::GetManifestName(const std::wstring& miniFileName)
+{
+    return miniFileName + L".deps";
+}
+
+std::vector<uint8_t> ModelBuildGraph::SerializeManifest(const Manifest& manifest)
+{
+    ManifestHeader header = {};
+    std::memcpy(header.id, "MDEP", 4);
+    header.version = kManifestVersion;
+    header.miniVersion = manifest.miniVersion;
+    header.numSources = (uint32_t)manifest.sources.size();
+    header.miniSize = manifest.miniSize;
+    header.miniModifiedTime = manifest.miniModifiedTime;
+    header.sceneIdx = manifest.options.sceneIdx;
+    header.optionFlags = (manifest.options.quantizePositions ? kQuantizePositions : 0) |
+        (manifest.options.compressTextures ? kCompressTextures : 0) | (manifest.options.compressFile ? kCompressFile : 0);
+    std::memcpy(header.stageKeys, manifest.stageKeys, sizeof(header.stageKeys));
+
+    std::vector<uint8_t> data((const uint8_t*)&header, (const uint8_t*)(&header + 1));
+    for (const SourceFile& file : manifest.sources)
+    {
+        SourceRecord record = {};
+        record.size = file.size;
+        record.modifiedTime = file.modifiedTime;
+        record.hash = file.hash;
+        record.pathLength = (uint32_t)file.path.size();
+        data.insert(data.end(), (const uint8_t*)&record, (const uint8_t*)(&record + 1));
+
+        for (wchar_t c : file.path)
+        {
+            const uint16_t unit = (uint16_t)c;
+            data.insert(data.end(), (const uint8_t*)&unit, (const uint8_t*)(&unit + 1));
+        }
+    }
+    return data;
+}
+
+bool ModelBuildGraph::ParseManifest(const uint8_t* data, size_t size, Manifest& manifest)
+{
+    ManifestHeader header;
+    if (size < sizeof(header))
+        return false;
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.id, "MDEP", 4) != 0 || header.version != kManifestVersion)
+        return false;
+
+    manifest.miniVersion = header.miniVersion;
+    manifest.miniSize = header.miniSize;
+    manifest.miniModifiedTime = header.miniModifiedTime;
+    manifest.options.sceneIdx = header.sceneIdx;
+    manifest.options.quantizePositions = (header.optionFlags & kQuantizePositions) != 0;
+    manifest.options.compressTextures = (header.optionFlags & kCompressTextures) != 0;
+    manifest.options.compressFile = (header.optionFlags & kCompressFile) != 0;
+    std::memcpy(manifest.stageKeys, header.stageKeys, sizeof(header.stageKeys));
+
+    size_t offset = sizeof(header);
+    manifest.sources.clear();
+    for (uint32_t i = 0; i < header.numSources; ++i)
+    {
+        SourceRecord record;
+        if (size - offset < sizeof(record))
+            return false;
+        std::memcpy(&record, data + offset, sizeof(record));
+        offset += sizeof(record);
+
+        if ((size - offset) / sizeof(uint16_t) < record.pathLength)
+            return false;
+
+        SourceFile file;
+        file.size = record.size;
+        file.modifiedTime = record.modifiedTime;
+        file.hash = record.hash;
+        file.path.resize(record.pathLength);
+        for (uint32_t c = 0; c < record.pathLength; ++c)
+        {
+            uint16_t unit;
+            std::memcpy(&unit, data + offset, sizeof(unit));
+            offset += sizeof(unit);
+            file.path[c] = (wchar_t)unit;
+        }
+        manifest.sources.push_back(file);
+    }
+
+    return offset == size;
+}
+
+bool ModelBuildGraph::ReadManifest(const std::wstring& fileName, Manifest& manifest)
+{
+    Utility::FileMapping file;
+    return file.Open(fileName) && ParseManifest(file.GetData(), file.GetSize(), manifest);
+}
+
+bool ModelBuildGraph::WriteManifest(const std::wstring& fileName, const Manifest& manifest)
+{
+    std::ofstream outFile(fileName, std::ios::out | std::ios::binary);
+    if (!outFile)
+        return false;
+
+    const std::vector<uint8_t> data = SerializeManifest(manifest);
+    outFile.write((const char*)data.data(), data.size());
+    return (bool)outFile;
+}
+
+bool ModelBuildGraph::StatFile(const std::wstring& path, uint64_t& size, int64_t& modifiedTime)
+{
+    struct _stat64 fileStat;
+    if (_wstat64(path.c_str(), &fileStat) == -1)
+        return false;
+
+    size = (uint64_t)fileStat.st_size;
+    modifiedTime = (int64_t)fileStat.st_mtime;
+    return true;
+}
+
+bool ModelBuildGraph::UpdateSources(std::vector<SourceFile>& sources, bool& touched)
+{
+    touched = false;
+    if (sources.empty())
+        return false;
+
+    for (SourceFile& file : sources)
+    {
+        uint64_t size;
+        int64_t modifiedTime;
+        if (!StatFile(file.path, size, modifiedTime))
+            return false;
+        if (size == file.size && modifiedTime == file.modifiedTime)
+            continue;
+
+        uint64_t hash;
+        if (size != file.size || !HashFile(file.path, size, hash) || hash != file.hash)
+            return false;
+
+        file.modifiedTime = modifiedTime;
+        touched = true;
+    }
+    return true;
+}
+
+bool ModelBuildGraph::GatherSources(const std::wstring& modelFile, const std::vector<std::wstring>& bufferFiles,
+    const std::vector<SourceFile>& previous, std::vector<SourceFile>& sources)
+{
+    std::vector<std::wstring> paths(1, modelFile);
+    for (const std::wstring& path : bufferFiles)
+    {
+        if (!path.empty() && std::find(paths.begin(), paths.end(), path) == paths.end())
+            paths.push_back(path);
+    }
+
+    sources.clear();
+    for (const std::wstring& path : paths)
+    {
+        SourceFile file;
+        file.path = path;
+        if (!StatFile(path, file.size, file.modifiedTime))
+            return false;
+
+        auto match = std::find_if(previous.begin(), previous.end(), [&](const SourceFile& prev)
+            { return prev.path == path && prev.size == file.size && prev.modifiedTime == file.modifiedTime; });
+        if (match != previous.end())
+            file.hash = match->hash;
+        else if (!HashFile(path, file.size, file.hash))
+            return false;
+
+        sources.push_back(file);
+    }
+    return true;
+}
+
+void ModelBuildGraph::ComputeStageKeys(const glTF::Asset& asset, const BuildOptions& options, uint64_t keys[kNumStages],
+    uint32_t numThreads)
+{
+    const glTF::Scene* scene = options.sceneIdx < 0 ? asset.m_scene :
+        (size_t)options.sceneIdx < asset.m_scenes.size() ? &asset.m_scenes[options.sceneIdx] : nullptr;
+
+    for (uint32_t stage = 0; stage < kNumStages; ++stage)
+    {
+        KeyBuilder key((uint64_t)stage << 32 | kStageVersions[stage]);
+        key.Add(scene != nullptr);
+        keys[stage] = key.Get();
+    }
+    if (scene == nullptr)
+        return;
+
+    // Hash the contents of every accessor a stage reads, largest first, across threads.
+    std::vector<uint64_t> accessorHashes(asset.m_accessors.size(), 0);
+    {
+        std::vector<uint8_t> used(asset.m_accessors.size(), 0);
+        auto Use = [&](const glTF::Accessor* accessor)
+        {
+            if (accessor != nullptr)
+                used[IndexOf(asset.m_accessors, accessor)] = 1;
+        };
+        for (const glTF::Mesh& mesh : asset.m_meshes)
+        {
+            for (const glTF::Primitive& prim : mesh.primitives)
+            {
+                for (const glTF::Accessor* attribute : prim.attributes)
+                    Use(attribute);
+                Use(prim.indices);
+            }
+        }
+        for (const glTF::Skin& skin : asset.m_skins)
+            Use(skin.inverseBindMatrices);
+        for (const glTF::Animation& anim : asset.m_animations)
+        {
+            for (const glTF::AnimSampler& sampler : anim.m_samplers)
+            {
+                Use(sampler.m_input);
+                Use(sampler.m_output);
+            }
+        }
+
+        std::vector<uint32_t> order;
+        for (uint32_t i = 0; i < used.size(); ++i)
+        {
+            if (used[i])
+                order.push_back(i);
+        }
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+            { return asset.m_accessors[a].count > asset.m_accessors[b].count; });
+
+        if (numThreads == 0)
+            numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+        ParallelFor(order.size(), numThreads, [&](size_t i)
+        {
+            accessorHashes[order[i]] = HashAccessor(asset.m_accessors[order[i]]);
+        });
+    }
+    auto AccessorHash = [&](const glTF::Accessor* accessor)
+    {
+        return accessor != nullptr ? accessorHashes[IndexOf(asset.m_accessors, accessor)] : 0ull;
+    };
+
+    const uint64_t hierarchy = HashHierarchy(asset, scene);
+
+    // Geometry: transforms, primitives and skins, and the few material properties that select vertex formats and PSOs
+    {
+        KeyBuilder key(keys[kGeometryStage]);
+        key.Add(options.quantizePositions);
+        key.Add(hierarchy);
+
+        for (const glTF::Node& node : asset.m_nodes)
+        {
+            key.Add((bool)node.pointsToCamera);
+            key.Add((bool)node.hasMatrix);
+            key.Add((bool)node.skeletonRoot);
+            if (node.hasMatrix)
+            {
+                key.Add(node.matrix, sizeof(node.matrix));
+            }
+            else
+            {
+                key.Add(node.scale, sizeof(node.scale));
+                key.Add(node.rotation, sizeof(node.rotation));
+                key.Add(node.translation, sizeof(node.translation));
+            }
+            key.Add(node.pointsToCamera ? -1 : IndexOf(asset.m_meshes, node.mesh));
+        }
+
+        key.Add((uint32_t)asset.m_meshes.size());
+        for (const glTF::Mesh& mesh : asset.m_meshes)
+        {
+            key.Add(mesh.skin);
+            key.Add((uint32_t)mesh.primitives.size());
+            for (const glTF::Primitive& prim : mesh.primitives)
+            {
+                key.Add(prim.mode);
+                key.Add(prim.attribMask);
+                for (const glTF::Accessor* attribute : prim.attributes)
+                    key.Add(AccessorHash(attribute));
+                key.Add(AccessorHash(prim.indices));
+                key.Add(prim.minPos, sizeof(prim.minPos));
+                key.Add(prim.maxPos, sizeof(prim.maxPos));
+                key.Add(prim.minIndex);
+                key.Add(prim.maxIndex);
+
+                // What OptimizeMesh reads of the material
+                const glTF::Material& material = *prim.material;
+                key.Add(material.index);
+                key.Add((uint32_t)material.baseColorUV);
+                key.Add((uint32_t)material.normalUV);
+                key.Add((uint32_t)material.twoSided);
+                key.Add((uint32_t)material.alphaTest);
+                key.Add((uint32_t)material.alphaBlend);
+            }
+        }
+
+        key.Add((uint32_t)asset.m_skins.size());
+        for (const glTF::Skin& skin : asset.m_skins)
+        {
+            key.Add(AccessorHash(skin.inverseBindMatrices));
+            key.Add(IndexOf(asset.m_nodes, skin.skeleton));
+            AddNodeList(key, asset, skin.joints);
+        }
+
+        keys[kGeometryStage] = key.Get();
+    }
+
+    // Materials: constants, texture slots and samplers, and the image names textures are converted from
+    {
+        KeyBuilder key(keys[kMaterialStage]);
+        key.Add(options.compressTextures);
+
+        key.Add((uint32_t)asset.m_images.size());
+        for (const glTF::Image& image : asset.m_images)
+            key.Add(image.path);
+
+        key.Add((uint32_t)asset.m_materials.size());
+        for (const glTF::Material& material : asset.m_materials)
+        {
+            key.Add(material.baseColorFactor, sizeof(material.baseColorFactor));
+            key.Add(material.metallicFactor);
+            key.Add(material.roughnessFactor);
+            key.Add(material.flags);
+            key.Add(material.emissiveFactor, sizeof(material.emissiveFactor));
+            key.Add(material.normalTextureScale);
+
+            for (const glTF::Texture* texture : material.textures)
+            {
+                key.Add(texture != nullptr ? IndexOf(asset.m_images, texture->source) : -2);
+                const glTF::Sampler* sampler = texture != nullptr ? texture->sampler : nullptr;
+                key.Add(sampler != nullptr ? (int32_t)sampler->wrapS : -1);
+                key.Add(sampler != nullptr ? (int32_t)sampler->wrapT : -1);
+            }
+        }
+
+        keys[kMaterialStage] = key.Get();
+    }
+
+    // Animations: channels, their targets' places in the scene graph and their key frames
+    {
+        KeyBuilder key(keys[kAnimationStage]);
+        key.Add(hierarchy);
+
+        key.Add((uint32_t)asset.m_animations.size());
+        for (const glTF::Animation& anim : asset.m_animations)
+        {
+            key.Add((uint32_t)anim.m_channels.size());
+            for (const glTF::AnimChannel& channel : anim.m_channels)
+            {
+                key.Add(IndexOf(asset.m_nodes, channel.m_target));
+                key.Add((int32_t)channel.m_path);
+                key.Add((int32_t)channel.m_sampler->m_interpolation);
+                key.Add(AccessorHash(channel.m_sampler->m_input));
+                key.Add(AccessorHash(channel.m_sampler->m_output));
+            }
+        }
+
+        keys[kAnimationStage] = key.Get();
+    }
+}
+
+uint32_t ModelBuildGraph::GetDirtyStages(const uint64_t oldKeys[kNumStages], const uint64_t newKeys[kNumStages])
+{
+    uint32_t dirty = 0;
+    for (uint32_t stage = 0; stage < kNumStages; ++stage)
+    {
+        if (oldKeys[stage] != newKeys[stage])
+            dirty |= 1u << stage;
+    }
+    return dirty;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace glTF { class Asset; }
+
+// Decides which parts of a .mini file have to be rebuilt. Each part, a stage, is keyed by a hash of everything it is
+// built from: the glTF objects it reads, the contents of the accessors it reads, the build options that affect it
+// and its converter's version, so editing a material factor leaves the meshes alone. A manifest written next to the
+// .mini records the keys it was built with and the size, time and contents hash of every source file. A model whose
+// files are untouched loads without parsing the glTF, and one whose files were rewritten without changing loads
+// without rebuilding anything. Textures aren't a stage: they are converted at load time through a cache keyed by
+// their contents.
+namespace ModelBuildGraph
+{
+    enum Stage
+    {
+        kGeometryStage,     // Scene graph, meshes, vertex and index buffers, meshlets, LODs and skins
+        kMaterialStage,     // Material constants, texture tables and texture conversion options
+        kAnimationStage,    // Key frames, curves and animation sets
+        kNumStages
+    };
+
+    const uint32_t kAllStages = (1u << kNumStages) - 1;
+
+    // "geometry", "materials" or "animations"
+    const char* GetStageName(uint32_t stage);
+
+    // Bump a stage's version whenever its converter would build something different from the same input.
+    const uint32_t kStageVersions[kNumStages] = { 2, 1, 2 };
+
+    struct BuildOptions
+    {
+        int sceneIdx = -1;              // -1 for the asset's default scene
+        bool quantizePositions = false; // Geometry
+        bool compressTextures = false;  // Materials
+        bool compressFile = false;      // Stored sections only; changing it rewrites the file without rebuilding
+    };
+
+    struct SourceFile
+    {
+        std::wstring path;
+        uint64_t size;
+        int64_t modifiedTime;
+        uint64_t hash;          // Of the contents
+    };
+
+    struct Manifest
+    {
+        uint32_t miniVersion = 0;       // CURRENT_MINI_FILE_VERSION of the .mini described
+        uint64_t miniSize = 0;          // Of the .mini as written, to notice it being replaced
+        int64_t miniModifiedTime = 0;
+        BuildOptions options;
+        uint64_t stageKeys[kNumStages] = {};
+        std::vector<SourceFile> sources;    // The model file first, then the files its buffers were read from
+    };
+
+    // The manifest sits next to the .mini, as "<name>.mini.deps".
+    std::wstring GetManifestName(const std::wstring& miniFileName);
+
+    std::vector<uint8_t> SerializeManifest(const Manifest& manifest);
+    bool ParseManifest(const uint8_t* data, size_t size, Manifest& manifest);
+    bool ReadManifest(const std::wstring& fileName, Manifest& manifest);
+    bool WriteManifest(const std::wstring& fileName, const Manifest& manifest);
+
+    // Reads the size and modification time of a file. Returns false if it doesn't exist.
+    bool StatFile(const std::wstring& path, uint64_t& size, int64_t& modifiedTime);
+
+    // Checks that every file still exists with the contents it had, hashing only the files whose size or time no
+    // longer match. Sets touched when a file was rewritten with the same contents and its time was brought up to date.
+    bool UpdateSources(std::vector<SourceFile>& sources, bool& touched);
+
+    // Fills in the sources of a fresh build, reusing the hashes in previous for files whose size and time match.
+    // Returns false if a file can't be read.
+    bool GatherSources(const std::wstring& modelFile, const std::vector<std::wstring>& bufferFiles,
+        const std::vector<SourceFile>& previous, std::vector<SourceFile>& sources);
+
+    // Keys every stage by what it reads of the asset and the options. Accessor contents are hashed on numThreads
+    // threads (0 for one per hardware thread).
+    void ComputeStageKeys(const glTF::Asset& asset, const BuildOptions& options, uint64_t keys[kNumStages],
+        uint32_t numThreads = 0);
+
+    // A bit per stage whose key differs.
+    uint32_t GetDirtyStages(const uint64_t oldKeys[kNumStages], const uint64_t newKeys[kNumStages]);
+}
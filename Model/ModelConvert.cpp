@@ -19,13 +19,22 @@
 #include "glTF.h"
 #include "TextureConvert.h"
 #include "MeshConvert.h"
+#include "ParallelFor.h"
+#include "IndexOptimizePostTransform.h"
+#include "MeshOptimize.h"
+#include "AnimationCompress.h"
 #include "TextureManager.h"
 #include "GraphicsCommon.h"
 #include "../Core/Utility.h"
 #include "../Core/Math/Common.h"
+#include "../Core/Compression.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <fstream>
 #include <map>
+#include <thread>
 #include <unordered_map>
 
 using namespace DirectX;
@@ -39,14 +48,98 @@ static inline Vector3 SafeNormalize(Vector3 x)
     return lenSq < 1e-10f ? Vector3(kXUnitVector) : x * RecipSqrt(lenSq);
 }
 
-void Renderer::CompileMesh(
+// Finds the positions of an optimized primitive in its depth stream, which starts with them.
+static bool GetPositionStream(const Primitive& prim, uint32_t& vertexCount, uint32_t& positionStride)
+{
+    if (prim.IB == nullptr || prim.VB == nullptr || prim.DepthVB == nullptr || prim.vertexStride == 0)
+        return false;
+
+    vertexCount = (uint32_t)(prim.VB->size() / prim.vertexStride);
+    if (vertexCount == 0)
+        return false;
+
+    positionStride = (uint32_t)(prim.DepthVB->size() / vertexCount);
+    return true;
+}
+
+// Splits an optimized primitive into meshlets.
+static void BuildMeshlets(Primitive& prim)
+{
+    prim.meshlets.clear();
+    uint32_t vertexCount, positionStride;
+    if (!GetPositionStream(prim, vertexCount, positionStride))
+        return;
+
+    Meshlets::Build(prim.IB->data(), prim.index32 != 0, prim.primCount,
+        prim.DepthVB->data(), positionStride, vertexCount, prim.meshlets);
+}
+
+// Appends a chain of reduced index lists to an optimized primitive's index buffer, each with about half the triangles
+// of the one before, for as long as the reduction pays off and stays within kMaxLodError of the primitive's size.
+static void BuildLods(Primitive& prim)
+{
+    // Relative to the bounding radius.
+    const float kMaxLodError = 0.05f;
+
+    prim.lods.clear();
+    uint32_t vertexCount, positionStride;
+    if (!GetPositionStream(prim, vertexCount, positionStride) || prim.primCount / 3 < MeshSimplify::kMinLodTriangles)
+        return;
+
+    std::vector<uint32_t> indices(prim.primCount);
+    if (prim.index32)
+        std::memcpy(indices.data(), prim.IB->data(), prim.primCount * sizeof(uint32_t));
+    else
+        std::copy((const uint16_t*)prim.IB->data(), (const uint16_t*)prim.IB->data() + prim.primCount, indices.begin());
+
+    MeshSimplify::Simplifier simplifier(indices.data(), prim.primCount, prim.DepthVB->data(), positionStride, vertexCount);
+    const float maxError = prim.m_BoundsLS.GetRadius() * kMaxLodError;
+    const uint32_t indexSize = prim.index32 ? 4 : 2;
+
+    uint32_t previous = prim.primCount / 3;
+    for (uint32_t level = 0; level < MeshSimplify::kMaxMeshLods; ++level)
+    {
+        simplifier.Simplify(previous / 2, maxError);
+
+        // A level that barely reduces isn't worth its indices.
+        const uint32_t triangleCount = simplifier.GetTriangleCount();
+        if (triangleCount == 0 || triangleCount > previous * 3 / 4)
+            break;
+
+        MeshLod lod;
+        lod.primCount = triangleCount * 3;
+        lod.startIndex = (uint32_t)(prim.IB->size() / indexSize);
+        lod.error = simplifier.GetError();
+
+        prim.IB->resize(prim.IB->size() + lod.primCount * indexSize);
+        uint8_t* dst = prim.IB->data() + lod.startIndex * indexSize;
+        if (prim.index32)
+            OptimizeFaces(simplifier.GetIndices().data(), lod.primCount, (uint32_t*)dst, MeshOptimize::kVertexCacheSize);
+        else
+            OptimizeFaces(simplifier.GetIndices().data(), lod.primCount, (uint16_t*)dst, MeshOptimize::kVertexCacheSize);
+        MeshOptimize::OptimizeOverdraw(dst, prim.index32 != 0, lod.primCount, prim.DepthVB->data(), positionStride, vertexCount);
+
+        prim.lods.push_back(lod);
+        previous = triangleCount;
+    }
+}
+
+// The serial half of CompileMesh: groups the already optimized primitives of srcMesh and appends their buffers to
+// bufferMemory and their meshlets and LODs to meshletList and lodList. Everything here depends on what came before it, so it runs in
+// scene order. With quantizePositions, each group's positions are stored as UNORM16 within the group's bounds.
+static void MergeMesh(
     std::vector<Mesh*>& meshList,
     std::vector<byte>& bufferMemory,
-    glTF::Mesh& srcMesh,
+    std::vector<Meshlet>& meshletList,
+    std::vector<MeshletRange>& meshletRanges,
+    std::vector<MeshLod>& lodList,
+    std::vector<MeshLodRange>& lodRanges,
+    const glTF::Mesh& srcMesh,
     uint32_t matrixIdx,
-    const Matrix4& localToObject,
+    std::vector<Primitive>& primitives,
     BoundingSphere& boundingSphere,
-    AxisAlignedBox& boundingBox
+    AxisAlignedBox& boundingBox,
+    bool quantizePositions
     )
 {
     // We still have a lot of work to do.  Now that we know about all of the primitives in this mesh
@@ -54,6 +147,10 @@ void Renderer::CompileMesh(
     // have the same vertex format and material.  These can share a PSO and Vertex/Index buffer views.
     // There may be more than one draw call per group due to 16-bit indices.
 
+    // Primitives OptimizeMesh couldn't convert (points and lines) have no buffers.
+    primitives.erase(std::remove_if(primitives.begin(), primitives.end(),
+        [](const Primitive& prim) { return prim.VB == nullptr; }), primitives.end());
+
     size_t totalVertexSize = 0;
     size_t totalDepthVertexSize = 0;
     size_t totalIndexSize = 0;
@@ -61,10 +158,8 @@ void Renderer::CompileMesh(
     BoundingSphere sphereOS(kZero);
     AxisAlignedBox bboxOS(kZero);
 
-    std::vector<Primitive> primitives(srcMesh.primitives.size());
     for (uint32_t i = 0; i < primitives.size(); ++i)
     {
-        OptimizeMesh(primitives[i], srcMesh.primitives[i], localToObject);
         sphereOS = sphereOS.Union(primitives[i].m_BoundsOS);
         bboxOS.AddBoundingBox(primitives[i].m_BBoxOS);
     }
@@ -73,16 +168,55 @@ void Renderer::CompileMesh(
     boundingBox = bboxOS;
 
     std::map<uint32_t, std::vector<Primitive*>> renderMeshes;
+    for (auto& prim : primitives)
+        renderMeshes[prim.hash].push_back(&prim);
+
+    // The draws of a group share a vertex buffer view and so one dequantization.
+    struct PositionDequantization
+    {
+        float scale[3];
+        float bias[3];
+    };
+    std::map<uint32_t, PositionDequantization> dequantization;
+    for (auto& iter : renderMeshes)
+    {
+        PositionDequantization& dq = dequantization[iter.first];
+        for (int i = 0; i < 3; ++i)
+        {
+            dq.scale[i] = 1.0f;
+            dq.bias[i] = 0.0f;
+        }
+        if (!quantizePositions)
+            continue;
+
+        AxisAlignedBox groupBox(kZero);
+        for (Primitive* draw : iter.second)
+            groupBox.AddBoundingBox(draw->m_BBoxLS);
+
+        // Quantized positions can be up to half a step from the ones the meshlet bounds were built from.
+        const float maxShift = Length(groupBox.GetDimensions()) * (0.5f / 65535.0f);
+
+        for (Primitive* draw : iter.second)
+        {
+            QuantizePositions(*draw, groupBox, dq.scale, dq.bias);
+            for (Meshlet& meshlet : draw->meshlets)
+                meshlet.radius += maxShift;
+        }
+    }
+
+    // After quantizing, which can only make more depth vertices the same.
+    for (auto& prim : primitives)
+        WeldDepthStream(prim);
+
     for (auto& prim : primitives)
     {
-        uint32_t hash = prim.hash;
-        renderMeshes[hash].push_back(&prim);
         totalVertexSize += prim.VB->size();
         totalDepthVertexSize += prim.DepthVB->size();
         totalIndexSize += Math::AlignUp(prim.IB->size(), 4);
     }
 
-    uint32_t totalBufferSize = (uint32_t)(totalVertexSize + totalDepthVertexSize + totalIndexSize);
+    // The depth index buffers follow the main ones in the same layout.
+    uint32_t totalBufferSize = (uint32_t)(totalVertexSize + totalDepthVertexSize + totalIndexSize * 2);
 
     Utility::ByteArray stagingBuffer;
     stagingBuffer.reset(new std::vector<byte>(totalBufferSize));
@@ -91,6 +225,7 @@ void Renderer::CompileMesh(
     uint32_t curVBOffset = 0;
     uint32_t curDepthVBOffset = (uint32_t)totalVertexSize;
     uint32_t curIBOffset = curDepthVBOffset + (uint32_t)totalDepthVertexSize;
+    uint32_t curDepthIBOffset = curIBOffset + (uint32_t)totalIndexSize;
 
     for (auto& iter : renderMeshes)
     {
@@ -115,18 +250,24 @@ void Renderer::CompileMesh(
         mesh->bounds[1] = collectiveSphere.GetCenter().GetY();
         mesh->bounds[2] = collectiveSphere.GetCenter().GetZ();
         mesh->bounds[3] = collectiveSphere.GetRadius();
+        std::memcpy(mesh->positionScale, dequantization[iter.first].scale, sizeof(mesh->positionScale));
+        std::memcpy(mesh->positionBias, dequantization[iter.first].bias, sizeof(mesh->positionBias));
         mesh->vbOffset = (uint32_t)bufferMemory.size() + curVBOffset;
         mesh->vbSize = (uint32_t)vbSize;
         mesh->vbDepthOffset = (uint32_t)bufferMemory.size() + curDepthVBOffset;
         mesh->vbDepthSize = (uint32_t)vbDepthSize;
         mesh->ibOffset = (uint32_t)bufferMemory.size() + curIBOffset;
         mesh->ibSize = (uint32_t)ibSize;
+        mesh->ibDepthOffset = (uint32_t)bufferMemory.size() + curDepthIBOffset;
         mesh->vbStride = (uint8_t)iter.second[0]->vertexStride;
         mesh->ibFormat = uint8_t(iter.second[0]->index32 ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT);
         mesh->meshCBV = (uint16_t)matrixIdx;
         mesh->materialCBV = iter.second[0]->materialIdx;
         mesh->psoFlags = iter.second[0]->psoFlags;
         mesh->pso = 0xFFFF;
+        // Assigned at load time, but zeroed so that rebuilding a model writes the same bytes every time.
+        mesh->srvTable = 0;
+        mesh->samplerTable = 0;
         if (srcMesh.skin >= 0)
         {
             mesh->numJoints = 0xFFFF;
@@ -142,23 +283,37 @@ void Renderer::CompileMesh(
 
         uint32_t drawIdx = 0;
         uint32_t curVertOffset = 0;
+        uint32_t curDepthVertOffset = 0;
         uint32_t curIndexOffset = 0;
+        const uint32_t depthStride = GetDepthVertexStride(mesh->psoFlags);
         for (auto& draw : iter.second)
         {
             Mesh::Draw& d = mesh->draw[drawIdx++];
             d.primCount = draw->primCount;
             d.baseVertex = curVertOffset;
+            d.depthBaseVertex = curDepthVertOffset;
             d.startIndex = curIndexOffset;
-            std::memcpy(uploadMem + curVBOffset + curVertOffset, draw->VB->data(), draw->VB->size());
+            std::memcpy(uploadMem + curVBOffset + curVertOffset * draw->vertexStride, draw->VB->data(), draw->VB->size());
+            std::memcpy(uploadMem + curDepthVBOffset + curDepthVertOffset * depthStride, draw->DepthVB->data(), draw->DepthVB->size());
             curVertOffset += (uint32_t)draw->VB->size() / draw->vertexStride;
-            std::memcpy(uploadMem + curDepthVBOffset, draw->DepthVB->data(), draw->DepthVB->size());
-            std::memcpy(uploadMem + curIBOffset + curIndexOffset, draw->IB->data(), draw->IB->size());
+            curDepthVertOffset += (uint32_t)draw->DepthVB->size() / depthStride;
+            std::memcpy(uploadMem + curIBOffset + (curIndexOffset << (draw->index32 + 1)), draw->IB->data(), draw->IB->size());
+            std::memcpy(uploadMem + curDepthIBOffset + (curIndexOffset << (draw->index32 + 1)), draw->DepthIB->data(), draw->DepthIB->size());
             curIndexOffset += (uint32_t)draw->IB->size() >> (draw->index32 + 1);
+
+            MeshletRange range = { (uint32_t)meshletList.size(), (uint32_t)draw->meshlets.size() };
+            meshletRanges.push_back(range);
+            meshletList.insert(meshletList.end(), draw->meshlets.begin(), draw->meshlets.end());
+
+            MeshLodRange lodRange = { (uint32_t)lodList.size(), (uint32_t)draw->lods.size() };
+            lodRanges.push_back(lodRange);
+            lodList.insert(lodList.end(), draw->lods.begin(), draw->lods.end());
         }
 
         curVBOffset += (uint32_t)vbSize;
         curDepthVBOffset += (uint32_t)vbDepthSize;
         curIBOffset += (uint32_t)Math::AlignUp(ibSize, 4);
+        curDepthIBOffset += (uint32_t)Math::AlignUp(ibSize, 4);
         curIndexOffset = Math::AlignUp(curIndexOffset, 4);
 
         meshList.push_back(mesh);
@@ -167,13 +322,43 @@ void Renderer::CompileMesh(
     bufferMemory.insert(bufferMemory.end(), stagingBuffer->begin(), stagingBuffer->end());
 }
 
+void Renderer::CompileMesh(
+    std::vector<Mesh*>& meshList,
+    std::vector<byte>& bufferMemory,
+    std::vector<Meshlet>& meshletList,
+    std::vector<MeshletRange>& meshletRanges,
+    std::vector<MeshLod>& lodList,
+    std::vector<MeshLodRange>& lodRanges,
+    glTF::Mesh& srcMesh,
+    uint32_t matrixIdx,
+    const Matrix4& localToObject,
+    BoundingSphere& boundingSphere,
+    AxisAlignedBox& boundingBox
+    )
+{
+    std::vector<Primitive> primitives(srcMesh.primitives.size());
+    for (uint32_t i = 0; i < primitives.size(); ++i)
+    {
+        OptimizeMesh(primitives[i], srcMesh.primitives[i], localToObject);
+        BuildMeshlets(primitives[i]);
+        BuildLods(primitives[i]);
+    }
+
+    MergeMesh(meshList, bufferMemory, meshletList, meshletRanges, lodList, lodRanges, srcMesh, matrixIdx, primitives, boundingSphere, boundingBox, false);
+}
+
+// A mesh instance met while walking the scene graph, compiled once the whole graph has been walked.
+struct MeshJob
+{
+    Matrix4 localToObject;
+    const glTF::Mesh* srcMesh;
+    uint32_t matrixIdx;
+};
+
 
 static uint32_t WalkGraph(
     std::vector<GraphNode>& sceneGraph,
-    BoundingSphere& modelBSphere,
-    AxisAlignedBox& modelBBox,
-    std::vector<Mesh*>& meshList,
-    std::vector<byte>& bufferMemory,
+    std::vector<MeshJob>& meshJobs,
     const std::vector<glTF::Node*>& siblings,
     uint32_t curPos,
     const Matrix4& xform
@@ -212,11 +397,11 @@ static uint32_t WalkGraph(
 
         if (!curNode->pointsToCamera && curNode->mesh != nullptr)
         {
-            BoundingSphere sphereOS;
-            AxisAlignedBox boxOS;
-            CompileMesh(meshList, bufferMemory, *curNode->mesh, curPos, LocalXform, sphereOS, boxOS);
-            modelBSphere = modelBSphere.Union(sphereOS);
-            modelBBox.AddBoundingBox(boxOS);
+            MeshJob job;
+            job.localToObject = LocalXform;
+            job.srcMesh = curNode->mesh;
+            job.matrixIdx = curPos;
+            meshJobs.push_back(job);
         }
 
         uint32_t nextPos = curPos + 1;
@@ -224,7 +409,7 @@ static uint32_t WalkGraph(
         if (curNode->children.size() > 0)
         {
             thisGraphNode.hasChildren = 1;
-            nextPos = WalkGraph(sceneGraph, modelBSphere, modelBBox, meshList, bufferMemory, curNode->children, nextPos, LocalXform);
+            nextPos = WalkGraph(sceneGraph, meshJobs, curNode->children, nextPos, LocalXform);
         }
 
         // Are there more siblings?
@@ -325,10 +510,7 @@ void BuildMaterials(ModelData& model, const glTF::Asset& asset)
     {
         auto iter = textureOptions.find(name);
         if (iter != textureOptions.end())
-        {
             model.m_TextureOptions.push_back(iter->second);
-            CompileTextureOnDemand(asset.m_basePath + Utility::UTF8ToWideString(iter->first), iter->second);
-        }
         else
             model.m_TextureOptions.push_back(0xFF);
     }
@@ -349,53 +531,58 @@ void BuildAnimations(ModelData& model, const glTF::Asset& asset)
         AnimationSet& animSet = model.m_Animations[animIdx++];
         animSet.duration = 0.0f;
         animSet.firstCurve = (uint32_t)model.m_AnimationCurves.size();
-        animSet.numCurves = (uint32_t)anim.m_channels.size();
 
-        for (size_t i = 0; i < animSet.numCurves; ++i)
+        for (const glTF::AnimChannel& channel : anim.m_channels)
         {
-            const glTF::AnimChannel& channel = anim.m_channels[i];
             const glTF::AnimSampler& sampler = *channel.m_sampler;
 
             ASSERT(channel.m_target->linearIdx >= 0);
 
-            AnimationCurve curve;
-            curve.targetNode = channel.m_target->linearIdx;
-            curve.targetPath = channel.m_path;
-            curve.interpolation = sampler.m_interpolation;
-            curve.keyFrameOffset = model.m_AnimationKeyFrameData.size();
-            curve.keyFrameFormat = std::min<uint32_t>(sampler.m_output->componentType, AnimationCurve::kFloat);
-            curve.numSegments = sampler.m_output->count - 1.0f;
+            // Blend shape weights can't be played back, so they aren't kept
+            if (channel.m_path == glTF::AnimChannel::kWeights)
+                continue;
 
-            // In glTF, stride==0 means "packed tightly"
-            if (sampler.m_output->stride == 0)
-            {
-                uint32_t numComponents = sampler.m_output->type + 1;
-                uint32_t bytesPerComponent = sampler.m_output->componentType / 2 + 1;
-                curve.keyFrameStride = numComponents * bytesPerComponent / 4;
-            }
-            else
+            std::vector<float> timeStamps, values;
+            glTF::ReadFloatElements(*sampler.m_input, timeStamps);
+            glTF::ReadFloatElements(*sampler.m_output, values);
+
+            // Cubic splines have an in-tangent, a value and an out-tangent for every time stamp
+            const size_t valuesPerKey = (channel.m_path == glTF::AnimChannel::kRotation ? 4 : 3) *
+                (sampler.m_interpolation == glTF::AnimSampler::kCubicSpline ? 3 : 1);
+            if (values.size() != timeStamps.size() * valuesPerKey)
             {
-                ASSERT(sampler.m_output->stride <= 16 && sampler.m_output->stride % 4 == 0);
-                curve.keyFrameStride = sampler.m_output->stride / 4;
+                Utility::Printf("Skipping an animation channel whose key frames don't match its time stamps\n");
+                continue;
             }
 
-            // Determine start and stop time stamps
-            const float* timeStamps = (float*)sampler.m_input->dataPtr;
-            curve.startTime = timeStamps[0];
+            AnimationCompress::SourceCurve source;
+            source.targetPath = channel.m_path;
+            source.interpolation = sampler.m_interpolation;
+            source.times = timeStamps.data();
+            source.values = values.data();
+            source.keyCount = (uint32_t)timeStamps.size();
+
+            AnimationCompress::CompressedCurve compressed;
+            if (!AnimationCompress::Compress(source, compressed))
+                continue;
 
-            const float endTime = timeStamps[sampler.m_output->count - 1];
-            curve.rangeScale = curve.numSegments / (endTime - curve.startTime);
+            AnimationCurve curve = compressed.curve;
+            curve.targetNode = channel.m_target->linearIdx;
+            curve.keyFrameOffset = model.m_AnimationKeyFrameData.size();
 
-            animSet.duration = std::max<float>(animSet.duration, endTime);
+            animSet.duration = std::max<float>(animSet.duration, compressed.endTime);
 
-            // Append this curve data
+            // Append this curve data, keeping the next curve's key frames 4-byte aligned
             model.m_AnimationKeyFrameData.insert(
                 model.m_AnimationKeyFrameData.end(),
-                sampler.m_output->dataPtr,
-                sampler.m_output->dataPtr + sampler.m_output->count * curve.keyFrameStride * 4);
+                compressed.keyFrames.begin(),
+                compressed.keyFrames.end());
+            model.m_AnimationKeyFrameData.resize((model.m_AnimationKeyFrameData.size() + 3) & ~3);
 
             model.m_AnimationCurves.push_back(curve);
         }
+
+        animSet.numCurves = (uint32_t)model.m_AnimationCurves.size() - animSet.firstCurve;
     }
 }
 
@@ -423,7 +610,13 @@ void BuildSkins(ModelData& model, const glTF::Asset& asset)
         }
 
         // Append IBMs
+        std::vector<byte> denseIBMs;
         Matrix4* IBMstart = (Matrix4*)skin.inverseBindMatrices->dataPtr;
+        if (!skin.inverseBindMatrices->HasInPlaceData())
+        {
+            glTF::ReadDenseElements(*skin.inverseBindMatrices, denseIBMs);
+            IBMstart = (Matrix4*)denseIBMs.data();
+        }
         Matrix4* IBMend = IBMstart + skin.inverseBindMatrices->count;
         ASSERT(skin.inverseBindMatrices->count == numJoints);
         model.m_JointIBMs.insert(model.m_JointIBMs.end(), IBMstart, IBMend);
@@ -441,33 +634,313 @@ void BuildSkins(ModelData& model, const glTF::Asset& asset)
     }
 }
 
-bool Renderer::BuildModel(ModelData& model, const glTF::Asset& asset, int sceneIdx)
+// Optimizes the primitives of every job concurrently, then merges them in job order. The merge is what assigns buffer
+// offsets and mesh order, so the result matches compiling the jobs one after another byte for byte.
+static void CompileMeshes(ModelData& model, const std::vector<MeshJob>& meshJobs, uint32_t numThreads, bool quantizePositions)
+{
+    struct PrimitiveTask
+    {
+        size_t cost;
+        uint32_t jobIdx;
+        uint32_t primIdx;
+    };
+
+    std::vector<std::vector<Primitive>> primitives(meshJobs.size());
+    std::vector<PrimitiveTask> tasks;
+    for (uint32_t jobIdx = 0; jobIdx < meshJobs.size(); ++jobIdx)
+    {
+        const glTF::Mesh& srcMesh = *meshJobs[jobIdx].srcMesh;
+        primitives[jobIdx].resize(srcMesh.primitives.size());
+        for (uint32_t primIdx = 0; primIdx < srcMesh.primitives.size(); ++primIdx)
+        {
+            const glTF::Primitive& srcPrim = srcMesh.primitives[primIdx];
+            PrimitiveTask task;
+            const glTF::Accessor* positions = srcPrim.attributes[glTF::Primitive::kPosition];
+            task.cost = srcPrim.indices != nullptr ? srcPrim.indices->count : positions != nullptr ? positions->count : 0;
+            task.jobIdx = jobIdx;
+            task.primIdx = primIdx;
+            tasks.push_back(task);
+        }
+    }
+
+    // Scene files commonly hold a few huge primitives among many small ones. Starting on the big ones first keeps
+    // a thread from picking one up last while the others sit idle.
+    std::stable_sort(tasks.begin(), tasks.end(),
+        [](const PrimitiveTask& a, const PrimitiveTask& b) { return a.cost > b.cost; });
+
+    if (numThreads == 0)
+        numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+
+    ParallelFor(tasks.size(), numThreads, [&](size_t taskIdx)
+    {
+        const PrimitiveTask& task = tasks[taskIdx];
+        const MeshJob& job = meshJobs[task.jobIdx];
+        Primitive& prim = primitives[task.jobIdx][task.primIdx];
+        OptimizeMesh(prim, job.srcMesh->primitives[task.primIdx], job.localToObject);
+        BuildMeshlets(prim);
+        BuildLods(prim);
+    });
+
+    model.m_BoundingSphere = BoundingSphere(kZero);
+    model.m_BoundingBox = AxisAlignedBox(kZero);
+    for (uint32_t jobIdx = 0; jobIdx < meshJobs.size(); ++jobIdx)
+    {
+        const MeshJob& job = meshJobs[jobIdx];
+        BoundingSphere sphereOS;
+        AxisAlignedBox boxOS;
+        MergeMesh(model.m_Meshes, model.m_GeometryData, model.m_Meshlets, model.m_MeshletRanges, model.m_Lods, model.m_LodRanges, *job.srcMesh, job.matrixIdx, primitives[jobIdx], sphereOS, boxOS, quantizePositions);
+        model.m_BoundingSphere = model.m_BoundingSphere.Union(sphereOS);
+        model.m_BoundingBox.AddBoundingBox(boxOS);
+
+        // Hand the converted buffers back as soon as they've been copied out.
+        primitives[jobIdx].clear();
+        primitives[jobIdx].shrink_to_fit();
+    }
+}
+
+static void FreeMeshes(ModelData& model)
 {
-    BuildMaterials(model, asset);
+    for (Mesh* mesh : model.m_Meshes)
+        free(mesh);
+    model.m_Meshes.clear();
+}
 
-    // Generate scene graph and meshes
-    model.m_SceneGraph.resize(asset.m_nodes.size());
+bool Renderer::BuildModel(ModelData& model, const glTF::Asset& asset, int sceneIdx, uint32_t numThreads, bool quantizePositions, uint32_t stages)
+{
     const glTF::Scene* scene = sceneIdx < 0 ? asset.m_scene : &asset.m_scenes[sceneIdx];
     if (scene == nullptr)
         return false;
 
-    // Aggregate all of the vertex and index buffers in this unified buffer
-    std::vector<byte>& bufferMemory = model.m_GeometryData;
+    if (stages & (1u << ModelBuildGraph::kMaterialStage))
+        BuildMaterials(model, asset);
 
-    model.m_BoundingSphere = BoundingSphere(kZero);
-    model.m_BoundingBox = AxisAlignedBox(kZero);
-    uint32_t numNodes = WalkGraph(model.m_SceneGraph, model.m_BoundingSphere, model.m_BoundingBox, model.m_Meshes, bufferMemory, scene->nodes, 0, Matrix4(kIdentity));
-    model.m_SceneGraph.resize(numNodes);
+    // The walk numbers the nodes that skins and animations refer to, so it runs whatever is rebuilt.
+    std::vector<GraphNode> sceneGraph(asset.m_nodes.size());
+    std::vector<MeshJob> meshJobs;
+    uint32_t numNodes = WalkGraph(sceneGraph, meshJobs, scene->nodes, 0, Matrix4(kIdentity));
+    sceneGraph.resize(numNodes);
 
-    BuildAnimations(model, asset);
-    BuildSkins(model, asset);
+    if (stages & (1u << ModelBuildGraph::kGeometryStage))
+    {
+        FreeMeshes(model);
+        model.m_SceneGraph = std::move(sceneGraph);
+        model.m_GeometryData.clear();
+        model.m_Meshlets.clear();
+        model.m_MeshletRanges.clear();
+        model.m_Lods.clear();
+        model.m_LodRanges.clear();
+        model.m_JointIndices.clear();
+        model.m_JointIBMs.clear();
+
+        // Aggregate all of the vertex and index buffers in the unified model.m_GeometryData
+        CompileMeshes(model, meshJobs, numThreads, quantizePositions);
+        BuildSkins(model, asset);
+    }
+
+    if (stages & (1u << ModelBuildGraph::kAnimationStage))
+    {
+        model.m_AnimationKeyFrameData.clear();
+        model.m_AnimationCurves.clear();
+        model.m_Animations.clear();
+        BuildAnimations(model, asset);
+    }
 
     return true;
 }
 
-bool Renderer::SaveModel(const std::wstring& filePath, const ModelData& data)
+static bool SameMeshes(const ModelData& a, const ModelData& b)
 {
-    std::ofstream outFile(filePath, std::ios::out | std::ios::binary);
+    if (a.m_GeometryData != b.m_GeometryData || a.m_Meshes.size() != b.m_Meshes.size())
+        return false;
+
+    if (a.m_Meshlets.size() != b.m_Meshlets.size() || a.m_MeshletRanges.size() != b.m_MeshletRanges.size() ||
+        std::memcmp(a.m_Meshlets.data(), b.m_Meshlets.data(), a.m_Meshlets.size() * sizeof(Meshlet)) != 0 ||
+        std::memcmp(a.m_MeshletRanges.data(), b.m_MeshletRanges.data(), a.m_MeshletRanges.size() * sizeof(MeshletRange)) != 0)
+        return false;
+
+    if (a.m_Lods.size() != b.m_Lods.size() || a.m_LodRanges.size() != b.m_LodRanges.size() ||
+        std::memcmp(a.m_Lods.data(), b.m_Lods.data(), a.m_Lods.size() * sizeof(MeshLod)) != 0 ||
+        std::memcmp(a.m_LodRanges.data(), b.m_LodRanges.data(), a.m_LodRanges.size() * sizeof(MeshLodRange)) != 0)
+        return false;
+
+    for (size_t i = 0; i < a.m_Meshes.size(); ++i)
+    {
+        const Mesh& meshA = *a.m_Meshes[i];
+        const Mesh& meshB = *b.m_Meshes[i];
+        if (meshA.numDraws != meshB.numDraws ||
+            std::memcmp(&meshA, &meshB, sizeof(Mesh) + (meshA.numDraws - 1) * sizeof(Mesh::Draw)) != 0)
+            return false;
+    }
+
+    const float boundsA[] = {
+        a.m_BoundingSphere.GetCenter().GetX(), a.m_BoundingSphere.GetCenter().GetY(), a.m_BoundingSphere.GetCenter().GetZ(),
+        a.m_BoundingSphere.GetRadius(),
+        a.m_BoundingBox.GetMin().GetX(), a.m_BoundingBox.GetMin().GetY(), a.m_BoundingBox.GetMin().GetZ(),
+        a.m_BoundingBox.GetMax().GetX(), a.m_BoundingBox.GetMax().GetY(), a.m_BoundingBox.GetMax().GetZ() };
+    const float boundsB[] = {
+        b.m_BoundingSphere.GetCenter().GetX(), b.m_BoundingSphere.GetCenter().GetY(), b.m_BoundingSphere.GetCenter().GetZ(),
+        b.m_BoundingSphere.GetRadius(),
+        b.m_BoundingBox.GetMin().GetX(), b.m_BoundingBox.GetMin().GetY(), b.m_BoundingBox.GetMin().GetZ(),
+        b.m_BoundingBox.GetMax().GetX(), b.m_BoundingBox.GetMax().GetY(), b.m_BoundingBox.GetMax().GetZ() };
+    return std::memcmp(boundsA, boundsB, sizeof(boundsA)) == 0;
+}
+
+bool Renderer::BenchmarkBuildModel(const glTF::Asset& asset)
+{
+    if (asset.m_scene == nullptr)
+        return false;
+
+    // Only the mesh compilation is timed. Materials kick off texture conversion, which has its own threads.
+    std::vector<GraphNode> sceneGraph(asset.m_nodes.size());
+    std::vector<MeshJob> meshJobs;
+    WalkGraph(sceneGraph, meshJobs, asset.m_scene->nodes, 0, Matrix4(kIdentity));
+
+    size_t numPrimitives = 0;
+    for (const MeshJob& job : meshJobs)
+        numPrimitives += job.srcMesh->primitives.size();
+
+    auto TimeBuild = [&](ModelData& model, uint32_t numThreads)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        CompileMeshes(model, meshJobs, numThreads, false);
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    };
+
+    // The first build also warms up the file cache and the allocator, so it is only used as the reference.
+    ModelData reference;
+    TimeBuild(reference, 1);
+    Utility::Printf("BuildModel benchmark: %zu mesh instances, %zu primitives, %zu meshes, %zu bytes of geometry\n",
+        meshJobs.size(), numPrimitives, reference.m_Meshes.size(), reference.m_GeometryData.size());
+
+    size_t numVertices = 0, numDepthVertices = 0;
+    for (const Mesh* mesh : reference.m_Meshes)
+    {
+        numVertices += mesh->vbSize / mesh->vbStride;
+        numDepthVertices += mesh->vbDepthSize / GetDepthVertexStride(mesh->psoFlags);
+    }
+    Utility::Printf("  %zu vertices, %zu in the welded depth-only stream\n", numVertices, numDepthVertices);
+
+    const uint32_t maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    double serialMs = 0.0;
+    bool allMatch = true;
+    for (uint32_t numThreads = 1; ; numThreads = std::min(numThreads * 2, maxThreads))
+    {
+        ModelData model;
+        const double ms = TimeBuild(model, numThreads);
+        if (numThreads == 1)
+            serialMs = ms;
+
+        const bool match = SameMeshes(reference, model);
+        allMatch &= match;
+        Utility::Printf("  %2u threads: %9.2f ms, %5.2fx%s\n", numThreads, ms, serialMs / ms, match ? "" : ", output differs from the serial build");
+        FreeMeshes(model);
+
+        if (numThreads == maxThreads)
+            break;
+    }
+
+    FreeMeshes(reference);
+    Utility::Printf("BuildModel benchmark: %s\n", allMatch ? "all builds match" : "FAILED");
+    return allMatch;
+}
+
+bool Renderer::ReportVertexQuantization(const glTF::Asset& asset)
+{
+    if (asset.m_scene == nullptr)
+        return false;
+
+    std::vector<GraphNode> sceneGraph(asset.m_nodes.size());
+    std::vector<MeshJob> meshJobs;
+    WalkGraph(sceneGraph, meshJobs, asset.m_scene->nodes, 0, Matrix4(kIdentity));
+
+    ModelData reference, quantized;
+    CompileMeshes(reference, meshJobs, 0, false);
+    CompileMeshes(quantized, meshJobs, 0, true);
+
+    // Normals and tangents are 10:10:10:2 and UVs half floats either way, so positions are all that changes.
+    bool valid = reference.m_Meshes.size() == quantized.m_Meshes.size();
+    size_t referenceBytes = 0;
+    size_t quantizedBytes = 0;
+    size_t numVertices = 0;
+    double maxError = 0.0;
+    double maxRelativeError = 0.0;
+    double sumSquaredError = 0.0;
+    for (size_t i = 0; valid && i < reference.m_Meshes.size(); ++i)
+    {
+        const Mesh& a = *reference.m_Meshes[i];
+        const Mesh& b = *quantized.m_Meshes[i];
+        const uint32_t vertexCount = a.vbSize / a.vbStride;
+        if ((b.psoFlags & PSOFlags::kQuantizedPosition) == 0 || b.vbSize / b.vbStride != vertexCount)
+        {
+            valid = false;
+            break;
+        }
+
+        referenceBytes += a.vbSize + a.vbDepthSize;
+        quantizedBytes += b.vbSize + b.vbDepthSize;
+        numVertices += vertexCount;
+
+        // The welded depth stream is only reachable through its own indices.
+        const uint32_t depthStride = GetDepthVertexStride(b.psoFlags);
+        const bool index32 = b.ibFormat == DXGI_FORMAT_R32_UINT;
+        for (uint32_t d = 0; d < b.numDraws; ++d)
+        {
+            const Mesh::Draw& draw = b.draw[d];
+            for (uint32_t i = draw.startIndex; i < draw.startIndex + draw.primCount; ++i)
+            {
+                const byte* ib = quantized.m_GeometryData.data() + b.ibOffset;
+                const byte* depthIB = quantized.m_GeometryData.data() + b.ibDepthOffset;
+                const uint32_t v = draw.baseVertex + (index32 ? ((const uint32_t*)ib)[i] : ((const uint16_t*)ib)[i]);
+                const uint32_t depthV = draw.depthBaseVertex + (index32 ? ((const uint32_t*)depthIB)[i] : ((const uint16_t*)depthIB)[i]);
+                const byte* quantizedVertex = quantized.m_GeometryData.data() + b.vbOffset + v * b.vbStride;
+                const byte* quantizedDepthVertex = quantized.m_GeometryData.data() + b.vbDepthOffset + depthV * depthStride;
+                if (std::memcmp(quantizedVertex, quantizedDepthVertex, 4 * sizeof(uint16_t)) != 0)
+                    valid = false;
+            }
+        }
+
+        for (uint32_t v = 0; v < vertexCount; ++v)
+        {
+            const byte* quantizedVertex = quantized.m_GeometryData.data() + b.vbOffset + v * b.vbStride;
+
+            float position[3];
+            uint16_t unorm[4];
+            std::memcpy(position, reference.m_GeometryData.data() + a.vbOffset + v * a.vbStride, sizeof(position));
+            std::memcpy(unorm, quantizedVertex, sizeof(unorm));
+
+            double squaredError = 0.0;
+            for (int c = 0; c < 3; ++c)
+            {
+                const double delta = unorm[c] * (double)b.positionScale[c] + b.positionBias[c] - position[c];
+                squaredError += delta * delta;
+            }
+
+            const double error = std::sqrt(squaredError);
+            sumSquaredError += squaredError;
+            maxError = std::max(maxError, error);
+            if (a.bounds[3] > 0.0f)
+                maxRelativeError = std::max(maxRelativeError, error / a.bounds[3]);
+        }
+    }
+
+    Utility::Printf("Vertex quantization: %zu meshes, %zu vertices, vertex streams %zu -> %zu bytes (%.2fx)\n",
+        reference.m_Meshes.size(), numVertices, referenceBytes, quantizedBytes,
+        quantizedBytes > 0 ? (double)referenceBytes / quantizedBytes : 0.0);
+    Utility::Printf("  position error: max %g, rms %g, max relative to the mesh radius %g\n",
+        maxError, numVertices > 0 ? std::sqrt(sumSquaredError / numVertices) : 0.0, maxRelativeError);
+    if (!valid)
+        Utility::Printf("Vertex quantization: FAILED, the quantized build doesn't match the float one\n");
+
+    FreeMeshes(reference);
+    FreeMeshes(quantized);
+    return valid;
+}
+
+bool Renderer::SaveModel(const std::wstring& filePath, const ModelData& data, bool compress)
+{
+    // Written beside the old file and renamed over it, so a failed save leaves the old one intact.
+    const std::wstring tempPath = filePath + L"." + std::to_wstring(GetCurrentThreadId()) + L".tmp";
+    std::ofstream outFile(tempPath, std::ios::out | std::ios::binary);
     if (!outFile)
         return false;
 
@@ -500,23 +973,102 @@ bool Renderer::SaveModel(const std::wstring& filePath, const ModelData& data)
     header.maxPos[1] = data.m_BoundingBox.GetMax().GetY();
     header.maxPos[2] = data.m_BoundingBox.GetMax().GetZ();
 
+    // The header is written again at the end, once the section table is known.
+    std::memset(header.sections, 0, sizeof(header.sections));
     outFile.write((char*)&header, sizeof(FileHeader));
-    outFile.write((char*)data.m_GeometryData.data(), header.geometrySize);
+
+    auto BeginSection = [&](MiniFileSection section)
+    {
+        static const char padding[kMiniSectionAlignment] = {};
+        uint32_t offset = (uint32_t)outFile.tellp();
+        outFile.write(padding, Math::AlignUp(offset, kMiniSectionAlignment) - offset);
+        header.sections[section].offset = (uint32_t)outFile.tellp();
+    };
+    auto EndSection = [&](MiniFileSection section)
+    {
+        header.sections[section].size = (uint32_t)outFile.tellp() - header.sections[section].offset;
+        header.sections[section].rawSize = header.sections[section].size;
+    };
+    auto WritePackedSection = [&](MiniFileSection section, const void* sectionData, size_t size, const std::vector<uint32_t>& shuffleStrides)
+    {
+        BeginSection(section);
+        if (compress && size > 0)
+        {
+            const std::vector<uint8_t> stream = Compression::CompressChunked((const uint8_t*)sectionData, size, shuffleStrides);
+            outFile.write((char*)stream.data(), stream.size());
+            EndSection(section);
+            header.sections[section].rawSize = (uint32_t)size;
+            header.sections[section].compressed = 1;
+        }
+        else
+        {
+            outFile.write((char*)sectionData, size);
+            EndSection(section);
+        }
+    };
+
+    // Vertex streams shuffle best by their own stride; 4 suits indices and depth-only positions.
+    std::vector<uint32_t> geometryStrides = { 0, 4 };
+    for (const Mesh* mesh : data.m_Meshes)
+    {
+        if (std::find(geometryStrides.begin(), geometryStrides.end(), mesh->vbStride) == geometryStrides.end())
+            geometryStrides.push_back(mesh->vbStride);
+    }
+
+    WritePackedSection(kGeometrySection, data.m_GeometryData.data(), header.geometrySize, geometryStrides);
+
+    BeginSection(kSceneGraphSection);
     outFile.write((char*)data.m_SceneGraph.data(), header.numNodes * sizeof(GraphNode));
+    EndSection(kSceneGraphSection);
+
+    BeginSection(kMeshSection);
     for (const Mesh* mesh : data.m_Meshes)
         outFile.write((char*)mesh, sizeof(Mesh) + (mesh->numDraws - 1) * sizeof(Mesh::Draw));
+    EndSection(kMeshSection);
+
+    BeginSection(kMeshletSection);
+    outFile.write((char*)data.m_Meshlets.data(), data.m_Meshlets.size() * sizeof(Meshlet));
+    EndSection(kMeshletSection);
+
+    BeginSection(kMeshletRangeSection);
+    outFile.write((char*)data.m_MeshletRanges.data(), data.m_MeshletRanges.size() * sizeof(MeshletRange));
+    EndSection(kMeshletRangeSection);
+
+    BeginSection(kLodSection);
+    outFile.write((char*)data.m_Lods.data(), data.m_Lods.size() * sizeof(MeshLod));
+    EndSection(kLodSection);
+
+    BeginSection(kLodRangeSection);
+    outFile.write((char*)data.m_LodRanges.data(), data.m_LodRanges.size() * sizeof(MeshLodRange));
+    EndSection(kLodRangeSection);
+
+    BeginSection(kMaterialConstantSection);
     outFile.write((char*)data.m_MaterialConstants.data(), header.numMaterials * sizeof(MaterialConstantData));
+    EndSection(kMaterialConstantSection);
+
+    BeginSection(kMaterialTextureSection);
     outFile.write((char*)data.m_MaterialTextures.data(), header.numMaterials * sizeof(MaterialTextureData));
+    EndSection(kMaterialTextureSection);
+
+    BeginSection(kStringTableSection);
     for (uint32_t i = 0; i < header.numTextures; ++i)
         outFile << data.m_TextureNames[i] << '\0';
+    EndSection(kStringTableSection);
+
+    BeginSection(kTextureOptionSection);
     outFile.write((char*)data.m_TextureOptions.data(), header.numTextures * sizeof(uint8_t));
+    EndSection(kTextureOptionSection);
 
     if (header.numAnimations > 0)
     {
         ASSERT(header.keyFrameDataSize > 0 && header.numAnimationCurves > 0);
-        outFile.write((char*)data.m_AnimationKeyFrameData.data(), header.keyFrameDataSize);
+        WritePackedSection(kKeyFrameSection, data.m_AnimationKeyFrameData.data(), header.keyFrameDataSize, { 0, 4 });
+        BeginSection(kAnimationCurveSection);
         outFile.write((char*)data.m_AnimationCurves.data(), header.numAnimationCurves * sizeof(AnimationCurve));
+        EndSection(kAnimationCurveSection);
+        BeginSection(kAnimationSection);
         outFile.write((char*)data.m_Animations.data(), header.numAnimations * sizeof(AnimationSet));
+        EndSection(kAnimationSection);
     }
     else
     {
@@ -526,8 +1078,22 @@ bool Renderer::SaveModel(const std::wstring& filePath, const ModelData& data)
     if (header.numJoints)
     {
         ASSERT(header.numJoints == (uint32_t)data.m_JointIBMs.size());
+        BeginSection(kJointIndexSection);
         outFile.write((char*)data.m_JointIndices.data(), header.numJoints * sizeof(uint16_t));
+        EndSection(kJointIndexSection);
+        BeginSection(kJointIBMSection);
         outFile.write((char*)data.m_JointIBMs.data(), header.numJoints * sizeof(Matrix4));
+        EndSection(kJointIBMSection);
+    }
+
+    outFile.seekp(0);
+    outFile.write((char*)&header, sizeof(FileHeader));
+    outFile.close();
+
+    if (!outFile || !MoveFileExW(tempPath.c_str(), filePath.c_str(), MOVEFILE_REPLACE_EXISTING))
+    {
+        _wremove(tempPath.c_str());
+        return false;
     }
 
     return true;
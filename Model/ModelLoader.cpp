@@ -21,9 +21,18 @@
 #include "ModelH3D.h"
 #include "TextureManager.h"
 #include "TextureConvert.h"
+#include "ParallelFor.h"
 #include "GraphicsCommon.h"
-
-#include <fstream>
+#include "../Core/FileUtility.h"
+#include "../Core/Compression.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <type_traits>
 #include <unordered_map>
 
 using namespace Renderer;
@@ -31,6 +40,13 @@ using namespace Graphics;
 
 std::unordered_map<uint32_t, uint32_t> g_SamplerPermutations;
 
+namespace Renderer
+{
+    BoolVar CompressModelFiles("Renderer/Compress Model Files", false);
+    BoolVar QuantizeModelVertices("Renderer/Quantize Model Vertices", false);
+    BoolVar CompressTextures("Renderer/Compress Textures", false);
+}
+
 D3D12_CPU_DESCRIPTOR_HANDLE GetSampler(uint32_t addressModes)
 {
     SamplerDesc samplerDesc;
@@ -50,49 +66,43 @@ void LoadMaterials(Model& model,
     // Load textures
     const uint32_t numTextures = (uint32_t)textureNames.size();
     model.textures.resize(numTextures);
+
+    std::vector<TextureCompileJob> compileJobs(numTextures);
     for (size_t ti = 0; ti < numTextures; ++ti)
     {
-        std::wstring originalFile = basePath + textureNames[ti];
-        CompileTextureOnDemand(originalFile, textureOptions[ti]);
+        compileJobs[ti].originalFile = basePath + textureNames[ti];
+        compileJobs[ti].flags = textureOptions[ti];
+    }
+    CompileTexturesOnDemand(compileJobs);
 
-        std::wstring ddsFile = Utility::RemoveExtension(originalFile) + L".dds";
-        model.textures[ti] = TextureManager::LoadDDSFromFile(ddsFile);
+    for (size_t ti = 0; ti < numTextures; ++ti)
+    {
+        std::wstring ddsFile = Utility::RemoveExtension(compileJobs[ti].originalFile) + L".dds";
+        model.textures[ti] = TextureManager::LoadDDSFromFile(ddsFile, kMagenta2D, false, true);
     }
 
     // Generate descriptor tables and record offsets for each material
     const uint32_t numMaterials = (uint32_t)materialTextures.size();
+    const uint32_t numTables = TextureManager::IsStreamingEnabled() ? 2 : 1;
     std::vector<uint32_t> tableOffsets(numMaterials);
+    model.m_MaterialTextures.resize(numMaterials);
 
     for (uint32_t matIdx = 0; matIdx < numMaterials; ++matIdx)
     {
         const MaterialTextureData& srcMat = materialTextures[matIdx];
+        Model::MaterialTextures& material = model.m_MaterialTextures[matIdx];
 
-        DescriptorHandle TextureHandles = Renderer::s_TextureHeap.Alloc(kNumTextures);
+        DescriptorHandle TextureHandles = Renderer::s_TextureHeap.Alloc(kNumTextures * numTables);
         uint32_t SRVDescriptorTable = Renderer::s_TextureHeap.GetOffsetOfHandle(TextureHandles);
 
-        uint32_t DestCount = kNumTextures;
-        uint32_t SourceCounts[kNumTextures] = { 1, 1, 1, 1, 1 };
-
-        D3D12_CPU_DESCRIPTOR_HANDLE DefaultTextures[kNumTextures] =
-        {
-            GetDefaultTexture(kWhiteOpaque2D),
-            GetDefaultTexture(kWhiteOpaque2D),
-            GetDefaultTexture(kWhiteOpaque2D),
-            GetDefaultTexture(kBlackTransparent2D),
-            GetDefaultTexture(kDefaultNormalMap)
-        };
-
-        D3D12_CPU_DESCRIPTOR_HANDLE SourceTextures[kNumTextures];
         for (uint32_t j = 0; j < kNumTextures; ++j)
-        {
-            if (srcMat.stringIdx[j] == 0xffff)
-                SourceTextures[j] = DefaultTextures[j];
-            else
-                SourceTextures[j] = model.textures[srcMat.stringIdx[j]].GetSRV();
-        }
+            material.textureIdx[j] = srcMat.stringIdx[j];
+        material.srvTables[0] = (uint16_t)SRVDescriptorTable;
+        material.srvTables[1] = (uint16_t)(SRVDescriptorTable + kNumTextures * (numTables - 1));
+        model.CopyTextureDescriptors(matIdx, 0);
 
-        g_Device->CopyDescriptors(1, &TextureHandles, &DestCount,
-            DestCount, SourceTextures, SourceCounts, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+        uint32_t DestCount = kNumTextures;
+        uint32_t SourceCounts[kNumTextures] = { 1, 1, 1, 1, 1 };
 
         // See if this combination of samplers has been used before.  If not, allocate more from the heap
         // and copy in the descriptors.
@@ -122,7 +132,7 @@ void LoadMaterials(Model& model,
     }
 
     // Update table offsets for each mesh
-    uint8_t* meshPtr = model.m_MeshData.get();
+    uint8_t* meshPtr = model.m_MeshData;
     for (uint32_t i = 0; i < model.m_NumMeshes; ++i)
     {
         Mesh& mesh = *(Mesh*)meshPtr;
@@ -134,119 +144,420 @@ void LoadMaterials(Model& model,
     }
 }
 
-std::shared_ptr<Model> Renderer::LoadModel(const std::wstring& filePath, bool forceRebuild)
+// Maps a .mini file and checks that it is the current version and that every section lies within it. Returns null
+// when the file has to be rebuilt.
+static std::shared_ptr<Utility::FileMapping> MapMiniFile(const std::wstring& miniFileName)
 {
-    const std::wstring miniFileName = Utility::RemoveExtension(filePath) + L".mini";
-    const std::wstring fileName = Utility::RemoveBasePath(filePath);
+    // Mesh data is patched with descriptor table offsets at load time, so the mapping is copy-on-write. Only the
+    // pages holding meshes ever become private.
+    std::shared_ptr<Utility::FileMapping> file = std::make_shared<Utility::FileMapping>();
+    if (!file->Open(miniFileName, true) || file->GetSize() < sizeof(FileHeader))
+        return nullptr;
+
+    const FileHeader& header = *(const FileHeader*)file->GetData();
+    if (strncmp(header.id, "MINI", 4) != 0 || header.version != CURRENT_MINI_FILE_VERSION)
+        return nullptr;
+
+    for (uint32_t i = 0; i < kNumMiniFileSections; ++i)
+    {
+        const FileSection& section = header.sections[i];
+        if (section.offset % kMiniSectionAlignment != 0 || (uint64_t)section.offset + section.size > file->GetSize())
+            return nullptr;
 
-    struct _stat64 sourceFileStat;
-    struct _stat64 miniFileStat;
-    std::ifstream inFile;
-    FileHeader header;
+        // Only sections that are copied out at load time may be compressed.
+        const bool packable = i == kGeometrySection || i == kKeyFrameSection;
+        if (!section.compressed && section.rawSize != section.size || section.compressed && !packable)
+            return nullptr;
+    }
 
-    bool sourceFileMissing = _wstat64(filePath.c_str(), &sourceFileStat) == -1;
-    bool miniFileMissing = _wstat64(miniFileName.c_str(), &miniFileStat) == -1;
+    if (header.sections[kGeometrySection].rawSize != header.geometrySize ||
+        header.sections[kKeyFrameSection].rawSize != (header.numAnimations > 0 ? header.keyFrameDataSize : 0))
+        return nullptr;
 
-    if (sourceFileMissing)
-        forceRebuild = false;
+    return file;
+}
 
-    if (sourceFileMissing && miniFileMissing)
+// Copies a section to dst, decoding compressed ones one chunk per item on numThreads threads (0 for one per hardware
+// thread). Chunks are all the same size but the last, so handing them out in order keeps the threads evenly loaded.
+static bool DecodeSection(const uint8_t* fileData, const FileSection& section, uint8_t* dst, uint32_t numThreads)
+{
+    if (!section.compressed)
     {
-        Utility::Printf("Error: Could not find %ws\n", fileName.c_str());
-        return nullptr;
+        std::memcpy(dst, fileData + section.offset, section.rawSize);
+        return true;
     }
 
-    bool needBuild = forceRebuild;
+    const size_t numChunks = Compression::GetChunkCount(section.rawSize);
+    if (numThreads == 0)
+        numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    numThreads = (uint32_t)std::min<size_t>(numThreads, numChunks);
 
-    // Check if .mini file exists and it is newer than source file
-    if (miniFileMissing || !sourceFileMissing && sourceFileStat.st_mtime > miniFileStat.st_mtime)
-        needBuild = true;
+    std::atomic<bool> succeeded(true);
+    ParallelFor(numChunks, numThreads, [&](size_t chunkIdx)
+    {
+        if (!Compression::DecompressChunk(fileData + section.offset, section.size, section.rawSize, (uint32_t)chunkIdx, dst))
+            succeeded = false;
+    });
+    return succeeded;
+}
 
-    // Check if it's an older version of .mini
-    if (!needBuild)
+// Reads a .mini file back into the form SaveModel takes, so that only some of it needs to be rebuilt. Compressed
+// sections are decoded on numThreads threads, as in DecodeSection.
+static bool ReadMiniFile(const Utility::FileMapping& file, ModelData& model, uint32_t numThreads)
+{
+    const uint8_t* fileData = file.GetData();
+    const FileHeader& header = *(const FileHeader*)fileData;
+    auto SectionData = [&](MiniFileSection section) { return fileData + header.sections[section].offset; };
+    auto ReadArray = [&](MiniFileSection section, auto& list)
     {
-        inFile = std::ifstream(miniFileName, std::ios::in | std::ios::binary);
-        inFile.read((char*)&header, sizeof(FileHeader));
-        if (strncmp(header.id, "MINI", 4) != 0 || header.version != CURRENT_MINI_FILE_VERSION)
-        {
-            Utility::Printf("Model version deprecated.  Rebuilding %ws...\n", fileName.c_str());
-            needBuild = true;
-            inFile.close();
-        }
+        typedef typename std::remove_reference<decltype(list)>::type::value_type T;
+        const T* elements = (const T*)SectionData(section);
+        list.assign(elements, elements + header.sections[section].size / sizeof(T));
+    };
+    auto ReadPacked = [&](MiniFileSection section, std::vector<byte>& data)
+    {
+        data.resize(header.sections[section].rawSize);
+        return data.empty() || DecodeSection(fileData, header.sections[section], data.data(), numThreads);
+    };
+
+    if (!ReadPacked(kGeometrySection, model.m_GeometryData) || !ReadPacked(kKeyFrameSection, model.m_AnimationKeyFrameData))
+        return false;
+
+    ReadArray(kSceneGraphSection, model.m_SceneGraph);
+    ReadArray(kMeshletSection, model.m_Meshlets);
+    ReadArray(kMeshletRangeSection, model.m_MeshletRanges);
+    ReadArray(kLodSection, model.m_Lods);
+    ReadArray(kLodRangeSection, model.m_LodRanges);
+    ReadArray(kMaterialConstantSection, model.m_MaterialConstants);
+    ReadArray(kMaterialTextureSection, model.m_MaterialTextures);
+    ReadArray(kTextureOptionSection, model.m_TextureOptions);
+    ReadArray(kAnimationCurveSection, model.m_AnimationCurves);
+    ReadArray(kAnimationSection, model.m_Animations);
+    ReadArray(kJointIndexSection, model.m_JointIndices);
+    ReadArray(kJointIBMSection, model.m_JointIBMs);
+
+    const char* stringTable = (const char*)SectionData(kStringTableSection);
+    const char* stringTableEnd = stringTable + header.sections[kStringTableSection].size;
+    model.m_TextureNames.resize(header.numTextures);
+    for (uint32_t i = 0; i < header.numTextures; ++i)
+    {
+        const char* stringEnd = std::find(stringTable, stringTableEnd, '\0');
+        model.m_TextureNames[i].assign(stringTable, stringEnd);
+        stringTable = std::min(stringEnd + 1, stringTableEnd);
     }
 
-    if (needBuild)
+    // Meshes are variable sized and allocated one by one, as CompileMesh does.
+    const uint8_t* meshPtr = SectionData(kMeshSection);
+    const uint8_t* meshEnd = meshPtr + header.sections[kMeshSection].size;
+    for (uint32_t i = 0; i < header.numMeshes; ++i)
     {
-        if (sourceFileMissing)
-        {
+        const Mesh& mesh = *(const Mesh*)meshPtr;
+        if ((size_t)(meshEnd - meshPtr) < sizeof(Mesh) || mesh.numDraws == 0 ||
+            (size_t)(meshEnd - meshPtr) < sizeof(Mesh) + (mesh.numDraws - 1) * sizeof(Mesh::Draw))
+            return false;
+
+        const size_t meshSize = sizeof(Mesh) + (mesh.numDraws - 1) * sizeof(Mesh::Draw);
+        Mesh* copy = (Mesh*)malloc(meshSize);
+        std::memcpy(copy, meshPtr, meshSize);
+        model.m_Meshes.push_back(copy);
+        meshPtr += meshSize;
+    }
+
+    if (model.m_SceneGraph.size() != header.numNodes || model.m_MaterialConstants.size() != header.numMaterials ||
+        model.m_MaterialTextures.size() != header.numMaterials || model.m_TextureOptions.size() != header.numTextures ||
+        model.m_Animations.size() != header.numAnimations || model.m_AnimationCurves.size() != header.numAnimationCurves ||
+        model.m_JointIndices.size() != header.numJoints || model.m_JointIBMs.size() != header.numJoints)
+        return false;
+
+    model.m_BoundingSphere = BoundingSphere(*(XMFLOAT4*)header.boundingSphere);
+    model.m_BoundingBox = AxisAlignedBox(Vector3(*(XMFLOAT3*)header.minPos), Vector3(*(XMFLOAT3*)header.maxPos));
+    return true;
+}
+
+static void FreeMeshes(ModelData& model)
+{
+    for (Mesh* mesh : model.m_Meshes)
+        free(mesh);
+    model.m_Meshes.clear();
+}
+
+static double MillisecondsSince(std::chrono::high_resolution_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// Brings the .mini beside a model file up to date with it and maps it. Only the stages whose keys changed are
+// rebuilt; the rest are read back from the old .mini. Returns null if there is no usable .mini.
+static std::shared_ptr<Utility::FileMapping> UpdateMiniFile(const std::wstring& filePath, const std::wstring& miniFileName,
+    const ModelBuildGraph::BuildOptions& options, bool forceRebuild, uint32_t numThreads, CookStats& stats)
+{
+    using namespace ModelBuildGraph;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    stats = CookStats();
+
+    const std::wstring fileName = Utility::RemoveBasePath(filePath);
+    const std::wstring manifestName = GetManifestName(miniFileName);
+
+    uint64_t sourceSize;
+    int64_t sourceModifiedTime;
+    if (!StatFile(filePath, sourceSize, sourceModifiedTime))
+    {
+        // Without the source, a .mini that is there is used as it is.
+        std::shared_ptr<Utility::FileMapping> miniFile = MapMiniFile(miniFileName);
+        if (miniFile == nullptr)
             Utility::Printf("Error: Could not find %ws\n", fileName.c_str());
+        stats.upToDate = miniFile != nullptr;
+        return miniFile;
+    }
+
+    // The manifest only counts if the .mini is still the one it was written for.
+    Manifest previous;
+    std::shared_ptr<Utility::FileMapping> miniFile;
+    if (!forceRebuild && ReadManifest(manifestName, previous) && previous.miniVersion == CURRENT_MINI_FILE_VERSION)
+    {
+        uint64_t miniSize;
+        int64_t miniModifiedTime;
+        if (StatFile(miniFileName, miniSize, miniModifiedTime) && miniSize == previous.miniSize &&
+            miniModifiedTime == previous.miniModifiedTime)
+            miniFile = MapMiniFile(miniFileName);
+    }
+    if (miniFile == nullptr)
+        previous.sources.clear();
+
+    const bool sameOptions = previous.options.sceneIdx == options.sceneIdx &&
+        previous.options.quantizePositions == options.quantizePositions &&
+        previous.options.compressTextures == options.compressTextures &&
+        previous.options.compressFile == options.compressFile;
+
+    bool touched = false;
+    if (miniFile != nullptr && sameOptions && UpdateSources(previous.sources, touched))
+    {
+        if (touched)
+            WriteManifest(manifestName, previous);
+        stats.upToDate = true;
+        stats.totalMs = MillisecondsSince(start);
+        return miniFile;
+    }
+
+    Manifest manifest;
+    manifest.miniVersion = CURRENT_MINI_FILE_VERSION;
+    manifest.options = options;
+
+    ModelData modelData;
+    uint32_t stages = kAllStages;
+    const std::wstring fileExt = Utility::ToLower(Utility::GetFileExtension(filePath));
+
+    if (fileExt == L"gltf" || fileExt == L"glb")
+    {
+        auto parseStart = std::chrono::high_resolution_clock::now();
+        glTF::Asset asset(filePath);
+        if (!GatherSources(filePath, asset.m_bufferFiles, previous.sources, manifest.sources))
             return nullptr;
-        }
+        stats.parseMs = MillisecondsSince(parseStart);
 
-        ModelData modelData;
+        auto keyStart = std::chrono::high_resolution_clock::now();
+        ComputeStageKeys(asset, options, manifest.stageKeys, numThreads);
+        stats.keyMs = MillisecondsSince(keyStart);
 
-        const std::wstring fileExt = Utility::ToLower(Utility::GetFileExtension(filePath));
+        if (miniFile != nullptr)
+        {
+            stages = GetDirtyStages(previous.stageKeys, manifest.stageKeys);
 
-        if (fileExt == L"gltf" || fileExt == L"glb")
+            // Nothing that any stage reads changed, so the .mini stands unless it is to be stored differently.
+            if (stages == 0 && previous.options.compressFile == options.compressFile)
+            {
+                manifest.miniSize = previous.miniSize;
+                manifest.miniModifiedTime = previous.miniModifiedTime;
+                WriteManifest(manifestName, manifest);
+                stats.upToDate = true;
+                stats.totalMs = MillisecondsSince(start);
+                return miniFile;
+            }
+
+            if (stages != kAllStages && !ReadMiniFile(*miniFile, modelData, numThreads))
+            {
+                FreeMeshes(modelData);
+                modelData = ModelData();
+                stages = kAllStages;
+            }
+        }
+
+        std::string stageList;
+        for (uint32_t stage = 0; stage < kNumStages; ++stage)
         {
-            glTF::Asset asset(filePath);
-            if (!BuildModel(modelData, asset))
-                return nullptr;
+            if (stages & (1u << stage))
+                stageList += std::string(stageList.empty() ? "" : ", ") + GetStageName(stage);
         }
-        else if (fileExt == L"h3d")
+        Utility::Printf("Building %ws (%s)...\n", fileName.c_str(), stages != 0 ? stageList.c_str() : "rewriting only");
+
+        // Stages don't read each other's output, so they are built one at a time to time each of them.
+        for (uint32_t stage = 0; stage < kNumStages; ++stage)
         {
-            ModelH3D modelh3d;
-            const std::wstring basePath = Utility::GetBasePath(filePath);
-            if (!modelh3d.Load(filePath) || !modelh3d.BuildModel(modelData, basePath))
+            if ((stages & (1u << stage)) == 0)
+                continue;
+
+            auto stageStart = std::chrono::high_resolution_clock::now();
+            if (!BuildModel(modelData, asset, options.sceneIdx, numThreads, options.quantizePositions, 1u << stage))
+            {
+                FreeMeshes(modelData);
                 return nullptr;
+            }
+            stats.stageMs[stage] = MillisecondsSince(stageStart);
         }
-        else
-        {
-            Utility::Printf(L"Unsupported model file extension: %ws\n", fileExt.c_str());
+    }
+    else if (fileExt == L"h3d")
+    {
+        // H3D models are always built whole, keyed by their file.
+        if (!GatherSources(filePath, std::vector<std::wstring>(), previous.sources, manifest.sources))
             return nullptr;
-        }
+        for (uint32_t stage = 0; stage < kNumStages; ++stage)
+            manifest.stageKeys[stage] = manifest.sources[0].hash;
 
-        if (!SaveModel(miniFileName, modelData))
+        Utility::Printf("Building %ws...\n", fileName.c_str());
+        ModelH3D modelh3d;
+        const std::wstring basePath = Utility::GetBasePath(filePath);
+        if (!modelh3d.Load(filePath) || !modelh3d.BuildModel(modelData, basePath))
             return nullptr;
+    }
+    else
+    {
+        Utility::Printf(L"Unsupported model file extension: %ws\n", fileExt.c_str());
+        return nullptr;
+    }
 
-        inFile = std::ifstream(miniFileName, std::ios::in | std::ios::binary);
-        inFile.read((char*)&header, sizeof(FileHeader));
+    // Textures are converted when the model loads, with the options saved here.
+    if (options.compressTextures && (stages & (1u << kMaterialStage)))
+    {
+        for (uint8_t& textureOptions : modelData.m_TextureOptions)
+        {
+            if (textureOptions != 0xFF)
+                textureOptions |= kDefaultBC;
+        }
     }
 
-    if (!inFile)
+    // The old file is released before it is replaced, and its manifest removed in case the save fails.
+    miniFile = nullptr;
+    _wremove(manifestName.c_str());
+
+    auto saveStart = std::chrono::high_resolution_clock::now();
+    const bool saved = SaveModel(miniFileName, modelData, options.compressFile);
+    FreeMeshes(modelData);
+    if (!saved)
         return nullptr;
+    stats.saveMs = MillisecondsSince(saveStart);
+    stats.rebuiltStages = stages;
+
+    if (!StatFile(miniFileName, manifest.miniSize, manifest.miniModifiedTime) || !WriteManifest(manifestName, manifest))
+        Utility::Printf("Warning: Could not write %ws; the model will be rebuilt whole next time\n", manifestName.c_str());
+
+    stats.totalMs = MillisecondsSince(start);
+    Utility::Printf("Built %ws in %.0f ms\n", fileName.c_str(), stats.totalMs);
+
+    return MapMiniFile(miniFileName);
+}
+
+// Reads the names of the textures a .mini file uses, relative to its model file, and their conversion options.
+static void ReadTextureTable(const uint8_t* fileData, std::vector<std::wstring>& textureNames,
+    std::vector<uint8_t>& textureOptions)
+{
+    const FileHeader& header = *(const FileHeader*)fileData;
+
+    textureNames.resize(header.numTextures);
+    const char* stringTable = (const char*)fileData + header.sections[kStringTableSection].offset;
+    const char* stringTableEnd = stringTable + header.sections[kStringTableSection].size;
+    for (uint32_t i = 0; i < header.numTextures; ++i)
+    {
+        const char* stringEnd = std::find(stringTable, stringTableEnd, '\0');
+        textureNames[i] = Utility::UTF8ToWideString(std::string(stringTable, stringEnd));
+        stringTable = std::min(stringEnd + 1, stringTableEnd);
+    }
+
+    const uint8_t* textureOptionData = fileData + header.sections[kTextureOptionSection].offset;
+    textureOptions.assign(textureOptionData, textureOptionData + header.numTextures);
+}
+
+bool Renderer::CookModel(const std::wstring& filePath, const ModelBuildGraph::BuildOptions& options, bool forceRebuild,
+    uint32_t numThreads, CookStats& stats, std::vector<TextureCompileJob>& textureJobs)
+{
+    const std::wstring miniFileName = Utility::RemoveExtension(filePath) + L".mini";
+
+    std::shared_ptr<Utility::FileMapping> miniFile = UpdateMiniFile(filePath, miniFileName, options, forceRebuild,
+        numThreads, stats);
+    if (miniFile == nullptr)
+        return false;
+
+    std::vector<std::wstring> textureNames;
+    std::vector<uint8_t> textureOptions;
+    ReadTextureTable(miniFile->GetData(), textureNames, textureOptions);
 
-    ASSERT(strncmp(header.id, "MINI", 4) == 0 && header.version == CURRENT_MINI_FILE_VERSION);
+    const std::wstring basePath = Utility::GetBasePath(filePath);
+    for (size_t ti = 0; ti < textureNames.size(); ++ti)
+    {
+        TextureCompileJob job;
+        job.originalFile = basePath + textureNames[ti];
+        job.flags = textureOptions[ti];
+        textureJobs.push_back(job);
+    }
+    return true;
+}
+
+std::shared_ptr<Model> Renderer::LoadModel(const std::wstring& filePath, bool forceRebuild)
+{
+    const std::wstring miniFileName = Utility::RemoveExtension(filePath) + L".mini";
+
+    ModelBuildGraph::BuildOptions options;
+    options.quantizePositions = QuantizeModelVertices;
+    options.compressTextures = CompressTextures;
+    options.compressFile = CompressModelFiles;
+
+    CookStats stats;
+    std::shared_ptr<Utility::FileMapping> miniFile = UpdateMiniFile(filePath, miniFileName, options, forceRebuild, 0, stats);
+    if (miniFile == nullptr)
+        return nullptr;
+
+    uint8_t* fileData = miniFile->GetData();
+    const FileHeader& header = *(const FileHeader*)fileData;
+    auto SectionData = [&](MiniFileSection section) { return fileData + header.sections[section].offset; };
 
     std::wstring basePath = Utility::GetBasePath(filePath);
 
     std::shared_ptr<Model> model(new Model);
 
+    // Everything the model reads on the CPU is used straight out of the mapping, which the model keeps open.
+    model->m_FileMapping = miniFile;
     model->m_NumNodes = header.numNodes;
-    model->m_SceneGraph.reset(new GraphNode[header.numNodes]);
+    model->m_SceneGraph = (const GraphNode*)SectionData(kSceneGraphSection);
     model->m_NumMeshes = header.numMeshes;
-    model->m_MeshData.reset(new uint8_t[header.meshDataSize]);
+    model->m_MeshData = SectionData(kMeshSection);
 
 	if (header.geometrySize > 0)
 	{
+		// Reading ahead lets the copy run at disk speed instead of taking one page fault at a time.
+		miniFile->Prefetch(header.sections[kGeometrySection].offset, header.geometrySize);
+
+		// Compressed geometry is decoded in parallel straight into the upload buffer.
 		UploadBuffer modelData;
 		modelData.Create(L"Model Data Upload", header.geometrySize);
-		inFile.read((char*)modelData.Map(), header.geometrySize);
+		const bool decoded = DecodeSection(fileData, header.sections[kGeometrySection], (uint8_t*)modelData.Map(), 0);
 		modelData.Unmap();
+		if (!decoded)
+		{
+			Utility::Printf("Error: Corrupt geometry in %ws\n", miniFileName.c_str());
+			return nullptr;
+		}
 		model->m_DataBuffer.Create(L"Model Data", header.geometrySize, 1, modelData);
 	}
 
-    inFile.read((char*)model->m_SceneGraph.get(), header.numNodes * sizeof(GraphNode));
-    inFile.read((char*)model->m_MeshData.get(), header.meshDataSize);
-
 	if (header.numMaterials > 0)
 	{
 		UploadBuffer materialConstants;
 		materialConstants.Create(L"Material Constant Upload", header.numMaterials * sizeof(MaterialConstants));
 		MaterialConstants* materialCBV = (MaterialConstants*)materialConstants.Map();
+		const MaterialConstantData* materialData = (const MaterialConstantData*)SectionData(kMaterialConstantSection);
 		for (uint32_t i = 0; i < header.numMaterials; ++i)
 		{
-			inFile.read((char*)materialCBV, sizeof(MaterialConstantData));
+			std::memcpy(materialCBV, materialData + i, sizeof(MaterialConstantData));
 			materialCBV++;
 		}
 		materialConstants.Unmap();
@@ -254,19 +565,12 @@ std::shared_ptr<Model> Renderer::LoadModel(const std::wstring& filePath, bool fo
 	}
 
     // Read material texture and sampler properties so we can load the material
-    std::vector<MaterialTextureData> materialTextures(header.numMaterials);
-    inFile.read((char*)materialTextures.data(), header.numMaterials * sizeof(MaterialTextureData));
+    const MaterialTextureData* materialTextureData = (const MaterialTextureData*)SectionData(kMaterialTextureSection);
+    std::vector<MaterialTextureData> materialTextures(materialTextureData, materialTextureData + header.numMaterials);
 
-    std::vector<std::wstring> textureNames(header.numTextures);
-    for (uint32_t i = 0; i < header.numTextures; ++i)
-    {
-        std::string utf8TextureName;
-        std::getline(inFile, utf8TextureName, '\0');
-        textureNames[i] = Utility::UTF8ToWideString(utf8TextureName);
-    }
-
-    std::vector<uint8_t> textureOptions(header.numTextures);
-    inFile.read((char*)textureOptions.data(), header.numTextures * sizeof(uint8_t));
+    std::vector<std::wstring> textureNames;
+    std::vector<uint8_t> textureOptions;
+    ReadTextureTable(fileData, textureNames, textureOptions);
 
     LoadMaterials(*model, materialTextures, textureNames, textureOptions, basePath);
 
@@ -275,27 +579,190 @@ std::shared_ptr<Model> Renderer::LoadModel(const std::wstring& filePath, bool fo
 
     // Load animation data
     model->m_NumAnimations = header.numAnimations;
+    model->m_KeyFrameData = nullptr;
+    model->m_CurveData = nullptr;
+    model->m_Animations = nullptr;
 
     if (header.numAnimations > 0)
     {
         ASSERT(header.keyFrameDataSize > 0 && header.numAnimationCurves > 0);
-        model->m_KeyFrameData.reset(new uint8_t[header.keyFrameDataSize]);
-        inFile.read((char*)model->m_KeyFrameData.get(), header.keyFrameDataSize);
-        model->m_CurveData.reset(new AnimationCurve[header.numAnimationCurves]);
-        inFile.read((char*)model->m_CurveData.get(), header.numAnimationCurves * sizeof(AnimationCurve));
-        model->m_Animations.reset(new AnimationSet[header.numAnimations]);
-        inFile.read((char*)model->m_Animations.get(), header.numAnimations * sizeof(AnimationSet));
+        const FileSection& keyFrameSection = header.sections[kKeyFrameSection];
+        if (keyFrameSection.compressed)
+        {
+            model->m_DecodedKeyFrames.reset(new uint8_t[keyFrameSection.rawSize]);
+            if (!DecodeSection(fileData, keyFrameSection, model->m_DecodedKeyFrames.get(), 0))
+            {
+                Utility::Printf("Error: Corrupt animation data in %ws\n", miniFileName.c_str());
+                return nullptr;
+            }
+            model->m_KeyFrameData = model->m_DecodedKeyFrames.get();
+        }
+        else
+        {
+            model->m_KeyFrameData = SectionData(kKeyFrameSection);
+        }
+        model->m_CurveData = (const AnimationCurve*)SectionData(kAnimationCurveSection);
+        model->m_Animations = (const AnimationSet*)SectionData(kAnimationSection);
     }
 
     model->m_NumJoints = header.numJoints;
+    model->m_JointIndices = nullptr;
+    model->m_JointIBMs = nullptr;
 
     if (header.numJoints > 0)
     {
-        model->m_JointIndices.reset(new uint16_t[header.numJoints]);
-        inFile.read((char*)model->m_JointIndices.get(), header.numJoints * sizeof(uint16_t));
-        model->m_JointIBMs.reset(new Matrix4[header.numJoints]);
-        inFile.read((char*)model->m_JointIBMs.get(), header.numJoints * sizeof(Matrix4));
+        model->m_JointIndices = (const uint16_t*)SectionData(kJointIndexSection);
+        model->m_JointIBMs = (const Matrix4*)SectionData(kJointIBMSection);
+    }
+
+    // Meshes without meshlets or LODs (or with ranges that don't line up with their draws) are culled whole and drawn
+    // at full detail.
+    model->m_Meshlets = nullptr;
+    model->m_MeshletRanges = nullptr;
+    model->m_Lods = nullptr;
+    model->m_LodRanges = nullptr;
+
+    std::vector<const Mesh*> drawMeshes;
+    {
+        const uint8_t* pMesh = model->m_MeshData;
+        for (uint32_t i = 0; i < header.numMeshes; ++i)
+        {
+            const Mesh& mesh = *(const Mesh*)pMesh;
+            drawMeshes.insert(drawMeshes.end(), mesh.numDraws, &mesh);
+            pMesh += sizeof(Mesh) + (mesh.numDraws - 1) * sizeof(Mesh::Draw);
+        }
+    }
+    const uint32_t numDraws = (uint32_t)drawMeshes.size();
+
+    const FileSection& meshletSection = header.sections[kMeshletSection];
+    const FileSection& meshletRangeSection = header.sections[kMeshletRangeSection];
+    if (meshletRangeSection.size > 0)
+    {
+        const uint32_t numMeshlets = meshletSection.size / sizeof(Meshlet);
+        const MeshletRange* ranges = (const MeshletRange*)SectionData(kMeshletRangeSection);
+        bool valid = meshletRangeSection.size == numDraws * sizeof(MeshletRange);
+        for (uint32_t i = 0; valid && i < numDraws; ++i)
+            valid = ranges[i].first <= numMeshlets && ranges[i].count <= numMeshlets - ranges[i].first;
+
+        if (valid)
+        {
+            model->m_Meshlets = (const Meshlet*)SectionData(kMeshletSection);
+            model->m_MeshletRanges = ranges;
+        }
+        else
+        {
+            Utility::Printf("Warning: Ignoring malformed meshlets in %ws\n", miniFileName.c_str());
+        }
+    }
+
+    const FileSection& lodSection = header.sections[kLodSection];
+    const FileSection& lodRangeSection = header.sections[kLodRangeSection];
+    if (lodRangeSection.size > 0)
+    {
+        const uint32_t numLods = lodSection.size / sizeof(MeshLod);
+        const MeshLod* lods = (const MeshLod*)SectionData(kLodSection);
+        const MeshLodRange* ranges = (const MeshLodRange*)SectionData(kLodRangeSection);
+        bool valid = lodRangeSection.size == numDraws * sizeof(MeshLodRange);
+        for (uint32_t i = 0, drawIdx = 0; valid && i < numDraws; ++i)
+        {
+            valid = ranges[i].first <= numLods && ranges[i].count <= numLods - ranges[i].first;
+
+            // Every level has to stay inside its mesh's index buffer.
+            const Mesh& mesh = *drawMeshes[i];
+            drawIdx = i > 0 && drawMeshes[i - 1] == &mesh ? drawIdx + 1 : 0;
+            const uint64_t numIndices = mesh.ibSize / (mesh.ibFormat == DXGI_FORMAT_R32_UINT ? 4 : 2);
+            for (uint32_t k = 0; valid && k < ranges[i].count; ++k)
+            {
+                const MeshLod& lod = lods[ranges[i].first + k];
+                valid = (uint64_t)mesh.draw[drawIdx].startIndex + lod.startIndex + lod.primCount <= numIndices;
+            }
+        }
+
+        if (valid)
+        {
+            model->m_Lods = lods;
+            model->m_LodRanges = ranges;
+        }
+        else
+        {
+            Utility::Printf("Warning: Ignoring malformed LODs in %ws\n", miniFileName.c_str());
+        }
     }
 
     return model;
 }
+
+bool Renderer::BenchmarkModelCompression(const std::wstring& miniFileName)
+{
+    std::shared_ptr<Utility::FileMapping> miniFile = MapMiniFile(miniFileName);
+    if (miniFile == nullptr)
+    {
+        Utility::Printf("Error: %ws is missing or out of date\n", miniFileName.c_str());
+        return false;
+    }
+
+    const uint8_t* fileData = miniFile->GetData();
+    const FileHeader& header = *(const FileHeader*)fileData;
+    const FileSection& geometrySection = header.sections[kGeometrySection];
+    std::vector<uint8_t> geometry(header.geometrySize);
+    if (geometry.empty() || !DecodeSection(fileData, geometrySection, geometry.data(), 0))
+        return false;
+
+    // The same shuffle candidates SaveModel tries
+    std::vector<uint32_t> vertexStrides = { 0, 4 };
+    const uint8_t* meshPtr = fileData + header.sections[kMeshSection].offset;
+    for (uint32_t i = 0; i < header.numMeshes; ++i)
+    {
+        const Mesh& mesh = *(const Mesh*)meshPtr;
+        if (std::find(vertexStrides.begin(), vertexStrides.end(), mesh.vbStride) == vertexStrides.end())
+            vertexStrides.push_back(mesh.vbStride);
+        meshPtr += sizeof(Mesh) + (mesh.numDraws - 1) * sizeof(Mesh::Draw);
+    }
+
+    struct Variant
+    {
+        const char* name;
+        bool compressed;
+        std::vector<uint32_t> shuffleStrides;
+    };
+    const Variant variants[] =
+    {
+        { "raw", false, {} },
+        { "LZ", true, { 0 } },
+        { "LZ + shuffle", true, vertexStrides },
+    };
+
+    Utility::Printf("Model compression benchmark: %u bytes of geometry, %u hardware threads\n",
+        header.geometrySize, std::thread::hardware_concurrency());
+
+    bool allMatch = true;
+    std::vector<uint8_t> decoded(geometry.size());
+    for (const Variant& variant : variants)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        std::vector<uint8_t> stream = variant.compressed ?
+            Compression::CompressChunked(geometry.data(), geometry.size(), variant.shuffleStrides) : geometry;
+        const double encodeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+        FileSection section = {};
+        section.size = (uint32_t)stream.size();
+        section.rawSize = (uint32_t)geometry.size();
+        section.compressed = variant.compressed;
+
+        double decodeMs = DBL_MAX;
+        for (int run = 0; run < 5; ++run)
+        {
+            start = std::chrono::high_resolution_clock::now();
+            allMatch &= DecodeSection(stream.data(), section, decoded.data(), 0);
+            decodeMs = std::min(decodeMs, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+        }
+        allMatch &= decoded == geometry;
+
+        Utility::Printf("  %-13s %11zu bytes (%5.1f%%), encode %8.1f ms, decode %7.2f ms (%6.0f MB/s)\n",
+            variant.name, stream.size(), 100.0 * stream.size() / geometry.size(), encodeMs, decodeMs,
+            geometry.size() / (decodeMs * 1e-3) / (1024.0 * 1024.0));
+    }
+
+    Utility::Printf("Model compression benchmark: %s\n", allMatch ? "all variants decode correctly" : "FAILED");
+    return allMatch;
+}
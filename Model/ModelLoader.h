@@ -16,15 +16,18 @@
 #include "Model.h"
 #include "Animation.h"
 #include "ConstantBuffers.h"
+#include "ModelBuildGraph.h"
 #include "../Core/Math/BoundingSphere.h"
 #include "../Core/Math/BoundingBox.h"
+#include "../Core/EngineTuning.h"
 
 #include <cstdint>
 #include <vector>
 
 namespace glTF { class Asset; struct Mesh; }
+struct TextureCompileJob;
 
-#define CURRENT_MINI_FILE_VERSION 13
+#define CURRENT_MINI_FILE_VERSION 20
 
 namespace Renderer
 {
@@ -62,11 +65,48 @@ namespace Renderer
         std::vector<MaterialTextureData> m_MaterialTextures;
         std::vector<MaterialConstantData> m_MaterialConstants;
         std::vector<Mesh*> m_Meshes;
+        std::vector<Meshlet> m_Meshlets;
+        std::vector<MeshletRange> m_MeshletRanges;  // One per Mesh::Draw
+        std::vector<MeshLod> m_Lods;
+        std::vector<MeshLodRange> m_LodRanges;      // One per Mesh::Draw
         std::vector<GraphNode> m_SceneGraph;
         std::vector<std::string> m_TextureNames;
         std::vector<uint8_t> m_TextureOptions;
     };
 
+    // The sections of a .mini file. Each one starts on a kMiniSectionAlignment boundary so that a mapped file can be
+    // used in place.
+    enum MiniFileSection
+    {
+        kGeometrySection,
+        kSceneGraphSection,
+        kMeshSection,
+        kMaterialConstantSection,
+        kMaterialTextureSection,
+        kStringTableSection,
+        kTextureOptionSection,
+        kKeyFrameSection,
+        kAnimationCurveSection,
+        kAnimationSection,
+        kJointIndexSection,
+        kJointIBMSection,
+        kMeshletSection,
+        kMeshletRangeSection,
+        kLodSection,
+        kLodRangeSection,
+        kNumMiniFileSections
+    };
+
+    const uint32_t kMiniSectionAlignment = 64;
+
+    struct FileSection
+    {
+        uint32_t offset;      // From the start of the file
+        uint32_t size;        // Stored size
+        uint32_t rawSize;     // Decoded size
+        uint32_t compressed;  // Nonzero for a Compression chunked stream
+    };
+
     struct FileHeader
     {
         char     id[4];   // "MINI"
@@ -85,11 +125,16 @@ namespace Renderer
         float    boundingSphere[4];
         float    minPos[3];
         float    maxPos[3];
+        FileSection sections[kNumMiniFileSections];
     };
 
     void CompileMesh(
         std::vector<Mesh*>& meshList,
         std::vector<byte>& bufferMemory,
+        std::vector<Meshlet>& meshletList,
+        std::vector<MeshletRange>& meshletRanges,
+        std::vector<MeshLod>& lodList,
+        std::vector<MeshLodRange>& lodRanges,
         glTF::Mesh& srcMesh,
         uint32_t matrixIdx,
         const Matrix4& localToObject,
@@ -97,8 +142,56 @@ namespace Renderer
         Math::AxisAlignedBox& boundingBox
     );
 
-    bool BuildModel( ModelData& model, const glTF::Asset& asset, int sceneIdx = -1 );
-    bool SaveModel( const std::wstring& filePath, const ModelData& model );
+    // Mesh primitives are optimized on numThreads threads (0 for one per hardware thread); the result doesn't depend
+    // on the thread count. With quantizePositions, vertex positions are stored as UNORM16 within their mesh's bounds.
+    // Only the parts of model in stages, a mask of ModelBuildGraph stages, are rebuilt; the rest is left as it is.
+    bool BuildModel( ModelData& model, const glTF::Asset& asset, int sceneIdx = -1, uint32_t numThreads = 0,
+        bool quantizePositions = false, uint32_t stages = ModelBuildGraph::kAllStages );
+
+    // Builds the asset's meshes with 1, 2, 4, ... threads up to the hardware thread count, checks that every build
+    // matches the single-threaded one byte for byte and prints the speedups. Returns whether all builds matched.
+    bool BenchmarkBuildModel( const glTF::Asset& asset );
+
+    // Builds the asset's meshes with float and with quantized positions and prints the vertex stream sizes and how far
+    // the quantized positions are from the float ones. Returns whether the two builds line up.
+    bool ReportVertexQuantization( const glTF::Asset& asset );
+
+    // With compress set, the geometry and keyframe sections are stored as chunked LZ streams; everything else stays
+    // raw so that it can be used in place.
+    bool SaveModel( const std::wstring& filePath, const ModelData& model, bool compress = false );
+
+    // Decodes the geometry section of a .mini file, raw, without shuffling and shuffled, on all cores and prints the
+    // stored sizes and decode times.
+    bool BenchmarkModelCompression( const std::wstring& miniFileName );
+
+    // Whether LoadModel compresses the .mini files it rebuilds.
+    extern BoolVar CompressModelFiles;
+
+    // Whether LoadModel quantizes the vertex positions of the models it rebuilds.
+    extern BoolVar QuantizeModelVertices;
+
+    // Whether the models LoadModel rebuilds have their textures block compressed (BC1, or BC3 with alpha).
+    extern BoolVar CompressTextures;
     
+    // What CookModel did to a model and how long each part of it took.
+    struct CookStats
+    {
+        bool upToDate = false;          // The .mini was used as it was; nothing was built or written
+        uint32_t rebuiltStages = 0;     // A mask of the ModelBuildGraph stages rebuilt
+        double parseMs = 0.0;           // Parsing the model file and hashing its sources
+        double keyMs = 0.0;             // Computing the stage keys
+        double stageMs[ModelBuildGraph::kNumStages] = {};
+        double saveMs = 0.0;
+        double totalMs = 0.0;
+    };
+
+    // Brings the model's .mini up to date without a graphics device, as LoadModel does but with the options given
+    // instead of the tuning variables, and building on numThreads threads (0 for one per hardware thread). Appends
+    // the textures the model uses to textureJobs, for converting those of many models in one batch.
+    bool CookModel( const std::wstring& filePath, const ModelBuildGraph::BuildOptions& options, bool forceRebuild,
+        uint32_t numThreads, CookStats& stats, std::vector<TextureCompileJob>& textureJobs );
+
+    // Rebuilds only the parts of the model's .mini whose inputs changed since it was built, as recorded in the
+    // ModelBuildGraph manifest beside it. forceRebuild rebuilds all of it.
     std::shared_ptr<Model> LoadModel( const std::wstring& filePath, bool forceRebuild = false );
 }
\ No newline at end of file
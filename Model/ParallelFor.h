@@ -0,0 +1,27 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// Runs fn(0) .. fn(count - 1) on up to numThreads threads, the calling one included. Items are handed out in order
+// from a shared counter, so callers sort them by descending cost to keep the threads evenly loaded.
+template <typename Function>
+inline void ParallelFor(size_t count, uint32_t numThreads, const Function& fn)
+{
+    std::atomic<size_t> nextItem(0);
+    auto worker = [&]()
+    {
+        for (size_t item = nextItem++; item < count; item = nextItem++)
+            fn(item);
+    };
+
+    std::vector<std::thread> threads;
+    for (uint32_t i = 1; i < numThreads && i < count; ++i)
+        threads.emplace_back(worker);
+    worker();
+    for (std::thread& thread : threads)
+        thread.join();
+}
@@ -13,6 +13,7 @@
 
 #include "Renderer.h"
 #include "Model.h"
+#include "MeshConvert.h"
 #include "TextureManager.h"
 #include "ConstantBuffers.h"
 #include "LightManager.h"
@@ -52,6 +53,9 @@
 // JFA
 #include "../Model/CompiledShaders/JFA3DCS.h"
 
+// SDF min-distance pyramid
+#include "../Model/CompiledShaders/SDFMinMipCS.h"
+
 #include <algorithm>
 
 #pragma warning(disable:4319) // '~': zero extending 'uint32_t' to 'uint64_t' of greater size
@@ -63,6 +67,10 @@ using namespace Renderer;
 namespace Renderer
 {
     BoolVar SeparateZPass("Renderer/Separate Z Pass", true);
+    BoolVar ClusterCulling("Renderer/Cluster Culling", true);
+    BoolVar MeshLODs("Renderer/Mesh LODs", true);
+    NumVar LODPixelError("Renderer/LOD Pixel Error", 1.0f, 0.25f, 16.0f, 0.25f);
+    BoolVar HierarchicalSDFTrace("Renderer/Hierarchical SDF Trace", false);
 
     bool s_Initialized = false;
 
@@ -70,6 +78,13 @@ namespace Renderer
     DescriptorHeap s_SamplerHeap;
     std::vector<GraphicsPSO> sm_PSOs;
 
+    // Depth and shadow PSOs for float positions, then the same for quantized ones. Color PSOs follow.
+    const uint32_t kNumDepthPSOs = 16;
+    const uint32_t kQuantizedDepthPSOs = kNumDepthPSOs / 2;
+
+    // The MeshQuantization cbuffer of the vertex shaders: two float3s, each padded to a float4
+    const uint32_t kNumMeshQuantizationConstants = 8;
+
     TextureRef s_RadianceCubeMap;
     TextureRef s_IrradianceCubeMap;
     float s_SpecularIBLRange;
@@ -102,6 +117,11 @@ namespace Renderer
 
     JFAGlobalConstants m_jfaGlobals;
 
+    // SDFGI: SDF min-distance pyramid (levels 1 and up; level 0 is m_FinalSDFOutput)
+    RootSignature m_SDFMipRS;
+    ComputePSO m_SDFMipPSO;
+    Texture m_SDFMips[SDF_HIERARCHY_COARSE_LEVELS];
+
     // SDFGI: SDF Ray March Debug
     DescriptorHeap m_SDFRayMarchTextureHeap; 
     DescriptorHandle m_SDFTextures;
@@ -146,99 +166,81 @@ void Renderer::Initialize(void)
     // For Voxel PSO's
     m_RootSig[kSDFGICommonCBV].InitAsConstantBuffer(3, D3D12_SHADER_VISIBILITY_ALL);
     m_RootSig[kSDFGIVoxelUAVs].InitAsDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 0, 2, D3D12_SHADER_VISIBILITY_PIXEL);
+    m_RootSig[kMeshQuantization].InitAsConstants(4, kNumMeshQuantizationConstants, D3D12_SHADER_VISIBILITY_VERTEX);
     m_RootSig.Finalize(L"RootSig", D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 
     DXGI_FORMAT ColorFormat = g_SceneColorBuffer.GetFormat();
     DXGI_FORMAT DepthFormat = g_SceneDepthBuffer.GetFormat();
 
-    D3D12_INPUT_ELEMENT_DESC posOnly[] =
-    {
-        { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT,    0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-    };
-
-    D3D12_INPUT_ELEMENT_DESC posAndUV[] =
-    {
-        { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT,    0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-        { "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT,       0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-    };
-
-    D3D12_INPUT_ELEMENT_DESC skinPos[] =
-    {
-        { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT,    0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-        { "BLENDINDICES", 0, DXGI_FORMAT_R16G16B16A16_UINT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-        { "BLENDWEIGHT", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-    };
+    ASSERT(sm_PSOs.size() == 0);
 
-    D3D12_INPUT_ELEMENT_DESC skinPosAndUV[] =
+    for (uint16_t positionFlags : { (uint16_t)0, (uint16_t)PSOFlags::kQuantizedPosition })
     {
-        { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT,    0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-        { "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT,       0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-        { "BLENDINDICES", 0, DXGI_FORMAT_R16G16B16A16_UINT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-        { "BLENDWEIGHT", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-    };
-
-    ASSERT(sm_PSOs.size() == 0);
+        std::vector<D3D12_INPUT_ELEMENT_DESC> posOnly, posAndUV, skinPos, skinPosAndUV;
+        GetDepthVertexLayout(positionFlags, posOnly);
+        GetDepthVertexLayout((uint16_t)(positionFlags | PSOFlags::kAlphaTest), posAndUV);
+        GetDepthVertexLayout((uint16_t)(positionFlags | PSOFlags::kHasSkin), skinPos);
+        GetDepthVertexLayout((uint16_t)(positionFlags | PSOFlags::kAlphaTest | PSOFlags::kHasSkin), skinPosAndUV);
+
+        // Depth Only PSOs
+
+        GraphicsPSO DepthOnlyPSO(L"Renderer: Depth Only PSO");
+        DepthOnlyPSO.SetRootSignature(m_RootSig);
+        DepthOnlyPSO.SetRasterizerState(RasterizerDefault);
+        DepthOnlyPSO.SetBlendState(BlendDisable);
+        DepthOnlyPSO.SetDepthStencilState(DepthStateReadWrite);
+        DepthOnlyPSO.SetInputLayout((uint32_t)posOnly.size(), posOnly.data());
+        DepthOnlyPSO.SetPrimitiveTopologyType(D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE);
+        DepthOnlyPSO.SetRenderTargetFormats(0, nullptr, DepthFormat);
+        DepthOnlyPSO.SetVertexShader(g_pDepthOnlyVS, sizeof(g_pDepthOnlyVS));
+        DepthOnlyPSO.Finalize();
+        sm_PSOs.push_back(DepthOnlyPSO);
+
+        GraphicsPSO CutoutDepthPSO(L"Renderer: Cutout Depth PSO");
+        CutoutDepthPSO = DepthOnlyPSO;
+        CutoutDepthPSO.SetInputLayout((uint32_t)posAndUV.size(), posAndUV.data());
+        CutoutDepthPSO.SetRasterizerState(RasterizerTwoSided);
+        CutoutDepthPSO.SetVertexShader(g_pCutoutDepthVS, sizeof(g_pCutoutDepthVS));
+        CutoutDepthPSO.SetPixelShader(g_pCutoutDepthPS, sizeof(g_pCutoutDepthPS));
+        CutoutDepthPSO.Finalize();
+        sm_PSOs.push_back(CutoutDepthPSO);
+
+        GraphicsPSO SkinDepthOnlyPSO = DepthOnlyPSO;
+        SkinDepthOnlyPSO.SetInputLayout((uint32_t)skinPos.size(), skinPos.data());
+        SkinDepthOnlyPSO.SetVertexShader(g_pDepthOnlySkinVS, sizeof(g_pDepthOnlySkinVS));
+        SkinDepthOnlyPSO.Finalize();
+        sm_PSOs.push_back(SkinDepthOnlyPSO);
+
+        GraphicsPSO SkinCutoutDepthPSO = CutoutDepthPSO;
+        SkinCutoutDepthPSO.SetInputLayout((uint32_t)skinPosAndUV.size(), skinPosAndUV.data());
+        SkinCutoutDepthPSO.SetVertexShader(g_pCutoutDepthSkinVS, sizeof(g_pCutoutDepthSkinVS));
+        SkinCutoutDepthPSO.Finalize();
+        sm_PSOs.push_back(SkinCutoutDepthPSO);
+
+        // Shadow PSOs
+
+        DepthOnlyPSO.SetRasterizerState(RasterizerShadow);
+        DepthOnlyPSO.SetRenderTargetFormats(0, nullptr, g_ShadowBuffer.GetFormat());
+        DepthOnlyPSO.Finalize();
+        sm_PSOs.push_back(DepthOnlyPSO);
+
+        CutoutDepthPSO.SetRasterizerState(RasterizerShadowTwoSided);
+        CutoutDepthPSO.SetRenderTargetFormats(0, nullptr, g_ShadowBuffer.GetFormat());
+        CutoutDepthPSO.Finalize();
+        sm_PSOs.push_back(CutoutDepthPSO);
+
+        SkinDepthOnlyPSO.SetRasterizerState(RasterizerShadow);
+        SkinDepthOnlyPSO.SetRenderTargetFormats(0, nullptr, g_ShadowBuffer.GetFormat());
+        SkinDepthOnlyPSO.Finalize();
+        sm_PSOs.push_back(SkinDepthOnlyPSO);
+
+        SkinCutoutDepthPSO.SetRasterizerState(RasterizerShadowTwoSided);
+        SkinCutoutDepthPSO.SetRenderTargetFormats(0, nullptr, g_ShadowBuffer.GetFormat());
+        SkinCutoutDepthPSO.Finalize();
+        sm_PSOs.push_back(SkinCutoutDepthPSO);
+    }
 
-    // Depth Only PSOs
-
-    GraphicsPSO DepthOnlyPSO(L"Renderer: Depth Only PSO");
-    DepthOnlyPSO.SetRootSignature(m_RootSig);
-    DepthOnlyPSO.SetRasterizerState(RasterizerDefault);
-    DepthOnlyPSO.SetBlendState(BlendDisable);
-    DepthOnlyPSO.SetDepthStencilState(DepthStateReadWrite);
-    DepthOnlyPSO.SetInputLayout(_countof(posOnly), posOnly);
-    DepthOnlyPSO.SetPrimitiveTopologyType(D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE);
-    DepthOnlyPSO.SetRenderTargetFormats(0, nullptr, DepthFormat);
-    DepthOnlyPSO.SetVertexShader(g_pDepthOnlyVS, sizeof(g_pDepthOnlyVS));
-    DepthOnlyPSO.Finalize();
-    sm_PSOs.push_back(DepthOnlyPSO);
-
-    GraphicsPSO CutoutDepthPSO(L"Renderer: Cutout Depth PSO");
-    CutoutDepthPSO = DepthOnlyPSO;
-    CutoutDepthPSO.SetInputLayout(_countof(posAndUV), posAndUV);
-    CutoutDepthPSO.SetRasterizerState(RasterizerTwoSided);
-    CutoutDepthPSO.SetVertexShader(g_pCutoutDepthVS, sizeof(g_pCutoutDepthVS));
-    CutoutDepthPSO.SetPixelShader(g_pCutoutDepthPS, sizeof(g_pCutoutDepthPS));
-    CutoutDepthPSO.Finalize();
-    sm_PSOs.push_back(CutoutDepthPSO);
-
-    GraphicsPSO SkinDepthOnlyPSO = DepthOnlyPSO;
-    SkinDepthOnlyPSO.SetInputLayout(_countof(skinPos), skinPos);
-    SkinDepthOnlyPSO.SetVertexShader(g_pDepthOnlySkinVS, sizeof(g_pDepthOnlySkinVS));
-    SkinDepthOnlyPSO.Finalize();
-    sm_PSOs.push_back(SkinDepthOnlyPSO);
-
-    GraphicsPSO SkinCutoutDepthPSO = CutoutDepthPSO;
-    SkinCutoutDepthPSO.SetInputLayout(_countof(skinPosAndUV), skinPosAndUV);
-    SkinCutoutDepthPSO.SetVertexShader(g_pCutoutDepthSkinVS, sizeof(g_pCutoutDepthSkinVS));
-    SkinCutoutDepthPSO.Finalize();
-    sm_PSOs.push_back(SkinCutoutDepthPSO);
-
-    ASSERT(sm_PSOs.size() == 4);
-
-    // Shadow PSOs
-
-    DepthOnlyPSO.SetRasterizerState(RasterizerShadow);
-    DepthOnlyPSO.SetRenderTargetFormats(0, nullptr, g_ShadowBuffer.GetFormat());
-    DepthOnlyPSO.Finalize();
-    sm_PSOs.push_back(DepthOnlyPSO);
-
-    CutoutDepthPSO.SetRasterizerState(RasterizerShadowTwoSided);
-    CutoutDepthPSO.SetRenderTargetFormats(0, nullptr, g_ShadowBuffer.GetFormat());
-    CutoutDepthPSO.Finalize();
-    sm_PSOs.push_back(CutoutDepthPSO);
-
-    SkinDepthOnlyPSO.SetRasterizerState(RasterizerShadow);
-    SkinDepthOnlyPSO.SetRenderTargetFormats(0, nullptr, g_ShadowBuffer.GetFormat());
-    SkinDepthOnlyPSO.Finalize();
-    sm_PSOs.push_back(SkinDepthOnlyPSO);
-
-    SkinCutoutDepthPSO.SetRasterizerState(RasterizerShadowTwoSided);
-    SkinCutoutDepthPSO.SetRenderTargetFormats(0, nullptr, g_ShadowBuffer.GetFormat());
-    SkinCutoutDepthPSO.Finalize();
-    sm_PSOs.push_back(SkinCutoutDepthPSO);
-
-    ASSERT(sm_PSOs.size() == 8);
+    ASSERT(sm_PSOs.size() == kNumDepthPSOs);
 
     // Default PSO
 
@@ -298,6 +300,7 @@ void Renderer::Initialize(void)
     // SDFGI Initialization
     InitializeVoxel(); 
     InitializeJFA();
+    InitializeSDFHierarchy();
     InitializeRayMarchDebug(); 
 
     s_Initialized = true;
@@ -339,7 +342,7 @@ void Renderer::InitializeVoxel(void)
 {
     // This is stupid, but we only do this so that sm_VoxelPSOs is the same size as sm_PSOs, 
     // because we want to index both of these arrays the same way. 
-    for (int i = 0; i < 8; ++i) {
+    for (uint32_t i = 0; i < kNumDepthPSOs; ++i) {
         sm_VoxelPSOs.push_back(m_DefaultVoxelPSO);
     }
 
@@ -462,22 +465,46 @@ void Renderer::InitializeJFA(void)
     m_jfaGlobals.gridResolution[2] = (float)SDF_TEXTURE_RESOLUTION;
 }
 
+void Renderer::InitializeSDFHierarchy(void)
+{
+    m_SDFMipRS.Reset(2, 0);
+    // 0: source level, destination level
+    m_SDFMipRS[0].InitAsDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, /*register*/ 0, /*count*/ 2);
+    // 1: destination resolution
+    m_SDFMipRS[1].InitAsConstants(0, 1);
+    m_SDFMipRS.Finalize(L"SDF Min Mip Root Sig", D3D12_ROOT_SIGNATURE_FLAG_NONE);
+
+    m_SDFMipPSO.SetRootSignature(m_SDFMipRS);
+    m_SDFMipPSO.SetComputeShader(g_pSDFMinMipCS, sizeof(g_pSDFMinMipCS));
+    m_SDFMipPSO.Finalize();
+
+    for (uint32_t level = 1; level < SDF_HIERARCHY_LEVELS; ++level)
+    {
+        const uint32_t resolution = SDFHierarchy::SDFLevelResolution(SDF_TEXTURE_RESOLUTION, level);
+        m_SDFMips[level - 1].Create3D(
+            4, resolution, resolution, resolution, DXGI_FORMAT_R32_FLOAT, nullptr, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, L"SDF Min Mip"
+        );
+    }
+}
+
 void Renderer::InitializeRayMarchDebug() {
-    m_SDFRayMarchTextureHeap.Create(L"SDF Ray March 3D Tex Descriptors", D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, 2);
+    constexpr uint32_t kNumTextures = 2 + SDF_HIERARCHY_COARSE_LEVELS;
+    m_SDFRayMarchTextureHeap.Create(L"SDF Ray March 3D Tex Descriptors", D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, kNumTextures);
 
-    // SRV: m_VoxelVoronoiInput
-    m_SDFTextures = m_SDFRayMarchTextureHeap.Alloc(2);
+    // UAV: albedo, SDF, then the coarse SDF levels
+    m_SDFTextures = m_SDFRayMarchTextureHeap.Alloc(kNumTextures);
     {
-        uint32_t DestCount = 2;
-        uint32_t SourceCounts[] = { 1, 1 };
+        uint32_t DestCount = kNumTextures;
+        uint32_t SourceCounts[kNumTextures];
+        D3D12_CPU_DESCRIPTOR_HANDLE SourceTextures[kNumTextures];
 
-        D3D12_CPU_DESCRIPTOR_HANDLE SourceTextures[] =
-        {
-            m_VoxelAlbedo.GetUAV(),
-            m_FinalSDFOutput.GetUAV()
-        };
+        SourceTextures[0] = m_VoxelAlbedo.GetUAV();
+        SourceTextures[1] = m_FinalSDFOutput.GetUAV();
+        for (uint32_t i = 0; i < SDF_HIERARCHY_COARSE_LEVELS; ++i)
+            SourceTextures[2 + i] = m_SDFMips[i].GetUAV();
+        std::fill(SourceCounts, SourceCounts + kNumTextures, 1);
 
-        g_Device->CopyDescriptors(1, &m_SDFTextures, &DestCount, DestCount, SourceTextures, SourceCounts, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+        g_Device->CopyDescriptors(1, &m_SDFTextures, &DestCount, kNumTextures, SourceTextures, SourceCounts, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
     }
 }
 
@@ -557,23 +584,7 @@ void Renderer::CreateVoxelPSO(uint16_t psoFlags) {
     ASSERT((psoFlags & Requirements) == Requirements);
 
     std::vector<D3D12_INPUT_ELEMENT_DESC> vertexLayout;
-    if (psoFlags & kHasPosition)
-        vertexLayout.push_back({ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT,    0, D3D12_APPEND_ALIGNED_ELEMENT });
-    if (psoFlags & kHasNormal)
-        vertexLayout.push_back({ "NORMAL",   0, DXGI_FORMAT_R10G10B10A2_UNORM,  0, D3D12_APPEND_ALIGNED_ELEMENT });
-    if (psoFlags & kHasTangent)
-        vertexLayout.push_back({ "TANGENT",  0, DXGI_FORMAT_R10G10B10A2_UNORM,  0, D3D12_APPEND_ALIGNED_ELEMENT });
-    if (psoFlags & kHasUV0)
-        vertexLayout.push_back({ "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT,       0, D3D12_APPEND_ALIGNED_ELEMENT });
-    else
-        vertexLayout.push_back({ "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT,       1, D3D12_APPEND_ALIGNED_ELEMENT });
-    if (psoFlags & kHasUV1)
-        vertexLayout.push_back({ "TEXCOORD", 1, DXGI_FORMAT_R16G16_FLOAT,       0, D3D12_APPEND_ALIGNED_ELEMENT });
-    if (psoFlags & kHasSkin)
-    {
-        vertexLayout.push_back({ "BLENDINDICES", 0, DXGI_FORMAT_R16G16B16A16_UINT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 });
-        vertexLayout.push_back({ "BLENDWEIGHT", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 });
-    }
+    GetVertexLayout(psoFlags, vertexLayout);
 
     ColorPSO.SetInputLayout((uint32_t)vertexLayout.size(), vertexLayout.data());
 
@@ -680,23 +691,7 @@ uint8_t Renderer::GetPSO(uint16_t psoFlags)
     ASSERT((psoFlags & Requirements) == Requirements);
 
     std::vector<D3D12_INPUT_ELEMENT_DESC> vertexLayout;
-    if (psoFlags & kHasPosition)
-        vertexLayout.push_back({"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT,    0, D3D12_APPEND_ALIGNED_ELEMENT});
-    if (psoFlags & kHasNormal)
-        vertexLayout.push_back({"NORMAL",   0, DXGI_FORMAT_R10G10B10A2_UNORM,  0, D3D12_APPEND_ALIGNED_ELEMENT});
-    if (psoFlags & kHasTangent)
-        vertexLayout.push_back({"TANGENT",  0, DXGI_FORMAT_R10G10B10A2_UNORM,  0, D3D12_APPEND_ALIGNED_ELEMENT});
-    if (psoFlags & kHasUV0)
-        vertexLayout.push_back({"TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT,       0, D3D12_APPEND_ALIGNED_ELEMENT});
-    else
-        vertexLayout.push_back({"TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT,       1, D3D12_APPEND_ALIGNED_ELEMENT});
-    if (psoFlags & kHasUV1)
-        vertexLayout.push_back({"TEXCOORD", 1, DXGI_FORMAT_R16G16_FLOAT,       0, D3D12_APPEND_ALIGNED_ELEMENT});
-    if (psoFlags & kHasSkin)
-    {
-        vertexLayout.push_back({ "BLENDINDICES", 0, DXGI_FORMAT_R16G16B16A16_UINT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 });
-        vertexLayout.push_back({ "BLENDWEIGHT", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 });
-    }
+    GetVertexLayout(psoFlags, vertexLayout);
 
     ColorPSO.SetInputLayout((uint32_t)vertexLayout.size(), vertexLayout.data());
 
@@ -871,8 +866,37 @@ void Renderer::ComputeSDF(ComputeContext& context)
             //3. Update swap bool
             swap = !swap;
         }
-        context.TransitionResource(m_FinalSDFOutput, D3D12_RESOURCE_STATE_GENERIC_READ);
     }
+
+    ComputeSDFHierarchy(context);
+    context.TransitionResource(m_FinalSDFOutput, D3D12_RESOURCE_STATE_GENERIC_READ);
+}
+
+void Renderer::ComputeSDFHierarchy(ComputeContext& context)
+{
+    ScopedTimer _prof(L"SDF Min Mip Pyramid", context);
+
+    context.SetPipelineState(m_SDFMipPSO);
+    context.SetRootSignature(m_SDFMipRS);
+
+    context.TransitionResource(m_FinalSDFOutput, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    for (uint32_t i = 0; i < SDF_HIERARCHY_COARSE_LEVELS; ++i)
+        context.TransitionResource(m_SDFMips[i], D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    context.InsertUAVBarrier(m_FinalSDFOutput, true);
+
+    for (uint32_t level = 1; level < SDF_HIERARCHY_LEVELS; ++level)
+    {
+        Texture& src = level == 1 ? m_FinalSDFOutput : m_SDFMips[level - 2];
+        Texture& dst = m_SDFMips[level - 1];
+        const uint32_t resolution = dst.GetWidth();
+
+        context.SetDynamicDescriptor(0, 0, src.GetUAV());
+        context.SetDynamicDescriptor(0, 1, dst.GetUAV());
+        context.SetConstants(1, resolution);
+        context.Dispatch3D(resolution, resolution, resolution, 4, 4, 4);
+        context.InsertUAVBarrier(dst);
+    }
+    // The coarse levels stay in UNORDERED_ACCESS; they are only ever read through UAVs.
 }
 
 void Renderer::RayMarchSDF(GraphicsContext& gfxContext, const Math::Camera& cam, const D3D12_VIEWPORT& viewport, const D3D12_RECT& scissor)
@@ -888,6 +912,7 @@ void Renderer::RayMarchSDF(GraphicsContext& gfxContext, const Math::Camera& cam,
     constants.zmin = -2000;
     constants.zmax = 2000;
     constants.sdfResolution = SDF_TEXTURE_RESOLUTION;
+    constants.sdfHierarchical = HierarchicalSDFTrace;
 
     // Init Root Sig
     RootSignature RayMarchRS;
@@ -896,7 +921,8 @@ void Renderer::RayMarchSDF(GraphicsContext& gfxContext, const Math::Camera& cam,
 
         // Root Parameters
         RayMarchRS[0].InitAsConstantBuffer(0, D3D12_SHADER_VISIBILITY_PIXEL);
-        RayMarchRS[1].InitAsDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 0, 2, D3D12_SHADER_VISIBILITY_PIXEL);
+        // Albedo, SDF, coarse SDF levels.
+        RayMarchRS[1].InitAsDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 0, 2 + SDF_HIERARCHY_COARSE_LEVELS, D3D12_SHADER_VISIBILITY_PIXEL);
         RayMarchRS.Finalize(L"Ray March Root Sig", D3D12_ROOT_SIGNATURE_FLAG_NONE);
     }
 
@@ -1034,7 +1060,9 @@ void MeshSorter::AddMesh( const Mesh& mesh, float distance,
     D3D12_GPU_VIRTUAL_ADDRESS meshCBV,
     D3D12_GPU_VIRTUAL_ADDRESS materialCBV,
     D3D12_GPU_VIRTUAL_ADDRESS bufferPtr,
-    const Joint* skeleton)
+    const Joint* skeleton,
+    const DrawRange* draws,
+    uint32_t numDraws)
 {
     SortKey key;
     key.value = m_SortObjects.size();
@@ -1042,7 +1070,8 @@ void MeshSorter::AddMesh( const Mesh& mesh, float distance,
 	bool alphaBlend = (mesh.psoFlags & PSOFlags::kAlphaBlend) == PSOFlags::kAlphaBlend;
     bool alphaTest = (mesh.psoFlags & PSOFlags::kAlphaTest) == PSOFlags::kAlphaTest;
     bool skinned = (mesh.psoFlags & PSOFlags::kHasSkin) == PSOFlags::kHasSkin;
-    uint64_t depthPSO = (skinned ? 2 : 0) + (alphaTest ? 1 : 0);
+    bool quantized = (mesh.psoFlags & PSOFlags::kQuantizedPosition) == PSOFlags::kQuantizedPosition;
+    uint64_t depthPSO = (quantized ? kQuantizedDepthPSOs : 0) + (skinned ? 2 : 0) + (alphaTest ? 1 : 0);
 
     union float_or_int { float f; uint32_t u; } dist;
     dist.f = Max(distance, 0.0f);
@@ -1089,8 +1118,48 @@ void MeshSorter::AddMesh( const Mesh& mesh, float distance,
         m_PassCounts[kOpaque]++;
     }
 
-    SortObject object = { &mesh, skeleton, meshCBV, materialCBV, bufferPtr };
+    SortObject object = { &mesh, skeleton, meshCBV, materialCBV, bufferPtr, (uint32_t)m_DrawRanges.size(), numDraws };
     m_SortObjects.push_back(object);
+    if (draws != nullptr)
+        m_DrawRanges.insert(m_DrawRanges.end(), draws, draws + numDraws);
+}
+
+float MeshSorter::GetTargetHeight() const
+{
+    if (m_Viewport.Height > 0.0f)
+        return m_Viewport.Height;
+    return m_DSV != nullptr ? (float)m_DSV->GetHeight() : 0.0f;
+}
+
+void MeshSorter::SetPositionDequantization(GraphicsContext& context, const Mesh& mesh)
+{
+    const float constants[kNumMeshQuantizationConstants] =
+    {
+        mesh.positionScale[0], mesh.positionScale[1], mesh.positionScale[2], 0.0f,
+        mesh.positionBias[0], mesh.positionBias[1], mesh.positionBias[2], 0.0f,
+    };
+    context.SetConstantArray(kMeshQuantization, kNumMeshQuantizationConstants, constants);
+}
+
+void MeshSorter::DrawObject(GraphicsContext& context, const SortObject& object, bool depthOnly) const
+{
+    const Mesh& mesh = *object.mesh;
+    if (object.numDraws == 0)
+    {
+        for (uint32_t i = 0; i < mesh.numDraws; ++i)
+        {
+            const Mesh::Draw& draw = mesh.draw[i];
+            context.DrawIndexed(draw.primCount, draw.startIndex, depthOnly ? draw.depthBaseVertex : draw.baseVertex);
+        }
+    }
+    else
+    {
+        for (uint32_t i = object.firstDraw; i < object.firstDraw + object.numDraws; ++i)
+        {
+            const DrawRange& range = m_DrawRanges[i];
+            context.DrawIndexed(range.primCount, range.startIndex, depthOnly ? range.depthBaseVertex : range.baseVertex);
+        }
+    }
 }
 
 void MeshSorter::Sort()
@@ -1271,23 +1340,21 @@ void MeshSorter::RenderMeshes(
             }
             context.SetPipelineState(sm_PSOs[key.psoIdx]);
 
-            if (m_CurrentPass == kZPass)
+            SetPositionDequantization(context, mesh);
+
+            const bool depthOnly = m_CurrentPass == kZPass;
+            if (depthOnly)
             {
-                bool alphaTest = (mesh.psoFlags & PSOFlags::kAlphaTest) == PSOFlags::kAlphaTest;
-                uint32_t stride = alphaTest ? 16u : 12u;
-                if (mesh.numJoints > 0)
-                    stride += 16;
-                context.SetVertexBuffer(0, {object.bufferPtr + mesh.vbDepthOffset, mesh.vbDepthSize, stride});
+                context.SetVertexBuffer(0, {object.bufferPtr + mesh.vbDepthOffset, mesh.vbDepthSize, GetDepthVertexStride(mesh.psoFlags)});
+                context.SetIndexBuffer({object.bufferPtr + mesh.ibDepthOffset, mesh.ibSize, (DXGI_FORMAT)mesh.ibFormat});
             }
             else
             {
                 context.SetVertexBuffer(0, {object.bufferPtr + mesh.vbOffset, mesh.vbSize, mesh.vbStride});
+                context.SetIndexBuffer({object.bufferPtr + mesh.ibOffset, mesh.ibSize, (DXGI_FORMAT)mesh.ibFormat});
             }
 
-            context.SetIndexBuffer({object.bufferPtr + mesh.ibOffset, mesh.ibSize, (DXGI_FORMAT)mesh.ibFormat});
-
-            for (uint32_t i = 0; i < mesh.numDraws; ++i)
-                context.DrawIndexed(mesh.draw[i].primCount, mesh.draw[i].startIndex, mesh.draw[i].baseVertex);
+            DrawObject(context, object, depthOnly);
 
             ++m_CurrentDraw;
         }
@@ -1358,13 +1425,13 @@ void MeshSorter::RenderVoxels(DrawPass pass, GraphicsContext& context, GlobalCon
             context.SetDescriptorTable(kMaterialSRVs, s_TextureHeap[mesh.srvTable]);
             context.SetDescriptorTable(kMaterialSamplers, s_SamplerHeap[mesh.samplerTable]);
             context.SetPipelineState(sm_VoxelPSOs[key.psoIdx]);
+            SetPositionDequantization(context, mesh);
 
             context.SetVertexBuffer(0, { object.bufferPtr + mesh.vbOffset, mesh.vbSize, mesh.vbStride });
 
             context.SetIndexBuffer({ object.bufferPtr + mesh.ibOffset, mesh.ibSize, (DXGI_FORMAT)mesh.ibFormat });
 
-            for (uint32_t i = 0; i < mesh.numDraws; ++i)
-                context.DrawIndexed(mesh.draw[i].primCount, mesh.draw[i].startIndex, mesh.draw[i].baseVertex);
+            DrawObject(context, object, false);
 
             ++m_CurrentDraw;
         }
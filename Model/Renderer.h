@@ -22,6 +22,7 @@
 #include <cstdint>
 #include <vector>
 #include "SDFGI.h"
+#include "../Core/SDFHierarchyCommon.h"
 
 #include <d3d12.h>
 
@@ -38,6 +39,12 @@ struct Joint;
 namespace Renderer
 {
     extern BoolVar SeparateZPass;
+    extern BoolVar ClusterCulling;
+    extern BoolVar MeshLODs;
+    extern NumVar LODPixelError;
+    // Whether SDF rays skip empty space through the min-distance pyramid instead of sphere tracing the full resolution
+    // SDF. The pyramid is built with the SDF either way, so this can be flipped at any time.
+    extern BoolVar HierarchicalSDFTrace;
 
     using namespace Math;
 
@@ -54,6 +61,8 @@ namespace Renderer
     extern Texture m_VoxelVoronoiInput;
     extern Texture m_FinalSDFOutput;
     extern Texture m_IntermediateSDFOutput;
+    // Min-distance pyramid over m_FinalSDFOutput, finest first (see SDFHierarchyCommon.h)
+    extern Texture m_SDFMips[SDF_HIERARCHY_COARSE_LEVELS];
 
     enum RootBindings
     {
@@ -69,6 +78,7 @@ namespace Renderer
         kSDFGICommonCBV,
         kSDFGIVoxelUAVs,
         kSDFGIDepthAtlasSRV,
+        kMeshQuantization,
 
         kNumRootBindings
     };
@@ -88,6 +98,7 @@ namespace Renderer
     void ClearSDFTextures(GraphicsContext& gfxContext); 
     void InitializeVoxel(void); 
     void InitializeJFA(void);
+    void InitializeSDFHierarchy(void);
     void InitializeRayMarchDebug(void);
     void CreateVoxelPSO(uint16_t psoFlags);
     uint8_t GetPSO(uint16_t psoFlags);
@@ -98,6 +109,7 @@ namespace Renderer
     void DrawShadowBuffer(GraphicsContext& gfxContext, const D3D12_VIEWPORT& viewport, const D3D12_RECT& scissor);
     void RayMarchSDF(GraphicsContext& gfxContext, const Math::Camera& cam, const D3D12_VIEWPORT& viewport, const D3D12_RECT& scissor);
     void ComputeSDF(ComputeContext& context);
+    void ComputeSDFHierarchy(ComputeContext& context);
 
     class MeshSorter
     {
@@ -105,9 +117,23 @@ namespace Renderer
 		enum BatchType { kDefault, kShadows };
         enum DrawPass { kZPass, kOpaque, kTransparent, kNumPasses };
 
+        // How finely models cull what they add. Meshes that were built with meshlets can drop the clusters outside
+        // the frustum and, for single-sided materials, the ones that face away from the camera.
+        enum ClusterCullMode { kCullMeshes, kCullClusters, kCullClustersAndBackfaces };
+
+        // An index range of a mesh to draw in place of its own draws.
+        struct DrawRange
+        {
+            uint32_t primCount;
+            uint32_t startIndex;
+            uint32_t baseVertex;
+            uint32_t depthBaseVertex;
+        };
+
 		MeshSorter(BatchType type)
 		{
 			m_BatchType = type;
+			m_ClusterCulling = kCullMeshes;
 			m_Camera = nullptr;
 			m_Viewport = {};
 			m_Scissor = {};
@@ -115,12 +141,14 @@ namespace Renderer
 			m_DSV = nullptr;
 			m_SortObjects.clear();
 			m_SortKeys.clear();
+			m_DrawRanges.clear();
 			std::memset(m_PassCounts, 0, sizeof(m_PassCounts));
 			m_CurrentPass = kZPass;
 			m_CurrentDraw = 0;
 		}
 
 		void SetCamera( const BaseCamera& camera ) { m_Camera = &camera; }
+		void SetClusterCulling( ClusterCullMode mode ) { m_ClusterCulling = mode; }
 		void SetViewport( const D3D12_VIEWPORT& viewport ) { m_Viewport = viewport; }
 		void SetScissor( const D3D12_RECT& scissor ) { m_Scissor = scissor; }
 		void AddRenderTarget( ColorBuffer& RTV )
@@ -133,12 +161,22 @@ namespace Renderer
         const Frustum& GetWorldFrustum() const { return m_Camera->GetWorldSpaceFrustum(); }
         const Frustum& GetViewFrustum() const { return m_Camera->GetViewSpaceFrustum(); }
         const Matrix4& GetViewMatrix() const { return m_Camera->GetViewMatrix(); }
+        const Matrix4& GetProjMatrix() const { return m_Camera->GetProjMatrix(); }
+        Vector3 GetCameraPosition() const { return m_Camera->GetPosition(); }
+        BatchType GetBatchType() const { return m_BatchType; }
+        ClusterCullMode GetClusterCulling() const { return m_ClusterCulling; }
 
+        // Height in pixels of what the sorter renders to, from the viewport or else the depth target. 0 if unknown.
+        float GetTargetHeight() const;
+
+        // When draws is given, the mesh is drawn with those numDraws ranges instead of its own draws.
         void AddMesh( const Mesh& mesh, float distance,
             D3D12_GPU_VIRTUAL_ADDRESS meshCBV,
             D3D12_GPU_VIRTUAL_ADDRESS materialCBV,
             D3D12_GPU_VIRTUAL_ADDRESS bufferPtr,
-            const Joint* skeleton = nullptr);
+            const Joint* skeleton = nullptr,
+            const DrawRange* draws = nullptr,
+            uint32_t numDraws = 0);
 
         void Sort();
 
@@ -170,11 +208,21 @@ namespace Renderer
             D3D12_GPU_VIRTUAL_ADDRESS meshCBV;
             D3D12_GPU_VIRTUAL_ADDRESS materialCBV;
             D3D12_GPU_VIRTUAL_ADDRESS bufferPtr;
+            uint32_t firstDraw;     // Into m_DrawRanges
+            uint32_t numDraws;      // 0 to use the mesh's draws
         };
 
+        // With depthOnly, from the welded depth-only buffers, which use the same index ranges.
+        void DrawObject(GraphicsContext& context, const SortObject& object, bool depthOnly) const;
+
+        // Sets the scale and bias the vertex shaders apply to the mesh's positions.
+        static void SetPositionDequantization(GraphicsContext& context, const Mesh& mesh);
+
         std::vector<SortObject> m_SortObjects;
         std::vector<uint64_t> m_SortKeys;
+        std::vector<DrawRange> m_DrawRanges;
 		BatchType m_BatchType;
+		ClusterCullMode m_ClusterCulling;
         uint32_t m_PassCounts[kNumPasses];
         DrawPass m_CurrentPass;
         uint32_t m_CurrentDraw;
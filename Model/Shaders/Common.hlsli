@@ -40,7 +40,8 @@
         "filter = FILTER_MIN_MAG_LINEAR_MIP_POINT)," \
     "StaticSampler(s12, maxAnisotropy = 8, visibility = SHADER_VISIBILITY_PIXEL)," \
     "CBV(b3)," \
-    "DescriptorTable(UAV(u0, numDescriptors = 2), visibility = SHADER_VISIBILITY_PIXEL)"
+    "DescriptorTable(UAV(u0, numDescriptors = 2), visibility = SHADER_VISIBILITY_PIXEL)," \
+    "RootConstants(num32BitConstants = 8, b4, visibility = SHADER_VISIBILITY_VERTEX)"
 
 // Common (static) samplers
 SamplerState defaultSampler : register(s10);
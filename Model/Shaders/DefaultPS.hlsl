@@ -12,6 +12,7 @@
 //              Justin Saunders (ATG)
 
 #include "Common.hlsli"
+#include "../../Core/SDFGIAtlasCommon.h"
 
 Texture2D<float4> baseColorTexture          : register(t0);
 Texture2D<float3> metallicRoughnessTexture  : register(t1);
@@ -347,21 +348,6 @@ float3 ComputeNormal(VSOutput vsOutput)
 #endif
 }
 
-float2 signNotZero(float2 v) {
-    return float2((v.x >= 0.0 ? 1.0 : -1.0), (v.y >= 0.0 ? 1.0 : -1.0));
-}
-
-float2 octEncode(float3 v) {
-    float l1norm = abs(v.x) + abs(v.y) + abs(v.z);
-    float2 result = v.xy * (1.0 / l1norm);
-    
-    if (v.z < 0.0) {
-        result = (1.0 - abs(result.yx)) * signNotZero(result.xy);
-    }
-    
-    return result;
-}
-
 float3 ACESToneMapping(float3 color) {
     const float a = 2.51f;
     const float b = 0.03f;
@@ -377,17 +363,7 @@ float3 GammaCorrection(float3 color, float gamma)
 }
 
 float2 GetUV(float3 direction, uint3 probeIndex) {
-    float2 encodedDir = octEncode(direction);
-
-    uint3 atlasCoord = 
-        uint3(GutterSize, GutterSize, 0) 
-        + probeIndex * uint3(ProbeAtlasBlockResolution + GutterSize, ProbeAtlasBlockResolution + GutterSize, 1);
-    float2 texCoord = atlasCoord.xy;
-    texCoord += float2(ProbeAtlasBlockResolution * 0.5f, ProbeAtlasBlockResolution * 0.5f);
-    texCoord += encodedDir * (ProbeAtlasBlockResolution * 0.5f);
-    texCoord = texCoord / float2(AtlasWidth, AtlasHeight);
-
-    return texCoord;
+    return SDFGIAtlasUV(SDFGIOctEncode(direction), probeIndex.xy, ProbeAtlasBlockResolution, GutterSize, float2(AtlasWidth, AtlasHeight));
 }
 
 float3 gridCoordToPosition(int3 c) {
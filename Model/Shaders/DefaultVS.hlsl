@@ -23,6 +23,12 @@ cbuffer MeshConstants : register(b0)
     float3x3 WorldIT;       // Object normal to world normal
 };
 
+cbuffer MeshQuantization : register(b4)
+{
+    float3 PositionScale;   // Quantized positions are stored as UNORM16 within the mesh bounds
+    float3 PositionBias;    // (1 and 0 for float positions)
+};
+
 cbuffer GlobalConstants : register(b1)
 {
     float4x4 ViewProjMatrix;
@@ -79,7 +85,7 @@ VSOutput main(VSInput vsInput)
 {
     VSOutput vsOutput;
 
-    float4 position = float4(vsInput.position, 1.0);
+    float4 position = float4(vsInput.position * PositionScale + PositionBias, 1.0);
     float3 normal = vsInput.normal * 2 - 1;
 #ifndef NO_TANGENT_FRAME
     float4 tangent = vsInput.tangent * 2 - 1;
@@ -23,6 +23,12 @@ cbuffer MeshConstants : register(b0)
     float3x3 WorldIT;       // Object normal to world normal
 };
 
+cbuffer MeshQuantization : register(b4)
+{
+    float3 PositionScale;   // Quantized positions are stored as UNORM16 within the mesh bounds
+    float3 PositionBias;    // (1 and 0 for float positions)
+};
+
 cbuffer GlobalConstants : register(b1)
 {
     float4x4 ViewProjMatrix;
@@ -63,7 +69,7 @@ VSOutput main(VSInput vsInput)
 {
     VSOutput vsOutput;
 
-    float4 position = float4(vsInput.position, 1.0);
+    float4 position = float4(vsInput.position * PositionScale + PositionBias, 1.0);
 
 #ifdef ENABLE_SKINNING
     // I don't like this hack.  The weights should be normalized already, but something is fishy.
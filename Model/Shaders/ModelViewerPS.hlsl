@@ -12,6 +12,7 @@
 
 #include "Common.hlsli"
 #include "Lighting.hlsli"
+#include "../../Core/SDFGIAtlasCommon.h"
 
 Texture2D<float3> texDiffuse		: register(t0);
 Texture2D<float3> texSpecular		: register(t1);
@@ -62,21 +63,6 @@ struct MRT
     float3 Normal : SV_Target1;
 };
 
-float2 signNotZero(float2 v) {
-    return float2((v.x >= 0.0 ? 1.0 : -1.0), (v.y >= 0.0 ? 1.0 : -1.0));
-}
-
-float2 octEncode(float3 v) {
-    float l1norm = abs(v.x) + abs(v.y) + abs(v.z);
-    float2 result = v.xy * (1.0 / l1norm);
-    
-    if (v.z < 0.0) {
-        result = (1.0 - abs(result.yx)) * signNotZero(result.xy);
-    }
-    
-    return result;
-}
-
 float3 ShadeFragmentWithProbes(
     float3 fragmentWorldPos,       
     float3 normal                 
@@ -103,19 +89,13 @@ float3 ShadeFragmentWithProbes(
 
     float4 irradiance[8];
     for (int i = 0; i < 8; ++i) {
-        // float2 encodedDir = octEncode(normalize(mul(RandomRotation, float4(probeIndices[i] - localPos, 1.0)).xyz));
-        // float2 encodedDir = octEncode(normalize(mul(RandomRotation, float4(-normal, 1.0)).xyz));
-        float2 encodedDir = octEncode(-normal);
-        // float2 encodedDir = octEncode(normalize(float3(0.1, -0.7, -0.43)));
+        // float2 encodedDir = SDFGIOctEncode(normalize(mul(RandomRotation, float4(probeIndices[i] - localPos, 1.0)).xyz));
+        // float2 encodedDir = SDFGIOctEncode(normalize(mul(RandomRotation, float4(-normal, 1.0)).xyz));
+        float2 encodedDir = SDFGIOctEncode(-normal);
+        // float2 encodedDir = SDFGIOctEncode(normalize(float3(0.1, -0.7, -0.43)));
         // float2 mappedDir = encodedDir * 0.5 + 0.5;
         // return float3(mappedDir, 0);
-        encodedDir = clamp(encodedDir, -1.0, 1.0);
-        uint3 atlasCoord = probeIndices[i] * uint3(ProbeAtlasBlockResolution + GutterSize, ProbeAtlasBlockResolution + GutterSize, 1);
-        float2 texCoord = atlasCoord.xy + uint2(
-            (encodedDir.x * 0.5 + 0.5) * (ProbeAtlasBlockResolution - GutterSize),
-            (encodedDir.y * 0.5 + 0.5) * (ProbeAtlasBlockResolution - GutterSize)
-        );
-        texCoord = texCoord / float2(AtlasWidth, AtlasHeight);
+        float2 texCoord = SDFGIAtlasUV(encodedDir, probeIndices[i].xy, ProbeAtlasBlockResolution, GutterSize, float2(AtlasWidth, AtlasHeight));
 
         irradiance[i] = IrradianceAtlas.SampleLevel(defaultSampler, float3(texCoord, probeIndices[i].z), 0);
         // irradiance[i] = IrradianceAtlas.SampleLevel(defaultSampler, float3(texCoord, 5), 0);
@@ -12,10 +12,15 @@ cbuffer CameraCB : register(b0) {
     float zmax;
     // texture resolution
     float sdfResolution;
+    // Nonzero to trace through the min-distance pyramid instead of sphere tracing the full resolution SDF
+    uint sdfHierarchical;
 };
 
 RWTexture3D<uint> AlbedoTex : register(u0);
 RWTexture3D<float> SDFTex : register(u1);
+// Coarse SDF levels in u2 and up.
+#define SDF_MIP_REGISTER u2
+#include "../../Core/Shaders/SDFHierarchy.hlsli"
 
 struct VSOutput {
     float4 pos : SV_POSITION;
@@ -144,6 +149,15 @@ float shortestDistanceToSurface(float3 eye, float3 marchingDirection, float star
 }
 
 int3 shortestDistanceToSurfaceTexSpace(float3 eye, float3 marchingDirection, out float depth) {
+    if (sdfHierarchical) {
+        int3 hit;
+        uint steps;
+        if (!SDFHierarchyTrace(eye, marchingDirection, hit, depth, steps)) {
+            return int3(-1, -1, -1);
+        }
+        return hit;
+    }
+
     float start = 0; 
     depth = start;
     for (int i = 0; i < MAX_MARCHING_STEPS; i++) {
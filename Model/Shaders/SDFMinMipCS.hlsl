@@ -0,0 +1,24 @@
+#include "../../Core/SDFHierarchyCommon.h"
+
+// Builds one level of the SDF min-distance pyramid from the level below it.
+RWTexture3D<float> SrcLevel : register(u0);
+RWTexture3D<float> DstLevel : register(u1);
+
+cbuffer SDFMipConstants : register(b0) {
+	uint dstResolution;
+}
+
+[numthreads(4, 4, 4)]
+void main(uint3 DTid : SV_DispatchThreadID)
+{
+	if (any(DTid >= dstResolution.xxx)) {
+		return;
+	}
+
+	uint3 src = DTid * 2;
+	DstLevel[DTid] = SDFMinReduce(
+		SrcLevel[src + uint3(0, 0, 0)], SrcLevel[src + uint3(1, 0, 0)],
+		SrcLevel[src + uint3(0, 1, 0)], SrcLevel[src + uint3(1, 1, 0)],
+		SrcLevel[src + uint3(0, 0, 1)], SrcLevel[src + uint3(1, 0, 1)],
+		SrcLevel[src + uint3(0, 1, 1)], SrcLevel[src + uint3(1, 1, 1)]);
+}
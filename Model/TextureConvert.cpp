@@ -15,14 +15,149 @@
 //
 
 #include "TextureConvert.h"
+#include "BlockCompress.h"
+#include "ParallelFor.h"
 #include "../Core/Utility.h"
+#include "../Core/FileUtility.h"
+#include "../Core/Hash.h"
 #include "DirectXTex.h"
 
+#include <algorithm>
+#include <atomic>
+#include <direct.h>
+#include <fstream>
+#include <limits>
+#include <thread>
+
 using namespace DirectX;
 
 #define GetFlag(f) ((Flags & f) != 0)
 
-void CompileTextureOnDemand(const std::wstring& originalFile, uint32_t flags)
+namespace
+{
+    // Bump this whenever ConvertToDDS would write something different for the same source and flags, so that cache
+    // entries made by an older converter stop matching.
+    const uint32_t kTextureConverterVersion = 2;
+
+    std::wstring s_TextureCacheDirectory = L"TextureCache";
+
+    // What a cache entry records about the DDS file it holds. The full manifest also names the source and the flags,
+    // which only serve whoever inspects the cache.
+    struct CacheManifest
+    {
+        uint64_t ddsSize;
+        uint64_t ddsHash;
+    };
+
+    std::wstring GetCacheKey(const std::vector<byte>& source, uint32_t flags)
+    {
+        uint64_t hash = Utility::HashBytes64(source.data(), source.size());
+        uint32_t settings[2] = { flags, kTextureConverterVersion };
+        hash = Utility::HashBytes64(settings, sizeof(settings), hash);
+
+        wchar_t key[17];
+        swprintf_s(key, L"%016llx", (unsigned long long)hash);
+        return key;
+    }
+
+    uint64_t HashFile(const std::vector<byte>& contents)
+    {
+        return Utility::HashBytes64(contents.data(), contents.size());
+    }
+
+    // Creates the directory and any missing parents.
+    void CreateDirectories(const std::wstring& directory)
+    {
+        for (size_t sep = directory.find_first_of(L"/\\", 1); ; sep = directory.find_first_of(L"/\\", sep + 1))
+        {
+            _wmkdir(directory.substr(0, sep).c_str());
+            if (sep == std::wstring::npos)
+                break;
+        }
+    }
+
+    // Writes the whole file under a temporary name and then renames it over the destination, so that concurrent
+    // readers, and other threads compiling the same texture, never see it half written.
+    bool WriteFileReplacing(const std::wstring& filePath, const void* data, size_t size)
+    {
+        const std::wstring tempPath = filePath + L"." + std::to_wstring(GetCurrentThreadId()) + L".tmp";
+        {
+            std::ofstream file(tempPath, std::ios::out | std::ios::binary);
+            if (!file)
+                return false;
+            file.write((const char*)data, size);
+            if (!file)
+            {
+                file.close();
+                _wremove(tempPath.c_str());
+                return false;
+            }
+        }
+
+        if (!MoveFileExW(tempPath.c_str(), filePath.c_str(), MOVEFILE_REPLACE_EXISTING))
+        {
+            _wremove(tempPath.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    bool ReadManifest(const std::wstring& manifestFile, CacheManifest& manifest)
+    {
+        std::ifstream file(manifestFile);
+        if (!file)
+            return false;
+
+        uint32_t version = 0;
+        bool haveSize = false, haveHash = false;
+        std::string name;
+        while (file >> name)
+        {
+            if (name == "version")
+                file >> version;
+            else if (name == "ddsSize")
+                haveSize = !!(file >> manifest.ddsSize);
+            else if (name == "ddsHash")
+                haveHash = !!(file >> std::hex >> manifest.ddsHash >> std::dec);
+
+            file.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        }
+        return version == kTextureConverterVersion && haveSize && haveHash;
+    }
+
+    bool WriteManifest(const std::wstring& manifestFile, const std::wstring& originalFile, uint32_t flags,
+        size_t sourceSize, const CacheManifest& manifest)
+    {
+        char numbers[128];
+        sprintf_s(numbers, "sourceSize %llu\nflags 0x%02x\nddsSize %llu\nddsHash %016llx\n",
+            (unsigned long long)sourceSize, flags, (unsigned long long)manifest.ddsSize,
+            (unsigned long long)manifest.ddsHash);
+
+        std::string text = "version " + std::to_string(kTextureConverterVersion) + "\n" +
+            "source " + Utility::WideStringToUTF8(originalFile) + "\n" + numbers;
+        return WriteFileReplacing(manifestFile, text.data(), text.size());
+    }
+
+    // The formats BlockCompress encodes; the rest are left to DirectXTex.
+    bool GetPortableBCFormat(DXGI_FORMAT format, BlockCompress::Format& bcFormat)
+    {
+        switch (format)
+        {
+        case DXGI_FORMAT_BC1_UNORM: case DXGI_FORMAT_BC1_UNORM_SRGB: bcFormat = BlockCompress::kBC1; return true;
+        case DXGI_FORMAT_BC3_UNORM: case DXGI_FORMAT_BC3_UNORM_SRGB: bcFormat = BlockCompress::kBC3; return true;
+        case DXGI_FORMAT_BC5_UNORM:                                  bcFormat = BlockCompress::kBC5; return true;
+        case DXGI_FORMAT_BC7_UNORM: case DXGI_FORMAT_BC7_UNORM_SRGB: bcFormat = BlockCompress::kBC7; return true;
+        default: return false;
+        }
+    }
+}
+
+void SetTextureCacheDirectory(const std::wstring& directory)
+{
+    s_TextureCacheDirectory = directory;
+}
+
+bool CompileTextureOnDemand(const std::wstring& originalFile, uint32_t flags)
 {
     std::wstring ddsFile = Utility::RemoveExtension(originalFile) + L".dds";
 
@@ -34,15 +169,88 @@ void CompileTextureOnDemand(const std::wstring& originalFile, uint32_t flags)
     if (srcFileMissing && ddsFileMissing)
     {
         Utility::Printf("Texture %ws is missing.\n", Utility::RemoveBasePath(originalFile).c_str());
-        return;
+        return false;
     }
 
-    // If we can find the source texture and the DDS file is older, reconvert.
-    if (ddsFileMissing || !srcFileMissing && ddsFileStat.st_mtime < srcFileStat.st_mtime)
+    // Without a source, or when the source already is the DDS file, there is nothing to convert.
+    if (srcFileMissing || Utility::ToLower(Utility::GetFileExtension(originalFile)) == L"dds")
+        return true;
+
+    Utility::ByteArray source = Utility::ReadFileSync(originalFile);
+    const std::wstring cacheEntry = s_TextureCacheDirectory + L"/" + GetCacheKey(*source, flags);
+    const std::wstring cachedDDSFile = cacheEntry + L".dds";
+    const std::wstring manifestFile = cacheEntry + L".manifest";
+
+    // The DDS file is current when it is the cached conversion of the source's present contents. Timestamps don't
+    // enter into it, because a checkout or a copy makes them meaningless.
+    CacheManifest manifest;
+    bool cached = ReadManifest(manifestFile, manifest);
+    if (cached && !ddsFileMissing && (uint64_t)ddsFileStat.st_size == manifest.ddsSize)
+    {
+        if (HashFile(*Utility::ReadFileSync(ddsFile)) == manifest.ddsHash)
+            return true;
+    }
+
+    if (cached)
     {
-        Utility::Printf("DDS texture %ws missing or older than source.  Rebuilding.\n", Utility::RemoveBasePath(originalFile).c_str());
-        ConvertToDDS(originalFile, flags);
+        Utility::ByteArray cachedDDS = Utility::ReadFileSync(cachedDDSFile);
+        if (cachedDDS->size() == manifest.ddsSize && HashFile(*cachedDDS) == manifest.ddsHash)
+        {
+            Utility::Printf("DDS texture %ws missing or out of date.  Copying from the texture cache.\n", Utility::RemoveBasePath(originalFile).c_str());
+            if (WriteFileReplacing(ddsFile, cachedDDS->data(), cachedDDS->size()))
+                return true;
+        }
     }
+
+    Utility::Printf("DDS texture %ws missing or out of date.  Rebuilding.\n", Utility::RemoveBasePath(originalFile).c_str());
+    if (!ConvertToDDS(originalFile, flags))
+        return false;
+
+    // The manifest goes in last, so that an entry with a manifest always has its DDS file.
+    Utility::ByteArray dds = Utility::ReadFileSync(ddsFile);
+    if (dds->empty())
+        return false;
+
+    manifest.ddsSize = dds->size();
+    manifest.ddsHash = HashFile(*dds);
+    CreateDirectories(s_TextureCacheDirectory);
+    if (!WriteFileReplacing(cachedDDSFile, dds->data(), dds->size()) ||
+        !WriteManifest(manifestFile, originalFile, flags, source->size(), manifest))
+    {
+        Utility::Printf("Could not add texture %ws to the texture cache in %ws.\n", Utility::RemoveBasePath(originalFile).c_str(), s_TextureCacheDirectory.c_str());
+    }
+    return true;
+}
+
+uint32_t CompileTexturesOnDemand(const std::vector<TextureCompileJob>& jobs)
+{
+    // A scene's textures range from tiny masks to 4K albedo maps. Converting the largest first keeps one of them
+    // from starting last while the other threads sit idle.
+    std::vector<std::pair<uint64_t, size_t>> order(jobs.size());
+    for (size_t i = 0; i < jobs.size(); ++i)
+    {
+        struct _stat64 srcFileStat;
+        bool srcFileMissing = _wstat64(jobs[i].originalFile.c_str(), &srcFileStat) == -1;
+        order[i] = std::make_pair(srcFileMissing ? 0ull : (uint64_t)srcFileStat.st_size, i);
+    }
+    std::stable_sort(order.begin(), order.end(),
+        [](const std::pair<uint64_t, size_t>& a, const std::pair<uint64_t, size_t>& b) { return a.first > b.first; });
+
+    uint32_t numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    std::atomic<uint32_t> numFailed(0);
+    ParallelFor(order.size(), numThreads, [&](size_t item)
+    {
+        // WIC, which loads the PNG and JPEG sources, needs COM on every thread that calls it.
+        HRESULT coInit = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+
+        const TextureCompileJob& job = jobs[order[item].second];
+        if (!CompileTextureOnDemand(job.originalFile, job.flags))
+            ++numFailed;
+
+        if (SUCCEEDED(coInit))
+            CoUninitialize();
+    });
+    return numFailed;
 }
 
 bool ConvertToDDS( const std::wstring& filePath, uint32_t Flags )
@@ -242,7 +450,27 @@ bool ConvertToDDS( const std::wstring& filePath, uint32_t Flags )
         {
             std::unique_ptr<ScratchImage> timage(new ScratchImage);
 
-            HRESULT hr = Compress( image->GetImages(), image->GetImageCount(), image->GetMetadata(), cformat, TEX_COMPRESS_DEFAULT, 0.5f, *timage );
+            // LDR formats go through our own encoder, which produces the same blocks on every platform and is much
+            // faster than DirectXTex's; BC6H stays with DirectXTex.
+            HRESULT hr;
+            BlockCompress::Format bcFormat;
+            if (GetPortableBCFormat(cformat, bcFormat) && image->GetMetadata().format == tformat)
+            {
+                TexMetadata compressedInfo = image->GetMetadata();
+                compressedInfo.format = cformat;
+                hr = timage->Initialize(compressedInfo);
+                for (size_t i = 0; SUCCEEDED(hr) && i < image->GetImageCount(); ++i)
+                {
+                    const Image& src = image->GetImages()[i];
+                    const Image& dst = timage->GetImages()[i];
+                    BlockCompress::CompressImage(src.pixels, src.rowPitch, (uint32_t)src.width, (uint32_t)src.height,
+                        bcFormat, dst.pixels, dst.rowPitch);
+                }
+            }
+            else
+            {
+                hr = Compress( image->GetImages(), image->GetImageCount(), image->GetMetadata(), cformat, TEX_COMPRESS_DEFAULT, 0.5f, *timage );
+            }
             if (FAILED(hr))
             {
                 Utility::Printf( "Failing compressing \"%ws\" (WIC: %08X).\n", filePath.c_str(), hr );
@@ -15,6 +15,7 @@
 
 #include <cstdint>
 #include <string>
+#include <vector>
 
 enum TexConversionFlags
 {
@@ -32,8 +33,26 @@ inline uint8_t TextureOptions(bool sRGB, bool hasAlpha=false, bool invertY=false
     return (sRGB ? kSRGB : 0) | (hasAlpha ? kPreserveAlpha : 0) | (invertY ? kFlipVertical : 0);
 }
 
-// If the DDS version of the texture specified does not exist or is older than the source texture, reconvert it.
-void CompileTextureOnDemand(const std::wstring& originalFile, uint32_t flags);
+// Converted textures are kept in a cache directory under a hash of the source file's contents, the conversion flags
+// and the converter version, so a texture is only ever converted once: touching, checking out or copying a source
+// doesn't rebuild it, and a different model using the same image picks up the existing conversion. The directory is
+// created on first use; the default is "TextureCache", relative to the working directory.
+void SetTextureCacheDirectory(const std::wstring& directory);
+
+// If the DDS version of the texture specified does not exist or was not made from the current contents of the source
+// texture with these flags, fetch it from the texture cache, or convert it and add it to the cache. Returns false
+// if there is no usable DDS file in the end: the texture is missing or could not be converted.
+bool CompileTextureOnDemand(const std::wstring& originalFile, uint32_t flags);
+
+struct TextureCompileJob
+{
+    std::wstring originalFile;
+    uint32_t flags;
+};
+
+// Runs CompileTextureOnDemand on every job, largest source file first, on one thread per hardware thread. Returns
+// how many of them failed.
+uint32_t CompileTexturesOnDemand(const std::vector<TextureCompileJob>& jobs);
 
 // Loads a non-DDS texture such as TGA, PNG, or JPG, then converts it to a more optimal
 // DDS format with a full mip chain.  Resultant file has the same path with the file extension
@@ -12,6 +12,8 @@
 //
 
 #include "glTF.h"
+#include "JsonDocument.h"
+#include "MeshoptDecoder.h"
 
 #include "../Core/CommandContext.h"
 #include "../Core/SamplerManager.h"
@@ -19,30 +21,34 @@
 #include "../Core/GraphicsCore.h"
 #include "../Core/FileUtility.h"
 
-#include <fstream>
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
 #include <iostream>
 
 using namespace glTF;
 using namespace Graphics;
 using namespace Utility;
 
-void ReadFloats( json& list, float flt_array[] )
+template <typename Json>
+void ReadFloats( const Json& list, float flt_array[] )
 {
     uint32_t i = 0;
     for (auto& flt : list)
         flt_array[i++] = flt;
 }
 
-void glTF::Asset::ProcessNodes( json& nodes )
+template <typename Json>
+void glTF::Asset::ProcessNodes( const Json& nodes )
 {
     m_nodes.resize(nodes.size());
 
     uint32_t nodeIdx = 0;
 
-    for (json::iterator it = nodes.begin(); it != nodes.end(); ++it)
+    for (auto it = nodes.begin(); it != nodes.end(); ++it)
     {
         glTF::Node& node = m_nodes[nodeIdx++];
-        json& thisNode = it.value();
+        const Json& thisNode = it.value();
 
         node.flags = 0;
         node.mesh = nullptr;
@@ -66,7 +72,7 @@ void glTF::Asset::ProcessNodes( json& nodes )
 
         if (thisNode.find("children") != thisNode.end())
         {
-            json& children = thisNode["children"];
+            const Json& children = thisNode["children"];
             node.children.reserve(children.size());
             for (auto& child : children)
                 node.children.push_back(&m_nodes[child]);
@@ -81,7 +87,7 @@ void glTF::Asset::ProcessNodes( json& nodes )
         else
         {
             // TODO:  Should check scale for 1 or 3 negative values to reverse triangle winding
-            json::iterator scale = thisNode.find("scale");
+            auto scale = thisNode.find("scale");
             if (scale != thisNode.end())
             {
                 ReadFloats(scale.value(), node.scale);
@@ -93,7 +99,7 @@ void glTF::Asset::ProcessNodes( json& nodes )
                 node.scale[2] = 1.0f;
             }
 
-            json::iterator rotation = thisNode.find("rotation");
+            auto rotation = thisNode.find("rotation");
             if (rotation != thisNode.end())
             {
                 ReadFloats(rotation.value(), node.rotation);
@@ -106,7 +112,7 @@ void glTF::Asset::ProcessNodes( json& nodes )
                 node.rotation[3] = 1.0f;
             }
 
-            json::iterator translation = thisNode.find("translation");
+            auto translation = thisNode.find("translation");
             if (translation != thisNode.end())
             {
                 ReadFloats(translation.value(), node.translation);
@@ -121,18 +127,19 @@ void glTF::Asset::ProcessNodes( json& nodes )
     }
 }
 
-void glTF::Asset::ProcessScenes( json& scenes )
+template <typename Json>
+void glTF::Asset::ProcessScenes( const Json& scenes )
 {
     m_scenes.reserve(scenes.size());
 
-    for (json::iterator it = scenes.begin(); it != scenes.end(); ++it)
+    for (auto it = scenes.begin(); it != scenes.end(); ++it)
     {
         glTF::Scene scene;
-        json& thisScene = it.value();
+        const Json& thisScene = it.value();
 
         if (thisScene.find("nodes") != thisScene.end())
         {
-            json& nodes = thisScene["nodes"];
+            const Json& nodes = thisScene["nodes"];
             scene.nodes.reserve(nodes.size());
             for (auto& node : nodes)
                 scene.nodes.push_back(&m_nodes[node]);
@@ -142,18 +149,19 @@ void glTF::Asset::ProcessScenes( json& scenes )
     }
 }
 
-void glTF::Asset::ProcessCameras( json& cameras )
+template <typename Json>
+void glTF::Asset::ProcessCameras( const Json& cameras )
 {
     m_cameras.reserve(cameras.size());
 
-    for (json::iterator it = cameras.begin(); it != cameras.end(); ++it)
+    for (auto it = cameras.begin(); it != cameras.end(); ++it)
     {
         glTF::Camera camera;
-        json& thisCamera = it.value();
+        const Json& thisCamera = it.value();
 
         if (thisCamera["type"] == "perspective")
         {
-            json& perspective = thisCamera["perspective"];
+            const Json& perspective = thisCamera["perspective"];
             camera.type = Camera::kPerspective;
             camera.aspectRatio = 0.0f;
             if (perspective.find("aspectRatio") != perspective.end())
@@ -167,7 +175,7 @@ void glTF::Asset::ProcessCameras( json& cameras )
         else
         {
             camera.type = Camera::kOrthographic;
-            json& orthographic = thisCamera["orthographic"];
+            const Json& orthographic = thisCamera["orthographic"];
             camera.xmag = orthographic["xmag"];
             camera.ymag = orthographic["ymag"];
             camera.znear = orthographic["znear"];
@@ -189,25 +197,166 @@ uint16_t TypeToEnum( const char type[] )
         return Accessor::kScalar;
 }
 
-void glTF::Asset::ProcessAccessors( json& accessors )
+// Maps a normalized integer, read as it is stored, to [0, 1] or [-1, 1]. Other values pass through.
+static float DequantizeComponent( uint16_t componentType, bool normalized, float value )
+{
+    if (!normalized)
+        return value;
+
+    switch (componentType)
+    {
+    case Accessor::kByte:           return std::max(value / 127.0f, -1.0f);
+    case Accessor::kUnsignedByte:   return value / 255.0f;
+    case Accessor::kShort:          return std::max(value / 32767.0f, -1.0f);
+    case Accessor::kUnsignedShort:  return value / 65535.0f;
+    default:                        return value;
+    }
+}
+
+static float ReadComponent( const byte* data, uint16_t componentType, bool normalized )
+{
+    float value;
+    switch (componentType)
+    {
+    case Accessor::kByte:           value = (float)*(const int8_t*)data; break;
+    case Accessor::kUnsignedByte:   value = (float)*(const uint8_t*)data; break;
+    case Accessor::kShort:          { int16_t v; memcpy(&v, data, sizeof(v)); value = (float)v; break; }
+    case Accessor::kUnsignedShort:  { uint16_t v; memcpy(&v, data, sizeof(v)); value = (float)v; break; }
+    case Accessor::kSignedInt:      { int32_t v; memcpy(&v, data, sizeof(v)); value = (float)v; break; }
+    case Accessor::kUnsignedInt:    { uint32_t v; memcpy(&v, data, sizeof(v)); value = (float)v; break; }
+    default:                        memcpy(&value, data, sizeof(value)); break;
+    }
+    return DequantizeComponent(componentType, normalized, value);
+}
+
+uint32_t glTF::Accessor::GetComponentCount() const
+{
+    static const uint32_t kCounts[] = { 1, 2, 3, 4, 4, 9, 16 };
+    return kCounts[type];
+}
+
+uint32_t glTF::Accessor::GetComponentSize() const
+{
+    static const uint32_t kSizes[] = { 1, 1, 2, 2, 4, 4, 4 };
+    return kSizes[componentType];
+}
+
+uint32_t glTF::Accessor::GetElementSize() const
+{
+    // Matrix columns start on 4-byte boundaries
+    if (type >= kMat2)
+    {
+        const uint32_t rows = type - kMat2 + 2;
+        return rows * ((rows * GetComponentSize() + 3) & ~3u);
+    }
+    return GetComponentCount() * GetComponentSize();
+}
+
+void glTF::ReadDenseElements( const Accessor& accessor, std::vector<byte>& elements )
+{
+    const uint32_t elementSize = accessor.GetElementSize();
+    elements.assign((size_t)accessor.count * elementSize, (byte)0);
+
+    if (accessor.dataPtr != nullptr)
+    {
+        const uint32_t stride = accessor.stride ? accessor.stride : elementSize;
+        for (uint32_t i = 0; i < accessor.count; ++i)
+            memcpy(elements.data() + (size_t)i * elementSize, accessor.dataPtr + (size_t)i * stride, elementSize);
+    }
+
+    for (uint32_t i = 0; i < accessor.sparseCount; ++i)
+    {
+        uint32_t index;
+        if (accessor.sparseIndexType == Accessor::kUnsignedByte)
+            index = accessor.sparseIndices[i];
+        else if (accessor.sparseIndexType == Accessor::kUnsignedShort)
+        {
+            uint16_t v;
+            memcpy(&v, accessor.sparseIndices + i * sizeof(v), sizeof(v));
+            index = v;
+        }
+        else
+            memcpy(&index, accessor.sparseIndices + i * sizeof(index), sizeof(index));
+
+        if (index < accessor.count)
+            memcpy(elements.data() + (size_t)index * elementSize, accessor.sparseValues + (size_t)i * elementSize, elementSize);
+    }
+}
+
+void glTF::ReadFloatElements( const Accessor& accessor, std::vector<float>& elements )
+{
+    std::vector<byte> dense;
+    ReadDenseElements(accessor, dense);
+
+    const uint32_t componentCount = accessor.GetComponentCount();
+    const uint32_t componentSize = accessor.GetComponentSize();
+    const uint32_t elementSize = accessor.GetElementSize();
+    const uint32_t rows = accessor.type >= Accessor::kMat2 ? accessor.type - Accessor::kMat2 + 2 : componentCount;
+    const uint32_t columnSize = elementSize / (componentCount / rows);
+
+    elements.resize((size_t)accessor.count * componentCount);
+    for (uint32_t i = 0; i < accessor.count; ++i)
+    {
+        const byte* element = dense.data() + (size_t)i * elementSize;
+        for (uint32_t c = 0; c < componentCount; ++c)
+        {
+            const byte* component = element + (c / rows) * columnSize + (c % rows) * componentSize;
+            elements[(size_t)i * componentCount + c] = ReadComponent(component, accessor.componentType, accessor.normalized);
+        }
+    }
+}
+
+template <typename Json>
+void glTF::Asset::ProcessAccessors( const Json& accessors )
 {
     m_accessors.reserve(accessors.size());
 
-    for (json::iterator it = accessors.begin(); it != accessors.end(); ++it)
+    for (auto it = accessors.begin(); it != accessors.end(); ++it)
     {
         glTF::Accessor accessor;
-        json& thisAccessor = it.value();
+        const Json& thisAccessor = it.value();
 
-        glTF::BufferView& bufferView = m_bufferViews[thisAccessor.at("bufferView")];
-        accessor.dataPtr = m_buffers[bufferView.buffer]->data() + bufferView.byteOffset;
-        accessor.stride = bufferView.byteStride;
-        if (thisAccessor.find("byteOffset") != thisAccessor.end())
-            accessor.dataPtr += thisAccessor.at("byteOffset");
+        // Without a buffer view the elements are zeros, normally overwritten by a sparse substitution
+        accessor.dataPtr = nullptr;
+        accessor.stride = 0;
+        if (thisAccessor.find("bufferView") != thisAccessor.end())
+        {
+            glTF::BufferView& bufferView = m_bufferViews[thisAccessor.at("bufferView")];
+            accessor.dataPtr = m_buffers[bufferView.buffer]->data() + bufferView.byteOffset;
+            accessor.stride = bufferView.byteStride;
+            if (thisAccessor.find("byteOffset") != thisAccessor.end())
+                accessor.dataPtr += thisAccessor.at("byteOffset").template get<uint32_t>();
+        }
         accessor.count = thisAccessor.at("count");
-        accessor.componentType = thisAccessor.at("componentType").get<uint16_t>() - 5120;
+        accessor.componentType = thisAccessor.at("componentType").template get<uint16_t>() - 5120;
+        accessor.normalized = thisAccessor.find("normalized") != thisAccessor.end() && thisAccessor.at("normalized").template get<bool>();
+
+        accessor.sparseCount = 0;
+        accessor.sparseIndexType = Accessor::kUnsignedInt;
+        accessor.sparseIndices = nullptr;
+        accessor.sparseValues = nullptr;
+        if (thisAccessor.find("sparse") != thisAccessor.end())
+        {
+            const Json& sparse = thisAccessor.at("sparse");
+            const Json& indices = sparse.at("indices");
+            const Json& values = sparse.at("values");
+
+            glTF::BufferView& indexView = m_bufferViews[indices.at("bufferView")];
+            accessor.sparseIndices = m_buffers[indexView.buffer]->data() + indexView.byteOffset;
+            if (indices.find("byteOffset") != indices.end())
+                accessor.sparseIndices += indices.at("byteOffset").template get<uint32_t>();
+            accessor.sparseIndexType = indices.at("componentType").template get<uint16_t>() - 5120;
+
+            glTF::BufferView& valueView = m_bufferViews[values.at("bufferView")];
+            accessor.sparseValues = m_buffers[valueView.buffer]->data() + valueView.byteOffset;
+            if (values.find("byteOffset") != values.end())
+                accessor.sparseValues += values.at("byteOffset").template get<uint32_t>();
+
+            accessor.sparseCount = sparse.at("count");
+        }
 
         char type[8];
-        strcpy_s(type, thisAccessor.at("type").get<std::string>().c_str());
+        strcpy_s(type, thisAccessor.at("type").template get<std::string>().c_str());
 
         accessor.type = TypeToEnum(type);
 
@@ -215,9 +364,10 @@ void glTF::Asset::ProcessAccessors( json& accessors )
     }
 }
 
-void glTF::Asset::FindAttribute( Primitive& prim, json& attributes, Primitive::eAttribType type, const string& name )
+template <typename Json>
+void glTF::Asset::FindAttribute( Primitive& prim, const Json& attributes, Primitive::eAttribType type, const string& name )
 {
-    json::iterator attrib = attributes.find(name);
+    auto attrib = attributes.find(name);
     if (attrib != attributes.end())
     {
         prim.attribMask |= 1 << type;
@@ -229,27 +379,28 @@ void glTF::Asset::FindAttribute( Primitive& prim, json& attributes, Primitive::e
     }
 }
 
-void glTF::Asset::ProcessMeshes( json& meshes, json& accessors )
+template <typename Json>
+void glTF::Asset::ProcessMeshes( const Json& meshes, const Json& accessors )
 {
     m_meshes.resize(meshes.size());
 
     uint32_t curMesh = 0;
-    for (json::iterator meshIt = meshes.begin(); meshIt != meshes.end(); ++meshIt, ++curMesh)
+    for (auto meshIt = meshes.begin(); meshIt != meshes.end(); ++meshIt, ++curMesh)
     {
-        json& thisMesh = meshIt.value();
-        json& primitives = thisMesh.at("primitives");
+        const Json& thisMesh = meshIt.value();
+        const Json& primitives = thisMesh.at("primitives");
 
         m_meshes[curMesh].primitives.resize(primitives.size());
         m_meshes[curMesh].skin = -1;
 
         uint32_t curSubMesh = 0;
-        for (json::iterator primIt = primitives.begin(); primIt != primitives.end(); ++primIt, ++curSubMesh)
+        for (auto primIt = primitives.begin(); primIt != primitives.end(); ++primIt, ++curSubMesh)
         {
             glTF::Primitive& prim = m_meshes[curMesh].primitives[curSubMesh];
-            json& thisPrim = primIt.value();
+            const Json& thisPrim = primIt.value();
 
             prim.attribMask = 0;
-            json& attributes = thisPrim.at("attributes");
+            const Json& attributes = thisPrim.at("attributes");
 
             FindAttribute(prim, attributes, Primitive::kPosition, "POSITION");
             FindAttribute(prim, attributes, Primitive::kNormal, "NORMAL");
@@ -261,10 +412,18 @@ void glTF::Asset::ProcessMeshes( json& meshes, json& accessors )
             FindAttribute(prim, attributes, Primitive::kWeights0, "WEIGHTS_0");
 
             // Read position AABB
-            json& positionAccessor = accessors[attributes.at("POSITION").get<uint32_t>()];
+            const Json& positionAccessor = accessors[attributes.at("POSITION").template get<uint32_t>()];
             ReadFloats(positionAccessor.at("min"), prim.minPos);
             ReadFloats(positionAccessor.at("max"), prim.maxPos);
 
+            // KHR_mesh_quantization positions keep their bounds in the stored integers
+            const Accessor& positions = *prim.attributes[Primitive::kPosition];
+            for (uint32_t i = 0; i < 3; ++i)
+            {
+                prim.minPos[i] = DequantizeComponent(positions.componentType, positions.normalized, prim.minPos[i]);
+                prim.maxPos[i] = DequantizeComponent(positions.componentType, positions.normalized, prim.maxPos[i]);
+            }
+
             prim.mode = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
             prim.indices = nullptr;
             prim.material = nullptr;
@@ -278,7 +437,7 @@ void glTF::Asset::ProcessMeshes( json& meshes, json& accessors )
             if (thisPrim.find("indices") != thisPrim.end())
             {
                 uint32_t accessorIndex = thisPrim.at("indices");
-                json& indicesAccessor = accessors[accessorIndex];
+                const Json& indicesAccessor = accessors[accessorIndex];
                 prim.indices = &m_accessors[accessorIndex];
                 if (indicesAccessor.find("max") != indicesAccessor.end())
                     prim.maxIndex = indicesAccessor.at("max")[0];
@@ -295,15 +454,16 @@ void glTF::Asset::ProcessMeshes( json& meshes, json& accessors )
     }
 }
 
-void glTF::Asset::ProcessSkins( json& skins )
+template <typename Json>
+void glTF::Asset::ProcessSkins( const Json& skins )
 {
     uint32_t skinIdx = 0;
 
-    for (json::iterator it = skins.begin(); it != skins.end(); ++it)
+    for (auto it = skins.begin(); it != skins.end(); ++it)
     {
         glTF::Skin& skin = m_skins[skinIdx++];
 
-        json& thisSkin = it.value();
+        const Json& thisSkin = it.value();
 
         skin.inverseBindMatrices = nullptr;
         skin.skeleton = nullptr;
@@ -317,7 +477,7 @@ void glTF::Asset::ProcessSkins( json& skins )
             skin.skeleton->skeletonRoot = true;
         }
 
-        json& joints = thisSkin.at("joints");
+        const Json& joints = thisSkin.at("joints");
         skin.joints.reserve(joints.size());
         for (auto& joint : joints)
             skin.joints.push_back(&m_nodes[joint]);
@@ -332,7 +492,8 @@ inline uint32_t floatToHalf( float f )
     return x.u >> 13;
 }
 
-uint32_t glTF::Asset::ReadTextureInfo( json& info_json, glTF::Texture* &info )
+template <typename Json>
+uint32_t glTF::Asset::ReadTextureInfo( const Json& info_json, glTF::Texture* &info )
 {
     info = nullptr;
 
@@ -345,21 +506,33 @@ uint32_t glTF::Asset::ReadTextureInfo( json& info_json, glTF::Texture* &info )
         return 0;
 }
 
-void glTF::Asset::ProcessMaterials( json& materials )
+template <typename Json>
+void glTF::Asset::ProcessMaterials( const Json& materials )
 {
     m_materials.reserve(materials.size());
 
     uint32_t materialIdx = 0;
 
-    for (json::iterator it = materials.begin(); it != materials.end(); ++it)
+    for (auto it = materials.begin(); it != materials.end(); ++it)
     {
         glTF::Material material;
-        json& thisMaterial = it.value();
+        const Json& thisMaterial = it.value();
 
         material.index = materialIdx++;
         material.flags = 0;
         material.alphaCutoff = floatToHalf(0.5f);
         material.normalTextureScale = 1.0f;
+        material.baseColorFactor[0] = 1.0f;
+        material.baseColorFactor[1] = 1.0f;
+        material.baseColorFactor[2] = 1.0f;
+        material.baseColorFactor[3] = 1.0f;
+        material.metallicFactor = 1.0f;
+        material.roughnessFactor = 1.0f;
+        material.emissiveFactor[0] = 0.0f;
+        material.emissiveFactor[1] = 0.0f;
+        material.emissiveFactor[2] = 0.0f;
+        for (uint32_t i = 0; i < Material::kNumTextures; ++i)
+            material.textures[i] = nullptr;
 
         if (thisMaterial.find("alphaMode") != thisMaterial.end())
         {
@@ -378,16 +551,7 @@ void glTF::Asset::ProcessMaterials( json& materials )
 
         if (thisMaterial.find("pbrMetallicRoughness") != thisMaterial.end())
         {
-            json& metallicRoughness = thisMaterial.at("pbrMetallicRoughness");
-
-            material.baseColorFactor[0] = 1.0f;
-            material.baseColorFactor[1] = 1.0f;
-            material.baseColorFactor[2] = 1.0f;
-            material.baseColorFactor[3] = 1.0f;
-            material.metallicFactor = 1.0f;
-            material.roughnessFactor = 1.0f;
-            for (uint32_t i = 0; i < Material::kNumTextures; ++i)
-                material.textures[i] = nullptr;
+            const Json& metallicRoughness = thisMaterial.at("pbrMetallicRoughness");
 
             if (metallicRoughness.find("baseColorFactor") != metallicRoughness.end())
                 ReadFloats(metallicRoughness.at("baseColorFactor"), material.baseColorFactor);
@@ -432,58 +596,79 @@ void glTF::Asset::ProcessMaterials( json& materials )
     }
 }
 
-bool ReadFile(const wstring& fileName, void* Dest, size_t Size)
+byte* glTF::Buffer::GetWritableData()
 {
-    struct _stat64 fileStat;
-    int fileExists = _wstat64(fileName.c_str(), &fileStat);
-    if (fileExists == -1)
-        return false;
-
-    ifstream file(fileName, ios::in | ios::binary);
-    if (!file)
-        return false;
-
-    ASSERT(Size == (size_t)fileStat.st_size);
-    file.read((char*)Dest, Size);
-    file.close();
-
-    return true;
+    if (m_file != nullptr)
+    {
+        m_bytes.assign(m_data, m_data + m_size);
+        m_data = m_bytes.data();
+        m_file = nullptr;
+    }
+    return m_data;
 }
 
-void glTF::Asset::ProcessBuffers( json& buffers, ByteArray chunk1bin )
+template <typename Json>
+void glTF::Asset::ProcessBuffers( const Json& buffers, BufferPtr chunk1bin )
 {
     m_buffers.reserve(buffers.size());
+    m_bufferFiles.reserve(buffers.size());
 
-    for (json::iterator it = buffers.begin(); it != buffers.end(); ++it)
+    for (auto it = buffers.begin(); it != buffers.end(); ++it)
     {
-        json& thisBuffer = it.value();
+        const Json& thisBuffer = it.value();
+
+        // An EXT_meshopt_compression fallback buffer only exists to receive the views decoded into it, so its file
+        // (if it names one at all) isn't loaded.
+        auto extensions = thisBuffer.find("extensions");
+        if (extensions != thisBuffer.end())
+        {
+            auto meshopt = extensions.value().find("EXT_meshopt_compression");
+            if (meshopt != extensions.value().end() && meshopt.value().find("fallback") != meshopt.value().end() &&
+                meshopt.value().at("fallback").template get<bool>())
+            {
+                m_buffers.push_back(std::make_shared<Buffer>(thisBuffer.at("byteLength").template get<size_t>()));
+                m_bufferFiles.push_back(wstring());
+                continue;
+            }
+        }
 
         if (thisBuffer.find("uri") != thisBuffer.end())
         {
             const string& uri = thisBuffer.at("uri");
             wstring filepath = m_basePath + wstring(uri.begin(), uri.end());
 
-            ByteArray ba = ReadFileSync(filepath);
-            ASSERT(ba->size() > 0, "Missing bin file %ws", filepath.c_str());
-            m_buffers.push_back(ba);
+            // Mapped, not read: the pages are read in as accessors touch them
+            std::shared_ptr<Utility::FileMapping> file = std::make_shared<Utility::FileMapping>();
+            if (file->Open(filepath))
+            {
+                m_buffers.push_back(std::make_shared<Buffer>(file, 0, file->GetSize()));
+            }
+            else
+            {
+                ASSERT(0, "Missing bin file %ws", filepath.c_str());
+                m_buffers.push_back(std::make_shared<Buffer>(0));
+            }
+            m_bufferFiles.push_back(filepath);
         }
         else
         {
             ASSERT(it == buffers.begin(), "Only the 1st buffer allowed to be internal");
-            ASSERT(chunk1bin->size() > 0, "GLB chunk1 missing data or not a GLB file");
-            m_buffers.push_back(chunk1bin);
+            ASSERT(chunk1bin != nullptr && chunk1bin->size() > 0, "GLB chunk1 missing data or not a GLB file");
+            m_buffers.push_back(chunk1bin != nullptr ? chunk1bin : std::make_shared<Buffer>(0));
+            m_bufferFiles.push_back(wstring());
         }
     }
 }
 
-void glTF::Asset::ProcessBufferViews( json& bufferViews )
+template <typename Json>
+void glTF::Asset::ProcessBufferViews( const Json& bufferViews )
 {
     m_bufferViews.reserve(bufferViews.size());
 
-    for (json::iterator it = bufferViews.begin(); it != bufferViews.end(); ++it)
+    for (auto it = bufferViews.begin(); it != bufferViews.end(); ++it)
     {
         glTF::BufferView bufferView;
-        json& thisBufferView = it.value();
+        const Json& thisBufferView = it.value();
 
         bufferView.buffer = thisBufferView.at("buffer");
         bufferView.byteLength = thisBufferView.at("byteLength");
@@ -501,26 +686,79 @@ void glTF::Asset::ProcessBufferViews( json& bufferViews )
         if (thisBufferView.find("target") != thisBufferView.end() && thisBufferView.at("target") == 34963)
             bufferView.elementArrayBuffer = true;
 
+        auto extensions = thisBufferView.find("extensions");
+        if (extensions != thisBufferView.end())
+        {
+            auto meshopt = extensions.value().find("EXT_meshopt_compression");
+            if (meshopt != extensions.value().end())
+                DecodeMeshoptView(bufferView, meshopt.value());
+        }
+
         m_bufferViews.push_back(bufferView);
     }
 }
 
-void glTF::Asset::ProcessImages( json& images )
+// EXT_meshopt_compression views are decoded as the file is parsed, into the view's own location (normally in a
+// fallback buffer), so accessors read them like any other view.
+template <typename Json>
+void glTF::Asset::DecodeMeshoptView( const BufferView& view, const Json& compression )
+{
+    const uint32_t source = compression.at("buffer");
+    const uint32_t byteOffset = compression.find("byteOffset") != compression.end() ? compression.at("byteOffset").template get<uint32_t>() : 0;
+    const uint32_t byteLength = compression.at("byteLength");
+    const uint32_t byteStride = compression.at("byteStride");
+    const uint32_t count = compression.at("count");
+    const std::string mode = compression.at("mode");
+    const std::string filter = compression.find("filter") != compression.end() ? compression.at("filter").template get<std::string>() : "NONE";
+
+    const BufferPtr& sourceBuffer = m_buffers[source];
+    const BufferPtr& targetBuffer = m_buffers[view.buffer];
+    if ((size_t)byteOffset + byteLength > sourceBuffer->size() ||
+        (size_t)view.byteOffset + (size_t)count * byteStride > targetBuffer->size())
+    {
+        Utility::Printf("EXT_meshopt_compression view doesn't fit its buffers\n");
+        return;
+    }
+
+    const uint8_t* encoded = (const uint8_t*)sourceBuffer->data() + byteOffset;
+    byte* decoded = targetBuffer->GetWritableData() + view.byteOffset;
+
+    bool success = false;
+    if (mode == "ATTRIBUTES")
+        success = MeshoptDecoder::DecodeVertexBuffer(decoded, count, byteStride, encoded, byteLength);
+    else if (mode == "TRIANGLES")
+        success = MeshoptDecoder::DecodeIndexBuffer(decoded, count, byteStride, encoded, byteLength);
+    else if (mode == "INDICES")
+        success = MeshoptDecoder::DecodeIndexSequence(decoded, count, byteStride, encoded, byteLength);
+
+    if (success && filter == "OCTAHEDRAL")
+        success = MeshoptDecoder::DecodeFilterOctahedral(decoded, count, byteStride);
+    else if (success && filter == "QUATERNION")
+        success = MeshoptDecoder::DecodeFilterQuaternion(decoded, count, byteStride);
+    else if (success && filter == "EXPONENTIAL")
+        success = MeshoptDecoder::DecodeFilterExponential(decoded, count, byteStride);
+
+    if (!success)
+        Utility::Printf("Failed to decode an EXT_meshopt_compression view (mode %s, filter %s)\n", mode.c_str(), filter.c_str());
+}
+
+template <typename Json>
+void glTF::Asset::ProcessImages( const Json& images )
 {
     m_images.resize(images.size());
 
     uint32_t imageIdx = 0;
 
-    for (json::iterator it = images.begin(); it != images.end(); ++it)
+    for (auto it = images.begin(); it != images.end(); ++it)
     {
-        json& thisImage = it.value();
+        const Json& thisImage = it.value();
         if (thisImage.find("uri") != thisImage.end())
         {
-            m_images[imageIdx++].path = thisImage.at("uri").get<string>();
+            m_images[imageIdx++].path = thisImage.at("uri").template get<string>();
         }
         else if (thisImage.find("bufferView") != thisImage.end())
         {
-            Utility::Printf("GLB image at buffer view %d with mime type %s\n", thisImage.at("bufferView").get<uint32_t>(), thisImage.at("mimeType").get<string>().c_str());
+            Utility::Printf("GLB image at buffer view %d with mime type %s\n", thisImage.at("bufferView").template get<uint32_t>(), thisImage.at("mimeType").template get<string>().c_str());
         }
         else
         {
@@ -556,15 +794,16 @@ D3D12_FILTER GLtoD3DTextureFilterMode( int32_t magFilter, int32_t minFilter )
 }
 */
 
-void glTF::Asset::ProcessSamplers( json& samplers )
+template <typename Json>
+void glTF::Asset::ProcessSamplers( const Json& samplers )
 {
     m_samplers.resize(samplers.size());
 
     uint32_t samplerIdx = 0;
 
-    for (json::iterator it = samplers.begin(); it != samplers.end(); ++it)
+    for (auto it = samplers.begin(); it != samplers.end(); ++it)
     {
-        json& thisSampler = it.value();
+        const Json& thisSampler = it.value();
 
         glTF::Sampler& sampler = m_samplers[samplerIdx++];
         sampler.filter = D3D12_FILTER_ANISOTROPIC;
@@ -592,16 +831,17 @@ void glTF::Asset::ProcessSamplers( json& samplers )
     }
 }
 
-void glTF::Asset::ProcessTextures( json& textures )
+template <typename Json>
+void glTF::Asset::ProcessTextures( const Json& textures )
 {
     m_textures.resize(textures.size());
 
     uint32_t texIdx = 0;
 
-    for (json::iterator it = textures.begin(); it != textures.end(); ++it)
+    for (auto it = textures.begin(); it != textures.end(); ++it)
     {
         glTF::Texture& texture = m_textures[texIdx++];
-        json& thisTexture = it.value();
+        const Json& thisTexture = it.value();
 
         texture.source = nullptr;
         texture.sampler = nullptr;
@@ -614,25 +854,26 @@ void glTF::Asset::ProcessTextures( json& textures )
     }
 }
 
-void glTF::Asset::ProcessAnimations(json& animations)
+template <typename Json>
+void glTF::Asset::ProcessAnimations( const Json& animations )
 {
     m_animations.resize(animations.size());
     uint32_t animIdx = 0;
 
     // Process all animations
-    for (json::iterator it = animations.begin(); it != animations.end(); ++it)
+    for (auto it = animations.begin(); it != animations.end(); ++it)
     {
-        json& thisAnimation = it.value();
+        const Json& thisAnimation = it.value();
         glTF::Animation& animation = m_animations[animIdx++];
 
         // Process this animation's samplers
-        json& samplers = thisAnimation.at("samplers");
+        const Json& samplers = thisAnimation.at("samplers");
         animation.m_samplers.resize(samplers.size());
         uint32_t samplerIdx = 0;
 
-        for (json::iterator it2 = samplers.begin(); it2 != samplers.end(); ++it2)
+        for (auto it2 = samplers.begin(); it2 != samplers.end(); ++it2)
         {
-            json& thisSampler = it2.value();
+            const Json& thisSampler = it2.value();
             glTF::AnimSampler& sampler = animation.m_samplers[samplerIdx++];
             sampler.m_input = &m_accessors[thisSampler.at("input")];
             sampler.m_output = &m_accessors[thisSampler.at("output")];
@@ -652,16 +893,16 @@ void glTF::Asset::ProcessAnimations(json& animations)
         }
 
         // Process this animation's channels
-        json& channels = thisAnimation.at("channels");
+        const Json& channels = thisAnimation.at("channels");
         animation.m_channels.resize(channels.size());
         uint32_t channelIdx = 0;
 
-        for (json::iterator it2 = channels.begin(); it2 != channels.end(); ++it2)
+        for (auto it2 = channels.begin(); it2 != channels.end(); ++it2)
         {
-            json& thisChannel = it2.value();
+            const Json& thisChannel = it2.value();
             glTF::AnimChannel& channel = animation.m_channels[channelIdx++];
             channel.m_sampler = &animation.m_samplers[thisChannel.at("sampler")];
-            json& thisTarget = thisChannel.at("target");
+            const Json& thisTarget = thisChannel.at("target");
             channel.m_target = &m_nodes[thisTarget.at("node")];
             const std::string& path = thisTarget.at("path");
             if (path == "translation")
@@ -676,62 +917,94 @@ void glTF::Asset::ProcessAnimations(json& animations)
     }
 }
 
-void glTF::Asset::Parse(const std::wstring& filepath)
+// Reads the JSON text, null terminated, and for GLB files maps the file and returns the binary chunk as a view of
+// the mapping, so that reading the JSON doesn't wait for the geometry.
+static bool ReadDocument(const std::wstring& filepath, ByteArray& gltfFile, BufferPtr& chunk1Bin)
 {
-    // TODO:  add GLB support by extracting JSON section and BIN sections
     //https://github.com/KhronosGroup/glTF/blob/master/specification/2.0/README.md#glb-file-format-specification
 
-    ByteArray gltfFile;
-    ByteArray chunk1Bin;
-
     std::wstring fileExt = Utility::ToLower(Utility::GetFileExtension(filepath));
 
     if (fileExt == L"glb")
     {
-        ifstream glbFile(filepath, ios::in | ios::binary);
+        std::shared_ptr<Utility::FileMapping> glbFile = std::make_shared<Utility::FileMapping>();
+        if (!glbFile->Open(filepath))
+        {
+            Utility::Printf("Error:  Unable to open %ws\n", filepath.c_str());
+            return false;
+        }
+
         struct GLBHeader
         {
             char magic[4];
             uint32_t version;
             uint32_t length;
-        } header;
-        glbFile.read((char*)&header, sizeof(GLBHeader));
+        };
+        struct GLBChunk
+        {
+            uint32_t length;
+            char type[4];
+        };
+
+        const byte* data = glbFile->GetData();
+        const size_t size = glbFile->GetSize();
+        GLBHeader header;
+        if (size < sizeof(GLBHeader) + sizeof(GLBChunk))
+        {
+            Utility::Printf("Error:  Invalid glTF binary format\n");
+            return false;
+        }
+        memcpy(&header, data, sizeof(GLBHeader));
         if (strncmp(header.magic, "glTF", 4) != 0)
         {
             Utility::Printf("Error:  Invalid glTF binary format\n");
-            return;
+            return false;
         }
         if (header.version != 2)
         {
             Utility::Printf("Error:  Only glTF 2.0 is supported\n");
-            return;
+            return false;
         }
 
-        uint32_t chunk0Length;
-        char chunk0Type[4];
-        glbFile.read((char*)&chunk0Length, 4);
-        glbFile.read((char*)&chunk0Type, 4);
-        if (strncmp(chunk0Type, "JSON", 4) != 0)
+        size_t offset = sizeof(GLBHeader);
+        GLBChunk chunk0;
+        memcpy(&chunk0, data + offset, sizeof(GLBChunk));
+        offset += sizeof(GLBChunk);
+        if (strncmp(chunk0.type, "JSON", 4) != 0)
         {
             Utility::Printf("Error: Expected chunk0 to contain JSON\n");
-            return;
+            return false;
+        }
+        if (chunk0.length > size - offset)
+        {
+            Utility::Printf("Error: Truncated glTF binary file\n");
+            return false;
         }
-        gltfFile = make_shared<vector<byte>>( chunk0Length + 1 );
-        glbFile.read((char*)gltfFile->data(), chunk0Length);
-        (*gltfFile)[chunk0Length] = '\0';
+        gltfFile = make_shared<vector<byte>>( chunk0.length + 1 );
+        memcpy(gltfFile->data(), data + offset, chunk0.length);
+        (*gltfFile)[chunk0.length] = '\0';
+        offset += chunk0.length;
 
-        uint32_t chunk1Length;
-        char chunk1Type[4];
-        glbFile.read((char*)&chunk1Length, 4);
-        glbFile.read((char*)&chunk1Type, 4);
-        if (strncmp(chunk1Type, "BIN", 3) != 0)
+        GLBChunk chunk1;
+        if (size - offset < sizeof(GLBChunk))
         {
             Utility::Printf("Error: Expected chunk1 to contain BIN\n");
-            return;
-       }
+            return false;
+        }
+        memcpy(&chunk1, data + offset, sizeof(GLBChunk));
+        offset += sizeof(GLBChunk);
+        if (strncmp(chunk1.type, "BIN", 3) != 0)
+        {
+            Utility::Printf("Error: Expected chunk1 to contain BIN\n");
+            return false;
+        }
+        if (chunk1.length > size - offset)
+        {
+            Utility::Printf("Error: Truncated glTF binary file\n");
+            return false;
+        }
 
-        chunk1Bin = make_shared<vector<byte>>(chunk1Length);
-        glbFile.read((char*)chunk1Bin->data(), chunk1Length);
+        chunk1Bin = make_shared<Buffer>(glbFile, offset, chunk1.length);
     }
     else 
     {
@@ -740,24 +1013,30 @@ void glTF::Asset::Parse(const std::wstring& filepath)
         // Null terminate the string (just in case)
         gltfFile = ReadFileSync(filepath);
         if (gltfFile->size() == 0)
-            return;
+            return false;
 
         gltfFile->push_back('\0');
-        chunk1Bin = make_shared<vector<byte>>(0);
+        chunk1Bin = nullptr;
     }
 
-    json root = json::parse((const char*)gltfFile->data());
-    if (!root.is_object())
+    return true;
+}
+
+template <typename Json>
+void glTF::Asset::ProcessDocument( const Json& root, BufferPtr chunk1Bin )
+{
+    // Compressed geometry other than meshopt (KHR_draco_mesh_compression) has no decoder here; such files load with
+    // whatever their uncompressed fallback provides.
+    if (root.find("extensionsRequired") != root.end())
     {
-        Printf("Invalid glTF file: %s\n", filepath.c_str());
-        return;
+        for (auto& extension : root.at("extensionsRequired"))
+        {
+            const std::string name = extension;
+            if (name != "EXT_meshopt_compression" && name != "KHR_mesh_quantization")
+                Printf("Unsupported required glTF extension %s\n", name.c_str());
+        }
     }
 
-    // Strip off file name to get root path to other related files
-    m_basePath = Utility::GetBasePath(filepath);
-
-    // Parse all state
-
     if (root.find("buffers") != root.end())
         ProcessBuffers(root.at("buffers"), chunk1Bin);
     if (root.find("bufferViews") != root.end())
@@ -789,3 +1068,324 @@ void glTF::Asset::Parse(const std::wstring& filepath)
     if (root.find("scene") != root.end())
         m_scene = &m_scenes[root.at("scene")];
 }
+
+void glTF::Asset::Parse(const std::wstring& filepath)
+{
+    ByteArray gltfFile;
+    BufferPtr chunk1Bin;
+    if (!ReadDocument(filepath, gltfFile, chunk1Bin))
+        return;
+
+    // Strings in the document point into gltfFile, which outlives it. Like json::parse, stop at the terminator.
+    JsonDocument document;
+    const char* text = (const char*)gltfFile->data();
+    if (!document.Parse(text, strlen(text)))
+    {
+        Printf("Invalid glTF file %ws: %s\n", filepath.c_str(), document.GetError().c_str());
+        return;
+    }
+
+    const JsonValue& root = document.GetRoot();
+    if (!root.is_object())
+    {
+        Printf("Invalid glTF file: %ws\n", filepath.c_str());
+        return;
+    }
+
+    // Strip off file name to get root path to other related files
+    m_basePath = Utility::GetBasePath(filepath);
+
+    // Parse all state
+    ProcessDocument(root, chunk1Bin);
+}
+
+template <typename T>
+static ptrdiff_t IndexOf( const std::vector<T>& list, const T* element )
+{
+    return element == nullptr ? -1 : element - list.data();
+}
+
+template <typename T>
+static bool SameIndices( const std::vector<T>& listA, const std::vector<T*>& a, const std::vector<T>& listB, const std::vector<T*>& b )
+{
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        if (IndexOf(listA, a[i]) != IndexOf(listB, b[i]))
+            return false;
+    }
+    return true;
+}
+
+static bool SameFloats( const float* a, const float* b, size_t count )
+{
+    return memcmp(a, b, count * sizeof(float)) == 0;
+}
+
+// Accessors point into buffers, which each parse reads anew, so they are compared as buffer index and offset.
+static std::pair<ptrdiff_t, ptrdiff_t> AccessorLocation( const Asset& asset, const byte* pointer )
+{
+    for (size_t i = 0; pointer != nullptr && i < asset.m_buffers.size(); ++i)
+    {
+        const byte* data = asset.m_buffers[i]->data();
+        if (pointer >= data && pointer <= data + asset.m_buffers[i]->size())
+            return std::make_pair((ptrdiff_t)i, pointer - data);
+    }
+    return std::make_pair((ptrdiff_t)-1, (ptrdiff_t)0);
+}
+
+static bool SameAssets( const Asset& a, const Asset& b )
+{
+    if (a.m_scenes.size() != b.m_scenes.size() || a.m_nodes.size() != b.m_nodes.size() ||
+        a.m_cameras.size() != b.m_cameras.size() || a.m_meshes.size() != b.m_meshes.size() ||
+        a.m_images.size() != b.m_images.size() || a.m_samplers.size() != b.m_samplers.size() ||
+        a.m_textures.size() != b.m_textures.size() || a.m_accessors.size() != b.m_accessors.size() ||
+        a.m_skins.size() != b.m_skins.size() || a.m_materials.size() != b.m_materials.size() ||
+        a.m_buffers.size() != b.m_buffers.size() || a.m_bufferViews.size() != b.m_bufferViews.size() ||
+        a.m_animations.size() != b.m_animations.size())
+        return false;
+
+    if (IndexOf(a.m_scenes, a.m_scene) != IndexOf(b.m_scenes, b.m_scene))
+        return false;
+
+    for (size_t i = 0; i < a.m_scenes.size(); ++i)
+    {
+        if (!SameIndices(a.m_nodes, a.m_scenes[i].nodes, b.m_nodes, b.m_scenes[i].nodes))
+            return false;
+    }
+
+    for (size_t i = 0; i < a.m_nodes.size(); ++i)
+    {
+        const Node& na = a.m_nodes[i];
+        const Node& nb = b.m_nodes[i];
+        if (na.flags != nb.flags || na.linearIdx != nb.linearIdx ||
+            !SameIndices(a.m_nodes, na.children, b.m_nodes, nb.children))
+            return false;
+        if (na.pointsToCamera ? IndexOf(a.m_cameras, na.camera) != IndexOf(b.m_cameras, nb.camera) :
+            IndexOf(a.m_meshes, na.mesh) != IndexOf(b.m_meshes, nb.mesh))
+            return false;
+        if (na.hasMatrix ? !SameFloats(na.matrix, nb.matrix, 16) :
+            !SameFloats(na.scale, nb.scale, 3) || !SameFloats(na.rotation, nb.rotation, 4) ||
+            !SameFloats(na.translation, nb.translation, 3))
+            return false;
+    }
+
+    for (size_t i = 0; i < a.m_cameras.size(); ++i)
+    {
+        const Camera& ca = a.m_cameras[i];
+        const Camera& cb = b.m_cameras[i];
+        if (ca.type != cb.type || ca.xmag != cb.xmag || ca.ymag != cb.ymag || ca.znear != cb.znear || ca.zfar != cb.zfar)
+            return false;
+    }
+
+    for (size_t i = 0; i < a.m_meshes.size(); ++i)
+    {
+        const Mesh& ma = a.m_meshes[i];
+        const Mesh& mb = b.m_meshes[i];
+        if (ma.skin != mb.skin || ma.primitives.size() != mb.primitives.size())
+            return false;
+
+        for (size_t j = 0; j < ma.primitives.size(); ++j)
+        {
+            const Primitive& pa = ma.primitives[j];
+            const Primitive& pb = mb.primitives[j];
+            if (pa.attribMask != pb.attribMask || pa.mode != pb.mode || pa.minIndex != pb.minIndex ||
+                pa.maxIndex != pb.maxIndex || !SameFloats(pa.minPos, pb.minPos, 3) || !SameFloats(pa.maxPos, pb.maxPos, 3) ||
+                IndexOf(a.m_accessors, pa.indices) != IndexOf(b.m_accessors, pb.indices) ||
+                IndexOf(a.m_materials, pa.material) != IndexOf(b.m_materials, pb.material))
+                return false;
+            for (uint32_t k = 0; k < Primitive::kNumAttribs; ++k)
+            {
+                if (IndexOf(a.m_accessors, pa.attributes[k]) != IndexOf(b.m_accessors, pb.attributes[k]))
+                    return false;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < a.m_images.size(); ++i)
+    {
+        if (a.m_images[i].path != b.m_images[i].path)
+            return false;
+    }
+
+    for (size_t i = 0; i < a.m_samplers.size(); ++i)
+    {
+        const Sampler& sa = a.m_samplers[i];
+        const Sampler& sb = b.m_samplers[i];
+        if (sa.filter != sb.filter || sa.wrapS != sb.wrapS || sa.wrapT != sb.wrapT)
+            return false;
+    }
+
+    for (size_t i = 0; i < a.m_textures.size(); ++i)
+    {
+        const Texture& ta = a.m_textures[i];
+        const Texture& tb = b.m_textures[i];
+        if (IndexOf(a.m_images, ta.source) != IndexOf(b.m_images, tb.source) ||
+            IndexOf(a.m_samplers, ta.sampler) != IndexOf(b.m_samplers, tb.sampler))
+            return false;
+    }
+
+    for (size_t i = 0; i < a.m_accessors.size(); ++i)
+    {
+        const Accessor& aa = a.m_accessors[i];
+        const Accessor& ab = b.m_accessors[i];
+        if (AccessorLocation(a, aa.dataPtr) != AccessorLocation(b, ab.dataPtr) || aa.stride != ab.stride || aa.count != ab.count ||
+            aa.componentType != ab.componentType || aa.type != ab.type || aa.normalized != ab.normalized)
+            return false;
+        if (aa.sparseCount != ab.sparseCount || aa.sparseIndexType != ab.sparseIndexType ||
+            AccessorLocation(a, aa.sparseIndices) != AccessorLocation(b, ab.sparseIndices) ||
+            AccessorLocation(a, aa.sparseValues) != AccessorLocation(b, ab.sparseValues))
+            return false;
+    }
+
+    for (size_t i = 0; i < a.m_skins.size(); ++i)
+    {
+        const Skin& sa = a.m_skins[i];
+        const Skin& sb = b.m_skins[i];
+        if (IndexOf(a.m_accessors, sa.inverseBindMatrices) != IndexOf(b.m_accessors, sb.inverseBindMatrices) ||
+            IndexOf(a.m_nodes, sa.skeleton) != IndexOf(b.m_nodes, sb.skeleton) ||
+            !SameIndices(a.m_nodes, sa.joints, b.m_nodes, sb.joints))
+            return false;
+    }
+
+    for (size_t i = 0; i < a.m_materials.size(); ++i)
+    {
+        const Material& ma = a.m_materials[i];
+        const Material& mb = b.m_materials[i];
+        if (ma.flags != mb.flags || ma.index != mb.index || !SameFloats(ma.baseColorFactor, mb.baseColorFactor, 4) ||
+            ma.metallicFactor != mb.metallicFactor || ma.roughnessFactor != mb.roughnessFactor ||
+            !SameFloats(ma.emissiveFactor, mb.emissiveFactor, 3) || ma.normalTextureScale != mb.normalTextureScale)
+            return false;
+        for (uint32_t k = 0; k < Material::kNumTextures; ++k)
+        {
+            if (IndexOf(a.m_textures, ma.textures[k]) != IndexOf(b.m_textures, mb.textures[k]))
+                return false;
+        }
+    }
+
+    for (size_t i = 0; i < a.m_buffers.size(); ++i)
+    {
+        if (a.m_buffers[i]->size() != b.m_buffers[i]->size())
+            return false;
+    }
+
+    for (size_t i = 0; i < a.m_bufferViews.size(); ++i)
+    {
+        const BufferView& va = a.m_bufferViews[i];
+        const BufferView& vb = b.m_bufferViews[i];
+        if (va.buffer != vb.buffer || va.byteLength != vb.byteLength || va.byteOffset != vb.byteOffset ||
+            va.byteStride != vb.byteStride || va.elementArrayBuffer != vb.elementArrayBuffer)
+            return false;
+    }
+
+    for (size_t i = 0; i < a.m_animations.size(); ++i)
+    {
+        const Animation& aa = a.m_animations[i];
+        const Animation& ab = b.m_animations[i];
+        if (aa.m_samplers.size() != ab.m_samplers.size() || aa.m_channels.size() != ab.m_channels.size())
+            return false;
+        for (size_t j = 0; j < aa.m_samplers.size(); ++j)
+        {
+            const AnimSampler& sa = aa.m_samplers[j];
+            const AnimSampler& sb = ab.m_samplers[j];
+            if (IndexOf(a.m_accessors, sa.m_input) != IndexOf(b.m_accessors, sb.m_input) ||
+                IndexOf(a.m_accessors, sa.m_output) != IndexOf(b.m_accessors, sb.m_output) ||
+                sa.m_interpolation != sb.m_interpolation)
+                return false;
+        }
+        for (size_t j = 0; j < aa.m_channels.size(); ++j)
+        {
+            const AnimChannel& ca = aa.m_channels[j];
+            const AnimChannel& cb = ab.m_channels[j];
+            if (IndexOf(aa.m_samplers, ca.m_sampler) != IndexOf(ab.m_samplers, cb.m_sampler) ||
+                IndexOf(a.m_nodes, ca.m_target) != IndexOf(b.m_nodes, cb.m_target) || ca.m_path != cb.m_path)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+bool glTF::Asset::BenchmarkParse(const std::wstring& filepath)
+{
+    ByteArray gltfFile;
+    BufferPtr chunk1Bin;
+    if (!ReadDocument(filepath, gltfFile, chunk1Bin))
+        return false;
+
+    const char* text = (const char*)gltfFile->data();
+    const size_t length = strlen(text);
+    const std::wstring basePath = Utility::GetBasePath(filepath);
+
+    auto Elapsed = [](std::chrono::high_resolution_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    };
+
+    // Processing includes mapping external buffers, though not reading them, and decoding meshopt views, which reads
+    // what they decode from. Tearing the DOM down is part of the total, since freeing nlohmann's many small
+    // allocations is a cost of its own.
+    const uint32_t kNumRuns = 5;
+    double referenceParseMs = DBL_MAX, referenceProcessMs = DBL_MAX, referenceTotalMs = DBL_MAX;
+    double arenaParseMs = DBL_MAX, arenaProcessMs = DBL_MAX, arenaTotalMs = DBL_MAX;
+    size_t arenaBytes = 0;
+    for (uint32_t run = 0; run < kNumRuns; ++run)
+    {
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            {
+                Asset asset;
+                asset.m_basePath = basePath;
+                json root = json::parse(text, text + length);
+                referenceParseMs = std::min(referenceParseMs, Elapsed(start));
+
+                auto processStart = std::chrono::high_resolution_clock::now();
+                asset.ProcessDocument(root, chunk1Bin);
+                referenceProcessMs = std::min(referenceProcessMs, Elapsed(processStart));
+            }
+            referenceTotalMs = std::min(referenceTotalMs, Elapsed(start));
+        }
+
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            {
+                Asset asset;
+                asset.m_basePath = basePath;
+                JsonDocument document;
+                if (!document.Parse(text, length))
+                {
+                    Utility::Printf("glTF parse benchmark: %s\n", document.GetError().c_str());
+                    return false;
+                }
+                arenaParseMs = std::min(arenaParseMs, Elapsed(start));
+                arenaBytes = document.GetMemoryUsage();
+
+                auto processStart = std::chrono::high_resolution_clock::now();
+                asset.ProcessDocument(document.GetRoot(), chunk1Bin);
+                arenaProcessMs = std::min(arenaProcessMs, Elapsed(processStart));
+            }
+            arenaTotalMs = std::min(arenaTotalMs, Elapsed(start));
+        }
+    }
+
+    Asset reference;
+    reference.m_basePath = basePath;
+    reference.ProcessDocument(json::parse(text, text + length), chunk1Bin);
+
+    JsonDocument document;
+    document.Parse(text, length);
+    Asset asset;
+    asset.m_basePath = basePath;
+    asset.ProcessDocument(document.GetRoot(), chunk1Bin);
+
+    const bool same = SameAssets(reference, asset);
+    Utility::Printf("glTF parse benchmark: %zu KB of JSON, %zu nodes, %zu meshes, %zu accessors, %zu materials, best of %u runs\n",
+        length >> 10, asset.m_nodes.size(), asset.m_meshes.size(), asset.m_accessors.size(), asset.m_materials.size(), kNumRuns);
+    Utility::Printf("  nlohmann::json: %9.2f ms parse, %9.2f ms process, %9.2f ms total\n",
+        referenceParseMs, referenceProcessMs, referenceTotalMs);
+    Utility::Printf("  JsonDocument:   %9.2f ms parse, %9.2f ms process, %9.2f ms total, %.2fx, %zu KB arena\n",
+        arenaParseMs, arenaProcessMs, arenaTotalMs, referenceTotalMs / arenaTotalMs, arenaBytes >> 10);
+    Utility::Printf("glTF parse benchmark: %s\n", same ? "both parsers build the same asset" : "FAILED, the assets differ");
+    return same;
+}
@@ -30,6 +30,39 @@ namespace glTF
     using json = nlohmann::json;
     using Utility::ByteArray;
 
+    // The bytes of a buffer. Buffers stored in files, external .bin files and the binary chunk of a .glb, are views of
+    // a read-only mapping of the file: nothing is read while parsing, the pages accessors touch are read in by the
+    // threads that first touch them, and untouched ones (unused meshes, embedded images) never are. Buffers that
+    // EXT_meshopt_compression views decode into are allocated, and a mapped buffer is copied into memory the first
+    // time something decodes into it.
+    class Buffer
+    {
+    public:
+        explicit Buffer( size_t size ) : m_bytes(size), m_data(m_bytes.data()), m_size(size) {}
+        explicit Buffer( std::vector<byte>&& bytes ) : m_bytes(std::move(bytes)), m_data(m_bytes.data()), m_size(m_bytes.size()) {}
+        Buffer( std::shared_ptr<Utility::FileMapping> file, size_t offset, size_t size )
+            : m_file(file), m_data(file->GetData() + offset), m_size(size) {}
+
+        Buffer( const Buffer& ) = delete;
+        Buffer& operator=( const Buffer& ) = delete;
+
+        // Read-only while the buffer is mapped
+        byte* data() const { return m_data; }
+        size_t size() const { return m_size; }
+        bool IsMapped() const { return m_file != nullptr; }
+
+        // The bytes, copied out of the mapping first when mapped.
+        byte* GetWritableData();
+
+    private:
+        std::shared_ptr<Utility::FileMapping> m_file;
+        std::vector<byte> m_bytes;
+        byte* m_data;
+        size_t m_size;
+    };
+
+    typedef std::shared_ptr<Buffer> BufferPtr;
+
     struct BufferView
     {
         uint32_t buffer;
@@ -65,18 +98,35 @@ namespace glTF
 
         //BufferView* bufferView;
         //uint32_t byteOffset; // offset from start of buffer view
-        byte* dataPtr;
+        byte* dataPtr;  // Null when there is no buffer view, in which case every element starts out as zeros
         uint32_t stride;
         uint32_t count; // number of elements
         uint16_t componentType;
         uint16_t type;
+        bool normalized;
+
+        // Sparse accessors replace some of the elements above. They are left as stored here and only expanded by
+        // ReadDenseElements and ReadFloatElements, when a consumer actually needs the values.
+        uint32_t sparseCount;       // Number of sparse elements
+        uint16_t sparseIndexType;   // componentType of the indices (ubyte, ushort or uint)
+        byte* sparseIndices;        // Increasing element indices
+        byte* sparseValues;         // Packed replacement elements
+
+        // Whether dataPtr can be read as it is, without expanding a sparse substitution or a missing buffer view.
+        bool HasInPlaceData() const { return dataPtr != nullptr && sparseCount == 0; }
 
-        // Nobody is doing this in the samples.  Seems dumb.
-        //uint32_t sparseCount;   // Number of sparse elements
-        //uint32_t sparseIndices; // Buffer view for indices into sparse data
-        //uint32_t sparseValues;  // Buffer view for packed array of sparse values
+        uint32_t GetComponentCount() const;
+        uint32_t GetComponentSize() const;
+        uint32_t GetElementSize() const;    // Including the column padding of byte and short matrices
     };
 
+    // Copies the elements of an accessor into a packed array, applying its sparse substitution.
+    void ReadDenseElements( const Accessor& accessor, std::vector<byte>& elements );
+
+    // Converts the elements of an accessor to floats, count * GetComponentCount() of them. Normalized integers map
+    // to [0, 1] or [-1, 1] as the spec defines, other integers keep their values.
+    void ReadFloatElements( const Accessor& accessor, std::vector<float>& elements );
+
     struct Image
     {
         std::string path; // UTF8
@@ -246,6 +296,10 @@ namespace glTF
 
         void Parse(const std::wstring& filepath);
 
+        // Parses the file several times with nlohmann::json and with JsonDocument, prints the best times of the JSON
+        // parse and of filling the asset, and checks that both parsers produce the same asset. Returns whether they do.
+        static bool BenchmarkParse(const std::wstring& filepath);
+
         Scene* m_scene;
         std::wstring m_basePath;
         std::vector<Scene> m_scenes;
@@ -258,26 +312,31 @@ namespace glTF
         std::vector<Accessor> m_accessors;
         std::vector<Skin> m_skins;
         std::vector<Material> m_materials;
-        std::vector<ByteArray> m_buffers;
+        std::vector<BufferPtr> m_buffers;
+        std::vector<std::wstring> m_bufferFiles;   // Where each buffer was read from; empty when it wasn't a file of its own
         std::vector<BufferView> m_bufferViews;
         std::vector<Animation> m_animations;
 
     private:
-        void ProcessBuffers( json& buffers, ByteArray chunk1bin );
-        void ProcessBufferViews( json& bufferViews );
-        void ProcessAccessors( json& accessors );
-        void ProcessMaterials( json& materials );
-        void ProcessTextures( json& textures );
-        void ProcessSamplers( json& samplers );
-        void ProcessImages( json& images );
-        void ProcessSkins( json& skins );
-        void ProcessMeshes( json& meshes, json& accessors );
-        void ProcessNodes( json& nodes );
-        void ProcessAnimations( json& nodes );
-        void ProcessCameras( json& cameras );
-        void ProcessScenes( json& scenes );
-        void FindAttribute( Primitive& prim, json& attributes, Primitive::eAttribType type, const std::string& name);
-        uint32_t ReadTextureInfo( json& info_json, glTF::Texture* &info );
+        // The Process functions walk either a JsonDocument (what Parse uses) or an nlohmann::json DOM (the reference
+        // that BenchmarkParse compares against); both answer the same interface.
+        template <typename Json> void ProcessDocument( const Json& root, BufferPtr chunk1bin );
+        template <typename Json> void ProcessBuffers( const Json& buffers, BufferPtr chunk1bin );
+        template <typename Json> void ProcessBufferViews( const Json& bufferViews );
+        template <typename Json> void DecodeMeshoptView( const BufferView& view, const Json& compression );
+        template <typename Json> void ProcessAccessors( const Json& accessors );
+        template <typename Json> void ProcessMaterials( const Json& materials );
+        template <typename Json> void ProcessTextures( const Json& textures );
+        template <typename Json> void ProcessSamplers( const Json& samplers );
+        template <typename Json> void ProcessImages( const Json& images );
+        template <typename Json> void ProcessSkins( const Json& skins );
+        template <typename Json> void ProcessMeshes( const Json& meshes, const Json& accessors );
+        template <typename Json> void ProcessNodes( const Json& nodes );
+        template <typename Json> void ProcessAnimations( const Json& nodes );
+        template <typename Json> void ProcessCameras( const Json& cameras );
+        template <typename Json> void ProcessScenes( const Json& scenes );
+        template <typename Json> void FindAttribute( Primitive& prim, const Json& attributes, Primitive::eAttribType type, const std::string& name);
+        template <typename Json> uint32_t ReadTextureInfo( const Json& info_json, glTF::Texture* &info );
     };
 
 
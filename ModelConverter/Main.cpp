@@ -14,6 +14,7 @@
 #include "ModelAssimp.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <iostream>
 
 void PrintHelp()
@@ -21,7 +22,7 @@ void PrintHelp()
     printf("model_convert\n");
 
     printf("usage:\n");
-    printf("model_convert input_file output_file\n");
+    printf("model_convert input_file output_file [weld_epsilon]\n");
 }
 
 void AssimpModel::PrintModelStats()
@@ -98,7 +99,7 @@ void AssimpModel::PrintModelStats()
 
 int main(int argc, char **argv)
 {
-    if (argc != 3)
+    if (argc != 3 && argc != 4)
     {
         PrintHelp();
         return -1;
@@ -112,6 +113,13 @@ int main(int argc, char **argv)
 
 	AssimpModel model;
 
+    if (argc == 4)
+    {
+        float weld_epsilon = (float)atof(argv[3]);
+        printf("weld epsilon %g\n", weld_epsilon);
+        model.SetWeldEpsilon(weld_epsilon);
+    }
+
     printf("loading...\n");
     if (!model.Load(input_file))
     {
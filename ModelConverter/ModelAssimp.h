@@ -33,6 +33,10 @@ public:
 
     void PrintModelStats();
 
+    // Vertices whose float attributes round to the same multiples of epsilon are merged while optimizing. Zero, the
+    // default, only merges exact duplicates.
+    void SetWeldEpsilon(float epsilon) { m_WeldEpsilon = epsilon; }
+
 private:
 
 	bool LoadAssimp(const std::string& filename);
@@ -41,5 +45,7 @@ private:
 	void OptimizeRemoveDuplicateVertices(bool depth);
 	void OptimizePostTransform(bool depth);
 	void OptimizePreTransform(bool depth);
+
+    float m_WeldEpsilon = 0.0f;
 };
 
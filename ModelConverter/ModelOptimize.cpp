@@ -13,6 +13,7 @@
 
 #include "ModelAssimp.h"
 #include "IndexOptimizePostTransform.h"
+#include "VertexWeld.h"
 
 #include <string.h>
 
@@ -28,46 +29,29 @@ void AssimpModel::OptimizeRemoveDuplicateVertices(bool depth)
         unsigned char *meshVertexData = depth ? (m_pVertexDataDepth + mesh->vertexDataByteOffsetDepth) : (m_pVertexData + mesh->vertexDataByteOffset);
 
         unsigned char *meshDeduplicatedVertexData = deduplicatedVertexData + deduplicatedVertexDataSize;
-        unsigned int deduplicatedCount = 0;
 
         unsigned int vertexCount = depth ? mesh->vertexCountDepth : mesh->vertexCount;
         uint32_t *vertexRemap = new uint32_t [vertexCount];
-        memset(vertexRemap, (uint32_t)-1, sizeof(uint32_t) * vertexCount);
-        assert(vertexCount <= (uint32_t)-1);
 
-        for (unsigned int v1 = 0; v1 < vertexCount; v1++)
+        VertexWeld::Options weldOptions;
+        weldOptions.epsilon = m_WeldEpsilon;
+        uint32_t attribsEnabled = depth ? mesh->attribsEnabledDepth : mesh->attribsEnabled;
+        const Attrib *attribs = depth ? mesh->attribDepth : mesh->attrib;
+        for (unsigned int attribIndex = 0; attribIndex < maxAttribs; attribIndex++)
         {
-            if (vertexRemap[v1] != (uint32_t)-1)
-                continue; // this was already found to be a duplicate
-
-            const unsigned char *v1Data = meshVertexData + v1 * vertexStride;
-
-            // this is a new unique vertex
-            uint32_t remappedSlot = deduplicatedCount++;
-            vertexRemap[v1] = remappedSlot;
-            memcpy(meshDeduplicatedVertexData + remappedSlot * vertexStride, v1Data, vertexStride);
-
-            // scan for duplicates
-            for (unsigned int v2 = v1 + 1; v2 < vertexCount; v2++)
-            {
-                if (vertexRemap[v2] != (uint32_t)-1)
-                    continue; // this was already found to be a duplicate of another vertex
-
-                const unsigned char *v2Data = meshVertexData + v2 * vertexStride;
-
-                if (0 == memcmp(v1Data, v2Data, vertexStride))
-                {
-                    vertexRemap[v2] = remappedSlot;
-                }
-            }
+            const Attrib &attrib = attribs[attribIndex];
+            if ((attribsEnabled & (1 << attribIndex)) == 0 || attrib.format != attrib_format_float || attrib.offset % 4 != 0)
+                continue;
+            for (unsigned int word = attrib.offset / 4; word < attrib.offset / 4 + attrib.components && word < 64; word++)
+                weldOptions.floatWordMask |= 1ull << word;
         }
 
+        unsigned int deduplicatedCount = VertexWeld::Weld(meshVertexData, vertexCount, vertexStride,
+            meshDeduplicatedVertexData, vertexRemap, weldOptions);
+
         unsigned int indexCount = mesh->indexCount;
         uint16_t *indexArray = (uint16_t*)((depth ? m_pIndexDataDepth : m_pIndexData) + mesh->indexDataByteOffset);
-        for (unsigned int n = 0; n < indexCount; n++)
-        {
-            indexArray[n] = vertexRemap[indexArray[n]];
-        }
+        VertexWeld::RemapIndices(indexArray, indexCount, vertexRemap);
 
         delete [] vertexRemap;
 
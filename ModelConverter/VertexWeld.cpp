@@ -0,0 +1,89 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+
+#include "VertexWeld.h"
+#include "../Core/Hash.h"
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+namespace VertexWeld
+{
+    // The vertex as whole words, with float words quantized when welding with an epsilon. A partial last word is
+    // zero-padded.
+    static void MakeKey(const uint8_t* vertex, uint32_t stride, const Options& options, uint32_t* key)
+    {
+        key[(stride + 3) / 4 - 1] = 0;
+        memcpy(key, vertex, stride);
+
+        if (options.epsilon <= 0.0f)
+            return;
+
+        const float scale = 1.0f / options.epsilon;
+        for (uint32_t word = 0; word < stride / 4 && word < 64; ++word)
+        {
+            if ((options.floatWordMask >> word & 1) == 0)
+                continue;
+
+            float value;
+            memcpy(&value, key + word, sizeof(value));
+
+            // NaNs and values too large to quantize keep their bits.
+            const float cell = floorf(value * scale + 0.5f);
+            if (fabsf(cell) < 2147483648.0f)
+                key[word] = (uint32_t)(int32_t)cell;
+        }
+    }
+
+    uint32_t Weld(const uint8_t* vertices, uint32_t vertexCount, uint32_t stride,
+        uint8_t* dstVertices, uint32_t* remap, const Options& options)
+    {
+        assert(stride > 0);
+        assert(dstVertices + (size_t)vertexCount * stride <= vertices || vertices + (size_t)vertexCount * stride <= dstVertices);
+
+        const uint32_t keyWords = (stride + 3) / 4;
+        const uint32_t kEmpty = 0xFFFFFFFF;
+
+        // At most half full, so probe sequences stay short.
+        size_t tableSize = 16;
+        while (tableSize < (size_t)vertexCount * 2)
+            tableSize *= 2;
+        std::vector<uint32_t> table(tableSize, kEmpty);
+
+        // Keys of the distinct vertices found so far, indexed by their new vertex index
+        std::vector<uint32_t> keys((size_t)vertexCount * keyWords);
+
+        uint32_t uniqueCount = 0;
+        for (uint32_t v = 0; v < vertexCount; ++v)
+        {
+            uint32_t* key = keys.data() + (size_t)uniqueCount * keyWords;
+            MakeKey(vertices + (size_t)v * stride, stride, options, key);
+
+            size_t slot = Utility::HashRange(key, key + keyWords, 2166136261U) & (tableSize - 1);
+            while (table[slot] != kEmpty && memcmp(keys.data() + (size_t)table[slot] * keyWords, key, keyWords * 4) != 0)
+                slot = (slot + 1) & (tableSize - 1);
+
+            if (table[slot] == kEmpty)
+            {
+                // A new distinct vertex. Its key is already in place at the end of keys.
+                table[slot] = uniqueCount;
+                memcpy(dstVertices + (size_t)uniqueCount * stride, vertices + (size_t)v * stride, stride);
+                ++uniqueCount;
+            }
+
+            remap[v] = table[slot];
+        }
+
+        return uniqueCount;
+    }
+}
@@ -0,0 +1,44 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Merges duplicate vertices in linear time by hashing each vertex's bytes into an open-addressed table.
+namespace VertexWeld
+{
+    struct Options
+    {
+        // Zero merges bit-identical vertices only. Otherwise the float words selected by floatWordMask are snapped to
+        // the nearest multiple of epsilon before vertices are compared, so near-duplicates merge too. Two values
+        // closer than epsilon can still land on either side of a rounding boundary and stay apart.
+        float epsilon = 0.0f;
+
+        // Bit i is set when the 32-bit word at byte offset 4 * i of a vertex holds a float.
+        uint64_t floatWordMask = 0;
+    };
+
+    // Copies the first instance of every distinct vertex to dstVertices, in order of first appearance, and sets
+    // remap[i] to the new index of vertex i. Returns the number of distinct vertices. dstVertices must hold
+    // vertexCount * stride bytes and must not overlap vertices.
+    uint32_t Weld(const uint8_t* vertices, uint32_t vertexCount, uint32_t stride,
+        uint8_t* dstVertices, uint32_t* remap, const Options& options = Options());
+
+    // Points an index list of any width at the welded vertices.
+    template <typename IndexType>
+    void RemapIndices(IndexType* indices, size_t indexCount, const uint32_t* remap)
+    {
+        for (size_t i = 0; i < indexCount; ++i)
+            indices[i] = (IndexType)remap[indices[i]];
+    }
+}
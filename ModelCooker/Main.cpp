@@ -0,0 +1,191 @@
+// Builds the .mini files of every glTF model under a directory, and converts their textures, without creating a
+// graphics device, so that content can be cooked ahead of time on a build machine. Models are cooked in parallel and
+// each one only has the stages whose inputs changed rebuilt, exactly as ModelViewer would when loading it. Exits with
+// 1 if any model or texture failed.
+
+#include "ModelLoader.h"
+#include "ModelBuildGraph.h"
+#include "TextureConvert.h"
+#include "ParallelFor.h"
+#include "Utility.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Renderer;
+
+static void PrintHelp()
+{
+    printf("ModelCooker\n");
+    printf("usage:\n");
+    printf("ModelCooker directory [-jobs N] [-force] [-quantize] [-compress] [-bc] [-texture_cache directory]\n");
+    printf("  -jobs N         models cooked at once (default: one per hardware thread, at most 4)\n");
+    printf("  -force          rebuild every .mini whole\n");
+    printf("  -quantize       store vertex positions as UNORM16\n");
+    printf("  -compress       store geometry and keyframes compressed\n");
+    printf("  -bc             block compress textures\n");
+    printf("  -texture_cache  where converted textures are cached (default: TextureCache)\n");
+}
+
+// Appends every .gltf and .glb file under directory, recursively, in a stable order.
+static void FindModels(const std::filesystem::path& directory, std::vector<std::filesystem::path>& models)
+{
+    std::error_code error;
+    for (std::filesystem::recursive_directory_iterator it(directory, error), end; !error && it != end; it.increment(error))
+    {
+        const std::wstring ext = Utility::ToLower(it->path().extension().wstring());
+        std::error_code statError;
+        if ((ext == L".gltf" || ext == L".glb") && it->is_regular_file(statError))
+            models.push_back(it->path());
+    }
+    std::sort(models.begin(), models.end());
+}
+
+static double MillisecondsSince(std::chrono::high_resolution_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+    using namespace ModelBuildGraph;
+
+    if (argc < 2)
+    {
+        PrintHelp();
+        return -1;
+    }
+
+    const std::filesystem::path directory = argv[1];
+    const uint32_t hardwareThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    uint32_t numJobs = std::min(hardwareThreads, 4u);
+    bool forceRebuild = false;
+    BuildOptions options;
+
+    for (int i = 2; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        if (arg == "-jobs" && i + 1 < argc)
+            numJobs = std::max((uint32_t)std::strtoul(argv[++i], nullptr, 10), 1u);
+        else if (arg == "-force")
+            forceRebuild = true;
+        else if (arg == "-quantize")
+            options.quantizePositions = true;
+        else if (arg == "-compress")
+            options.compressFile = true;
+        else if (arg == "-bc")
+            options.compressTextures = true;
+        else if (arg == "-texture_cache" && i + 1 < argc)
+            SetTextureCacheDirectory(std::filesystem::path(argv[++i]).wstring());
+        else
+        {
+            PrintHelp();
+            return -1;
+        }
+    }
+
+    std::vector<std::filesystem::path> models;
+    FindModels(directory, models);
+    if (models.empty())
+    {
+        printf("No glTF models found in %s\n", directory.u8string().c_str());
+        return -1;
+    }
+
+    // Each model builds its meshes on several threads, so the hardware threads are split between the models being
+    // cooked at once rather than every one of them asking for all of them.
+    numJobs = std::min(numJobs, (uint32_t)models.size());
+    const uint32_t threadsPerJob = std::max(hardwareThreads / numJobs, 1u);
+
+    printf("Cooking %zu models, %u at a time on %u threads each\n", models.size(), numJobs, threadsPerJob);
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    std::vector<CookStats> stats(models.size());
+    std::vector<uint8_t> succeeded(models.size());
+    std::vector<std::vector<TextureCompileJob>> textureJobs(models.size());
+    ParallelFor(models.size(), numJobs, [&](size_t modelIdx)
+    {
+        succeeded[modelIdx] = CookModel(models[modelIdx].wstring(), options, forceRebuild, threadsPerJob, stats[modelIdx],
+            textureJobs[modelIdx]);
+    });
+
+    const double modelMs = MillisecondsSince(start);
+
+    // Models often share textures, and two conversions of the same one would race for its output, so the textures
+    // of all models are converted together, each once.
+    std::vector<TextureCompileJob> allTextureJobs;
+    std::set<std::pair<std::wstring, uint32_t>> seenTextures;
+    for (const std::vector<TextureCompileJob>& jobs : textureJobs)
+    {
+        for (const TextureCompileJob& job : jobs)
+        {
+            if (seenTextures.insert(std::make_pair(Utility::ToLower(job.originalFile), job.flags)).second)
+                allTextureJobs.push_back(job);
+        }
+    }
+
+    auto textureStart = std::chrono::high_resolution_clock::now();
+    const uint32_t numTexturesFailed = CompileTexturesOnDemand(allTextureJobs);
+    const double textureMs = MillisecondsSince(textureStart);
+
+    printf("\n%-40s %9s %9s", "model", "parse", "keys");
+    for (uint32_t stage = 0; stage < kNumStages; ++stage)
+        printf(" %10s", GetStageName(stage));
+    printf(" %9s %9s\n", "save", "total");
+
+    uint32_t numFailed = 0, numUpToDate = 0;
+    CookStats totals;
+    for (size_t modelIdx = 0; modelIdx < models.size(); ++modelIdx)
+    {
+        const CookStats& s = stats[modelIdx];
+        printf("%-40s", models[modelIdx].filename().u8string().c_str());
+
+        if (!succeeded[modelIdx])
+        {
+            printf(" FAILED\n");
+            ++numFailed;
+            continue;
+        }
+        if (s.upToDate)
+        {
+            printf(" up to date\n");
+            ++numUpToDate;
+            continue;
+        }
+
+        printf(" %9.1f %9.1f", s.parseMs, s.keyMs);
+        for (uint32_t stage = 0; stage < kNumStages; ++stage)
+        {
+            if (s.rebuiltStages & (1u << stage))
+                printf(" %10.1f", s.stageMs[stage]);
+            else
+                printf(" %10s", "-");
+            totals.stageMs[stage] += s.stageMs[stage];
+        }
+        printf(" %9.1f %9.1f\n", s.saveMs, s.totalMs);
+
+        totals.parseMs += s.parseMs;
+        totals.keyMs += s.keyMs;
+        totals.saveMs += s.saveMs;
+        totals.totalMs += s.totalMs;
+    }
+
+    printf("%-40s %9.1f %9.1f", "sum", totals.parseMs, totals.keyMs);
+    for (uint32_t stage = 0; stage < kNumStages; ++stage)
+        printf(" %10.1f", totals.stageMs[stage]);
+    printf(" %9.1f %9.1f\n", totals.saveMs, totals.totalMs);
+
+    printf("\n%zu models (%u up to date, %u failed) in %.0f ms, %zu textures (%u failed) in %.0f ms, %.0f ms in all\n",
+        models.size(), numUpToDate, numFailed, modelMs, allTextureJobs.size(), numTexturesFailed, textureMs,
+        MillisecondsSince(start));
+
+    return numFailed == 0 && numTexturesFailed == 0 ? 0 : 1;
+}
@@ -29,6 +29,7 @@
 #include "GameInput.h"
 #include "SponzaRenderer.h"
 #include "glTF.h"
+#include "TextureConvert.h"
 #include "Renderer.h"
 #include "Model.h"
 #include "ModelLoader.h"
@@ -38,6 +39,8 @@
 #include "imgui_impl_win32.h"
 #include "imgui_impl_dx12.h"
 #include "SDFGI.h"
+#include "SDFHierarchy.h"
+#include "SDFPacketTracer.h"
 #include "Settings.h"
 
 #define RENDER_DIRECT_ONLY 0
@@ -109,6 +112,9 @@ private:
     bool showIrradianceAtlas = false;
     bool showVisibilityAtlas = false;
     bool runSDFOnce = true;
+    // The sun as of the last probe invalidation.
+    Float3 lastSunDirection = Float3(0.0f, 0.0f, 0.0f);
+    float lastSunIntensity = -1.0f;
 };
 
 CREATE_APPLICATION( ModelViewer )
@@ -214,6 +220,54 @@ void ModelViewer::Startup( void )
     if (CommandLineArgs::GetInteger(L"rebuild", rebuildValue))
         forceRebuild = rebuildValue != 0;
 
+    uint32_t sdfBenchmarkResolution;
+    if (CommandLineArgs::GetInteger(L"sdf_benchmark", sdfBenchmarkResolution))
+    {
+        SDFHierarchy::Volume sdfBenchmarkVolume = SDFHierarchy::CreateTestVolume(sdfBenchmarkResolution);
+        SDFHierarchy::Benchmark(sdfBenchmarkVolume, 100000);
+        SDFPacketTracer::Benchmark(sdfBenchmarkVolume, 1000000);
+    }
+
+    uint32_t compressModels;
+    if (CommandLineArgs::GetInteger(L"compress_models", compressModels))
+        Renderer::CompressModelFiles = compressModels != 0;
+
+    uint32_t quantizeModels;
+    if (CommandLineArgs::GetInteger(L"quantize_models", quantizeModels))
+        Renderer::QuantizeModelVertices = quantizeModels != 0;
+
+    uint32_t compressTextures;
+    if (CommandLineArgs::GetInteger(L"compress_textures", compressTextures))
+        Renderer::CompressTextures = compressTextures != 0;
+
+    std::wstring textureCacheDirectory;
+    if (CommandLineArgs::GetString(L"texture_cache", textureCacheDirectory))
+        SetTextureCacheDirectory(textureCacheDirectory);
+
+    uint32_t textureStreamingBudget;
+    if (CommandLineArgs::GetInteger(L"texture_streaming_budget", textureStreamingBudget) && textureStreamingBudget != 0)
+        TextureManager::EnableStreaming((uint64_t)textureStreamingBudget << 20);
+
+    uint32_t textureCacheBenchmarkThreads;
+    if (CommandLineArgs::GetInteger(L"texture_cache_benchmark", textureCacheBenchmarkThreads) && textureCacheBenchmarkThreads != 0)
+        TextureManager::BenchmarkCache(textureCacheBenchmarkThreads);
+
+    std::wstring compressionBenchmarkFile;
+    if (CommandLineArgs::GetString(L"mini_compression_benchmark", compressionBenchmarkFile))
+        Renderer::BenchmarkModelCompression(compressionBenchmarkFile);
+
+    std::wstring parseBenchmarkFile;
+    if (CommandLineArgs::GetString(L"gltf_parse_benchmark", parseBenchmarkFile))
+        glTF::Asset::BenchmarkParse(parseBenchmarkFile);
+
+    std::wstring meshBuildBenchmarkFile;
+    if (CommandLineArgs::GetString(L"mesh_build_benchmark", meshBuildBenchmarkFile))
+        Renderer::BenchmarkBuildModel(glTF::Asset(meshBuildBenchmarkFile));
+
+    std::wstring quantizationReportFile;
+    if (CommandLineArgs::GetString(L"vertex_quantization_report", quantizationReportFile))
+        Renderer::ReportVertexQuantization(glTF::Asset(quantizationReportFile));
+
     if (CommandLineArgs::GetString(L"model", gltfFileName) == false)
     {
 #ifdef LEGACY_RENDERER
@@ -365,6 +419,8 @@ void ModelViewer::Update( float deltaT )
 {
     ScopedTimer _prof(L"Update State");
 
+    TextureManager::UpdateStreaming();
+
     if (GameInput::IsFirstPressed(GameInput::kLShoulder))
         DebugZoom.Decrement();
     else if (GameInput::IsFirstPressed(GameInput::kRShoulder))
@@ -386,6 +442,21 @@ void ModelViewer::Update( float deltaT )
 
     gfxContext.Finish();
 
+    // Every probe sees the sun, so changing it makes all of them stale; each animated mesh only makes the probes
+    // around where it was and where it is stale. Either way they are brought into the next probe update instead of
+    // waiting for the sweep.
+    const Float3 sunDirection = SunDirection.Value();
+    const float sunIntensity = g_SunLightIntensity;
+    if (sunDirection.x != lastSunDirection.x || sunDirection.y != lastSunDirection.y ||
+        sunDirection.z != lastSunDirection.z || sunIntensity != lastSunIntensity)
+    {
+        mp_SDFGIManager->InvalidateAllProbes();
+        lastSunDirection = sunDirection;
+        lastSunIntensity = sunIntensity;
+    }
+    for (const Math::AxisAlignedBox& bounds : m_ModelInst.GetAnimatedBounds())
+        mp_SDFGIManager->InvalidateProbes(bounds);
+
     // We use viewport offsets to jitter sample positions from frame to frame (for TAA.)
     // D3D has a design quirk with fractional offsets such that the implicit scissor
     // region of a viewport is floor(TopLeftXY) and floor(TopLeftXY + WidthHeight), so
@@ -463,6 +534,7 @@ void ModelViewer::NonLegacyRenderShadowMap(GraphicsContext& gfxContext, const Ma
 
     MeshSorter shadowSorter(MeshSorter::kShadows);
     shadowSorter.SetCamera(m_SunShadowCamera);
+    shadowSorter.SetClusterCulling(MeshSorter::kCullClusters);
     shadowSorter.SetDepthStencilTarget(g_ShadowBuffer);
 
     m_ModelInst.Render(shadowSorter);
@@ -605,6 +677,7 @@ void ModelViewer::NonLegacyRenderScene(GraphicsContext& gfxContext, const Math::
 
     MeshSorter mainSorter(MeshSorter::kDefault);
     mainSorter.SetCamera(cam);
+    mainSorter.SetClusterCulling(MeshSorter::kCullClustersAndBackfaces);
     mainSorter.SetViewport(viewport);
     mainSorter.SetScissor(scissor);
     mainSorter.SetDepthStencilTarget(g_SceneDepthBuffer);
@@ -738,6 +811,12 @@ void ModelViewer::RenderUI( class GraphicsContext& gfxContext ) {
     ImGui::SliderFloat("GI Intensity", &giIntensity, 0.0f, 1.0f, "%.2f");
     mp_SDFGIManager->giIntensity = pow(giIntensity, 2.0f);
     ImGui::SliderFloat("Hysteresis", &mp_SDFGIManager->hysteresis, 0.0f, 1.0f);
+    // Respacing the grid reprojects the converged probes instead of starting over; applied once the slider is released.
+    static float probeSpacing = mp_SDFGIManager->probeGrid.probeSpacing[0];
+    ImGui::SliderFloat("Probe Spacing", &probeSpacing, 50.0f, 400.0f, "%.0f");
+    if (ImGui::IsItemDeactivatedAfterEdit())
+        mp_SDFGIManager->RequestRelocation(mp_SDFGIManager->probeGrid.sceneBounds, probeSpacing);
+    ImGui::SliderInt("Probe Update Period", &mp_SDFGIManager->probeUpdatePeriod, 1, 16);
     ImGui::Checkbox("Show Voxelized SDF Scene", &rayMarchDebug);
     static const char* shadingOptions[]{"Show DI + GI","Show DI Only","Show GI Only"};
     static int shadingMode = 0;
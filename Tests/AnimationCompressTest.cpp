@@ -0,0 +1,390 @@
+#include "Check.h"
+#include "../Model/AnimationCompress.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+
+using namespace AnimationCompress;
+using namespace Tests;
+
+namespace
+{
+    // A smoothly moving source curve of the given kind, sampled at evenly spaced keys unless jittered.
+    struct TestCurve
+    {
+        const char* name;
+        uint32_t targetPath;
+        uint32_t interpolation;
+        std::vector<float> times;
+        std::vector<float> values;
+
+        SourceCurve Source() const
+        {
+            return { targetPath, interpolation, times.data(), values.data(), (uint32_t)times.size() };
+        }
+    };
+
+    // A linear curve over the time range [0, segments] with its keys at keyFrameOffset 0.
+    AnimationCurve CreateCurve(uint32_t targetPath, uint32_t format, uint32_t segments)
+    {
+        AnimationCurve curve = {};
+        curve.targetPath = targetPath;
+        curve.interpolation = AnimationCurve::kLinear;
+        curve.keyFrameFormat = format;
+        curve.keyFrameStride = GetComponentCount(targetPath);
+        curve.numSegments = (float)segments;
+        curve.startTime = 0.0f;
+        curve.rangeScale = 1.0f;
+        return curve;
+    }
+
+    // motion scales how far the value swings, 0 holding it constant.
+    void GenerateValue(uint32_t targetPath, const float* phase, float motion, float time, float* value)
+    {
+        if (targetPath == AnimationCurve::kRotation)
+        {
+            // About an axis that wanders, by an angle that swings
+            const float angle = 0.3f * phase[3] + 1.5f * motion * std::sin(time * 2.1f + phase[0]);
+            float axis[3] = { std::sin(time * 0.7f + phase[1]), std::cos(time * 0.9f + phase[2]), 0.6f };
+            const float length = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+            for (int c = 0; c < 3; ++c)
+                value[c] = axis[c] / length * std::sin(angle * 0.5f);
+            value[3] = std::cos(angle * 0.5f);
+        }
+        else
+        {
+            const float offset = targetPath == AnimationCurve::kScale ? 1.0f : phase[3] * 4.0f;
+            const float amplitude = (targetPath == AnimationCurve::kScale ? 0.2f : 0.5f) * motion;
+            for (int c = 0; c < 3; ++c)
+                value[c] = offset + amplitude * std::sin(time * (1.3f + c * 0.4f) + phase[c]);
+        }
+    }
+
+    TestCurve GenerateCurve(const char* name, uint32_t targetPath, uint32_t interpolation, uint32_t keyCount,
+        float duration, bool jitter, float motion, std::mt19937& rng)
+    {
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        const float phase[4] = { unit(rng) * 6.28f, unit(rng) * 6.28f, unit(rng) * 6.28f, unit(rng) - 0.5f };
+
+        TestCurve curve;
+        curve.name = name;
+        curve.targetPath = targetPath;
+        curve.interpolation = interpolation;
+        const uint32_t n = GetComponentCount(targetPath);
+
+        for (uint32_t k = 0; k < keyCount; ++k)
+        {
+            float time = duration * k / (keyCount - 1);
+            if (jitter && k > 0 && k + 1 < keyCount)
+                time += (unit(rng) - 0.5f) * 0.8f * duration / (keyCount - 1);
+            curve.times.push_back(time);
+
+            float value[4];
+            GenerateValue(targetPath, phase, motion, time, value);
+            if (interpolation != AnimationCurve::kCubicSpline)
+            {
+                curve.values.insert(curve.values.end(), value, value + n);
+                continue;
+            }
+
+            // Tangents by central differences of the generating function
+            const float h = 0.001f;
+            float before[4], after[4], tangent[4];
+            GenerateValue(targetPath, phase, motion, time - h, before);
+            GenerateValue(targetPath, phase, motion, time + h, after);
+            for (uint32_t c = 0; c < n; ++c)
+                tangent[c] = (after[c] - before[c]) / (2.0f * h);
+            curve.values.insert(curve.values.end(), tangent, tangent + n);
+            curve.values.insert(curve.values.end(), value, value + n);
+            curve.values.insert(curve.values.end(), tangent, tangent + n);
+        }
+        return curve;
+    }
+
+    // What the keys took as the builder used to store them: the glTF values as floats, without the time stamps.
+    size_t GetSourceSize(const SourceCurve& source)
+    {
+        return source.keyCount * GetComponentCount(source.targetPath) * 4 * (source.interpolation == AnimationCurve::kCubicSpline ? 3 : 1);
+    }
+
+    // A skeleton's worth of curves keyed at 30 frames per second, the way exporters bake every channel of every
+    // joint: rotations swinging anywhere from barely to wildly, translations only moving for the root and every
+    // eighth joint, and scales constant.
+    std::vector<TestCurve> GenerateSkeleton(uint32_t numJoints, float duration, std::mt19937& rng)
+    {
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        const uint32_t keyCount = (uint32_t)(duration * 30.0f) + 1;
+        std::vector<TestCurve> curves;
+        for (uint32_t joint = 0; joint < numJoints; ++joint)
+        {
+            const float swing = unit(rng);
+            curves.push_back(GenerateCurve("rotation", AnimationCurve::kRotation, AnimationCurve::kLinear, keyCount, duration, false, swing * swing, rng));
+            curves.push_back(GenerateCurve("translation", AnimationCurve::kTranslation, AnimationCurve::kLinear, keyCount, duration, false, joint % 8 == 0 ? 1.0f : 0.0f, rng));
+            curves.push_back(GenerateCurve("scale", AnimationCurve::kScale, AnimationCurve::kLinear, keyCount, duration, false, 0.0f, rng));
+        }
+        return curves;
+    }
+
+    double MillisecondsSince(std::chrono::high_resolution_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    // Compresses a generated skeleton's worth of curves and prints the sizes, the errors and how long sampling every
+    // curve takes from floats and from the compressed keys.
+    bool Benchmark(void)
+    {
+        const uint32_t kJoints = 64;
+        const float kDuration = 8.0f;
+        const uint32_t kFrames = 1000;
+
+        std::mt19937 rng(7);
+        const std::vector<TestCurve> skeleton = GenerateSkeleton(kJoints, kDuration, rng);
+
+        // The source keys as the builder used to store them, floats at the source's own spacing
+        std::vector<AnimationCurve> floatCurves, compressedCurves;
+        std::vector<uint8_t> floatKeys, compressedKeys;
+        size_t sourceBytes = 0;
+        float maxRotationError = 0.0f, maxVectorError = 0.0f;
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for (const TestCurve& test : skeleton)
+        {
+            const SourceCurve source = test.Source();
+            sourceBytes += GetSourceSize(source);
+
+            CompressedCurve compressed;
+            Compress(source, compressed);
+            compressed.curve.keyFrameOffset = (uint32_t)compressedKeys.size();
+            compressedKeys.insert(compressedKeys.end(), compressed.keyFrames.begin(), compressed.keyFrames.end());
+            compressedKeys.resize((compressedKeys.size() + 3) & ~3);
+            compressedCurves.push_back(compressed.curve);
+
+            float& maxError = test.targetPath == AnimationCurve::kRotation ? maxRotationError : maxVectorError;
+            maxError = std::max(maxError, compressed.maxError);
+
+            AnimationCurve curve = compressed.curve;
+            curve.keyFrameOffset = (uint32_t)floatKeys.size();
+            curve.keyFrameFormat = AnimationCurve::kFloat;
+            curve.numSegments = (float)(source.keyCount - 1);
+            curve.rangeScale = curve.numSegments / (compressed.endTime - curve.startTime);
+            const uint8_t* values = (const uint8_t*)test.values.data();
+            floatKeys.insert(floatKeys.end(), values, values + test.values.size() * 4);
+            floatCurves.push_back(curve);
+        }
+        const double compressMs = MillisecondsSince(start);
+
+        auto Sample = [&](const std::vector<AnimationCurve>& curves, const std::vector<uint8_t>& keys)
+        {
+            float total = 0.0f;
+            auto frameStart = std::chrono::high_resolution_clock::now();
+            for (uint32_t frame = 0; frame < kFrames; ++frame)
+            {
+                const float time = kDuration * frame / kFrames;
+                for (const AnimationCurve& curve : curves)
+                {
+                    float value[4];
+                    SampleCurve(curve, keys.data(), time, value);
+                    total += value[0];
+                }
+            }
+            const double ms = MillisecondsSince(frameStart);
+            // Keeps the sampling from being optimized away
+            return total == 12345.0f ? ms + 1.0 : ms;
+        };
+
+        const double floatMs = Sample(floatCurves, floatKeys);
+        const double compressedMs = Sample(compressedCurves, compressedKeys);
+
+        std::printf("AnimationCompress benchmark: %u curves of %.0f seconds keyed at 30 Hz\n", (uint32_t)skeleton.size(), kDuration);
+        std::printf("  keys %zu bytes, compressed %zu bytes (%.2fx) in %.2f ms\n", sourceBytes, compressedKeys.size(),
+            (double)sourceBytes / compressedKeys.size(), compressMs);
+        std::printf("  max error %.5f rad rotation, %.6f translation or scale\n", maxRotationError, maxVectorError);
+        std::printf("  sampling every curve %u times: %.2f ms from floats, %.2f ms compressed\n", kFrames, floatMs, compressedMs);
+        return true;
+    }
+
+    // Checks the decoders against known values and nlerp against its bound, both through SampleCurve, that generated
+    // curves of every kind stay within their tolerance of the source, also between the times the compressor checked,
+    // and that a skeleton baked the way exporters bake them shrinks at least fourfold.
+    bool Run(void)
+    {
+        Check check("AnimationCompress");
+
+        // Smallest three round trips every largest component, of either sign.
+        {
+            const float rotations[6][4] = {
+                { 0.0f, 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, 0.0f, -1.0f }, { 0.9f, 0.3f, -0.2f, 0.1f },
+                { -0.1f, -0.8f, 0.5f, 0.2f }, { 0.3f, 0.2f, -0.85f, -0.4f }, { 0.5f, -0.5f, 0.5f, -0.5f } };
+            for (const float* rotation : rotations)
+            {
+                float q[4] = { rotation[0], rotation[1], rotation[2], rotation[3] };
+                Normalize(q);
+                uint8_t key[6];
+                EncodeSmallestThree48(q, key);
+                float decoded[4];
+                SampleCurve(CreateCurve(AnimationCurve::kRotation, AnimationCurve::kSmallestThree48, 0), key, 0.0f, decoded);
+                const float error = GetError(AnimationCurve::kRotation, q, decoded);
+                if (!(error < 2e-4f))
+                    check.Fail("Smallest three decodes (%.3f, %.3f, %.3f, %.3f) %.6f rad off\n", q[0], q[1], q[2], q[3], error);
+            }
+        }
+
+        // Range keys decode to within half a step.
+        {
+            const std::vector<float> keys = { -2.0f, 0.0f, 5.0f, 3.0f, 0.0f, 5.0f, 0.5f, 0.0f, 5.0f };
+            std::vector<uint8_t> encoded;
+            Encode(AnimationCurve::kTranslation, AnimationCurve::kRangeUNorm16, keys, encoded);
+            const AnimationCurve curve = CreateCurve(AnimationCurve::kTranslation, AnimationCurve::kRangeUNorm16, 2);
+            for (size_t k = 0; k < 3; ++k)
+            {
+                float decoded[4];
+                SampleCurve(curve, encoded.data(), (float)k, decoded);
+                if (std::abs(decoded[0] - keys[k * 3]) > 5.0f / 131070.0f + 1e-6f || decoded[1] != 0.0f || decoded[2] != 5.0f)
+                    check.Fail("Range key %zu decodes to (%.6f, %.6f, %.6f)\n", k, decoded[0], decoded[1], decoded[2]);
+            }
+        }
+
+        // Nlerp stays within the bound Animation.h gives of the slerp between two keys, and within kNlerpTolerance of
+        // it for keys kMaxKeyAngle apart.
+        {
+            const float angles[3] = { 0.1f, kMaxKeyAngle, 1.5f };
+            for (float angle : angles)
+            {
+                const float axis[3] = { 0.48f, -0.6f, 0.64f };
+                float keys[8] = { 0.0f, 0.0f, 0.0f, 1.0f };
+                for (int c = 0; c < 3; ++c)
+                    keys[4 + c] = axis[c] * std::sin(angle * 0.5f);
+                keys[7] = std::cos(angle * 0.5f);
+                const AnimationCurve curve = CreateCurve(AnimationCurve::kRotation, AnimationCurve::kFloat, 1);
+
+                float maxError = 0.0f;
+                for (int sample = 0; sample <= 64; ++sample)
+                {
+                    const float t = sample / 64.0f;
+                    float slerp[4], value[4];
+                    for (int c = 0; c < 3; ++c)
+                        slerp[c] = axis[c] * std::sin(angle * t * 0.5f);
+                    slerp[3] = std::cos(angle * t * 0.5f);
+                    SampleCurve(curve, (const uint8_t*)keys, t, value);
+                    maxError = std::max(maxError, GetError(AnimationCurve::kRotation, slerp, value));
+                }
+                // GetError's float rounding is far below the bound at these angles.
+                const float bound = angle * angle * angle / 240.0f + 2e-5f;
+                if (maxError > bound || (angle == kMaxKeyAngle && maxError > kNlerpTolerance))
+                    check.Fail("Nlerp strays %.7f rad from slerp between keys %.2f rad apart, bound %.7f\n", maxError, angle, bound);
+            }
+        }
+
+        // A constant curve keeps one key and a straight line two.
+        {
+            const float times[3] = { 0.0f, 0.5f, 1.0f };
+            const float constant[12] = { 0, 0, 0.6f, 0.8f, 0, 0, 0.6f, 0.8f, 0, 0, 0.6f, 0.8f };
+            CompressedCurve result;
+            if (!Compress({ AnimationCurve::kRotation, AnimationCurve::kLinear, times, constant, 3 }, result) ||
+                result.curve.numSegments != 0.0f || result.keyFrames.size() != 6 || result.maxError > result.tolerance)
+                check.Fail("A constant rotation keeps %.0f segments in %zu bytes\n", result.curve.numSegments, result.keyFrames.size());
+
+            const float line[9] = { 0, 0, 0, 1, 2, 3, 2, 4, 6 };
+            if (!Compress({ AnimationCurve::kTranslation, AnimationCurve::kLinear, times, line, 3 }, result) ||
+                result.curve.numSegments != 1.0f || result.curve.keyFrameFormat != AnimationCurve::kRangeUNorm16)
+                check.Fail("A straight translation keeps %.0f segments in format %u\n", result.curve.numSegments, (uint32_t)result.curve.keyFrameFormat);
+
+            const float single[3] = { 1, 2, 3 };
+            if (!Compress({ AnimationCurve::kScale, AnimationCurve::kLinear, times, single, 1 }, result) || result.curve.numSegments != 0.0f)
+                check.Fail("A single scale key keeps %.0f segments\n", result.curve.numSegments);
+
+            if (Compress({ AnimationCurve::kWeights, AnimationCurve::kLinear, times, single, 1 }, result))
+                check.Fail("Weights are compressed\n");
+        }
+
+        // Every kind of evenly keyed curve stays within its tolerance of the source, also at times the compressor
+        // didn't check, with some room for the error between the times it did. Unevenly keyed ones may not, when
+        // their keys are closer than kMaxSampleRate, but then they keep the most keys as floats and maxError says how
+        // far off they are.
+        {
+            std::mt19937 rng(11);
+            std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+            const uint32_t paths[3] = { AnimationCurve::kTranslation, AnimationCurve::kRotation, AnimationCurve::kScale };
+            const char* pathNames[3] = { "translation", "rotation", "scale" };
+            const uint32_t interpolations[4] = { AnimationCurve::kLinear, AnimationCurve::kStep, AnimationCurve::kCatmullRomSpline, AnimationCurve::kCubicSpline };
+            const char* interpolationNames[4] = { "linear", "step", "Catmull-Rom", "cubic" };
+
+            for (uint32_t p = 0; p < 3; ++p)
+            {
+                for (uint32_t i = 0; i < 4; ++i)
+                {
+                    for (int jitter = 0; jitter < 2; ++jitter)
+                    {
+                        // Stepped curves can only be followed where their keys fall on the resampled ones
+                        if (jitter && interpolations[i] == AnimationCurve::kStep)
+                            continue;
+
+                        const TestCurve test = GenerateCurve(pathNames[p], paths[p], interpolations[i], 61, 2.0f, jitter != 0, 1.0f, rng);
+                        const char* jittered = jitter ? " jittered" : "";
+                        const SourceCurve source = test.Source();
+                        CompressedCurve result;
+                        if (!Compress(source, result))
+                        {
+                            check.Fail("%s %s%s: not compressed\n", interpolationNames[i], test.name, jittered);
+                            continue;
+                        }
+
+                        if (result.maxError > result.tolerance && (!jitter || result.curve.keyFrameFormat != AnimationCurve::kFloat ||
+                            result.curve.numSegments < 2.0f * kMaxSampleRate))
+                        {
+                            check.Fail("%s %s%s: %.6f off at the times checked with %.0f segments, tolerance %.6f\n", interpolationNames[i],
+                                test.name, jittered, result.maxError, result.curve.numSegments, result.tolerance);
+                        }
+                        if ((result.curve.interpolation == AnimationCurve::kStep) != (interpolations[i] == AnimationCurve::kStep))
+                            check.Fail("%s %s%s: plays back with interpolation %u\n", interpolationNames[i], test.name, jittered, (uint32_t)result.curve.interpolation);
+
+                        float maxError = 0.0f;
+                        for (int sample = 0; sample < 500; ++sample)
+                        {
+                            // Stepped curves are sampled between their keys
+                            float time = unit(rng) * 2.0f;
+                            if (interpolations[i] == AnimationCurve::kStep)
+                                time = (std::floor(time * 30.0f) + 0.2f + unit(rng) * 0.6f) / 30.0f;
+                            float expected[4], value[4];
+                            EvaluateSource(source, time, expected);
+                            SampleCurve(result.curve, result.keyFrames.data(), time, value);
+                            maxError = std::max(maxError, GetError(paths[p], expected, value));
+                        }
+                        if (maxError > std::max(result.tolerance, result.maxError) * 2.0f)
+                        {
+                            check.Fail("%s %s%s: %.6f off between the times checked, %.6f at them, tolerance %.6f\n", interpolationNames[i],
+                                test.name, jittered, maxError, result.maxError, result.tolerance);
+                        }
+                    }
+                }
+            }
+        }
+
+        // A skeleton baked the way exporters do shrinks at least fourfold.
+        {
+            std::mt19937 rng(7);
+            size_t sourceBytes = 0, compressedBytes = 0;
+            for (const TestCurve& test : GenerateSkeleton(16, 4.0f, rng))
+            {
+                CompressedCurve result;
+                Compress(test.Source(), result);
+                sourceBytes += GetSourceSize(test.Source());
+                compressedBytes += result.keyFrames.size();
+                if (result.maxError > result.tolerance)
+                    check.Fail("A baked %s is %.6f off, tolerance %.6f\n", test.name, result.maxError, result.tolerance);
+            }
+
+            if (compressedBytes * 4 > sourceBytes)
+                check.Fail("Baked keys only shrink from %zu to %zu bytes\n", sourceBytes, compressedBytes);
+        }
+
+        return check.Finish();
+    }
+
+    Registration s_Registration("AnimationCompress", Run);
+    Registration s_Benchmark("AnimationCompressBenchmark", Benchmark, kBenchmark);
+}
@@ -0,0 +1,137 @@
+#include "Check.h"
+#include "../Model/BlockCompress.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace BlockCompress;
+using namespace Tests;
+
+namespace
+{
+    // Compresses generated gradients, noise and flat blocks in every format and checks the decoded images against
+    // per-format error bounds, that flat blocks are exact and that BC7 keeps its anchor index rule. Prints the errors.
+    bool Run(void)
+    {
+        Check check("BlockCompress");
+
+        const Format kFormats[] = { kBC1, kBC3, kBC5, kBC7 };
+        const char* kFormatNames[] = { "BC1", "BC3", "BC5", "BC7" };
+        const int kChannels[] = { 3, 4, 2, 4 };     // Channels each format keeps, from red on
+
+        enum Pattern { kGradient, kDetail, kNoise, kNumPatterns };
+        const char* kPatternNames[] = { "gradient", "detail", "noise" };
+
+        // Largest RMS error allowed per format and pattern, in 8-bit units
+        const float kMaxError[4][kNumPatterns] =
+        {
+            { 3.0f, 9.0f, 80.0f },
+            { 3.0f, 9.0f, 80.0f },
+            { 1.5f, 3.0f, 40.0f },
+            { 2.0f, 8.5f, 60.0f },
+        };
+
+        std::mt19937 rng(7);
+        const uint32_t kSize = 64;
+        std::vector<uint8_t> image(kSize * kSize * 4);
+        std::vector<uint8_t> blocks(kSize / 4 * kSize / 4 * 16);
+
+        for (int pattern = 0; pattern < kNumPatterns; ++pattern)
+        {
+            for (uint32_t y = 0; y < kSize; ++y)
+            {
+                for (uint32_t x = 0; x < kSize; ++x)
+                {
+                    uint8_t* pixel = &image[(y * kSize + x) * 4];
+                    for (int c = 0; c < 4; ++c)
+                    {
+                        float value;
+                        if (pattern == kGradient)
+                            value = (x * (c + 1) + y * (3 - c)) * 255.0f / (kSize * 4);
+                        else if (pattern == kDetail)
+                            value = 127.5f + 60.0f * std::sin(x * 0.35f + c) * std::cos(y * 0.21f - c) + 60.0f * std::sin((x + y) * 0.05f * (c + 1));
+                        else
+                            value = (float)(rng() & 255);
+                        pixel[c] = (uint8_t)std::min(255.0f, std::max(0.0f, value));
+                    }
+                }
+            }
+
+            for (int f = 0; f < 4; ++f)
+            {
+                const size_t blockRowPitch = kSize / 4 * GetBlockSize(kFormats[f]);
+                CompressImage(image.data(), kSize * 4, kSize, kSize, kFormats[f], blocks.data(), blockRowPitch);
+
+                double sum = 0.0;
+                for (uint32_t by = 0; by < kSize / 4; ++by)
+                {
+                    for (uint32_t bx = 0; bx < kSize / 4; ++bx)
+                    {
+                        const uint8_t* block = &blocks[by * blockRowPitch + bx * GetBlockSize(kFormats[f])];
+                        uint8_t decoded[64];
+                        DecompressBlock(block, kFormats[f], decoded);
+
+                        if (kFormats[f] == kBC7 && (block[0] & 0x7f) != 0x40)
+                            check.Fail("BC7 block isn't in mode 6\n");
+
+                        for (int i = 0; i < 16; ++i)
+                        {
+                            const uint8_t* source = &image[((by * 4 + i / 4) * kSize + bx * 4 + i % 4) * 4];
+                            for (int c = 0; c < kChannels[f]; ++c)
+                            {
+                                const double d = (double)source[c] - decoded[i * 4 + c];
+                                sum += d * d;
+                            }
+                        }
+                    }
+                }
+
+                const float rmse = (float)std::sqrt(sum / (kSize * kSize * kChannels[f]));
+                std::printf("BlockCompress: %s %s RMS error %.2f\n", kFormatNames[f], kPatternNames[pattern], rmse);
+                if (rmse > kMaxError[f][pattern])
+                    check.Fail("%s %s RMS error %.2f over %.2f\n", kFormatNames[f], kPatternNames[pattern], rmse, kMaxError[f][pattern]);
+            }
+        }
+
+        // Flat blocks: exact for the single channel blocks, within 565 rounding for BC1 and BC3 color and within one
+        // step for BC7, whose shared p-bit can't match the parity of every channel
+        for (int trial = 0; trial < 256; ++trial)
+        {
+            uint8_t flat[64];
+            const uint32_t color = rng();
+            for (int i = 0; i < 16; ++i)
+                std::memcpy(flat + i * 4, &color, 4);
+
+            for (int f = 0; f < 4; ++f)
+            {
+                uint8_t block[16];
+                uint8_t decoded[64];
+                CompressBlock(flat, kFormats[f], block);
+                DecompressBlock(block, kFormats[f], decoded);
+
+                for (int i = 0; i < 16; ++i)
+                {
+                    for (int c = 0; c < kChannels[f]; ++c)
+                    {
+                        const bool exactChannel = kFormats[f] == kBC5 || (kFormats[f] == kBC3 && c == 3);
+                        const int tolerance = exactChannel ? 0 : (kFormats[f] == kBC7 ? 1 : 4);
+                        if (std::abs((int)flat[i * 4 + c] - (int)decoded[i * 4 + c]) > tolerance)
+                        {
+                            check.Fail("%s flat block %08X channel %d decoded as %d\n",
+                                kFormatNames[f], color, c, decoded[i * 4 + c]);
+                            i = 16;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+
+        return check.Finish();
+    }
+
+    Registration s_Registration("BlockCompress", Run);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdarg>
+#include <cstdio>
+
+// What every test reports through. The first few failures are printed in full and the rest only counted, so an
+// invariant broken on every element doesn't bury the summary line.
+namespace Tests
+{
+    class Check
+    {
+    public:
+        explicit Check(const char* name) : m_Name(name), m_Failures(0) {}
+
+        const char* Name() const { return m_Name; }
+        int Failures() const { return m_Failures; }
+
+        // Counts a failure and prints it, prefixed with the test name, unless enough have been printed already.
+        void Fail(const char* format, ...)
+        {
+            if (m_Failures++ >= kMaxReported)
+                return;
+            va_list ap;
+            va_start(ap, format);
+            std::printf("%s: ", m_Name);
+            std::vprintf(format, ap);
+            va_end(ap);
+        }
+
+        // Prints "name: details, passed (0 failures)" or the same with FAILED and returns whether nothing failed.
+        bool Finish(const char* details, ...)
+        {
+            va_list ap;
+            va_start(ap, details);
+            std::printf("%s: ", m_Name);
+            std::vprintf(details, ap);
+            va_end(ap);
+            std::printf(", %s (%d failures)\n", m_Failures == 0 ? "passed" : "FAILED", m_Failures);
+            return m_Failures == 0;
+        }
+
+        bool Finish()
+        {
+            std::printf("%s: %s (%d failures)\n", m_Name, m_Failures == 0 ? "passed" : "FAILED", m_Failures);
+            return m_Failures == 0;
+        }
+
+    private:
+        static const int kMaxReported = 8;
+
+        const char* m_Name;
+        int m_Failures;
+    };
+
+    // Each test file registers its tests, and any benchmarks, from a static Registration. Tests run under ctest;
+    // benchmarks only when named on the command line, since they take a while and check nothing.
+    enum Kind { kTest, kBenchmark };
+
+    typedef bool (*TestFunction)(void);
+
+    struct Registration
+    {
+        Registration(const char* name, TestFunction function, Kind kind = kTest);
+    };
+}
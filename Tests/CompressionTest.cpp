@@ -0,0 +1,136 @@
+#include "Check.h"
+#include "../Core/Compression.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+using namespace Compression;
+using namespace Tests;
+
+namespace
+{
+    // Round-trips synthetic and random data of many sizes through both codecs, feeds the decoder corrupted streams
+    // and prints compression ratios and decode speeds.
+    bool Run(void)
+    {
+        Check check("Compression");
+
+        std::mt19937 rng(5);
+
+        // Interleaved position/normal/uv vertices on a smooth surface, the data the byte shuffle is meant for.
+        auto MakeVertices = [&](size_t numVertices)
+        {
+            std::vector<uint8_t> data(numVertices * 32);
+            for (size_t i = 0; i < numVertices; ++i)
+            {
+                const float u = (float)(i % 256) / 255.0f, v = (float)(i / 256) / 255.0f;
+                const float vertex[8] = { u * 100.0f, std::sin(u * 6.0f) * std::cos(v * 4.0f) * 10.0f, v * 100.0f,
+                    0.0f, 1.0f, 0.0f, u, v };
+                std::memcpy(data.data() + i * 32, vertex, sizeof(vertex));
+            }
+            return data;
+        };
+
+        auto MakeRandom = [&](size_t size, uint32_t alphabet)
+        {
+            std::vector<uint8_t> data(size);
+            for (uint8_t& byte : data)
+                byte = (uint8_t)(rng() % alphabet);
+            return data;
+        };
+
+        std::vector<std::vector<uint8_t>> inputs;
+        for (size_t size = 0; size < 40; ++size)
+            inputs.push_back(MakeRandom(size, 3));
+        inputs.push_back(MakeRandom(100000, 256));
+        inputs.push_back(MakeRandom(300000, 4));
+        inputs.push_back(std::vector<uint8_t>(kChunkSize * 2 + 77, 0xAB));
+        inputs.push_back(MakeVertices(70000));
+
+        // Block codec round trips
+        for (const std::vector<uint8_t>& input : inputs)
+        {
+            std::vector<uint8_t> compressed(LZCompressBound(input.size()));
+            const size_t compressedSize = LZCompress(input.data(), input.size(), compressed.data());
+            if (compressedSize > compressed.size())
+                check.Fail("%zu bytes compressed past the bound\n", input.size());
+
+            std::vector<uint8_t> output(input.size() + 1);
+            if (!LZDecompress(compressed.data(), compressedSize, output.data(), input.size()) ||
+                !std::equal(input.begin(), input.end(), output.begin()))
+                check.Fail("%zu-byte round trip failed\n", input.size());
+
+            // A wrong expected size must be rejected.
+            if (LZDecompress(compressed.data(), compressedSize, output.data(), input.size() + 1))
+                check.Fail("%zu-byte stream decoded to the wrong size\n", input.size());
+        }
+
+        // Shuffle round trips, including sizes that don't fill the last element
+        for (uint32_t stride = 1; stride <= 33; stride += 4)
+        {
+            const std::vector<uint8_t> input = MakeRandom(1000 + stride, 256);
+            std::vector<uint8_t> shuffled(input.size()), output(input.size());
+            Shuffle(input.data(), input.size(), stride, shuffled.data());
+            Unshuffle(shuffled.data(), shuffled.size(), stride, output.data());
+            if (output != input)
+                check.Fail("shuffle round trip with stride %u failed\n", stride);
+        }
+
+        // Chunked streams, decoded out of order as parallel tasks would
+        const std::vector<uint32_t> kStrides = { 0, 4, 32 };
+        for (const std::vector<uint8_t>& input : inputs)
+        {
+            const std::vector<uint8_t> stream = CompressChunked(input.data(), input.size(), kStrides);
+            std::vector<uint8_t> output(input.size());
+            const uint32_t numChunks = GetChunkCount(input.size());
+            for (uint32_t i = 0; i < numChunks; ++i)
+            {
+                const uint32_t chunkIdx = numChunks - 1 - i;
+                if (!DecompressChunk(stream.data(), stream.size(), input.size(), chunkIdx, output.data()))
+                    check.Fail("chunk %u of %zu bytes failed to decode\n", chunkIdx, input.size());
+            }
+            if (output != input)
+                check.Fail("chunked round trip of %zu bytes failed\n", input.size());
+        }
+
+        // Corrupted blocks must fail cleanly or decode to something of the right size, never overrun.
+        {
+            const std::vector<uint8_t>& input = inputs.back();
+            std::vector<uint8_t> compressed(LZCompressBound(input.size()));
+            compressed.resize(LZCompress(input.data(), input.size(), compressed.data()));
+            std::vector<uint8_t> output(input.size());
+            for (int trial = 0; trial < 2000; ++trial)
+            {
+                std::vector<uint8_t> corrupted = compressed;
+                for (int flips = 1 + trial % 4; flips > 0; --flips)
+                    corrupted[rng() % corrupted.size()] ^= (uint8_t)(1 + rng() % 255);
+                corrupted.resize(corrupted.size() - (trial % 3 == 0 ? rng() % 16 : 0));
+                LZDecompress(corrupted.data(), corrupted.size(), output.data(), output.size());
+            }
+        }
+
+        // Ratios and decode speed on the vertex data
+        {
+            const std::vector<uint8_t>& input = inputs.back();
+            std::vector<uint8_t> output(input.size());
+            for (uint32_t stride : { 0u, 4u, 32u })
+            {
+                const std::vector<uint8_t> stream = CompressChunked(input.data(), input.size(), std::vector<uint32_t>(1, stride));
+                const int kRuns = 20;
+                const auto start = std::chrono::steady_clock::now();
+                for (int run = 0; run < kRuns; ++run)
+                    for (uint32_t i = 0; i < GetChunkCount(input.size()); ++i)
+                        DecompressChunk(stream.data(), stream.size(), input.size(), i, output.data());
+                const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                std::printf("Compression: vertex data, shuffle stride %2u: %5.1f%% of %zu bytes, decodes at %.0f MB/s on one thread\n",
+                    stride, 100.0 * stream.size() / input.size(), input.size(), kRuns * input.size() / seconds / (1024.0 * 1024.0));
+            }
+        }
+
+        return check.Finish();
+    }
+
+    Registration s_Registration("Compression", Run);
+}
@@ -0,0 +1,197 @@
+#include "Check.h"
+#include "../Core/DDSLayout.h"
+#include "../Core/dds.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+using namespace DDSLayout;
+using namespace DirectX;
+using namespace Tests;
+
+namespace
+{
+    const uint32_t kAlphaModePremultiplied = 2;     // DDS_ALPHA_MODE_PREMULTIPLIED
+
+    // Parses headers written for legacy, DX10, cube, volume, array and malformed files, checks the descriptions and
+    // the subresource offsets against ones computed independently, and checks that every truncation of a file is
+    // caught.
+    bool Run(void)
+    {
+        Check check("DDSLayout");
+
+        // Writes the headers of a DDS file. A zero dxgiFormat writes a legacy header with the given pixel format.
+        auto MakeHeaders = [](uint32_t width, uint32_t height, uint32_t depth, uint32_t mipCount, const DDS_PIXELFORMAT& ddpf,
+            uint32_t flags, uint32_t caps2, DXGI_FORMAT dxgiFormat, uint32_t dimension, uint32_t arraySize, uint32_t miscFlag,
+            uint32_t miscFlags2)
+        {
+            DDS_HEADER header = {};
+            header.size = sizeof(DDS_HEADER);
+            header.flags = DDS_HEADER_FLAGS_TEXTURE | DDS_HEADER_FLAGS_MIPMAP | flags;
+            header.width = width;
+            header.height = height;
+            header.depth = depth;
+            header.mipMapCount = mipCount;
+            header.ddspf = ddpf;
+            header.caps2 = caps2;
+
+            std::vector<uint8_t> file(sizeof(uint32_t) + sizeof(DDS_HEADER));
+            memcpy(file.data(), &DDS_MAGIC, sizeof(uint32_t));
+            if (dxgiFormat != DXGI_FORMAT_UNKNOWN)
+            {
+                header.ddspf.size = sizeof(DDS_PIXELFORMAT);
+                header.ddspf.flags = DDS_FOURCC;
+                header.ddspf.fourCC = MAKEFOURCC('D', 'X', '1', '0');
+
+                DDS_HEADER_DXT10 d3d10ext = { dxgiFormat, dimension, miscFlag, arraySize, miscFlags2 };
+                file.resize(file.size() + sizeof(DDS_HEADER_DXT10));
+                memcpy(file.data() + sizeof(uint32_t) + sizeof(DDS_HEADER), &d3d10ext, sizeof(DDS_HEADER_DXT10));
+            }
+            memcpy(file.data() + sizeof(uint32_t), &header, sizeof(DDS_HEADER));
+            return file;
+        };
+
+        auto FourCC = [](uint32_t fourCC)
+        {
+            DDS_PIXELFORMAT ddpf = { sizeof(DDS_PIXELFORMAT), DDS_FOURCC, fourCC, 0, 0, 0, 0, 0 };
+            return ddpf;
+        };
+        const DDS_PIXELFORMAT kA8R8G8B8 = { sizeof(DDS_PIXELFORMAT), DDS_RGBA, 0, 32, 0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000 };
+        const DDS_PIXELFORMAT kNoFormat = {};
+
+        struct Expected
+        {
+            const char* name;
+            std::vector<uint8_t> headers;
+            Result result;
+            Dimension dimension;
+            uint32_t width, height, depth, arraySize, mipCount;
+            DXGI_FORMAT format;
+            bool isCubeMap;
+            uint32_t alphaMode;
+            uint32_t bytesPerBlock;     // 0 for uncompressed formats
+            uint32_t bytesPerTexel;
+        };
+
+        const uint32_t kVolume = DDS_HEADER_FLAGS_VOLUME;
+        const Expected cases[] =
+        {
+            { "DXT1", MakeHeaders(256, 128, 0, 9, FourCC(MAKEFOURCC('D', 'X', 'T', '1')), 0, 0, DXGI_FORMAT_UNKNOWN, 0, 0, 0, 0),
+                kOk, kTexture2D, 256, 128, 1, 1, 9, DXGI_FORMAT_BC1_UNORM, false, 0, 8, 0 },
+            { "DXT4", MakeHeaders(64, 64, 0, 0, FourCC(MAKEFOURCC('D', 'X', 'T', '4')), 0, 0, DXGI_FORMAT_UNKNOWN, 0, 0, 0, 0),
+                kOk, kTexture2D, 64, 64, 1, 1, 1, DXGI_FORMAT_BC3_UNORM, false, kAlphaModePremultiplied, 16, 0 },
+            { "BC7 array", MakeHeaders(1000, 600, 0, 10, kNoFormat, 0, 0, DXGI_FORMAT_BC7_UNORM_SRGB, DDS_DIMENSION_TEXTURE2D, 3, 0, 2),
+                kOk, kTexture2D, 1000, 600, 1, 3, 10, DXGI_FORMAT_BC7_UNORM_SRGB, false, 2, 16, 0 },
+            { "A8R8G8B8 cube", MakeHeaders(64, 64, 0, 7, kA8R8G8B8, 0, DDS_CUBEMAP_ALLFACES, DXGI_FORMAT_UNKNOWN, 0, 0, 0, 0),
+                kOk, kTexture2D, 64, 64, 1, 6, 7, DXGI_FORMAT_B8G8R8A8_UNORM, true, 0, 0, 4 },
+            { "BC5 cube array", MakeHeaders(32, 32, 0, 6, kNoFormat, 0, 0, DXGI_FORMAT_BC5_UNORM, DDS_DIMENSION_TEXTURE2D, 2, DDS_RESOURCE_MISC_TEXTURECUBE, 0),
+                kOk, kTexture2D, 32, 32, 1, 12, 6, DXGI_FORMAT_BC5_UNORM, true, 0, 16, 0 },
+            { "RGBA16F volume", MakeHeaders(32, 16, 8, 6, FourCC(113), kVolume, 0, DXGI_FORMAT_UNKNOWN, 0, 0, 0, 0),
+                kOk, kTexture3D, 32, 16, 8, 1, 6, DXGI_FORMAT_R16G16B16A16_FLOAT, false, 0, 0, 8 },
+            { "R8 1D array", MakeHeaders(300, 1, 0, 9, kNoFormat, 0, 0, DXGI_FORMAT_R8_UNORM, DDS_DIMENSION_TEXTURE1D, 4, 0, 0),
+                kOk, kTexture1D, 300, 1, 1, 4, 9, DXGI_FORMAT_R8_UNORM, false, 0, 0, 1 },
+
+            { "no array slices", MakeHeaders(64, 64, 0, 1, kNoFormat, 0, 0, DXGI_FORMAT_BC1_UNORM, DDS_DIMENSION_TEXTURE2D, 0, 0, 0), kInvalidData },
+            { "1D with height", MakeHeaders(64, 2, 0, 1, kNoFormat, DDS_HEIGHT, 0, DXGI_FORMAT_R8_UNORM, DDS_DIMENSION_TEXTURE1D, 1, 0, 0), kInvalidData },
+            { "3D without volume flag", MakeHeaders(8, 8, 8, 1, kNoFormat, 0, 0, DXGI_FORMAT_R8_UNORM, DDS_DIMENSION_TEXTURE3D, 1, 0, 0), kInvalidData },
+            { "partial cube", MakeHeaders(64, 64, 0, 1, kA8R8G8B8, 0, DDS_CUBEMAP_POSITIVEX, DXGI_FORMAT_UNKNOWN, 0, 0, 0, 0), kNotSupported },
+            { "palettized", MakeHeaders(64, 64, 0, 1, kNoFormat, 0, 0, DXGI_FORMAT_P8, DDS_DIMENSION_TEXTURE2D, 1, 0, 0), kNotSupported },
+            { "unknown fourCC", MakeHeaders(64, 64, 0, 1, FourCC(MAKEFOURCC('A', 'B', 'C', 'D')), 0, 0, DXGI_FORMAT_UNKNOWN, 0, 0, 0, 0), kNotSupported },
+            { "16 mips", MakeHeaders(1 << 15, 1, 0, 16, kNoFormat, 0, 0, DXGI_FORMAT_R8_UNORM, DDS_DIMENSION_TEXTURE2D, 1, 0, 0), kNotSupported },
+            { "too wide", MakeHeaders(20000, 4, 0, 1, FourCC(MAKEFOURCC('D', 'X', 'T', '5')), 0, 0, DXGI_FORMAT_UNKNOWN, 0, 0, 0, 0), kNotSupported },
+            { "volume array", MakeHeaders(8, 8, 8, 1, kNoFormat, kVolume, 0, DXGI_FORMAT_R8_UNORM, DDS_DIMENSION_TEXTURE3D, 2, 0, 0), kNotSupported },
+        };
+
+        for (const Expected& expected : cases)
+        {
+            // Every prefix of the headers is rejected without reading past it.
+            for (size_t size = 0; size < expected.headers.size(); ++size)
+            {
+                std::vector<uint8_t> prefix(expected.headers.begin(), expected.headers.begin() + size);
+                TextureDesc desc;
+                if (ParseHeader(prefix.empty() ? nullptr : prefix.data(), size, desc) == kOk)
+                    check.Fail("%s: accepted %zu of %zu header bytes\n", expected.name, size, expected.headers.size());
+            }
+
+            TextureDesc desc;
+            const Result result = ParseHeader(expected.headers.data(), expected.headers.size(), desc);
+            if (result != expected.result)
+            {
+                check.Fail("%s: result %d, expected %d\n", expected.name, (int)result, (int)expected.result);
+                continue;
+            }
+            if (result != kOk)
+                continue;
+
+            if (desc.headerSize != expected.headers.size() || desc.dimension != expected.dimension ||
+                desc.width != expected.width || desc.height != expected.height || desc.depth != expected.depth ||
+                desc.arraySize != expected.arraySize || desc.mipCount != expected.mipCount || desc.format != expected.format ||
+                desc.isCubeMap != expected.isCubeMap || desc.alphaMode != expected.alphaMode)
+            {
+                check.Fail("%s: parsed as %ux%ux%u, %u slices, %u mips, format %d, dimension %d, alpha mode %u\n",
+                    expected.name, desc.width, desc.height, desc.depth, desc.arraySize, desc.mipCount, (int)desc.format,
+                    (int)desc.dimension, desc.alphaMode);
+                continue;
+            }
+
+            // Lay out the subresources with every size limit that leaves out a different number of mips.
+            for (size_t maxSize = 0; ; maxSize = maxSize == 0 ? 1 : maxSize * 2)
+            {
+                Layout layout;
+                if (GetLayout(desc, maxSize, layout) != kOk)
+                {
+                    check.Fail("%s: no layout with a limit of %zu\n", expected.name, maxSize);
+                    break;
+                }
+
+                uint32_t skipMip = 0;
+                while (maxSize != 0 && desc.mipCount > 1 && skipMip < desc.mipCount &&
+                    std::max({ desc.width >> skipMip, desc.height >> skipMip, desc.depth >> skipMip }) > maxSize)
+                {
+                    ++skipMip;
+                }
+
+                uint64_t offset = 0;
+                size_t index = 0;
+                bool matches = layout.skipMip == skipMip && layout.mipCount == desc.mipCount - skipMip &&
+                    layout.subresources.size() == (size_t)layout.mipCount * desc.arraySize &&
+                    layout.width == std::max(desc.width >> skipMip, 1u) && layout.height == std::max(desc.height >> skipMip, 1u) &&
+                    layout.depth == std::max(desc.depth >> skipMip, 1u);
+                for (uint32_t slice = 0; slice < desc.arraySize && matches; ++slice)
+                {
+                    for (uint32_t mip = 0; mip < desc.mipCount && matches; ++mip)
+                    {
+                        const uint64_t w = std::max(desc.width >> mip, 1u), h = std::max(desc.height >> mip, 1u);
+                        const uint64_t d = std::max(desc.depth >> mip, 1u);
+                        const uint64_t rowPitch = expected.bytesPerBlock != 0 ? (w + 3) / 4 * expected.bytesPerBlock : w * expected.bytesPerTexel;
+                        const uint64_t slicePitch = expected.bytesPerBlock != 0 ? rowPitch * ((h + 3) / 4) : rowPitch * h;
+                        if (mip >= skipMip)
+                        {
+                            const Subresource& subresource = layout.subresources[index++];
+                            matches = subresource.offset == offset && subresource.rowPitch == rowPitch &&
+                                subresource.slicePitch == slicePitch;
+                        }
+                        offset += slicePitch * d;
+                    }
+                }
+                if (!matches || layout.dataSize != offset)
+                    check.Fail("%s: wrong layout with a limit of %zu\n", expected.name, maxSize);
+
+                if (skipMip == 0 && maxSize != 0)
+                    break;
+            }
+        }
+
+        // The block compression formats and nothing else
+        for (uint32_t format = 0; format <= DXGI_FORMAT_BC7_UNORM_SRGB; ++format)
+        {
+            const bool bc = (format >= 70 && format <= 84) || format >= 94;
+            if (IsBlockCompressed((DXGI_FORMAT)format) != bc)
+                check.Fail("format %u %s block compressed\n", format, bc ? "is" : "isn't");
+        }
+
+        return check.Finish();
+    }
+
+    Registration s_Registration("DDSLayout", Run);
+}
@@ -0,0 +1,388 @@
+#include "Check.h"
+#include "../Model/JsonDocument.h"
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace glTF;
+using namespace Tests;
+
+namespace
+{
+    void AppendString(std::string& out, const char* chars, size_t length)
+    {
+        out += '"';
+        for (size_t i = 0; i < length; ++i)
+        {
+            const unsigned char c = (unsigned char)chars[i];
+            char hex[8];
+            if (c < 0x20 || c >= 0x7F || c == '"' || c == '\\')
+            {
+                std::snprintf(hex, sizeof(hex), "\\x%02X", c);
+                out += hex;
+            }
+            else
+            {
+                out += (char)c;
+            }
+        }
+        out += '"';
+    }
+
+    // A canonical form of a parsed tree that spells out every value's type: i:, u: and f: for the three kinds of
+    // number, strings as raw bytes with everything unprintable in hex, members in document order.
+    void Dump(const JsonValue& value, std::string& out)
+    {
+        char number[40];
+        switch (value.type())
+        {
+        case JsonValue::kNull: out += "null"; break;
+        case JsonValue::kBoolean: out += value.get<bool>() ? "true" : "false"; break;
+        case JsonValue::kInteger: std::snprintf(number, sizeof(number), "i:%" PRId64, value.get<int64_t>()); out += number; break;
+        case JsonValue::kUnsigned: std::snprintf(number, sizeof(number), "u:%" PRIu64, value.get<uint64_t>()); out += number; break;
+        case JsonValue::kFloat: std::snprintf(number, sizeof(number), "f:%.17g", value.get<double>()); out += number; break;
+        case JsonValue::kString:
+        {
+            const std::string string = value.get<std::string>();
+            AppendString(out, string.data(), string.size());
+            break;
+        }
+        case JsonValue::kArray:
+        case JsonValue::kObject:
+        {
+            const bool isObject = value.is_object();
+            out += isObject ? '{' : '[';
+            for (JsonValue::const_iterator child = value.begin(); child != value.end(); ++child)
+            {
+                if (child != value.begin())
+                    out += ',';
+                if (isObject)
+                {
+                    const std::string key = child.key();
+                    AppendString(out, key.data(), key.size());
+                    out += ':';
+                }
+                Dump(child.value(), out);
+            }
+            out += isObject ? '}' : ']';
+            break;
+        }
+        }
+    }
+
+    std::string Dump(const JsonValue& value)
+    {
+        std::string out;
+        Dump(value, out);
+        return out;
+    }
+
+    std::string DumpFloat(double d)
+    {
+        char number[40];
+        std::snprintf(number, sizeof(number), "f:%.17g", d);
+        return number;
+    }
+
+    // Random documents as text with random whitespace, along with the Dump of what they should parse to.
+    class Generator
+    {
+    public:
+        explicit Generator(uint32_t seed) : m_Rng(seed) {}
+
+        void Value(int depth, std::string& text, std::string& expected)
+        {
+            switch (m_Rng() % (depth > 0 ? 7 : 5))
+            {
+            case 0: text += "null"; expected += "null"; break;
+            case 1:
+            {
+                const char* literal = m_Rng() % 2 ? "true" : "false";
+                text += literal;
+                expected += literal;
+                break;
+            }
+            case 2: Number(text, expected); break;
+            case 3: Number(text, expected); break;
+            case 4: String(text, expected); break;
+            default: Container(depth, text, expected); break;
+            }
+        }
+
+    private:
+        void Space(std::string& text)
+        {
+            static const char kSpaces[] = " \t\r\n";
+            while (m_Rng() % 3 == 0)
+                text += kSpaces[m_Rng() % 4];
+        }
+
+        void Number(std::string& text, std::string& expected)
+        {
+            char number[64];
+            if (m_Rng() % 2)
+            {
+                // Integers of every length, which stay integers as long as they fit in 64 bits.
+                const int digits = 1 + m_Rng() % 19;
+                uint64_t magnitude = 0;
+                for (int i = 0; i < digits; ++i)
+                    magnitude = magnitude * 10 + (i == 0 ? 1 + m_Rng() % 9 : m_Rng() % 10);
+                const bool negative = m_Rng() % 2 != 0;
+                std::snprintf(number, sizeof(number), "%s%" PRIu64, negative ? "-" : "", magnitude);
+                text += number;
+                if (negative)
+                    std::snprintf(number, sizeof(number), "i:%" PRId64, -(int64_t)magnitude);
+                else
+                    std::snprintf(number, sizeof(number), "%c:%" PRIu64, digits <= 18 ? 'i' : 'u', magnitude);
+                expected += number;
+            }
+            else
+            {
+                // Doubles with up to 17 significant digits and a wide exponent range, always written with an exponent
+                // so they parse as floats. Either path through ParseNumber has to round as strtod does.
+                const int precision = (int)(m_Rng() % 17);
+                const double mantissa = (double)(m_Rng() % 1000000007) / 1000000007.0 * 9.0 + 1.0;
+                const int exponent = (int)(m_Rng() % 600) - 300;
+                std::snprintf(number, sizeof(number), "%s%.*fe%d", m_Rng() % 2 ? "-" : "", precision, mantissa, exponent);
+                text += number;
+                expected += DumpFloat(std::strtod(number, nullptr));
+            }
+        }
+
+        void String(std::string& text, std::string& expected)
+        {
+            static const char* kPieces[][2] =
+            {
+                { "a", "a" }, { "Z", "Z" }, { " ", " " }, { "/", "/" },
+                { "\\\"", "\"" }, { "\\\\", "\\" }, { "\\/", "/" }, { "\\b", "\b" }, { "\\f", "\f" },
+                { "\\n", "\n" }, { "\\r", "\r" }, { "\\t", "\t" },
+                { "\\u0041", "A" }, { "\\u00e9", "\xC3\xA9" }, { "\\u20AC", "\xE2\x82\xAC" },
+                { "\\ud83d\\ude00", "\xF0\x9F\x98\x80" }, { "\xC3\xA9", "\xC3\xA9" },
+            };
+            const int numPieces = sizeof(kPieces) / sizeof(kPieces[0]);
+
+            std::string decoded;
+            text += '"';
+            for (uint32_t length = m_Rng() % 6; length > 0; --length)
+            {
+                const int piece = (int)(m_Rng() % numPieces);
+                text += kPieces[piece][0];
+                decoded += kPieces[piece][1];
+            }
+            text += '"';
+            AppendString(expected, decoded.data(), decoded.size());
+        }
+
+        void Container(int depth, std::string& text, std::string& expected)
+        {
+            const bool isObject = m_Rng() % 2 != 0;
+            text += isObject ? '{' : '[';
+            expected += isObject ? '{' : '[';
+            for (uint32_t count = m_Rng() % 5, i = 0; i < count; ++i)
+            {
+                if (i > 0)
+                {
+                    text += ',';
+                    expected += ',';
+                }
+                Space(text);
+                if (isObject)
+                {
+                    String(text, expected);
+                    Space(text);
+                    text += ':';
+                    expected += ':';
+                    Space(text);
+                }
+                Value(depth - 1, text, expected);
+                Space(text);
+            }
+            text += isObject ? '}' : ']';
+            expected += isObject ? '}' : ']';
+        }
+
+        std::mt19937 m_Rng;
+    };
+
+    // Parses a copy of text in a buffer of exactly its length, so that a read past the end shows up under a memory
+    // checker. The document points into the buffer, which has to live as long as it does.
+    bool ParseExact(JsonDocument& document, const std::string& text, std::unique_ptr<char[]>& buffer)
+    {
+        buffer.reset(new char[text.size() + (text.empty() ? 1 : 0)]);
+        std::memcpy(buffer.get(), text.data(), text.size());
+        return document.Parse(buffer.get(), text.size());
+    }
+
+    // Parses well-formed documents, hand-written and generated, and compares them with the trees they should give.
+    // Every truncation of them and a list of malformed documents must fail, leaving a null root and an error.
+    bool Run(void)
+    {
+        Check check("JsonDocument");
+
+        struct Case
+        {
+            const char* text;
+            const char* expected;
+        };
+        const Case kWellFormed[] =
+        {
+            { "null", "null" },
+            { " \t\r\n true \n", "true" },
+            { "[]", "[]" },
+            { "{}", "{}" },
+            { "[[[]],{}]", "[[[]],{}]" },
+            { "{\"a\":1,\"b\":[true,false,null],\"c\":{\"d\":\"e\"}}", "{\"a\":i:1,\"b\":[true,false,null],\"c\":{\"d\":\"e\"}}" },
+            { "{\"\":0}", "{\"\":i:0}" },
+            { "\xEF\xBB\xBF{\"bom\":true}", "{\"bom\":true}" },
+            { "\"\"", "\"\"" },
+            { "\"\\\"\\\\\\/\\b\\f\\n\\r\\t\"", "\"\\x22\\x5C/\\x08\\x0C\\x0A\\x0D\\x09\"" },
+            { "\"\\u0000\"", "\"\\x00\"" },
+            { "\"\\u0041\\u00E9\\u20ac\\uD83D\\uDE00\"", "\"A\\xC3\\xA9\\xE2\\x82\\xAC\\xF0\\x9F\\x98\\x80\"" },
+            { "\"\\uDBFF\\uDFFF\"", "\"\\xF4\\x8F\\xBF\\xBF\"" },
+            { "\"\\u007F\\u0080\\u07FF\\u0800\\uFFFF\"", "\"\\x7F\\xC2\\x80\\xDF\\xBF\\xE0\\xA0\\x80\\xEF\\xBF\\xBF\"" },
+            { "0", "i:0" },
+            { "-0", "i:0" },
+            { "[1,-1,123456789012345678]", "[i:1,i:-1,i:123456789012345678]" },
+            { "9223372036854775807", "u:9223372036854775807" },
+            { "-9223372036854775808", "i:-9223372036854775808" },
+            { "18446744073709551615", "u:18446744073709551615" },
+            { "18446744073709551616", "f:1.8446744073709552e+19" },
+            { "-9223372036854775809", "f:-9.2233720368547758e+18" },
+            { "1.0", "f:1" },
+            { "-0.0", "f:-0" },
+            { "1e2", "f:100" },
+            { "1E+2", "f:100" },
+            { "1e-2", "f:0.01" },
+            { "0.1", "f:0.10000000000000001" },
+            { "0.000001234", "f:1.234e-06" },
+            { "123456789012345678901234567890", "f:1.2345678901234568e+29" },
+            { "2.2250738585072011e-308", "f:2.2250738585072009e-308" },
+            { "4.9e-324", "f:4.9406564584124654e-324" },
+            { "1e-400", "f:0" },
+            { "1.7976931348623157e308", "f:1.7976931348623157e+308" },
+            { "1e000000000000000000002", "f:100" },
+            { "{\"k\":1,\"k\":2}", "{\"k\":i:1,\"k\":i:2}" },
+        };
+
+        for (const Case& test : kWellFormed)
+        {
+            JsonDocument document;
+            std::unique_ptr<char[]> buffer;
+            const std::string text = test.text;
+            if (!ParseExact(document, text, buffer))
+            {
+                check.Fail("'%s' didn't parse: %s\n", test.text, document.GetError().c_str());
+                continue;
+            }
+            const std::string dump = Dump(document.GetRoot());
+            if (dump != test.expected)
+                check.Fail("'%s' parsed to %s, expected %s\n", test.text, dump.c_str(), test.expected);
+        }
+
+        // The last of duplicate members wins lookups.
+        {
+            JsonDocument document;
+            std::unique_ptr<char[]> buffer;
+            if (!ParseExact(document, "{\"k\":1,\"k\":2}", buffer) || document.GetRoot().find("k")->get<int>() != 2)
+                check.Fail("duplicate member: the first one won\n");
+        }
+
+        const char* kMalformed[] =
+        {
+            "", " ", "\xEF\xBB\xBF", "\xEF\xBB", "\xEF\xBB\xBF\xEF\xBB\xBF{}", "{} \xEF\xBB\xBF",
+            "[", "]", "{", "}", "[1,]", "[,1]", "[1 2]", "[1]]", "[1],", "{\"a\"}", "{\"a\":}", "{a:1}",
+            "{\"a\":1,}", "{\"a\":1 \"b\":2}", "{\"a\",1}", "{1:2}", "[}", "{]",
+            "tru", "truex", "nul", "nulll", "True", "[true false]", "NaN", "Infinity", "-Infinity", "undefined",
+            "01", "-01", "1.", ".5", "-", "-a", "+1", "--1", "1e", "1e+", "1e-", "1.e1", "0x10", "1ee1", "1e1.5",
+            "1e400", "-1e400", "1e99999999999",
+            "\"abc", "\"abc\\", "\"abc\\\"", "\"\\x\"", "\"\\u12\"", "\"\\u12G4\"", "\"\\u\"",
+            "\"\\ud800\"", "\"\\ud800\\u0041\"", "\"\\ud800\\\"", "\"\\udc00\"", "\"\\ud83d\\ude0\"",
+            "\"a\nb\"", "\"a\tb\"", "\"\x01\"", "\"\\n\x1F\"", "'single'", "[\"a\" \"b\"]",
+            "/* comment */ 1", "1 // comment", "1 2", "{} {}",
+        };
+        for (const char* text : kMalformed)
+        {
+            JsonDocument document;
+            std::unique_ptr<char[]> buffer;
+            if (ParseExact(document, text, buffer))
+                check.Fail("'%s' parsed to %s\n", text, Dump(document.GetRoot()).c_str());
+            else if (document.GetError().empty() || !document.GetRoot().is_null())
+                check.Fail("'%s' failed without an error or with a root\n", text);
+        }
+
+        // Every number in the grammar that strtod accepts rounds as strtod does, through the fast path or not.
+        {
+            std::mt19937 rng(13);
+            for (int i = 0; i < 20000; ++i)
+            {
+                char number[64];
+                const uint64_t mantissa = ((uint64_t)rng() << 32 | rng()) >> (rng() % 64);
+                const int scale = (int)(rng() % 25);
+                const int exponent = (int)(rng() % 60) - 30;
+                std::snprintf(number, sizeof(number), "%" PRIu64 ".%0*de%d", mantissa, scale, (int)(rng() % 1000), exponent);
+
+                JsonDocument document;
+                std::unique_ptr<char[]> buffer;
+                if (!ParseExact(document, number, buffer))
+                {
+                    check.Fail("'%s' didn't parse: %s\n", number, document.GetError().c_str());
+                    continue;
+                }
+                const double d = document.GetRoot().get<double>();
+                const double reference = std::strtod(number, nullptr);
+                if (document.GetRoot().type() != JsonValue::kFloat || std::memcmp(&d, &reference, sizeof(d)) != 0)
+                    check.Fail("'%s' parsed to %s, strtod gives %.17g\n", number, Dump(document.GetRoot()).c_str(), reference);
+            }
+        }
+
+        // Generated documents parse to the tree they were generated from. Each one is then cut short at every length
+        // and parsed in place, with the rest of the document right after the end it was given: a parser that reads
+        // past the end would see the missing characters and could succeed. The same cuts are parsed from exact-size
+        // copies too.
+        uint32_t numDocuments = 0;
+        size_t numTruncations = 0;
+        for (uint32_t seed = 0; seed < 300; ++seed)
+        {
+            Generator generator(seed);
+            std::string text, expected;
+            generator.Value(4, text, expected);
+
+            JsonDocument document;
+            std::unique_ptr<char[]> buffer;
+            if (!ParseExact(document, text, buffer))
+            {
+                check.Fail("generated document %u didn't parse: %s\n%s\n", seed, document.GetError().c_str(), text.c_str());
+                continue;
+            }
+            const std::string dump = Dump(document.GetRoot());
+            if (dump != expected)
+            {
+                check.Fail("generated document %u parsed to\n%s\nexpected\n%s\n", seed, dump.c_str(), expected.c_str());
+                continue;
+            }
+            ++numDocuments;
+
+            // A number cut short can still be a number, so only containers and strings are cut.
+            if (text[0] != '{' && text[0] != '[' && text[0] != '"')
+                continue;
+
+            for (size_t length = 0; length < text.size(); ++length)
+            {
+                if (document.Parse(text.data(), length) || ParseExact(document, text.substr(0, length), buffer))
+                {
+                    check.Fail("generated document %u cut to %zu characters parsed\n", seed, length);
+                    break;
+                }
+                ++numTruncations;
+            }
+        }
+
+        return check.Finish("%u generated documents, %zu truncations", numDocuments, numTruncations);
+    }
+
+    Registration s_Registration("JsonDocument", Run);
+}
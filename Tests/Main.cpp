@@ -0,0 +1,66 @@
+#include "Check.h"
+#include <cstring>
+#include <vector>
+
+// Runs the tests named on the command line, or every test when none is. Benchmarks run only when named.
+// Exits with 1 if any test failed or a name matched nothing.
+namespace
+{
+    struct Entry
+    {
+        const char* name;
+        Tests::TestFunction function;
+        Tests::Kind kind;
+    };
+
+    std::vector<Entry>& Registry(void)
+    {
+        static std::vector<Entry> s_Registry;
+        return s_Registry;
+    }
+}
+
+Tests::Registration::Registration(const char* name, TestFunction function, Kind kind)
+{
+    Registry().push_back({ name, function, kind });
+}
+
+int main(int argc, char** argv)
+{
+    if (argc == 2 && std::strcmp(argv[1], "--list") == 0)
+    {
+        for (const Entry& entry : Registry())
+            std::printf("%s%s\n", entry.name, entry.kind == Tests::kBenchmark ? " (benchmark)" : "");
+        return 0;
+    }
+
+    bool passed = true;
+    if (argc == 1)
+    {
+        for (const Entry& entry : Registry())
+        {
+            if (entry.kind == Tests::kTest)
+                passed = entry.function() && passed;
+        }
+        return passed ? 0 : 1;
+    }
+
+    for (int i = 1; i < argc; ++i)
+    {
+        bool found = false;
+        for (const Entry& entry : Registry())
+        {
+            if (std::strcmp(entry.name, argv[i]) == 0)
+            {
+                passed = entry.function() && passed;
+                found = true;
+            }
+        }
+        if (!found)
+        {
+            std::printf("No test or benchmark named %s\n", argv[i]);
+            passed = false;
+        }
+    }
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,371 @@
+#include "Check.h"
+#include "../Model/MeshOptimize.h"
+#include "../Model/IndexOptimizePostTransform.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace MeshOptimize;
+using namespace Tests;
+
+namespace
+{
+    // Every stage is measured, and OptimizeVertexFetch run, as if the vertices were a typical 32 byte vertex.
+    const uint32_t kVertexStride = 32;
+
+    struct TestMesh
+    {
+        const char* name;
+        std::vector<float> positions;
+        std::vector<uint32_t> indices;
+
+        uint32_t VertexCount() const { return (uint32_t)positions.size() / 3; }
+        uint32_t IndexCount() const { return (uint32_t)indices.size(); }
+        const uint8_t* Positions() const { return (const uint8_t*)positions.data(); }
+    };
+
+    // Appends an n by n grid over [-1, 1]^2 at z, wrapped around a sphere of that radius when sphere is set. Faces
+    // point away from the origin (toward +z for the flat grid).
+    void AppendGrid(TestMesh& mesh, uint32_t n, bool sphere, float z)
+    {
+        const uint32_t base = mesh.VertexCount();
+        for (uint32_t y = 0; y <= n; ++y)
+        {
+            for (uint32_t x = 0; x <= n; ++x)
+            {
+                if (sphere)
+                {
+                    const float theta = 3.14159265f * y / n, phi = 6.28318531f * x / n;
+                    mesh.positions.push_back(z * std::sin(theta) * std::cos(phi));
+                    mesh.positions.push_back(z * std::sin(theta) * std::sin(phi));
+                    mesh.positions.push_back(z * std::cos(theta));
+                }
+                else
+                {
+                    mesh.positions.push_back(2.0f * x / n - 1.0f);
+                    mesh.positions.push_back(2.0f * y / n - 1.0f);
+                    mesh.positions.push_back(z);
+                }
+            }
+        }
+        for (uint32_t y = 0; y < n; ++y)
+        {
+            for (uint32_t x = 0; x < n; ++x)
+            {
+                const uint32_t v = base + y * (n + 1) + x;
+                const uint32_t flat[6] = { v, v + 1, v + n + 2, v, v + n + 2, v + n + 1 };
+                const uint32_t round[6] = { v, v + n + 2, v + 1, v, v + n + 1, v + n + 2 };
+                mesh.indices.insert(mesh.indices.end(), sphere ? round : flat, (sphere ? round : flat) + 6);
+            }
+        }
+    }
+
+    // Shuffles the triangles and the vertices, as an exporter that keeps neither in any useful order would.
+    void Shuffle(TestMesh& mesh, std::mt19937& rng)
+    {
+        const uint32_t triangleCount = mesh.IndexCount() / 3;
+        for (uint32_t t = triangleCount - 1; t > 0; --t)
+        {
+            const uint32_t other = std::uniform_int_distribution<uint32_t>(0, t)(rng);
+            std::swap_ranges(mesh.indices.begin() + t * 3, mesh.indices.begin() + t * 3 + 3, mesh.indices.begin() + other * 3);
+        }
+
+        std::vector<uint32_t> order(mesh.VertexCount());
+        for (uint32_t v = 0; v < order.size(); ++v)
+            order[v] = v;
+        std::shuffle(order.begin(), order.end(), rng);
+
+        std::vector<float> positions(mesh.positions.size());
+        for (uint32_t v = 0; v < order.size(); ++v)
+            std::copy_n(&mesh.positions[v * 3], 3, &positions[order[v] * 3]);
+        mesh.positions.swap(positions);
+        for (uint32_t& index : mesh.indices)
+            index = order[index];
+    }
+
+    // Grids, spheres and nested spheres, in the order they were generated and shuffled.
+    std::vector<TestMesh> CreateTestMeshes(uint32_t n)
+    {
+        std::mt19937 rng(5);
+        std::vector<TestMesh> meshes(6);
+
+        meshes[0].name = "grid";
+        AppendGrid(meshes[0], n, false, 0.0f);
+        meshes[1].name = "sphere";
+        AppendGrid(meshes[1], n, true, 1.0f);
+        meshes[2].name = "shells";
+        for (uint32_t shell = 0; shell < 4; ++shell)
+            AppendGrid(meshes[2], n / 2, true, 0.4f + 0.2f * shell);
+
+        for (uint32_t i = 0; i < 3; ++i)
+        {
+            meshes[i + 3] = meshes[i];
+            Shuffle(meshes[i + 3], rng);
+        }
+        meshes[3].name = "shuffled grid";
+        meshes[4].name = "shuffled sphere";
+        meshes[5].name = "shuffled shells";
+        return meshes;
+    }
+
+    // The stages as OptimizeMesh runs them, with 32-bit indices.
+    void OptimizeCache(TestMesh& mesh, uint32_t cacheSize = kVertexCacheSize)
+    {
+        std::vector<uint32_t> optimized(mesh.indices.size());
+        OptimizeFaces(mesh.indices.data(), mesh.indices.size(), optimized.data(), cacheSize);
+        mesh.indices.swap(optimized);
+    }
+
+    void OptimizeFetch(TestMesh& mesh)
+    {
+        std::vector<uint32_t> remap;
+        const uint32_t usedVertexCount = OptimizeVertexFetch(mesh.indices.data(), true, mesh.IndexCount(), mesh.VertexCount(), kVertexStride, remap);
+        std::vector<uint8_t> vertices(mesh.Positions(), mesh.Positions() + mesh.positions.size() * 4);
+        RemapVertexBuffer(vertices, 12, remap, usedVertexCount);
+        mesh.positions.resize(usedVertexCount * 3);
+        std::memcpy(mesh.positions.data(), vertices.data(), vertices.size());
+    }
+
+    double MillisecondsSince(std::chrono::high_resolution_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    // Runs each stage on generated grids, spheres and nested shells, in their original and in shuffled order, and
+    // prints the vertex reuse, overdraw and fetch cost after each stage, the time each took and the reuse that
+    // OptimizeFaces reaches with other cache sizes.
+    bool Benchmark(void)
+    {
+        auto Report = [&](const char* stage, const TestMesh& mesh, double ms)
+        {
+            const VertexCacheStats cache = AnalyzeVertexCache(mesh.indices.data(), true, mesh.IndexCount(), mesh.VertexCount());
+            const OverdrawStats overdraw = AnalyzeOverdraw(mesh.indices.data(), true, mesh.IndexCount(), mesh.Positions(), 12, mesh.VertexCount());
+            const VertexFetchStats fetch = AnalyzeVertexFetch(mesh.indices.data(), true, mesh.IndexCount(), mesh.VertexCount(), kVertexStride);
+            std::printf("  %-10s ACMR %.3f, ATVR %.3f, overdraw %.3f, overfetch %.3f, %8.2f ms\n",
+                stage, cache.acmr, cache.atvr, overdraw.overdraw, fetch.overfetch, ms);
+        };
+
+        std::printf("MeshOptimize benchmark: batches of %u vertices and %u triangles, %u byte vertices\n",
+            kBatchVertices, kBatchTriangles, kVertexStride);
+
+        for (TestMesh& mesh : CreateTestMeshes(256))
+        {
+            std::printf("%s: %u triangles, %u vertices\n", mesh.name, mesh.IndexCount() / 3, mesh.VertexCount());
+            Report("input", mesh, 0.0);
+
+            std::printf("  OptimizeFaces ACMR by cache size:");
+            for (uint32_t cacheSize = 8; cacheSize <= 64; cacheSize *= 2)
+            {
+                TestMesh sized = mesh;
+                OptimizeCache(sized, cacheSize);
+                std::printf(" %u: %.3f", cacheSize, AnalyzeVertexCache(sized.indices.data(), true, sized.IndexCount(), sized.VertexCount()).acmr);
+            }
+            std::printf("\n");
+
+            auto start = std::chrono::high_resolution_clock::now();
+            OptimizeCache(mesh);
+            Report("cache", mesh, MillisecondsSince(start));
+
+            start = std::chrono::high_resolution_clock::now();
+            OptimizeOverdraw(mesh.indices.data(), true, mesh.IndexCount(), mesh.Positions(), 12, mesh.VertexCount());
+            Report("overdraw", mesh, MillisecondsSince(start));
+
+            start = std::chrono::high_resolution_clock::now();
+            OptimizeFetch(mesh);
+            Report("fetch", mesh, MillisecondsSince(start));
+        }
+        return true;
+    }
+
+    // Checks the analyzers on meshes with known costs, and that the stages only ever reorder triangles (keeping their
+    // winding) and vertices, that each improves what it targets on generated meshes and that OptimizeOverdraw stays
+    // within its threshold.
+    bool Run(void)
+    {
+        Check check("MeshOptimize");
+
+        // Analyzers on meshes whose costs are known.
+        {
+            const uint16_t triangle[3] = { 0, 1, 2 };
+            const VertexCacheStats stats = AnalyzeVertexCache(triangle, false, 3, 3);
+            if (stats.verticesShaded != 3 || stats.acmr != 3.0f || stats.atvr != 1.0f)
+                check.Fail("One triangle shades %u vertices, ACMR %.3f, ATVR %.3f\n", stats.verticesShaded, stats.acmr, stats.atvr);
+
+            const uint32_t quad[6] = { 0, 1, 2, 0, 2, 3 };
+            const VertexCacheStats quadStats = AnalyzeVertexCache(quad, true, 6, 4);
+            if (quadStats.verticesShaded != 4 || quadStats.acmr != 2.0f)
+                check.Fail("A quad shades %u vertices\n", quadStats.verticesShaded);
+
+            // The same triangle again and again fills batches of kBatchTriangles, each shading it once.
+            std::vector<uint32_t> repeated(kBatchTriangles * 3 * 3);
+            for (size_t i = 0; i < repeated.size(); ++i)
+                repeated[i] = (uint32_t)(i % 3);
+            const VertexCacheStats repeatedStats = AnalyzeVertexCache(repeated.data(), true, (uint32_t)repeated.size(), 3);
+            if (repeatedStats.verticesShaded != 9)
+                check.Fail("Three batches of one triangle shade %u vertices instead of 9\n", repeatedStats.verticesShaded);
+
+            // Triangles that each use three new vertices fill a batch of 32 vertices after 10 of them.
+            std::vector<uint32_t> disjoint(33 * 3);
+            for (uint32_t i = 0; i < disjoint.size(); ++i)
+                disjoint[i] = i;
+            const VertexCacheStats disjointStats = AnalyzeVertexCache(disjoint.data(), true, (uint32_t)disjoint.size(), 99);
+            if (disjointStats.verticesShaded != 99 || disjointStats.atvr != 1.0f)
+                check.Fail("Disjoint triangles shade %u vertices instead of 99\n", disjointStats.verticesShaded);
+
+            // Vertices that each fill a cache line, used in order and then again in reverse: the second pass hits.
+            std::vector<uint32_t> fetchIndices;
+            for (uint32_t v = 0; v < kFetchCacheLines; ++v)
+                fetchIndices.push_back(v);
+            for (uint32_t v = kFetchCacheLines; v-- > 0; )
+                fetchIndices.push_back(v);
+            while (fetchIndices.size() % 3 != 0)
+                fetchIndices.push_back(fetchIndices.back());
+            const VertexFetchStats fetch = AnalyzeVertexFetch(fetchIndices.data(), true, (uint32_t)fetchIndices.size(), kFetchCacheLines, kFetchLineSize);
+            if (fetch.bytesFetched != (uint64_t)kFetchCacheLines * kFetchLineSize || fetch.overfetch != 1.0f)
+                check.Fail("Fetching %u lines twice reads %llu bytes\n", kFetchCacheLines, (unsigned long long)fetch.bytesFetched);
+
+            // Four 16 byte vertices in one line, but one more line than the cache holds between their uses.
+            std::vector<uint32_t> strided;
+            const uint32_t perLine = kFetchLineSize / 16;
+            for (uint32_t k = 0; k < perLine; ++k)
+            {
+                for (uint32_t line = 0; line <= kFetchCacheLines; ++line)
+                    strided.push_back(line * perLine + k);
+            }
+            while (strided.size() % 3 != 0)
+                strided.push_back(strided.back());
+            const VertexFetchStats stridedFetch = AnalyzeVertexFetch(strided.data(), true, (uint32_t)strided.size(), (kFetchCacheLines + 1) * perLine, 16);
+            if (stridedFetch.overfetch != (float)perLine)
+                check.Fail("Striding across %u lines overfetches %.3f times instead of %u\n", kFetchCacheLines + 1, stridedFetch.overfetch, perLine);
+
+            // Two quads facing +z, one behind the other: drawn front first, every pixel is shaded once; drawn back
+            // first, twice. No other view sees either.
+            TestMesh layers;
+            AppendGrid(layers, 1, false, 1.0f);
+            AppendGrid(layers, 1, false, 0.0f);
+            const OverdrawStats frontFirst = AnalyzeOverdraw(layers.indices.data(), true, layers.IndexCount(), layers.Positions(), 12, layers.VertexCount());
+            std::rotate(layers.indices.begin(), layers.indices.begin() + 6, layers.indices.end());
+            const OverdrawStats backFirst = AnalyzeOverdraw(layers.indices.data(), true, layers.IndexCount(), layers.Positions(), 12, layers.VertexCount());
+            const uint64_t gridPixels = (uint64_t)kOverdrawGridSize * kOverdrawGridSize;
+            if (frontFirst.pixelsCovered != gridPixels || frontFirst.overdraw != 1.0f)
+                check.Fail("Front to back quads cover %llu pixels with overdraw %.3f\n", (unsigned long long)frontFirst.pixelsCovered, frontFirst.overdraw);
+            if (backFirst.pixelsCovered != gridPixels || backFirst.overdraw != 2.0f)
+                check.Fail("Back to front quads cover %llu pixels with overdraw %.3f\n", (unsigned long long)backFirst.pixelsCovered, backFirst.overdraw);
+
+            // Reversing the winding turns both quads toward -z, from where the one drawn first is in front.
+            for (size_t t = 0; t < layers.indices.size(); t += 3)
+                std::swap(layers.indices[t + 1], layers.indices[t + 2]);
+            const OverdrawStats reversed = AnalyzeOverdraw(layers.indices.data(), true, layers.IndexCount(), layers.Positions(), 12, layers.VertexCount());
+            if (reversed.pixelsCovered != gridPixels || reversed.overdraw != 1.0f)
+                check.Fail("Reversed quads cover %llu pixels with overdraw %.3f\n", (unsigned long long)reversed.pixelsCovered, reversed.overdraw);
+        }
+
+        // The stages on generated meshes.
+        for (TestMesh& mesh : CreateTestMeshes(64))
+        {
+            // Triangles as their three corner positions, starting from the smallest corner so that rotating a
+            // triangle doesn't change it but flipping it does.
+            auto Corners = [](const TestMesh& m)
+            {
+                std::vector<std::vector<float>> triangles;
+                for (uint32_t t = 0; t < m.IndexCount() / 3; ++t)
+                {
+                    std::vector<float> corners[3];
+                    for (uint32_t k = 0; k < 3; ++k)
+                        corners[k].assign(&m.positions[m.indices[t * 3 + k] * 3], &m.positions[m.indices[t * 3 + k] * 3] + 3);
+                    const uint32_t first = (uint32_t)(std::min_element(corners, corners + 3) - corners);
+                    std::vector<float> triangle;
+                    for (uint32_t k = 0; k < 3; ++k)
+                        triangle.insert(triangle.end(), corners[(first + k) % 3].begin(), corners[(first + k) % 3].end());
+                    triangles.push_back(triangle);
+                }
+                std::sort(triangles.begin(), triangles.end());
+                return triangles;
+            };
+
+            const std::vector<std::vector<float>> original = Corners(mesh);
+            const bool isShuffled = std::strncmp(mesh.name, "shuffled", 8) == 0;
+            const VertexCacheStats input = AnalyzeVertexCache(mesh.indices.data(), true, mesh.IndexCount(), mesh.VertexCount());
+
+            OptimizeCache(mesh);
+            const VertexCacheStats cache = AnalyzeVertexCache(mesh.indices.data(), true, mesh.IndexCount(), mesh.VertexCount());
+            const OverdrawStats cacheOverdraw = AnalyzeOverdraw(mesh.indices.data(), true, mesh.IndexCount(), mesh.Positions(), 12, mesh.VertexCount());
+            if (cache.acmr > input.acmr || cache.acmr > 1.0f)
+                check.Fail("%s: OptimizeFaces leaves ACMR at %.3f (from %.3f)\n", mesh.name, cache.acmr, input.acmr);
+
+            // 16-bit indices go through the same code, and must come out the same.
+            std::vector<uint16_t> indices16(mesh.indices.begin(), mesh.indices.end());
+            OptimizeOverdraw(indices16.data(), false, mesh.IndexCount(), mesh.Positions(), 12, mesh.VertexCount());
+            OptimizeOverdraw(mesh.indices.data(), true, mesh.IndexCount(), mesh.Positions(), 12, mesh.VertexCount());
+            if (!std::equal(indices16.begin(), indices16.end(), mesh.indices.begin()))
+                check.Fail("%s: OptimizeOverdraw orders 16 and 32-bit indices differently\n", mesh.name);
+
+            const VertexCacheStats overdrawCache = AnalyzeVertexCache(mesh.indices.data(), true, mesh.IndexCount(), mesh.VertexCount());
+            const OverdrawStats overdraw = AnalyzeOverdraw(mesh.indices.data(), true, mesh.IndexCount(), mesh.Positions(), 12, mesh.VertexCount());
+            if (overdraw.overdraw > cacheOverdraw.overdraw || overdraw.pixelsCovered != cacheOverdraw.pixelsCovered)
+                check.Fail("%s: OptimizeOverdraw takes overdraw from %.3f to %.3f\n", mesh.name, cacheOverdraw.overdraw, overdraw.overdraw);
+            if (overdrawCache.acmr > cache.acmr * kOverdrawThreshold * 1.1f)
+                check.Fail("%s: OptimizeOverdraw takes ACMR from %.3f to %.3f\n", mesh.name, cache.acmr, overdrawCache.acmr);
+
+            const uint32_t vertexCount = mesh.VertexCount();
+            const VertexFetchStats overdrawFetch = AnalyzeVertexFetch(mesh.indices.data(), true, mesh.IndexCount(), mesh.VertexCount(), kVertexStride);
+            OptimizeFetch(mesh);
+            const VertexFetchStats fetch = AnalyzeVertexFetch(mesh.indices.data(), true, mesh.IndexCount(), mesh.VertexCount(), kVertexStride);
+            const VertexCacheStats fetchCache = AnalyzeVertexCache(mesh.indices.data(), true, mesh.IndexCount(), mesh.VertexCount());
+            if (mesh.VertexCount() != vertexCount)
+                check.Fail("%s: OptimizeVertexFetch keeps %u of %u vertices, all used\n", mesh.name, mesh.VertexCount(), vertexCount);
+            if (fetchCache.verticesShaded != overdrawCache.verticesShaded)
+                check.Fail("%s: OptimizeVertexFetch changes the vertices shaded\n", mesh.name);
+            // Whether it renumbers them or not, no mesh fetches more than before, and shuffled vertices, which are
+            // scattered all over the buffer, should be renumbered in the order they are first used.
+            if (fetch.overfetch > overdrawFetch.overfetch)
+                check.Fail("%s: OptimizeVertexFetch takes overfetch from %.3f to %.3f\n", mesh.name, overdrawFetch.overfetch, fetch.overfetch);
+            if (isShuffled)
+            {
+                if (fetch.overfetch >= overdrawFetch.overfetch)
+                    check.Fail("%s: OptimizeVertexFetch leaves overfetch at %.3f\n", mesh.name, fetch.overfetch);
+
+                uint32_t nextVertex = 0;
+                for (uint32_t index : mesh.indices)
+                {
+                    if (index > nextVertex)
+                    {
+                        check.Fail("%s: vertex %u is used before vertex %u\n", mesh.name, index, nextVertex);
+                        break;
+                    }
+                    nextVertex = std::max(nextVertex, index + 1);
+                }
+            }
+
+            if (Corners(mesh) != original)
+                check.Fail("%s: the optimized mesh has different triangles\n", mesh.name);
+
+            // Nested shells are where ordering pays: the outer ones should go first and hide the rest.
+            if (std::strstr(mesh.name, "shells") && overdraw.overdraw > 1.02f)
+                check.Fail("%s: OptimizeOverdraw only takes overdraw from %.3f to %.3f\n", mesh.name, cacheOverdraw.overdraw, overdraw.overdraw);
+        }
+
+        // Unused vertices are dropped, and the rest keep their order where first use fetches no less: four one byte
+        // vertices share a line either way.
+        {
+            uint16_t indices[6] = { 4, 2, 5, 5, 2, 0 };
+            std::vector<uint32_t> remap;
+            const uint32_t used = OptimizeVertexFetch(indices, false, 6, 7, 1, remap);
+            const uint16_t expected[6] = { 2, 1, 3, 3, 1, 0 };
+            std::vector<uint8_t> vertices = { 10, 11, 12, 13, 14, 15, 16 };
+            RemapVertexBuffer(vertices, 1, remap, used);
+            const std::vector<uint8_t> expectedVertices = { 10, 12, 14, 15 };
+            if (used != 4 || !std::equal(indices, indices + 6, expected) || vertices != expectedVertices ||
+                remap[1] != kUnusedVertex || remap[3] != kUnusedVertex || remap[6] != kUnusedVertex)
+                check.Fail("OptimizeVertexFetch renumbers a small list wrongly\n");
+        }
+
+        return check.Finish();
+    }
+
+    Registration s_Registration("MeshOptimize", Run);
+    Registration s_Benchmark("MeshOptimizeBenchmark", Benchmark, kBenchmark);
+}
@@ -0,0 +1,154 @@
+#include "Check.h"
+#include "../Model/MeshSimplify.h"
+#include <cmath>
+#include <random>
+#include <vector>
+
+using namespace MeshSimplify;
+using namespace Tests;
+
+namespace
+{
+    // Unnormalized face normal of triangle abc, in doubles so slivers keep their sign.
+    void Cross(const float a[3], const float b[3], const float c[3], double n[3])
+    {
+        const double e1[3] = { (double)b[0] - a[0], (double)b[1] - a[1], (double)b[2] - a[2] };
+        const double e2[3] = { (double)c[0] - a[0], (double)c[1] - a[1], (double)c[2] - a[2] };
+        n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+        n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+        n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+    }
+
+    // Simplifies generated grids and a sphere and checks that every level stays within its reported error of the
+    // original surface, keeps its borders and seams, never flips a triangle and never grows. Prints the reductions.
+    bool Run(void)
+    {
+        Check check("MeshSimplify");
+
+        std::mt19937 rng(3);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+        enum Shape { kFlatGrid, kBumpyGrid, kSeamedGrid, kSphere, kNumShapes };
+        const char* kShapeNames[] = { "flat grid", "bumpy grid", "seamed grid", "sphere" };
+
+        for (int shape = 0; shape < kNumShapes; ++shape)
+        {
+            const uint32_t n = 64;
+            std::vector<float> positions;
+            std::vector<uint32_t> indices;
+
+            // An (n+1)^2 grid over [-1, 1]^2, wrapped around a sphere for kSphere. The seamed grid splits the middle
+            // column of vertices, as a UV seam would.
+            const uint32_t columns = shape == kSeamedGrid ? n + 2 : n + 1;
+            for (uint32_t y = 0; y <= n; ++y)
+            {
+                for (uint32_t c = 0; c < columns; ++c)
+                {
+                    const uint32_t x = shape == kSeamedGrid && c > n / 2 ? c - 1 : c;
+                    const float u = 2.0f * x / n - 1.0f, v = 2.0f * y / n - 1.0f;
+                    if (shape == kSphere)
+                    {
+                        const float theta = 3.14159265f * (0.02f + 0.96f * y / n), phi = 6.28318531f * x / n;
+                        positions.push_back(std::sin(theta) * std::cos(phi));
+                        positions.push_back(std::cos(theta));
+                        positions.push_back(std::sin(theta) * std::sin(phi));
+                    }
+                    else
+                    {
+                        positions.push_back(u);
+                        positions.push_back(v);
+                        positions.push_back(shape == kBumpyGrid ? 0.05f * std::sin(5.0f * u) * std::cos(4.0f * v) + 0.002f * unit(rng) : 0.0f);
+                    }
+                }
+            }
+            for (uint32_t y = 0; y < n; ++y)
+            {
+                for (uint32_t x = 0; x < n; ++x)
+                {
+                    const uint32_t c = shape == kSeamedGrid && x >= n / 2 ? x + 1 : x;
+                    const uint32_t v = y * columns + c;
+                    const uint32_t quad[6] = { v, v + 1, v + columns + 1, v, v + columns + 1, v + columns };
+                    indices.insert(indices.end(), quad, quad + 6);
+                }
+            }
+
+            const uint32_t vertexCount = (uint32_t)positions.size() / 3;
+            Simplifier simplifier(indices.data(), (uint32_t)indices.size(), (const uint8_t*)positions.data(), 12, vertexCount);
+
+            std::vector<uint8_t> required(vertexCount, 0);
+            if (shape != kSphere)
+            {
+                for (uint32_t v = 0; v < vertexCount; ++v)
+                {
+                    const uint32_t y = v / columns, c = v % columns;
+                    const bool seam = shape == kSeamedGrid && (c == n / 2 || c == n / 2 + 1);
+                    required[v] = y == 0 || y == n || c == 0 || c == columns - 1 || seam;
+                }
+            }
+
+            uint32_t previous = (uint32_t)indices.size() / 3;
+            float previousError = 0.0f;
+            std::printf("MeshSimplify: %s, %u triangles:", kShapeNames[shape], previous);
+            for (uint32_t level = 0; level < kMaxMeshLods + 2; ++level)
+            {
+                simplifier.Simplify(previous / 2, 0.1f);
+                const std::vector<uint32_t>& lod = simplifier.GetIndices();
+                const uint32_t count = simplifier.GetTriangleCount();
+                std::printf(" %u (error %.4f)", count, simplifier.GetError());
+
+                if (count > previous || simplifier.GetError() < previousError)
+                    check.Fail("%s level %u grew\n", kShapeNames[shape], level);
+                previous = count;
+                previousError = simplifier.GetError();
+
+                std::vector<uint8_t> used(vertexCount, 0);
+                for (size_t i = 0; i < lod.size(); i += 3)
+                {
+                    const float* p[3];
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        if (lod[i + k] >= vertexCount)
+                        {
+                            check.Fail("index %u out of range\n", lod[i + k]);
+                            return check.Finish();
+                        }
+                        used[lod[i + k]] = 1;
+                        p[k] = &positions[lod[i + k] * 3];
+                    }
+
+                    double nrm[3];
+                    Cross(p[0], p[1], p[2], nrm);
+                    const float centroid[3] = { (p[0][0] + p[1][0] + p[2][0]) / 3, (p[0][1] + p[1][1] + p[2][1]) / 3, (p[0][2] + p[1][2] + p[2][2]) / 3 };
+                    if (shape == kSphere)
+                    {
+                        // Outward facing, and no further inside the sphere than the error allows for.
+                        const double facing = nrm[0] * centroid[0] + nrm[1] * centroid[1] + nrm[2] * centroid[2];
+                        const float depth = 1.0f - std::sqrt(centroid[0] * centroid[0] + centroid[1] * centroid[1] + centroid[2] * centroid[2]);
+                        if (facing <= 0.0)
+                            check.Fail("sphere level %u has an inward facing triangle\n", level);
+                        if (depth > 2.0f * simplifier.GetError() + 1e-3f)
+                            check.Fail("sphere level %u strays %.4f with error %.4f\n", level, depth, simplifier.GetError());
+                    }
+                    else if (nrm[2] < -1e-3 * std::sqrt(nrm[0] * nrm[0] + nrm[1] * nrm[1] + nrm[2] * nrm[2]))
+                    {
+                        check.Fail("%s level %u has a flipped triangle\n", kShapeNames[shape], level);
+                    }
+                }
+
+                for (uint32_t v = 0; v < vertexCount; ++v)
+                {
+                    if (required[v] && !used[v])
+                        check.Fail("%s level %u lost border or seam vertex %u\n", kShapeNames[shape], level, v);
+                }
+            }
+            std::printf("\n");
+
+            if (shape == kFlatGrid && simplifier.GetError() > 1e-5f)
+                check.Fail("flat grid reports error %f\n", simplifier.GetError());
+        }
+
+        return check.Finish();
+    }
+
+    Registration s_Registration("MeshSimplify", Run);
+}
@@ -0,0 +1,139 @@
+#include "Check.h"
+#include "../Model/Meshlet.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <random>
+#include <vector>
+
+using namespace Meshlets;
+using namespace Tests;
+
+namespace
+{
+    // Builds meshlets for generated meshes and checks that they cover every triangle once within the limits, that
+    // their spheres hold their vertices and that their cones only cull clusters which face away from the eye.
+    bool Run(void)
+    {
+        Check check("Meshlets");
+
+        std::mt19937 rng(5);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+        // Grids bent over a sphere, which give both flat-ish clusters with tight cones and clusters that wrap around
+        // and can't be culled, plus shuffled triangle soups that hit the vertex limit first.
+        const uint32_t kGridSizes[] = { 1, 7, 40, 200 };
+        for (int shape = 0; shape < 2; ++shape)
+        {
+            for (uint32_t n : kGridSizes)
+            {
+                std::vector<float> positions;
+                std::vector<uint32_t> indices;
+                if (shape == 0)
+                {
+                    for (uint32_t y = 0; y <= n; ++y)
+                    {
+                        for (uint32_t x = 0; x <= n; ++x)
+                        {
+                            const float theta = 3.14159265f * (0.05f + 0.9f * y / n);
+                            const float phi = 6.28318531f * x / n;
+                            positions.push_back(std::sin(theta) * std::cos(phi));
+                            positions.push_back(std::cos(theta));
+                            positions.push_back(std::sin(theta) * std::sin(phi));
+                        }
+                    }
+                    for (uint32_t y = 0; y < n; ++y)
+                    {
+                        for (uint32_t x = 0; x < n; ++x)
+                        {
+                            const uint32_t v = y * (n + 1) + x;
+                            const uint32_t quad[6] = { v, v + 1, v + n + 1, v + 1, v + n + 2, v + n + 1 };
+                            indices.insert(indices.end(), quad, quad + 6);
+                        }
+                    }
+                }
+                else
+                {
+                    for (uint32_t v = 0; v < n * n; ++v)
+                    {
+                        positions.push_back(unit(rng));
+                        positions.push_back(unit(rng));
+                        positions.push_back(unit(rng));
+                    }
+                    for (uint32_t t = 0; t < 2 * n * n; ++t)
+                    {
+                        for (int k = 0; k < 3; ++k)
+                            indices.push_back(rng() % (n * n));
+                    }
+                }
+
+                const uint32_t vertexCount = (uint32_t)positions.size() / 3;
+                const uint32_t indexCount = (uint32_t)indices.size();
+                const bool index32 = vertexCount > 0xFFFF;
+                std::vector<uint16_t> indices16(indices.begin(), indices.end());
+                const void* indexData = index32 ? (const void*)indices.data() : (const void*)indices16.data();
+
+                std::vector<Meshlet> meshlets;
+                Build(indexData, index32, indexCount, (const uint8_t*)positions.data(), 12, vertexCount, meshlets);
+
+                uint32_t nextIndex = 0, coned = 0;
+                for (const Meshlet& meshlet : meshlets)
+                {
+                    if (meshlet.startIndex != nextIndex)
+                        check.Fail("meshlet starts at index %u, expected %u\n", meshlet.startIndex, nextIndex);
+                    if (meshlet.triangleCount == 0 || meshlet.triangleCount > kMaxMeshletTriangles || meshlet.vertexCount > kMaxMeshletVertices)
+                        check.Fail("meshlet with %u triangles and %u vertices\n", meshlet.triangleCount, meshlet.vertexCount);
+                    nextIndex = meshlet.startIndex + meshlet.triangleCount * 3;
+
+                    std::vector<uint32_t> unique(indices.begin() + meshlet.startIndex, indices.begin() + nextIndex);
+                    std::sort(unique.begin(), unique.end());
+                    unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+                    if (unique.size() != meshlet.vertexCount)
+                        check.Fail("meshlet counts %u vertices, references %zu\n", meshlet.vertexCount, unique.size());
+
+                    for (uint32_t v : unique)
+                    {
+                        const float* p = &positions[v * 3];
+                        const float d[3] = { p[0] - meshlet.center[0], p[1] - meshlet.center[1], p[2] - meshlet.center[2] };
+                        if (d[0] * d[0] + d[1] * d[1] + d[2] * d[2] > meshlet.radius * meshlet.radius)
+                            check.Fail("vertex %u outside its meshlet's sphere\n", v);
+                    }
+
+                    if (meshlet.coneCutoff >= 1.0f)
+                        continue;
+                    ++coned;
+
+                    // Whenever the cone culls, every non-degenerate triangle must face away from the eye.
+                    for (int trial = 0; trial < 64; ++trial)
+                    {
+                        const float eye[3] = { 4.0f * unit(rng), 4.0f * unit(rng), 4.0f * unit(rng) };
+                        if (!ConeCulls(meshlet, eye))
+                            continue;
+                        for (uint32_t i = meshlet.startIndex; i < nextIndex; i += 3)
+                        {
+                            const float* a = &positions[indices[i] * 3];
+                            const float* b = &positions[indices[i + 1] * 3];
+                            const float* c = &positions[indices[i + 2] * 3];
+                            const float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+                            const float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+                            const float nrm[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+                            const float facing = nrm[0] * (eye[0] - a[0]) + nrm[1] * (eye[1] - a[1]) + nrm[2] * (eye[2] - a[2]);
+                            if (facing > 1e-5f)
+                                check.Fail("cone culls a triangle that faces the eye\n");
+                        }
+                    }
+                }
+                if (nextIndex != indexCount)
+                    check.Fail("meshlets cover %u of %u indices\n", nextIndex, indexCount);
+
+                std::printf("Meshlets: %s %u: %u triangles in %zu meshlets (%.1f triangles each), %u with cones\n",
+                    shape == 0 ? "sphere" : "soup", n, indexCount / 3, meshlets.size(),
+                    meshlets.empty() ? 0.0 : (double)indexCount / 3 / meshlets.size(), coned);
+            }
+        }
+
+        return check.Finish();
+    }
+
+    Registration s_Registration("Meshlets", Run);
+}
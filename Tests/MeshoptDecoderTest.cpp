@@ -0,0 +1,591 @@
+#include "Check.h"
+#include "../Model/MeshoptDecoder.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace MeshoptDecoder;
+using namespace Tests;
+
+namespace
+{
+    // The bitstream layout, restated here rather than shared with the decoder so that a mistake in either shows up
+    // against the other.
+    const uint8_t kVertexHeader = 0xa0;
+    const size_t kVertexBlockSizeBytes = 8192;
+    const size_t kVertexBlockMaxSize = 256;
+    const size_t kByteGroupSize = 16;
+    const size_t kTailMinSize = 32;
+    const uint8_t kIndexHeader = 0xe0;
+    const uint8_t kSequenceHeader = 0xd0;
+    const size_t kCodeAuxTableSize = 16;
+
+    typedef uint32_t VertexFifo[16];
+    typedef uint32_t EdgeFifo[16][2];
+
+    size_t GetVertexBlockSize(size_t stride)
+    {
+        size_t result = (kVertexBlockSizeBytes / stride) & ~(kByteGroupSize - 1);
+        return std::min(result, kVertexBlockMaxSize);
+    }
+
+    void PushVertexFifo(VertexFifo fifo, uint32_t v, size_t& offset, bool push = true)
+    {
+        fifo[offset] = v;
+        offset = (offset + (push ? 1 : 0)) & 15;
+    }
+
+    void PushEdgeFifo(EdgeFifo fifo, uint32_t a, uint32_t b, size_t& offset)
+    {
+        fifo[offset][0] = a;
+        fifo[offset][1] = b;
+        offset = (offset + 1) & 15;
+    }
+
+    // Reference encoders, only used to produce streams for the decoders.
+    void EncodeVByte(std::vector<uint8_t>& out, uint32_t v)
+    {
+        do
+        {
+            out.push_back((uint8_t)((v & 127) | (v > 127 ? 128 : 0)));
+            v >>= 7;
+        } while (v);
+    }
+
+    void EncodeIndex(std::vector<uint8_t>& out, uint32_t index, uint32_t last)
+    {
+        const uint32_t d = index - last;
+        EncodeVByte(out, (d << 1) ^ (uint32_t)((int32_t)d >> 31));
+    }
+
+    size_t EncodedGroupSize(const uint8_t* group, int bitsLog2)
+    {
+        if (bitsLog2 == 3)
+            return kByteGroupSize;
+
+        size_t size = 0;
+        const uint8_t escape = bitsLog2 == 0 ? 0 : (uint8_t)((1 << (1 << bitsLog2)) - 1);
+        for (size_t i = 0; i < kByteGroupSize; ++i)
+        {
+            if (bitsLog2 == 0 && group[i] != 0)
+                return SIZE_MAX;
+            size += bitsLog2 != 0 && group[i] >= escape ? 1 : 0;
+        }
+        return size + kByteGroupSize * (bitsLog2 == 0 ? 0 : 1 << bitsLog2) / 8;
+    }
+
+    void EncodeBytes(std::vector<uint8_t>& out, const uint8_t* buffer, size_t size)
+    {
+        const size_t headerOffset = out.size();
+        out.resize(out.size() + (size / kByteGroupSize + 3) / 4, 0);
+
+        for (size_t i = 0; i < size; i += kByteGroupSize)
+        {
+            int best = 3;
+            for (int bitsLog2 = 2; bitsLog2 >= 0; --bitsLog2)
+            {
+                if (EncodedGroupSize(buffer + i, bitsLog2) <= EncodedGroupSize(buffer + i, best))
+                    best = bitsLog2;
+            }
+
+            const size_t group = i / kByteGroupSize;
+            out[headerOffset + group / 4] |= (uint8_t)(best << ((group % 4) * 2));
+
+            if (best == 3)
+            {
+                out.insert(out.end(), buffer + i, buffer + i + kByteGroupSize);
+            }
+            else if (best != 0)
+            {
+                const int bits = 1 << best;
+                const uint8_t escape = (uint8_t)((1 << bits) - 1);
+                for (size_t j = 0; j < kByteGroupSize; j += 8 / bits)
+                {
+                    uint8_t packed = 0;
+                    for (size_t k = j; k < j + 8 / bits; ++k)
+                        packed = (uint8_t)((packed << bits) | std::min(buffer[i + k], escape));
+                    out.push_back(packed);
+                }
+                for (size_t k = 0; k < kByteGroupSize; ++k)
+                {
+                    if (buffer[i + k] >= escape)
+                        out.push_back(buffer[i + k]);
+                }
+            }
+        }
+    }
+
+    std::vector<uint8_t> EncodeVertexBuffer(const uint8_t* vertices, size_t count, size_t stride)
+    {
+        std::vector<uint8_t> out(1, kVertexHeader);
+
+        std::vector<uint8_t> lastVertex(vertices, vertices + stride);
+        const size_t blockSize = GetVertexBlockSize(stride);
+
+        for (size_t offset = 0; offset < count; offset += blockSize)
+        {
+            const size_t blockCount = std::min(blockSize, count - offset);
+            const size_t alignedCount = (blockCount + kByteGroupSize - 1) & ~(kByteGroupSize - 1);
+
+            for (size_t k = 0; k < stride; ++k)
+            {
+                uint8_t deltas[kVertexBlockMaxSize] = {};
+                uint8_t previous = lastVertex[k];
+                for (size_t i = 0; i < blockCount; ++i)
+                {
+                    const uint8_t v = vertices[(offset + i) * stride + k];
+                    const uint8_t delta = (uint8_t)(v - previous);
+                    deltas[i] = (uint8_t)((delta << 1) ^ (uint8_t)((int8_t)delta >> 7));
+                    previous = v;
+                }
+                EncodeBytes(out, deltas, alignedCount);
+            }
+
+            std::memcpy(lastVertex.data(), vertices + (offset + blockCount - 1) * stride, stride);
+        }
+
+        out.resize(out.size() + std::max(stride, kTailMinSize) - stride, 0);
+        out.insert(out.end(), vertices, vertices + stride);
+        return out;
+    }
+
+    int FindEdge(const EdgeFifo fifo, uint32_t a, uint32_t b, uint32_t c, size_t offset)
+    {
+        for (int i = 0; i < 16; ++i)
+        {
+            const size_t index = (offset - 1 - i) & 15;
+            if (fifo[index][0] == a && fifo[index][1] == b)
+                return (i << 2) | 0;
+            if (fifo[index][0] == b && fifo[index][1] == c)
+                return (i << 2) | 1;
+            if (fifo[index][0] == c && fifo[index][1] == a)
+                return (i << 2) | 2;
+        }
+        return -1;
+    }
+
+    int FindVertex(const VertexFifo fifo, uint32_t v, size_t offset)
+    {
+        for (int i = 0; i < 16; ++i)
+        {
+            if (fifo[(offset - 1 - i) & 15] == v)
+                return i;
+        }
+        return -1;
+    }
+
+    std::vector<uint8_t> EncodeIndexBuffer(const uint32_t* indices, size_t count, int version)
+    {
+        static const uint8_t kCodeAuxTable[kCodeAuxTableSize] =
+        {
+            0x00, 0x76, 0x87, 0x56, 0x67, 0x78, 0xa9, 0x86, 0x65, 0x89, 0x68, 0x98, 0x01, 0x69, 0x00, 0x00,
+        };
+        static const int kRotations[3][3] = { { 0, 1, 2 }, { 1, 2, 0 }, { 2, 0, 1 } };
+
+        std::vector<uint8_t> codes;
+        std::vector<uint8_t> data;
+
+        EdgeFifo edgeFifo;
+        std::memset(edgeFifo, -1, sizeof(edgeFifo));
+        VertexFifo vertexFifo;
+        std::memset(vertexFifo, -1, sizeof(vertexFifo));
+        size_t edgeFifoOffset = 0;
+        size_t vertexFifoOffset = 0;
+
+        uint32_t next = 0;
+        uint32_t last = 0;
+        const int fecMax = version >= 1 ? 13 : 15;
+
+        for (size_t i = 0; i < count; i += 3)
+        {
+            const int fer = FindEdge(edgeFifo, indices[i + 0], indices[i + 1], indices[i + 2], edgeFifoOffset);
+
+            if (fer >= 0 && (fer >> 2) < 15)
+            {
+                const int* order = kRotations[fer & 3];
+                const uint32_t a = indices[i + order[0]], b = indices[i + order[1]], c = indices[i + order[2]];
+
+                const int fe = fer >> 2;
+                const int fc = FindVertex(vertexFifo, c, vertexFifoOffset);
+                int fec = (fc >= 1 && fc < fecMax) ? fc : (c == next ? (next++, 0) : 15);
+
+                if (fec == 15 && version >= 1)
+                {
+                    if (c + 1 == last)
+                        fec = 13, last = c;
+                    if (c == last + 1)
+                        fec = 14, last = c;
+                }
+
+                codes.push_back((uint8_t)((fe << 4) | fec));
+                if (fec == 15)
+                    EncodeIndex(data, c, last), last = c;
+
+                if (fec == 0 || fec >= fecMax)
+                    PushVertexFifo(vertexFifo, c, vertexFifoOffset);
+                PushEdgeFifo(edgeFifo, c, b, edgeFifoOffset);
+                PushEdgeFifo(edgeFifo, a, c, edgeFifoOffset);
+            }
+            else
+            {
+                // Rotate the next unused index, if any, to the front
+                const int rotation = indices[i + 1] == next ? 1 : (indices[i + 2] == next ? 2 : 0);
+                const int* order = kRotations[rotation];
+                const uint32_t a = indices[i + order[0]], b = indices[i + order[1]], c = indices[i + order[2]];
+
+                const int fb = FindVertex(vertexFifo, b, vertexFifoOffset);
+                const int fc = FindVertex(vertexFifo, c, vertexFifoOffset);
+
+                const int fea = a == next ? (next++, 0) : 15;
+                const int feb = (fb >= 0 && fb < 14) ? fb + 1 : (b == next ? (next++, 0) : 15);
+                const int fec = (fc >= 0 && fc < 14) ? fc + 1 : (c == next ? (next++, 0) : 15);
+
+                const uint8_t codeAux = (uint8_t)((feb << 4) | fec);
+                int codeAuxIndex = -1;
+                for (int t = 0; t < 14 && codeAuxIndex < 0; ++t)
+                    codeAuxIndex = kCodeAuxTable[t] == codeAux ? t : -1;
+
+                if (fea == 0 && codeAuxIndex >= 0)
+                {
+                    codes.push_back((uint8_t)(0xf0 | codeAuxIndex));
+                }
+                else
+                {
+                    codes.push_back((uint8_t)(0xf0 | 14 | (fea ? 1 : 0)));
+                    data.push_back(codeAux);
+                }
+
+                if (fea == 15)
+                    EncodeIndex(data, a, last), last = a;
+                if (feb == 15)
+                    EncodeIndex(data, b, last), last = b;
+                if (fec == 15)
+                    EncodeIndex(data, c, last), last = c;
+
+                PushVertexFifo(vertexFifo, a, vertexFifoOffset);
+                PushVertexFifo(vertexFifo, b, vertexFifoOffset, feb == 0 || feb == 15);
+                PushVertexFifo(vertexFifo, c, vertexFifoOffset, fec == 0 || fec == 15);
+                PushEdgeFifo(edgeFifo, b, a, edgeFifoOffset);
+                PushEdgeFifo(edgeFifo, c, b, edgeFifoOffset);
+                PushEdgeFifo(edgeFifo, a, c, edgeFifoOffset);
+            }
+        }
+
+        std::vector<uint8_t> out(1, (uint8_t)(kIndexHeader | version));
+        out.insert(out.end(), codes.begin(), codes.end());
+        out.insert(out.end(), data.begin(), data.end());
+        out.insert(out.end(), kCodeAuxTable, kCodeAuxTable + kCodeAuxTableSize);
+        return out;
+    }
+
+    std::vector<uint8_t> EncodeIndexSequence(const uint32_t* indices, size_t count)
+    {
+        std::vector<uint8_t> out(1, (uint8_t)(kSequenceHeader | 1));
+
+        uint32_t last[2] = {};
+        uint32_t current = 0;
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            const int32_t cd = (int32_t)(indices[i] - last[current]);
+            current ^= (cd < 0 ? -cd : cd) >= 30 ? 1 : 0;
+
+            const uint32_t d = indices[i] - last[current];
+            const uint32_t v = (d << 1) ^ (uint32_t)((int32_t)d >> 31);
+            EncodeVByte(out, (v << 1) | current);
+            last[current] = indices[i];
+        }
+
+        out.resize(out.size() + 4, 0);
+        return out;
+    }
+
+    int QuantizeSnorm(float v, int bits)
+    {
+        const float scale = float((1 << (bits - 1)) - 1);
+        v = std::max(-1.0f, std::min(1.0f, v));
+        return int(v * scale + (v >= 0.0f ? 0.5f : -0.5f));
+    }
+
+    // Triangles compare equal under rotation, which the index codec is free to apply
+    std::vector<uint32_t> CanonicalTriangles(const uint32_t* indices, size_t count)
+    {
+        std::vector<uint32_t> result(indices, indices + count);
+        for (size_t i = 0; i < count; i += 3)
+        {
+            while (result[i] > result[i + 1] || result[i] > result[i + 2])
+                std::rotate(&result[i], &result[i + 1], &result[i + 3]);
+        }
+        return result;
+    }
+
+    // Encodes generated vertex and index data with the reference encoders, decodes it and checks that it round trips,
+    // that filtered normals and quaternions come back within their quantization error and that truncated streams are
+    // rejected. Prints the compression ratios.
+    bool Run(void)
+    {
+        Check check("MeshoptDecoder");
+
+        std::mt19937 rng(5);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+        // Vertex streams: smooth float positions, noisy bytes, constant data and block boundaries
+        {
+            enum Pattern { kSmooth, kNoise, kConstant, kNumPatterns };
+            const char* kPatternNames[] = { "smooth", "noise", "constant" };
+            const size_t kCounts[] = { 1, 15, 16, 257, 1000, 4099 };
+            const size_t kStrides[] = { 4, 12, 16, 32, 256 };
+
+            for (int pattern = 0; pattern < kNumPatterns; ++pattern)
+            {
+                size_t rawSize = 0;
+                size_t encodedSize = 0;
+
+                for (size_t count : kCounts)
+                {
+                    for (size_t stride : kStrides)
+                    {
+                        std::vector<uint8_t> vertices(count * stride);
+                        for (size_t i = 0; i < count; ++i)
+                        {
+                            for (size_t k = 0; k < stride; k += 4)
+                            {
+                                float f = 0.0f;
+                                if (pattern == kSmooth)
+                                    f = std::sin(0.01f * i + 0.3f * k) * 10.0f;
+                                else if (pattern == kNoise)
+                                    f = unit(rng) * 1e6f;
+                                else
+                                    f = 1.0f;
+                                std::memcpy(&vertices[i * stride + k], &f, 4);
+                            }
+                        }
+
+                        const std::vector<uint8_t> encoded = EncodeVertexBuffer(vertices.data(), count, stride);
+                        std::vector<uint8_t> decoded(count * stride + 1, 0xcd);
+
+                        if (!DecodeVertexBuffer(decoded.data(), count, stride, encoded.data(), encoded.size()) ||
+                            std::memcmp(decoded.data(), vertices.data(), vertices.size()) != 0 ||
+                            decoded.back() != 0xcd)
+                        {
+                            check.Fail("%s vertices (%zu x %zu bytes) don't round trip\n",
+                                kPatternNames[pattern], count, stride);
+                        }
+
+                        // Every truncation must be caught rather than read past the end
+                        for (size_t cut = 1; cut < encoded.size(); cut += std::max<size_t>(1, encoded.size() / 16))
+                        {
+                            std::vector<uint8_t> truncated(encoded.begin(), encoded.end() - cut);
+                            if (DecodeVertexBuffer(decoded.data(), count, stride, truncated.data(), truncated.size()))
+                                check.Fail("vertex stream cut by %zu bytes decoded\n", cut);
+                        }
+
+                        rawSize += vertices.size();
+                        encodedSize += encoded.size();
+                    }
+                }
+
+                std::printf("MeshoptDecoder: %s vertices %zu -> %zu bytes\n",
+                    kPatternNames[pattern], rawSize, encodedSize);
+            }
+        }
+
+        // Triangle lists: a grid in scan order, the same grid shuffled and a soup of unrelated triangles
+        {
+            const uint32_t kGrid = 64;
+            std::vector<uint32_t> grid;
+            for (uint32_t y = 0; y < kGrid; ++y)
+            {
+                for (uint32_t x = 0; x < kGrid; ++x)
+                {
+                    const uint32_t v = y * (kGrid + 1) + x;
+                    const uint32_t quad[6] = { v, v + kGrid + 1, v + 1, v + 1, v + kGrid + 1, v + kGrid + 2 };
+                    grid.insert(grid.end(), quad, quad + 6);
+                }
+            }
+
+            std::vector<uint32_t> shuffled = grid;
+            for (size_t i = shuffled.size() / 3 - 1; i > 0; --i)
+            {
+                const size_t j = rng() % (i + 1);
+                std::swap_ranges(&shuffled[i * 3], &shuffled[i * 3 + 3], &shuffled[j * 3]);
+            }
+
+            std::vector<uint32_t> soup(3000);
+            for (uint32_t& index : soup)
+                index = rng() % 60000;
+
+            const std::vector<uint32_t>* kLists[] = { &grid, &shuffled, &soup };
+            const char* kListNames[] = { "grid", "shuffled grid", "soup" };
+
+            for (int list = 0; list < 3; ++list)
+            {
+                const std::vector<uint32_t>& indices = *kLists[list];
+                const std::vector<uint32_t> expected = CanonicalTriangles(indices.data(), indices.size());
+
+                for (int version = 0; version <= 1; ++version)
+                {
+                    const std::vector<uint8_t> encoded = EncodeIndexBuffer(indices.data(), indices.size(), version);
+
+                    std::vector<uint32_t> decoded32(indices.size());
+                    std::vector<uint16_t> decoded16(indices.size());
+                    const bool decoded =
+                        DecodeIndexBuffer(decoded32.data(), indices.size(), 4, encoded.data(), encoded.size()) &&
+                        DecodeIndexBuffer(decoded16.data(), indices.size(), 2, encoded.data(), encoded.size());
+
+                    const std::vector<uint32_t> widened(decoded16.begin(), decoded16.end());
+                    if (!decoded || CanonicalTriangles(decoded32.data(), decoded32.size()) != expected ||
+                        CanonicalTriangles(widened.data(), widened.size()) != expected)
+                    {
+                        check.Fail("%s triangles (version %d) don't round trip\n", kListNames[list], version);
+                    }
+
+                    for (size_t cut = 1; cut < encoded.size(); cut += std::max<size_t>(1, encoded.size() / 16))
+                    {
+                        std::vector<uint8_t> truncated(encoded.begin(), encoded.end() - cut);
+                        if (DecodeIndexBuffer(decoded32.data(), indices.size(), 4, truncated.data(), truncated.size()))
+                            check.Fail("triangle stream cut by %zu bytes decoded\n", cut);
+                    }
+
+                    if (version == 1)
+                    {
+                        std::printf("MeshoptDecoder: %s triangles %zu -> %zu bytes\n",
+                            kListNames[list], indices.size() * 4, encoded.size());
+                    }
+                }
+
+                const std::vector<uint8_t> sequence = EncodeIndexSequence(indices.data(), indices.size());
+                std::vector<uint32_t> decodedSequence(indices.size());
+                if (!DecodeIndexSequence(decodedSequence.data(), indices.size(), 4, sequence.data(), sequence.size()) ||
+                    decodedSequence != indices)
+                {
+                    check.Fail("%s index sequence doesn't round trip\n", kListNames[list]);
+                }
+
+                std::vector<uint8_t> truncated(sequence.begin(), sequence.end() - 1);
+                if (DecodeIndexSequence(decodedSequence.data(), indices.size(), 4, truncated.data(), truncated.size()))
+                    check.Fail("truncated %s index sequence decoded\n", kListNames[list]);
+            }
+        }
+
+        // Filters: random unit normals and quaternions must come back within the precision they were stored at
+        {
+            const size_t kCount = 4096;
+
+            for (int bits = 8; bits <= 16; bits += 8)
+            {
+                std::vector<int8_t> normals8(kCount * 4);
+                std::vector<int16_t> normals16(kCount * 4);
+                std::vector<float> expected(kCount * 3);
+
+                for (size_t i = 0; i < kCount; ++i)
+                {
+                    float n[3] = { unit(rng), unit(rng), unit(rng) };
+                    const float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                    for (int k = 0; k < 3; ++k)
+                        n[k] = length > 1e-3f ? n[k] / length : (k == 2 ? 1.0f : 0.0f);
+                    std::memcpy(&expected[i * 3], n, sizeof(n));
+
+                    const float l1 = std::fabs(n[0]) + std::fabs(n[1]) + std::fabs(n[2]);
+                    const float nx = n[0] / l1;
+                    const float ny = n[1] / l1;
+                    const float u = n[2] >= 0.0f ? nx : (1.0f - std::fabs(ny)) * (nx >= 0.0f ? 1.0f : -1.0f);
+                    const float v = n[2] >= 0.0f ? ny : (1.0f - std::fabs(nx)) * (ny >= 0.0f ? 1.0f : -1.0f);
+
+                    const int encoded[4] = { QuantizeSnorm(u, bits), QuantizeSnorm(v, bits), QuantizeSnorm(1.0f, bits), 7 };
+                    for (int k = 0; k < 4; ++k)
+                    {
+                        normals8[i * 4 + k] = (int8_t)encoded[k];
+                        normals16[i * 4 + k] = (int16_t)encoded[k];
+                    }
+                }
+
+                const bool byteNormals = bits == 8;
+                DecodeFilterOctahedral(byteNormals ? (void*)normals8.data() : (void*)normals16.data(), kCount,
+                    byteNormals ? 4 : 8);
+
+                const float scale = byteNormals ? 127.0f : 32767.0f;
+                const float tolerance = byteNormals ? 0.03f : 0.0005f;
+                float worst = 0.0f;
+                for (size_t i = 0; i < kCount; ++i)
+                {
+                    float dot = 0.0f;
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        const float decoded = (byteNormals ? normals8[i * 4 + k] : normals16[i * 4 + k]) / scale;
+                        dot += decoded * expected[i * 3 + k];
+                    }
+                    worst = std::max(worst, 1.0f - dot);
+
+                    if ((byteNormals ? normals8[i * 4 + 3] : normals16[i * 4 + 3]) != 7)
+                        check.Fail("octahedral filter changed the fourth component\n");
+                }
+                if (worst > tolerance)
+                    check.Fail("%d-bit octahedral normals off by %f\n", bits, worst);
+            }
+
+            for (int bits = 12; bits <= 16; bits += 4)
+            {
+                std::vector<int16_t> quaternions(kCount * 4);
+                std::vector<float> expected(kCount * 4);
+
+                for (size_t i = 0; i < kCount; ++i)
+                {
+                    float q[4] = { unit(rng), unit(rng), unit(rng), unit(rng) };
+                    const float length = std::sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+                    for (int k = 0; k < 4; ++k)
+                        q[k] = length > 1e-3f ? q[k] / length : (k == 3 ? 1.0f : 0.0f);
+                    std::memcpy(&expected[i * 4], q, sizeof(q));
+
+                    int qc = 0;
+                    for (int k = 1; k < 4; ++k)
+                        qc = std::fabs(q[k]) > std::fabs(q[qc]) ? k : qc;
+                    const float sign = q[qc] < 0.0f ? -1.0f : 1.0f;
+
+                    for (int k = 0; k < 3; ++k)
+                        quaternions[i * 4 + k] = (int16_t)QuantizeSnorm(q[(qc + 1 + k) & 3] * std::sqrt(2.0f) * sign, bits);
+                    quaternions[i * 4 + 3] = (int16_t)((QuantizeSnorm(1.0f, bits) & ~3) | qc);
+                }
+
+                DecodeFilterQuaternion(quaternions.data(), kCount, 8);
+
+                float worst = 0.0f;
+                for (size_t i = 0; i < kCount; ++i)
+                {
+                    float dot = 0.0f;
+                    for (int k = 0; k < 4; ++k)
+                        dot += quaternions[i * 4 + k] / 32767.0f * expected[i * 4 + k];
+                    worst = std::max(worst, 1.0f - std::fabs(dot));
+                }
+                if (worst > (bits == 12 ? 0.0005f : 0.00005f))
+                    check.Fail("%d-bit quaternions off by %f\n", bits, worst);
+            }
+
+            std::vector<uint32_t> exponential(kCount);
+            std::vector<float> expected(kCount);
+            for (size_t i = 0; i < kCount; ++i)
+            {
+                const float f = std::ldexp(unit(rng), (int)(rng() % 40) - 20);
+                int exponent = 0;
+                std::frexp(f, &exponent);
+                exponent -= 15;
+                int mantissa = (int)std::lround(std::ldexp(f, -exponent));
+                if (std::abs(mantissa) >= (1 << 15))
+                    mantissa /= 2, exponent += 1;
+
+                expected[i] = std::ldexp((float)mantissa, exponent);
+                exponential[i] = ((uint32_t)exponent << 24) | ((uint32_t)mantissa & 0xffffff);
+            }
+
+            DecodeFilterExponential(exponential.data(), kCount, 4);
+            if (std::memcmp(exponential.data(), expected.data(), kCount * 4) != 0)
+                check.Fail("exponential filter mismatch\n");
+        }
+
+        return check.Finish();
+    }
+
+    Registration s_Registration("MeshoptDecoder", Run);
+}
@@ -0,0 +1,306 @@
+#include "Check.h"
+#include "../Model/ModelBuildGraph.h"
+#include "../Model/glTF.h"
+#include <vector>
+
+using namespace ModelBuildGraph;
+using namespace Tests;
+
+namespace
+{
+    enum TestEdit
+    {
+        kNoEdit,
+        kStridedPositions,
+        kBaseColorFactor,
+        kImagePath,
+        kSamplerWrap,
+        kAlphaTest,
+        kVertexPosition,
+        kIndexOrder,
+        kNodeTranslation,
+        kChildOrder,
+        kInverseBindMatrix,
+        kKeyFrameValue,
+        kKeyFrameTime,
+        kInterpolation,
+        kQuantizeOption,
+        kCompressTexturesOption,
+        kCompressFileOption,
+        kNumTestEdits
+    };
+
+    const char* kTestEditNames[] =
+    {
+        "no edit", "strided positions", "base color factor", "image path", "sampler wrap", "alpha test",
+        "vertex position", "index order", "node translation", "child order", "inverse bind matrix",
+        "key frame value", "key frame time", "interpolation", "quantize option", "compress textures option",
+        "compress file option"
+    };
+
+    const uint32_t kGeometry = 1u << kGeometryStage;
+    const uint32_t kMaterial = 1u << kMaterialStage;
+    const uint32_t kAnimation = 1u << kAnimationStage;
+
+    const uint32_t kExpectedDirtyStages[] =
+    {
+        0, 0, kMaterial, kMaterial, kMaterial, kGeometry | kMaterial, kGeometry, kGeometry, kGeometry,
+        kGeometry | kAnimation, kGeometry, kAnimation, kAnimation, kAnimation, kGeometry, kMaterial, 0
+    };
+
+    static_assert(sizeof(kTestEditNames) / sizeof(kTestEditNames[0]) == kNumTestEdits &&
+        sizeof(kExpectedDirtyStages) / sizeof(kExpectedDirtyStages[0]) == kNumTestEdits,
+        "Every edit needs a name and an expectation");
+
+    // A skinned triangle under a root node with an animated joint beside it, and one textured material.
+    void BuildTestAsset(glTF::Asset& asset, BuildOptions& options, TestEdit edit)
+    {
+        options = BuildOptions();
+        options.quantizePositions = edit == kQuantizeOption;
+        options.compressTextures = edit == kCompressTexturesOption;
+        options.compressFile = edit == kCompressFileOption;
+
+        float positions[3][3] = { { 0, 0, 0 }, { 1, 0, 0 }, { 0, 1, 0 } };
+        if (edit == kVertexPosition)
+            positions[2][1] = 2.0f;
+        const uint16_t indices[3] = { 0, (uint16_t)(edit == kIndexOrder ? 2 : 1), (uint16_t)(edit == kIndexOrder ? 1 : 2) };
+        const float times[2] = { 0.0f, edit == kKeyFrameTime ? 2.0f : 1.0f };
+        const float values[6] = { 0, 0, 0, 1, edit == kKeyFrameValue ? 5.0f : 2.0f, 3 };
+        float ibm[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+        if (edit == kInverseBindMatrix)
+            ibm[12] = 1.0f;
+
+        // Laid out back to back, except that strided positions are padded with bytes that must not matter.
+        std::shared_ptr<std::vector<byte>> buffer = std::make_shared<std::vector<byte>>();
+        auto Append = [&](const void* data, size_t size)
+        {
+            const size_t offset = buffer->size();
+            buffer->insert(buffer->end(), (const byte*)data, (const byte*)data + size);
+            return offset;
+        };
+        const uint32_t positionStride = edit == kStridedPositions ? 16 : 12;
+        const uint32_t padding = 0xCDCDCDCD;
+        size_t positionOffset = buffer->size();
+        for (const float* position : positions)
+        {
+            Append(position, 12);
+            if (positionStride > 12)
+                Append(&padding, positionStride - 12);
+        }
+        const size_t offsets[] = { positionOffset, Append(indices, sizeof(indices)), Append(times, sizeof(times)),
+            Append(values, sizeof(values)), Append(ibm, sizeof(ibm)) };
+        asset.m_buffers.push_back(std::make_shared<glTF::Buffer>(std::move(*buffer)));
+        byte* bufferData = asset.m_buffers.back()->data();
+
+        struct { uint16_t componentType, type; uint32_t count, stride; } accessorDescs[] =
+        {
+            { glTF::Accessor::kFloat, glTF::Accessor::kVec3, 3, positionStride },
+            { glTF::Accessor::kUnsignedShort, glTF::Accessor::kScalar, 3, 2 },
+            { glTF::Accessor::kFloat, glTF::Accessor::kScalar, 2, 4 },
+            { glTF::Accessor::kFloat, glTF::Accessor::kVec3, 2, 12 },
+            { glTF::Accessor::kFloat, glTF::Accessor::kMat4, 1, 64 },
+        };
+        asset.m_accessors.resize(sizeof(accessorDescs) / sizeof(accessorDescs[0]));
+        for (size_t i = 0; i < asset.m_accessors.size(); ++i)
+        {
+            glTF::Accessor& accessor = asset.m_accessors[i];
+            std::memset(&accessor, 0, sizeof(accessor));
+            accessor.dataPtr = bufferData + offsets[i];
+            accessor.componentType = accessorDescs[i].componentType;
+            accessor.type = accessorDescs[i].type;
+            accessor.count = accessorDescs[i].count;
+            accessor.stride = accessorDescs[i].stride;
+        }
+
+        asset.m_images.resize(1);
+        asset.m_images[0].path = edit == kImagePath ? "albedo2.png" : "albedo.png";
+
+        asset.m_samplers.resize(1);
+        asset.m_samplers[0].filter = D3D12_FILTER_ANISOTROPIC;
+        asset.m_samplers[0].wrapS = edit == kSamplerWrap ? D3D12_TEXTURE_ADDRESS_MODE_CLAMP : D3D12_TEXTURE_ADDRESS_MODE_WRAP;
+        asset.m_samplers[0].wrapT = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
+
+        asset.m_textures.resize(1);
+        asset.m_textures[0].source = &asset.m_images[0];
+        asset.m_textures[0].sampler = &asset.m_samplers[0];
+
+        asset.m_materials.resize(1);
+        glTF::Material& material = asset.m_materials[0];
+        std::memset(&material, 0, sizeof(material));
+        for (float& f : material.baseColorFactor)
+            f = 1.0f;
+        if (edit == kBaseColorFactor)
+            material.baseColorFactor[0] = 0.5f;
+        material.metallicFactor = 1.0f;
+        material.roughnessFactor = 1.0f;
+        material.normalTextureScale = 1.0f;
+        material.alphaTest = edit == kAlphaTest ? 1 : 0;
+        material.textures[glTF::Material::kBaseColor] = &asset.m_textures[0];
+
+        asset.m_meshes.resize(1);
+        asset.m_meshes[0].skin = 0;
+        asset.m_meshes[0].primitives.resize(1);
+        glTF::Primitive& prim = asset.m_meshes[0].primitives[0];
+        std::memset(&prim, 0, sizeof(prim));
+        prim.attributes[glTF::Primitive::kPosition] = &asset.m_accessors[0];
+        prim.indices = &asset.m_accessors[1];
+        prim.material = &material;
+        prim.attribMask = 1 << glTF::Primitive::kPosition;
+        prim.mode = 4;
+        prim.maxPos[0] = prim.maxPos[1] = 1.0f;
+        prim.maxIndex = 2;
+
+        asset.m_nodes.resize(3);
+        for (glTF::Node& node : asset.m_nodes)
+        {
+            node.flags = 0;
+            node.mesh = nullptr;
+            std::memset(node.matrix, 0, sizeof(node.matrix));
+            node.scale[0] = node.scale[1] = node.scale[2] = 1.0f;
+            node.rotation[3] = 1.0f;
+            node.linearIdx = -1;
+        }
+        asset.m_nodes[0].children.push_back(&asset.m_nodes[edit == kChildOrder ? 2 : 1]);
+        asset.m_nodes[0].children.push_back(&asset.m_nodes[edit == kChildOrder ? 1 : 2]);
+        asset.m_nodes[1].mesh = &asset.m_meshes[0];
+        if (edit == kNodeTranslation)
+            asset.m_nodes[1].translation[0] = 1.0f;
+        asset.m_nodes[2].skeletonRoot = true;
+
+        asset.m_skins.resize(1);
+        asset.m_skins[0].inverseBindMatrices = &asset.m_accessors[4];
+        asset.m_skins[0].skeleton = &asset.m_nodes[2];
+        asset.m_skins[0].joints.push_back(&asset.m_nodes[2]);
+
+        asset.m_scenes.resize(1);
+        asset.m_scenes[0].nodes.push_back(&asset.m_nodes[0]);
+        asset.m_scene = &asset.m_scenes[0];
+
+        asset.m_animations.resize(1);
+        glTF::Animation& anim = asset.m_animations[0];
+        anim.m_samplers.resize(1);
+        anim.m_samplers[0].m_input = &asset.m_accessors[2];
+        anim.m_samplers[0].m_output = &asset.m_accessors[3];
+        anim.m_samplers[0].m_interpolation = edit == kInterpolation ? glTF::AnimSampler::kStep : glTF::AnimSampler::kLinear;
+        anim.m_channels.resize(1);
+        anim.m_channels[0].m_sampler = &anim.m_samplers[0];
+        anim.m_channels[0].m_target = &asset.m_nodes[2];
+        anim.m_channels[0].m_path = glTF::AnimChannel::kTranslation;
+    }
+
+    // Builds small assets in memory and checks that each kind of edit changes the keys of exactly the stages that read
+    // what was edited, that keys don't depend on where the asset lives in memory and that manifests round trip and
+    // reject truncation.
+    bool Run(void)
+    {
+        Check check("ModelBuildGraph");
+
+        // Stage keys
+        {
+            glTF::Asset reference;
+            BuildOptions referenceOptions;
+            BuildTestAsset(reference, referenceOptions, kNoEdit);
+            uint64_t referenceKeys[kNumStages];
+            ComputeStageKeys(reference, referenceOptions, referenceKeys, 1);
+
+            uint64_t threadedKeys[kNumStages];
+            ComputeStageKeys(reference, referenceOptions, threadedKeys, 4);
+            if (GetDirtyStages(referenceKeys, threadedKeys) != 0)
+                check.Fail("keys depend on the thread count\n");
+
+            for (uint32_t stage = 0; stage < kNumStages; ++stage)
+            {
+                for (uint32_t other = 0; other < stage; ++other)
+                {
+                    if (referenceKeys[stage] == referenceKeys[other])
+                        check.Fail("stages %u and %u share a key\n", other, stage);
+                }
+            }
+
+            // Each edit is built into an asset of its own, at different addresses from the reference.
+            for (int edit = 0; edit < kNumTestEdits; ++edit)
+            {
+                glTF::Asset asset;
+                BuildOptions options;
+                BuildTestAsset(asset, options, (TestEdit)edit);
+                uint64_t keys[kNumStages];
+                ComputeStageKeys(asset, options, keys, 2);
+
+                const uint32_t dirty = GetDirtyStages(referenceKeys, keys);
+                if (dirty != kExpectedDirtyStages[edit])
+                    check.Fail("%s: dirty stages 0x%x, expected 0x%x\n", kTestEditNames[edit], dirty, kExpectedDirtyStages[edit]);
+            }
+
+            // A scene that doesn't exist keys differently from the one that does
+            BuildOptions missingScene = referenceOptions;
+            missingScene.sceneIdx = 1;
+            uint64_t missingKeys[kNumStages];
+            ComputeStageKeys(reference, missingScene, missingKeys, 1);
+            if (GetDirtyStages(referenceKeys, missingKeys) != kAllStages)
+                check.Fail("a missing scene didn't change every key\n");
+        }
+
+        // Manifests
+        {
+            Manifest manifest;
+            manifest.miniVersion = 18;
+            manifest.miniSize = 0x123456789ull;
+            manifest.miniModifiedTime = 1700000000;
+            manifest.options.sceneIdx = 2;
+            manifest.options.quantizePositions = true;
+            manifest.options.compressFile = true;
+            manifest.stageKeys[kGeometryStage] = 0x0123456789ABCDEFull;
+            manifest.stageKeys[kMaterialStage] = 0xFEDCBA9876543210ull;
+            manifest.stageKeys[kAnimationStage] = 7;
+            SourceFile model = { L"Models/Scene/Scene.gltf", 4096, 1700000001, 0xAAAAull };
+            SourceFile buffer = { L"Models/Scene/G\u00e9om\u00e9trie.bin", 0, -1, 0xBBBBull };
+            manifest.sources.push_back(model);
+            manifest.sources.push_back(buffer);
+
+            const std::vector<uint8_t> data = SerializeManifest(manifest);
+            Manifest parsed;
+            if (!ParseManifest(data.data(), data.size(), parsed))
+            {
+                check.Fail("manifest didn't parse\n");
+            }
+            else
+            {
+                bool same = parsed.miniVersion == manifest.miniVersion && parsed.miniSize == manifest.miniSize &&
+                    parsed.miniModifiedTime == manifest.miniModifiedTime &&
+                    parsed.options.sceneIdx == manifest.options.sceneIdx &&
+                    parsed.options.quantizePositions == manifest.options.quantizePositions &&
+                    parsed.options.compressTextures == manifest.options.compressTextures &&
+                    parsed.options.compressFile == manifest.options.compressFile &&
+                    GetDirtyStages(parsed.stageKeys, manifest.stageKeys) == 0 &&
+                    parsed.sources.size() == manifest.sources.size();
+                for (size_t i = 0; same && i < parsed.sources.size(); ++i)
+                {
+                    same = parsed.sources[i].path == manifest.sources[i].path && parsed.sources[i].size == manifest.sources[i].size &&
+                        parsed.sources[i].modifiedTime == manifest.sources[i].modifiedTime && parsed.sources[i].hash == manifest.sources[i].hash;
+                }
+                if (!same)
+                    check.Fail("manifest didn't round trip\n");
+            }
+
+            for (size_t size = 0; size < data.size(); ++size)
+            {
+                if (ParseManifest(data.data(), size, parsed))
+                    check.Fail("manifest truncated to %zu bytes parsed\n", size);
+            }
+
+            std::vector<uint8_t> extended = data;
+            extended.push_back(0);
+            if (ParseManifest(extended.data(), extended.size(), parsed))
+                check.Fail("manifest with trailing bytes parsed\n");
+
+            std::vector<uint8_t> renamed = data;
+            renamed[0] = 'X';
+            if (ParseManifest(renamed.data(), renamed.size(), parsed))
+                check.Fail("manifest with the wrong id parsed\n");
+        }
+
+        return check.Finish();
+    }
+
+    Registration s_Registration("ModelBuildGraph", Run);
+}
@@ -0,0 +1,84 @@
+#include "Check.h"
+#include "../Core/SDFGIAtlas.h"
+#include <cmath>
+#include <vector>
+
+using namespace SDFGIAtlas;
+using namespace Tests;
+
+namespace
+{
+    // Octahedral coordinates just outside [-1, 1]^2 name the same direction as their reflection across the nearest
+    // edge, negated along that edge.
+    float2 FoldIntoOctahedron(float2 o)
+    {
+        if (std::abs(o.x) > 1.0f)
+            o = float2(SDFGISignNotZero(o.x) * 2.0f - o.x, -o.y);
+        if (std::abs(o.y) > 1.0f)
+            o = float2(-o.x, SDFGISignNotZero(o.y) * 2.0f - o.y);
+        return o;
+    }
+
+    // Exhaustively checks a block: every texel center decodes to a direction that encodes back into the same texel,
+    // the batch paths match the scalar ones, and every border texel copies from inside the block.
+    bool Run(void)
+    {
+        const uint blockResolution = SDFGI_ATLAS_BLOCK_RESOLUTION;
+        Check check("SDFGIAtlas");
+
+        // Sub-texel positions tested per texel along each axis; kept off the texel edges so rounding can't cross them.
+        const int kSubSamples = 16;
+
+        // Round trip of every sub-texel position, collected for the batch comparison below.
+        std::vector<float> u, v;
+        for (int ty = 0; ty < (int)blockResolution; ++ty)
+        {
+            for (int tx = 0; tx < (int)blockResolution; ++tx)
+            {
+                for (int sy = 0; sy < kSubSamples; ++sy)
+                {
+                    for (int sx = 0; sx < kSubSamples; ++sx)
+                    {
+                        const float2 position(tx + (sx + 0.5f) / kSubSamples, ty + (sy + 0.5f) / kSubSamples);
+                        const float2 o = SDFGIBlockToOct(position, blockResolution);
+                        const float2 back = SDFGIOctToBlock(SDFGIOctEncode(SDFGIOctDecode(o)), blockResolution);
+                        if ((int)back.x != tx || (int)back.y != ty || std::abs(back.x - position.x) > 1e-3f || std::abs(back.y - position.y) > 1e-3f)
+                            check.Fail("texel (%d, %d) at (%f, %f) round-trips to (%f, %f)\n", tx, ty, position.x, position.y, back.x, back.y);
+                        u.push_back(o.x);
+                        v.push_back(o.y);
+                    }
+                }
+            }
+        }
+
+        // Batch paths against the scalar ones, including a tail that doesn't fill a vector.
+        const size_t count = u.size() + 3;
+        u.resize(count, 0.25f);
+        v.resize(count, -0.5f);
+        std::vector<float> x(count), y(count), z(count), u2(count), v2(count);
+        OctDecodeBatch(u.data(), v.data(), x.data(), y.data(), z.data(), count);
+        OctEncodeBatch(x.data(), y.data(), z.data(), u2.data(), v2.data(), count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            const float3 d = SDFGIOctDecode(float2(u[i], v[i]));
+            const float2 o = SDFGIOctEncode(d);
+            if (d.x != x[i] || d.y != y[i] || d.z != z[i] || o.x != u2[i] || o.y != v2[i])
+                check.Fail("batch result %zu differs from scalar\n", i);
+        }
+
+        // Every border texel must copy the texel its own (out of range) center folds back into.
+        for (uint i = 0; i < SDFGI_ATLAS_BORDER_TEXELS(blockResolution); ++i)
+        {
+            const int2 border = SDFGIBorderTexel(i, blockResolution);
+            const int2 source = SDFGIBorderSource(border, blockResolution);
+            const float2 folded = SDFGIOctToBlock(FoldIntoOctahedron(
+                SDFGIBlockToOct(float2(border.x + 0.5f, border.y + 0.5f), blockResolution)), blockResolution);
+            if ((int)folded.x != source.x || (int)folded.y != source.y)
+                check.Fail("border texel (%d, %d) copies (%d, %d), expected (%d, %d)\n", border.x, border.y, source.x, source.y, (int)folded.x, (int)folded.y);
+        }
+
+        return check.Finish("%ux%u block, %zu directions", blockResolution, blockResolution, count);
+    }
+
+    Registration s_Registration("SDFGIAtlas", Run);
+}
@@ -0,0 +1,178 @@
+#include "Check.h"
+#include "../Core/SDFGIProbeScheduler.h"
+#include <algorithm>
+#include <random>
+
+using namespace SDFGIProbeScheduler;
+using namespace Tests;
+
+namespace
+{
+    // Simulates many frames over several grids and checks that every probe is dispatched exactly once per sweep,
+    // invalidated tiles are picked up on the next frame and no group falls outside the grid, and that a small moving
+    // box only adds the tiles around it. Prints the per-frame group counts against the full-grid dispatches they
+    // replace.
+    bool Run(void)
+    {
+        Check check("SDFGIProbeScheduler");
+
+        const uint32_t kGrids[][3] = { { 40, 9, 12 }, { 17, 1, 6 }, { 3, 3, 3 }, { 1, 1, 1 }, { 64, 16, 64 } };
+        const uint32_t kPeriods[] = { 1, 4, 7 };
+        std::mt19937 rng(11);
+
+        for (const auto& grid : kGrids)
+        {
+            const uint32_t probeCount = grid[0] * grid[1] * grid[2];
+            for (uint32_t period : kPeriods)
+            {
+                TileScheduler scheduler;
+                scheduler.Reset(grid);
+                const uint32_t tileCount = scheduler.GetTileCount();
+                std::vector<TileCommand> commands;
+
+                // Every tile starts invalidated, so the first frame covers the whole grid.
+                if (scheduler.BuildFrame(period, commands) != probeCount)
+                    check.Fail("%ux%ux%u, first frame doesn't cover the grid\n", grid[0], grid[1], grid[2]);
+
+                // Then two full sweeps, checking that each frame touches every probe at most once and never leaves
+                // the grid, and that every probe is touched once per sweep.
+                const uint32_t sweepFrames = period;
+                std::vector<uint32_t> updates(probeCount, 0);
+                uint64_t sweepGroups = 0;
+                uint32_t maxFrameGroups = 0;
+                for (uint32_t frame = 0; frame < 2 * sweepFrames; ++frame)
+                {
+                    const uint32_t groups = scheduler.BuildFrame(period, commands);
+                    sweepGroups += groups;
+                    maxFrameGroups = std::max(maxFrameGroups, groups);
+
+                    std::vector<uint8_t> touched(probeCount, 0);
+                    uint32_t counted = 0;
+                    for (const TileCommand& command : commands)
+                    {
+                        for (uint32_t z = 0; z < command.groupCount[2]; ++z)
+                            for (uint32_t y = 0; y < command.groupCount[1]; ++y)
+                                for (uint32_t x = 0; x < command.groupCount[0]; ++x)
+                                {
+                                    const uint32_t p[3] = { command.tileOrigin[0] + x, command.tileOrigin[1] + y, command.tileOrigin[2] + z };
+                                    ++counted;
+                                    if (p[0] >= grid[0] || p[1] >= grid[1] || p[2] >= grid[2])
+                                    {
+                                        check.Fail("group for probe (%u, %u, %u) outside the grid\n", p[0], p[1], p[2]);
+                                        continue;
+                                    }
+                                    const uint32_t index = (p[2] * grid[1] + p[1]) * grid[0] + p[0];
+                                    if (touched[index]++)
+                                        check.Fail("probe %u dispatched twice in one frame\n", index);
+                                    ++updates[index];
+                                }
+                    }
+                    if (counted != groups)
+                        check.Fail("frame reports %u groups, commands hold %u\n", groups, counted);
+                }
+
+                // Rounding the share up lets the sweep run ahead, but never by a whole pass more for some tiles than
+                // for others.
+                const uint32_t sweptTiles = 2 * sweepFrames * ((tileCount + period - 1) / period);
+                for (uint32_t i = 0; i < probeCount; ++i)
+                {
+                    if (updates[i] < 2 || updates[i] < sweptTiles / tileCount || updates[i] > (sweptTiles + tileCount - 1) / tileCount)
+                        check.Fail("%ux%ux%u period %u, probe %u updated %u times in two sweeps\n",
+                            grid[0], grid[1], grid[2], period, i, updates[i]);
+                }
+
+                // Invalidated probes are picked up on the very next frame, on top of the sweep's share.
+                for (int trial = 0; trial < 16; ++trial)
+                {
+                    uint32_t probeMin[3], probeMax[3];
+                    for (int axis = 0; axis < 3; ++axis)
+                    {
+                        probeMin[axis] = rng() % grid[axis];
+                        probeMax[axis] = probeMin[axis] + rng() % 6;
+                    }
+                    scheduler.Invalidate(probeMin, probeMax);
+                    scheduler.BuildFrame(period, commands);
+
+                    for (uint32_t z = probeMin[2]; z <= std::min(probeMax[2], grid[2] - 1); ++z)
+                        for (uint32_t y = probeMin[1]; y <= std::min(probeMax[1], grid[1] - 1); ++y)
+                            for (uint32_t x = probeMin[0]; x <= std::min(probeMax[0], grid[0] - 1); ++x)
+                            {
+                                const bool found = std::any_of(commands.begin(), commands.end(), [&](const TileCommand& c)
+                                {
+                                    return x - c.tileOrigin[0] < c.groupCount[0] && y - c.tileOrigin[1] < c.groupCount[1] && z - c.tileOrigin[2] < c.groupCount[2];
+                                });
+                                if (!found)
+                                    check.Fail("invalidated probe (%u, %u, %u) not updated\n", x, y, z);
+                            }
+                }
+
+                // Once handled, invalidations don't linger.
+                scheduler.BuildFrame(period, commands);
+                if (commands.size() != (tileCount + period - 1) / period)
+                    check.Fail("%zu tiles after invalidations were handled, expected %u\n", commands.size(), (tileCount + period - 1) / period);
+
+                // The full-grid path ran the update and the border pass over every probe every updatePeriod frames.
+                std::printf("SDFGIProbeScheduler: %ux%ux%u, period %u: %u tiles, %.0f groups/frame (peak %u) vs %u every %u frames\n",
+                    grid[0], grid[1], grid[2], period, tileCount, (double)sweepGroups / (2 * sweepFrames), maxFrameGroups, 2 * probeCount, period);
+            }
+        }
+
+        // A small box moving through a 64x16x64 grid, as an animated mesh does, only adds the few tiles around
+        // where it was and where it is to each frame.
+        {
+            const uint32_t grid[3] = { 64, 16, 64 };
+            const float gridMin[3] = { -320.0f, -80.0f, -320.0f };
+            const float spacing[3] = { 10.0f, 10.0f, 10.0f };
+            const uint32_t period = 8;
+            TileScheduler scheduler;
+            scheduler.Reset(grid);
+            const uint32_t tileCount = scheduler.GetTileCount();
+            const uint32_t sweepShare = (tileCount + period - 1) / period;
+            std::vector<TileCommand> commands;
+            scheduler.BuildFrame(period, commands);
+
+            uint32_t maxFrameTiles = 0;
+            for (uint32_t frame = 0; frame < 190; ++frame)
+            {
+                // 15 units wide, moving 3 units a frame across the grid; last frame's and this frame's boxes together.
+                const float x = -300.0f + 3.0f * frame;
+                const float boundsMin[3] = { x - 3.0f, -5.0f, 20.0f };
+                const float boundsMax[3] = { x + 15.0f, 10.0f, 35.0f };
+                uint32_t probeMin[3], probeMax[3];
+                if (!GetProbeRange(boundsMin, boundsMax, gridMin, spacing, grid, probeMin, probeMax))
+                {
+                    check.Fail("moving box, frame %u: box inside the grid has no probes\n", frame);
+                    continue;
+                }
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    if (probeMin[axis] * spacing[axis] + gridMin[axis] > boundsMin[axis] ||
+                        probeMax[axis] * spacing[axis] + gridMin[axis] < boundsMax[axis])
+                        check.Fail("moving box, frame %u: probes %u-%u don't enclose the box on axis %d\n",
+                            frame, probeMin[axis], probeMax[axis], axis);
+                }
+                scheduler.Invalidate(probeMin, probeMax);
+                scheduler.BuildFrame(period, commands);
+                maxFrameTiles = std::max(maxFrameTiles, (uint32_t)commands.size());
+            }
+
+            // The probes around a box at most 3 probes wide span 2 tiles a side.
+            if (maxFrameTiles > sweepShare + 8)
+                check.Fail("moving box: %u tiles in a frame, expected at most %u of %u\n", maxFrameTiles, sweepShare + 8,
+                    tileCount);
+
+            // Boxes outside the grid touch nothing.
+            const float farMin[3] = { 1000.0f, 0.0f, 0.0f }, farMax[3] = { 1010.0f, 1.0f, 1.0f };
+            uint32_t probeMin[3], probeMax[3];
+            if (GetProbeRange(farMin, farMax, gridMin, spacing, grid, probeMin, probeMax))
+                check.Fail("moving box: a box outside the grid has probes\n");
+
+            std::printf("SDFGIProbeScheduler: moving box, at most %u of %u tiles a frame, %u of them the sweep's\n",
+                maxFrameTiles, tileCount, sweepShare);
+        }
+
+        return check.Finish();
+    }
+
+    Registration s_Registration("SDFGIProbeScheduler", Run);
+}
@@ -0,0 +1,151 @@
+#include "Check.h"
+#include "../Core/SDFGIReprojection.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+using namespace SDFGIAtlas;
+using namespace SDFGIReprojection;
+using namespace Tests;
+
+namespace
+{
+    // Calls f(probeX, probeY, probeZ, texelX, texelY, values) for every block texel of the atlas.
+    template <typename F>
+    void ForEachBlockTexel(const GridDesc& grid, Atlas& atlas, F f)
+    {
+        for (uint pz = 0; pz < grid.count[2]; ++pz)
+            for (uint py = 0; py < grid.count[1]; ++py)
+                for (uint px = 0; px < grid.count[0]; ++px)
+                {
+                    const uint2 origin = SDFGIAtlasBlockOrigin(uint2(px, py), SDFGI_ATLAS_BLOCK_RESOLUTION, SDFGI_ATLAS_GUTTER_SIZE);
+                    for (uint ty = 0; ty < SDFGI_ATLAS_BLOCK_RESOLUTION; ++ty)
+                        for (uint tx = 0; tx < SDFGI_ATLAS_BLOCK_RESOLUTION; ++tx)
+                            f(px, py, pz, tx, ty, atlas.At(origin.x + tx, origin.y + ty, pz));
+                }
+    }
+
+    float3 ProbePosition(const GridDesc& grid, uint px, uint py, uint pz)
+    {
+        return float3(grid.minBounds.x + px * grid.spacing.x, grid.minBounds.y + py * grid.spacing.y, grid.minBounds.z + pz * grid.spacing.z);
+    }
+
+    // Differs per channel and per block texel, and is linear in the probe position, so trilinear reconstruction
+    // of it is exact up to rounding.
+    float LinearField(float3 p, uint tx, uint ty, uint c)
+    {
+        return (0.5f + c) * p.x - 0.25f * p.y + (c == 1 ? 2.0f : -1.0f) * p.z + 3.0f * tx + 5.0f * ty + c;
+    }
+
+    // Reprojects synthetic fields between scrolled, resized and respaced grids and checks the results against the
+    // analytic answer.
+    bool Run(void)
+    {
+        Check check("SDFGIReprojection");
+        const uint kChannels = 4;
+
+        const GridDesc oldGrid = { float3(-300.0f, 0.0f, 100.0f), float3(100.0f, 100.0f, 100.0f), { 6, 5, 4 } };
+
+        // A linear field resampled onto a finer, shifted grid that lies inside the old one.
+        {
+            Atlas oldAtlas = CreateAtlas(oldGrid, kChannels);
+            ForEachBlockTexel(oldGrid, oldAtlas, [&](uint px, uint py, uint pz, uint tx, uint ty, float* v)
+            {
+                for (uint c = 0; c < kChannels; ++c)
+                    v[c] = LinearField(ProbePosition(oldGrid, px, py, pz), tx, ty, c);
+            });
+
+            const GridDesc newGrid = { float3(-263.0f, 12.0f, 155.0f), float3(70.0f, 70.0f, 70.0f), { 7, 6, 4 } };
+            Atlas newAtlas = CreateAtlas(newGrid, kChannels);
+            Reproject(oldGrid, oldAtlas, newGrid, newAtlas);
+            ForEachBlockTexel(newGrid, newAtlas, [&](uint px, uint py, uint pz, uint tx, uint ty, float* v)
+            {
+                for (uint c = 0; c < kChannels; ++c)
+                {
+                    const float expected = LinearField(ProbePosition(newGrid, px, py, pz), tx, ty, c);
+                    if (std::abs(v[c] - expected) > 1e-4f * std::max(1.0f, std::abs(expected)))
+                        check.Fail("linear field at probe (%u, %u, %u) texel (%u, %u) is %f, expected %f\n", px, py, pz, tx, ty, v[c], expected);
+                }
+            });
+        }
+
+        // Scrolling by whole probes copies blocks exactly; probes that scrolled in repeat the old grid's edge.
+        {
+            std::mt19937 rng(7);
+            std::uniform_real_distribution<float> dist(0.0f, 10.0f);
+            Atlas oldAtlas = CreateAtlas(oldGrid, kChannels);
+            for (float& v : oldAtlas.texels)
+                v = dist(rng);
+
+            const int shift[3] = { 2, -1, 1 };
+            const GridDesc newGrid =
+            {
+                float3(oldGrid.minBounds.x + shift[0] * oldGrid.spacing.x, oldGrid.minBounds.y + shift[1] * oldGrid.spacing.y,
+                       oldGrid.minBounds.z + shift[2] * oldGrid.spacing.z),
+                oldGrid.spacing, { oldGrid.count[0], oldGrid.count[1], oldGrid.count[2] }
+            };
+            Atlas newAtlas = CreateAtlas(newGrid, kChannels);
+            Reproject(oldGrid, oldAtlas, newGrid, newAtlas);
+            ForEachBlockTexel(newGrid, newAtlas, [&](uint px, uint py, uint pz, uint tx, uint ty, float* v)
+            {
+                const int p[3] = { (int)px, (int)py, (int)pz };
+                uint source[3];
+                for (int a = 0; a < 3; ++a)
+                    source[a] = (uint)std::min(std::max(p[a] + shift[a], 0), (int)oldGrid.count[a] - 1);
+                const uint2 origin = SDFGIAtlasBlockOrigin(uint2(source[0], source[1]), SDFGI_ATLAS_BLOCK_RESOLUTION, SDFGI_ATLAS_GUTTER_SIZE);
+                const float* expected = oldAtlas.At(origin.x + tx, origin.y + ty, source[2]);
+                for (uint c = 0; c < kChannels; ++c)
+                {
+                    if (v[c] != expected[c])
+                        check.Fail("scrolled probe (%u, %u, %u) texel (%u, %u) is %f, expected %f\n", px, py, pz, tx, ty, v[c], expected[c]);
+                }
+            });
+        }
+
+        // A constant field stays constant across any change of grid, including a single probe along an axis and a
+        // new grid that extends past the old one.
+        {
+            Atlas oldAtlas = CreateAtlas(oldGrid, kChannels);
+            for (float& v : oldAtlas.texels)
+                v = 0.75f;
+
+            const GridDesc flatGrid = { float3(-420.0f, 230.0f, -40.0f), float3(45.0f, 1.0f, 130.0f), { 15, 1, 6 } };
+            Atlas flatAtlas = CreateAtlas(flatGrid, kChannels);
+            Reproject(oldGrid, oldAtlas, flatGrid, flatAtlas);
+
+            // And back from the single-slab grid, which only has one probe to blend along y.
+            Atlas backAtlas = CreateAtlas(oldGrid, kChannels);
+            Reproject(flatGrid, flatAtlas, oldGrid, backAtlas);
+
+            ForEachBlockTexel(oldGrid, backAtlas, [&](uint px, uint py, uint pz, uint tx, uint ty, float* v)
+            {
+                for (uint c = 0; c < kChannels; ++c)
+                {
+                    if (std::abs(v[c] - 0.75f) > 1e-5f)
+                        check.Fail("constant field at probe (%u, %u, %u) texel (%u, %u) is %f\n", px, py, pz, tx, ty, v[c]);
+                }
+            });
+
+            // The border ring of a reprojected atlas is the same copy of its block as for any other atlas.
+            FillBorders(flatGrid, flatAtlas);
+            for (uint pz = 0; pz < flatGrid.count[2]; ++pz)
+            {
+                for (uint px = 0; px < flatGrid.count[0]; ++px)
+                {
+                    const uint2 origin = SDFGIAtlasBlockOrigin(uint2(px, 0), SDFGI_ATLAS_BLOCK_RESOLUTION, SDFGI_ATLAS_GUTTER_SIZE);
+                    for (uint i = 0; i < SDFGI_ATLAS_BORDER_TEXELS(SDFGI_ATLAS_BLOCK_RESOLUTION); ++i)
+                    {
+                        const int2 border = SDFGIBorderTexel(i, SDFGI_ATLAS_BLOCK_RESOLUTION);
+                        const float* v = flatAtlas.At(origin.x + border.x, origin.y + border.y, pz);
+                        if (std::abs(v[0] - 0.75f) > 1e-5f)
+                            check.Fail("border texel (%d, %d) of probe (%u, 0, %u) is %f\n", border.x, border.y, px, pz, v[0]);
+                    }
+                }
+            }
+        }
+
+        return check.Finish();
+    }
+
+    Registration s_Registration("SDFGIReprojection", Run);
+}
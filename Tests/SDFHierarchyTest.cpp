@@ -0,0 +1,134 @@
+#include "Check.h"
+#include "../Core/SDFHierarchy.h"
+#include <cmath>
+#include <random>
+#include <vector>
+
+using namespace SDFHierarchy;
+using namespace Tests;
+
+namespace
+{
+    // Two triangles spanning the voxel centers of corners a, b, c and a + c - b.
+    void AddQuad(std::vector<float>& triangles, const float a[3], const float b[3], const float c[3])
+    {
+        const float d[3] = { a[0] + c[0] - b[0], a[1] + c[1] - b[1], a[2] + c[2] - b[2] };
+        for (const float* corner : { a, b, c, a, c, d })
+        {
+            for (int axis = 0; axis < 3; ++axis)
+                triangles.push_back(corner[axis] + 0.5f);
+        }
+    }
+
+    // The surface of the box of voxels lo..hi inclusive, which its voxelization is the shell of.
+    std::vector<float> CreateBoxMesh(const int lo[3], const int hi[3])
+    {
+        std::vector<float> triangles;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            const int u = (axis + 1) % 3, v = (axis + 2) % 3;
+            for (int side = 0; side < 2; ++side)
+            {
+                float a[3], b[3], c[3];
+                a[axis] = b[axis] = c[axis] = (float)(side == 0 ? lo[axis] : hi[axis]);
+                a[u] = (float)lo[u]; a[v] = (float)hi[v];
+                b[u] = (float)lo[u]; b[v] = (float)lo[v];
+                c[u] = (float)hi[u]; c[v] = (float)lo[v];
+                AddQuad(triangles, a, b, c);
+            }
+        }
+        return triangles;
+    }
+
+    // Checks the distance transform against brute force on voxels that triangles shrunk to points mark one at a
+    // time, and against the exact distances to a box mesh, inside and out.
+    bool Run(void)
+    {
+        Check check("SDFHierarchy");
+
+        {
+            const uint32_t resolution = 24;
+            std::mt19937 rng(5);
+            std::vector<int> points;
+            std::vector<float> triangles;
+            for (int i = 0; i < 20; ++i)
+            {
+                int p[3];
+                for (int axis = 0; axis < 3; ++axis)
+                    p[axis] = (int)(rng() % resolution);
+                points.insert(points.end(), p, p + 3);
+                for (int corner = 0; corner < 3; ++corner)
+                {
+                    for (int axis = 0; axis < 3; ++axis)
+                        triangles.push_back(p[axis] + 0.5f);
+                }
+            }
+            // Wholly outside the volume, so it must leave no mark.
+            for (int corner = 0; corner < 3; ++corner)
+                triangles.insert(triangles.end(), { -5.0f, (float)resolution + 3.0f, 10.0f });
+
+            const Volume volume = BakeVolume(triangles, resolution);
+            for (int z = 0; z < (int)resolution; ++z)
+            {
+                for (int y = 0; y < (int)resolution; ++y)
+                {
+                    for (int x = 0; x < (int)resolution; ++x)
+                    {
+                        int nearest = INT32_MAX;
+                        for (size_t i = 0; i < points.size(); i += 3)
+                        {
+                            const int dx = x - points[i], dy = y - points[i + 1], dz = z - points[i + 2];
+                            nearest = std::min(nearest, dx * dx + dy * dy + dz * dz);
+                        }
+                        const float baked = volume.Fetch(0, x, y, z);
+                        if (std::abs(baked - std::sqrt((float)nearest)) > 1e-4f)
+                            check.Fail("points: voxel (%d, %d, %d) is %g, expected %g\n", x, y, z, baked, std::sqrt((float)nearest));
+                    }
+                }
+            }
+        }
+
+        {
+            const uint32_t resolution = 32;
+            const int lo[3] = { 6, 9, 4 };
+            const int hi[3] = { 20, 15, 25 };
+            const Volume volume = BakeVolume(CreateBoxMesh(lo, hi), resolution);
+
+            for (uint32_t level = 1; level < SDF_HIERARCHY_LEVELS; ++level)
+            {
+                const uint32_t levelResolution = SDFLevelResolution(resolution, level);
+                if (volume.levels[level].size() != (size_t)levelResolution * levelResolution * levelResolution)
+                    check.Fail("box: level %u has %zu values\n", level, volume.levels[level].size());
+            }
+
+            for (int z = 0; z < (int)resolution; ++z)
+            {
+                for (int y = 0; y < (int)resolution; ++y)
+                {
+                    for (int x = 0; x < (int)resolution; ++x)
+                    {
+                        const int v[3] = { x, y, z };
+                        bool inside = true;
+                        int insideDistance = INT32_MAX;
+                        float squared = 0.0f;
+                        for (int axis = 0; axis < 3; ++axis)
+                        {
+                            inside = inside && v[axis] > lo[axis] && v[axis] < hi[axis];
+                            insideDistance = std::min(insideDistance, std::min(v[axis] - lo[axis], hi[axis] - v[axis]));
+                            const int d = std::max(std::max(lo[axis] - v[axis], v[axis] - hi[axis]), 0);
+                            squared += (float)(d * d);
+                        }
+                        const float expected = inside ? (float)insideDistance : std::sqrt(squared);
+                        const float baked = volume.Fetch(0, x, y, z);
+                        if (std::abs(baked - expected) > 1e-4f)
+                            check.Fail("box: voxel (%d, %d, %d) is %g, expected %g\n", x, y, z, baked, expected);
+                    }
+                }
+            }
+        }
+
+        return check.Finish();
+    }
+
+    Registration s_Registration("SDFHierarchy", Run);
+}
@@ -0,0 +1,146 @@
+#include "Check.h"
+#include "../Core/SDFPacketTracer.h"
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace SDFPacketTracer;
+using namespace SDFHierarchy;
+using namespace Tests;
+
+namespace
+{
+    bool SameResult(const TraceResult& a, const TraceResult& b)
+    {
+        return a.hit == b.hit && a.steps == b.steps && a.depth == b.depth &&
+            std::equal(a.voxel, a.voxel + 3, b.voxel);
+    }
+
+    // What the result slots of inactive lanes are filled with, so that writing one shows.
+    TraceResult Untouched()
+    {
+        TraceResult result;
+        result.hit = true;
+        result.depth = -1.0f;
+        result.steps = 0xDEAD;
+        std::fill(result.voxel, result.voxel + 3, -7);
+        return result;
+    }
+
+    void CheckLanes(Check& check, const char* label, SimdLevel level, const std::vector<TraceResult>& results,
+        const std::vector<TraceResult>& reference, uint32_t first, uint32_t laneMask)
+    {
+        for (uint32_t lane = 0; lane < GetPacketWidth(level) && first + lane < results.size(); ++lane)
+        {
+            const TraceResult& result = results[first + lane];
+            const bool active = (laneMask & (1u << lane)) != 0;
+            if (!SameResult(result, active ? reference[first + lane] : Untouched()))
+            {
+                check.Fail("%s, %s: ray %u (lane %u of mask 0x%x) %s\n", GetSimdLevelName(level), label, first + lane,
+                    lane, laneMask, active ? "doesn't match TraceHierarchical" : "was written");
+            }
+        }
+    }
+
+    // Traces random rays, rays that start in a surface and rays along the axes with every packet width this CPU
+    // supports, whole batches and single packets under random and single-lane masks, and checks that each result
+    // matches TraceHierarchical bit for bit and that no inactive lane is written.
+    bool Run(void)
+    {
+        Check check("SDFPacketTracer");
+
+        const Volume volume = CreateTestVolume(64);
+        const uint32_t kRandomRays = 2000;
+        std::vector<float> aos = CreateRandomRays(volume, kRandomRays, 3);
+
+        // Rays starting on the floor, which escape before they can hit anything, and rays parallel to two axes, whose
+        // cell exits are decided by the third alone.
+        std::mt19937 rng(7);
+        for (int i = 0; i < 40; ++i)
+        {
+            const float eye[3] = { 2.0f + (float)(rng() % 60), 0.5f, 2.0f + (float)(rng() % 60) };
+            const float up[3] = { 0.0f, 1.0f, 0.0f };
+            const float slanted[3] = { 0.6f, 0.0f, -0.8f };
+            aos.insert(aos.end(), eye, eye + 3);
+            aos.insert(aos.end(), up, up + 3);
+            aos.insert(aos.end(), eye, eye + 3);
+            aos.insert(aos.end(), slanted, slanted + 3);
+        }
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            for (float sign : { 1.0f, -1.0f })
+            {
+                float eye[3] = { 20.5f + (float)(rng() % 20), 20.5f + (float)(rng() % 20), 20.5f + (float)(rng() % 20) };
+                float dir[3] = { 0.0f, 0.0f, 0.0f };
+                dir[axis] = sign;
+                aos.insert(aos.end(), eye, eye + 3);
+                aos.insert(aos.end(), dir, dir + 3);
+            }
+        }
+
+        // Not a multiple of any packet width, so every batch ends in a partial packet.
+        const uint32_t rayCount = (uint32_t)(aos.size() / 6);
+        RayBatch rays;
+        rays.Resize(rayCount);
+        for (uint32_t i = 0; i < rayCount; ++i)
+            rays.Set(i, &aos[i * 6], &aos[i * 6 + 3]);
+
+        const uint32_t kShortSteps = 6;
+        std::vector<TraceResult> reference(rayCount), shortReference(rayCount);
+        uint32_t hits = 0;
+        for (uint32_t i = 0; i < rayCount; ++i)
+        {
+            reference[i] = TraceHierarchical(volume, &aos[i * 6], &aos[i * 6 + 3]);
+            shortReference[i] = TraceHierarchical(volume, &aos[i * 6], &aos[i * 6 + 3], kShortSteps);
+            hits += reference[i].hit ? 1 : 0;
+        }
+        if (hits == 0 || hits == rayCount)
+            check.Fail("%u of %u rays hit, so the test rays don't cover both outcomes\n", hits, rayCount);
+
+        const SimdLevel best = DetectSimdLevel();
+        for (int l = (int)SimdLevel::Scalar; l <= (int)best; ++l)
+        {
+            const SimdLevel level = (SimdLevel)l;
+            const uint32_t width = GetPacketWidth(level);
+            const uint32_t fullMask = (uint32_t)((1ull << width) - 1);
+
+            std::vector<TraceResult> results(rayCount, Untouched());
+            TraceRays(volume, rays, results.data(), 512, level);
+            for (uint32_t first = 0; first < rayCount; first += width)
+                CheckLanes(check, "batch", level, results, reference, first, fullMask);
+
+            std::fill(results.begin(), results.end(), Untouched());
+            TraceRays(volume, rays, results.data(), kShortSteps, level);
+            for (uint32_t first = 0; first < rayCount; first += width)
+                CheckLanes(check, "step limit", level, results, shortReference, first, fullMask);
+
+            // Random masks over every packet, clipped to the rays that exist.
+            std::fill(results.begin(), results.end(), Untouched());
+            std::vector<uint32_t> masks;
+            for (uint32_t first = 0; first < rayCount; first += width)
+            {
+                const uint32_t lanes = std::min(width, rayCount - first);
+                const uint32_t mask = (uint32_t)rng() & fullMask & (uint32_t)((1ull << lanes) - 1);
+                TracePacket(volume, rays, first, mask, &results[first], 512, level);
+                masks.push_back(mask);
+            }
+            for (uint32_t first = 0; first < rayCount; first += width)
+                CheckLanes(check, "random mask", level, results, reference, first, masks[first / width]);
+
+            // Each lane on its own, in the first packet and in the last whole one.
+            for (uint32_t first : { 0u, (rayCount / width - 1) * width })
+            {
+                for (uint32_t lane = 0; lane < width; ++lane)
+                {
+                    std::fill(results.begin(), results.end(), Untouched());
+                    TracePacket(volume, rays, first, 1u << lane, &results[first], 512, level);
+                    CheckLanes(check, "single lane", level, results, reference, first, 1u << lane);
+                }
+            }
+        }
+
+        return check.Finish("%u rays, %u hits, up to %s", rayCount, hits, GetSimdLevelName(best));
+    }
+
+    Registration s_Registration("SDFPacketTracer", Run);
+}
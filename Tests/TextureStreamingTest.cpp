@@ -0,0 +1,212 @@
+#include "Check.h"
+#include "../Core/TextureStreaming.h"
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace TextureStreaming;
+using namespace Tests;
+
+namespace
+{
+    // Streams simulated scenes through budgets of several sizes, completing requests a few frames late, and checks that
+    // the planned residency never exceeds the budget beyond the tails, tails stay resident, the largest shortfalls
+    // are served first, textures out of view are evicted for ones in view and nothing exceeds the pending limit.
+    bool Run(void)
+    {
+        Check check("TextureStreaming");
+
+        // BC7-sized mips: one byte per texel.
+        auto MipBytes = [](uint32_t size)
+        {
+            std::vector<uint64_t> bytes;
+            for (uint32_t s = size; ; s /= 2)
+            {
+                bytes.push_back(std::max(s, 4u) * (uint64_t)std::max(s, 4u));
+                if (s == 1)
+                    break;
+            }
+            return bytes;
+        };
+        auto TailMip = [](uint32_t size)
+        {
+            uint32_t mip = 0;
+            while ((size >> mip) > kMipTailSize)
+                ++mip;
+            return mip;
+        };
+
+        // Wanted mips follow the screen size.
+        {
+            Scheduler scheduler;
+            uint32_t id = scheduler.AddTexture(1024, 512, MipBytes(1024), TailMip(1024));
+            const float kPixels[] = { 5000.0f, 1024.0f, 1000.0f, 512.0f, 300.0f, 1.0f, 0.0f };
+            const uint32_t kMips[] = { 0, 0, 0, 1, 1, 3, 3 };
+            std::vector<Request> requests;
+            for (size_t i = 0; i < sizeof(kPixels) / sizeof(kPixels[0]); ++i)
+            {
+                scheduler.SetRetentionFrames(0);
+                scheduler.ReportUsage(id, kPixels[i]);
+                scheduler.Update(requests);
+                if (scheduler.GetWantedMip(id) != kMips[i])
+                    check.Fail("%.0f pixels want mip %u, expected %u\n", kPixels[i], scheduler.GetWantedMip(id), kMips[i]);
+                for (const Request& request : requests)
+                    scheduler.CompleteRequest(request.texture, true);
+                requests.clear();
+            }
+        }
+
+        std::mt19937 rng(5);
+        const uint32_t kSizes[] = { 4096, 2048, 2048, 1024, 1024, 1024, 512, 512, 256, 128, 64 };
+        const uint64_t kMB = 1 << 20;
+        const uint64_t kBudgets[] = { 4 * kMB, 24 * kMB, 64 * kMB, 1024 * kMB };
+
+        for (uint64_t budget : kBudgets)
+        {
+            const uint32_t kMaxPending = 3;
+            const uint32_t kLatency = 3;   // Frames a request takes
+
+            Scheduler scheduler;
+            scheduler.SetBudget(budget);
+            scheduler.SetMaxPendingRequests(kMaxPending);
+            scheduler.SetRetentionFrames(10);
+
+            std::vector<uint32_t> ids, sizes;
+            uint64_t tailBytes = 0, fullBytes = 0;
+            for (int i = 0; i < 60; ++i)
+            {
+                uint32_t size = kSizes[rng() % (sizeof(kSizes) / sizeof(kSizes[0]))];
+                std::vector<uint64_t> mips = MipBytes(size);
+                uint32_t tail = TailMip(size);
+                ids.push_back(scheduler.AddTexture(size, size, mips, tail));
+                sizes.push_back(size);
+                for (uint32_t m = 0; m < mips.size(); ++m)
+                {
+                    fullBytes += mips[m];
+                    if (m >= tail)
+                        tailBytes += mips[m];
+                }
+            }
+
+            struct InFlight { Request request; uint32_t frame; };
+            std::vector<InFlight> inFlight;
+            std::vector<Request> requests;
+            uint32_t requestCount = 0;
+
+            // The camera looks at a window of the textures that moves along every 40 frames.
+            for (uint32_t frame = 0; frame < 400; ++frame)
+            {
+                uint32_t first = frame / 40 * 6 % (uint32_t)ids.size();
+                for (uint32_t i = 0; i < 12; ++i)
+                {
+                    uint32_t t = (first + i) % (uint32_t)ids.size();
+                    scheduler.ReportUsage(ids[t], (float)(sizes[t] >> (i % 3)));
+                }
+
+                for (size_t i = 0; i < inFlight.size(); )
+                {
+                    if (frame - inFlight[i].frame >= kLatency)
+                    {
+                        const Request& request = inFlight[i].request;
+                        if (scheduler.GetResidentMip(request.texture) == request.firstMip)
+                            check.Fail("request for the mip texture %u already has\n", request.texture);
+                        scheduler.CompleteRequest(request.texture, true);
+                        inFlight.erase(inFlight.begin() + i);
+                    }
+                    else
+                        ++i;
+                }
+
+                requests.clear();
+                scheduler.Update(requests);
+                requestCount += (uint32_t)requests.size();
+                for (const Request& request : requests)
+                    inFlight.push_back({ request, frame });
+
+                if (scheduler.GetPendingRequestCount() > kMaxPending || inFlight.size() > kMaxPending)
+                    check.Fail("%u requests pending, the limit is %u\n", scheduler.GetPendingRequestCount(), kMaxPending);
+                if (scheduler.GetPlannedBytes() > std::max(budget, tailBytes))
+                    check.Fail("%llu bytes planned over a budget of %llu\n", scheduler.GetPlannedBytes(), budget);
+
+                for (uint32_t id : ids)
+                {
+                    if (scheduler.GetResidentMip(id) > TailMip(sizes[id]))
+                        check.Fail("texture %u lost its tail\n", id);
+                }
+            }
+
+            // Settle, then every visible texture should have what it wants if the budget holds it.
+            for (uint32_t frame = 400; frame < 440; ++frame)
+            {
+                uint32_t first = 399 / 40 * 6 % (uint32_t)ids.size();
+                for (uint32_t i = 0; i < 12; ++i)
+                {
+                    uint32_t t = (first + i) % (uint32_t)ids.size();
+                    scheduler.ReportUsage(ids[t], (float)(sizes[t] >> (i % 3)));
+                }
+                for (const InFlight& f : inFlight)
+                    scheduler.CompleteRequest(f.request.texture, true);
+                inFlight.clear();
+                requests.clear();
+                scheduler.Update(requests);
+                for (const Request& request : requests)
+                    inFlight.push_back({ request, frame });
+            }
+
+            uint64_t visibleBytes = 0;
+            bool visibleServed = true;
+            {
+                uint32_t first = 399 / 40 * 6 % (uint32_t)ids.size();
+                for (uint32_t i = 0; i < 12; ++i)
+                {
+                    uint32_t t = (first + i) % (uint32_t)ids.size();
+                    std::vector<uint64_t> mips = MipBytes(sizes[t]);
+                    for (uint32_t m = scheduler.GetWantedMip(ids[t]); m < mips.size(); ++m)
+                        visibleBytes += mips[m];
+                    visibleServed &= scheduler.GetResidentMip(ids[t]) == scheduler.GetWantedMip(ids[t]);
+                }
+            }
+            if (visibleBytes + tailBytes <= budget && !visibleServed)
+                check.Fail("%llu MB budget, visible textures don't have their mips\n", (unsigned long long)(budget / kMB));
+
+            std::printf("TextureStreaming: %4llu MB budget, %u requests, %llu MB resident of %llu MB (tails %.1f MB)\n",
+                (unsigned long long)(budget / kMB), requestCount, (unsigned long long)(scheduler.GetResidentBytes() / kMB),
+                (unsigned long long)(fullBytes / kMB), (double)tailBytes / kMB);
+        }
+
+        // With one request at a time, the texture short of the most pixels goes first, and it isn't starved by a
+        // bigger texture that is already closer to what it needs.
+        {
+            Scheduler scheduler;
+            scheduler.SetMaxPendingRequests(1);
+            uint32_t small = scheduler.AddTexture(512, 512, MipBytes(512), TailMip(512));
+            uint32_t large = scheduler.AddTexture(2048, 2048, MipBytes(2048), TailMip(2048));
+            std::vector<Request> requests;
+            scheduler.ReportUsage(small, 100.0f);
+            scheduler.ReportUsage(large, 2048.0f);
+            scheduler.Update(requests);
+            if (requests.size() != 1 || requests[0].texture != large || requests[0].firstMip != 0)
+                check.Fail("the largest shortfall wasn't served first\n");
+        }
+
+        // A texture removed while its request is pending keeps its id until the request completes.
+        {
+            Scheduler scheduler;
+            uint32_t a = scheduler.AddTexture(1024, 1024, MipBytes(1024), TailMip(1024));
+            std::vector<Request> requests;
+            scheduler.ReportUsage(a, 1024.0f);
+            scheduler.Update(requests);
+            scheduler.RemoveTexture(a);
+            uint32_t b = scheduler.AddTexture(512, 512, MipBytes(512), TailMip(512));
+            if (b == a)
+                check.Fail("id %u reused while a request for it was pending\n", a);
+            scheduler.CompleteRequest(a, true);
+            if (scheduler.AddTexture(256, 256, MipBytes(256), TailMip(256)) != a)
+                check.Fail("id %u not reused after its request completed\n", a);
+        }
+
+        return check.Finish();
+    }
+
+    Registration s_Registration("TextureStreaming", Run);
+}
@@ -0,0 +1,241 @@
+#include "Check.h"
+#include "../ModelConverter/VertexWeld.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace VertexWeld;
+using namespace Tests;
+
+namespace
+{
+    // The key Weld compares for one word of a vertex: float words snapped to a multiple of epsilon, everything else
+    // as raw bits. A partial last word is zero-padded.
+    uint32_t ReferenceWord(const uint8_t* vertex, uint32_t stride, uint32_t word, const Options& options)
+    {
+        uint32_t bits = 0;
+        std::memcpy(&bits, vertex + word * 4, std::min(stride - word * 4, 4u));
+        if (options.epsilon <= 0.0f || word * 4 + 4 > stride || word >= 64 || (options.floatWordMask >> word & 1) == 0)
+            return bits;
+
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        const float cell = std::floor(value * (1.0f / options.epsilon) + 0.5f);
+        return std::fabs(cell) < 2147483648.0f ? (uint32_t)(int32_t)cell : bits;
+    }
+
+    bool ReferenceEqual(const uint8_t* a, const uint8_t* b, uint32_t stride, const Options& options)
+    {
+        for (uint32_t word = 0; word < (stride + 3) / 4; ++word)
+        {
+            if (ReferenceWord(a, stride, word, options) != ReferenceWord(b, stride, word, options))
+                return false;
+        }
+        return true;
+    }
+
+    // Welds by comparing every vertex with every distinct one before it.
+    uint32_t ReferenceWeld(const uint8_t* vertices, uint32_t vertexCount, uint32_t stride, const Options& options,
+        std::vector<uint32_t>& firstInstance, std::vector<uint32_t>& remap)
+    {
+        firstInstance.clear();
+        remap.resize(vertexCount);
+        for (uint32_t v = 0; v < vertexCount; ++v)
+        {
+            uint32_t match = 0;
+            while (match < firstInstance.size() &&
+                !ReferenceEqual(vertices + (size_t)firstInstance[match] * stride, vertices + (size_t)v * stride, stride, options))
+                ++match;
+            if (match == firstInstance.size())
+                firstInstance.push_back(v);
+            remap[v] = match;
+        }
+        return (uint32_t)firstInstance.size();
+    }
+
+    // Welds vertices and checks the count, the remap and the copied vertices against the brute-force reference.
+    void CheckWeld(Check& check, const char* label, const std::vector<uint8_t>& vertices, uint32_t stride,
+        const Options& options, uint32_t* uniqueCount = nullptr)
+    {
+        const uint32_t vertexCount = (uint32_t)(vertices.size() / stride);
+        std::vector<uint8_t> welded(vertices.size());
+        std::vector<uint32_t> remap(vertexCount, 0xFFFFFFFF);
+        const uint32_t count = Weld(vertices.data(), vertexCount, stride, welded.data(), remap.data(), options);
+
+        std::vector<uint32_t> expectedFirst, expectedRemap;
+        const uint32_t expectedCount = ReferenceWeld(vertices.data(), vertexCount, stride, options, expectedFirst, expectedRemap);
+        if (uniqueCount != nullptr)
+            *uniqueCount = count;
+
+        if (count != expectedCount)
+        {
+            check.Fail("%s, stride %u: %u distinct vertices, expected %u\n", label, stride, count, expectedCount);
+            return;
+        }
+        for (uint32_t v = 0; v < vertexCount; ++v)
+        {
+            if (remap[v] != expectedRemap[v])
+            {
+                check.Fail("%s, stride %u: vertex %u maps to %u, expected %u\n", label, stride, v, remap[v], expectedRemap[v]);
+                return;
+            }
+        }
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            if (std::memcmp(welded.data() + (size_t)i * stride, vertices.data() + (size_t)expectedFirst[i] * stride, stride) != 0)
+            {
+                check.Fail("%s, stride %u: welded vertex %u isn't a copy of vertex %u\n", label, stride, i, expectedFirst[i]);
+                return;
+            }
+        }
+    }
+
+    // Welds generated vertex streams with duplicates, near-duplicates and strides that aren't whole words, and checks
+    // every result against a brute-force weld, then remaps 16- and 32-bit index lists.
+    bool Run(void)
+    {
+        Check check("VertexWeld");
+
+        std::mt19937 rng(11);
+        const uint32_t kStrides[] = { 1, 4, 6, 12, 13, 22, 32, 39 };
+        const float kEpsilon = 1.0f / 64.0f;
+
+        for (uint32_t stride : kStrides)
+        {
+            // Vertices drawn from a small pool of prototypes, so most of them are exact duplicates. Float words hold
+            // multiples of epsilon; the other words hold small integers whose bits are denormal floats.
+            const uint32_t words = stride / 4;
+            const uint64_t floatWordMask = words == 0 ? 0 : 0x5555555555555555ull & ((1ull << words) - 1);
+            std::vector<std::vector<uint8_t>> prototypes(40, std::vector<uint8_t>(stride));
+            for (std::vector<uint8_t>& prototype : prototypes)
+            {
+                for (uint32_t word = 0; word < words; ++word)
+                {
+                    uint32_t bits = rng() % 5;
+                    if (floatWordMask >> word & 1)
+                    {
+                        const float value = (float)((int)(rng() % 33) - 16) * kEpsilon;
+                        std::memcpy(&bits, &value, sizeof(bits));
+                    }
+                    std::memcpy(prototype.data() + word * 4, &bits, sizeof(bits));
+                }
+                for (uint32_t b = words * 4; b < stride; ++b)
+                    prototype[b] = (uint8_t)(rng() % 3);
+            }
+
+            std::vector<uint8_t> vertices;
+            std::vector<uint8_t> jittered;
+            for (uint32_t v = 0; v < 500; ++v)
+            {
+                const std::vector<uint8_t>& prototype = prototypes[rng() % prototypes.size()];
+                vertices.insert(vertices.end(), prototype.begin(), prototype.end());
+
+                // The same vertex with its float words moved by well under half of epsilon, so it stays in its cell.
+                std::vector<uint8_t> nearby = prototype;
+                for (uint32_t word = 0; word < words; ++word)
+                {
+                    if ((floatWordMask >> word & 1) == 0)
+                        continue;
+                    float value;
+                    std::memcpy(&value, nearby.data() + word * 4, sizeof(value));
+                    value += ((float)(rng() % 1001) / 1000.0f - 0.5f) * 0.4f * kEpsilon;
+                    std::memcpy(nearby.data() + word * 4, &value, sizeof(value));
+                }
+                jittered.insert(jittered.end(), nearby.begin(), nearby.end());
+            }
+
+            // Exact welding finds the duplicates and nothing else.
+            uint32_t exactCount = 0;
+            CheckWeld(check, "exact", vertices, stride, Options(), &exactCount);
+            if (exactCount > prototypes.size())
+                check.Fail("exact, stride %u: %u distinct vertices from %zu prototypes\n", stride, exactCount, prototypes.size());
+
+            // With an epsilon, the jittered copies weld back down to the prototypes.
+            Options options;
+            options.epsilon = kEpsilon;
+            options.floatWordMask = floatWordMask;
+            uint32_t jitteredCount = 0;
+            CheckWeld(check, "epsilon", jittered, stride, options, &jitteredCount);
+            if (jitteredCount != exactCount)
+                check.Fail("epsilon, stride %u: %u distinct jittered vertices, %u without jitter\n", stride, jitteredCount, exactCount);
+
+            // Without the mask, or without the epsilon, the jitter keeps them apart.
+            if (floatWordMask != 0)
+            {
+                CheckWeld(check, "exact jittered", jittered, stride, Options());
+                Options unmasked = options;
+                unmasked.floatWordMask = 0;
+                CheckWeld(check, "epsilon unmasked", jittered, stride, unmasked);
+            }
+        }
+
+        // Near-equal words outside the mask are compared bit for bit: denormal-looking integers 1 and 2 would both
+        // snap to zero if they were treated as floats, and so would 1.0f and the float just above it.
+        {
+            const uint32_t stride = 12;
+            const float one = 1.0f, nextOne = std::nextafter(1.0f, 2.0f);
+            std::vector<uint8_t> vertices(4 * stride, 0);
+            const uint32_t one32 = 1, two32 = 2;
+            std::memcpy(&vertices[0 * stride + 4], &one32, 4);
+            std::memcpy(&vertices[1 * stride + 4], &two32, 4);
+            std::memcpy(&vertices[2 * stride + 8], &one, 4);
+            std::memcpy(&vertices[3 * stride + 8], &nextOne, 4);
+
+            Options options;
+            options.epsilon = 0.5f;
+            options.floatWordMask = 1;
+            std::vector<uint8_t> welded(vertices.size());
+            uint32_t remap[4];
+            const uint32_t count = Weld(vertices.data(), 4, stride, welded.data(), remap, options);
+            if (count != 4)
+                check.Fail("non-float words: %u distinct vertices, expected 4\n", count);
+
+            // Marking the last word as a float lets 1.0f and its neighbor merge.
+            options.floatWordMask = 1 | 4;
+            if (Weld(vertices.data(), 4, stride, welded.data(), remap, options) != 3 || remap[3] != remap[2])
+                check.Fail("float words: the floats next to 1.0f didn't merge\n");
+        }
+
+        // 32-bit indices past 65535 keep their high bits, and 16-bit ones remap the same way.
+        {
+            const uint32_t distinct = 70000, stride = 4;
+            std::vector<uint8_t> vertices((size_t)distinct * 2 * stride);
+            for (uint32_t v = 0; v < distinct * 2; ++v)
+            {
+                const uint32_t value = v % distinct;
+                std::memcpy(&vertices[(size_t)v * stride], &value, sizeof(value));
+            }
+            std::vector<uint8_t> welded(vertices.size());
+            std::vector<uint32_t> remap(distinct * 2);
+            const uint32_t count = Weld(vertices.data(), distinct * 2, stride, welded.data(), remap.data());
+            if (count != distinct)
+                check.Fail("index remap: %u distinct vertices, expected %u\n", count, distinct);
+
+            std::vector<uint32_t> indices(30000);
+            for (uint32_t& index : indices)
+                index = rng() % (distinct * 2);
+            std::vector<uint32_t> remapped = indices;
+            RemapIndices(remapped.data(), remapped.size(), remap.data());
+            for (size_t i = 0; i < indices.size(); ++i)
+            {
+                if (remapped[i] != indices[i] % distinct)
+                {
+                    check.Fail("32-bit index %zu: %u remapped to %u, expected %u\n", i, indices[i], remapped[i], indices[i] % distinct);
+                    break;
+                }
+            }
+
+            std::vector<uint16_t> shortIndices = { 0, 1, 2, 2, 1, 0 };
+            const uint32_t shortRemap[] = { 0, 1, 0 };
+            RemapIndices(shortIndices.data(), shortIndices.size(), shortRemap);
+            if (shortIndices != std::vector<uint16_t>({ 0, 1, 0, 0, 1, 0 }))
+                check.Fail("16-bit indices didn't remap\n");
+        }
+
+        return check.Finish();
+    }
+
+    Registration s_Registration("VertexWeld", Run);
+}